@@ -47,5 +47,18 @@ VOID DispatchCleanup(PDOKAN_IO_EVENT IoEvent) {
         &IoEvent->DokanFileInfo);
   }
 
+  if (IoEvent->DokanFileInfo.DeletePending) {
+    LPCWSTR fileName = IoEvent->EventContext->Operation.Cleanup.FileName;
+    if (IoEvent->DokanInstance->DirectoryListCache) {
+      DokanDirectoryListCache_Invalidate(
+          IoEvent->DokanInstance->DirectoryListCache, fileName,
+          wcslen(fileName));
+    }
+    if (IoEvent->DokanInstance->FileInfoCache) {
+      DokanFileInfoCache_InvalidateTree(IoEvent->DokanInstance->FileInfoCache,
+                                        fileName, wcslen(fileName));
+    }
+  }
+
   EventCompletion(IoEvent);
 }
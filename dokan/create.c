@@ -22,6 +22,8 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokani.h"
 #include "dokan_pool.h"
+#include "dokan_read_ahead.h"
+#include "dokan_write_coalescer.h"
 
 #include <assert.h>
 
@@ -126,7 +128,7 @@ VOID DispatchCreate(PDOKAN_IO_EVENT IoEvent) {
 
   assert(IoEvent->DokanOpenInfo == NULL);
 
-  IoEvent->DokanOpenInfo = PopFileOpenInfo();
+  IoEvent->DokanOpenInfo = PopFileOpenInfo(IoEvent->DokanInstance->ObjectPools);
   IoEvent->DokanOpenInfo->OpenCount = 1;
   IoEvent->DokanOpenInfo->EventContext = IoEvent->EventContext;
   IoEvent->DokanOpenInfo->DokanInstance = IoEvent->DokanInstance;
@@ -144,6 +146,14 @@ VOID DispatchCreate(PDOKAN_IO_EVENT IoEvent) {
 
   origOptions = options;
 
+  // The writes other opens of the file buffered land before it is truncated.
+  if (IoEvent->DokanInstance->WriteCoalescer &&
+      (disposition == FILE_SUPERSEDE || disposition == FILE_OVERWRITE ||
+       disposition == FILE_OVERWRITE_IF)) {
+    DokanWriteCoalescer_FlushFile(IoEvent->DokanInstance->WriteCoalescer,
+                                  fileName);
+  }
+
   // to open directory
   // even if this flag is not specified,
   // there is a case to open a directory
@@ -235,6 +245,7 @@ VOID DispatchCreate(PDOKAN_IO_EVENT IoEvent) {
   // save the information about this access in DOKAN_OPEN_INFO
   IoEvent->DokanOpenInfo->IsDirectory = IoEvent->DokanFileInfo.IsDirectory;
   IoEvent->DokanOpenInfo->UserContext = IoEvent->DokanFileInfo.Context;
+  UpdateOpenInfoFileName(IoEvent, fileName);
 
   if (!CreateSuccesStatusCheck(status, disposition)) {
     if (IoEvent->EventContext->Flags & SL_OPEN_TARGET_DIRECTORY) {
@@ -287,11 +298,13 @@ VOID DispatchCreate(PDOKAN_IO_EVENT IoEvent) {
         IoEvent->EventResult->Operation.Create.Information = FILE_OPENED;
       } else {
         DbgPrint("Parent CreateFile failed status = %lx\n", status);
-        PushFileOpenInfo(IoEvent->DokanOpenInfo);
+        PushFileOpenInfo(IoEvent->DokanInstance->ObjectPools,
+                         IoEvent->DokanOpenInfo);
         IoEvent->DokanOpenInfo = NULL;
       }
     } else {
-      PushFileOpenInfo(IoEvent->DokanOpenInfo);
+      PushFileOpenInfo(IoEvent->DokanInstance->ObjectPools,
+                       IoEvent->DokanOpenInfo);
       IoEvent->DokanOpenInfo = NULL;
     }
 
@@ -321,6 +334,25 @@ VOID DispatchCreate(PDOKAN_IO_EVENT IoEvent) {
 
     if (IoEvent->DokanFileInfo.IsDirectory)
       IoEvent->EventResult->Operation.Create.Flags |= DOKAN_FILE_DIRECTORY;
+
+    // A new or truncated entry makes the cached listing of its parent stale
+    if (IoEvent->EventResult->Operation.Create.Information != FILE_OPENED) {
+      if (IoEvent->DokanInstance->DirectoryListCache) {
+        DokanDirectoryListCache_Invalidate(
+            IoEvent->DokanInstance->DirectoryListCache, fileName,
+            wcslen(fileName));
+      }
+      if (IoEvent->DokanInstance->FileInfoCache) {
+        DokanFileInfoCache_InvalidateFile(IoEvent->DokanInstance->FileInfoCache,
+                                          fileName, wcslen(fileName),
+                                          /*IncludeParent=*/TRUE);
+      }
+      if (IoEvent->DokanInstance->ReadAhead) {
+        DokanReadAhead_Invalidate(IoEvent->DokanInstance->ReadAhead, fileName,
+                                  wcslen(fileName),
+                                  /*IncludeChildren=*/FALSE);
+      }
+    }
   }
 
   if (origFileName)
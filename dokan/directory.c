@@ -24,26 +24,10 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "fileinfo.h"
 #include "list.h"
 #include "dokan_pool.h"
+#include "dokan_pattern.h"
 
 #include <assert.h>
 
-/**
-* \struct DOKAN_FIND_DATA
-* \brief Dokan find file list
-*
-* Used by FindFiles
-*/
-typedef struct _DOKAN_FIND_DATA {
-  /**
-  * File data information link
-  */
-  WIN32_FIND_DATAW FindData;
-  /**
-  * Current list entry informations
-  */
-  LIST_ENTRY ListEntry;
-} DOKAN_FIND_DATA, *PDOKAN_FIND_DATA;
-
 VOID DokanFillDirInfo(PFILE_DIRECTORY_INFORMATION Buffer,
                       PWIN32_FIND_DATAW FindData, ULONG Index,
                       PDOKAN_INSTANCE DokanInstance) {
@@ -371,25 +355,152 @@ DokanFillDirectoryInformation(FILE_INFORMATION_CLASS DirectoryInfo,
   return thisEntrySize;
 }
 
+/**
+ * \struct DOKAN_FIND_FILES_STREAM
+ * \brief State of a streamed directory query
+ *
+ * Used as ProcessingContext by FindFiles when DOKAN_OPTION_STREAM_FIND_FILES
+ * is enabled. Entries are written to the reply buffer as they are reported.
+ */
+typedef struct _DOKAN_FIND_FILES_STREAM {
+  PDOKAN_IO_EVENT IoEvent;
+  PVOID CurrentBuffer;
+  PVOID LastBuffer;
+  ULONG LengthRemaining;
+  /**
+   * Position of the next reported entry, counting every entry reported and
+   * the generated "." and "..". It is the FileIndex kept by the driver.
+   */
+  ULONG Index;
+  /** FileIndex of the query, the position of the first entry to return */
+  ULONG StartIndex;
+  /** Entries generated by the library before the ones of the file system */
+  ULONG GeneratedEntryCount;
+  /** Whether the file system started its enumeration at StartIndex */
+  BOOL Resumed;
+  /** Number of entries written to the reply */
+  ULONG EntryCount;
+  /** Whether entries have to be filtered with Pattern */
+  BOOL PatternCheck;
+  BOOL PatternCompiled;
+  DOKAN_PATTERN Pattern;
+  PWCHAR SearchPattern;
+  /** Whether "." and ".." were generated and must be skipped */
+  BOOL SkipDotEntries;
+  /** Whether the reply cannot take more entries */
+  BOOL BufferFull;
+  /** Whether the first entry to return did not fit in the reply */
+  BOOL BufferOverflow;
+} DOKAN_FIND_FILES_STREAM, *PDOKAN_FIND_FILES_STREAM;
+
+// Writes the entry to the reply when it matches and comes after the
+// requested FileIndex. Returns 1 once the reply is full.
+int StreamFileData(PDOKAN_FIND_FILES_STREAM Stream,
+                   PWIN32_FIND_DATAW FindData) {
+  PDOKAN_IO_EVENT ioEvent = Stream->IoEvent;
+  ULONG position;
+  ULONG entrySize;
+
+  if (Stream->BufferFull) {
+    return 1;
+  }
+  // Positions count the entries filtered out below so that the file system
+  // can resume at one, see DokanGetFindFilesStartIndex.
+  position = Stream->Index++;
+  if (position < Stream->StartIndex) {
+    return 0;
+  }
+  if (Stream->SkipDotEntries && (wcscmp(FindData->cFileName, L".") == 0 ||
+                                 wcscmp(FindData->cFileName, L"..") == 0)) {
+    return 0;
+  }
+  if (Stream->PatternCheck &&
+      !(Stream->PatternCompiled
+            ? DokanPattern_Match(&Stream->Pattern, FindData->cFileName)
+            : DokanIsNameInExpression(
+                  Stream->SearchPattern, FindData->cFileName,
+                  !(ioEvent->DokanInstance->DokanOptions->Options &
+                    DOKAN_OPTION_CASE_SENSITIVE)))) {
+    return 0;
+  }
+
+  // index+1 is very important, should use next entry index
+  entrySize = DokanFillDirectoryInformation(
+      ioEvent->EventContext->Operation.Directory.FileInformationClass,
+      Stream->CurrentBuffer, &Stream->LengthRemaining, FindData,
+      position + 1, ioEvent->DokanInstance);
+  if (entrySize == 0) {
+    // The next query starts with this entry.
+    Stream->Index = position;
+    Stream->BufferFull = TRUE;
+    Stream->BufferOverflow = Stream->EntryCount == 0;
+    return 1;
+  }
+  Stream->LastBuffer = Stream->CurrentBuffer;
+  ++Stream->EntryCount;
+  if (ioEvent->EventContext->Flags & SL_RETURN_SINGLE_ENTRY) {
+    Stream->BufferFull = TRUE;
+    return 1;
+  }
+  ((PFILE_BOTH_DIR_INFORMATION)Stream->CurrentBuffer)->NextEntryOffset =
+      entrySize;
+  Stream->CurrentBuffer = (PCHAR)Stream->CurrentBuffer + entrySize;
+  return 0;
+}
+
+ULONG DOKANAPI DokanGetFindFilesStartIndex(PDOKAN_FILE_INFO DokanFileInfo) {
+  PDOKAN_FIND_FILES_STREAM stream;
+  if (!(DokanFileInfo->DokanOptions->Options &
+        DOKAN_OPTION_STREAM_FIND_FILES) ||
+      !DokanFileInfo->ProcessingContext) {
+    return 0;
+  }
+  stream = (PDOKAN_FIND_FILES_STREAM)DokanFileInfo->ProcessingContext;
+  if (!stream->Resumed) {
+    // The entries reported from now on start at the requested position.
+    stream->Resumed = TRUE;
+    stream->Index = max(stream->Index, stream->StartIndex);
+  }
+  return stream->StartIndex > stream->GeneratedEntryCount
+             ? stream->StartIndex - stream->GeneratedEntryCount
+             : 0;
+}
+
 int WINAPI DokanFillFileData(PWIN32_FIND_DATAW FindData,
                              PDOKAN_FILE_INFO FileInfo) {
   assert(FileInfo->ProcessingContext);
-  PDOKAN_VECTOR dirList = (PDOKAN_VECTOR )FileInfo->ProcessingContext;
-  DokanVector_PushBack(dirList, FindData);
+  if (FileInfo->DokanOptions->Options & DOKAN_OPTION_STREAM_FIND_FILES) {
+    return StreamFileData(
+        (PDOKAN_FIND_FILES_STREAM)FileInfo->ProcessingContext, FindData);
+  }
+  PDOKAN_DIRECTORY_LIST dirList =
+      (PDOKAN_DIRECTORY_LIST)FileInfo->ProcessingContext;
+  DokanDirectoryList_PushBack(dirList, FindData);
   return 0;
 }
 
 // add entry which matches the pattern specifed in EventContext
 // to the buffer specifed in EventInfo
 //
-LONG MatchFiles(PDOKAN_IO_EVENT IoEvent, PDOKAN_VECTOR DirList) {
+// Cursor holds where the previous call stopped in DirList. When the requested
+// FileIndex is at or after it, matching resumes from there instead of from
+// the first entry. The cursor is updated to the position following the last
+// entry returned.
+//
+LONG MatchFiles(PDOKAN_IO_EVENT IoEvent, PDOKAN_DIRECTORY_LIST DirList,
+                PDOKAN_DIRECTORY_CURSOR Cursor) {
   ULONG lengthRemaining =
       IoEvent->EventContext->Operation.Directory.BufferLength;
   PVOID currentBuffer = IoEvent->EventResult->Buffer;
   PVOID lastBuffer = currentBuffer;
+  ULONG fileIndex = IoEvent->EventContext->Operation.Directory.FileIndex;
   ULONG index = 0;
+  size_t i = 0;
+  size_t count = DokanDirectoryList_GetCount(DirList);
   BOOL patternCheck = FALSE;
   PWCHAR pattern = NULL;
+  DOKAN_PATTERN compiledPattern;
+  BOOL patternCompiled = FALSE;
   BOOL bufferOverFlow = FALSE;
   BOOL caseSensitive = IoEvent->DokanInstance->DokanOptions->Options &
                        DOKAN_OPTION_CASE_SENSITIVE;
@@ -405,23 +516,35 @@ LONG MatchFiles(PDOKAN_IO_EVENT IoEvent, PDOKAN_VECTOR DirList) {
       (!IoEvent->DokanInstance->DokanOperations->FindFilesWithPattern ||
        IoEvent->DokanOpenInfo->UnimplementedFindFilesWithPattern)) {
     patternCheck = TRUE;
+    // Compile the pattern once instead of interpreting it for every entry
+    patternCompiled =
+        DokanPattern_Compile(&compiledPattern, pattern, !caseSensitive);
+  }
+
+  // Resume from the last position when the query continues after it
+  if (Cursor->Index <= fileIndex && Cursor->Position <= count) {
+    index = Cursor->Index;
+    i = Cursor->Position;
   }
 
-  for (size_t i = 0; i < DokanVector_GetCount(DirList); ++i) {
-    PDOKAN_FIND_DATA find = (PDOKAN_FIND_DATA)DokanVector_GetItem(DirList, i);
-    DbgPrintW(L"FileMatch? : %s (%s,%d,%d)\n", find->FindData.cFileName,
-              (pattern ? pattern : L"null"),
-              IoEvent->EventContext->Operation.Directory.FileIndex, index);
+  for (; i < count; ++i) {
+    PDOKAN_DIRECTORY_ENTRY entry = DokanDirectoryList_GetEntry(DirList, i);
+    DbgPrintW(L"FileMatch? : %s (%s,%d,%d)\n", entry->FileName,
+              (pattern ? pattern : L"null"), fileIndex, index);
 
     // pattern is not specified or pattern match is ignore cases
     if (!patternCheck ||
-        DokanIsNameInExpression(pattern, find->FindData.cFileName,
-                                !caseSensitive)) {
-      if (IoEvent->EventContext->Operation.Directory.FileIndex <= index) {
+        (patternCompiled
+             ? DokanPattern_Match(&compiledPattern, entry->FileName)
+             : DokanIsNameInExpression(pattern, entry->FileName,
+                                       !caseSensitive))) {
+      if (fileIndex <= index) {
+        WIN32_FIND_DATAW findData;
+        DokanDirectoryList_GetFindData(entry, &findData);
         // index+1 is very important, should use next entry index
         ULONG entrySize = DokanFillDirectoryInformation(
             IoEvent->EventContext->Operation.Directory.FileInformationClass,
-            currentBuffer, &lengthRemaining, &find->FindData, index + 1,
+            currentBuffer, &lengthRemaining, &findData, index + 1,
             IoEvent->DokanInstance);
         // buffer is full
         if (entrySize == 0) {
@@ -435,6 +558,7 @@ LONG MatchFiles(PDOKAN_IO_EVENT IoEvent, PDOKAN_VECTOR DirList) {
 
           DbgPrint("  =>return single entry\n");
           index++;
+          i++;
           break;
         }
         DbgPrint("  =>return\n");
@@ -448,13 +572,19 @@ LONG MatchFiles(PDOKAN_IO_EVENT IoEvent, PDOKAN_VECTOR DirList) {
     }
   }
 
+  Cursor->Index = index;
+  Cursor->Position = i;
+  if (patternCompiled) {
+    DokanPattern_Free(&compiledPattern);
+  }
+
   // Since next of the last entry doesn't exist, clear next offset
   ((PFILE_BOTH_DIR_INFORMATION)lastBuffer)->NextEntryOffset = 0;
   // acctualy used length of buffer
   IoEvent->EventResult->BufferLength =
       IoEvent->EventContext->Operation.Directory.BufferLength -
       lengthRemaining;
-  if (index <= IoEvent->EventContext->Operation.Directory.FileIndex) {
+  if (index <= fileIndex) {
     if (bufferOverFlow)
       return -2; // BUFFER_OVERFLOW
     return -1;   // NO_MORE_FILES
@@ -467,7 +597,8 @@ VOID AddMissingCurrentAndParentFolder(PDOKAN_IO_EVENT IoEvent) {
   BOOLEAN currentFolder = FALSE, parentFolder = FALSE;
   WIN32_FIND_DATAW findData;
   FILETIME systime;
-  PDOKAN_VECTOR dirList = (PDOKAN_VECTOR)IoEvent->DokanFileInfo.ProcessingContext;
+  PDOKAN_DIRECTORY_LIST dirList =
+      (PDOKAN_DIRECTORY_LIST)IoEvent->DokanFileInfo.ProcessingContext;
 
   assert(dirList);
   if (IoEvent->EventContext->Operation.Directory.SearchPatternLength != 0) {
@@ -484,14 +615,15 @@ VOID AddMissingCurrentAndParentFolder(PDOKAN_IO_EVENT IoEvent) {
   }
 
   for (size_t i = 0;
-       (!currentFolder || !parentFolder) && i < DokanVector_GetCount(dirList);
+       (!currentFolder || !parentFolder) &&
+       i < DokanDirectoryList_GetCount(dirList);
        ++i) {
-    PDOKAN_FIND_DATA find = (PDOKAN_FIND_DATA)DokanVector_GetItem(dirList, i);
-    if (wcscmp(find->FindData.cFileName, L".") == 0) {
+    PDOKAN_DIRECTORY_ENTRY entry = DokanDirectoryList_GetEntry(dirList, i);
+    if (wcscmp(entry->FileName, L".") == 0) {
       currentFolder = TRUE;
     }
 
-    if (wcscmp(find->FindData.cFileName, L"..") == 0) {
+    if (wcscmp(entry->FileName, L"..") == 0) {
       parentFolder = TRUE;
     }
   }
@@ -508,22 +640,23 @@ VOID AddMissingCurrentAndParentFolder(PDOKAN_IO_EVENT IoEvent) {
       findData.cFileName[0] = '.';
       findData.cFileName[1] = '.';
       // NULL written during ZeroMemory()
-      DokanVector_PushFront(dirList, &findData);
+      DokanDirectoryList_PushFront(dirList, &findData);
     }
     if (!currentFolder) {
       findData.cFileName[0] = '.';
       findData.cFileName[1] = '\0';
-      DokanVector_PushFront(dirList, &findData);
+      DokanDirectoryList_PushFront(dirList, &findData);
     }
   }
 }
 
 NTSTATUS WriteDirectoryResults(PDOKAN_IO_EVENT EventInfo,
-                               PDOKAN_VECTOR dirList) {
+                               PDOKAN_DIRECTORY_LIST dirList,
+                               PDOKAN_DIRECTORY_CURSOR Cursor) {
   // If this function is called then so far everything should be good
   assert(EventInfo->EventResult->Status == STATUS_SUCCESS);
   // Write the file info to the output buffer
-  int index = MatchFiles(EventInfo, dirList);
+  int index = MatchFiles(EventInfo, dirList, Cursor);
   DbgPrint("WriteDirectoryResults() New directory index is %d.\n", index);
   // there is no matched file
   if (index < 0) {
@@ -550,9 +683,10 @@ NTSTATUS WriteDirectoryResults(PDOKAN_IO_EVENT EventInfo,
 }
 
 VOID EndFindFilesCommon(PDOKAN_IO_EVENT IoEvent, NTSTATUS Status) {
-  PDOKAN_VECTOR dirList =
-      (PDOKAN_VECTOR)IoEvent->DokanFileInfo.ProcessingContext;
-  PDOKAN_VECTOR oldDirList = NULL;
+  PDOKAN_DIRECTORY_LIST dirList =
+      (PDOKAN_DIRECTORY_LIST)IoEvent->DokanFileInfo.ProcessingContext;
+  PDOKAN_DIRECTORY_LIST oldDirList = NULL;
+  DOKAN_DIRECTORY_CURSOR cursor = {0, 0};
 
   assert(IoEvent->EventResult->BufferLength == 0);
   assert(IoEvent->DokanFileInfo.ProcessingContext);
@@ -566,12 +700,13 @@ VOID EndFindFilesCommon(PDOKAN_IO_EVENT IoEvent, NTSTATUS Status) {
 
   if (Status == STATUS_SUCCESS) {
     AddMissingCurrentAndParentFolder(IoEvent);
-    Status = WriteDirectoryResults(IoEvent, dirList);
+    Status = WriteDirectoryResults(IoEvent, dirList, &cursor);
     EnterCriticalSection(&IoEvent->DokanOpenInfo->CriticalSection);
     {
       if (IoEvent->DokanOpenInfo->DirList != dirList) {
         oldDirList = IoEvent->DokanOpenInfo->DirList;
         IoEvent->DokanOpenInfo->DirList = dirList;
+        IoEvent->DokanOpenInfo->DirListCursor = cursor;
       } else {
         // They should never point to the same object
         DbgPrint("Dokan Warning: EndFindFilesCommon() "
@@ -593,16 +728,132 @@ VOID EndFindFilesCommon(PDOKAN_IO_EVENT IoEvent, NTSTATUS Status) {
     }
     LeaveCriticalSection(&IoEvent->DokanOpenInfo->CriticalSection);
     if (oldDirList) {
-      PushDirectoryList(oldDirList);
+      PushDirectoryList(IoEvent->DokanInstance->ObjectPools, oldDirList);
     }
   } else {
-    PushDirectoryList(dirList);
+    PushDirectoryList(IoEvent->DokanInstance->ObjectPools, dirList);
   }
   IoEvent->DokanFileInfo.ProcessingContext = NULL;
   IoEvent->EventResult->Status = Status;
   EventCompletion(IoEvent);
 }
 
+// Generates "." and ".." in a streamed query, the same way
+// AddMissingCurrentAndParentFolder does for cached listings.
+VOID StreamCurrentAndParentFolder(PDOKAN_FIND_FILES_STREAM Stream) {
+  PDOKAN_IO_EVENT ioEvent = Stream->IoEvent;
+  WIN32_FIND_DATAW findData;
+  FILETIME systime;
+
+  if (wcscmp(ioEvent->EventContext->Operation.Directory.DirectoryName,
+             L"\\") == 0 ||
+      (Stream->SearchPattern != NULL &&
+       wcscmp(Stream->SearchPattern, L"*") != 0)) {
+    return;
+  }
+
+  ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
+  findData.dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+  GetSystemTimeAsFileTime(&systime);
+  findData.ftCreationTime = systime;
+  findData.ftLastAccessTime = systime;
+  findData.ftLastWriteTime = systime;
+  findData.cFileName[0] = '.';
+  StreamFileData(Stream, &findData);
+  findData.cFileName[1] = '.';
+  StreamFileData(Stream, &findData);
+  Stream->GeneratedEntryCount = 2;
+  Stream->SkipDotEntries = TRUE;
+}
+
+// Lists the directory for a single query without keeping the listing around.
+// The only state kept between queries is the FileIndex held by the driver,
+// the position of the next entry. File systems that do not resume at it with
+// DokanGetFindFilesStartIndex have the entries before it skipped here.
+VOID DispatchStreamedDirectoryInformation(PDOKAN_IO_EVENT IoEvent,
+                                          PDOKAN_OPEN_INFO OpenInfo,
+                                          PWCHAR SearchPattern) {
+  DOKAN_FIND_FILES_STREAM stream;
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+  BOOL unimplementedFindFilesWithPattern;
+
+  ZeroMemory(&stream, sizeof(DOKAN_FIND_FILES_STREAM));
+  stream.IoEvent = IoEvent;
+  stream.CurrentBuffer = IoEvent->EventResult->Buffer;
+  stream.LastBuffer = stream.CurrentBuffer;
+  stream.LengthRemaining =
+      IoEvent->EventContext->Operation.Directory.BufferLength;
+  stream.SearchPattern = SearchPattern;
+  stream.StartIndex = IoEvent->EventContext->Operation.Directory.FileIndex;
+  IoEvent->DokanFileInfo.ProcessingContext = &stream;
+
+  StreamCurrentAndParentFolder(&stream);
+
+  EnterCriticalSection(&OpenInfo->CriticalSection);
+  unimplementedFindFilesWithPattern =
+      OpenInfo->UnimplementedFindFilesWithPattern;
+  LeaveCriticalSection(&OpenInfo->CriticalSection);
+
+  if (IoEvent->DokanInstance->DokanOperations->FindFilesWithPattern &&
+      !unimplementedFindFilesWithPattern) {
+    status = IoEvent->DokanInstance->DokanOperations->FindFilesWithPattern(
+        IoEvent->EventContext->Operation.Directory.DirectoryName,
+        SearchPattern ? SearchPattern : L"*", DokanFillFileData,
+        &IoEvent->DokanFileInfo);
+    if (status == STATUS_NOT_IMPLEMENTED) {
+      EnterCriticalSection(&OpenInfo->CriticalSection);
+      OpenInfo->UnimplementedFindFilesWithPattern = TRUE;
+      LeaveCriticalSection(&OpenInfo->CriticalSection);
+    }
+  }
+
+  if (status == STATUS_NOT_IMPLEMENTED &&
+      IoEvent->DokanInstance->DokanOperations->FindFiles) {
+    if (SearchPattern && wcscmp(SearchPattern, L"*") != 0) {
+      stream.PatternCheck = TRUE;
+      stream.PatternCompiled = DokanPattern_Compile(
+          &stream.Pattern, SearchPattern,
+          !(IoEvent->DokanInstance->DokanOptions->Options &
+            DOKAN_OPTION_CASE_SENSITIVE));
+    }
+    status = IoEvent->DokanInstance->DokanOperations->FindFiles(
+        IoEvent->EventContext->Operation.Directory.DirectoryName,
+        DokanFillFileData, &IoEvent->DokanFileInfo);
+    if (stream.PatternCompiled) {
+      DokanPattern_Free(&stream.Pattern);
+    }
+  }
+  IoEvent->DokanFileInfo.ProcessingContext = NULL;
+
+  if (status == STATUS_PENDING) {
+    DbgPrint("Dokan Error: FindFiles returned STATUS_PENDING which is not "
+             "supported when streaming directory listings.\n");
+    status = STATUS_INTERNAL_ERROR;
+  }
+
+  IoEvent->EventResult->BufferLength = 0;
+  IoEvent->EventResult->Operation.Directory.Index =
+      IoEvent->EventContext->Operation.Directory.FileIndex;
+  if (status == STATUS_SUCCESS) {
+    if (stream.EntryCount > 0) {
+      // Since next of the last entry doesn't exist, clear next offset
+      ((PFILE_BOTH_DIR_INFORMATION)stream.LastBuffer)->NextEntryOffset = 0;
+      IoEvent->EventResult->BufferLength =
+          IoEvent->EventContext->Operation.Directory.BufferLength -
+          stream.LengthRemaining;
+      IoEvent->EventResult->Operation.Directory.Index = stream.Index;
+    } else if (stream.BufferOverflow) {
+      status = STATUS_BUFFER_OVERFLOW;
+    } else if (IoEvent->EventContext->Operation.Directory.FileIndex == 0) {
+      status = STATUS_NO_SUCH_FILE;
+    } else {
+      status = STATUS_NO_MORE_FILES;
+    }
+  }
+  IoEvent->EventResult->Status = status;
+  EventCompletion(IoEvent);
+}
+
 VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
   PWCHAR searchPattern = NULL;
   NTSTATUS status = STATUS_SUCCESS;
@@ -611,6 +862,13 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
   BOOL forceScan = FALSE;
   PDOKAN_OPEN_INFO openInfo = IoEvent->DokanOpenInfo;
   BOOLEAN allocatedOpenInfo = FALSE;
+  // The event can be released by its completion, before openInfo.
+  PDOKAN_OBJECT_POOLS objectPools = IoEvent->DokanInstance->ObjectPools;
+  PDOKAN_DIRECTORY_LIST_CACHE directoryListCache = NULL;
+  LPCWSTR cachePattern = NULL;
+  ULONG64 directoryListSequence = 0;
+  ULONG64 fileInfoSequence = 0;
+  BOOLEAN unimplementedFindFilesWithPattern = FALSE;
 
   DbgPrint(
       "###FindFiles file handle = 0x%p, eventID = %04d, event Info = 0x%p\n",
@@ -654,10 +912,19 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
   }
 
   if (!openInfo) {
-    openInfo = PopFileOpenInfo();
+    openInfo = PopFileOpenInfo(objectPools);
     allocatedOpenInfo = TRUE;
   }
 
+  if (IoEvent->DokanInstance->DokanOptions->Options &
+      DOKAN_OPTION_STREAM_FIND_FILES) {
+    DispatchStreamedDirectoryInformation(IoEvent, openInfo, searchPattern);
+    if (allocatedOpenInfo) {
+      PushFileOpenInfo(objectPools, openInfo);
+    }
+    return;
+  }
+
   EnterCriticalSection(&openInfo->CriticalSection);
   {
     if (openInfo->DirList == NULL) {
@@ -679,7 +946,8 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
             ? TRUE
             : FALSE;
     if (!forceScan) {
-      status = WriteDirectoryResults(IoEvent, openInfo->DirList);
+      status = WriteDirectoryResults(IoEvent, openInfo->DirList,
+                                     &openInfo->DirListCursor);
     }
   }
   LeaveCriticalSection(&openInfo->CriticalSection);
@@ -688,23 +956,61 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
     IoEvent->EventResult->Status = status;
     EventCompletion(IoEvent);
     if (allocatedOpenInfo) {
-      PushFileOpenInfo(openInfo);
+      PushFileOpenInfo(objectPools, openInfo);
     }
     return;
   }
 
-  IoEvent->DokanFileInfo.ProcessingContext = PopDirectoryList();
+  IoEvent->DokanFileInfo.ProcessingContext = PopDirectoryList(objectPools);
   if (!IoEvent->DokanFileInfo.ProcessingContext) {
     DbgPrint(
         "Dokan Error: Failed to allocate memory for a new directory list.\n");
     IoEvent->EventResult->Status = STATUS_NO_MEMORY;
     EventCompletion(IoEvent);
     if (allocatedOpenInfo) {
-      PushFileOpenInfo(openInfo);
+      PushFileOpenInfo(objectPools, openInfo);
     }
     return;
   }
 
+  // Reuse a listing done recently by another handle
+  directoryListCache = IoEvent->DokanInstance->DirectoryListCache;
+  if (directoryListCache) {
+    // Without FindFilesWithPattern the listing does not depend on the pattern
+    cachePattern =
+        (searchPattern &&
+         IoEvent->DokanInstance->DokanOperations->FindFilesWithPattern)
+            ? searchPattern
+            : L"*";
+    if (DokanDirectoryListCache_Lookup(
+            directoryListCache,
+            IoEvent->EventContext->Operation.Directory.DirectoryName,
+            cachePattern,
+            (PDOKAN_DIRECTORY_LIST)IoEvent->DokanFileInfo.ProcessingContext,
+            &unimplementedFindFilesWithPattern)) {
+      if (unimplementedFindFilesWithPattern) {
+        EnterCriticalSection(&openInfo->CriticalSection);
+        openInfo->UnimplementedFindFilesWithPattern = TRUE;
+        LeaveCriticalSection(&openInfo->CriticalSection);
+      }
+      EndFindFilesCommon(IoEvent, STATUS_SUCCESS);
+      if (allocatedOpenInfo) {
+        PushFileOpenInfo(objectPools, openInfo);
+      }
+      return;
+    }
+  }
+
+  // Taken before listing so that a change made meanwhile is not cached over.
+  if (directoryListCache) {
+    directoryListSequence =
+        DokanDirectoryListCache_GetInvalidationSequence(directoryListCache);
+  }
+  if (IoEvent->DokanInstance->FileInfoCache) {
+    fileInfoSequence = DokanFileInfoCache_GetInvalidationSequence(
+        IoEvent->DokanInstance->FileInfoCache);
+  }
+
   status = STATUS_NOT_IMPLEMENTED;
 
   // Reminder: FindFilesWithPattern may not be implemented by returning STATUS_NOT_IMPLEMENTED.
@@ -728,6 +1034,23 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
         DokanFillFileData, &IoEvent->DokanFileInfo);
   }
 
+  if (status == STATUS_SUCCESS && directoryListCache) {
+    DokanDirectoryListCache_Insert(
+        directoryListCache,
+        IoEvent->EventContext->Operation.Directory.DirectoryName, cachePattern,
+        (PDOKAN_DIRECTORY_LIST)IoEvent->DokanFileInfo.ProcessingContext,
+        openInfo->UnimplementedFindFilesWithPattern, directoryListSequence);
+  }
+
+  // Listed entries answer the attribute queries that usually follow
+  if (status == STATUS_SUCCESS && IoEvent->DokanInstance->FileInfoCache) {
+    DokanFileInfoCache_InsertDirectoryList(
+        IoEvent->DokanInstance->FileInfoCache,
+        IoEvent->EventContext->Operation.Directory.DirectoryName,
+        (PDOKAN_DIRECTORY_LIST)IoEvent->DokanFileInfo.ProcessingContext,
+        fileInfoSequence);
+  }
+
   if (status != STATUS_NOT_IMPLEMENTED) {
     EndFindFilesCommon(IoEvent, status);
   } else {
@@ -737,14 +1060,10 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
   }
 
   if (allocatedOpenInfo) {
-    PushFileOpenInfo(openInfo);
+    PushFileOpenInfo(objectPools, openInfo);
   }
 }
 
-#define DOS_STAR (L'<')
-#define DOS_QM (L'>')
-#define DOS_DOT (L'"')
-
 BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, // matching pattern
                                       LPCWSTR Name,       // file name
                                       BOOL IgnoreCase) {
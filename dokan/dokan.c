@@ -24,6 +24,15 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "fileinfo.h"
 #include "list.h"
 #include "dokan_pool.h"
+#include "dokan_reply.h"
+#include "dokan_batch_sizer.h"
+#include "dokan_statistics.h"
+#include "dokan_event_trace.h"
+#include "dokan_loopback.h"
+#include "dokan_read_ahead.h"
+#include "dokan_transport.h"
+#include "dokan_trace.h"
+#include "dokan_write_coalescer.h"
 
 #include <conio.h>
 #include <process.h>
@@ -42,6 +51,9 @@ BOOL g_DebugMode = TRUE;
 // DokanOptions->UseStdErr is ON?
 BOOL g_UseStdErr = FALSE;
 
+// Baseline of the event benchmark, see dokani.h.
+BOOL g_DokanWorkPerBatchEvent = FALSE;
+
 // Dokan DLL critical section
 CRITICAL_SECTION g_InstanceCriticalSection;
 
@@ -55,21 +67,26 @@ VOID DOKANAPI DokanUseStdErr(BOOL Status) { g_UseStdErr = Status; }
 VOID DOKANAPI DokanDebugMode(BOOL Status) { g_DebugMode = Status; }
 
 VOID DispatchDriverLogs(PDOKAN_IO_EVENT IoEvent) {
-  UNREFERENCED_PARAMETER(IoEvent);
-
   PDOKAN_LOG_MESSAGE log_message =
       (PDOKAN_LOG_MESSAGE)((PCHAR)IoEvent->EventContext +
                            sizeof(EVENT_CONTEXT));
-  if (log_message->MessageLength) {
-    ULONG paquet_size = FIELD_OFFSET(DOKAN_LOG_MESSAGE, Message[0]) +
-                        log_message->MessageLength;
-    if (((PCHAR)log_message + paquet_size) <=
-        ((PCHAR)IoEvent->EventContext + IoEvent->EventContext->Length)) {
-      DbgPrint("DriverLog: %.*s\n", log_message->MessageLength,
-               log_message->Message);
-    } else {
-      DbgPrint("Invalid driver log message received.\n");
-    }
+  const DOKAN_TRACE_RECORD *record;
+  ULONG offset = 0;
+  CHAR line[DOKAN_TRACE_LINE_MAX_SIZE];
+
+  if (IoEvent->EventContext->Length < sizeof(EVENT_CONTEXT) ||
+      !DokanTraceIsValidMessage(
+          log_message, IoEvent->EventContext->Length - sizeof(EVENT_CONTEXT))) {
+    DbgPrint("Invalid driver log message received.\n");
+    return;
+  }
+  if (log_message->DroppedRecords) {
+    DbgPrint("DriverLog: %lu logs were dropped\n",
+             log_message->DroppedRecords);
+  }
+  while ((record = DokanTraceNextRecord(log_message, &offset)) != NULL) {
+    DokanTraceFormatRecord(record, line, sizeof(line));
+    DbgPrint("DriverLog: %s\n", line);
   }
 }
 
@@ -86,6 +103,8 @@ NewDokanInstance() {
   dokanInstance->Device = INVALID_HANDLE_VALUE;
   dokanInstance->NotifyHandle = INVALID_HANDLE_VALUE;
   dokanInstance->KeepaliveHandle = INVALID_HANDLE_VALUE;
+  dokanInstance->Transport = &g_DokanDeviceTransport;
+  dokanInstance->ObjectPools = GetGlobalObjectPools();
 
   (void)InitializeCriticalSectionAndSpinCount(&dokanInstance->CriticalSection,
                                               0x80000400);
@@ -148,6 +167,11 @@ VOID DeleteDokanInstance(PDOKAN_INSTANCE DokanInstance) {
     DestroyThreadpoolEnvironment(
         &DokanInstance->ThreadInfo.CallbackEnvironment);
   }
+  // The file system completes the pending events from its own threads, which
+  // still use the pools and the transport until their reply is sent.
+  while (InterlockedCompareExchange(&DokanInstance->DetachedEvents, 0, 0)) {
+    Sleep(1);
+  }
   if (DokanInstance->NotifyHandle &&
       DokanInstance->NotifyHandle != INVALID_HANDLE_VALUE) {
     CloseHandle(DokanInstance->NotifyHandle);
@@ -163,6 +187,20 @@ VOID DeleteDokanInstance(PDOKAN_INSTANCE DokanInstance) {
       DokanInstance->GlobalDevice != INVALID_HANDLE_VALUE) {
     CloseHandle(DokanInstance->GlobalDevice);
   }
+  // The last flushes of the coalescer invalidate the caches below.
+  DokanWriteCoalescer_Free(DokanInstance->WriteCoalescer);
+  DokanInstance->WriteCoalescer = NULL;
+  DokanDirectoryListCache_Free(DokanInstance->DirectoryListCache);
+  DokanInstance->DirectoryListCache = NULL;
+  DokanFileInfoCache_Free(DokanInstance->FileInfoCache);
+  DokanInstance->FileInfoCache = NULL;
+  DokanReadAhead_Free(DokanInstance->ReadAhead);
+  DokanInstance->ReadAhead = NULL;
+  DokanReplyAggregator_Free(DokanInstance->ReplyAggregator);
+  DokanIoBatchSizer_Free(DokanInstance->IoBatchSizer);
+  DokanStatistics_Free(DokanInstance->Statistics);
+  DokanEventRecorder_Free(DokanInstance->EventRecorder);
+  FreeObjectPools(DokanInstance->ObjectPools);
   DeleteCriticalSection(&DokanInstance->CriticalSection);
   EnterCriticalSection(&g_InstanceCriticalSection);
   { RemoveEntryList(&DokanInstance->ListEntry); }
@@ -171,6 +209,77 @@ VOID DeleteDokanInstance(PDOKAN_INSTANCE DokanInstance) {
   free(DokanInstance);
 }
 
+// Returns the options to read the fields added in
+// DOKAN_OPTIONS_TUNING_VERSION from. The struct of an older version ends
+// before them, they are read from LegacyOptions instead where they are 0, the
+// defaults.
+static PDOKAN_OPTIONS GetTuningOptions(PDOKAN_OPTIONS DokanOptions,
+                                       PDOKAN_OPTIONS LegacyOptions) {
+  if (DokanOptions->Version >= DOKAN_OPTIONS_TUNING_VERSION) {
+    return DokanOptions;
+  }
+  ZeroMemory(LegacyOptions, sizeof(DOKAN_OPTIONS));
+  memcpy_s(LegacyOptions, sizeof(DOKAN_OPTIONS), DokanOptions,
+           FIELD_OFFSET(DOKAN_OPTIONS, DirectoryListCacheTimeout));
+  return LegacyOptions;
+}
+
+// Allocates the caches enabled by the options of the instance.
+static BOOL AllocateDokanInstanceCaches(PDOKAN_INSTANCE DokanInstance) {
+  DOKAN_OPTIONS legacyOptions;
+  PDOKAN_OPTIONS dokanOptions =
+      GetTuningOptions(DokanInstance->DokanOptions, &legacyOptions);
+  if (dokanOptions->Options & DOKAN_OPTION_INSTANCE_POOLS) {
+    PDOKAN_OBJECT_POOLS objectPools = AllocObjectPools(
+        dokanOptions->PoolMaxCount, dokanOptions->PoolPrewarmCount);
+    // The mount still works with the global pools.
+    if (objectPools) {
+      DokanInstance->ObjectPools = objectPools;
+    } else {
+      DokanDbgPrint("Dokan Warning: Failed to allocate the object pools of "
+                    "the instance, using the global ones.\n");
+    }
+  }
+  if ((dokanOptions->Options & DOKAN_OPTION_DIRECTORY_LIST_CACHE) &&
+      !(dokanOptions->Options & DOKAN_OPTION_STREAM_FIND_FILES)) {
+    DokanInstance->DirectoryListCache = DokanDirectoryListCache_Alloc(
+        dokanOptions->DirectoryListCacheTimeout,
+        dokanOptions->DirectoryListCacheMaxSize,
+        dokanOptions->Options & DOKAN_OPTION_CASE_SENSITIVE);
+    if (!DokanInstance->DirectoryListCache) {
+      return FALSE;
+    }
+  }
+  // The cache is keyed by the file names that the kernel stops sending.
+  if ((dokanOptions->Options & DOKAN_OPTION_FILE_INFO_CACHE) &&
+      !(dokanOptions->Options & DOKAN_OPTION_OMIT_IO_FILE_NAMES)) {
+    DokanInstance->FileInfoCache = DokanFileInfoCache_Alloc(
+        dokanOptions->FileInfoCacheTimeout,
+        dokanOptions->Options & DOKAN_OPTION_CASE_SENSITIVE);
+    if (!DokanInstance->FileInfoCache) {
+      return FALSE;
+    }
+  }
+  if (dokanOptions->Options & DOKAN_OPTION_READ_AHEAD) {
+    DokanInstance->ReadAhead = DokanReadAhead_Alloc(
+        dokanOptions->ReadAheadSize, dokanOptions->ReadAheadMaxMemory,
+        dokanOptions->Options & DOKAN_OPTION_CASE_SENSITIVE);
+    if (!DokanInstance->ReadAhead) {
+      return FALSE;
+    }
+  }
+  if (dokanOptions->Options & DOKAN_OPTION_WRITE_COALESCING) {
+    DokanInstance->WriteCoalescer = DokanWriteCoalescer_Alloc(
+        DokanInstance, dokanOptions->WriteCoalescingSize,
+        dokanOptions->WriteCoalescingTimeout,
+        dokanOptions->Options & DOKAN_OPTION_CASE_SENSITIVE);
+    if (!DokanInstance->WriteCoalescer) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
 BOOL IsMountPointDriveLetter(LPCWSTR mountPoint) {
   size_t mountPointLength;
   if (!mountPoint || *mountPoint == 0) {
@@ -303,8 +412,20 @@ VOID HandleUnknownEvent(PDOKAN_IO_EVENT IoEvent) {
 }
 
 VOID DispatchEvent(PDOKAN_IO_EVENT IoEvent) {
+  PDOKAN_INSTANCE dokanInstance = IoEvent->DokanInstance;
+  ULONG majorFunction = IoEvent->EventContext->MajorFunction;
+  LONG64 dispatchStart = DokanStatistics_Now();
+
   SetupIOEventForProcessing(IoEvent);
-  switch (IoEvent->EventContext->MajorFunction) {
+  IoEvent->PullTime = IoEvent->IoBatch ? IoEvent->IoBatch->PullTime : 0;
+  // The writes buffered for the open reach the file system before its other
+  // operations.
+  if (dokanInstance->WriteCoalescer && IoEvent->DokanOpenInfo &&
+      majorFunction != IRP_MJ_WRITE && majorFunction != IRP_MJ_FLUSH_BUFFERS) {
+    DokanWriteCoalescer_Flush(dokanInstance->WriteCoalescer, IoEvent,
+                              /*TakeError=*/FALSE);
+  }
+  switch (majorFunction) {
   case IRP_MJ_CREATE:
     DispatchCreate(IoEvent);
     break;
@@ -351,6 +472,19 @@ VOID DispatchEvent(PDOKAN_IO_EVENT IoEvent) {
     HandleUnknownEvent(IoEvent);
     break;
   }
+  // Creates never complete asynchronously, the reply is the final one.
+  if (majorFunction == IRP_MJ_CREATE && IoEvent->EventResult &&
+      IoEvent->EventResult->Context) {
+    DokanEventRecorder_RecordOpen(dokanInstance->EventRecorder,
+                                  IoEvent->EventContext->SerialNumber,
+                                  IoEvent->EventResult->Context);
+  }
+  // A pending event cannot be released before this returns, see
+  // DetachPendingEvent.
+  DokanStatistics_RecordDispatch(
+      dokanInstance->Statistics, majorFunction, IoEvent->PullTime,
+      dispatchStart, DokanStatistics_Now(),
+      IoEvent->AsyncState != DOKAN_IO_EVENT_ASYNC_NONE);
 }
 
 VOID OnDeviceIoCtlFailed(PDOKAN_INSTANCE DokanInstance, DWORD Result) {
@@ -360,7 +494,8 @@ VOID OnDeviceIoCtlFailed(PDOKAN_INSTANCE DokanInstance, DWORD Result) {
                    DokanInstance->DeviceName, Result);
   }
 
-  if (InterlockedAdd(&DokanInstance->UnmountedCalled, 1) == 1) {
+  if (DokanInstance->Transport->Mounted &&
+      InterlockedAdd(&DokanInstance->UnmountedCalled, 1) == 1) {
     DokanNotifyUnmounted(DokanInstance);
   }
 
@@ -373,11 +508,12 @@ VOID OnDeviceIoCtlFailed(PDOKAN_INSTANCE DokanInstance, DWORD Result) {
 // End it all
 VOID HandleProcessIoFatalError(PDOKAN_INSTANCE DokanInstance,
                                PDOKAN_IO_BATCH IoBatch, DWORD Result) {
-  PushIoBatchBuffer(IoBatch);
+  PushIoBatchBuffer(DokanInstance->ObjectPools, IoBatch);
   OnDeviceIoCtlFailed(DokanInstance, Result);
 }
 
-VOID FreeIoEventResult(PEVENT_INFORMATION EventResult, ULONG EventResultSize,
+VOID FreeIoEventResult(PDOKAN_OBJECT_POOLS Pools,
+                       PEVENT_INFORMATION EventResult, ULONG EventResultSize,
                        BOOL PoolAllocated) {
   if (!EventResult) {
     return;
@@ -385,15 +521,15 @@ VOID FreeIoEventResult(PEVENT_INFORMATION EventResult, ULONG EventResultSize,
   if (!PoolAllocated) {
     FreeEventResult(EventResult);
   } else if (EventResultSize <= DOKAN_EVENT_INFO_DEFAULT_SIZE) {
-    PushEventResult(EventResult);
+    PushEventResult(Pools, EventResult);
   } else if (EventResultSize <= DOKAN_EVENT_INFO_16K_SIZE) {
-    Push16KEventResult(EventResult);
+    Push16KEventResult(Pools, EventResult);
   } else if (EventResultSize <= DOKAN_EVENT_INFO_32K_SIZE) {
-    Push32KEventResult(EventResult);
+    Push32KEventResult(Pools, EventResult);
   } else if (EventResultSize <= DOKAN_EVENT_INFO_64K_SIZE) {
-    Push64KEventResult(EventResult);
+    Push64KEventResult(Pools, EventResult);
   } else if (EventResultSize <= DOKAN_EVENT_INFO_128K_SIZE) {
-    Push128KEventResult(EventResult);
+    Push128KEventResult(Pools, EventResult);
   } else {
     assert(FALSE);
   }
@@ -414,6 +550,17 @@ VOID QueueIoEvent(PDOKAN_IO_EVENT IoEvent, PTP_WORK_CALLBACK Callback) {
   SubmitThreadpoolWork(work);
 }
 
+// Executes the event on the thread pool with the reusable dispatch work of
+// the instance. Each submission runs the callback once, and every run
+// executes one of the queued events.
+VOID QueueBatchIoEvent(PDOKAN_IO_EVENT IoEvent) {
+  DOKAN_INSTANCE_THREADINFO *threadInfo = &IoEvent->DokanInstance->ThreadInfo;
+  AcquireSRWLockExclusive(&threadInfo->DispatchQueueLock);
+  InsertTailList(&threadInfo->DispatchQueue, &IoEvent->DispatchListEntry);
+  ReleaseSRWLockExclusive(&threadInfo->DispatchQueueLock);
+  SubmitThreadpoolWork(threadInfo->DispatchWork);
+}
+
 DWORD
 GetEventInfoSize(__in ULONG MajorFunction, __in PEVENT_INFORMATION EventInfo) {
   if (MajorFunction == IRP_MJ_WRITE) {
@@ -426,6 +573,32 @@ GetEventInfoSize(__in ULONG MajorFunction, __in PEVENT_INFORMATION EventInfo) {
                         EventInfo->BufferLength);
 }
 
+// Main pull threads wait for events indefinitely unless the batch size can
+// still shrink, see DokanIoBatchSizer_GetMainPullTimeout.
+ULONG GetPullEventTimeoutMs(PDOKAN_IO_BATCH IoBatch) {
+  if (!IoBatch->MainPullThread) {
+    return DOKAN_PULL_EVENT_TIMEOUT_MS;
+  }
+  return DokanIoBatchSizer_GetMainPullTimeout(
+      IoBatch->DokanInstance->IoBatchSizer);
+}
+
+// Accounts for the events pulled in IoBatch.
+VOID RecordPull(PDOKAN_IO_BATCH IoBatch) {
+  PDOKAN_INSTANCE dokanInstance = IoBatch->DokanInstance;
+  IoBatch->PullTime = DokanStatistics_Now();
+  if (DokanIoBatchSizer_RecordPull(dokanInstance->IoBatchSizer,
+                                   IoBatch->EventContextSize,
+                                   IoBatch->NumberOfBytesTransferred)) {
+    TrimIoBatchBuffers(dokanInstance->ObjectPools, IoBatch->EventContextSize);
+  }
+  if (IoBatch->NumberOfBytesTransferred) {
+    DokanEventRecorder_RecordBatch(dokanInstance->EventRecorder,
+                                   IoBatch->EventContext,
+                                   IoBatch->NumberOfBytesTransferred);
+  }
+}
+
 DWORD SendAndPullEventInformation(PDOKAN_IO_EVENT IoEvent,
                                   PDOKAN_IO_BATCH IoBatch,
                                   BOOL ReleaseBatchBuffers) {
@@ -435,6 +608,10 @@ DWORD SendAndPullEventInformation(PDOKAN_IO_EVENT IoEvent,
   ULONG eventResultSize = 0;
   PEVENT_INFORMATION eventInfo = NULL;
   BOOL eventInfoPollAllocated = FALSE;
+  EVENT_INFORMATION timeoutOnlyInfo;
+  ULONG pullEventTimeoutMs = 0;
+  // IoEvent can be released before its result is sent.
+  PDOKAN_OBJECT_POOLS objectPools = IoBatch->DokanInstance->ObjectPools;
 
   if (IoEvent && IoEvent->EventResult) {
     eventInfo = IoEvent->EventResult;
@@ -443,34 +620,48 @@ DWORD SendAndPullEventInformation(PDOKAN_IO_EVENT IoEvent,
     inputBuffer = (PCHAR)eventInfo;
     eventInfoSize =
         GetEventInfoSize(IoEvent->EventContext->MajorFunction, eventInfo);
-    eventInfo->PullEventTimeoutMs =
-        IoBatch->MainPullThread ? /*infinite*/ 0 : DOKAN_PULL_EVENT_TIMEOUT_MS;
+    eventInfo->ReplyLength = eventInfoSize;
+    eventInfo->PullEventTimeoutMs = GetPullEventTimeoutMs(IoBatch);
     if (ReleaseBatchBuffers) {
-      PushIoBatchBuffer(IoEvent->IoBatch);
-      PushIoEventBuffer(IoEvent);
+      PushIoBatchBuffer(objectPools, IoEvent->IoBatch);
+      PushIoEventBuffer(objectPools, IoEvent);
     }
     DbgPrint(
         "Dokan Information: SendAndPullEventInformation() with NTSTATUS 0x%x, "
         "context 0x%lx, and result object 0x%p with size %d\n",
         eventInfo->Status, eventInfo->Context, eventInfo, eventInfoSize);
+    if (IoBatch->DokanInstance->ReplyAggregator) {
+      DokanReplyAggregator_RecordIoctl(IoBatch->DokanInstance->ReplyAggregator,
+                                       /*ReplyCount=*/1);
+    }
   } else {
     // Main pull thread is allowed to pull events without having event results to send
     assert(IoBatch->MainPullThread);
+    pullEventTimeoutMs = GetPullEventTimeoutMs(IoBatch);
+    if (pullEventTimeoutMs) {
+      // A reply of no event, skipped by the driver with its length, only
+      // carries the timeout.
+      RtlZeroMemory(&timeoutOnlyInfo, sizeof(EVENT_INFORMATION));
+      timeoutOnlyInfo.PullEventTimeoutMs = pullEventTimeoutMs;
+      timeoutOnlyInfo.ReplyLength = sizeof(EVENT_INFORMATION);
+      inputBuffer = (PCHAR)&timeoutOnlyInfo;
+      eventInfoSize = sizeof(EVENT_INFORMATION);
+    }
   }
 
-  if (!DeviceIoControl(
-          IoBatch->DokanInstance->Device, // Handle to device
+  if (!DokanTransport_Control(
+          IoBatch->DokanInstance,         // Instance pulling the events
           FSCTL_EVENT_PROCESS_N_PULL,     // IO Control code
           inputBuffer,                    // Input Buffer to driver.
           eventInfoSize,                  // Length of input buffer in bytes.
           &IoBatch->EventContext[0],      // Output Buffer from driver.
-          BATCH_EVENT_CONTEXT_SIZE,       // Length of output buffer in bytes.
-          &IoBatch->NumberOfBytesTransferred, // Bytes placed in buffer.
-          NULL                                // asynchronous call
+          IoBatch->EventContextSize,      // Length of output buffer in bytes.
+          &IoBatch->NumberOfBytesTransferred // Bytes placed in buffer.
           )) {
     lastError = GetLastError();
     if (eventInfo) {
-      FreeIoEventResult(eventInfo, eventResultSize, eventInfoPollAllocated);
+      FreeIoEventResult(objectPools, eventInfo, eventResultSize,
+                        eventInfoPollAllocated);
     }
     if (!IoBatch->DokanInstance->FileSystemStopped) {
       DokanDbgPrintW(
@@ -481,11 +672,85 @@ DWORD SendAndPullEventInformation(PDOKAN_IO_EVENT IoEvent,
     return lastError;
   }
   if (eventInfo) {
-    FreeIoEventResult(eventInfo, eventResultSize, eventInfoPollAllocated);
+    FreeIoEventResult(objectPools, eventInfo, eventResultSize,
+                      eventInfoPollAllocated);
   }
+  RecordPull(IoBatch);
   return 0;
 }
 
+// Sends the replies of several events with a single ioctl and pulls new
+// events. The events are released as with SendAndPullEventInformation.
+DWORD SendAndPullEventInformationBatch(PDOKAN_IO_EVENT *IoEvents,
+                                       ULONG IoEventCount,
+                                       PDOKAN_IO_BATCH IoBatch) {
+  DWORD lastError = 0;
+  DWORD inputBufferSize = 0;
+  DWORD offset = 0;
+  PCHAR inputBuffer = NULL;
+  PDOKAN_OBJECT_POOLS objectPools = IoBatch->DokanInstance->ObjectPools;
+
+  for (ULONG i = 0; i < IoEventCount; ++i) {
+    inputBufferSize += GetEventInfoSize(
+        IoEvents[i]->EventContext->MajorFunction, IoEvents[i]->EventResult);
+  }
+  inputBuffer = malloc(inputBufferSize);
+  if (!inputBuffer) {
+    // Send the replies one by one instead, the last one with the pull.
+    DbgPrintW(L"Dokan Error: Reply batch allocation failed.\n");
+    for (ULONG i = 0; i + 1 < IoEventCount; ++i) {
+      SendEventInformation(IoEvents[i]);
+    }
+    return SendAndPullEventInformation(IoEvents[IoEventCount - 1], IoBatch,
+                                       /*ReleaseBatchBuffers=*/TRUE);
+  }
+  for (ULONG i = 0; i < IoEventCount; ++i) {
+    PDOKAN_IO_EVENT ioEvent = IoEvents[i];
+    PEVENT_INFORMATION eventInfo = ioEvent->EventResult;
+    DWORD eventInfoSize =
+        GetEventInfoSize(ioEvent->EventContext->MajorFunction, eventInfo);
+    ULONG eventResultSize = ioEvent->EventResultSize;
+    BOOL eventInfoPoolAllocated = ioEvent->PoolAllocated;
+    // The driver uses the timeout of the first reply, and skips the replies
+    // of the events that timed out with their length.
+    eventInfo->PullEventTimeoutMs = GetPullEventTimeoutMs(IoBatch);
+    eventInfo->ReplyLength = eventInfoSize;
+    RtlCopyMemory(inputBuffer + offset, eventInfo, eventInfoSize);
+    offset += eventInfoSize;
+    PushIoBatchBuffer(objectPools, ioEvent->IoBatch);
+    PushIoEventBuffer(objectPools, ioEvent);
+    FreeIoEventResult(objectPools, eventInfo, eventResultSize,
+                      eventInfoPoolAllocated);
+  }
+  DbgPrint("Dokan Information: SendAndPullEventInformationBatch() with %d "
+           "replies and size %d\n",
+           IoEventCount, inputBufferSize);
+  DokanReplyAggregator_RecordIoctl(IoBatch->DokanInstance->ReplyAggregator,
+                                   IoEventCount);
+
+  if (!DokanTransport_Control(
+          IoBatch->DokanInstance,         // Instance pulling the events
+          FSCTL_EVENT_PROCESS_N_PULL,     // IO Control code
+          inputBuffer,                    // Input Buffer to driver.
+          inputBufferSize,                // Length of input buffer in bytes.
+          &IoBatch->EventContext[0],      // Output Buffer from driver.
+          IoBatch->EventContextSize,      // Length of output buffer in bytes.
+          &IoBatch->NumberOfBytesTransferred // Bytes placed in buffer.
+          )) {
+    lastError = GetLastError();
+    if (!IoBatch->DokanInstance->FileSystemStopped) {
+      DokanDbgPrintW(
+          L"Dokan Error: Dokan device result ioctl failed for wait with "
+          L"code %d.\n",
+          lastError);
+    }
+  } else {
+    RecordPull(IoBatch);
+  }
+  free(inputBuffer);
+  return lastError;
+}
+
 VOID CALLBACK DispatchBatchIoCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Parameter,
                                PTP_WORK Work) {
   UNREFERENCED_PARAMETER(Instance);
@@ -494,35 +759,76 @@ VOID CALLBACK DispatchBatchIoCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Para
   PDOKAN_IO_EVENT ioEvent = (PDOKAN_IO_EVENT)Parameter;
   assert(ioEvent);
   PDOKAN_INSTANCE dokanInstance = ioEvent->DokanInstance;
+  PDOKAN_REPLY_AGGREGATOR replyAggregator = dokanInstance->ReplyAggregator;
+  PDOKAN_IO_EVENT replies[DOKAN_REPLY_AGGREGATION_MAX_REPLIES];
   PDOKAN_IO_BATCH ioBatch = NULL;
   BOOL mainPullThread = ioEvent->EventContext == NULL;
+  // Batching is enabled in this mode, see DokanCreateFileSystem.
+  assert(replyAggregator);
+  if (mainPullThread) {
+    // The event only carried the instance to the main pull thread.
+    PushIoEventBuffer(dokanInstance->ObjectPools, ioEvent);
+    ioEvent = NULL;
+  }
 
   while (TRUE) {
+    ULONG replyCount = 1;
     // 6 - Process events coming from:
     // - Last event not dispatched to the pool (see bottom of this fct).
     // - New pool thread that just started with a dispatched event.
     // Note: Main pull thread does not have an EventContext when started.
     if (ioEvent && ioEvent->EventContext) {
+      // Only the replies of pool threads can be handed off, see
+      // DokanReplyAggregator_Collect. Their dispatch began when the batch was
+      // split below.
       DispatchEvent(ioEvent);
+      if (!mainPullThread) {
+        DokanReplyAggregator_EndDispatch(replyAggregator);
+      }
+      if (DetachPendingEvent(ioEvent)) {
+        // The file system will complete the event later and send its result.
+        if (mainPullThread) {
+          ioEvent = NULL;
+          continue;
+        }
+        return;
+      }
       if (!ioEvent->EventResult) {
         // Some events like Close() do not have event results.
         // Release the resource and terminate here unless we are the main pulling thread.
-        PushIoBatchBuffer(ioEvent->IoBatch);
-        PushIoEventBuffer(ioEvent);
+        PushIoBatchBuffer(dokanInstance->ObjectPools, ioEvent->IoBatch);
+        PushIoEventBuffer(dokanInstance->ObjectPools, ioEvent);
         if (mainPullThread) {
           ioEvent = NULL;
           continue;
         }
         return;
       }
+      // Merge the result with the ones of the events completing at the same
+      // time.
+      replyCount = DokanReplyAggregator_Collect(
+          replyAggregator, ioEvent,
+          GetEventInfoSize(ioEvent->EventContext->MajorFunction,
+                           ioEvent->EventResult),
+          mainPullThread, replies);
+      if (!replyCount) {
+        // Another thread sends the result and keeps pulling.
+        return;
+      }
     }
 
-    ioBatch = PopIoBatchBuffer();
+    ioBatch = PopIoBatchBuffer(
+        dokanInstance->ObjectPools,
+        DokanIoBatchSizer_GetSize(dokanInstance->IoBatchSizer));
     ioBatch->MainPullThread = mainPullThread;
     ioBatch->DokanInstance = dokanInstance;
 
     // 1 - Send event result and pull new events.
-    DWORD error = SendAndPullEventInformation(ioEvent, ioBatch, /*ReleaseBatchBuffers=*/TRUE);
+    DWORD error =
+        replyCount > 1
+            ? SendAndPullEventInformationBatch(replies, replyCount, ioBatch)
+            : SendAndPullEventInformation(ioEvent, ioBatch,
+                                          /*ReleaseBatchBuffers=*/TRUE);
     if (error) {
       HandleProcessIoFatalError(dokanInstance, ioBatch, error);
       return;
@@ -530,7 +836,7 @@ VOID CALLBACK DispatchBatchIoCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Para
 
     // 2 - Terminate thread as nothing needs to be proceed unless we are the mainPullThread.
     if (!ioBatch->NumberOfBytesTransferred) {
-      PushIoBatchBuffer(ioBatch);
+      PushIoBatchBuffer(dokanInstance->ObjectPools, ioBatch);
       if (mainPullThread) {
         ioEvent = NULL;
         continue;
@@ -550,7 +856,7 @@ VOID CALLBACK DispatchBatchIoCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Para
     context = ioBatch->EventContext;
     LONG eventContextBatchCount = ioBatch->EventContextBatchCount;
     while (eventContextBatchCount) {
-      ioEvent = PopIoEventBuffer();
+      ioEvent = PopIoEventBuffer(dokanInstance->ObjectPools);
       if (!ioEvent) {
         DbgPrintW(L"Dokan Error: IoEvent allocation failed.\n");
         OnDeviceIoCtlFailed(ioBatch->DokanInstance, ERROR_OUTOFMEMORY);
@@ -564,13 +870,40 @@ VOID CALLBACK DispatchBatchIoCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Para
       context = (PEVENT_CONTEXT)((PCHAR)(context) + context->Length);
       // 4 - All batched events are dispatched to the thread pool except the last event that is executed on the current thread.
       // Note: Single thread mode has batching disabled and therefore only has one event which is executed on the main thread.
+      // The events still to run keep the reply window open from now on.
+      if (eventContextBatchCount || !mainPullThread) {
+        DokanReplyAggregator_BeginDispatch(replyAggregator);
+      }
       if (eventContextBatchCount) {
-        QueueIoEvent(ioEvent, DispatchBatchIoCallback);
+        if (g_DokanWorkPerBatchEvent) {
+          QueueIoEvent(ioEvent, DispatchBatchIoCallback);
+        } else {
+          QueueBatchIoEvent(ioEvent);
+        }
       }
     }
   }
 }
 
+VOID CALLBACK DispatchQueuedIoCallback(PTP_CALLBACK_INSTANCE Instance,
+                                       PVOID Parameter, PTP_WORK Work) {
+  PDOKAN_INSTANCE dokanInstance = (PDOKAN_INSTANCE)Parameter;
+  PLIST_ENTRY entry = NULL;
+  AcquireSRWLockExclusive(&dokanInstance->ThreadInfo.DispatchQueueLock);
+  if (!IsListEmpty(&dokanInstance->ThreadInfo.DispatchQueue)) {
+    entry = RemoveHeadList(&dokanInstance->ThreadInfo.DispatchQueue);
+  }
+  ReleaseSRWLockExclusive(&dokanInstance->ThreadInfo.DispatchQueueLock);
+  // There are as many runs as there were events queued.
+  assert(entry);
+  if (!entry) {
+    return;
+  }
+  DispatchBatchIoCallback(
+      Instance, CONTAINING_RECORD(entry, DOKAN_IO_EVENT, DispatchListEntry),
+      Work);
+}
+
 VOID CALLBACK DispatchDedicatedIoCallback(PTP_CALLBACK_INSTANCE Instance,
                                           PVOID Parameter, PTP_WORK Work) {
   UNREFERENCED_PARAMETER(Instance);
@@ -578,7 +911,10 @@ VOID CALLBACK DispatchDedicatedIoCallback(PTP_CALLBACK_INSTANCE Instance,
 
   PDOKAN_IO_EVENT ioEvent = (PDOKAN_IO_EVENT)Parameter;
   assert(ioEvent);
-  PDOKAN_IO_BATCH ioBatch = PopIoBatchBuffer();
+  PDOKAN_INSTANCE dokanInstance = ioEvent->DokanInstance;
+  PDOKAN_IO_BATCH ioBatch =
+      PopIoBatchBuffer(dokanInstance->ObjectPools,
+                       DokanIoBatchSizer_GetSize(dokanInstance->IoBatchSizer));
   ioBatch->MainPullThread = TRUE;
   ioBatch->DokanInstance = ioEvent->DokanInstance;
   ioEvent->EventContext = ioBatch->EventContext;
@@ -589,7 +925,7 @@ VOID CALLBACK DispatchDedicatedIoCallback(PTP_CALLBACK_INSTANCE Instance,
     DWORD error =
         SendAndPullEventInformation(ioEvent, ioBatch, /*ReleaseBatchBuffers=*/FALSE);
     if (error) {
-      PushIoEventBuffer(ioEvent);
+      PushIoEventBuffer(dokanInstance->ObjectPools, ioEvent);
       HandleProcessIoFatalError(ioBatch->DokanInstance, ioBatch, error);
       return;
     }
@@ -603,6 +939,30 @@ VOID CALLBACK DispatchDedicatedIoCallback(PTP_CALLBACK_INSTANCE Instance,
     }
     // 3 - Process event
     DispatchEvent(ioEvent);
+    if (DetachPendingEvent(ioEvent)) {
+      // The pending event keeps its buffers until the file system completes
+      // it. Continue pulling with new ones.
+      ioBatch = PopIoBatchBuffer(
+          dokanInstance->ObjectPools,
+          DokanIoBatchSizer_GetSize(dokanInstance->IoBatchSizer));
+      ioEvent = PopIoEventBuffer(dokanInstance->ObjectPools);
+      if (!ioBatch || !ioEvent) {
+        DbgPrintW(L"Dokan Error: IoEvent allocation failed.\n");
+        if (ioEvent) {
+          PushIoEventBuffer(dokanInstance->ObjectPools, ioEvent);
+        }
+        if (ioBatch) {
+          PushIoBatchBuffer(dokanInstance->ObjectPools, ioBatch);
+        }
+        OnDeviceIoCtlFailed(dokanInstance, ERROR_OUTOFMEMORY);
+        return;
+      }
+      ioBatch->MainPullThread = TRUE;
+      ioBatch->DokanInstance = dokanInstance;
+      ioEvent->DokanInstance = dokanInstance;
+      ioEvent->EventContext = ioBatch->EventContext;
+      ioEvent->IoBatch = ioBatch;
+    }
   }
 }
 
@@ -671,6 +1031,83 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
   return returnCode;
 }
 
+// Allocates the state of the dispatch and starts the threads pulling the
+// events from the transport of the instance.
+static int StartDokanInstanceDispatch(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_OPTIONS dokanOptions = DokanInstance->DokanOptions;
+  DWORD_PTR processAffinityMask;
+  DWORD_PTR systemAffinityMask;
+  DWORD mainPullThreadCount = 0;
+  if (GetProcessAffinityMask(GetCurrentProcess(), &processAffinityMask,
+                             &systemAffinityMask)) {
+    while (processAffinityMask) {
+      mainPullThreadCount += 1;
+      processAffinityMask >>= 1;
+    }
+  } else {
+    DbgPrintW(L"Dokan Error: GetProcessAffinityMask failed with Error %d\n",
+              GetLastError());
+  }
+  if (dokanOptions->SingleThread) {
+    mainPullThreadCount = 1; // Really not recommanded
+    dokanOptions->Options &= ~DOKAN_OPTION_ALLOW_IPC_BATCHING;
+  } else if (mainPullThreadCount < DOKAN_MAIN_PULL_THREAD_COUNT_MIN) {
+    mainPullThreadCount = DOKAN_MAIN_PULL_THREAD_COUNT_MIN;
+  } else if (mainPullThreadCount > DOKAN_MAIN_PULL_THREAD_COUNT_MAX) {
+    // Thread pool will allocate more threads when pulling batched events
+    dokanOptions->Options |= DOKAN_OPTION_ALLOW_IPC_BATCHING;
+    mainPullThreadCount = DOKAN_MAIN_PULL_THREAD_COUNT_MAX;
+  }
+  // The flag does not fit in a BOOLEAN, compare instead of truncating it.
+  BOOLEAN allowIpcBatching =
+      (dokanOptions->Options & DOKAN_OPTION_ALLOW_IPC_BATCHING) != 0;
+  DbgPrintW(L"Dokan: Using %d main pull threads with ipc batching: %d\n",
+            mainPullThreadCount, allowIpcBatching);
+  DokanInstance->IoBatchSizer =
+      DokanIoBatchSizer_Alloc(/*Adaptive=*/allowIpcBatching);
+  if (!DokanInstance->IoBatchSizer) {
+    return DOKAN_MOUNT_ERROR;
+  }
+  DokanInstance->Statistics = DokanStatistics_Alloc();
+  if (!DokanInstance->Statistics) {
+    return DOKAN_MOUNT_ERROR;
+  }
+  DokanInstance->EventRecorder = DokanEventRecorder_Alloc();
+  if (!DokanInstance->EventRecorder) {
+    return DOKAN_MOUNT_ERROR;
+  }
+  if (allowIpcBatching) {
+    DokanInstance->ReplyAggregator = DokanReplyAggregator_Alloc();
+    if (!DokanInstance->ReplyAggregator) {
+      return DOKAN_MOUNT_ERROR;
+    }
+    InitializeListHead(&DokanInstance->ThreadInfo.DispatchQueue);
+    InitializeSRWLock(&DokanInstance->ThreadInfo.DispatchQueueLock);
+    // Owned and closed by the cleanup group of the instance.
+    DokanInstance->ThreadInfo.DispatchWork = CreateThreadpoolWork(
+        DispatchQueuedIoCallback, DokanInstance,
+        &DokanInstance->ThreadInfo.CallbackEnvironment);
+    if (!DokanInstance->ThreadInfo.DispatchWork) {
+      DbgPrintW(L"Dokan Error: CreateThreadpoolWork() has returned error "
+                L"code %u.\n",
+                GetLastError());
+      return DOKAN_MOUNT_ERROR;
+    }
+  }
+  for (DWORD x = 0; x < mainPullThreadCount; ++x) {
+    PDOKAN_IO_EVENT ioEvent = PopIoEventBuffer(DokanInstance->ObjectPools);
+    if (!ioEvent) {
+      DokanDbgPrintW(L"Dokan Error: IoEvent allocation failed.");
+      return DOKAN_MOUNT_ERROR;
+    }
+    ioEvent->DokanInstance = DokanInstance;
+    QueueIoEvent(ioEvent, allowIpcBatching
+                              ? DispatchBatchIoCallback
+                              : DispatchDedicatedIoCallback);
+  }
+  return DOKAN_SUCCESS;
+}
+
 int DOKANAPI DokanCreateFileSystem(_In_ PDOKAN_OPTIONS DokanOptions,
                                    _In_ PDOKAN_OPERATIONS DokanOperations,
                                    _Out_ DOKAN_HANDLE *DokanInstance) {
@@ -717,6 +1154,12 @@ int DOKANAPI DokanCreateFileSystem(_In_ PDOKAN_OPTIONS DokanOptions,
     return DOKAN_VERSION_ERROR;
   }
 
+  if (DokanOptions->Version < DOKAN_OPTIONS_TUNING_VERSION) {
+    DbgPrintW(L"Dokan Info: Options of version %d, the fields added in "
+              L"version %d take their default values.\n",
+              DokanOptions->Version, DOKAN_OPTIONS_TUNING_VERSION);
+  }
+
   if (DokanOptions->SingleThread) {
     DbgPrintW(L"Dokan Info: Single thread mode enabled.\n");
   }
@@ -729,6 +1172,10 @@ int DOKANAPI DokanCreateFileSystem(_In_ PDOKAN_OPTIONS DokanOptions,
 
   dokanInstance->DokanOptions = DokanOptions;
   dokanInstance->DokanOperations = DokanOperations;
+  if (!AllocateDokanInstanceCaches(dokanInstance)) {
+    DeleteDokanInstance(dokanInstance);
+    return DOKAN_MOUNT_ERROR;
+  }
   dokanInstance->GlobalDevice =
       CreateFile(DOKAN_GLOBAL_DEVICE_NAME,           // lpFileName
                  0,                                  // dwDesiredAccess
@@ -790,44 +1237,10 @@ int DOKANAPI DokanCreateFileSystem(_In_ PDOKAN_OPTIONS DokanOptions,
     return DOKAN_DRIVER_INSTALL_ERROR;
   }
 
-  DWORD_PTR processAffinityMask;
-  DWORD_PTR systemAffinityMask;
-  DWORD mainPullThreadCount = 0;
-  if (GetProcessAffinityMask(GetCurrentProcess(), &processAffinityMask,
-                             &systemAffinityMask)) {
-    while (processAffinityMask) {
-      mainPullThreadCount += 1;
-      processAffinityMask >>= 1;
-    }
-  } else {
-    DbgPrintW(L"Dokan Error: GetProcessAffinityMask failed with Error %d\n",
-              GetLastError());
-  }
-  if (DokanOptions->SingleThread) {
-    mainPullThreadCount = 1; // Really not recommanded
-    DokanOptions->Options &= ~DOKAN_OPTION_ALLOW_IPC_BATCHING;
-  } else if (mainPullThreadCount < DOKAN_MAIN_PULL_THREAD_COUNT_MIN) {
-    mainPullThreadCount = DOKAN_MAIN_PULL_THREAD_COUNT_MIN;
-  } else if (mainPullThreadCount > DOKAN_MAIN_PULL_THREAD_COUNT_MAX) {
-    // Thread pool will allocate more threads when pulling batched events
-    DokanOptions->Options |= DOKAN_OPTION_ALLOW_IPC_BATCHING;
-    mainPullThreadCount = DOKAN_MAIN_PULL_THREAD_COUNT_MAX;
-  }
-  BOOLEAN allowIpcBatching =
-      (BOOLEAN)(DokanOptions->Options & DOKAN_OPTION_ALLOW_IPC_BATCHING);
-  DbgPrintW(L"Dokan: Using %d main pull threads with ipc batching: %d\n",
-            mainPullThreadCount, allowIpcBatching);
-  for (DWORD x = 0; x < mainPullThreadCount; ++x) {
-    PDOKAN_IO_EVENT ioEvent = PopIoEventBuffer();
-    if (!ioEvent) {
-      DokanDbgPrintW(L"Dokan Error: IoEvent allocation failed.");
-      DeleteDokanInstance(dokanInstance);
-      return DOKAN_MOUNT_ERROR;
-    }
-    ioEvent->DokanInstance = dokanInstance;
-    QueueIoEvent(ioEvent, allowIpcBatching
-                              ? DispatchBatchIoCallback
-                              : DispatchDedicatedIoCallback);
+  result = StartDokanInstanceDispatch(dokanInstance);
+  if (result != DOKAN_SUCCESS) {
+    DeleteDokanInstance(dokanInstance);
+    return result;
   }
 
   if (!DokanMount(dokanInstance, DokanOptions)) {
@@ -902,6 +1315,88 @@ VOID EventCompletion(PDOKAN_IO_EVENT IoEvent) {
   ReleaseDokanOpenInfo(IoEvent);
 }
 
+// Called by a dispatch function when the file system callback returned
+// STATUS_PENDING. The event result is filled later by a DokanEndDispatch*
+// call, possibly before this is reached.
+VOID DispatchPendingEvent(PDOKAN_IO_EVENT IoEvent) {
+  InterlockedCompareExchange(&IoEvent->AsyncState,
+                             DOKAN_IO_EVENT_ASYNC_DISPATCHED,
+                             DOKAN_IO_EVENT_ASYNC_NONE);
+}
+
+// Called by the pulling threads once DispatchEvent returned. Returns TRUE
+// when the event is still pending, in which case it now belongs to the thread
+// that will complete it and must no longer be accessed.
+BOOL DetachPendingEvent(PDOKAN_IO_EVENT IoEvent) {
+  PDOKAN_INSTANCE dokanInstance = IoEvent->DokanInstance;
+  // Counted before another thread can complete it.
+  InterlockedIncrement(&dokanInstance->DetachedEvents);
+  if (InterlockedCompareExchange(&IoEvent->AsyncState,
+                                 DOKAN_IO_EVENT_ASYNC_PENDING,
+                                 DOKAN_IO_EVENT_ASYNC_DISPATCHED) ==
+      DOKAN_IO_EVENT_ASYNC_DISPATCHED) {
+    return TRUE;
+  }
+  InterlockedDecrement(&dokanInstance->DetachedEvents);
+  return FALSE;
+}
+
+// Called once the result of a pending event is filled and EventCompletion was
+// done. The result is sent here if the dispatching thread already left the
+// event, otherwise it will send it the usual way.
+VOID CompletePendingEvent(PDOKAN_IO_EVENT IoEvent) {
+  PDOKAN_INSTANCE dokanInstance = IoEvent->DokanInstance;
+  // The event stays valid until the exchange below.
+  DokanStatistics_RecordCompletion(dokanInstance->Statistics,
+                                   IoEvent->EventContext->MajorFunction,
+                                   IoEvent->PullTime, DokanStatistics_Now());
+  if (InterlockedExchange(&IoEvent->AsyncState,
+                          DOKAN_IO_EVENT_ASYNC_COMPLETED) !=
+      DOKAN_IO_EVENT_ASYNC_PENDING) {
+    return;
+  }
+  SendEventInformation(IoEvent);
+  InterlockedDecrement(&dokanInstance->DetachedEvents);
+}
+
+VOID SendEventInformation(PDOKAN_IO_EVENT IoEvent) {
+  PDOKAN_INSTANCE dokanInstance = IoEvent->DokanInstance;
+  PEVENT_INFORMATION eventInfo = IoEvent->EventResult;
+  ULONG eventResultSize = IoEvent->EventResultSize;
+  BOOL eventInfoPoolAllocated = IoEvent->PoolAllocated;
+  DWORD eventInfoSize;
+  DWORD returnedLength;
+
+  eventInfoSize =
+      GetEventInfoSize(IoEvent->EventContext->MajorFunction, eventInfo);
+  eventInfo->ReplyLength = eventInfoSize;
+  eventInfo->PullEventTimeoutMs = 0;
+  PushIoBatchBuffer(dokanInstance->ObjectPools, IoEvent->IoBatch);
+  PushIoEventBuffer(dokanInstance->ObjectPools, IoEvent);
+  DbgPrint("Dokan Information: SendEventInformation() with NTSTATUS 0x%x, "
+           "context 0x%lx, and result object 0x%p with size %d\n",
+           eventInfo->Status, eventInfo->Context, eventInfo, eventInfoSize);
+
+  // Without output buffer the driver completes the reply and returns
+  // without waiting for new events.
+  if (!DokanTransport_Control(dokanInstance,              // Instance replying
+                              FSCTL_EVENT_PROCESS_N_PULL, // IO Control code
+                              eventInfo,      // Input Buffer to driver.
+                              eventInfoSize,  // Length of input buffer in bytes.
+                              NULL,           // Output Buffer from driver.
+                              0,              // Length of output buffer in bytes.
+                              &returnedLength // Bytes placed in buffer.
+                              )) {
+    if (!dokanInstance->FileSystemStopped) {
+      DokanDbgPrintW(L"Dokan Error: Dokan device result ioctl failed for "
+                     L"pending event with code %d.\n",
+                     GetLastError());
+    }
+  }
+  FreeIoEventResult(dokanInstance->ObjectPools, eventInfo, eventResultSize,
+                    eventInfoPoolAllocated);
+}
+
 VOID CheckFileName(LPWSTR FileName) {
   size_t len = wcslen(FileName);
   // if the beginning of file name is "\\",
@@ -920,6 +1415,55 @@ VOID CheckFileName(LPWSTR FileName) {
     FileName[len - 1] = '\0';
 }
 
+// Keeps the name the kernel sent for the open of the event so that it can be
+// retrieved by DokanGetFileName once the kernel stops sending it. Events are
+// dispatched concurrently, so a name older than the kept one is ignored.
+VOID UpdateOpenInfoFileName(PDOKAN_IO_EVENT IoEvent, LPCWSTR FileName) {
+  LPWSTR fileName = NULL;
+  LPWSTR oldFileName = NULL;
+  ULONG generation = IoEvent->EventContext->FileNameGeneration;
+  if (!IoEvent->DokanOpenInfo || FileName[0] == L'\0' ||
+      !(IoEvent->DokanInstance->DokanOptions->Options &
+        DOKAN_OPTION_OMIT_IO_FILE_NAMES)) {
+    return;
+  }
+  fileName = _wcsdup(FileName);
+  if (!fileName) {
+    DokanDbgPrint("Dokan Error: Failed to keep the open file name.\n");
+    return;
+  }
+  EnterCriticalSection(&IoEvent->DokanOpenInfo->CriticalSection);
+  if (IoEvent->DokanOpenInfo->FileName &&
+      (LONG)(generation - IoEvent->DokanOpenInfo->FileNameGeneration) < 0) {
+    oldFileName = fileName;
+  } else {
+    oldFileName = IoEvent->DokanOpenInfo->FileName;
+    IoEvent->DokanOpenInfo->FileName = fileName;
+    IoEvent->DokanOpenInfo->FileNameGeneration = generation;
+  }
+  LeaveCriticalSection(&IoEvent->DokanOpenInfo->CriticalSection);
+  free(oldFileName);
+}
+
+NTSTATUS DOKANAPI DokanGetFileName(_In_ PDOKAN_FILE_INFO DokanFileInfo,
+                                   _Out_writes_(FileNameSize) LPWSTR FileName,
+                                   _In_ ULONG FileNameSize) {
+  PDOKAN_IO_EVENT ioEvent = (PDOKAN_IO_EVENT)DokanFileInfo->DokanContext;
+  NTSTATUS status = STATUS_NOT_FOUND;
+  if (!ioEvent || !ioEvent->DokanOpenInfo) {
+    return STATUS_NOT_FOUND;
+  }
+  EnterCriticalSection(&ioEvent->DokanOpenInfo->CriticalSection);
+  if (ioEvent->DokanOpenInfo->FileName) {
+    status = wcscpy_s(FileName, FileNameSize,
+                      ioEvent->DokanOpenInfo->FileName) == 0
+                 ? STATUS_SUCCESS
+                 : STATUS_BUFFER_TOO_SMALL;
+  }
+  LeaveCriticalSection(&ioEvent->DokanOpenInfo->CriticalSection);
+  return status;
+}
+
 ULONG DispatchGetEventInformationLength(ULONG bufferSize) {
   // EVENT_INFORMATION has a buffer of size 8 already
   // we remote it to the struct size and add the requested buffer size
@@ -933,25 +1477,29 @@ VOID CreateDispatchCommon(PDOKAN_IO_EVENT IoEvent, ULONG SizeOfEventInfo, BOOL U
   assert(IoEvent->EventResult == NULL && IoEvent->EventResultSize == 0);
 
   if (SizeOfEventInfo <= DOKAN_EVENT_INFO_DEFAULT_BUFFER_SIZE) {
-    IoEvent->EventResult = PopEventResult();
+    IoEvent->EventResult = PopEventResult(IoEvent->DokanInstance->ObjectPools);
     IoEvent->EventResultSize = DOKAN_EVENT_INFO_DEFAULT_SIZE;
     IoEvent->PoolAllocated = TRUE;
   } else {
     if (UseExtraMemoryPool) {
       if (SizeOfEventInfo <= (16 * 1024)) {
-        IoEvent->EventResult = Pop16KEventResult();
+        IoEvent->EventResult =
+            Pop16KEventResult(IoEvent->DokanInstance->ObjectPools);
         IoEvent->EventResultSize = DOKAN_EVENT_INFO_16K_SIZE;
         IoEvent->PoolAllocated = TRUE;
       } else if (SizeOfEventInfo <= (32 * 1024)) {
-        IoEvent->EventResult = Pop32KEventResult();
+        IoEvent->EventResult =
+            Pop32KEventResult(IoEvent->DokanInstance->ObjectPools);
         IoEvent->EventResultSize = DOKAN_EVENT_INFO_32K_SIZE;
         IoEvent->PoolAllocated = TRUE;
       } else if (SizeOfEventInfo <= (64 * 1024)) {
-        IoEvent->EventResult = Pop64KEventResult();
+        IoEvent->EventResult =
+            Pop64KEventResult(IoEvent->DokanInstance->ObjectPools);
         IoEvent->EventResultSize = DOKAN_EVENT_INFO_64K_SIZE;
         IoEvent->PoolAllocated = TRUE;
       } else if (SizeOfEventInfo <= (128 * 1024)) {
-        IoEvent->EventResult = Pop128KEventResult();
+        IoEvent->EventResult =
+            Pop128KEventResult(IoEvent->DokanInstance->ObjectPools);
         IoEvent->EventResultSize = DOKAN_EVENT_INFO_128K_SIZE;
         IoEvent->PoolAllocated = TRUE;
       }
@@ -1005,7 +1553,11 @@ VOID ReleaseDokanOpenInfo(PDOKAN_IO_EVENT IoEvent) {
   }
   IoEvent->DokanFileInfo.Context = IoEvent->DokanOpenInfo->CloseUserContext;
   LeaveCriticalSection(&IoEvent->DokanOpenInfo->CriticalSection);
-  PushFileOpenInfo(IoEvent->DokanOpenInfo);
+  DokanWriteCoalescer_ReleaseOpen(IoEvent->DokanInstance->WriteCoalescer,
+                                  IoEvent->DokanOpenInfo);
+  DokanReadAhead_ReleaseOpen(IoEvent->DokanInstance->ReadAhead,
+                             IoEvent->DokanOpenInfo);
+  PushFileOpenInfo(IoEvent->DokanInstance->ObjectPools, IoEvent->DokanOpenInfo);
   IoEvent->DokanOpenInfo = NULL;
   if (IoEvent->EventResult) {
     // Reset the Kernel UserContext if we can. Close events do not have one.
@@ -1074,6 +1626,7 @@ BOOL SendGlobalReleaseIRP(LPCWSTR MountPoint) {
 }
 
 int DokanStart(_In_ PDOKAN_INSTANCE DokanInstance) {
+  DOKAN_OPTIONS legacyOptions;
   EVENT_START eventStart;
   PEVENT_DRIVER_INFO driverInfo;
   ULONG returnedLength = 0;
@@ -1126,6 +1679,9 @@ int DokanStart(_In_ PDOKAN_INSTANCE DokanInstance) {
   if (DokanInstance->DokanOptions->Options & DOKAN_OPTION_ALLOW_IPC_BATCHING) {
     eventStart.Flags |= DOKAN_EVENT_ALLOW_IPC_BATCHING;
   }
+  if (DokanInstance->DokanOptions->Options & DOKAN_OPTION_OMIT_IO_FILE_NAMES) {
+    eventStart.Flags |= DOKAN_EVENT_OMIT_IO_FILE_NAMES;
+  }
   if (driverLetter && mountManager &&
       !CheckDriveLetterAvailability(DokanInstance->MountPoint[0])) {
     eventStart.Flags |= DOKAN_EVENT_DRIVE_LETTER_IN_USE;
@@ -1156,6 +1712,9 @@ int DokanStart(_In_ PDOKAN_INSTANCE DokanInstance) {
 
   eventStart.IrpTimeout = DokanInstance->DokanOptions->Timeout;
   eventStart.FcbGarbageCollectionIntervalMs = 2000;
+  eventStart.PendingIrpShardCount =
+      GetTuningOptions(DokanInstance->DokanOptions, &legacyOptions)
+          ->PendingIrpShardCount;
 
   SendToDevice(DOKAN_GLOBAL_DEVICE_NAME, FSCTL_EVENT_START, &eventStart,
                sizeof(EVENT_START), driverInfo, sizeof(EVENT_DRIVER_INFO),
@@ -1474,6 +2033,22 @@ BOOL DOKANAPI DokanNotifyPath(_In_ DOKAN_HANDLE DokanInstance,
   }
   // remove the mount letter and colon from length, for example: "G:"
   length -= prefixSize;
+  if (instance->DirectoryListCache) {
+    DokanDirectoryListCache_Invalidate(instance->DirectoryListCache,
+                                       FilePath + prefixSize, length);
+  }
+  if (instance->FileInfoCache) {
+    DokanFileInfoCache_InvalidateTree(instance->FileInfoCache,
+                                      FilePath + prefixSize, length);
+  }
+  if (instance->ReadAhead) {
+    DokanReadAhead_Invalidate(instance->ReadAhead, FilePath + prefixSize,
+                              length, /*IncludeChildren=*/TRUE);
+  }
+  if (!instance->Transport->Mounted) {
+    // There is no driver to notify, only the caches of the instance.
+    return TRUE;
+  }
   ULONG returnedLength;
   ULONG inputLength = (ULONG)(sizeof(DOKAN_NOTIFY_PATH_INTERMEDIATE) +
                               (length * sizeof(WCHAR)));
@@ -1497,6 +2072,432 @@ BOOL DOKANAPI DokanNotifyPath(_In_ DOKAN_HANDLE DokanInstance,
   return TRUE;
 }
 
+BOOL DOKANAPI
+DokanGetCacheStatistics(_In_ DOKAN_HANDLE DokanInstance,
+                        _Out_opt_ PDOKAN_CACHE_STATISTICS FileInfoCache,
+                        _Out_opt_ PDOKAN_CACHE_STATISTICS DirectoryListCache) {
+  DOKAN_INSTANCE *instance = (DOKAN_INSTANCE *)DokanInstance;
+  if (!instance) {
+    return FALSE;
+  }
+  if (FileInfoCache) {
+    ZeroMemory(FileInfoCache, sizeof(DOKAN_CACHE_STATISTICS));
+    if (instance->FileInfoCache) {
+      DokanFileInfoCache_GetStatistics(instance->FileInfoCache, FileInfoCache);
+    }
+  }
+  if (DirectoryListCache) {
+    ZeroMemory(DirectoryListCache, sizeof(DOKAN_CACHE_STATISTICS));
+    if (instance->DirectoryListCache) {
+      DokanDirectoryListCache_GetStatistics(instance->DirectoryListCache,
+                                            DirectoryListCache);
+    }
+  }
+  return TRUE;
+}
+
+BOOL DOKANAPI
+DokanGetReadAheadStatistics(_In_ DOKAN_HANDLE DokanInstance,
+                            _Out_ PDOKAN_READ_AHEAD_STATISTICS Statistics) {
+  DOKAN_INSTANCE *instance = (DOKAN_INSTANCE *)DokanInstance;
+  if (!instance || !Statistics) {
+    return FALSE;
+  }
+  ZeroMemory(Statistics, sizeof(DOKAN_READ_AHEAD_STATISTICS));
+  if (instance->ReadAhead) {
+    DokanReadAhead_GetStatistics(instance->ReadAhead, Statistics);
+  }
+  return TRUE;
+}
+
+BOOL DOKANAPI DokanGetWriteCoalescingStatistics(
+    _In_ DOKAN_HANDLE DokanInstance,
+    _Out_ PDOKAN_WRITE_COALESCING_STATISTICS Statistics) {
+  DOKAN_INSTANCE *instance = (DOKAN_INSTANCE *)DokanInstance;
+  if (!instance || !Statistics) {
+    return FALSE;
+  }
+  ZeroMemory(Statistics, sizeof(DOKAN_WRITE_COALESCING_STATISTICS));
+  if (instance->WriteCoalescer) {
+    DokanWriteCoalescer_GetStatistics(instance->WriteCoalescer, Statistics);
+  }
+  return TRUE;
+}
+
+C_ASSERT(DokanPoolTypeCount == DOKAN_POOL_COUNT);
+
+BOOL DOKANAPI
+DokanGetPoolStatistics(_In_ DOKAN_HANDLE DokanInstance,
+                       _Out_ PDOKAN_POOL_USAGE_STATISTICS Statistics) {
+  DOKAN_INSTANCE *instance = (DOKAN_INSTANCE *)DokanInstance;
+  DOKAN_POOL_STATISTICS poolStatistics;
+  if (!instance || !Statistics) {
+    return FALSE;
+  }
+  ZeroMemory(Statistics, sizeof(DOKAN_POOL_USAGE_STATISTICS));
+  Statistics->InstancePools = instance->ObjectPools != GetGlobalObjectPools();
+  for (int type = 0; type < DokanPoolTypeCount; ++type) {
+    PDOKAN_OBJECT_POOL_STATISTICS pool = &Statistics->Pools[type];
+    GetPoolStatistics(instance->ObjectPools, type, &poolStatistics);
+    pool->Hits = poolStatistics.Hits;
+    pool->Misses = poolStatistics.Misses;
+    pool->DepotRefills = poolStatistics.DepotRefills;
+    pool->DepotSpills = poolStatistics.DepotSpills;
+    pool->Overflows = poolStatistics.Overflows;
+    pool->MemoryUsage = poolStatistics.CachedBytes + poolStatistics.InUseBytes;
+    pool->InUseMemory = poolStatistics.InUseBytes;
+    Statistics->Hits += pool->Hits;
+    Statistics->Misses += pool->Misses;
+    Statistics->DepotRefills += pool->DepotRefills;
+    Statistics->DepotSpills += pool->DepotSpills;
+    Statistics->Overflows += pool->Overflows;
+    Statistics->MemoryUsage += pool->MemoryUsage;
+    Statistics->InUseMemory += pool->InUseMemory;
+  }
+  return TRUE;
+}
+
+BOOL DOKANAPI
+DokanGetIoBatchStatistics(_In_ DOKAN_HANDLE DokanInstance,
+                          _Out_ PDOKAN_IO_BATCH_STATISTICS Statistics) {
+  DOKAN_INSTANCE *instance = (DOKAN_INSTANCE *)DokanInstance;
+  if (!instance || !Statistics) {
+    return FALSE;
+  }
+  ZeroMemory(Statistics, sizeof(DOKAN_IO_BATCH_STATISTICS));
+  if (instance->IoBatchSizer) {
+    DokanIoBatchSizer_GetStatistics(instance->IoBatchSizer, Statistics);
+  }
+  return TRUE;
+}
+
+BOOL DOKANAPI DokanGetStatistics(_In_ DOKAN_HANDLE DokanInstance,
+                                 _Out_opt_ PDOKAN_STATISTICS Statistics,
+                                 _In_ BOOL Reset) {
+  DOKAN_INSTANCE *instance = (DOKAN_INSTANCE *)DokanInstance;
+  if (!instance || !instance->Statistics) {
+    return FALSE;
+  }
+  return DokanStatistics_Get(instance->Statistics, Statistics, Reset);
+}
+
+BOOL DOKANAPI DokanStartEventRecording(_In_ DOKAN_HANDLE DokanInstance,
+                                       _In_ LPCWSTR TracePath) {
+  DOKAN_INSTANCE *instance = (DOKAN_INSTANCE *)DokanInstance;
+  DWORD error;
+  if (!instance || !instance->EventRecorder || !TracePath) {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return FALSE;
+  }
+  error = DokanEventRecorder_Start(instance->EventRecorder, TracePath);
+  if (error != ERROR_SUCCESS) {
+    SetLastError(error);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL DOKANAPI DokanStopEventRecording(_In_ DOKAN_HANDLE DokanInstance) {
+  DOKAN_INSTANCE *instance = (DOKAN_INSTANCE *)DokanInstance;
+  DWORD error;
+  if (!instance || !instance->EventRecorder) {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return FALSE;
+  }
+  error = DokanEventRecorder_Stop(instance->EventRecorder);
+  if (error != ERROR_SUCCESS) {
+    SetLastError(error);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// Dispatches the events of a BATCH record like DispatchBatchIoCallback, one
+// after the other on the current thread.
+static VOID ReplayEventBatch(PDOKAN_INSTANCE DokanInstance,
+                             PEVENT_CONTEXT EventContext, ULONG Length,
+                             PDOKAN_REPLAY_RESULT Result) {
+  PDOKAN_EVENT_REPLAYER replayer =
+      (PDOKAN_EVENT_REPLAYER)DokanInstance->TransportContext;
+  ULONG eventCount = DokanEventReplayer_CountEvents(EventContext, Length);
+  PDOKAN_IO_BATCH ioBatch;
+  PEVENT_CONTEXT context;
+
+  if (!eventCount) {
+    DokanDbgPrintW(L"Dokan Warning: Skipping an invalid batch of the event "
+                   L"trace.\n");
+    return;
+  }
+  // The dispatch modifies the events, it gets a copy of them.
+  ioBatch = malloc(DOKAN_IO_BATCH_SIZE(Length));
+  if (!ioBatch) {
+    DbgPrintW(L"Dokan Error: IoBatch allocation failed.\n");
+    Result->SkippedEvents += eventCount;
+    return;
+  }
+  RtlZeroMemory(ioBatch, FIELD_OFFSET(DOKAN_IO_BATCH, EventContext));
+  RtlCopyMemory(ioBatch->EventContext, EventContext, Length);
+  ioBatch->DokanInstance = DokanInstance;
+  ioBatch->NumberOfBytesTransferred = Length;
+  ioBatch->EventContextSize = Length;
+  ioBatch->MainPullThread = TRUE;
+  ioBatch->EventContextBatchCount = eventCount;
+  ioBatch->PullTime = DokanStatistics_Now();
+
+  context = ioBatch->EventContext;
+  for (ULONG i = 0; i < eventCount; ++i) {
+    // The batch stays valid while the next events hold it.
+    PEVENT_CONTEXT nextContext =
+        (PEVENT_CONTEXT)((PCHAR)context + context->Length);
+    PDOKAN_IO_EVENT ioEvent = NULL;
+    ULONG64 replayContext = 0;
+    if (context->Context &&
+        (!DokanEventTraceMap_Get(&replayer->Contexts, context->Context,
+                                 &replayContext) ||
+         !replayContext)) {
+      ++Result->SkippedEvents;
+      PushIoBatchBuffer(DokanInstance->ObjectPools, ioBatch);
+      context = nextContext;
+      continue;
+    }
+    context->Context = replayContext;
+    ioEvent = PopIoEventBuffer(DokanInstance->ObjectPools);
+    if (!ioEvent) {
+      DbgPrintW(L"Dokan Error: IoEvent allocation failed.\n");
+      ++Result->SkippedEvents;
+      PushIoBatchBuffer(DokanInstance->ObjectPools, ioBatch);
+      context = nextContext;
+      continue;
+    }
+    ioEvent->DokanInstance = DokanInstance;
+    ioEvent->EventContext = context;
+    ioEvent->IoBatch = ioBatch;
+    ++Result->Events;
+    // Released by the reply of CompletePendingEvent if the event is still
+    // pending.
+    DokanEventReplayer_AcquireEvent(replayer);
+    DispatchEvent(ioEvent);
+    if (DetachPendingEvent(ioEvent)) {
+      context = nextContext;
+      continue;
+    }
+    if (ioEvent->EventResult) {
+      if (context->MajorFunction == IRP_MJ_CREATE &&
+          ioEvent->EventResult->Context &&
+          !DokanEventTraceMap_Put(&replayer->Creates, context->SerialNumber,
+                                  ioEvent->EventResult->Context)) {
+        DbgPrintW(L"Dokan Error: Failed to keep the replayed open.\n");
+      }
+      FreeIoEventResult(DokanInstance->ObjectPools, ioEvent->EventResult,
+                        ioEvent->EventResultSize, ioEvent->PoolAllocated);
+    }
+    PushIoBatchBuffer(DokanInstance->ObjectPools, ioBatch);
+    PushIoEventBuffer(DokanInstance->ObjectPools, ioEvent);
+    DokanEventReplayer_ReleaseEvent(replayer);
+    context = nextContext;
+  }
+}
+
+BOOL DOKANAPI DokanReplayEventTrace(_In_ LPCWSTR TracePath,
+                                    _In_ PDOKAN_OPTIONS DokanOptions,
+                                    _In_ PDOKAN_OPERATIONS DokanOperations,
+                                    _Out_ PDOKAN_REPLAY_RESULT Result,
+                                    _Out_opt_ PDOKAN_STATISTICS Statistics) {
+  PDOKAN_INSTANCE dokanInstance;
+  PDOKAN_EVENT_REPLAYER replayer = NULL;
+  PDOKAN_EVENT_TRACE_RECORD record;
+  PCHAR data;
+  LONG64 start;
+  LONG64 frequency;
+  DWORD error;
+
+  if (!TracePath || !DokanOptions || !DokanOperations || !Result) {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return FALSE;
+  }
+  ZeroMemory(Result, sizeof(DOKAN_REPLAY_RESULT));
+  error = DokanEventReplayer_Open(TracePath, &replayer);
+  if (error != ERROR_SUCCESS) {
+    SetLastError(error);
+    return FALSE;
+  }
+
+  CheckAllocationUnitSectorSize(DokanOptions);
+  dokanInstance = NewDokanInstance();
+  if (!dokanInstance) {
+    DokanEventReplayer_Close(replayer);
+    SetLastError(ERROR_OUTOFMEMORY);
+    return FALSE;
+  }
+  dokanInstance->DokanOptions = DokanOptions;
+  dokanInstance->DokanOperations = DokanOperations;
+  dokanInstance->Transport = &g_DokanEventReplayTransport;
+  dokanInstance->TransportContext = replayer;
+  dokanInstance->IoBatchSizer = DokanIoBatchSizer_Alloc(/*Adaptive=*/FALSE);
+  dokanInstance->Statistics = DokanStatistics_Alloc();
+  if (!dokanInstance->IoBatchSizer || !dokanInstance->Statistics ||
+      !AllocateDokanInstanceCaches(dokanInstance)) {
+    DeleteDokanInstance(dokanInstance);
+    DokanEventReplayer_Close(replayer);
+    SetLastError(ERROR_OUTOFMEMORY);
+    return FALSE;
+  }
+
+  start = DokanStatistics_Now();
+  while ((record = DokanEventReplayer_Next(replayer, &data)) != NULL) {
+    switch (record->Type) {
+    case DOKAN_EVENT_TRACE_BATCH:
+      ReplayEventBatch(dokanInstance, (PEVENT_CONTEXT)data, record->Length,
+                       Result);
+      break;
+    case DOKAN_EVENT_TRACE_OPEN: {
+      // Stays 0 if the create failed in the replay, which also forgets a
+      // previous open that had the same recorded context.
+      ULONG64 replayContext = 0;
+      DokanEventTraceMap_Get(&replayer->Creates, record->SerialNumber,
+                             &replayContext);
+      if (!DokanEventTraceMap_Put(&replayer->Contexts, record->Context,
+                                  replayContext)) {
+        DbgPrintW(L"Dokan Error: Failed to keep the replayed open.\n");
+      }
+      break;
+    }
+    default:
+      // WRITE records are read by SendWriteRequest.
+      break;
+    }
+  }
+  DokanEventReplayer_WaitIdle(replayer);
+
+  frequency = dokanInstance->Statistics->Frequency;
+  Result->ElapsedMicroseconds =
+      (ULONG64)(DokanStatistics_Now() - start) * 1000000 / frequency;
+  Result->RecordedMicroseconds =
+      (ULONG64)replayer->Duration * 1000000 / replayer->Frequency;
+  if (Statistics) {
+    DokanStatistics_Get(dokanInstance->Statistics, Statistics,
+                        /*Reset=*/FALSE);
+  }
+  DeleteDokanInstance(dokanInstance);
+  DokanEventReplayer_Close(replayer);
+  return TRUE;
+}
+
+// Starts an instance dispatching the events of the loopback transport. On
+// failure, sets the last error and returns NULL, the caller frees Loopback.
+static PDOKAN_INSTANCE StartLoopbackInstance(PDOKAN_OPTIONS DokanOptions,
+                                             PDOKAN_OPERATIONS DokanOperations,
+                                             PDOKAN_LOOPBACK Loopback,
+                                             PLONG64 Start) {
+  PDOKAN_INSTANCE dokanInstance;
+  CheckAllocationUnitSectorSize(DokanOptions);
+  dokanInstance = NewDokanInstance();
+  if (!dokanInstance) {
+    SetLastError(ERROR_OUTOFMEMORY);
+    return NULL;
+  }
+  dokanInstance->DokanOptions = DokanOptions;
+  dokanInstance->DokanOperations = DokanOperations;
+  dokanInstance->Transport = &g_DokanLoopbackTransport;
+  dokanInstance->TransportContext = Loopback;
+  if (!AllocateDokanInstanceCaches(dokanInstance)) {
+    DeleteDokanInstance(dokanInstance);
+    SetLastError(ERROR_OUTOFMEMORY);
+    return NULL;
+  }
+
+  *Start = DokanStatistics_Now();
+  if (StartDokanInstanceDispatch(dokanInstance) != DOKAN_SUCCESS) {
+    // Fails the pull threads already started.
+    dokanInstance->FileSystemStopped = TRUE;
+    DokanLoopback_Stop(Loopback);
+    DeleteDokanInstance(dokanInstance);
+    SetLastError(ERROR_OUTOFMEMORY);
+    return NULL;
+  }
+  return dokanInstance;
+}
+
+PDOKAN_INSTANCE DokanStartLoopbackInstance(PDOKAN_OPTIONS DokanOptions,
+                                           PDOKAN_OPERATIONS DokanOperations) {
+  PDOKAN_INSTANCE dokanInstance;
+  PDOKAN_LOOPBACK loopback = NULL;
+  LONG64 start;
+  DWORD error = DokanLoopback_Alloc(
+      NULL, (DokanOptions->Options & DOKAN_OPTION_OMIT_IO_FILE_NAMES) != 0,
+      &loopback);
+  if (error != ERROR_SUCCESS) {
+    SetLastError(error);
+    return NULL;
+  }
+  dokanInstance =
+      StartLoopbackInstance(DokanOptions, DokanOperations, loopback, &start);
+  if (!dokanInstance) {
+    DokanLoopback_Free(loopback);
+  }
+  return dokanInstance;
+}
+
+VOID DokanStopLoopbackInstance(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_LOOPBACK loopback = (PDOKAN_LOOPBACK)DokanInstance->TransportContext;
+  DokanInstance->FileSystemStopped = TRUE;
+  DokanLoopback_Stop(loopback);
+  // Waits for the pull threads to exit.
+  DeleteDokanInstance(DokanInstance);
+  DokanLoopback_Free(loopback);
+}
+
+BOOL DOKANAPI
+DokanRunLoopbackBenchmark(_In_ PDOKAN_OPTIONS DokanOptions,
+                          _In_ PDOKAN_OPERATIONS DokanOperations,
+                          _In_ const DOKAN_LOOPBACK_WORKLOAD *Workload,
+                          _Out_ PDOKAN_LOOPBACK_RESULT Result,
+                          _Out_opt_ PDOKAN_STATISTICS Statistics) {
+  PDOKAN_INSTANCE dokanInstance;
+  PDOKAN_LOOPBACK loopback = NULL;
+  LONG64 start;
+  DWORD error;
+
+  if (!DokanOptions || !DokanOperations || !Workload || !Result) {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return FALSE;
+  }
+  ZeroMemory(Result, sizeof(DOKAN_LOOPBACK_RESULT));
+  error = DokanLoopback_Alloc(
+      Workload,
+      (DokanOptions->Options & DOKAN_OPTION_OMIT_IO_FILE_NAMES) != 0,
+      &loopback);
+  if (error != ERROR_SUCCESS) {
+    SetLastError(error);
+    return FALSE;
+  }
+
+  dokanInstance =
+      StartLoopbackInstance(DokanOptions, DokanOperations, loopback, &start);
+  if (!dokanInstance) {
+    DokanLoopback_Free(loopback);
+    return FALSE;
+  }
+  DokanLoopback_WaitCompleted(loopback);
+  Result->ElapsedMicroseconds = (ULONG64)(DokanStatistics_Now() - start) *
+                                1000000 /
+                                dokanInstance->Statistics->Frequency;
+
+  dokanInstance->FileSystemStopped = TRUE;
+  DokanLoopback_Stop(loopback);
+  if (Statistics) {
+    DokanStatistics_Get(dokanInstance->Statistics, Statistics,
+                        /*Reset=*/FALSE);
+  }
+  DokanGetWriteCoalescingStatistics((DOKAN_HANDLE)dokanInstance,
+                                    &Result->WriteCoalescing);
+  // Waits for the pull threads to exit.
+  DeleteDokanInstance(dokanInstance);
+  DokanLoopback_GetResult(loopback, Result);
+  DokanLoopback_Free(loopback);
+  return TRUE;
+}
+
 BOOL DOKANAPI DokanNotifyCreate(_In_ DOKAN_HANDLE DokanInstance,
                                 _In_ LPCWSTR FilePath, _In_ BOOL IsDirectory) {
   return DokanNotifyPath(DokanInstance, FilePath,
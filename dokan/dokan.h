@@ -56,9 +56,15 @@ extern "C" {
 /** @{ */
 
 /** The current Dokan version (200 means ver 2.0.0). \ref DOKAN_OPTIONS.Version */
-#define DOKAN_VERSION 230
+#define DOKAN_VERSION 240
 /** Minimum Dokan version (ver 2.0.0) accepted. */
 #define DOKAN_MINIMUM_COMPATIBLE_VERSION 200
+/**
+ * First version (ver 2.4.0) whose \ref DOKAN_OPTIONS has the fields following
+ * VolumeSecurityDescriptor. They are not read from the options of older
+ * versions and take their default values.
+ */
+#define DOKAN_OPTIONS_TUNING_VERSION 240
 /** Driver file name including the DOKAN_MAJOR_API_VERSION */
 #define DOKAN_DRIVER_NAME L"dokan" DOKAN_MAJOR_API_VERSION L".sys"
 /** Network provider name including the DOKAN_MAJOR_API_VERSION */
@@ -129,8 +135,126 @@ extern "C" {
  * Pull batches of events from the driver instead of a single one and execute them parallelly.
  * This option should only be used on computers with low cpu count
  * and userland filesystem taking time to process requests (like remote storage).
+ * The results of events completing at the same time are also sent back to the driver together.
  */
 #define DOKAN_OPTION_ALLOW_IPC_BATCHING (1 << 12)
+/**
+ * Stream directory listings straight into the reply sent to the kernel
+ * instead of caching the whole listing for the handle.
+ *
+ * \ref DOKAN_OPERATIONS.FindFiles or \ref DOKAN_OPERATIONS.FindFilesWithPattern
+ * is then called for every directory query and only the entries fitting in
+ * the reply are kept. The FillFindData callback returns 1 once the reply is
+ * full and the implementation should stop the enumeration at that point.
+ * Entries must be reported in the same order on each call since queries
+ * resume at the position where the previous one stopped.
+ * The "." and ".." entries are generated by the library.
+ * This greatly reduces memory usage for huge directories. The implementation
+ * should start its enumeration at \ref DokanGetFindFilesStartIndex. Otherwise
+ * the library skips the entries already returned, which makes listing a
+ * directory quadratic in its number of entries.
+ */
+#define DOKAN_OPTION_STREAM_FIND_FILES (1 << 13)
+/**
+ * Share directory listings between the handles of the mount.
+ *
+ * The result of \ref DOKAN_OPERATIONS.FindFiles or
+ * \ref DOKAN_OPERATIONS.FindFilesWithPattern is kept for
+ * \ref DOKAN_OPTIONS.DirectoryListCacheTimeout and reused when another handle
+ * lists the same directory. A listing is dropped when a file is created,
+ * deleted, renamed or has its information changed through the mount, or
+ * when the file system reports a change with \ref DokanNotifyCreate,
+ * \ref DokanNotifyDelete, \ref DokanNotifyUpdate or \ref DokanNotifyRename.
+ * Changes made to the backing storage outside of the mount are only seen once
+ * the listing expires unless they are notified.
+ * This option is ignored when \ref DOKAN_OPTION_STREAM_FIND_FILES is enabled.
+ */
+#define DOKAN_OPTION_DIRECTORY_LIST_CACHE (1 << 14)
+/**
+ * Keep the results of \ref DOKAN_OPERATIONS.GetFileInformation for
+ * \ref DOKAN_OPTIONS.FileInfoCacheTimeout and answer the following queries of
+ * the same file and \ref DOKAN_FILE_INFO.Context from it.
+ * Entries listed by \ref DOKAN_OPERATIONS.FindFiles or
+ * \ref DOKAN_OPERATIONS.FindFilesWithPattern are also kept and answer the
+ * queries only needing the attributes, times and size of the file.
+ * An entry is dropped when the file is written, has its information changed,
+ * is renamed or deleted through the mount, or when the file system reports a
+ * change with the DokanNotify functions.
+ * Hits and misses can be read with \ref DokanGetCacheStatistics.
+ */
+#define DOKAN_OPTION_FILE_INFO_CACHE (1 << 15)
+/**
+ * Identify the file of \ref DOKAN_OPERATIONS.ReadFile,
+ * \ref DOKAN_OPERATIONS.WriteFile, \ref DOKAN_OPERATIONS.FlushFileBuffers and
+ * \ref DOKAN_OPERATIONS.GetFileInformation only by \ref DOKAN_FILE_INFO.Context.
+ *
+ * The kernel no longer sends the file name with these requests, which saves
+ * copying it for every read and write of deep paths. The FileName given to
+ * these callbacks is then empty, and the ones needing the name can retrieve
+ * it with \ref DokanGetFileName.
+ * \ref DOKAN_OPTION_FILE_INFO_CACHE is ignored when this option is enabled.
+ */
+#define DOKAN_OPTION_OMIT_IO_FILE_NAMES (1 << 16)
+/**
+ * Read ahead of the opens reading a file sequentially.
+ *
+ * Once an open reads consecutive ranges, the library issues larger
+ * \ref DOKAN_OPERATIONS.ReadFile calls of \ref DOKAN_OPTIONS.ReadAheadSize
+ * bytes ahead of it on the thread pool and answers its next reads from
+ * memory. These speculative reads have the \ref DOKAN_FILE_INFO of the read
+ * that triggered them and can complete asynchronously like any read.
+ * Reads of ReadAheadSize bytes or more never trigger them.
+ * The data read ahead is dropped when the file is written, truncated or
+ * renamed through the mount, or when the file system reports a change with
+ * the DokanNotify functions. Changes made to the backing storage outside of
+ * the mount are not seen by the reads answered from memory.
+ * Hits and misses can be read with \ref DokanGetReadAheadStatistics.
+ */
+#define DOKAN_OPTION_READ_AHEAD (1 << 17)
+/**
+ * Coalesce the small sequential writes of each open before passing them to
+ * \ref DOKAN_OPERATIONS.WriteFile.
+ *
+ * A write smaller than \ref DOKAN_OPTIONS.WriteCoalescingSize that continues
+ * the previous write of its open is copied to a per-open buffer and completed
+ * at once with success. The buffer is passed to WriteFile in a single call,
+ * with the \ref DOKAN_FILE_INFO of the open, when it is full, when
+ * \ref DOKAN_OPTIONS.WriteCoalescingTimeout elapsed since its first write, when
+ * a write does not continue it, and before any other operation on the same
+ * open, including FlushFileBuffers and Cleanup.
+ * Paging, non cached and write to end of file writes are never buffered.
+ *
+ * Consistency guarantees:
+ * - The writes of an open reach WriteFile in their order, before any later
+ *   operation on the same open. FlushFileBuffers is called only once all the
+ *   earlier writes of the open reached WriteFile.
+ * - A write completed to the application but still buffered is lost if the
+ *   file system process exits or crashes. At most WriteCoalescingSize bytes
+ *   per open, written during the last WriteCoalescingTimeout milliseconds,
+ *   can be lost this way.
+ * - The other opens of the file, in this process or not, see the buffered
+ *   data only once it reached WriteFile.
+ * - A failed or short WriteFile of buffered data is returned by the next
+ *   FlushFileBuffers of the open. It is only logged if the open has none.
+ * Counters can be read with \ref DokanGetWriteCoalescingStatistics.
+ */
+#define DOKAN_OPTION_WRITE_COALESCING (1 << 18)
+/**
+ * Give the mount object pools of its own instead of the pools shared by all
+ * the mounts of the process.
+ *
+ * The buffers of the events, their results and the open contexts are reused
+ * through pools to avoid allocating them for each request. By default every
+ * mount of the process takes them from and returns them to the same pools,
+ * so a busy mount can drain them at the expense of the others. With this
+ * option the mount gets its own pools, sized by
+ * \ref DOKAN_OPTIONS.PoolMaxCount and filled with
+ * \ref DOKAN_OPTIONS.PoolPrewarmCount objects at mount time. They are freed
+ * at unmount. The shared pools are used if they cannot be allocated.
+ * Their counters and memory usage can be read with
+ * \ref DokanGetPoolStatistics.
+ */
+#define DOKAN_OPTION_INSTANCE_POOLS (1 << 19)
 
 /** @} */
 
@@ -172,6 +296,71 @@ typedef struct _DOKAN_OPTIONS {
   ULONG VolumeSecurityDescriptorLength;
   /** Optional Volume Security descriptor. See <a href="https://docs.microsoft.com/en-us/windows/win32/api/securitybaseapi/nf-securitybaseapi-initializesecuritydescriptor">InitializeSecurityDescriptor</a> */
   CHAR VolumeSecurityDescriptor[VOLUME_SECURITY_DESCRIPTOR_MAX_SIZE];
+  // The fields below are only read when Version is at least
+  // DOKAN_OPTIONS_TUNING_VERSION.
+  /**
+   * Time in milliseconds a directory listing stays cached when
+   * \ref DOKAN_OPTION_DIRECTORY_LIST_CACHE is enabled. Set 0 to use the default of 2 seconds.
+   */
+  ULONG DirectoryListCacheTimeout;
+  /**
+   * Maximum memory in bytes used by the cached directory listings when
+   * \ref DOKAN_OPTION_DIRECTORY_LIST_CACHE is enabled. Least recently used
+   * listings are dropped above it. Set 0 to use the default of 64MB.
+   */
+  ULONG DirectoryListCacheMaxSize;
+  /**
+   * Time in milliseconds a file information stays cached when
+   * \ref DOKAN_OPTION_FILE_INFO_CACHE is enabled. Set 0 to use the default of 1 second.
+   */
+  ULONG FileInfoCacheTimeout;
+  /**
+   * Number of shards the driver splits the pending requests of the mount into,
+   * each with its own lock, to reduce contention when many threads issue
+   * requests at once. It is rounded down to a power of 2 and capped by the
+   * driver. Set 0 to use one shard per processor.
+   */
+  ULONG PendingIrpShardCount;
+  /**
+   * Size in bytes of the speculative reads when \ref DOKAN_OPTION_READ_AHEAD
+   * is enabled. Set 0 to use the default of 1MB.
+   */
+  ULONG ReadAheadSize;
+  /**
+   * Maximum memory in bytes used by the read-ahead of the mount when
+   * \ref DOKAN_OPTION_READ_AHEAD is enabled. Each open reading ahead uses up
+   * to 3 times ReadAheadSize. No speculative read is issued above it, and
+   * ReadAheadSize is reduced to a third of it if larger. Set 0 to use the
+   * default of 64MB.
+   */
+  ULONG ReadAheadMaxMemory;
+  /**
+   * Size in bytes of the buffer of each open writing when
+   * \ref DOKAN_OPTION_WRITE_COALESCING is enabled. Only smaller writes are
+   * buffered. Set 0 to use the default of 1MB.
+   */
+  ULONG WriteCoalescingSize;
+  /**
+   * Maximum time in milliseconds a write stays buffered when
+   * \ref DOKAN_OPTION_WRITE_COALESCING is enabled. Set 0 to use the default of
+   * 100 milliseconds.
+   */
+  ULONG WriteCoalescingTimeout;
+  /**
+   * Number of free objects each pool of the mount keeps when
+   * \ref DOKAN_OPTION_INSTANCE_POOLS is enabled. The pools of large results
+   * and of directory listings keep an eighth of it. Each thread processing
+   * requests can keep up to 64 more objects per pool aside. Set 0 to use the
+   * default of 1024.
+   */
+  ULONG PoolMaxCount;
+  /**
+   * Number of event buffers, event results and open contexts allocated in
+   * the pools of the mount at mount time when \ref DOKAN_OPTION_INSTANCE_POOLS
+   * is enabled. It is capped by PoolMaxCount. Set 0 to allocate them on
+   * demand.
+   */
+  ULONG PoolPrewarmCount;
 } DOKAN_OPTIONS, *PDOKAN_OPTIONS;
 
 /**
@@ -228,7 +417,8 @@ typedef struct _DOKAN_FILE_INFO {
 
 /**
  * \brief FillFindData Used to add an entry in FindFiles operation
- * \return 1 if buffer is full, otherwise 0 (currently it never returns 1)
+ * \return 1 if buffer is full, otherwise 0. It only returns 1 when
+ * \ref DOKAN_OPTION_STREAM_FIND_FILES is enabled.
  */
 typedef int(WINAPI *PFillFindData)(PWIN32_FIND_DATAW, PDOKAN_FILE_INFO);
 
@@ -337,13 +527,17 @@ typedef struct _DOKAN_OPERATIONS {
   * functions may be invoked after DOKAN_OPERATIONS.Cleanup in order to complete the I/O operations.
   * The file system application should also properly work in this case.
   *
+  * The read can be completed asynchronously by returning \c STATUS_PENDING and
+  * later calling \ref DokanEndDispatchRead from any thread. Buffer and
+  * DokanFileInfo stay valid until then.
+  *
   * \param FileName File path requested by the Kernel on the FileSystem.
   * \param Buffer Read buffer that has to be filled with the read result.
   * \param BufferLength Buffer length and read size to continue with.
   * \param ReadLength Total data size that has been read.
   * \param Offset Offset from where the read has to be continued.
   * \param DokanFileInfo Information about the file or directory.
-  * \return \c STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * \return \c STATUS_SUCCESS on success, \c STATUS_PENDING if the read will be completed with \ref DokanEndDispatchRead or NTSTATUS appropriate to the request result.
   * \see WriteFile
   */
   NTSTATUS(DOKAN_CALLBACK *ReadFile)(LPCWSTR FileName,
@@ -364,6 +558,10 @@ typedef struct _DOKAN_OPERATIONS {
   * functions may be invoked after DOKAN_OPERATIONS.Cleanup in order to complete the I/O operations.
   * The file system application should also properly work in this case.
   * This type of request should follow Windows rules like not extending the current file size.
+  *
+  * The write can be completed asynchronously by returning \c STATUS_PENDING and
+  * later calling \ref DokanEndDispatchWrite from any thread. Buffer and
+  * DokanFileInfo stay valid until then.
   * 
   * \param FileName File path requested by the Kernel on the FileSystem.
   * \param Buffer Data that has to be written.
@@ -371,7 +569,7 @@ typedef struct _DOKAN_OPERATIONS {
   * \param NumberOfBytesWritten Total number of bytes that have been written.
   * \param Offset Offset from where the write has to be continued.
   * \param DokanFileInfo Information about the file or directory.
-  * \return \c STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * \return \c STATUS_SUCCESS on success, \c STATUS_PENDING if the write will be completed with \ref DokanEndDispatchWrite or NTSTATUS appropriate to the request result.
   * \see ReadFile
   */
   NTSTATUS(DOKAN_CALLBACK *WriteFile)(LPCWSTR FileName,
@@ -1118,6 +1316,578 @@ BOOL DOKANAPI DokanNotifyRename(_In_ DOKAN_HANDLE DokanInstance,
 
 /**@}*/
 
+/**
+ * \struct DOKAN_CACHE_STATISTICS
+ * \brief Counters of a library cache.
+ * \see DokanGetCacheStatistics
+ */
+typedef struct _DOKAN_CACHE_STATISTICS {
+  /** Queries answered from the cache. */
+  ULONG64 Hits;
+  /** Queries forwarded to the file system. */
+  ULONG64 Misses;
+  /** Entries dropped because their file changed. */
+  ULONG64 Invalidations;
+  /** Entries dropped to stay within the cache limits. */
+  ULONG64 Evictions;
+  /** Number of entries currently cached. */
+  ULONG EntryCount;
+  /** Memory in bytes used by the entries currently cached. */
+  ULONG64 MemoryUsage;
+} DOKAN_CACHE_STATISTICS, *PDOKAN_CACHE_STATISTICS;
+
+/**
+ * \struct DOKAN_IO_BATCH_STATISTICS
+ * \brief Counters of the buffers pulling events from the driver.
+ * \see DokanGetIoBatchStatistics
+ */
+typedef struct _DOKAN_IO_BATCH_STATISTICS {
+  /** Size in bytes of the buffers of the next pulls. */
+  ULONG BufferSize;
+  /** Largest size in bytes the buffers reached. */
+  ULONG PeakBufferSize;
+  /** Pulls made from the driver. */
+  ULONG64 Pulls;
+  /** Pulls that returned no event. */
+  ULONG64 EmptyPulls;
+  /** Bytes of events returned by the pulls. */
+  ULONG64 BytesPulled;
+  /** Times the buffer size doubled because the pulls filled the buffers. */
+  ULONG64 Grows;
+  /** Times the buffer size halved because the pulls barely used the buffers. */
+  ULONG64 Shrinks;
+} DOKAN_IO_BATCH_STATISTICS, *PDOKAN_IO_BATCH_STATISTICS;
+
+/**
+ * \brief Retrieve the counters of the buffers pulling events from the driver.
+ *
+ * The buffer size only adapts to the load when
+ * \ref DOKAN_OPTION_ALLOW_IPC_BATCHING is enabled. Otherwise the driver returns
+ * a single event per pull and the smallest size is used.
+ *
+ * \param DokanInstance The dokan mount context created by \ref DokanCreateFileSystem .
+ * \param Statistics Receives the counters.
+ * \return \c TRUE if the counters were retrieved.
+ */
+BOOL DOKANAPI
+DokanGetIoBatchStatistics(_In_ DOKAN_HANDLE DokanInstance,
+                          _Out_ PDOKAN_IO_BATCH_STATISTICS Statistics);
+
+/** Number of buckets of a \ref DOKAN_LATENCY_HISTOGRAM */
+#define DOKAN_LATENCY_HISTOGRAM_BUCKET_COUNT 124
+/** Number of operations of \ref DOKAN_STATISTICS, one per IRP major function */
+#define DOKAN_STATISTICS_OPERATION_COUNT 0x1c
+
+/**
+ * \struct DOKAN_LATENCY_HISTOGRAM
+ * \brief Distribution of the durations of an operation, in microseconds.
+ *
+ * Buckets 0 to 3 count the durations of 0 to 3 microseconds. Above, each power
+ * of two is split in 4 buckets of the same width: bucket \c i starts at
+ * <tt>(4 + i % 4) << (i / 4 - 1)</tt> microseconds. The last bucket also
+ * counts the longer durations.
+ * \see DokanGetLatencyPercentile
+ */
+typedef struct _DOKAN_LATENCY_HISTOGRAM {
+  /** Number of durations recorded. */
+  ULONG64 Count;
+  /** Sum of the durations recorded, in microseconds. */
+  ULONG64 TotalMicroseconds;
+  /** Number of durations recorded in each bucket. */
+  ULONG64 Buckets[DOKAN_LATENCY_HISTOGRAM_BUCKET_COUNT];
+} DOKAN_LATENCY_HISTOGRAM, *PDOKAN_LATENCY_HISTOGRAM;
+
+/**
+ * \struct DOKAN_OPERATION_STATISTICS
+ * \brief Latencies of the events of an IRP major function.
+ * \see DokanGetStatistics
+ */
+typedef struct _DOKAN_OPERATION_STATISTICS {
+  /** Events whose callback returned \c STATUS_PENDING. */
+  ULONG64 PendingEvents;
+  /** From the pull of the event from the driver to the start of its dispatch. */
+  DOKAN_LATENCY_HISTOGRAM QueueTime;
+  /** Time spent dispatching the event, including the file system callback. */
+  DOKAN_LATENCY_HISTOGRAM CallbackTime;
+  /**
+   * From the pull of the event to its result being ready to be sent to the
+   * driver. Includes the time until the completion of pending events.
+   */
+  DOKAN_LATENCY_HISTOGRAM TotalTime;
+} DOKAN_OPERATION_STATISTICS, *PDOKAN_OPERATION_STATISTICS;
+
+/**
+ * \struct DOKAN_STATISTICS
+ * \brief Latencies of the events dispatched by a mount.
+ *
+ * This structure is large, prefer allocating it on the heap.
+ * \see DokanGetStatistics
+ */
+typedef struct _DOKAN_STATISTICS {
+  /** Indexed by IRP major function, like IRP_MJ_READ. */
+  DOKAN_OPERATION_STATISTICS Operations[DOKAN_STATISTICS_OPERATION_COUNT];
+} DOKAN_STATISTICS, *PDOKAN_STATISTICS;
+
+/**
+ * \brief Retrieve the latencies of the events dispatched by a mount.
+ *
+ * The latencies are always recorded, each dispatching thread in its own
+ * counters. They are merged when retrieved.
+ *
+ * \param DokanInstance The dokan mount context created by \ref DokanCreateFileSystem .
+ * \param Statistics Receives the latencies recorded since the mount or the last reset. Can be NULL.
+ * \param Reset Whether to restart recording from zero after retrieving them.
+ * \return \c TRUE if the latencies were retrieved.
+ */
+BOOL DOKANAPI DokanGetStatistics(_In_ DOKAN_HANDLE DokanInstance,
+                                 _Out_opt_ PDOKAN_STATISTICS Statistics,
+                                 _In_ BOOL Reset);
+
+/**
+ * \brief Estimate a percentile of a latency histogram.
+ *
+ * \param Histogram A histogram retrieved by \ref DokanGetStatistics .
+ * \param Percentile The percentile to estimate, between 0 and 100.
+ * \return The upper bound in microseconds of the bucket holding the
+ * percentile, or 0 if the histogram is empty.
+ */
+ULONG64 DOKANAPI
+DokanGetLatencyPercentile(_In_ const DOKAN_LATENCY_HISTOGRAM *Histogram,
+                          _In_ double Percentile);
+
+/**
+ * \brief Start recording the events a mount receives from the driver.
+ *
+ * The events are written to a trace file as they are pulled, in the format
+ * of the driver. The trace can be fed again to any file system with
+ * \ref DokanReplayEventTrace . It holds the names and the written data of the
+ * files, treat it like the content of the volume.
+ *
+ * \param DokanInstance The dokan mount context created by \ref DokanCreateFileSystem .
+ * \param TracePath Path of the trace file. An existing file is replaced.
+ * \return \c TRUE if the recording started. Otherwise \c FALSE and GetLastError returns the error.
+ * \see DokanStopEventRecording
+ */
+BOOL DOKANAPI DokanStartEventRecording(_In_ DOKAN_HANDLE DokanInstance,
+                                       _In_ LPCWSTR TracePath);
+
+/**
+ * \brief Stop the recording started by \ref DokanStartEventRecording .
+ *
+ * Unmounting also stops the recording.
+ *
+ * \param DokanInstance The dokan mount context created by \ref DokanCreateFileSystem .
+ * \return \c TRUE if the whole trace was written. Otherwise \c FALSE and GetLastError returns the error.
+ */
+BOOL DOKANAPI DokanStopEventRecording(_In_ DOKAN_HANDLE DokanInstance);
+
+/**
+ * \struct DOKAN_REPLAY_RESULT
+ * \brief Result of \ref DokanReplayEventTrace .
+ */
+typedef struct _DOKAN_REPLAY_RESULT {
+  /** Number of events dispatched. */
+  ULONG64 Events;
+  /**
+   * Number of events not dispatched because their open is not known, like
+   * when the recording started after it or its create failed in the replay.
+   */
+  ULONG64 SkippedEvents;
+  /** Time the replay took, including the completion of pending events. */
+  ULONG64 ElapsedMicroseconds;
+  /** Time between the start of the recording and its last event. */
+  ULONG64 RecordedMicroseconds;
+} DOKAN_REPLAY_RESULT, *PDOKAN_REPLAY_RESULT;
+
+/**
+ * \brief Dispatch the events of a trace to a file system, without a driver.
+ *
+ * The events recorded by \ref DokanStartEventRecording are dispatched in their
+ * order, as fast as possible, on the calling thread. The callbacks are called
+ * as for a mount with the same options, except Mounted and Unmounted. Callbacks
+ * returning \c STATUS_PENDING are waited for before returning.
+ *
+ * The file system must be in the state it had when the recording started
+ * for the events to have the same results. The files the trace does not
+ * close are not closed.
+ *
+ * \ref DokanInit must have been called.
+ *
+ * \param TracePath Path of the trace file.
+ * \param DokanOptions The options of the replayed mount. MountPoint is not used.
+ * \param DokanOperations The file system to dispatch the events to.
+ * \param Result Receives the number of events and the duration of the replay.
+ * \param Statistics Receives the latencies of the replayed events. Can be NULL.
+ * \return \c TRUE if the trace was replayed. Otherwise \c FALSE and GetLastError returns the error.
+ */
+BOOL DOKANAPI DokanReplayEventTrace(_In_ LPCWSTR TracePath,
+                                    _In_ PDOKAN_OPTIONS DokanOptions,
+                                    _In_ PDOKAN_OPERATIONS DokanOperations,
+                                    _Out_ PDOKAN_REPLAY_RESULT Result,
+                                    _Out_opt_ PDOKAN_STATISTICS Statistics);
+
+/**
+ * \struct DOKAN_LOOPBACK_WORKLOAD
+ * \brief Synthetic events generated by \ref DokanRunLoopbackBenchmark .
+ *
+ * Concurrency files named \\DokanLoopback<N>, in FileNameDepth directories
+ * named \\DokanLoopbackDirectory<D>, are each opened OpensPerFile times with
+ * \c FILE_OPEN_IF. Every open runs OperationsPerOpen reads, writes and basic
+ * information queries picked at random with the given weights, then is
+ * cleaned up and closed. The files of an open do not wait for each
+ * other, a file waits for the reply of its event before the next one.
+ *
+ * With a DirectoryQueryBufferLength, the files open the directory holding
+ * them instead and list it OperationsPerOpen times.
+ */
+typedef struct _DOKAN_LOOPBACK_WORKLOAD {
+  /** Number of files with an event in flight at the same time. */
+  ULONG Concurrency;
+  /** Number of times each file is opened. */
+  ULONG OpensPerFile;
+  /** Number of reads, writes and queries of each open. */
+  ULONG OperationsPerOpen;
+  /** Relative frequency of the reads. */
+  ULONG ReadWeight;
+  /** Relative frequency of the writes. */
+  ULONG WriteWeight;
+  /** Relative frequency of the basic information queries. */
+  ULONG QueryInformationWeight;
+  /**
+   * Size in bytes of the reads and writes. They access the first FileBlocks
+   * blocks of this size of the files.
+   */
+  ULONG IoSize;
+  /**
+   * Maximum number of events returned by a pull, 0 to fill the buffers. Like
+   * with the driver, a pull returns a single event unless the options allow
+   * \c DOKAN_OPTION_ALLOW_IPC_BATCHING.
+   */
+  ULONG MaxBatchEvents;
+  /** Seed of the operation picks, the same seed generates the same events. */
+  ULONG Seed;
+  /**
+   * Number of blocks of IoSize accessed in the files, 0 for 16. The operation
+   * N of an open accesses the block N modulo FileBlocks, so a workload of
+   * writes only with OperationsPerOpen blocks writes each file sequentially,
+   * like a log.
+   */
+  ULONG FileBlocks;
+  /**
+   * Number of directories above the files, at most
+   * \ref DOKAN_LOOPBACK_MAX_FILE_NAME_DEPTH. Deeper names cost more to send
+   * and dispatch, unless \ref DOKAN_OPTION_OMIT_IO_FILE_NAMES leaves them out
+   * of the reads, writes and queries.
+   */
+  ULONG FileNameDepth;
+  /**
+   * Buffer length in bytes of the directory queries, 0 for reads, writes and
+   * queries. Otherwise the operations of an open are listings of the
+   * directory of the files, the root when FileNameDepth is 0. A listing is a
+   * FileBothDirectoryInformation query restarting the scan followed by
+   * queries continuing it, like FindFirstFile and FindNextFile, until
+   * \c STATUS_NO_MORE_FILES.
+   */
+  ULONG DirectoryQueryBufferLength;
+  /** Search pattern of the directory queries, NULL to list every entry. */
+  LPCWSTR DirectorySearchPattern;
+} DOKAN_LOOPBACK_WORKLOAD, *PDOKAN_LOOPBACK_WORKLOAD;
+
+/** Maximum DOKAN_LOOPBACK_WORKLOAD.FileNameDepth. */
+#define DOKAN_LOOPBACK_MAX_FILE_NAME_DEPTH 8
+
+/**
+ * \struct DOKAN_WRITE_COALESCING_STATISTICS
+ * \brief Counters of the write coalescing of a mount.
+ * \see DokanGetWriteCoalescingStatistics
+ */
+typedef struct _DOKAN_WRITE_COALESCING_STATISTICS {
+  /** Writes completed from the buffers. */
+  ULONG64 BufferedWrites;
+  /** Writes passed to the file system as they came. */
+  ULONG64 DirectWrites;
+  /** WriteFile calls of buffered data. */
+  ULONG64 Flushes;
+  /** Flushes made because the buffer was full. */
+  ULONG64 FullFlushes;
+  /** Flushes made because WriteCoalescingTimeout elapsed. */
+  ULONG64 TimeoutFlushes;
+  /** Bytes passed to the file system by the flushes. */
+  ULONG64 FlushedBytes;
+  /** Flushes that failed or did not write everything. */
+  ULONG64 FailedFlushes;
+  /** Memory in bytes currently used by the buffers. */
+  ULONG64 MemoryUsage;
+} DOKAN_WRITE_COALESCING_STATISTICS, *PDOKAN_WRITE_COALESCING_STATISTICS;
+
+/**
+ * \struct DOKAN_LOOPBACK_RESULT
+ * \brief Result of \ref DokanRunLoopbackBenchmark .
+ */
+typedef struct _DOKAN_LOOPBACK_RESULT {
+  /** Number of events pulled. */
+  ULONG64 Events;
+  /**
+   * Number of replies of an unexpected size, serial number or status. A create
+   * must succeed, a write must write everything and a read must succeed or
+   * reach the end of file.
+   */
+  ULONG64 InvalidReplies;
+  /** Number of pulls that returned events. */
+  ULONG64 Pulls;
+  /** Number of replies received. */
+  ULONG64 Replies;
+  /**
+   * Number of calls that sent replies. Replies / ReplyIoctls is the number of
+   * replies sent per call to the driver.
+   */
+  ULONG64 ReplyIoctls;
+  /**
+   * Number of pulls that sent no reply but a timeout, made by the main pull
+   * threads while the batch size can shrink.
+   */
+  ULONG64 TimeoutOnlyPulls;
+  /** Number of entries returned by the directory queries. */
+  ULONG64 DirectoryEntries;
+  /** Time between the start of the pull threads and the last event. */
+  ULONG64 ElapsedMicroseconds;
+  /**
+   * Counters of the \ref DOKAN_OPTION_WRITE_COALESCING write coalescing at the
+   * end of the run, set to 0 when it is not enabled.
+   */
+  DOKAN_WRITE_COALESCING_STATISTICS WriteCoalescing;
+} DOKAN_LOOPBACK_RESULT, *PDOKAN_LOOPBACK_RESULT;
+
+/**
+ * \brief Run a synthetic workload through the dispatch of a file system,
+ * without a driver.
+ *
+ * The events are generated in process and pulled by the same threads, with
+ * the same batching, as for a mount with the given options. This measures
+ * the throughput of the library and the file system callbacks alone.
+ * Callbacks are called as for a mount except Mounted and Unmounted. The
+ * written data are a byte pattern.
+ *
+ * \ref DokanInit must have been called.
+ *
+ * \param DokanOptions The options of the simulated mount. MountPoint is not used.
+ * \param DokanOperations The file system to dispatch the events to.
+ * \param Workload The events to generate.
+ * \param Result Receives the number of events, the duration and the counters of the run.
+ * \param Statistics Receives the latencies of the events. Can be NULL.
+ * \return \c TRUE if the whole workload ran. Otherwise \c FALSE and GetLastError returns the error.
+ */
+BOOL DOKANAPI
+DokanRunLoopbackBenchmark(_In_ PDOKAN_OPTIONS DokanOptions,
+                          _In_ PDOKAN_OPERATIONS DokanOperations,
+                          _In_ const DOKAN_LOOPBACK_WORKLOAD *Workload,
+                          _Out_ PDOKAN_LOOPBACK_RESULT Result,
+                          _Out_opt_ PDOKAN_STATISTICS Statistics);
+
+/**
+ * \struct DOKAN_READ_AHEAD_STATISTICS
+ * \brief Counters of the read-ahead of a mount.
+ * \see DokanGetReadAheadStatistics
+ */
+typedef struct _DOKAN_READ_AHEAD_STATISTICS {
+  /** Reads answered from the data read ahead. */
+  ULONG64 Hits;
+  /** Reads forwarded to the file system. */
+  ULONG64 Misses;
+  /** Speculative reads issued to the file system. */
+  ULONG64 SpeculativeReads;
+  /** Bytes returned by the speculative reads. */
+  ULONG64 SpeculativeReadBytes;
+  /** Speculative reads not issued to stay within the memory limit. */
+  ULONG64 SkippedSpeculativeReads;
+  /** Times the data read ahead for an open was dropped because the file changed. */
+  ULONG64 Invalidations;
+  /** Memory in bytes currently used. */
+  ULONG64 MemoryUsage;
+} DOKAN_READ_AHEAD_STATISTICS, *PDOKAN_READ_AHEAD_STATISTICS;
+
+/** Number of object pools in \ref DOKAN_POOL_USAGE_STATISTICS.Pools. */
+#define DOKAN_POOL_COUNT 9
+
+/**
+ * \struct DOKAN_OBJECT_POOL_STATISTICS
+ * \brief Counters of one object pool.
+ * \see DOKAN_POOL_USAGE_STATISTICS
+ */
+typedef struct _DOKAN_OBJECT_POOL_STATISTICS {
+  /** Objects reused from the pool. */
+  ULONG64 Hits;
+  /** Objects allocated because the pool was empty. */
+  ULONG64 Misses;
+  /**
+   * Times a thread had to take objects from the depot shared by all threads.
+   * With DepotSpills, shows how often the threads contend on the pool.
+   */
+  ULONG64 DepotRefills;
+  /** Times a thread had to give objects back to the shared depot. */
+  ULONG64 DepotSpills;
+  /** Objects freed because the pool was full. */
+  ULONG64 Overflows;
+  /**
+   * Memory in bytes currently used by the objects of the pool, free or in
+   * use.
+   */
+  ULONG64 MemoryUsage;
+  /**
+   * Part of MemoryUsage used by the objects handed out and not released yet.
+   * Not counted for directory lists.
+   */
+  ULONG64 InUseMemory;
+} DOKAN_OBJECT_POOL_STATISTICS, *PDOKAN_OBJECT_POOL_STATISTICS;
+
+/**
+ * \struct DOKAN_POOL_USAGE_STATISTICS
+ * \brief Counters of the object pools used by a mount.
+ * \see DokanGetPoolStatistics
+ */
+typedef struct _DOKAN_POOL_USAGE_STATISTICS {
+  /** Whether the mount has its own pools, see \ref DOKAN_OPTION_INSTANCE_POOLS. */
+  BOOL InstancePools;
+  /** Objects reused from the pools. */
+  ULONG64 Hits;
+  /** Objects allocated because the pools were empty. */
+  ULONG64 Misses;
+  /** Objects freed because the pools were full. */
+  ULONG64 Overflows;
+  /**
+   * Memory in bytes currently used by the objects of the pools: the free
+   * ones and the batches, results and open infos in use.
+   */
+  ULONG64 MemoryUsage;
+  /** Part of MemoryUsage used by the objects in use. */
+  ULONG64 InUseMemory;
+  /** Exchanges of objects between the threads and the shared depots. */
+  ULONG64 DepotRefills;
+  ULONG64 DepotSpills;
+  /**
+   * Counters of each pool: I/O batches, I/O events, event results of the
+   * default size, of 16K, 32K, 64K and 128K, open infos and directory lists.
+   */
+  DOKAN_OBJECT_POOL_STATISTICS Pools[DOKAN_POOL_COUNT];
+} DOKAN_POOL_USAGE_STATISTICS, *PDOKAN_POOL_USAGE_STATISTICS;
+
+/**
+ * \brief Retrieve the counters of the caches of a mount.
+ *
+ * The counters of a cache that is not enabled are set to 0.
+ *
+ * \param DokanInstance The dokan mount context created by \ref DokanCreateFileSystem .
+ * \param FileInfoCache Receives the counters of the \ref DOKAN_OPTION_FILE_INFO_CACHE cache. Can be NULL.
+ * \param DirectoryListCache Receives the counters of the \ref DOKAN_OPTION_DIRECTORY_LIST_CACHE cache. Can be NULL.
+ * \return \c TRUE if the counters were retrieved.
+ */
+BOOL DOKANAPI
+DokanGetCacheStatistics(_In_ DOKAN_HANDLE DokanInstance,
+                        _Out_opt_ PDOKAN_CACHE_STATISTICS FileInfoCache,
+                        _Out_opt_ PDOKAN_CACHE_STATISTICS DirectoryListCache);
+
+/**
+ * \brief Retrieve the counters of the \ref DOKAN_OPTION_READ_AHEAD read-ahead of
+ * a mount.
+ *
+ * The hit rate of the reads is Hits / (Hits + Misses). The counters are set
+ * to 0 when the read-ahead is not enabled.
+ *
+ * \param DokanInstance The dokan mount context created by \ref DokanCreateFileSystem .
+ * \param Statistics Receives the counters.
+ * \return \c TRUE if the counters were retrieved.
+ */
+BOOL DOKANAPI
+DokanGetReadAheadStatistics(_In_ DOKAN_HANDLE DokanInstance,
+                            _Out_ PDOKAN_READ_AHEAD_STATISTICS Statistics);
+
+/**
+ * \brief Retrieve the counters of the \ref DOKAN_OPTION_WRITE_COALESCING write
+ * coalescing of a mount.
+ *
+ * The number of WriteFile calls saved is BufferedWrites - Flushes. The
+ * counters are set to 0 when the write coalescing is not enabled.
+ *
+ * \param DokanInstance The dokan mount context created by \ref DokanCreateFileSystem .
+ * \param Statistics Receives the counters.
+ * \return \c TRUE if the counters were retrieved.
+ */
+BOOL DOKANAPI DokanGetWriteCoalescingStatistics(
+    _In_ DOKAN_HANDLE DokanInstance,
+    _Out_ PDOKAN_WRITE_COALESCING_STATISTICS Statistics);
+
+/**
+ * \brief Retrieve the counters of the object pools used by a mount.
+ *
+ * Without \ref DOKAN_OPTION_INSTANCE_POOLS the mount uses the pools shared by
+ * all the mounts of the process and the counters cover all of them.
+ *
+ * \param DokanInstance The dokan mount context created by \ref DokanCreateFileSystem .
+ * \param Statistics Receives the counters.
+ * \return \c TRUE if the counters were retrieved.
+ */
+BOOL DOKANAPI
+DokanGetPoolStatistics(_In_ DOKAN_HANDLE DokanInstance,
+                       _Out_ PDOKAN_POOL_USAGE_STATISTICS Statistics);
+
+/**
+ * \brief Retrieve the current file name of an open.
+ *
+ * Meant for the callbacks receiving an empty FileName when
+ * \ref DOKAN_OPTION_OMIT_IO_FILE_NAMES is enabled. The name is only kept by
+ * the library when this option is enabled.
+ *
+ * \param DokanFileInfo The DokanFileInfo given to the callback.
+ * \param FileName Receives the null-terminated file name.
+ * \param FileNameSize Size of FileName in characters.
+ * \return \c STATUS_SUCCESS, \c STATUS_BUFFER_TOO_SMALL if FileName cannot hold the name, or \c STATUS_NOT_FOUND if the name of the open is not known.
+ */
+NTSTATUS DOKANAPI DokanGetFileName(_In_ PDOKAN_FILE_INFO DokanFileInfo,
+                                   _Out_writes_(FileNameSize) LPWSTR FileName,
+                                   _In_ ULONG FileNameSize);
+
+/**
+ * \brief Get the entry a streamed directory query starts at.
+ *
+ * With \ref DOKAN_OPTION_STREAM_FIND_FILES, \ref DOKAN_OPERATIONS.FindFiles
+ * and \ref DOKAN_OPERATIONS.FindFilesWithPattern can call this before
+ * reporting any entry and start reporting at the returned index, counted from
+ * 0 over the entries they report in their usual order. The library then no
+ * longer skips the entries returned by the previous queries itself.
+ * Once called, the first entry reported is taken as the one at that index.
+ *
+ * \param DokanFileInfo The DokanFileInfo given to the callback.
+ * \return Number of entries to skip, 0 for the first query or when the option is disabled.
+ */
+ULONG DOKANAPI DokanGetFindFilesStartIndex(_In_ PDOKAN_FILE_INFO DokanFileInfo);
+
+/**
+ * \brief Complete a \ref DOKAN_OPERATIONS.ReadFile that returned \c STATUS_PENDING.
+ *
+ * Can be called from any thread, including before the callback returned.
+ * The read Buffer and DokanFileInfo must no longer be used afterwards.
+ *
+ * \param DokanFileInfo The DokanFileInfo given to the ReadFile callback.
+ * \param ReadLength Total data size that has been read.
+ * \param Status Result of the read. Cannot be \c STATUS_PENDING.
+ */
+VOID DOKANAPI DokanEndDispatchRead(_In_ PDOKAN_FILE_INFO DokanFileInfo,
+                                   ULONG ReadLength, NTSTATUS Status);
+
+/**
+ * \brief Complete a \ref DOKAN_OPERATIONS.WriteFile that returned \c STATUS_PENDING.
+ *
+ * Can be called from any thread, including before the callback returned.
+ * The write Buffer and DokanFileInfo must no longer be used afterwards.
+ *
+ * \param DokanFileInfo The DokanFileInfo given to the WriteFile callback.
+ * \param NumberOfBytesWritten Total number of bytes that have been written.
+ * \param Status Result of the write. Cannot be \c STATUS_PENDING.
+ */
+VOID DOKANAPI DokanEndDispatchWrite(_In_ PDOKAN_FILE_INFO DokanFileInfo,
+                                    ULONG NumberOfBytesWritten,
+                                    NTSTATUS Status);
+
 /**
  * \brief Convert WIN32 error to NTSTATUS
  *
@@ -0,0 +1,138 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokan_batch_sizer.h"
+
+PDOKAN_IO_BATCH_SIZER DokanIoBatchSizer_Alloc(BOOL Adaptive) {
+  PDOKAN_IO_BATCH_SIZER sizer = malloc(sizeof(DOKAN_IO_BATCH_SIZER));
+  if (!sizer) {
+    DokanDbgPrintW(L"Dokan Error: Failed to allocate IO batch sizer.\n");
+    return NULL;
+  }
+  ZeroMemory(sizer, sizeof(DOKAN_IO_BATCH_SIZER));
+  sizer->Adaptive = Adaptive;
+  sizer->EventContextSize = Adaptive ? DOKAN_IO_BATCH_DEFAULT_EVENT_CONTEXT_SIZE
+                                     : DOKAN_IO_BATCH_MIN_EVENT_CONTEXT_SIZE;
+  sizer->PeakEventContextSize = sizer->EventContextSize;
+  sizer->LowFillSince = (LONG64)GetTickCount64();
+  return sizer;
+}
+
+VOID DokanIoBatchSizer_Free(PDOKAN_IO_BATCH_SIZER Sizer) {
+  if (!Sizer) {
+    return;
+  }
+  DbgPrint("Dokan Information: %lld pulls of %lld bytes, %lld empty, batch "
+           "size grown %lld times and shrunk %lld times, at most %d bytes\n",
+           Sizer->Pulls, Sizer->BytesPulled, Sizer->EmptyPulls, Sizer->Grows,
+           Sizer->Shrinks, Sizer->PeakEventContextSize);
+  free(Sizer);
+}
+
+ULONG DokanIoBatchSizer_GetSize(PDOKAN_IO_BATCH_SIZER Sizer) {
+  return (ULONG)Sizer->EventContextSize;
+}
+
+ULONG DokanIoBatchSizer_GetMainPullTimeout(PDOKAN_IO_BATCH_SIZER Sizer) {
+  if (!Sizer->Adaptive ||
+      Sizer->EventContextSize <= DOKAN_IO_BATCH_MIN_EVENT_CONTEXT_SIZE) {
+    return 0;
+  }
+  return DOKAN_IO_BATCH_IDLE_PULL_TIMEOUT_MS;
+}
+
+// Starts a new run of low fill pulls.
+static VOID ResetLowFillPulls(PDOKAN_IO_BATCH_SIZER Sizer, LONG64 Now) {
+  InterlockedExchange(&Sizer->LowFillPulls, 0);
+  InterlockedExchange64(&Sizer->LowFillSince, Now);
+}
+
+BOOL DokanIoBatchSizer_RecordPull(PDOKAN_IO_BATCH_SIZER Sizer,
+                                  ULONG EventContextSize,
+                                  DWORD NumberOfBytesTransferred) {
+  LONG newSize = 0;
+  LONG peakSize = 0;
+  LONG64 now = 0;
+  LONG lowFillPulls = 0;
+  InterlockedIncrement64(&Sizer->Pulls);
+  InterlockedAdd64(&Sizer->BytesPulled, NumberOfBytesTransferred);
+  if (!NumberOfBytesTransferred) {
+    InterlockedIncrement64(&Sizer->EmptyPulls);
+  }
+  // Pulls made with a buffer of a previous size say nothing about the
+  // current one.
+  if (!Sizer->Adaptive || (LONG)EventContextSize != Sizer->EventContextSize) {
+    return FALSE;
+  }
+  now = (LONG64)GetTickCount64();
+  if ((ULONG64)NumberOfBytesTransferred * 100 >=
+      (ULONG64)EventContextSize * DOKAN_IO_BATCH_GROW_FILL_PERCENT) {
+    ResetLowFillPulls(Sizer, now);
+    if (EventContextSize >= DOKAN_IO_BATCH_MAX_EVENT_CONTEXT_SIZE) {
+      return FALSE;
+    }
+    newSize = (LONG)EventContextSize * 2;
+    if (InterlockedCompareExchange(&Sizer->EventContextSize, newSize,
+                                   (LONG)EventContextSize) !=
+        (LONG)EventContextSize) {
+      return FALSE;
+    }
+    InterlockedIncrement64(&Sizer->Grows);
+    do {
+      peakSize = Sizer->PeakEventContextSize;
+    } while (peakSize < newSize &&
+             InterlockedCompareExchange(&Sizer->PeakEventContextSize, newSize,
+                                        peakSize) != peakSize);
+    DbgPrint("Dokan Information: IO batch size grown to %d bytes\n", newSize);
+    return TRUE;
+  }
+  if ((ULONG64)NumberOfBytesTransferred * 100 >
+      (ULONG64)EventContextSize * DOKAN_IO_BATCH_SHRINK_FILL_PERCENT) {
+    ResetLowFillPulls(Sizer, now);
+    return FALSE;
+  }
+  lowFillPulls = InterlockedIncrement(&Sizer->LowFillPulls);
+  if (EventContextSize <= DOKAN_IO_BATCH_MIN_EVENT_CONTEXT_SIZE ||
+      (lowFillPulls < DOKAN_IO_BATCH_SHRINK_PULLS &&
+       now - Sizer->LowFillSince < DOKAN_IO_BATCH_SHRINK_IDLE_MS)) {
+    return FALSE;
+  }
+  ResetLowFillPulls(Sizer, now);
+  newSize = (LONG)EventContextSize / 2;
+  if (InterlockedCompareExchange(&Sizer->EventContextSize, newSize,
+                                 (LONG)EventContextSize) !=
+      (LONG)EventContextSize) {
+    return FALSE;
+  }
+  InterlockedIncrement64(&Sizer->Shrinks);
+  DbgPrint("Dokan Information: IO batch size shrunk to %d bytes\n", newSize);
+  return TRUE;
+}
+
+VOID DokanIoBatchSizer_GetStatistics(PDOKAN_IO_BATCH_SIZER Sizer,
+                                     PDOKAN_IO_BATCH_STATISTICS Statistics) {
+  Statistics->BufferSize = (ULONG)Sizer->EventContextSize;
+  Statistics->PeakBufferSize = (ULONG)Sizer->PeakEventContextSize;
+  Statistics->Pulls = Sizer->Pulls;
+  Statistics->EmptyPulls = Sizer->EmptyPulls;
+  Statistics->BytesPulled = Sizer->BytesPulled;
+  Statistics->Grows = Sizer->Grows;
+  Statistics->Shrinks = Sizer->Shrinks;
+}
@@ -0,0 +1,89 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_BATCH_SIZER_H_
+#define DOKAN_BATCH_SIZER_H_
+
+#include "dokani.h"
+
+// Bounds of the size of the EventContext buffer of a DOKAN_IO_BATCH. The
+// smallest one can hold any event the driver sends.
+#define DOKAN_IO_BATCH_MIN_EVENT_CONTEXT_SIZE EVENT_CONTEXT_MAX_SIZE
+#define DOKAN_IO_BATCH_MAX_EVENT_CONTEXT_SIZE (EVENT_CONTEXT_MAX_SIZE * 16)
+#define DOKAN_IO_BATCH_DEFAULT_EVENT_CONTEXT_SIZE (EVENT_CONTEXT_MAX_SIZE * 4)
+
+// The size doubles after a pull filling at least this percentage of the
+// buffer, since the driver then likely had more events to return.
+#define DOKAN_IO_BATCH_GROW_FILL_PERCENT 75
+// The size halves after this many consecutive pulls filling at most
+// DOKAN_IO_BATCH_SHRINK_FILL_PERCENT of the buffer, or once such pulls have
+// lasted DOKAN_IO_BATCH_SHRINK_IDLE_MS, like the empty pulls of an idle
+// volume.
+#define DOKAN_IO_BATCH_SHRINK_PULLS 256
+#define DOKAN_IO_BATCH_SHRINK_FILL_PERCENT 12
+#define DOKAN_IO_BATCH_SHRINK_IDLE_MS 1000
+// Timeout of the pulls of the main pull threads while the size can still
+// shrink. They otherwise wait for events indefinitely and an idle volume would
+// never record the pulls that shrink it.
+#define DOKAN_IO_BATCH_IDLE_PULL_TIMEOUT_MS 500
+
+// Picks the size of the buffers pulling events from the driver.
+// Without IPC batching the driver returns a single event per pull, so the
+// smallest size is always used. Otherwise the size follows the fill ratio of
+// the pulls: it grows under event storms so that each
+// FSCTL_EVENT_PROCESS_N_PULL returns more events, and shrinks back while the
+// volume is idle to save the memory held by each pull thread.
+typedef struct _DOKAN_IO_BATCH_SIZER {
+  BOOL Adaptive;
+  volatile LONG EventContextSize;
+  // Consecutive pulls with a low fill ratio, and the GetTickCount64() time
+  // the last pull before them or the last resize happened.
+  volatile LONG LowFillPulls;
+  volatile LONG64 LowFillSince;
+  volatile LONG PeakEventContextSize;
+  volatile LONG64 Pulls;
+  volatile LONG64 EmptyPulls;
+  volatile LONG64 BytesPulled;
+  volatile LONG64 Grows;
+  volatile LONG64 Shrinks;
+} DOKAN_IO_BATCH_SIZER, *PDOKAN_IO_BATCH_SIZER;
+
+PDOKAN_IO_BATCH_SIZER DokanIoBatchSizer_Alloc(BOOL Adaptive);
+
+VOID DokanIoBatchSizer_Free(PDOKAN_IO_BATCH_SIZER Sizer);
+
+// Returns the EventContext buffer size to use for the next pull.
+ULONG DokanIoBatchSizer_GetSize(PDOKAN_IO_BATCH_SIZER Sizer);
+
+// Returns the PullEventTimeoutMs of the pulls of the main pull threads, 0 for
+// an infinite wait.
+ULONG DokanIoBatchSizer_GetMainPullTimeout(PDOKAN_IO_BATCH_SIZER Sizer);
+
+// Counts a pull of NumberOfBytesTransferred bytes in a buffer of
+// EventContextSize bytes and adapts the size to it. Returns TRUE when the size
+// changed, the pooled batches of EventContextSize bytes are then stale.
+BOOL DokanIoBatchSizer_RecordPull(PDOKAN_IO_BATCH_SIZER Sizer,
+                                  ULONG EventContextSize,
+                                  DWORD NumberOfBytesTransferred);
+
+VOID DokanIoBatchSizer_GetStatistics(PDOKAN_IO_BATCH_SIZER Sizer,
+                                     PDOKAN_IO_BATCH_STATISTICS Statistics);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+#include <assert.h>
+
+#define DEFAULT_ARENA_SIZE (16 * 1024)
+
+// Entries are kept aligned on the FILETIME fields alignment.
+#define ENTRY_ALIGNMENT sizeof(DWORD)
+
+PDOKAN_DIRECTORY_LIST DokanDirectoryList_Alloc() {
+  PDOKAN_DIRECTORY_LIST list =
+      (PDOKAN_DIRECTORY_LIST)malloc(sizeof(DOKAN_DIRECTORY_LIST));
+  if (!list) {
+    DbgPrintW(L"DOKAN_DIRECTORY_LIST allocation failed.\n");
+    return NULL;
+  }
+  list->Arena = NULL;
+  list->ArenaSize = 0;
+  list->ArenaCapacity = 0;
+  list->Index = DokanVector_Alloc(sizeof(ULONG));
+  if (!list->Index) {
+    free(list);
+    return NULL;
+  }
+  return list;
+}
+
+VOID DokanDirectoryList_Free(PDOKAN_DIRECTORY_LIST List) {
+  if (!List) {
+    return;
+  }
+  if (List->Arena) {
+    free(List->Arena);
+  }
+  DokanVector_Free(List->Index);
+  free(List);
+}
+
+VOID DokanDirectoryList_Clear(PDOKAN_DIRECTORY_LIST List) {
+  List->ArenaSize = 0;
+  DokanVector_Clear(List->Index);
+}
+
+BOOL DokanDirectoryList_Copy(PDOKAN_DIRECTORY_LIST Dest,
+                             PDOKAN_DIRECTORY_LIST Source) {
+  size_t count = DokanVector_GetCount(Source->Index);
+
+  DokanDirectoryList_Clear(Dest);
+  if (Source->ArenaSize > Dest->ArenaCapacity) {
+    PBYTE newArena = (PBYTE)realloc(Dest->Arena, Source->ArenaSize);
+    if (!newArena) {
+      DbgPrintW(L"DOKAN_DIRECTORY_LIST arena allocation failed.\n");
+      return FALSE;
+    }
+    Dest->Arena = newArena;
+    Dest->ArenaCapacity = Source->ArenaSize;
+  }
+  if (Source->ArenaSize > 0) {
+    RtlCopyMemory(Dest->Arena, Source->Arena, Source->ArenaSize);
+  }
+  Dest->ArenaSize = Source->ArenaSize;
+  if (count > 0 &&
+      !DokanVector_PushBackArray(Dest->Index,
+                                 DokanVector_GetItem(Source->Index, 0),
+                                 count)) {
+    DokanDirectoryList_Clear(Dest);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// Copies the entry at the end of the arena and returns its offset.
+BOOL AppendEntry(PDOKAN_DIRECTORY_LIST List, PWIN32_FIND_DATAW FindData,
+                 PULONG Offset) {
+  size_t nameLength = wcsnlen(FindData->cFileName, MAX_PATH);
+  size_t entrySize = FIELD_OFFSET(DOKAN_DIRECTORY_ENTRY, FileName) +
+                     (nameLength + 1) * sizeof(WCHAR);
+  PDOKAN_DIRECTORY_ENTRY entry;
+
+  entrySize = (entrySize + ENTRY_ALIGNMENT - 1) & ~(ENTRY_ALIGNMENT - 1);
+  if (List->ArenaSize + entrySize > MAXULONG) {
+    DbgPrintW(L"DOKAN_DIRECTORY_LIST arena is full.\n");
+    return FALSE;
+  }
+  if (List->ArenaSize + entrySize > List->ArenaCapacity) {
+    size_t newCapacity =
+        List->ArenaCapacity ? List->ArenaCapacity * 2 : DEFAULT_ARENA_SIZE;
+    while (newCapacity < List->ArenaSize + entrySize) {
+      newCapacity *= 2;
+    }
+    PBYTE newArena = (PBYTE)realloc(List->Arena, newCapacity);
+    if (!newArena) {
+      DbgPrintW(L"DOKAN_DIRECTORY_LIST arena allocation failed.\n");
+      return FALSE;
+    }
+    List->Arena = newArena;
+    List->ArenaCapacity = newCapacity;
+  }
+
+  entry = (PDOKAN_DIRECTORY_ENTRY)(List->Arena + List->ArenaSize);
+  entry->FileAttributes = FindData->dwFileAttributes;
+  entry->FileSizeHigh = FindData->nFileSizeHigh;
+  entry->FileSizeLow = FindData->nFileSizeLow;
+  entry->CreationTime = FindData->ftCreationTime;
+  entry->LastAccessTime = FindData->ftLastAccessTime;
+  entry->LastWriteTime = FindData->ftLastWriteTime;
+  entry->FileNameLength = (USHORT)nameLength;
+  RtlCopyMemory(entry->FileName, FindData->cFileName,
+                nameLength * sizeof(WCHAR));
+  entry->FileName[nameLength] = L'\0';
+
+  *Offset = (ULONG)List->ArenaSize;
+  List->ArenaSize += entrySize;
+  return TRUE;
+}
+
+BOOL DokanDirectoryList_PushBack(PDOKAN_DIRECTORY_LIST List,
+                                 PWIN32_FIND_DATAW FindData) {
+  ULONG offset;
+  if (!AppendEntry(List, FindData, &offset)) {
+    return FALSE;
+  }
+  return DokanVector_PushBack(List->Index, &offset);
+}
+
+BOOL DokanDirectoryList_PushFront(PDOKAN_DIRECTORY_LIST List,
+                                  PWIN32_FIND_DATAW FindData) {
+  ULONG offset;
+  if (!AppendEntry(List, FindData, &offset)) {
+    return FALSE;
+  }
+  return DokanVector_PushFront(List->Index, &offset);
+}
+
+size_t DokanDirectoryList_GetCount(PDOKAN_DIRECTORY_LIST List) {
+  return DokanVector_GetCount(List->Index);
+}
+
+PDOKAN_DIRECTORY_ENTRY DokanDirectoryList_GetEntry(PDOKAN_DIRECTORY_LIST List,
+                                                   size_t Index) {
+  PULONG offset = (PULONG)DokanVector_GetItem(List->Index, Index);
+  if (!offset) {
+    return NULL;
+  }
+  assert(*offset < List->ArenaSize);
+  return (PDOKAN_DIRECTORY_ENTRY)(List->Arena + *offset);
+}
+
+VOID DokanDirectoryList_GetFindData(PDOKAN_DIRECTORY_ENTRY Entry,
+                                    PWIN32_FIND_DATAW FindData) {
+  ZeroMemory(FindData, FIELD_OFFSET(WIN32_FIND_DATAW, cFileName));
+  FindData->dwFileAttributes = Entry->FileAttributes;
+  FindData->nFileSizeHigh = Entry->FileSizeHigh;
+  FindData->nFileSizeLow = Entry->FileSizeLow;
+  FindData->ftCreationTime = Entry->CreationTime;
+  FindData->ftLastAccessTime = Entry->LastAccessTime;
+  FindData->ftLastWriteTime = Entry->LastWriteTime;
+  RtlCopyMemory(FindData->cFileName, Entry->FileName,
+                (Entry->FileNameLength + 1) * sizeof(WCHAR));
+  FindData->cAlternateFileName[0] = L'\0';
+}
+
+size_t DokanDirectoryList_GetMemoryUsage(PDOKAN_DIRECTORY_LIST List) {
+  return sizeof(DOKAN_DIRECTORY_LIST) + List->ArenaCapacity +
+         DokanVector_GetCapacity(List->Index) * sizeof(ULONG);
+}
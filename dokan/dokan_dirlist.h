@@ -0,0 +1,86 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_DIRLIST_H_
+#define DOKAN_DIRLIST_H_
+
+// A directory entry as stored in a DOKAN_DIRECTORY_LIST. Only the fields of
+// WIN32_FIND_DATAW used to answer directory queries are kept, and the name
+// takes only the space it needs.
+typedef struct _DOKAN_DIRECTORY_ENTRY {
+  DWORD FileAttributes;
+  DWORD FileSizeHigh;
+  DWORD FileSizeLow;
+  FILETIME CreationTime;
+  FILETIME LastAccessTime;
+  FILETIME LastWriteTime;
+  // Length of FileName in characters, without the terminating null.
+  USHORT FileNameLength;
+  // Null terminated file name.
+  WCHAR FileName[1];
+} DOKAN_DIRECTORY_ENTRY, *PDOKAN_DIRECTORY_ENTRY;
+
+// A directory listing packed in a single arena. Entries are appended one
+// after the other and located through an index of arena offsets.
+typedef struct _DOKAN_DIRECTORY_LIST {
+  PBYTE Arena;
+  size_t ArenaSize;
+  size_t ArenaCapacity;
+  // Offsets of the entries in Arena, in listing order.
+  PDOKAN_VECTOR Index;
+} DOKAN_DIRECTORY_LIST, *PDOKAN_DIRECTORY_LIST;
+
+// Creates a new empty DOKAN_DIRECTORY_LIST.
+PDOKAN_DIRECTORY_LIST DokanDirectoryList_Alloc();
+
+// Releases the memory associated with a DOKAN_DIRECTORY_LIST.
+VOID DokanDirectoryList_Free(PDOKAN_DIRECTORY_LIST List);
+
+// Removes all entries. The memory is kept for reuse.
+VOID DokanDirectoryList_Clear(PDOKAN_DIRECTORY_LIST List);
+
+// Replaces the content of Dest by a copy of Source. The arena of Dest is only
+// grown to the size used by Source.
+BOOL DokanDirectoryList_Copy(PDOKAN_DIRECTORY_LIST Dest,
+                             PDOKAN_DIRECTORY_LIST Source);
+
+// Appends an entry to the list.
+BOOL DokanDirectoryList_PushBack(PDOKAN_DIRECTORY_LIST List,
+                                 PWIN32_FIND_DATAW FindData);
+
+// Inserts an entry at the front of the list. Only the index is moved.
+BOOL DokanDirectoryList_PushFront(PDOKAN_DIRECTORY_LIST List,
+                                  PWIN32_FIND_DATAW FindData);
+
+// Retrieves the number of entries in the list.
+size_t DokanDirectoryList_GetCount(PDOKAN_DIRECTORY_LIST List);
+
+// Retrieves the entry at the specified index.
+PDOKAN_DIRECTORY_ENTRY DokanDirectoryList_GetEntry(PDOKAN_DIRECTORY_LIST List,
+                                                   size_t Index);
+
+// Expands an entry back to a WIN32_FIND_DATAW.
+VOID DokanDirectoryList_GetFindData(PDOKAN_DIRECTORY_ENTRY Entry,
+                                    PWIN32_FIND_DATAW FindData);
+
+// Retrieves the memory allocated by the list in bytes.
+size_t DokanDirectoryList_GetMemoryUsage(PDOKAN_DIRECTORY_LIST List);
+
+#endif
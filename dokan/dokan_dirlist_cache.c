@@ -0,0 +1,350 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+#include <assert.h>
+
+typedef struct _DOKAN_DIRECTORY_LIST_CACHE_ENTRY {
+  LIST_ENTRY BucketEntry;
+  LIST_ENTRY LruEntry;
+  ULONG Hash;
+  ULONG64 ExpirationTime;
+  PDOKAN_DIRECTORY_LIST DirList;
+  BOOLEAN UnimplementedFindFilesWithPattern;
+  // Memory accounted in the cache size for this entry.
+  size_t Size;
+  size_t DirectoryNameLength;
+  // Points after DirectoryName in the same allocation.
+  PWCHAR SearchPattern;
+  // Directory name folded to upper case unless the mount is case sensitive,
+  // followed by the search pattern folded the same way.
+  WCHAR DirectoryName[1];
+} DOKAN_DIRECTORY_LIST_CACHE_ENTRY, *PDOKAN_DIRECTORY_LIST_CACHE_ENTRY;
+
+static WCHAR FoldChar(PDOKAN_DIRECTORY_LIST_CACHE Cache, WCHAR C) {
+  return Cache->CaseSensitive ? C : towupper(C);
+}
+
+// Length of the name without its trailing backslashes, except for the root.
+static size_t GetNameLength(LPCWSTR Name, size_t Length) {
+  size_t length = Length;
+  while (length > 1 && Name[length - 1] == L'\\') {
+    --length;
+  }
+  return length;
+}
+
+static ULONG HashKey(PDOKAN_DIRECTORY_LIST_CACHE Cache, LPCWSTR DirectoryName,
+                     size_t DirectoryNameLength, LPCWSTR SearchPattern) {
+  // FNV-1a
+  ULONG hash = 2166136261;
+  size_t i;
+  for (i = 0; i < DirectoryNameLength; ++i) {
+    hash = (hash ^ FoldChar(Cache, DirectoryName[i])) * 16777619;
+  }
+  hash = (hash ^ L'\0') * 16777619;
+  for (; *SearchPattern; ++SearchPattern) {
+    hash = (hash ^ FoldChar(Cache, *SearchPattern)) * 16777619;
+  }
+  return hash;
+}
+
+// Compares a folded name stored in an entry with a name given by the caller.
+static BOOL NameEquals(PDOKAN_DIRECTORY_LIST_CACHE Cache, LPCWSTR Folded,
+                       LPCWSTR Name, size_t Length) {
+  size_t i;
+  for (i = 0; i < Length; ++i) {
+    if (Folded[i] != FoldChar(Cache, Name[i])) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static BOOL PatternEquals(PDOKAN_DIRECTORY_LIST_CACHE Cache, LPCWSTR Folded,
+                          LPCWSTR Pattern) {
+  size_t length = wcslen(Pattern);
+  return wcslen(Folded) == length &&
+         NameEquals(Cache, Folded, Pattern, length);
+}
+
+static VOID RemoveCacheEntry(PDOKAN_DIRECTORY_LIST_CACHE Cache,
+                             PDOKAN_DIRECTORY_LIST_CACHE_ENTRY Entry) {
+  RemoveEntryList(&Entry->BucketEntry);
+  RemoveEntryList(&Entry->LruEntry);
+  assert(Cache->EntryCount > 0 && Cache->Size >= Entry->Size);
+  --Cache->EntryCount;
+  Cache->Size -= Entry->Size;
+  DokanDirectoryList_Free(Entry->DirList);
+  free(Entry);
+}
+
+static PDOKAN_DIRECTORY_LIST_CACHE_ENTRY
+FindCacheEntry(PDOKAN_DIRECTORY_LIST_CACHE Cache, ULONG Hash,
+               LPCWSTR DirectoryName, size_t DirectoryNameLength,
+               LPCWSTR SearchPattern) {
+  PLIST_ENTRY bucket =
+      &Cache->Buckets[Hash % DOKAN_DIRECTORY_LIST_CACHE_BUCKET_COUNT];
+  PLIST_ENTRY listEntry;
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = listEntry->Flink) {
+    PDOKAN_DIRECTORY_LIST_CACHE_ENTRY entry = CONTAINING_RECORD(
+        listEntry, DOKAN_DIRECTORY_LIST_CACHE_ENTRY, BucketEntry);
+    if (entry->Hash == Hash &&
+        entry->DirectoryNameLength == DirectoryNameLength &&
+        NameEquals(Cache, entry->DirectoryName, DirectoryName,
+                   DirectoryNameLength) &&
+        PatternEquals(Cache, entry->SearchPattern, SearchPattern)) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+PDOKAN_DIRECTORY_LIST_CACHE DokanDirectoryListCache_Alloc(ULONG Timeout,
+                                                          size_t MaxSize,
+                                                          BOOL CaseSensitive) {
+  ULONG i;
+  PDOKAN_DIRECTORY_LIST_CACHE cache =
+      (PDOKAN_DIRECTORY_LIST_CACHE)malloc(sizeof(DOKAN_DIRECTORY_LIST_CACHE));
+  if (!cache) {
+    DbgPrintW(L"DOKAN_DIRECTORY_LIST_CACHE allocation failed.\n");
+    return NULL;
+  }
+  ZeroMemory(cache, sizeof(DOKAN_DIRECTORY_LIST_CACHE));
+  (void)InitializeCriticalSectionAndSpinCount(&cache->CriticalSection,
+                                              0x80000400);
+  for (i = 0; i < DOKAN_DIRECTORY_LIST_CACHE_BUCKET_COUNT; ++i) {
+    InitializeListHead(&cache->Buckets[i]);
+  }
+  InitializeListHead(&cache->LruList);
+  cache->Timeout =
+      Timeout ? Timeout : DOKAN_DIRECTORY_LIST_CACHE_DEFAULT_TIMEOUT;
+  cache->MaxSize =
+      MaxSize ? MaxSize : DOKAN_DIRECTORY_LIST_CACHE_DEFAULT_MAX_SIZE;
+  cache->CaseSensitive = CaseSensitive;
+  return cache;
+}
+
+VOID DokanDirectoryListCache_Free(PDOKAN_DIRECTORY_LIST_CACHE Cache) {
+  if (!Cache) {
+    return;
+  }
+  while (!IsListEmpty(&Cache->LruList)) {
+    RemoveCacheEntry(Cache,
+                     CONTAINING_RECORD(Cache->LruList.Flink,
+                                       DOKAN_DIRECTORY_LIST_CACHE_ENTRY,
+                                       LruEntry));
+  }
+  DeleteCriticalSection(&Cache->CriticalSection);
+  free(Cache);
+}
+
+BOOL DokanDirectoryListCache_Lookup(PDOKAN_DIRECTORY_LIST_CACHE Cache,
+                                    LPCWSTR DirectoryName,
+                                    LPCWSTR SearchPattern,
+                                    PDOKAN_DIRECTORY_LIST DirList,
+                                    PBOOLEAN UnimplementedFindFilesWithPattern) {
+  size_t directoryNameLength =
+      GetNameLength(DirectoryName, wcslen(DirectoryName));
+  ULONG hash =
+      HashKey(Cache, DirectoryName, directoryNameLength, SearchPattern);
+  BOOL found = FALSE;
+
+  EnterCriticalSection(&Cache->CriticalSection);
+  {
+    PDOKAN_DIRECTORY_LIST_CACHE_ENTRY entry = FindCacheEntry(
+        Cache, hash, DirectoryName, directoryNameLength, SearchPattern);
+    if (entry && entry->ExpirationTime <= GetTickCount64()) {
+      RemoveCacheEntry(Cache, entry);
+      entry = NULL;
+    }
+    if (entry && DokanDirectoryList_Copy(DirList, entry->DirList)) {
+      *UnimplementedFindFilesWithPattern =
+          entry->UnimplementedFindFilesWithPattern;
+      RemoveEntryList(&entry->LruEntry);
+      InsertHeadList(&Cache->LruList, &entry->LruEntry);
+      found = TRUE;
+    }
+    if (found) {
+      ++Cache->Hits;
+    } else {
+      ++Cache->Misses;
+    }
+  }
+  LeaveCriticalSection(&Cache->CriticalSection);
+  return found;
+}
+
+ULONG64
+DokanDirectoryListCache_GetInvalidationSequence(
+    PDOKAN_DIRECTORY_LIST_CACHE Cache) {
+  ULONG64 sequence;
+  EnterCriticalSection(&Cache->CriticalSection);
+  { sequence = Cache->InvalidationSequence; }
+  LeaveCriticalSection(&Cache->CriticalSection);
+  return sequence;
+}
+
+VOID DokanDirectoryListCache_Insert(PDOKAN_DIRECTORY_LIST_CACHE Cache,
+                                    LPCWSTR DirectoryName,
+                                    LPCWSTR SearchPattern,
+                                    PDOKAN_DIRECTORY_LIST DirList,
+                                    BOOLEAN UnimplementedFindFilesWithPattern,
+                                    ULONG64 InvalidationSequence) {
+  size_t directoryNameLength =
+      GetNameLength(DirectoryName, wcslen(DirectoryName));
+  size_t searchPatternLength = wcslen(SearchPattern);
+  size_t entrySize =
+      FIELD_OFFSET(DOKAN_DIRECTORY_LIST_CACHE_ENTRY, DirectoryName) +
+      (directoryNameLength + 1 + searchPatternLength + 1) * sizeof(WCHAR);
+  PDOKAN_DIRECTORY_LIST_CACHE_ENTRY entry;
+  PDOKAN_DIRECTORY_LIST_CACHE_ENTRY oldEntry;
+  size_t i;
+
+  if (DirList->ArenaSize + entrySize > Cache->MaxSize) {
+    return;
+  }
+
+  entry = (PDOKAN_DIRECTORY_LIST_CACHE_ENTRY)malloc(entrySize);
+  if (!entry) {
+    return;
+  }
+  entry->DirList = DokanDirectoryList_Alloc();
+  if (!entry->DirList || !DokanDirectoryList_Copy(entry->DirList, DirList)) {
+    DokanDirectoryList_Free(entry->DirList);
+    free(entry);
+    return;
+  }
+  for (i = 0; i < directoryNameLength; ++i) {
+    entry->DirectoryName[i] = FoldChar(Cache, DirectoryName[i]);
+  }
+  entry->DirectoryName[directoryNameLength] = L'\0';
+  entry->SearchPattern = &entry->DirectoryName[directoryNameLength + 1];
+  for (i = 0; i <= searchPatternLength; ++i) {
+    entry->SearchPattern[i] = FoldChar(Cache, SearchPattern[i]);
+  }
+  entry->DirectoryNameLength = directoryNameLength;
+  entry->Hash =
+      HashKey(Cache, DirectoryName, directoryNameLength, SearchPattern);
+  entry->UnimplementedFindFilesWithPattern = UnimplementedFindFilesWithPattern;
+  entry->Size =
+      entrySize + DokanDirectoryList_GetMemoryUsage(entry->DirList);
+  if (entry->Size > Cache->MaxSize) {
+    // The copy also counts its header and index, it would never be evicted
+    DokanDirectoryList_Free(entry->DirList);
+    free(entry);
+    return;
+  }
+  entry->ExpirationTime = GetTickCount64() + Cache->Timeout;
+
+  EnterCriticalSection(&Cache->CriticalSection);
+  {
+    if (Cache->InvalidationSequence != InvalidationSequence) {
+      // The listing may predate a change of the directory
+      LeaveCriticalSection(&Cache->CriticalSection);
+      DokanDirectoryList_Free(entry->DirList);
+      free(entry);
+      return;
+    }
+    oldEntry = FindCacheEntry(Cache, entry->Hash, DirectoryName,
+                              directoryNameLength, SearchPattern);
+    if (oldEntry) {
+      RemoveCacheEntry(Cache, oldEntry);
+    }
+    InsertHeadList(
+        &Cache->Buckets[entry->Hash % DOKAN_DIRECTORY_LIST_CACHE_BUCKET_COUNT],
+        &entry->BucketEntry);
+    InsertHeadList(&Cache->LruList, &entry->LruEntry);
+    ++Cache->EntryCount;
+    Cache->Size += entry->Size;
+    // Evict the least recently used listings until we are back in budget
+    while (Cache->Size > Cache->MaxSize &&
+           Cache->LruList.Blink != &entry->LruEntry) {
+      RemoveCacheEntry(Cache,
+                       CONTAINING_RECORD(Cache->LruList.Blink,
+                                         DOKAN_DIRECTORY_LIST_CACHE_ENTRY,
+                                         LruEntry));
+      ++Cache->Evictions;
+    }
+  }
+  LeaveCriticalSection(&Cache->CriticalSection);
+}
+
+VOID DokanDirectoryListCache_Invalidate(PDOKAN_DIRECTORY_LIST_CACHE Cache,
+                                        LPCWSTR FileName,
+                                        size_t FileNameLength) {
+  size_t fileNameLength = GetNameLength(FileName, FileNameLength);
+  size_t parentLength = fileNameLength;
+  PLIST_ENTRY listEntry;
+  PLIST_ENTRY nextEntry;
+
+  while (parentLength > 0 && FileName[parentLength - 1] != L'\\') {
+    --parentLength;
+  }
+  // Keep the backslash when the parent is the root
+  if (parentLength > 1) {
+    --parentLength;
+  }
+
+  EnterCriticalSection(&Cache->CriticalSection);
+  {
+    ++Cache->InvalidationSequence;
+    for (listEntry = Cache->LruList.Flink; listEntry != &Cache->LruList;
+         listEntry = nextEntry) {
+      PDOKAN_DIRECTORY_LIST_CACHE_ENTRY entry = CONTAINING_RECORD(
+          listEntry, DOKAN_DIRECTORY_LIST_CACHE_ENTRY, LruEntry);
+      size_t length = entry->DirectoryNameLength;
+      BOOL affected = FALSE;
+      nextEntry = listEntry->Flink;
+      if (fileNameLength <= 1) {
+        // The root changed, every listing is below it
+        affected = TRUE;
+      } else if (length == parentLength) {
+        affected = NameEquals(Cache, entry->DirectoryName, FileName, length);
+      } else if (length >= fileNameLength &&
+                 (length == fileNameLength ||
+                  entry->DirectoryName[fileNameLength] == L'\\')) {
+        affected = NameEquals(Cache, entry->DirectoryName, FileName,
+                              fileNameLength);
+      }
+      if (affected) {
+        RemoveCacheEntry(Cache, entry);
+        ++Cache->Invalidations;
+      }
+    }
+  }
+  LeaveCriticalSection(&Cache->CriticalSection);
+}
+
+VOID DokanDirectoryListCache_GetStatistics(PDOKAN_DIRECTORY_LIST_CACHE Cache,
+                                           PDOKAN_CACHE_STATISTICS Statistics) {
+  EnterCriticalSection(&Cache->CriticalSection);
+  {
+    Statistics->Hits = Cache->Hits;
+    Statistics->Misses = Cache->Misses;
+    Statistics->Invalidations = Cache->Invalidations;
+    Statistics->Evictions = Cache->Evictions;
+    Statistics->EntryCount = Cache->EntryCount;
+    Statistics->MemoryUsage = Cache->Size;
+  }
+  LeaveCriticalSection(&Cache->CriticalSection);
+}
@@ -0,0 +1,98 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_DIRLIST_CACHE_H_
+#define DOKAN_DIRLIST_CACHE_H_
+
+#define DOKAN_DIRECTORY_LIST_CACHE_BUCKET_COUNT 256
+
+// Default time in milliseconds a cached listing stays valid.
+#define DOKAN_DIRECTORY_LIST_CACHE_DEFAULT_TIMEOUT 2000
+
+// Default memory budget in bytes of the cached listings.
+#define DOKAN_DIRECTORY_LIST_CACHE_DEFAULT_MAX_SIZE (64 * 1024 * 1024)
+
+// Directory listings shared by all the handles of a mount instance.
+// Entries are keyed by directory name and search pattern, expire after
+// Timeout and are evicted in least recently used order once the memory used
+// goes over MaxSize.
+typedef struct _DOKAN_DIRECTORY_LIST_CACHE {
+  CRITICAL_SECTION CriticalSection;
+  LIST_ENTRY Buckets[DOKAN_DIRECTORY_LIST_CACHE_BUCKET_COUNT];
+  // Most recently used entries first.
+  LIST_ENTRY LruList;
+  ULONG Timeout;
+  size_t MaxSize;
+  size_t Size;
+  ULONG EntryCount;
+  BOOL CaseSensitive;
+  // Incremented by every invalidation. A listing made while it changed can
+  // miss the change and is not stored.
+  ULONG64 InvalidationSequence;
+  ULONG64 Hits;
+  ULONG64 Misses;
+  ULONG64 Invalidations;
+  ULONG64 Evictions;
+} DOKAN_DIRECTORY_LIST_CACHE, *PDOKAN_DIRECTORY_LIST_CACHE;
+
+// Creates a new empty cache. A Timeout or MaxSize of 0 selects the default.
+PDOKAN_DIRECTORY_LIST_CACHE DokanDirectoryListCache_Alloc(ULONG Timeout,
+                                                          size_t MaxSize,
+                                                          BOOL CaseSensitive);
+
+// Releases the cache and all the listings it holds.
+VOID DokanDirectoryListCache_Free(PDOKAN_DIRECTORY_LIST_CACHE Cache);
+
+// Copies the cached listing of DirectoryName into DirList. Returns FALSE
+// when no valid listing is cached.
+BOOL DokanDirectoryListCache_Lookup(PDOKAN_DIRECTORY_LIST_CACHE Cache,
+                                    LPCWSTR DirectoryName,
+                                    LPCWSTR SearchPattern,
+                                    PDOKAN_DIRECTORY_LIST DirList,
+                                    PBOOLEAN UnimplementedFindFilesWithPattern);
+
+// Returns the invalidation sequence to give to
+// DokanDirectoryListCache_Insert, taken before listing the directory.
+ULONG64
+DokanDirectoryListCache_GetInvalidationSequence(
+    PDOKAN_DIRECTORY_LIST_CACHE Cache);
+
+// Stores a copy of DirList as the listing of DirectoryName. Nothing is stored
+// when an invalidation happened since InvalidationSequence was taken.
+VOID DokanDirectoryListCache_Insert(PDOKAN_DIRECTORY_LIST_CACHE Cache,
+                                    LPCWSTR DirectoryName,
+                                    LPCWSTR SearchPattern,
+                                    PDOKAN_DIRECTORY_LIST DirList,
+                                    BOOLEAN UnimplementedFindFilesWithPattern,
+                                    ULONG64 InvalidationSequence);
+
+// Drops the listings affected by a change of FileName: the listing of its
+// parent directory, its own and the ones of its subdirectories.
+// FileNameLength is in characters and FileName does not need to be null
+// terminated.
+VOID DokanDirectoryListCache_Invalidate(PDOKAN_DIRECTORY_LIST_CACHE Cache,
+                                        LPCWSTR FileName,
+                                        size_t FileNameLength);
+
+// Retrieves the cache counters.
+VOID DokanDirectoryListCache_GetStatistics(PDOKAN_DIRECTORY_LIST_CACHE Cache,
+                                           PDOKAN_CACHE_STATISTICS Statistics);
+
+#endif
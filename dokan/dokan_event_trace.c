@@ -0,0 +1,493 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokan_event_trace.h"
+
+#include <assert.h>
+
+#define DOKAN_EVENT_TRACE_MAP_MIN_CAPACITY 256
+
+static const CHAR g_EventTracePadding[DOKAN_EVENT_TRACE_ALIGNMENT] = {0};
+
+PDOKAN_EVENT_RECORDER DokanEventRecorder_Alloc() {
+  PDOKAN_EVENT_RECORDER recorder = malloc(sizeof(DOKAN_EVENT_RECORDER));
+  if (!recorder) {
+    DokanDbgPrintW(L"Dokan Error: Failed to allocate event recorder.\n");
+    return NULL;
+  }
+  ZeroMemory(recorder, sizeof(DOKAN_EVENT_RECORDER));
+  InitializeSRWLock(&recorder->Lock);
+  return recorder;
+}
+
+VOID DokanEventRecorder_Free(PDOKAN_EVENT_RECORDER Recorder) {
+  if (!Recorder) {
+    return;
+  }
+  DokanEventRecorder_Stop(Recorder);
+  free(Recorder);
+}
+
+// Writes Length bytes to the trace file. Called with the lock held.
+static DWORD WriteTraceFile(PDOKAN_EVENT_RECORDER Recorder, const VOID *Data,
+                            ULONG Length) {
+  DWORD written = 0;
+  if (!WriteFile(Recorder->File, Data, Length, &written, NULL)) {
+    return GetLastError();
+  }
+  return written == Length ? ERROR_SUCCESS : ERROR_WRITE_FAULT;
+}
+
+static DWORD FlushTraceBuffer(PDOKAN_EVENT_RECORDER Recorder) {
+  DWORD error = ERROR_SUCCESS;
+  if (Recorder->BufferLength) {
+    error = WriteTraceFile(Recorder, Recorder->Buffer, Recorder->BufferLength);
+    Recorder->BufferLength = 0;
+  }
+  return error;
+}
+
+// Closes the trace file. Called with the lock held.
+static DWORD CloseTraceFile(PDOKAN_EVENT_RECORDER Recorder) {
+  DWORD error = FlushTraceBuffer(Recorder);
+  InterlockedExchange(&Recorder->Recording, FALSE);
+  CloseHandle(Recorder->File);
+  Recorder->File = NULL;
+  free(Recorder->Buffer);
+  Recorder->Buffer = NULL;
+  return error;
+}
+
+DWORD DokanEventRecorder_Start(PDOKAN_EVENT_RECORDER Recorder,
+                               LPCWSTR TracePath) {
+  DOKAN_EVENT_TRACE_HEADER header;
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER now;
+  DWORD error;
+
+  AcquireSRWLockExclusive(&Recorder->Lock);
+  if (Recorder->File) {
+    ReleaseSRWLockExclusive(&Recorder->Lock);
+    return ERROR_ALREADY_INITIALIZED;
+  }
+  Recorder->Buffer = malloc(DOKAN_EVENT_RECORDER_BUFFER_SIZE);
+  if (!Recorder->Buffer) {
+    ReleaseSRWLockExclusive(&Recorder->Lock);
+    return ERROR_NOT_ENOUGH_MEMORY;
+  }
+  Recorder->File = CreateFileW(TracePath, GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                               CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (Recorder->File == INVALID_HANDLE_VALUE) {
+    error = GetLastError();
+    Recorder->File = NULL;
+    free(Recorder->Buffer);
+    Recorder->Buffer = NULL;
+    ReleaseSRWLockExclusive(&Recorder->Lock);
+    return error;
+  }
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&now);
+  header.Magic = DOKAN_EVENT_TRACE_MAGIC;
+  header.Version = DOKAN_EVENT_TRACE_VERSION;
+  header.Frequency = frequency.QuadPart;
+  error = WriteTraceFile(Recorder, &header, sizeof(header));
+  if (error != ERROR_SUCCESS) {
+    CloseTraceFile(Recorder);
+    ReleaseSRWLockExclusive(&Recorder->Lock);
+    return error;
+  }
+  Recorder->Start = now.QuadPart;
+  Recorder->BufferLength = 0;
+  InterlockedExchange(&Recorder->Recording, TRUE);
+  ReleaseSRWLockExclusive(&Recorder->Lock);
+  return ERROR_SUCCESS;
+}
+
+DWORD DokanEventRecorder_Stop(PDOKAN_EVENT_RECORDER Recorder) {
+  DWORD error;
+  AcquireSRWLockExclusive(&Recorder->Lock);
+  if (!Recorder->File) {
+    ReleaseSRWLockExclusive(&Recorder->Lock);
+    return ERROR_INVALID_STATE;
+  }
+  error = CloseTraceFile(Recorder);
+  ReleaseSRWLockExclusive(&Recorder->Lock);
+  return error;
+}
+
+static VOID AppendRecord(PDOKAN_EVENT_RECORDER Recorder, USHORT Type,
+                         ULONG SerialNumber, ULONG64 Context,
+                         const VOID *Data, ULONG Length) {
+  DOKAN_EVENT_TRACE_RECORD record;
+  ULONG64 recordSize = DOKAN_EVENT_TRACE_RECORD_SIZE(Length);
+  ULONG paddingLength =
+      (ULONG)(recordSize - sizeof(DOKAN_EVENT_TRACE_RECORD) - Length);
+  LARGE_INTEGER now;
+  DWORD error = ERROR_SUCCESS;
+
+  if (!Recorder || !Recorder->Recording) {
+    return;
+  }
+  QueryPerformanceCounter(&now);
+  ZeroMemory(&record, sizeof(record));
+  record.Type = Type;
+  record.Length = Length;
+  record.SerialNumber = SerialNumber;
+  record.Context = Context;
+
+  AcquireSRWLockExclusive(&Recorder->Lock);
+  if (!Recorder->File) {
+    ReleaseSRWLockExclusive(&Recorder->Lock);
+    return;
+  }
+  record.Time = now.QuadPart - Recorder->Start;
+  if (Recorder->BufferLength + recordSize > DOKAN_EVENT_RECORDER_BUFFER_SIZE) {
+    error = FlushTraceBuffer(Recorder);
+  }
+  if (error == ERROR_SUCCESS &&
+      recordSize > DOKAN_EVENT_RECORDER_BUFFER_SIZE) {
+    // Too large to be buffered.
+    error = WriteTraceFile(Recorder, &record, sizeof(record));
+    if (error == ERROR_SUCCESS) {
+      error = WriteTraceFile(Recorder, Data, Length);
+    }
+    if (error == ERROR_SUCCESS && paddingLength) {
+      error = WriteTraceFile(Recorder, g_EventTracePadding, paddingLength);
+    }
+  } else if (error == ERROR_SUCCESS) {
+    PCHAR buffer = Recorder->Buffer + Recorder->BufferLength;
+    RtlCopyMemory(buffer, &record, sizeof(record));
+    if (Length) {
+      RtlCopyMemory(buffer + sizeof(record), Data, Length);
+    }
+    RtlZeroMemory(buffer + sizeof(record) + Length, paddingLength);
+    Recorder->BufferLength += (ULONG)recordSize;
+  }
+  if (error != ERROR_SUCCESS) {
+    DokanDbgPrintW(L"Dokan Error: Failed to write the event trace with error "
+                   L"%d, stopping the recording.\n",
+                   error);
+    CloseTraceFile(Recorder);
+  }
+  ReleaseSRWLockExclusive(&Recorder->Lock);
+}
+
+VOID DokanEventRecorder_RecordBatch(PDOKAN_EVENT_RECORDER Recorder,
+                                    PEVENT_CONTEXT EventContext,
+                                    ULONG Length) {
+  AppendRecord(Recorder, DOKAN_EVENT_TRACE_BATCH, 0, 0, EventContext, Length);
+}
+
+VOID DokanEventRecorder_RecordOpen(PDOKAN_EVENT_RECORDER Recorder,
+                                   ULONG SerialNumber, ULONG64 Context) {
+  AppendRecord(Recorder, DOKAN_EVENT_TRACE_OPEN, SerialNumber, Context, NULL,
+               0);
+}
+
+VOID DokanEventRecorder_RecordWrite(PDOKAN_EVENT_RECORDER Recorder,
+                                    PEVENT_CONTEXT EventContext,
+                                    ULONG Length) {
+  AppendRecord(Recorder, DOKAN_EVENT_TRACE_WRITE, EventContext->SerialNumber,
+               0, EventContext, Length);
+}
+
+static ULONG GetMapSlot(ULONG64 Key, ULONG Capacity) {
+  // Fibonacci hashing, the keys are pointers and serial numbers.
+  return (ULONG)((Key * 0x9E3779B97F4A7C15ULL) >> 32) & (Capacity - 1);
+}
+
+static PDOKAN_EVENT_TRACE_MAP_ENTRY FindMapEntry(
+    PDOKAN_EVENT_TRACE_MAP_ENTRY Entries, ULONG Capacity, ULONG64 Key) {
+  ULONG slot = GetMapSlot(Key, Capacity);
+  while (Entries[slot].Used && Entries[slot].Key != Key) {
+    slot = (slot + 1) & (Capacity - 1);
+  }
+  return &Entries[slot];
+}
+
+static BOOL GrowMap(PDOKAN_EVENT_TRACE_MAP Map) {
+  ULONG capacity = Map->Capacity ? Map->Capacity * 2
+                                 : DOKAN_EVENT_TRACE_MAP_MIN_CAPACITY;
+  PDOKAN_EVENT_TRACE_MAP_ENTRY entries =
+      calloc(capacity, sizeof(DOKAN_EVENT_TRACE_MAP_ENTRY));
+  if (!entries) {
+    return FALSE;
+  }
+  for (ULONG i = 0; i < Map->Capacity; ++i) {
+    if (Map->Entries[i].Used) {
+      *FindMapEntry(entries, capacity, Map->Entries[i].Key) = Map->Entries[i];
+    }
+  }
+  free(Map->Entries);
+  Map->Entries = entries;
+  Map->Capacity = capacity;
+  return TRUE;
+}
+
+BOOL DokanEventTraceMap_Put(PDOKAN_EVENT_TRACE_MAP Map, ULONG64 Key,
+                            ULONG64 Value) {
+  PDOKAN_EVENT_TRACE_MAP_ENTRY entry;
+  // Keep the load under 3/4.
+  if ((Map->Count + 1) * 4 > Map->Capacity * 3 && !GrowMap(Map)) {
+    return FALSE;
+  }
+  entry = FindMapEntry(Map->Entries, Map->Capacity, Key);
+  if (!entry->Used) {
+    entry->Used = TRUE;
+    entry->Key = Key;
+    ++Map->Count;
+  }
+  entry->Value = Value;
+  return TRUE;
+}
+
+BOOL DokanEventTraceMap_Get(PDOKAN_EVENT_TRACE_MAP Map, ULONG64 Key,
+                            PULONG64 Value) {
+  PDOKAN_EVENT_TRACE_MAP_ENTRY entry;
+  if (!Map->Capacity) {
+    return FALSE;
+  }
+  entry = FindMapEntry(Map->Entries, Map->Capacity, Key);
+  if (!entry->Used) {
+    return FALSE;
+  }
+  *Value = entry->Value;
+  return TRUE;
+}
+
+VOID DokanEventTraceMap_Free(PDOKAN_EVENT_TRACE_MAP Map) {
+  free(Map->Entries);
+  ZeroMemory(Map, sizeof(DOKAN_EVENT_TRACE_MAP));
+}
+
+// Checks the records of the trace and indexes the large writes.
+static DWORD IndexTrace(PDOKAN_EVENT_REPLAYER Replayer) {
+  PDOKAN_EVENT_TRACE_HEADER header = (PDOKAN_EVENT_TRACE_HEADER)Replayer->View;
+  ULONG64 position = sizeof(DOKAN_EVENT_TRACE_HEADER);
+
+  if (Replayer->Size < sizeof(DOKAN_EVENT_TRACE_HEADER) ||
+      header->Magic != DOKAN_EVENT_TRACE_MAGIC ||
+      header->Version != DOKAN_EVENT_TRACE_VERSION || header->Frequency <= 0) {
+    return ERROR_BAD_FORMAT;
+  }
+  Replayer->Frequency = header->Frequency;
+  while (position < Replayer->Size) {
+    PDOKAN_EVENT_TRACE_RECORD record =
+        (PDOKAN_EVENT_TRACE_RECORD)(Replayer->View + position);
+    if (Replayer->Size - position < sizeof(DOKAN_EVENT_TRACE_RECORD) ||
+        Replayer->Size - position <
+            DOKAN_EVENT_TRACE_RECORD_SIZE(record->Length)) {
+      // Truncated, the recording was not stopped. Replay what is complete.
+      DokanDbgPrintW(L"Dokan Warning: Event trace truncated at %I64u.\n",
+                     position);
+      Replayer->Size = position;
+      break;
+    }
+    if (record->Type == DOKAN_EVENT_TRACE_WRITE &&
+        !DokanEventTraceMap_Put(&Replayer->Writes, record->SerialNumber,
+                                position + sizeof(DOKAN_EVENT_TRACE_RECORD))) {
+      return ERROR_NOT_ENOUGH_MEMORY;
+    }
+    Replayer->Duration = record->Time;
+    position += DOKAN_EVENT_TRACE_RECORD_SIZE(record->Length);
+  }
+  Replayer->Position = sizeof(DOKAN_EVENT_TRACE_HEADER);
+  return ERROR_SUCCESS;
+}
+
+DWORD DokanEventReplayer_Open(LPCWSTR TracePath,
+                              PDOKAN_EVENT_REPLAYER *Replayer) {
+  PDOKAN_EVENT_REPLAYER replayer;
+  LARGE_INTEGER size;
+  DWORD error = ERROR_SUCCESS;
+
+  *Replayer = NULL;
+  replayer = malloc(sizeof(DOKAN_EVENT_REPLAYER));
+  if (!replayer) {
+    return ERROR_NOT_ENOUGH_MEMORY;
+  }
+  ZeroMemory(replayer, sizeof(DOKAN_EVENT_REPLAYER));
+  replayer->OutstandingEvents = 1;
+  replayer->IdleEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (!replayer->IdleEvent) {
+    error = GetLastError();
+    DokanEventReplayer_Close(replayer);
+    return error;
+  }
+  replayer->File = CreateFileW(TracePath, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (replayer->File == INVALID_HANDLE_VALUE) {
+    error = GetLastError();
+    replayer->File = NULL;
+    DokanEventReplayer_Close(replayer);
+    return error;
+  }
+  if (!GetFileSizeEx(replayer->File, &size)) {
+    error = GetLastError();
+    DokanEventReplayer_Close(replayer);
+    return error;
+  }
+  if ((ULONG64)size.QuadPart < sizeof(DOKAN_EVENT_TRACE_HEADER)) {
+    DokanEventReplayer_Close(replayer);
+    return ERROR_BAD_FORMAT;
+  }
+  replayer->Size = size.QuadPart;
+  replayer->Mapping =
+      CreateFileMappingW(replayer->File, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (replayer->Mapping) {
+    replayer->View = MapViewOfFile(replayer->Mapping, FILE_MAP_READ, 0, 0, 0);
+  }
+  if (!replayer->View) {
+    error = GetLastError();
+    DokanEventReplayer_Close(replayer);
+    return error;
+  }
+  error = IndexTrace(replayer);
+  if (error != ERROR_SUCCESS) {
+    DokanEventReplayer_Close(replayer);
+    return error;
+  }
+  *Replayer = replayer;
+  return ERROR_SUCCESS;
+}
+
+VOID DokanEventReplayer_Close(PDOKAN_EVENT_REPLAYER Replayer) {
+  if (!Replayer) {
+    return;
+  }
+  if (Replayer->View) {
+    UnmapViewOfFile(Replayer->View);
+  }
+  if (Replayer->Mapping) {
+    CloseHandle(Replayer->Mapping);
+  }
+  if (Replayer->File) {
+    CloseHandle(Replayer->File);
+  }
+  if (Replayer->IdleEvent) {
+    CloseHandle(Replayer->IdleEvent);
+  }
+  DokanEventTraceMap_Free(&Replayer->Writes);
+  DokanEventTraceMap_Free(&Replayer->Creates);
+  DokanEventTraceMap_Free(&Replayer->Contexts);
+  free(Replayer);
+}
+
+PDOKAN_EVENT_TRACE_RECORD
+DokanEventReplayer_Next(PDOKAN_EVENT_REPLAYER Replayer, PCHAR *Data) {
+  PDOKAN_EVENT_TRACE_RECORD record;
+  if (Replayer->Position >= Replayer->Size) {
+    return NULL;
+  }
+  // The records were checked by IndexTrace.
+  record = (PDOKAN_EVENT_TRACE_RECORD)(Replayer->View + Replayer->Position);
+  *Data = (PCHAR)(record + 1);
+  Replayer->Position += DOKAN_EVENT_TRACE_RECORD_SIZE(record->Length);
+  return record;
+}
+
+// Copies the recorded EVENT_CONTEXT of the large write SerialNumber.
+static DWORD ReadRecordedWrite(PDOKAN_EVENT_REPLAYER Replayer,
+                               ULONG SerialNumber, PEVENT_CONTEXT EventContext,
+                               ULONG EventContextLength,
+                               LPDWORD BytesReturned) {
+  PDOKAN_EVENT_TRACE_RECORD record;
+  ULONG64 position;
+  if (!DokanEventTraceMap_Get(&Replayer->Writes, SerialNumber, &position)) {
+    DokanDbgPrintW(L"Dokan Warning: Write %u is missing from the event "
+                   L"trace.\n",
+                   SerialNumber);
+    return ERROR_NOT_FOUND;
+  }
+  record = (PDOKAN_EVENT_TRACE_RECORD)(Replayer->View + position -
+                                       sizeof(DOKAN_EVENT_TRACE_RECORD));
+  if (record->Length > EventContextLength) {
+    return ERROR_INSUFFICIENT_BUFFER;
+  }
+  RtlCopyMemory(EventContext, Replayer->View + position, record->Length);
+  *BytesReturned = record->Length;
+  return ERROR_SUCCESS;
+}
+
+static BOOL ReplayControl(PDOKAN_INSTANCE DokanInstance, DWORD IoControlCode,
+                          PVOID InputBuffer, DWORD InputLength,
+                          PVOID OutputBuffer, DWORD OutputLength,
+                          LPDWORD BytesReturned) {
+  PDOKAN_EVENT_REPLAYER replayer =
+      (PDOKAN_EVENT_REPLAYER)DokanInstance->TransportContext;
+  DWORD error = ERROR_SUCCESS;
+  *BytesReturned = 0;
+  switch (IoControlCode) {
+  case FSCTL_EVENT_PROCESS_N_PULL:
+    // Only pending events reply through the transport, see
+    // DokanReplayEventTrace.
+    assert(OutputLength == 0);
+    DokanEventReplayer_ReleaseEvent(replayer);
+    break;
+  case FSCTL_EVENT_WRITE:
+    assert(InputLength >= sizeof(EVENT_INFORMATION));
+    error = ReadRecordedWrite(
+        replayer, ((PEVENT_INFORMATION)InputBuffer)->SerialNumber,
+        (PEVENT_CONTEXT)OutputBuffer, OutputLength, BytesReturned);
+    break;
+  default:
+    break;
+  }
+  UNREFERENCED_PARAMETER(InputLength);
+  if (error != ERROR_SUCCESS) {
+    SetLastError(error);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+const DOKAN_TRANSPORT g_DokanEventReplayTransport = {ReplayControl,
+                                                     /*Mounted=*/FALSE};
+
+VOID DokanEventReplayer_AcquireEvent(PDOKAN_EVENT_REPLAYER Replayer) {
+  InterlockedIncrement(&Replayer->OutstandingEvents);
+}
+
+VOID DokanEventReplayer_ReleaseEvent(PDOKAN_EVENT_REPLAYER Replayer) {
+  if (InterlockedDecrement(&Replayer->OutstandingEvents) == 0) {
+    SetEvent(Replayer->IdleEvent);
+  }
+}
+
+VOID DokanEventReplayer_WaitIdle(PDOKAN_EVENT_REPLAYER Replayer) {
+  DokanEventReplayer_ReleaseEvent(Replayer);
+  WaitForSingleObject(Replayer->IdleEvent, INFINITE);
+}
+
+ULONG DokanEventReplayer_CountEvents(PEVENT_CONTEXT EventContext,
+                                     ULONG Length) {
+  ULONG count = 0;
+  while (Length) {
+    if (Length < FIELD_OFFSET(EVENT_CONTEXT, Operation) ||
+        EventContext->Length < FIELD_OFFSET(EVENT_CONTEXT, Operation) ||
+        EventContext->Length > Length) {
+      return 0;
+    }
+    ++count;
+    Length -= EventContext->Length;
+    EventContext = (PEVENT_CONTEXT)((PCHAR)EventContext + EventContext->Length);
+  }
+  return count;
+}
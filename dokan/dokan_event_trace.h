@@ -0,0 +1,192 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_EVENT_TRACE_H_
+#define DOKAN_EVENT_TRACE_H_
+
+#include "dokani.h"
+#include "dokan_transport.h"
+
+// A trace file is a DOKAN_EVENT_TRACE_HEADER followed by records. Each record
+// is a DOKAN_EVENT_TRACE_RECORD followed by Length bytes of data, padded to
+// DOKAN_EVENT_TRACE_ALIGNMENT.
+#define DOKAN_EVENT_TRACE_MAGIC 0x5254454B // "KETR"
+#define DOKAN_EVENT_TRACE_VERSION 1
+#define DOKAN_EVENT_TRACE_ALIGNMENT 8
+
+// Events pulled from the driver together. The data are their EVENT_CONTEXT.
+#define DOKAN_EVENT_TRACE_BATCH 1
+// Context replied to the driver for a successful create. There is no data.
+#define DOKAN_EVENT_TRACE_OPEN 2
+// EVENT_CONTEXT of a large write, pulled with FSCTL_EVENT_WRITE.
+#define DOKAN_EVENT_TRACE_WRITE 3
+
+typedef struct _DOKAN_EVENT_TRACE_HEADER {
+  ULONG Magic;
+  ULONG Version;
+  // Performance counter ticks per second of the record times.
+  LONG64 Frequency;
+} DOKAN_EVENT_TRACE_HEADER, *PDOKAN_EVENT_TRACE_HEADER;
+
+typedef struct _DOKAN_EVENT_TRACE_RECORD {
+  USHORT Type;
+  USHORT Reserved;
+  // Size of the data following the record, without the padding.
+  ULONG Length;
+  // Performance counter ticks since the start of the recording.
+  LONG64 Time;
+  // Serial number of the event of OPEN and WRITE records.
+  ULONG SerialNumber;
+  ULONG Reserved2;
+  // Context of OPEN records.
+  ULONG64 Context;
+} DOKAN_EVENT_TRACE_RECORD, *PDOKAN_EVENT_TRACE_RECORD;
+
+#define DOKAN_EVENT_TRACE_RECORD_SIZE(Length)                                  \
+  ((sizeof(DOKAN_EVENT_TRACE_RECORD) + (ULONG64)(Length) +                     \
+    DOKAN_EVENT_TRACE_ALIGNMENT - 1) &                                         \
+   ~(ULONG64)(DOKAN_EVENT_TRACE_ALIGNMENT - 1))
+
+// Records are buffered and written to the file once this size is reached.
+#define DOKAN_EVENT_RECORDER_BUFFER_SIZE (1024 * 1024)
+
+// Writes the events received by a mount to a trace file, see
+// DokanStartEventRecording.
+typedef struct _DOKAN_EVENT_RECORDER {
+  // Read without the lock to skip recording quickly.
+  volatile LONG Recording;
+  // Protects the fields below.
+  SRWLOCK Lock;
+  // Trace file, NULL when not recording.
+  HANDLE File;
+  // Performance counter at the start of the recording.
+  LONG64 Start;
+  // Records not written to the file yet.
+  PCHAR Buffer;
+  ULONG BufferLength;
+} DOKAN_EVENT_RECORDER, *PDOKAN_EVENT_RECORDER;
+
+PDOKAN_EVENT_RECORDER DokanEventRecorder_Alloc();
+
+// Stops the recording if needed.
+VOID DokanEventRecorder_Free(PDOKAN_EVENT_RECORDER Recorder);
+
+// Creates the trace file, replacing an existing one. Returns a Win32 error.
+DWORD DokanEventRecorder_Start(PDOKAN_EVENT_RECORDER Recorder,
+                               LPCWSTR TracePath);
+
+// Writes the buffered records and closes the trace file. Returns a Win32
+// error, ERROR_INVALID_STATE if nothing was being recorded.
+DWORD DokanEventRecorder_Stop(PDOKAN_EVENT_RECORDER Recorder);
+
+// The recording functions below do nothing if Recorder is NULL or not
+// recording. A write error stops the recording.
+
+VOID DokanEventRecorder_RecordBatch(PDOKAN_EVENT_RECORDER Recorder,
+                                    PEVENT_CONTEXT EventContext,
+                                    ULONG Length);
+
+VOID DokanEventRecorder_RecordOpen(PDOKAN_EVENT_RECORDER Recorder,
+                                   ULONG SerialNumber, ULONG64 Context);
+
+VOID DokanEventRecorder_RecordWrite(PDOKAN_EVENT_RECORDER Recorder,
+                                    PEVENT_CONTEXT EventContext,
+                                    ULONG Length);
+
+typedef struct _DOKAN_EVENT_TRACE_MAP_ENTRY {
+  ULONG64 Key;
+  ULONG64 Value;
+  BOOL Used;
+} DOKAN_EVENT_TRACE_MAP_ENTRY, *PDOKAN_EVENT_TRACE_MAP_ENTRY;
+
+// Open addressing hash map used by the replay. Entries are never removed.
+typedef struct _DOKAN_EVENT_TRACE_MAP {
+  PDOKAN_EVENT_TRACE_MAP_ENTRY Entries;
+  // Power of two.
+  ULONG Capacity;
+  ULONG Count;
+} DOKAN_EVENT_TRACE_MAP, *PDOKAN_EVENT_TRACE_MAP;
+
+// Inserts or replaces the value of Key. Returns FALSE on allocation failure.
+BOOL DokanEventTraceMap_Put(PDOKAN_EVENT_TRACE_MAP Map, ULONG64 Key,
+                            ULONG64 Value);
+
+BOOL DokanEventTraceMap_Get(PDOKAN_EVENT_TRACE_MAP Map, ULONG64 Key,
+                            PULONG64 Value);
+
+VOID DokanEventTraceMap_Free(PDOKAN_EVENT_TRACE_MAP Map);
+
+// Feeds a trace file to the dispatch of an instance without a device, see
+// DokanReplayEventTrace.
+typedef struct _DOKAN_EVENT_REPLAYER {
+  HANDLE File;
+  HANDLE Mapping;
+  // Read-only view of the whole trace file.
+  PCHAR View;
+  ULONG64 Size;
+  // Offset of the next record returned by DokanEventReplayer_Next.
+  ULONG64 Position;
+  LONG64 Frequency;
+  // Time of the last record.
+  LONG64 Duration;
+  // Serial number -> offset of the data of the WRITE record.
+  DOKAN_EVENT_TRACE_MAP Writes;
+  // Serial number -> context replied by the replay for a create.
+  DOKAN_EVENT_TRACE_MAP Creates;
+  // Recorded context -> context replied by the replay for the same open.
+  DOKAN_EVENT_TRACE_MAP Contexts;
+  // Events dispatched but not completed, plus one held by the replay loop.
+  volatile LONG OutstandingEvents;
+  // Set when OutstandingEvents drops to 0.
+  HANDLE IdleEvent;
+} DOKAN_EVENT_REPLAYER, *PDOKAN_EVENT_REPLAYER;
+
+// Transport of a replay, its context is the DOKAN_EVENT_REPLAYER. The replies
+// are dropped and the large writes are read from the trace.
+extern const DOKAN_TRANSPORT g_DokanEventReplayTransport;
+
+// Opens and validates a trace file. Returns a Win32 error.
+DWORD DokanEventReplayer_Open(LPCWSTR TracePath,
+                              PDOKAN_EVENT_REPLAYER *Replayer);
+
+VOID DokanEventReplayer_Close(PDOKAN_EVENT_REPLAYER Replayer);
+
+// Returns the next record and sets Data to its data, or NULL at the end of
+// the trace.
+PDOKAN_EVENT_TRACE_RECORD
+DokanEventReplayer_Next(PDOKAN_EVENT_REPLAYER Replayer, PCHAR *Data);
+
+// Counts an event that can complete after its dispatch returned.
+VOID DokanEventReplayer_AcquireEvent(PDOKAN_EVENT_REPLAYER Replayer);
+
+// Called once an event counted by DokanEventReplayer_AcquireEvent completed.
+// The transport does it for the replies of pending events.
+VOID DokanEventReplayer_ReleaseEvent(PDOKAN_EVENT_REPLAYER Replayer);
+
+// Releases the count of the replay loop and waits for the completion of the
+// pending events.
+VOID DokanEventReplayer_WaitIdle(PDOKAN_EVENT_REPLAYER Replayer);
+
+// Returns the number of events of a BATCH record, or 0 if their lengths are
+// invalid.
+ULONG DokanEventReplayer_CountEvents(PEVENT_CONTEXT EventContext,
+                                     ULONG Length);
+
+#endif
@@ -0,0 +1,444 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+#include <assert.h>
+
+typedef struct _DOKAN_FILE_INFO_CACHE_ENTRY {
+  LIST_ENTRY BucketEntry;
+  LIST_ENTRY LruEntry;
+  ULONG Hash;
+  ULONG64 ExpirationTime;
+  ULONG64 Context;
+  // Built from a directory listing: only the attributes, times and size are
+  // known and the entry matches any context.
+  BOOLEAN FromDirectoryList;
+  BY_HANDLE_FILE_INFORMATION FileInfo;
+  size_t Size;
+  size_t NameLength;
+  // File name folded to upper case unless the mount is case sensitive.
+  WCHAR Name[1];
+} DOKAN_FILE_INFO_CACHE_ENTRY, *PDOKAN_FILE_INFO_CACHE_ENTRY;
+
+static WCHAR FoldChar(PDOKAN_FILE_INFO_CACHE Cache, WCHAR C) {
+  return Cache->CaseSensitive ? C : towupper(C);
+}
+
+// Length of the name without its trailing backslashes, except for the root.
+static size_t GetNameLength(LPCWSTR Name, size_t Length) {
+  while (Length > 1 && Name[Length - 1] == L'\\') {
+    --Length;
+  }
+  return Length;
+}
+
+// Length of the parent directory name, keeping the backslash of the root.
+static size_t GetParentLength(LPCWSTR Name, size_t Length) {
+  while (Length > 0 && Name[Length - 1] != L'\\') {
+    --Length;
+  }
+  if (Length > 1) {
+    --Length;
+  }
+  return Length;
+}
+
+static ULONG HashName(PDOKAN_FILE_INFO_CACHE Cache, LPCWSTR Name,
+                      size_t Length) {
+  // FNV-1a
+  ULONG hash = 2166136261;
+  size_t i;
+  for (i = 0; i < Length; ++i) {
+    hash = (hash ^ FoldChar(Cache, Name[i])) * 16777619;
+  }
+  return hash;
+}
+
+static BOOL NameEquals(PDOKAN_FILE_INFO_CACHE Cache, LPCWSTR Folded,
+                       LPCWSTR Name, size_t Length) {
+  size_t i;
+  for (i = 0; i < Length; ++i) {
+    if (Folded[i] != FoldChar(Cache, Name[i])) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static PLIST_ENTRY GetBucket(PDOKAN_FILE_INFO_CACHE Cache, ULONG Hash) {
+  return &Cache->Buckets[Hash % DOKAN_FILE_INFO_CACHE_BUCKET_COUNT];
+}
+
+static VOID RemoveCacheEntry(PDOKAN_FILE_INFO_CACHE Cache,
+                             PDOKAN_FILE_INFO_CACHE_ENTRY Entry) {
+  RemoveEntryList(&Entry->BucketEntry);
+  RemoveEntryList(&Entry->LruEntry);
+  assert(Cache->EntryCount > 0 && Cache->Size >= Entry->Size);
+  --Cache->EntryCount;
+  Cache->Size -= Entry->Size;
+  free(Entry);
+}
+
+// Whether an entry built from a directory listing holds everything needed to
+// answer a query of FileInformationClass.
+static BOOL IsDirectoryListInfoEnough(ULONG FileInformationClass) {
+  switch (FileInformationClass) {
+  case FileBasicInformation:
+  case FileAttributeTagInformation:
+  case FileNetworkOpenInformation:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+// Removes all the entries of a name. Must be called with the lock held.
+// Returns TRUE when the removed entries tell that the name is not a
+// directory.
+static BOOL RemoveName(PDOKAN_FILE_INFO_CACHE Cache, LPCWSTR Name,
+                       size_t Length) {
+  ULONG hash = HashName(Cache, Name, Length);
+  PLIST_ENTRY bucket = GetBucket(Cache, hash);
+  PLIST_ENTRY listEntry;
+  PLIST_ENTRY nextEntry;
+  BOOL removed = FALSE;
+  BOOL directory = FALSE;
+  for (listEntry = bucket->Flink; listEntry != bucket; listEntry = nextEntry) {
+    PDOKAN_FILE_INFO_CACHE_ENTRY entry =
+        CONTAINING_RECORD(listEntry, DOKAN_FILE_INFO_CACHE_ENTRY, BucketEntry);
+    nextEntry = listEntry->Flink;
+    if (entry->Hash == hash && entry->NameLength == Length &&
+        NameEquals(Cache, entry->Name, Name, Length)) {
+      removed = TRUE;
+      directory |= entry->FileInfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY;
+      RemoveCacheEntry(Cache, entry);
+      ++Cache->Invalidations;
+    }
+  }
+  return removed && !directory;
+}
+
+// Inserts a new entry replacing the one with the same key. Must be called
+// with the lock held.
+static VOID InsertCacheEntry(PDOKAN_FILE_INFO_CACHE Cache,
+                             PDOKAN_FILE_INFO_CACHE_ENTRY NewEntry) {
+  PLIST_ENTRY bucket = GetBucket(Cache, NewEntry->Hash);
+  PLIST_ENTRY listEntry;
+  for (listEntry = bucket->Flink; listEntry != bucket;
+       listEntry = listEntry->Flink) {
+    PDOKAN_FILE_INFO_CACHE_ENTRY entry =
+        CONTAINING_RECORD(listEntry, DOKAN_FILE_INFO_CACHE_ENTRY, BucketEntry);
+    if (entry->Hash == NewEntry->Hash &&
+        entry->NameLength == NewEntry->NameLength &&
+        entry->FromDirectoryList == NewEntry->FromDirectoryList &&
+        entry->Context == NewEntry->Context &&
+        wcsncmp(entry->Name, NewEntry->Name, entry->NameLength) == 0) {
+      RemoveCacheEntry(Cache, entry);
+      break;
+    }
+  }
+  InsertHeadList(bucket, &NewEntry->BucketEntry);
+  InsertHeadList(&Cache->LruList, &NewEntry->LruEntry);
+  ++Cache->EntryCount;
+  Cache->Size += NewEntry->Size;
+  while (Cache->EntryCount > DOKAN_FILE_INFO_CACHE_MAX_ENTRIES) {
+    RemoveCacheEntry(Cache, CONTAINING_RECORD(Cache->LruList.Blink,
+                                              DOKAN_FILE_INFO_CACHE_ENTRY,
+                                              LruEntry));
+    ++Cache->Evictions;
+  }
+}
+
+// Allocates an entry for the name made of Prefix and Name, separated by a
+// backslash when Prefix is not the root.
+static PDOKAN_FILE_INFO_CACHE_ENTRY
+AllocCacheEntry(PDOKAN_FILE_INFO_CACHE Cache, LPCWSTR Prefix,
+                size_t PrefixLength, LPCWSTR Name, size_t NameLength) {
+  BOOL separator = NameLength > 0 && PrefixLength > 0 &&
+                   Prefix[PrefixLength - 1] != L'\\';
+  size_t length = PrefixLength + (separator ? 1 : 0) + NameLength;
+  size_t entrySize = FIELD_OFFSET(DOKAN_FILE_INFO_CACHE_ENTRY, Name) +
+                     (length + 1) * sizeof(WCHAR);
+  PDOKAN_FILE_INFO_CACHE_ENTRY entry;
+  size_t i;
+  size_t position = 0;
+
+  entry = (PDOKAN_FILE_INFO_CACHE_ENTRY)malloc(entrySize);
+  if (!entry) {
+    return NULL;
+  }
+  for (i = 0; i < PrefixLength; ++i) {
+    entry->Name[position++] = FoldChar(Cache, Prefix[i]);
+  }
+  if (separator) {
+    entry->Name[position++] = L'\\';
+  }
+  for (i = 0; i < NameLength; ++i) {
+    entry->Name[position++] = FoldChar(Cache, Name[i]);
+  }
+  entry->Name[length] = L'\0';
+  entry->NameLength = length;
+  entry->Hash = HashName(Cache, entry->Name, length);
+  entry->Size = entrySize;
+  entry->ExpirationTime = GetTickCount64() + Cache->Timeout;
+  return entry;
+}
+
+BOOL DokanFileInfoCache_IsCacheable(ULONG FileInformationClass) {
+  switch (FileInformationClass) {
+  case FileBasicInformation:
+  case FileIdInformation:
+  case FileInternalInformation:
+  case FileStandardInformation:
+  case FileAllInformation:
+  case FileAttributeTagInformation:
+  case FileNetworkOpenInformation:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+PDOKAN_FILE_INFO_CACHE DokanFileInfoCache_Alloc(ULONG Timeout,
+                                                BOOL CaseSensitive) {
+  ULONG i;
+  PDOKAN_FILE_INFO_CACHE cache =
+      (PDOKAN_FILE_INFO_CACHE)malloc(sizeof(DOKAN_FILE_INFO_CACHE));
+  if (!cache) {
+    DbgPrintW(L"DOKAN_FILE_INFO_CACHE allocation failed.\n");
+    return NULL;
+  }
+  ZeroMemory(cache, sizeof(DOKAN_FILE_INFO_CACHE));
+  (void)InitializeCriticalSectionAndSpinCount(&cache->CriticalSection,
+                                              0x80000400);
+  for (i = 0; i < DOKAN_FILE_INFO_CACHE_BUCKET_COUNT; ++i) {
+    InitializeListHead(&cache->Buckets[i]);
+  }
+  InitializeListHead(&cache->LruList);
+  cache->Timeout = Timeout ? Timeout : DOKAN_FILE_INFO_CACHE_DEFAULT_TIMEOUT;
+  cache->CaseSensitive = CaseSensitive;
+  return cache;
+}
+
+VOID DokanFileInfoCache_Free(PDOKAN_FILE_INFO_CACHE Cache) {
+  if (!Cache) {
+    return;
+  }
+  while (!IsListEmpty(&Cache->LruList)) {
+    RemoveCacheEntry(Cache, CONTAINING_RECORD(Cache->LruList.Flink,
+                                              DOKAN_FILE_INFO_CACHE_ENTRY,
+                                              LruEntry));
+  }
+  DeleteCriticalSection(&Cache->CriticalSection);
+  free(Cache);
+}
+
+BOOL DokanFileInfoCache_Lookup(PDOKAN_FILE_INFO_CACHE Cache, LPCWSTR FileName,
+                               ULONG64 Context, ULONG FileInformationClass,
+                               PBY_HANDLE_FILE_INFORMATION FileInfo) {
+  size_t length = GetNameLength(FileName, wcslen(FileName));
+  ULONG hash = HashName(Cache, FileName, length);
+  PLIST_ENTRY bucket = GetBucket(Cache, hash);
+  PLIST_ENTRY listEntry;
+  PLIST_ENTRY nextEntry;
+  PDOKAN_FILE_INFO_CACHE_ENTRY found = NULL;
+  ULONG64 now = GetTickCount64();
+  BOOL allowDirectoryList = IsDirectoryListInfoEnough(FileInformationClass);
+
+  EnterCriticalSection(&Cache->CriticalSection);
+  {
+    for (listEntry = bucket->Flink; listEntry != bucket;
+         listEntry = nextEntry) {
+      PDOKAN_FILE_INFO_CACHE_ENTRY entry = CONTAINING_RECORD(
+          listEntry, DOKAN_FILE_INFO_CACHE_ENTRY, BucketEntry);
+      nextEntry = listEntry->Flink;
+      if (entry->Hash != hash || entry->NameLength != length ||
+          !NameEquals(Cache, entry->Name, FileName, length)) {
+        continue;
+      }
+      if (entry->ExpirationTime <= now) {
+        RemoveCacheEntry(Cache, entry);
+        continue;
+      }
+      if (entry->FromDirectoryList ? allowDirectoryList
+                                   : entry->Context == Context) {
+        found = entry;
+        break;
+      }
+    }
+    if (found) {
+      *FileInfo = found->FileInfo;
+      RemoveEntryList(&found->LruEntry);
+      InsertHeadList(&Cache->LruList, &found->LruEntry);
+      ++Cache->Hits;
+    } else {
+      ++Cache->Misses;
+    }
+  }
+  LeaveCriticalSection(&Cache->CriticalSection);
+  return found != NULL;
+}
+
+ULONG64 DokanFileInfoCache_GetInvalidationSequence(
+    PDOKAN_FILE_INFO_CACHE Cache) {
+  ULONG64 sequence;
+  EnterCriticalSection(&Cache->CriticalSection);
+  { sequence = Cache->InvalidationSequence; }
+  LeaveCriticalSection(&Cache->CriticalSection);
+  return sequence;
+}
+
+VOID DokanFileInfoCache_Insert(PDOKAN_FILE_INFO_CACHE Cache, LPCWSTR FileName,
+                               ULONG64 Context,
+                               PBY_HANDLE_FILE_INFORMATION FileInfo,
+                               ULONG64 InvalidationSequence) {
+  PDOKAN_FILE_INFO_CACHE_ENTRY entry = AllocCacheEntry(
+      Cache, FileName, GetNameLength(FileName, wcslen(FileName)), NULL, 0);
+  if (!entry) {
+    return;
+  }
+  entry->Context = Context;
+  entry->FromDirectoryList = FALSE;
+  entry->FileInfo = *FileInfo;
+
+  EnterCriticalSection(&Cache->CriticalSection);
+  {
+    if (Cache->InvalidationSequence == InvalidationSequence) {
+      InsertCacheEntry(Cache, entry);
+      entry = NULL;
+    }
+  }
+  LeaveCriticalSection(&Cache->CriticalSection);
+  // The information may predate a change of the file
+  free(entry);
+}
+
+VOID DokanFileInfoCache_InsertDirectoryList(PDOKAN_FILE_INFO_CACHE Cache,
+                                            LPCWSTR DirectoryName,
+                                            PDOKAN_DIRECTORY_LIST DirList,
+                                            ULONG64 InvalidationSequence) {
+  size_t directoryNameLength =
+      GetNameLength(DirectoryName, wcslen(DirectoryName));
+  size_t count = DokanDirectoryList_GetCount(DirList);
+  size_t i;
+
+  // Only keep the start of listings bigger than the cache itself
+  if (count > DOKAN_FILE_INFO_CACHE_MAX_ENTRIES / 2) {
+    count = DOKAN_FILE_INFO_CACHE_MAX_ENTRIES / 2;
+  }
+
+  EnterCriticalSection(&Cache->CriticalSection);
+  {
+    // The listing may predate a change of its entries
+    if (Cache->InvalidationSequence != InvalidationSequence) {
+      count = 0;
+    }
+    for (i = 0; i < count; ++i) {
+      PDOKAN_DIRECTORY_ENTRY dirEntry = DokanDirectoryList_GetEntry(DirList, i);
+      PDOKAN_FILE_INFO_CACHE_ENTRY entry;
+      if (wcscmp(dirEntry->FileName, L".") == 0 ||
+          wcscmp(dirEntry->FileName, L"..") == 0) {
+        continue;
+      }
+      entry = AllocCacheEntry(Cache, DirectoryName, directoryNameLength,
+                              dirEntry->FileName, dirEntry->FileNameLength);
+      if (!entry) {
+        break;
+      }
+      entry->Context = 0;
+      entry->FromDirectoryList = TRUE;
+      ZeroMemory(&entry->FileInfo, sizeof(BY_HANDLE_FILE_INFORMATION));
+      entry->FileInfo.dwFileAttributes = dirEntry->FileAttributes;
+      entry->FileInfo.ftCreationTime = dirEntry->CreationTime;
+      entry->FileInfo.ftLastAccessTime = dirEntry->LastAccessTime;
+      entry->FileInfo.ftLastWriteTime = dirEntry->LastWriteTime;
+      entry->FileInfo.nFileSizeHigh = dirEntry->FileSizeHigh;
+      entry->FileInfo.nFileSizeLow = dirEntry->FileSizeLow;
+      entry->FileInfo.nNumberOfLinks = 1;
+      InsertCacheEntry(Cache, entry);
+    }
+  }
+  LeaveCriticalSection(&Cache->CriticalSection);
+}
+
+VOID DokanFileInfoCache_InvalidateFile(PDOKAN_FILE_INFO_CACHE Cache,
+                                       LPCWSTR FileName, size_t FileNameLength,
+                                       BOOL IncludeParent) {
+  size_t length = GetNameLength(FileName, FileNameLength);
+  size_t parentLength = GetParentLength(FileName, length);
+  EnterCriticalSection(&Cache->CriticalSection);
+  {
+    ++Cache->InvalidationSequence;
+    if (IncludeParent && parentLength > 0) {
+      RemoveName(Cache, FileName, parentLength);
+    }
+    RemoveName(Cache, FileName, length);
+  }
+  LeaveCriticalSection(&Cache->CriticalSection);
+}
+
+VOID DokanFileInfoCache_InvalidateTree(PDOKAN_FILE_INFO_CACHE Cache,
+                                       LPCWSTR FileName,
+                                       size_t FileNameLength) {
+  size_t length = GetNameLength(FileName, FileNameLength);
+  size_t parentLength = GetParentLength(FileName, length);
+  PLIST_ENTRY listEntry;
+  PLIST_ENTRY nextEntry;
+
+  EnterCriticalSection(&Cache->CriticalSection);
+  {
+    ++Cache->InvalidationSequence;
+    // The parent directory times change with its content
+    if (parentLength > 0) {
+      RemoveName(Cache, FileName, parentLength);
+    }
+    // Entries below the name only exist for directories
+    if (!RemoveName(Cache, FileName, length)) {
+      for (listEntry = Cache->LruList.Flink; listEntry != &Cache->LruList;
+           listEntry = nextEntry) {
+        PDOKAN_FILE_INFO_CACHE_ENTRY entry = CONTAINING_RECORD(
+            listEntry, DOKAN_FILE_INFO_CACHE_ENTRY, LruEntry);
+        nextEntry = listEntry->Flink;
+        if (entry->NameLength > length &&
+            (length == 1 || entry->Name[length] == L'\\') &&
+            NameEquals(Cache, entry->Name, FileName, length)) {
+          RemoveCacheEntry(Cache, entry);
+          ++Cache->Invalidations;
+        }
+      }
+    }
+  }
+  LeaveCriticalSection(&Cache->CriticalSection);
+}
+
+VOID DokanFileInfoCache_GetStatistics(PDOKAN_FILE_INFO_CACHE Cache,
+                                      PDOKAN_CACHE_STATISTICS Statistics) {
+  EnterCriticalSection(&Cache->CriticalSection);
+  {
+    Statistics->Hits = Cache->Hits;
+    Statistics->Misses = Cache->Misses;
+    Statistics->Invalidations = Cache->Invalidations;
+    Statistics->Evictions = Cache->Evictions;
+    Statistics->EntryCount = Cache->EntryCount;
+    Statistics->MemoryUsage = Cache->Size;
+  }
+  LeaveCriticalSection(&Cache->CriticalSection);
+}
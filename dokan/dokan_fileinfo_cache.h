@@ -0,0 +1,109 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_FILEINFO_CACHE_H_
+#define DOKAN_FILEINFO_CACHE_H_
+
+#define DOKAN_FILE_INFO_CACHE_BUCKET_COUNT 4096
+
+// Default time in milliseconds a cached file information stays valid.
+#define DOKAN_FILE_INFO_CACHE_DEFAULT_TIMEOUT 1000
+
+// Number of entries above which the least recently used ones are evicted.
+#define DOKAN_FILE_INFO_CACHE_MAX_ENTRIES 16384
+
+// GetFileInformation results of a mount instance.
+// Entries are keyed by file name and DOKAN_FILE_INFO.Context. Entries built
+// from a directory listing have no context and only hold the fields found in
+// a WIN32_FIND_DATAW, they only answer the information classes that do not
+// need more.
+typedef struct _DOKAN_FILE_INFO_CACHE {
+  CRITICAL_SECTION CriticalSection;
+  LIST_ENTRY Buckets[DOKAN_FILE_INFO_CACHE_BUCKET_COUNT];
+  // Most recently used entries first.
+  LIST_ENTRY LruList;
+  ULONG Timeout;
+  ULONG EntryCount;
+  size_t Size;
+  BOOL CaseSensitive;
+  // Incremented by every invalidation. Information retrieved while it changed
+  // can miss the change and is not stored.
+  ULONG64 InvalidationSequence;
+  ULONG64 Hits;
+  ULONG64 Misses;
+  ULONG64 Invalidations;
+  ULONG64 Evictions;
+} DOKAN_FILE_INFO_CACHE, *PDOKAN_FILE_INFO_CACHE;
+
+// Creates a new empty cache. A Timeout of 0 selects the default.
+PDOKAN_FILE_INFO_CACHE DokanFileInfoCache_Alloc(ULONG Timeout,
+                                                BOOL CaseSensitive);
+
+// Releases the cache and all its entries.
+VOID DokanFileInfoCache_Free(PDOKAN_FILE_INFO_CACHE Cache);
+
+// Whether queries of FileInformationClass can be answered from the cache.
+// Only the classes derived from BY_HANDLE_FILE_INFORMATION alone can.
+BOOL DokanFileInfoCache_IsCacheable(ULONG FileInformationClass);
+
+// Retrieves the cached information of FileName able to answer a query of
+// FileInformationClass. Returns FALSE when none is cached.
+BOOL DokanFileInfoCache_Lookup(PDOKAN_FILE_INFO_CACHE Cache, LPCWSTR FileName,
+                               ULONG64 Context, ULONG FileInformationClass,
+                               PBY_HANDLE_FILE_INFORMATION FileInfo);
+
+// Returns the invalidation sequence to give to the inserts, taken before
+// calling the file system.
+ULONG64 DokanFileInfoCache_GetInvalidationSequence(
+    PDOKAN_FILE_INFO_CACHE Cache);
+
+// Stores the GetFileInformation result of FileName opened with Context.
+// Nothing is stored when an invalidation happened since InvalidationSequence
+// was taken, as for DokanFileInfoCache_InsertDirectoryList.
+VOID DokanFileInfoCache_Insert(PDOKAN_FILE_INFO_CACHE Cache, LPCWSTR FileName,
+                               ULONG64 Context,
+                               PBY_HANDLE_FILE_INFORMATION FileInfo,
+                               ULONG64 InvalidationSequence);
+
+// Stores the entries of the listing of DirectoryName.
+VOID DokanFileInfoCache_InsertDirectoryList(PDOKAN_FILE_INFO_CACHE Cache,
+                                            LPCWSTR DirectoryName,
+                                            PDOKAN_DIRECTORY_LIST DirList,
+                                            ULONG64 InvalidationSequence);
+
+// Drops the entries of FileName, and of its parent directory when
+// IncludeParent is set. Used when the file changed but no file below it did.
+// FileNameLength is in characters and FileName does not need to be null
+// terminated.
+VOID DokanFileInfoCache_InvalidateFile(PDOKAN_FILE_INFO_CACHE Cache,
+                                       LPCWSTR FileName, size_t FileNameLength,
+                                       BOOL IncludeParent);
+
+// Drops the entries of FileName, of its parent directory and of everything
+// below it. Used when FileName is deleted or renamed.
+VOID DokanFileInfoCache_InvalidateTree(PDOKAN_FILE_INFO_CACHE Cache,
+                                       LPCWSTR FileName,
+                                       size_t FileNameLength);
+
+// Retrieves the cache counters.
+VOID DokanFileInfoCache_GetStatistics(PDOKAN_FILE_INFO_CACHE Cache,
+                                      PDOKAN_CACHE_STATISTICS Statistics);
+
+#endif
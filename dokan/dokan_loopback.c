@@ -0,0 +1,800 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokan_loopback.h"
+
+#include <assert.h>
+
+// Largest IoSize of a workload, so that the events fit in a ULONG.
+#define DOKAN_LOOPBACK_MAX_IO_SIZE (64 * 1024 * 1024)
+
+#define DOKAN_LOOPBACK_ALIGN(Length) (((Length) + 7) & ~(SIZE_T)7)
+
+// Returns the length of an event whose operation ends at Length. The events
+// are at least as large as an EVENT_CONTEXT and aligned for the next one.
+static ULONG GetLoopbackEventLength(SIZE_T Length) {
+  return (ULONG)max(sizeof(EVENT_CONTEXT), DOKAN_LOOPBACK_ALIGN(Length));
+}
+
+// Returns the length of the file name sent in the events of the given major
+// function. Like the driver, the reads, writes and queries of an open omit it
+// when the mount asks for it, the create sent it already and files are never
+// renamed.
+static ULONG GetEventFileNameLength(PDOKAN_LOOPBACK Loopback,
+                                    PDOKAN_LOOPBACK_FILE File,
+                                    UCHAR MajorFunction) {
+  if (Loopback->OmitIoFileNames &&
+      (MajorFunction == IRP_MJ_READ || MajorFunction == IRP_MJ_WRITE ||
+       MajorFunction == IRP_MJ_QUERY_INFORMATION)) {
+    return 0;
+  }
+  return File->FileNameLength;
+}
+
+// Offset of the data of the writes of a file.
+static ULONG GetWriteBufferOffset(PDOKAN_LOOPBACK Loopback,
+                                  PDOKAN_LOOPBACK_FILE File) {
+  return (ULONG)DOKAN_LOOPBACK_ALIGN(
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.Write.FileName) +
+      GetEventFileNameLength(Loopback, File, IRP_MJ_WRITE) + sizeof(WCHAR));
+}
+
+static ULONG NextRandom(PDOKAN_LOOPBACK Loopback) {
+  // xorshift32
+  ULONG x = Loopback->Random;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  Loopback->Random = x;
+  return x;
+}
+
+static UCHAR PickOperation(PDOKAN_LOOPBACK Loopback) {
+  const DOKAN_LOOPBACK_WORKLOAD *workload = &Loopback->Workload;
+  ULONG64 pick;
+  if (workload->DirectoryQueryBufferLength) {
+    return IRP_MJ_DIRECTORY_CONTROL;
+  }
+  pick = NextRandom(Loopback) %
+         ((ULONG64)workload->ReadWeight + workload->WriteWeight +
+          workload->QueryInformationWeight);
+  if (pick < workload->ReadWeight) {
+    return IRP_MJ_READ;
+  }
+  if (pick < (ULONG64)workload->ReadWeight + workload->WriteWeight) {
+    return IRP_MJ_WRITE;
+  }
+  return IRP_MJ_QUERY_INFORMATION;
+}
+
+static VOID PushReadyFile(PDOKAN_LOOPBACK Loopback, ULONG Index) {
+  ULONG concurrency = Loopback->Workload.Concurrency;
+  assert(Loopback->ReadyCount < concurrency);
+  Loopback->ReadyFiles[(Loopback->ReadyHead + Loopback->ReadyCount) %
+                       concurrency] = Index;
+  ++Loopback->ReadyCount;
+  WakeConditionVariable(&Loopback->ReadyCondition);
+}
+
+static ULONG PopReadyFile(PDOKAN_LOOPBACK Loopback) {
+  ULONG index = Loopback->ReadyFiles[Loopback->ReadyHead];
+  assert(Loopback->ReadyCount);
+  Loopback->ReadyHead =
+      (Loopback->ReadyHead + 1) % Loopback->Workload.Concurrency;
+  --Loopback->ReadyCount;
+  return index;
+}
+
+// Moves the file past its current event, which is done, and makes it ready
+// for the next one if any. A failed create skips the cleanup and close.
+static VOID AdvanceFile(PDOKAN_LOOPBACK Loopback, ULONG Index, BOOL Success) {
+  PDOKAN_LOOPBACK_FILE file = &Loopback->Files[Index];
+  const DOKAN_LOOPBACK_WORKLOAD *workload = &Loopback->Workload;
+  file->SerialNumber = 0;
+  file->RequestLength = 0;
+  switch (file->State) {
+  case DOKAN_LOOPBACK_FILE_CREATE:
+    if (Success) {
+      file->Operations = 0;
+      file->State = workload->OperationsPerOpen ? DOKAN_LOOPBACK_FILE_IO
+                                                : DOKAN_LOOPBACK_FILE_CLEANUP;
+      break;
+    }
+    // Continue with the next open like after a close.
+    file->State = DOKAN_LOOPBACK_FILE_CLOSE;
+    // Fall through
+  case DOKAN_LOOPBACK_FILE_CLOSE:
+    file->Context = 0;
+    if (file->Opens == workload->OpensPerFile) {
+      file->State = DOKAN_LOOPBACK_FILE_DONE;
+      if (++Loopback->DoneFiles == workload->Concurrency) {
+        SetEvent(Loopback->CompletedEvent);
+      }
+      return;
+    }
+    ++file->Opens;
+    file->State = DOKAN_LOOPBACK_FILE_CREATE;
+    break;
+  case DOKAN_LOOPBACK_FILE_IO:
+    if (file->DirectoryIndex) {
+      // The listing continues.
+      break;
+    }
+    if (++file->Operations == workload->OperationsPerOpen) {
+      file->State = DOKAN_LOOPBACK_FILE_CLEANUP;
+    }
+    break;
+  case DOKAN_LOOPBACK_FILE_CLEANUP:
+    file->State = DOKAN_LOOPBACK_FILE_CLOSE;
+    break;
+  default:
+    assert(FALSE);
+    return;
+  }
+
+  switch (file->State) {
+  case DOKAN_LOOPBACK_FILE_CREATE:
+    file->MajorFunction = IRP_MJ_CREATE;
+    break;
+  case DOKAN_LOOPBACK_FILE_IO:
+    file->MajorFunction = PickOperation(Loopback);
+    break;
+  case DOKAN_LOOPBACK_FILE_CLEANUP:
+    file->MajorFunction = IRP_MJ_CLEANUP;
+    break;
+  default:
+    file->MajorFunction = IRP_MJ_CLOSE;
+    break;
+  }
+  PushReadyFile(Loopback, Index);
+}
+
+// Returns the length of the next event of the file, including the data of a
+// write.
+static ULONG GetNextEventLength(PDOKAN_LOOPBACK Loopback,
+                                PDOKAN_LOOPBACK_FILE File) {
+  SIZE_T nameSize =
+      GetEventFileNameLength(Loopback, File, File->MajorFunction) +
+      sizeof(WCHAR);
+  switch (File->MajorFunction) {
+  case IRP_MJ_CREATE:
+    return GetLoopbackEventLength(
+        FIELD_OFFSET(EVENT_CONTEXT, Operation.Create) + sizeof(CREATE_CONTEXT) +
+        2 * sizeof(DOKAN_UNICODE_STRING_INTERMEDIATE) + nameSize);
+  case IRP_MJ_READ:
+    return GetLoopbackEventLength(
+        FIELD_OFFSET(EVENT_CONTEXT, Operation.Read.FileName) + nameSize);
+  case IRP_MJ_WRITE:
+    return GetLoopbackEventLength(
+        (SIZE_T)GetWriteBufferOffset(Loopback, File) +
+        Loopback->Workload.IoSize);
+  case IRP_MJ_QUERY_INFORMATION:
+    return GetLoopbackEventLength(
+        FIELD_OFFSET(EVENT_CONTEXT, Operation.File.FileName) + nameSize);
+  case IRP_MJ_DIRECTORY_CONTROL:
+    // Like the driver, the search pattern follows the null terminated
+    // directory name.
+    return GetLoopbackEventLength(
+        FIELD_OFFSET(EVENT_CONTEXT, Operation.Directory.SearchPatternBase) +
+        nameSize + Loopback->SearchPatternLength + sizeof(WCHAR));
+  case IRP_MJ_CLEANUP:
+    return GetLoopbackEventLength(
+        FIELD_OFFSET(EVENT_CONTEXT, Operation.Cleanup.FileName) + nameSize);
+  default:
+    return GetLoopbackEventLength(
+        FIELD_OFFSET(EVENT_CONTEXT, Operation.Close.FileName) + nameSize);
+  }
+}
+
+// Writes the next event of the file, with the serial number the file waits
+// for. A write with a RequestLength has no data, the driver sends it with
+// FSCTL_EVENT_WRITE. The data of the other writes are filled by
+// FillWriteData.
+static VOID BuildEvent(PDOKAN_LOOPBACK Loopback, PDOKAN_LOOPBACK_FILE File,
+                       PEVENT_CONTEXT EventContext, ULONG Length,
+                       ULONG RequestLength) {
+  const DOKAN_LOOPBACK_WORKLOAD *workload = &Loopback->Workload;
+  LONG64 byteOffset =
+      (LONG64)(File->Operations % workload->FileBlocks) * workload->IoSize;
+  ULONG fileNameLength =
+      GetEventFileNameLength(Loopback, File, File->MajorFunction);
+  PWCHAR fileName;
+
+  RtlZeroMemory(EventContext, File->MajorFunction == IRP_MJ_WRITE
+                                  ? max(sizeof(EVENT_CONTEXT),
+                                        GetWriteBufferOffset(Loopback, File))
+                                  : Length);
+  EventContext->Length = Length;
+  EventContext->SerialNumber = File->SerialNumber;
+  EventContext->ProcessId = Loopback->ProcessId;
+  EventContext->MajorFunction = File->MajorFunction;
+  EventContext->Context = File->Context;
+
+  switch (File->MajorFunction) {
+  case IRP_MJ_CREATE: {
+    PCREATE_CONTEXT create = &EventContext->Operation.Create;
+    PDOKAN_ACCESS_STATE_INTERMEDIATE accessState =
+        &create->SecurityContext.AccessState;
+    // Empty object name and type, followed by the file name.
+    accessState->UnicodeStringObjectNameOffset = sizeof(CREATE_CONTEXT);
+    accessState->UnicodeStringObjectTypeOffset =
+        sizeof(CREATE_CONTEXT) + sizeof(DOKAN_UNICODE_STRING_INTERMEDIATE);
+    accessState->OriginalDesiredAccess = FILE_GENERIC_READ | FILE_GENERIC_WRITE;
+    accessState->RemainingDesiredAccess = accessState->OriginalDesiredAccess;
+    create->SecurityContext.DesiredAccess = accessState->OriginalDesiredAccess;
+    create->FileAttributes = FILE_ATTRIBUTE_NORMAL;
+    create->CreateOptions = workload->DirectoryQueryBufferLength
+                                ? (FILE_OPEN << 24) | FILE_DIRECTORY_FILE |
+                                      FILE_SYNCHRONOUS_IO_NONALERT
+                                : (FILE_OPEN_IF << 24) |
+                                      FILE_NON_DIRECTORY_FILE |
+                                      FILE_SYNCHRONOUS_IO_NONALERT;
+    create->ShareAccess = FILE_SHARE_READ | FILE_SHARE_WRITE;
+    create->FileNameLength = File->FileNameLength;
+    create->FileNameOffset =
+        sizeof(CREATE_CONTEXT) + 2 * sizeof(DOKAN_UNICODE_STRING_INTERMEDIATE);
+    fileName = (PWCHAR)((PCHAR)create + create->FileNameOffset);
+    break;
+  }
+  case IRP_MJ_READ:
+    EventContext->Operation.Read.ByteOffset.QuadPart = byteOffset;
+    EventContext->Operation.Read.BufferLength = workload->IoSize;
+    EventContext->Operation.Read.FileNameLength = fileNameLength;
+    fileName = EventContext->Operation.Read.FileName;
+    break;
+  case IRP_MJ_WRITE:
+    EventContext->Operation.Write.ByteOffset.QuadPart = byteOffset;
+    EventContext->Operation.Write.BufferLength = workload->IoSize;
+    EventContext->Operation.Write.BufferOffset =
+        GetWriteBufferOffset(Loopback, File);
+    EventContext->Operation.Write.RequestLength = RequestLength;
+    EventContext->Operation.Write.FileNameLength = fileNameLength;
+    fileName = EventContext->Operation.Write.FileName;
+    break;
+  case IRP_MJ_QUERY_INFORMATION:
+    EventContext->Operation.File.FileInformationClass = FileBasicInformation;
+    EventContext->Operation.File.BufferLength = sizeof(FILE_BASIC_INFORMATION);
+    EventContext->Operation.File.FileNameLength = fileNameLength;
+    fileName = EventContext->Operation.File.FileName;
+    break;
+  case IRP_MJ_DIRECTORY_CONTROL:
+    if (!File->DirectoryIndex) {
+      EventContext->Flags = SL_RESTART_SCAN;
+    }
+    EventContext->Operation.Directory.FileInformationClass =
+        FileBothDirectoryInformation;
+    EventContext->Operation.Directory.FileIndex = File->DirectoryIndex;
+    EventContext->Operation.Directory.BufferLength =
+        workload->DirectoryQueryBufferLength;
+    EventContext->Operation.Directory.DirectoryNameLength = fileNameLength;
+    if (Loopback->SearchPatternLength) {
+      EventContext->Operation.Directory.SearchPatternLength =
+          Loopback->SearchPatternLength;
+      EventContext->Operation.Directory.SearchPatternOffset = fileNameLength;
+      RtlCopyMemory((PCHAR)EventContext->Operation.Directory.SearchPatternBase +
+                        fileNameLength,
+                    workload->DirectorySearchPattern,
+                    Loopback->SearchPatternLength);
+    }
+    fileName = EventContext->Operation.Directory.DirectoryName;
+    break;
+  case IRP_MJ_CLEANUP:
+    EventContext->Operation.Cleanup.FileNameLength = File->FileNameLength;
+    fileName = EventContext->Operation.Cleanup.FileName;
+    break;
+  default:
+    EventContext->Operation.Close.FileNameLength = File->FileNameLength;
+    fileName = EventContext->Operation.Close.FileName;
+    break;
+  }
+  // The terminating null was zeroed with the rest.
+  RtlCopyMemory(fileName, File->FileName, fileNameLength);
+}
+
+// Fills the data of the writes of the events with a pattern, outside of the
+// lock as the driver copies them before queuing the events.
+static VOID FillWriteData(PEVENT_CONTEXT EventContext, ULONG Length) {
+  while (Length) {
+    if (EventContext->MajorFunction == IRP_MJ_WRITE &&
+        !EventContext->Operation.Write.RequestLength) {
+      FillMemory((PCHAR)EventContext +
+                     EventContext->Operation.Write.BufferOffset,
+                 EventContext->Operation.Write.BufferLength,
+                 (BYTE)EventContext->SerialNumber);
+    }
+    Length -= EventContext->Length;
+    EventContext = (PEVENT_CONTEXT)((PCHAR)EventContext + EventContext->Length);
+  }
+}
+
+// Returns the file waiting for the reply of the event, or NULL.
+static PDOKAN_LOOPBACK_FILE FindWaitingFile(PDOKAN_LOOPBACK Loopback,
+                                            ULONG SerialNumber) {
+  PDOKAN_LOOPBACK_FILE file;
+  if (!SerialNumber || !Loopback->Workload.Concurrency) {
+    return NULL;
+  }
+  file = &Loopback->Files[(SerialNumber - 1) % Loopback->Workload.Concurrency];
+  return file->SerialNumber == SerialNumber ? file : NULL;
+}
+
+// Whether the reply is the one of the event of DokanLoopback_SendEvent.
+static BOOL IsSentEventReply(PDOKAN_LOOPBACK Loopback,
+                             PEVENT_INFORMATION EventInfo) {
+  return Loopback->SentEvent && Loopback->SentEventPulled &&
+         !Loopback->SentEventDone &&
+         EventInfo->SerialNumber == Loopback->SentEvent->SerialNumber;
+}
+
+// Hands the reply, NULL for a close, to DokanLoopback_SendEvent.
+static VOID CompleteSentEvent(PDOKAN_LOOPBACK Loopback,
+                              PEVENT_INFORMATION EventInfo, ULONG Length) {
+  if (EventInfo) {
+    RtlCopyMemory(Loopback->SentReply, EventInfo,
+                  min(Length, Loopback->SentReplyLength));
+  }
+  Loopback->SentEventDone = TRUE;
+  WakeAllConditionVariable(&Loopback->SentCondition);
+}
+
+static BOOL IsValidReply(PDOKAN_LOOPBACK Loopback, PDOKAN_LOOPBACK_FILE File,
+                         PEVENT_INFORMATION EventInfo) {
+  switch (File->MajorFunction) {
+  case IRP_MJ_CREATE:
+    return EventInfo->Status == STATUS_SUCCESS && EventInfo->Context;
+  case IRP_MJ_READ:
+    return (EventInfo->Status == STATUS_SUCCESS &&
+            EventInfo->BufferLength <= Loopback->Workload.IoSize) ||
+           EventInfo->Status == STATUS_END_OF_FILE;
+  case IRP_MJ_WRITE:
+    return EventInfo->Status == STATUS_SUCCESS &&
+           EventInfo->BufferLength == Loopback->Workload.IoSize;
+  case IRP_MJ_DIRECTORY_CONTROL:
+    // An empty listing ends with STATUS_NO_SUCH_FILE.
+    if (EventInfo->Status == STATUS_SUCCESS) {
+      return EventInfo->BufferLength &&
+             EventInfo->BufferLength <=
+                 Loopback->Workload.DirectoryQueryBufferLength &&
+             EventInfo->Operation.Directory.Index > File->DirectoryIndex;
+    }
+    return EventInfo->Status == STATUS_NO_MORE_FILES ||
+           (EventInfo->Status == STATUS_NO_SUCH_FILE && !File->DirectoryIndex);
+  default:
+    return EventInfo->Status == STATUS_SUCCESS;
+  }
+}
+
+// Returns the number of entries of a successful directory query reply.
+static ULONG CountDirectoryEntries(PEVENT_INFORMATION EventInfo) {
+  ULONG count = 1;
+  ULONG offset = 0;
+  ULONG nextEntryOffset;
+  while ((nextEntryOffset = ((PFILE_BOTH_DIR_INFORMATION)(EventInfo->Buffer +
+                                                           offset))
+                                ->NextEntryOffset) != 0 &&
+         nextEntryOffset < EventInfo->BufferLength - offset) {
+    offset += nextEntryOffset;
+    ++count;
+  }
+  return count;
+}
+
+// Checks the replies and makes their files ready for the next event. Returns
+// the PullEventTimeoutMs of the first reply.
+static ULONG ProcessReplies(PDOKAN_LOOPBACK Loopback, PCHAR InputBuffer,
+                            ULONG InputLength) {
+  ULONG timeoutMs = 0;
+  ULONG offset = 0;
+  PEVENT_INFORMATION timeoutOnlyInfo = (PEVENT_INFORMATION)InputBuffer;
+  if (InputLength == sizeof(EVENT_INFORMATION) &&
+      !timeoutOnlyInfo->SerialNumber && timeoutOnlyInfo->ReplyLength) {
+    // Like the driver, a pull with a timeout and no reply.
+    ++Loopback->Result.TimeoutOnlyPulls;
+    return timeoutOnlyInfo->PullEventTimeoutMs;
+  }
+  if (InputLength >= sizeof(EVENT_INFORMATION)) {
+    ++Loopback->Result.ReplyIoctls;
+  }
+  while (InputLength - offset >= sizeof(EVENT_INFORMATION)) {
+    PEVENT_INFORMATION eventInfo = (PEVENT_INFORMATION)(InputBuffer + offset);
+    PDOKAN_LOOPBACK_FILE file =
+        FindWaitingFile(Loopback, eventInfo->SerialNumber);
+    ULONG eventInfoSize = eventInfo->ReplyLength;
+    BOOL valid;
+    if (IsSentEventReply(Loopback, eventInfo)) {
+      if (!eventInfoSize) {
+        eventInfoSize =
+            GetEventInfoSize(Loopback->SentEvent->MajorFunction, eventInfo);
+      }
+      if (eventInfoSize > InputLength - offset) {
+        ++Loopback->Result.InvalidReplies;
+        break;
+      }
+      if (!offset) {
+        timeoutMs = eventInfo->PullEventTimeoutMs;
+      }
+      ++Loopback->Result.Replies;
+      CompleteSentEvent(Loopback, eventInfo, eventInfoSize);
+      offset += eventInfoSize;
+      continue;
+    }
+    if (eventInfoSize > InputLength - offset ||
+        (file && eventInfoSize &&
+         eventInfoSize < GetEventInfoSize(file->MajorFunction, eventInfo))) {
+      ++Loopback->Result.InvalidReplies;
+      break;
+    }
+    if (!file) {
+      // Like the driver, the reply is skipped with its length. Without it the
+      // size depends on the event and the rest cannot be read.
+      ++Loopback->Result.InvalidReplies;
+      if (!eventInfoSize) {
+        break;
+      }
+      offset += eventInfoSize;
+      continue;
+    }
+    if (!eventInfoSize) {
+      eventInfoSize = GetEventInfoSize(file->MajorFunction, eventInfo);
+      if (eventInfoSize > InputLength - offset) {
+        ++Loopback->Result.InvalidReplies;
+        break;
+      }
+    }
+    if (!offset) {
+      timeoutMs = eventInfo->PullEventTimeoutMs;
+    }
+    ++Loopback->Result.Replies;
+    valid = IsValidReply(Loopback, file, eventInfo);
+    if (!valid) {
+      ++Loopback->Result.InvalidReplies;
+    }
+    if (file->MajorFunction == IRP_MJ_CREATE && valid) {
+      file->Context = eventInfo->Context;
+    }
+    if (file->MajorFunction == IRP_MJ_DIRECTORY_CONTROL) {
+      // A failed query ends the listing.
+      if (valid && eventInfo->Status == STATUS_SUCCESS) {
+        Loopback->Result.DirectoryEntries += CountDirectoryEntries(eventInfo);
+        file->DirectoryIndex = eventInfo->Operation.Directory.Index;
+      } else {
+        file->DirectoryIndex = 0;
+      }
+    }
+    AdvanceFile(Loopback, (ULONG)(file - Loopback->Files),
+                valid || file->MajorFunction != IRP_MJ_CREATE);
+    offset += eventInfoSize;
+  }
+  return timeoutMs;
+}
+
+static BOOL HasSentEventToPull(PDOKAN_LOOPBACK Loopback) {
+  return Loopback->SentEvent && !Loopback->SentEventPulled;
+}
+
+// Writes the events of the ready files that fit in the buffer. Like the
+// driver, returns a single event unless batching is allowed. Returns their
+// length.
+static ULONG PullEvents(PDOKAN_LOOPBACK Loopback, PCHAR OutputBuffer,
+                        ULONG OutputLength, BOOL AllowBatching) {
+  ULONG maxEvents = AllowBatching ? Loopback->Workload.MaxBatchEvents : 1;
+  ULONG length = 0;
+  ULONG events = 0;
+  if (HasSentEventToPull(Loopback)) {
+    PEVENT_CONTEXT sentEvent = Loopback->SentEvent;
+    RtlCopyMemory(OutputBuffer, sentEvent, sentEvent->Length);
+    length = sentEvent->Length;
+    ++events;
+    Loopback->SentEventPulled = TRUE;
+    if (sentEvent->MajorFunction == IRP_MJ_CLOSE) {
+      CompleteSentEvent(Loopback, NULL, 0);
+    }
+  }
+  while (Loopback->ReadyCount && (!maxEvents || events < maxEvents)) {
+    ULONG index = Loopback->ReadyFiles[Loopback->ReadyHead];
+    PDOKAN_LOOPBACK_FILE file = &Loopback->Files[index];
+    ULONG eventLength = GetNextEventLength(Loopback, file);
+    ULONG requestLength = 0;
+    if (eventLength > OutputLength - length) {
+      if (length || file->MajorFunction != IRP_MJ_WRITE) {
+        break;
+      }
+      // Too large for any pull, the dispatch requests the whole write.
+      requestLength = eventLength;
+      eventLength =
+          GetLoopbackEventLength(GetWriteBufferOffset(Loopback, file));
+      assert(eventLength <= OutputLength);
+      if (eventLength > OutputLength) {
+        break;
+      }
+    }
+    PopReadyFile(Loopback);
+    file->SerialNumber =
+        file->Events++ * Loopback->Workload.Concurrency + index + 1;
+    file->RequestLength = requestLength;
+    BuildEvent(Loopback, file, (PEVENT_CONTEXT)(OutputBuffer + length),
+               eventLength, requestLength);
+    length += eventLength;
+    ++events;
+    if (file->MajorFunction == IRP_MJ_CLOSE) {
+      // There is no reply to a close.
+      AdvanceFile(Loopback, index, /*Success=*/TRUE);
+    }
+  }
+  if (events) {
+    Loopback->Result.Events += events;
+    ++Loopback->Result.Pulls;
+  }
+  return length;
+}
+
+static BOOL ProcessAndPull(PDOKAN_LOOPBACK Loopback, BOOL AllowBatching,
+                           PVOID InputBuffer, DWORD InputLength,
+                           PVOID OutputBuffer, DWORD OutputLength,
+                           LPDWORD BytesReturned) {
+  ULONG timeoutMs;
+  EnterCriticalSection(&Loopback->Lock);
+  timeoutMs = ProcessReplies(Loopback, (PCHAR)InputBuffer, InputLength);
+  if (!OutputLength) {
+    LeaveCriticalSection(&Loopback->Lock);
+    return TRUE;
+  }
+  // Like the driver, a pull without replies or with a timeout of 0 waits for
+  // events indefinitely.
+  while (!Loopback->ReadyCount && !HasSentEventToPull(Loopback) &&
+         !Loopback->Stopped) {
+    if (!SleepConditionVariableCS(&Loopback->ReadyCondition, &Loopback->Lock,
+                                  InputLength && timeoutMs ? timeoutMs
+                                                           : INFINITE)) {
+      break;
+    }
+  }
+  if (Loopback->Stopped) {
+    LeaveCriticalSection(&Loopback->Lock);
+    SetLastError(ERROR_OPERATION_ABORTED);
+    return FALSE;
+  }
+  *BytesReturned = PullEvents(Loopback, (PCHAR)OutputBuffer, OutputLength,
+                              AllowBatching);
+  LeaveCriticalSection(&Loopback->Lock);
+  // The events sent by DokanLoopback_SendEvent hold their data already.
+  if (Loopback->Workload.Concurrency) {
+    FillWriteData((PEVENT_CONTEXT)OutputBuffer, *BytesReturned);
+  }
+  return TRUE;
+}
+
+static BOOL PullWrite(PDOKAN_LOOPBACK Loopback, PVOID InputBuffer,
+                      DWORD InputLength, PVOID OutputBuffer, DWORD OutputLength,
+                      LPDWORD BytesReturned) {
+  PDOKAN_LOOPBACK_FILE file = NULL;
+  ULONG length = 0;
+  EnterCriticalSection(&Loopback->Lock);
+  if (InputLength >= sizeof(EVENT_INFORMATION)) {
+    file = FindWaitingFile(Loopback,
+                           ((PEVENT_INFORMATION)InputBuffer)->SerialNumber);
+  }
+  if (file && file->RequestLength && file->RequestLength <= OutputLength) {
+    length = file->RequestLength;
+    BuildEvent(Loopback, file, (PEVENT_CONTEXT)OutputBuffer, length,
+               /*RequestLength=*/0);
+  } else {
+    ++Loopback->Result.InvalidReplies;
+  }
+  LeaveCriticalSection(&Loopback->Lock);
+  if (!length) {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return FALSE;
+  }
+  FillWriteData((PEVENT_CONTEXT)OutputBuffer, length);
+  *BytesReturned = length;
+  return TRUE;
+}
+
+static BOOL LoopbackControl(PDOKAN_INSTANCE DokanInstance, DWORD IoControlCode,
+                            PVOID InputBuffer, DWORD InputLength,
+                            PVOID OutputBuffer, DWORD OutputLength,
+                            LPDWORD BytesReturned) {
+  PDOKAN_LOOPBACK loopback = (PDOKAN_LOOPBACK)DokanInstance->TransportContext;
+  *BytesReturned = 0;
+  switch (IoControlCode) {
+  case FSCTL_EVENT_PROCESS_N_PULL:
+    return ProcessAndPull(loopback,
+                          DokanInstance->DokanOptions->Options &
+                              DOKAN_OPTION_ALLOW_IPC_BATCHING,
+                          InputBuffer, InputLength, OutputBuffer, OutputLength,
+                          BytesReturned);
+  case FSCTL_EVENT_WRITE:
+    return PullWrite(loopback, InputBuffer, InputLength, OutputBuffer,
+                     OutputLength, BytesReturned);
+  default:
+    // The events never time out.
+    return TRUE;
+  }
+}
+
+const DOKAN_TRANSPORT g_DokanLoopbackTransport = {LoopbackControl,
+                                                  /*Mounted=*/FALSE};
+
+DWORD DokanLoopback_Alloc(const DOKAN_LOOPBACK_WORKLOAD *Workload,
+                          BOOL OmitIoFileNames, PDOKAN_LOOPBACK *Loopback) {
+  PDOKAN_LOOPBACK loopback;
+  *Loopback = NULL;
+  if (Workload) {
+    ULONG64 weights = (ULONG64)Workload->ReadWeight + Workload->WriteWeight +
+                      Workload->QueryInformationWeight;
+    if (!Workload->Concurrency || !Workload->OpensPerFile ||
+        (Workload->OperationsPerOpen && !weights &&
+         !Workload->DirectoryQueryBufferLength) ||
+        ((Workload->ReadWeight || Workload->WriteWeight) &&
+         !Workload->IoSize) ||
+        Workload->IoSize > DOKAN_LOOPBACK_MAX_IO_SIZE ||
+        Workload->DirectoryQueryBufferLength > DOKAN_LOOPBACK_MAX_IO_SIZE ||
+        Workload->FileNameDepth > DOKAN_LOOPBACK_MAX_FILE_NAME_DEPTH) {
+      return ERROR_INVALID_PARAMETER;
+    }
+    // The serial numbers of all the events must be different.
+    if ((ULONG64)Workload->Concurrency * Workload->OpensPerFile *
+            ((ULONG64)Workload->OperationsPerOpen + 3) >
+        MAXULONG) {
+      return ERROR_INVALID_PARAMETER;
+    }
+  }
+
+  loopback = malloc(sizeof(DOKAN_LOOPBACK));
+  if (!loopback) {
+    return ERROR_OUTOFMEMORY;
+  }
+  ZeroMemory(loopback, sizeof(DOKAN_LOOPBACK));
+  loopback->OmitIoFileNames = OmitIoFileNames;
+  loopback->ProcessId = GetCurrentProcessId();
+  loopback->CompletedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (Workload) {
+    loopback->Workload = *Workload;
+    if (Workload->DirectorySearchPattern) {
+      loopback->SearchPatternLength =
+          (ULONG)wcslen(Workload->DirectorySearchPattern) * sizeof(WCHAR);
+    }
+    if (!loopback->Workload.FileBlocks) {
+      loopback->Workload.FileBlocks = DOKAN_LOOPBACK_BLOCKS;
+    }
+    loopback->Random = Workload->Seed ? Workload->Seed : 1;
+    loopback->Files =
+        calloc(Workload->Concurrency, sizeof(DOKAN_LOOPBACK_FILE));
+    loopback->ReadyFiles = calloc(Workload->Concurrency, sizeof(ULONG));
+  }
+  if ((Workload && (!loopback->Files || !loopback->ReadyFiles)) ||
+      !loopback->CompletedEvent) {
+    free(loopback->Files);
+    free(loopback->ReadyFiles);
+    if (loopback->CompletedEvent) {
+      CloseHandle(loopback->CompletedEvent);
+    }
+    free(loopback);
+    return ERROR_OUTOFMEMORY;
+  }
+  InitializeCriticalSection(&loopback->Lock);
+  InitializeConditionVariable(&loopback->ReadyCondition);
+  InitializeConditionVariable(&loopback->SentCondition);
+  if (!Workload) {
+    *Loopback = loopback;
+    return ERROR_SUCCESS;
+  }
+  for (ULONG i = 0; i < Workload->Concurrency; ++i) {
+    PDOKAN_LOOPBACK_FILE file = &loopback->Files[i];
+    ULONG nameLength = 0;
+    for (ULONG depth = 0; depth < Workload->FileNameDepth; ++depth) {
+      nameLength += swprintf_s(file->FileName + nameLength,
+                               DOKAN_LOOPBACK_FILE_NAME_MAX - nameLength,
+                               L"\\DokanLoopbackDirectory%lu", depth);
+    }
+    if (Workload->DirectoryQueryBufferLength) {
+      // The directory of the files.
+      if (!nameLength) {
+        nameLength = swprintf_s(file->FileName, DOKAN_LOOPBACK_FILE_NAME_MAX,
+                                L"\\");
+      }
+    } else {
+      nameLength += swprintf_s(file->FileName + nameLength,
+                               DOKAN_LOOPBACK_FILE_NAME_MAX - nameLength,
+                               L"\\DokanLoopback%lu", i);
+    }
+    file->FileNameLength = nameLength * sizeof(WCHAR);
+    file->Opens = 1;
+    file->State = DOKAN_LOOPBACK_FILE_CREATE;
+    file->MajorFunction = IRP_MJ_CREATE;
+    loopback->ReadyFiles[i] = i;
+  }
+  loopback->ReadyCount = Workload->Concurrency;
+  *Loopback = loopback;
+  return ERROR_SUCCESS;
+}
+
+VOID DokanLoopback_Free(PDOKAN_LOOPBACK Loopback) {
+  if (!Loopback) {
+    return;
+  }
+  DeleteCriticalSection(&Loopback->Lock);
+  CloseHandle(Loopback->CompletedEvent);
+  free(Loopback->Files);
+  free(Loopback->ReadyFiles);
+  free(Loopback);
+}
+
+VOID DokanLoopback_WaitCompleted(PDOKAN_LOOPBACK Loopback) {
+  WaitForSingleObject(Loopback->CompletedEvent, INFINITE);
+}
+
+VOID DokanLoopback_Stop(PDOKAN_LOOPBACK Loopback) {
+  EnterCriticalSection(&Loopback->Lock);
+  Loopback->Stopped = TRUE;
+  LeaveCriticalSection(&Loopback->Lock);
+  WakeAllConditionVariable(&Loopback->ReadyCondition);
+  WakeAllConditionVariable(&Loopback->SentCondition);
+}
+
+VOID DokanLoopback_GetResult(PDOKAN_LOOPBACK Loopback,
+                             PDOKAN_LOOPBACK_RESULT Result) {
+  EnterCriticalSection(&Loopback->Lock);
+  Result->Events = Loopback->Result.Events;
+  Result->InvalidReplies = Loopback->Result.InvalidReplies;
+  Result->Pulls = Loopback->Result.Pulls;
+  Result->Replies = Loopback->Result.Replies;
+  Result->ReplyIoctls = Loopback->Result.ReplyIoctls;
+  Result->TimeoutOnlyPulls = Loopback->Result.TimeoutOnlyPulls;
+  Result->DirectoryEntries = Loopback->Result.DirectoryEntries;
+  LeaveCriticalSection(&Loopback->Lock);
+}
+
+BOOL DokanLoopback_SendEvent(PDOKAN_LOOPBACK Loopback,
+                             PEVENT_CONTEXT EventContext,
+                             PEVENT_INFORMATION Reply, ULONG ReplyLength) {
+  BOOL done;
+  assert(!Loopback->Workload.Concurrency);
+  assert(EventContext->Length <= EVENT_CONTEXT_MAX_SIZE);
+  EnterCriticalSection(&Loopback->Lock);
+  while (Loopback->SentEvent && !Loopback->Stopped) {
+    SleepConditionVariableCS(&Loopback->SentCondition, &Loopback->Lock,
+                             INFINITE);
+  }
+  if (Loopback->Stopped) {
+    LeaveCriticalSection(&Loopback->Lock);
+    return FALSE;
+  }
+  EventContext->SerialNumber = ++Loopback->SentEvents;
+  EventContext->ProcessId = Loopback->ProcessId;
+  Loopback->SentEvent = EventContext;
+  Loopback->SentEventPulled = FALSE;
+  Loopback->SentEventDone = FALSE;
+  Loopback->SentReply = Reply;
+  Loopback->SentReplyLength = ReplyLength;
+  WakeConditionVariable(&Loopback->ReadyCondition);
+  while (!Loopback->SentEventDone && !Loopback->Stopped) {
+    SleepConditionVariableCS(&Loopback->SentCondition, &Loopback->Lock,
+                             INFINITE);
+  }
+  done = Loopback->SentEventDone;
+  Loopback->SentEvent = NULL;
+  // Lets the next sender in.
+  WakeAllConditionVariable(&Loopback->SentCondition);
+  LeaveCriticalSection(&Loopback->Lock);
+  return done;
+}
@@ -0,0 +1,152 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_LOOPBACK_H_
+#define DOKAN_LOOPBACK_H_
+
+#include "dokani.h"
+#include "dokan_transport.h"
+
+// States of a loopback file, named after the next event it sends.
+#define DOKAN_LOOPBACK_FILE_CREATE 0
+#define DOKAN_LOOPBACK_FILE_IO 1
+#define DOKAN_LOOPBACK_FILE_CLEANUP 2
+#define DOKAN_LOOPBACK_FILE_CLOSE 3
+#define DOKAN_LOOPBACK_FILE_DONE 4
+
+// Default DOKAN_LOOPBACK_WORKLOAD.FileBlocks.
+#define DOKAN_LOOPBACK_BLOCKS 16
+
+// Fits the names of DOKAN_LOOPBACK_MAX_FILE_NAME_DEPTH directories.
+#define DOKAN_LOOPBACK_FILE_NAME_MAX MAX_PATH
+
+typedef struct _DOKAN_LOOPBACK_FILE {
+  ULONG State;
+  // Opens started, including the current one.
+  ULONG Opens;
+  // Reads, writes and queries, or listings, done by the current open.
+  ULONG Operations;
+  // FileIndex of the next directory query of the current listing, 0 to start
+  // a listing.
+  ULONG DirectoryIndex;
+  // Events sent, used for the serial numbers.
+  ULONG Events;
+  // Context replied by the create of the current open.
+  ULONG64 Context;
+  // Serial number of the event waiting for its reply, 0 if none.
+  ULONG SerialNumber;
+  // Major function of that event.
+  UCHAR MajorFunction;
+  // Length of the write of the event, sent by FSCTL_EVENT_WRITE when it does
+  // not fit in the pull buffers. 0 otherwise.
+  ULONG RequestLength;
+  ULONG FileNameLength;
+  WCHAR FileName[DOKAN_LOOPBACK_FILE_NAME_MAX];
+} DOKAN_LOOPBACK_FILE, *PDOKAN_LOOPBACK_FILE;
+
+// Generates the events of a DOKAN_LOOPBACK_WORKLOAD and checks their replies,
+// see DokanRunLoopbackBenchmark. Without a workload, it only sends the events
+// of DokanLoopback_SendEvent.
+typedef struct _DOKAN_LOOPBACK {
+  // Protects the fields below.
+  CRITICAL_SECTION Lock;
+  // Woken when a file becomes ready or the loopback stops.
+  CONDITION_VARIABLE ReadyCondition;
+  DOKAN_LOOPBACK_WORKLOAD Workload;
+  // Workload.Concurrency files. The file of a serial number is
+  // SerialNumber % Concurrency.
+  PDOKAN_LOOPBACK_FILE Files;
+  // Ring of the indexes of the files whose next event can be pulled.
+  PULONG ReadyFiles;
+  ULONG ReadyHead;
+  ULONG ReadyCount;
+  // Files in the DOKAN_LOOPBACK_FILE_DONE state.
+  ULONG DoneFiles;
+  // State of the xorshift generator picking the operations.
+  ULONG Random;
+  // Sent as the requestor of the events.
+  ULONG ProcessId;
+  // Whether the reads, writes and queries omit the file name, see
+  // DOKAN_OPTION_OMIT_IO_FILE_NAMES.
+  BOOL OmitIoFileNames;
+  BOOL Stopped;
+  // Set once all the files are done.
+  HANDLE CompletedEvent;
+  // Length in bytes of Workload.DirectorySearchPattern.
+  ULONG SearchPatternLength;
+  // Events, InvalidReplies and Pulls.
+  DOKAN_LOOPBACK_RESULT Result;
+  // Event of DokanLoopback_SendEvent in progress, NULL if none.
+  PEVENT_CONTEXT SentEvent;
+  BOOL SentEventPulled;
+  // Set once the reply of SentEvent was copied to SentReply, or once a close
+  // was pulled.
+  BOOL SentEventDone;
+  PEVENT_INFORMATION SentReply;
+  ULONG SentReplyLength;
+  // Events sent, used for their serial numbers.
+  ULONG SentEvents;
+  // Woken when SentEvent is done or can be used again.
+  CONDITION_VARIABLE SentCondition;
+} DOKAN_LOOPBACK, *PDOKAN_LOOPBACK;
+
+// Transport of a loopback benchmark, its context is the DOKAN_LOOPBACK.
+extern const DOKAN_TRANSPORT g_DokanLoopbackTransport;
+
+// Validates the workload and allocates its files. Workload can be NULL for a
+// loopback of DokanLoopback_SendEvent only. Returns a Win32 error.
+DWORD DokanLoopback_Alloc(const DOKAN_LOOPBACK_WORKLOAD *Workload,
+                          BOOL OmitIoFileNames, PDOKAN_LOOPBACK *Loopback);
+
+VOID DokanLoopback_Free(PDOKAN_LOOPBACK Loopback);
+
+// Waits until all the events were pulled and the ones expecting a reply got
+// it.
+VOID DokanLoopback_WaitCompleted(PDOKAN_LOOPBACK Loopback);
+
+// Fails the pulls in progress and the next ones with ERROR_OPERATION_ABORTED.
+VOID DokanLoopback_Stop(PDOKAN_LOOPBACK Loopback);
+
+// Copies Events, InvalidReplies and Pulls to Result.
+VOID DokanLoopback_GetResult(PDOKAN_LOOPBACK Loopback,
+                             PDOKAN_LOOPBACK_RESULT Result);
+
+// Sends an event of at most EVENT_CONTEXT_MAX_SIZE bytes, whose serial number
+// is set here, to the pull threads of a loopback without workload and waits
+// for its reply, copied to Reply up to ReplyLength bytes. A close returns
+// once pulled as it has no reply. Events sent from several threads go one
+// after the other. Returns FALSE if the loopback stopped first.
+BOOL DokanLoopback_SendEvent(PDOKAN_LOOPBACK Loopback,
+                             PEVENT_CONTEXT EventContext,
+                             PEVENT_INFORMATION Reply, ULONG ReplyLength);
+
+// Runs the dispatch of a file system with the options and callbacks of a
+// mount, on a loopback without workload, for the host tests that send events
+// one by one. Returns NULL and sets the last error on failure. Implemented
+// with the other instance functions in dokan.c.
+PDOKAN_INSTANCE DokanStartLoopbackInstance(PDOKAN_OPTIONS DokanOptions,
+                                           PDOKAN_OPERATIONS DokanOperations);
+
+// Stops the pull threads of an instance of DokanStartLoopbackInstance, waits
+// for its events and deletes it.
+VOID DokanStopLoopbackInstance(PDOKAN_INSTANCE DokanInstance);
+
+#endif
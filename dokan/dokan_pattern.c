@@ -0,0 +1,334 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+#include "dokan_pattern.h"
+
+#include <assert.h>
+
+static BOOL IsWildcard(WCHAR C) {
+  return C == L'*' || C == L'?' || C == DOS_STAR || C == DOS_QM ||
+         C == DOS_DOT;
+}
+
+static WCHAR FoldChar(PDOKAN_PATTERN Pattern, WCHAR C) {
+  if (!Pattern->IgnoreCase) {
+    return C;
+  }
+  // Most names are ASCII, whose upper case needs no table lookup.
+  if (C < 0x80) {
+    return C >= L'a' && C <= L'z' ? C - (L'a' - L'A') : C;
+  }
+  return towupper(C);
+}
+
+// Compares Count characters of Name with the already folded Literal.
+static BOOL EqualsLiteral(PDOKAN_PATTERN Pattern, LPCWSTR Name,
+                          LPCWSTR Literal, size_t Count) {
+  for (size_t i = 0; i < Count; ++i) {
+    if (FoldChar(Pattern, Name[i]) != Literal[i]) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+BOOL DokanPattern_Compile(PDOKAN_PATTERN Pattern, LPCWSTR Expression,
+                          BOOL IgnoreCase) {
+  size_t wildcardCount = 0;
+  size_t length = wcslen(Expression);
+
+  ZeroMemory(Pattern, sizeof(DOKAN_PATTERN));
+  Pattern->IgnoreCase = IgnoreCase;
+  Pattern->ExpressionLength = length;
+  Pattern->Expression = (PWCHAR)malloc((length + 1) * sizeof(WCHAR));
+  if (!Pattern->Expression) {
+    DbgPrint("Dokan Error: Failed to allocate search pattern.\n");
+    return FALSE;
+  }
+  // Fold the case of the expression once instead of for every name
+  for (size_t i = 0; i < length; ++i) {
+    Pattern->Expression[i] = FoldChar(Pattern, Expression[i]);
+    if (IsWildcard(Expression[i])) {
+      ++wildcardCount;
+    }
+  }
+  Pattern->Expression[length] = L'\0';
+
+  if (length == 1 && Pattern->Expression[0] == L'*') {
+    Pattern->Kind = DokanPatternMatchAll;
+  } else if (wildcardCount == 0) {
+    Pattern->Kind = DokanPatternLiteral;
+    Pattern->Literal = Pattern->Expression;
+    Pattern->LiteralLength = length;
+  } else if (wildcardCount == 1 && Pattern->Expression[length - 1] == L'*') {
+    Pattern->Kind = DokanPatternPrefix;
+    Pattern->Literal = Pattern->Expression;
+    Pattern->LiteralLength = length - 1;
+  } else if (wildcardCount == 1 && Pattern->Expression[0] == L'*') {
+    Pattern->Kind = DokanPatternSuffix;
+    Pattern->Literal = Pattern->Expression + 1;
+    Pattern->LiteralLength = length - 1;
+  } else if (wildcardCount == 1 && Pattern->Expression[0] == DOS_STAR &&
+             wcschr(Pattern->Expression + 1, L'.') != NULL) {
+    // DOS_STAR stops at the last dot of the name. When the literal holds a
+    // dot, the last dot of any name ending with it lies within the literal,
+    // so "<.ext" is a plain suffix match.
+    Pattern->Kind = DokanPatternSuffix;
+    Pattern->Literal = Pattern->Expression + 1;
+    Pattern->LiteralLength = length - 1;
+  } else if (!wcschr(Expression, DOS_STAR) && !wcschr(Expression, DOS_QM) &&
+             !wcschr(Expression, DOS_DOT)) {
+    Pattern->Kind = DokanPatternWildcards;
+  } else {
+    Pattern->Kind = DokanPatternGeneric;
+    while (!IsWildcard(Expression[Pattern->PrefixLength])) {
+      ++Pattern->PrefixLength;
+    }
+    while (!IsWildcard(Expression[length - Pattern->SuffixLength - 1])) {
+      ++Pattern->SuffixLength;
+    }
+    Pattern->UsesLastDot = wcschr(Expression, DOS_STAR) != NULL ||
+                           wcschr(Expression, DOS_QM) != NULL;
+    Pattern->States = (PBYTE)malloc(2 * (length + 1));
+    if (!Pattern->States) {
+      DbgPrint("Dokan Error: Failed to allocate search pattern states.\n");
+      DokanPattern_Free(Pattern);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// Matches an expression of literals, '*' and '?'. A mismatch only retries the
+// last '*' one character further: what an earlier '*' could consume instead
+// cannot help the part after the last one match.
+static BOOL MatchWildcards(PDOKAN_PATTERN Pattern, LPCWSTR Name) {
+  PWCHAR expression = Pattern->Expression;
+  size_t ei = 0;
+  size_t ni = 0;
+  size_t starEi = 0;
+  size_t starNi = 0;
+  BOOL star = FALSE;
+
+  while (Name[ni] != L'\0') {
+    if (expression[ei] == L'*') {
+      star = TRUE;
+      starEi = ++ei;
+      starNi = ni;
+    } else if (expression[ei] != L'\0' &&
+               (expression[ei] == L'?' ||
+                expression[ei] == FoldChar(Pattern, Name[ni]))) {
+      ++ei;
+      ++ni;
+    } else if (star) {
+      ei = starEi;
+      ni = ++starNi;
+    } else {
+      return FALSE;
+    }
+  }
+  while (expression[ei] == L'*') {
+    ++ei;
+  }
+  return expression[ei] == L'\0';
+}
+
+// Simulates the expression as an NFA whose states are the positions in the
+// expression. Every name character is visited once, with no recursion or
+// backtracking, and only the range of the active states is walked.
+static BOOL MatchGeneric(PDOKAN_PATTERN Pattern, LPCWSTR Name) {
+  size_t stateCount = Pattern->ExpressionLength + 1;
+  PWCHAR expression = Pattern->Expression;
+  PBYTE current = Pattern->States;
+  PBYTE next = Pattern->States + stateCount;
+  size_t nameLength = 0;
+  BOOL hasDot = FALSE;
+  size_t lastDot = 0;
+  size_t ni = Pattern->PrefixLength;
+  size_t first = Pattern->PrefixLength;
+  size_t last = first;
+
+  // Each literal character of the prefix and the suffix consumes exactly one
+  // character of the name, so most names are rejected before the NFA runs.
+  for (size_t i = 0; i < Pattern->PrefixLength; ++i) {
+    if (Name[i] == L'\0' || FoldChar(Pattern, Name[i]) != expression[i]) {
+      return FALSE;
+    }
+  }
+  // The whole name is only scanned when the prefix did not filter it or when
+  // the expression needs its last dot.
+  if (Pattern->UsesLastDot || !Pattern->PrefixLength) {
+    for (; Name[nameLength]; ++nameLength) {
+      if (Name[nameLength] == L'.') {
+        hasDot = TRUE;
+        lastDot = nameLength;
+      }
+    }
+    if (nameLength < Pattern->PrefixLength + Pattern->SuffixLength ||
+        !EqualsLiteral(Pattern, Name + nameLength - Pattern->SuffixLength,
+                       expression + stateCount - 1 - Pattern->SuffixLength,
+                       Pattern->SuffixLength)) {
+      return FALSE;
+    }
+  }
+
+  ZeroMemory(Pattern->States, 2 * stateCount);
+  current[first] = TRUE;
+  for (;;) {
+    size_t nextFirst = stateCount;
+    size_t nextLast = 0;
+    WCHAR c;
+
+    // Follow the transitions that do not consume the current character.
+    // They only move forward so a single pass is enough.
+    for (size_t ei = first; ei <= last && ei < stateCount - 1; ++ei) {
+      BOOL skip = FALSE;
+      if (!current[ei]) {
+        continue;
+      }
+      switch (expression[ei]) {
+      case L'*':
+      case DOS_STAR:
+        skip = TRUE;
+        break;
+      case DOS_QM:
+        // Matches nothing at the end of the name or before its last dot
+        skip = Name[ni] == L'\0' || (Name[ni] == L'.' && ni == lastDot);
+        break;
+      case DOS_DOT:
+        // Matches nothing at the end of the name or when there is no dot
+        skip = Name[ni] == L'\0' || Name[ni] != L'.';
+        break;
+      default:
+        break;
+      }
+      if (skip) {
+        current[ei + 1] = TRUE;
+        last = max(last, ei + 1);
+      }
+    }
+
+    if (Name[ni] == L'\0') {
+      break;
+    }
+
+    c = FoldChar(Pattern, Name[ni]);
+    for (size_t ei = first; ei <= last && ei < stateCount - 1; ++ei) {
+      size_t target = stateCount;
+      if (!current[ei]) {
+        continue;
+      }
+      switch (expression[ei]) {
+      case L'*':
+        target = ei;
+        break;
+      case DOS_STAR:
+        // Consumes characters up to the last dot of the name
+        if (hasDot && lastDot >= ni ? ni < lastDot : ni > 0) {
+          target = ei;
+        }
+        break;
+      case DOS_QM:
+        if (c != L'.' || (hasDot && ni < lastDot)) {
+          target = ei + 1;
+        }
+        break;
+      case DOS_DOT:
+        if (c == L'.') {
+          target = ei + 1;
+        }
+        break;
+      case L'?':
+        target = ei + 1;
+        break;
+      default:
+        if (expression[ei] == c) {
+          target = ei + 1;
+        }
+        break;
+      }
+      if (target < stateCount) {
+        next[target] = TRUE;
+        nextFirst = min(nextFirst, target);
+        nextLast = max(nextLast, target);
+      }
+    }
+    if (nextFirst == stateCount) {
+      return FALSE;
+    }
+
+    // The states of the next character start cleared.
+    ZeroMemory(current + first, last - first + 1);
+    PBYTE swap = current;
+    current = next;
+    next = swap;
+    first = nextFirst;
+    last = nextLast;
+    ++ni;
+  }
+
+  return current[stateCount - 1];
+}
+
+BOOL DokanPattern_Match(PDOKAN_PATTERN Pattern, LPCWSTR Name) {
+  size_t nameLength;
+
+  switch (Pattern->Kind) {
+  case DokanPatternMatchAll:
+    return TRUE;
+  case DokanPatternLiteral:
+    nameLength = wcslen(Name);
+    return nameLength == Pattern->LiteralLength &&
+           EqualsLiteral(Pattern, Name, Pattern->Literal, nameLength);
+  case DokanPatternPrefix:
+    for (size_t i = 0; i < Pattern->LiteralLength; ++i) {
+      if (Name[i] == L'\0' ||
+          FoldChar(Pattern, Name[i]) != Pattern->Literal[i]) {
+        return FALSE;
+      }
+    }
+    return TRUE;
+  case DokanPatternSuffix:
+    nameLength = wcslen(Name);
+    return nameLength >= Pattern->LiteralLength &&
+           EqualsLiteral(Pattern, Name + nameLength - Pattern->LiteralLength,
+                         Pattern->Literal, Pattern->LiteralLength);
+  case DokanPatternWildcards:
+    return MatchWildcards(Pattern, Name);
+  case DokanPatternGeneric:
+    return MatchGeneric(Pattern, Name);
+  default:
+    assert(FALSE);
+    return FALSE;
+  }
+}
+
+VOID DokanPattern_Free(PDOKAN_PATTERN Pattern) {
+  if (Pattern->Expression) {
+    free(Pattern->Expression);
+    Pattern->Expression = NULL;
+  }
+  if (Pattern->States) {
+    free(Pattern->States);
+    Pattern->States = NULL;
+  }
+  Pattern->Literal = NULL;
+}
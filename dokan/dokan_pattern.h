@@ -0,0 +1,79 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_PATTERN_H_
+#define DOKAN_PATTERN_H_
+
+#define DOS_STAR (L'<')
+#define DOS_QM (L'>')
+#define DOS_DOT (L'"')
+
+// How a compiled expression is evaluated against a name.
+typedef enum _DOKAN_PATTERN_KIND {
+  // "*": every name matches.
+  DokanPatternMatchAll,
+  // No wildcard: the name must be equal to the literal.
+  DokanPatternLiteral,
+  // "literal*": the name must start with the literal.
+  DokanPatternPrefix,
+  // "*literal" or "<literal" with a dot in the literal: the name must end
+  // with the literal.
+  DokanPatternSuffix,
+  // Only '*' and '?' wildcards: matched greedily, backtracking to the last
+  // '*' only.
+  DokanPatternWildcards,
+  // Anything else, evaluated by simulating the expression as an NFA.
+  DokanPatternGeneric,
+} DOKAN_PATTERN_KIND;
+
+// A search expression compiled once so that it can be matched against many
+// names. Same wildcard semantics as DokanIsNameInExpression.
+typedef struct _DOKAN_PATTERN {
+  DOKAN_PATTERN_KIND Kind;
+  BOOL IgnoreCase;
+  // Expression, upper cased when IgnoreCase is set.
+  PWCHAR Expression;
+  size_t ExpressionLength;
+  // Literal part used by the fast paths. Points into Expression.
+  PWCHAR Literal;
+  size_t LiteralLength;
+  // Lengths of the literals before the first and after the last wildcard of
+  // a generic expression, which names are checked against before the NFA.
+  size_t PrefixLength;
+  size_t SuffixLength;
+  // Whether the generic expression has a DOS_STAR or DOS_QM, which depend on
+  // the last dot of the name.
+  BOOL UsesLastDot;
+  // Scratch state sets used by the generic matcher.
+  PBYTE States;
+} DOKAN_PATTERN, *PDOKAN_PATTERN;
+
+// Compiles Expression into Pattern. Returns FALSE on allocation failure.
+BOOL DokanPattern_Compile(PDOKAN_PATTERN Pattern, LPCWSTR Expression,
+                          BOOL IgnoreCase);
+
+// Returns whether Name matches the compiled Pattern.
+// A compiled pattern must not be used by multiple threads at the same time.
+BOOL DokanPattern_Match(PDOKAN_PATTERN Pattern, LPCWSTR Name);
+
+// Releases the memory associated with a compiled pattern.
+VOID DokanPattern_Free(PDOKAN_PATTERN Pattern);
+
+#endif
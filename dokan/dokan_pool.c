@@ -21,73 +21,463 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokan_pool.h"
 #include "dokan_vector.h"
+#include "list.h"
 
 #include <assert.h>
+#include <malloc.h>
 #include <threadpoolapiset.h>
 
-#define DOKAN_IO_BATCH_POOL_SIZE 1024
-#define DOKAN_IO_EVENT_POOL_SIZE 1024
-#define DOKAN_IO_EXTRA_EVENT_POOL_SIZE 128
-#define DOKAN_DIRECTORY_LIST_POOL_SIZE 128
+// Objects the depots of the main pools hold when no size is configured.
+#define DOKAN_OBJECT_POOL_DEFAULT_SIZE 1024
+// Directory lists holding more memory than this are freed instead of pooled.
+#define DOKAN_DIRECTORY_LIST_POOL_MAX_MEMORY (256 * 1024)
+
+// Largest number of objects a magazine can hold.
+#define DOKAN_POOL_MAGAZINE_MAX_SIZE 32
+
+/**
+ * A fixed size stack of free objects.
+ *
+ * Each thread owns up to two magazines per pool and pops and pushes objects
+ * from them without any synchronization. Only when both are empty (or full)
+ * does the thread exchange a whole magazine with the depot of its pools.
+ */
+typedef struct DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT)
+    _DOKAN_POOL_MAGAZINE {
+  SLIST_ENTRY ListEntry;
+  ULONG Count;
+  PVOID Items[DOKAN_POOL_MAGAZINE_MAX_SIZE];
+} DOKAN_POOL_MAGAZINE, *PDOKAN_POOL_MAGAZINE;
+
+/**
+ * Depot of a pool.
+ *
+ * Magazines are exchanged through lock-free lists so threads never wait on
+ * each other.
+ */
+typedef struct _DOKAN_OBJECT_POOL {
+  /** Magazines holding free objects */
+  SLIST_HEADER FullMagazines;
+  /** Magazines ready to be filled */
+  SLIST_HEADER EmptyMagazines;
+  /** Number of magazines in FullMagazines */
+  volatile LONG FullMagazineCount;
+  /** Maximum number of magazines kept in FullMagazines */
+  LONG MaxFullMagazines;
+  /** Number of objects per magazine for this pool */
+  ULONG MagazineSize;
+} DOKAN_OBJECT_POOL, *PDOKAN_OBJECT_POOL;
+
+/**
+ * A set of pools, one for every DOKAN_POOL_TYPE.
+ *
+ * The global set is shared by the instances not using
+ * DOKAN_OPTION_INSTANCE_POOLS. Each set has its own FLS slot so a thread
+ * serving several instances keeps separate magazines for each of them.
+ */
+struct _DOKAN_OBJECT_POOLS {
+  DOKAN_OBJECT_POOL Pools[DokanPoolTypeCount];
+  /** FLS slot holding the DOKAN_POOL_THREAD_CACHE of the current thread */
+  DWORD FlsIndex;
+  /**
+   * Live thread caches and the counters of the ones already released.
+   * Only used when a thread cache is created, released or for statistics.
+   */
+  LIST_ENTRY ThreadCacheList;
+  DOKAN_POOL_STATISTICS RetiredStatistics[DokanPoolTypeCount];
+  CRITICAL_SECTION ThreadCacheCriticalSection;
+};
+
+/**
+ * Per-thread magazines and counters of every pool of a set.
+ *
+ * Released by the FLS callback when the thread exits or the set is freed.
+ */
+typedef struct _DOKAN_POOL_THREAD_CACHE {
+  LIST_ENTRY ListEntry;
+  PDOKAN_OBJECT_POOLS Pools;
+  PDOKAN_POOL_MAGAZINE Loaded[DokanPoolTypeCount];
+  PDOKAN_POOL_MAGAZINE Previous[DokanPoolTypeCount];
+  DOKAN_POOL_STATISTICS Statistics[DokanPoolTypeCount];
+} DOKAN_POOL_THREAD_CACHE, *PDOKAN_POOL_THREAD_CACHE;
 
 // Global thread pool
 PTP_POOL g_ThreadPool = NULL;
 
-// Global vector of event buffers
-PDOKAN_VECTOR g_IoBatchBufferPool = NULL;
-CRITICAL_SECTION g_IoBatchBufferCriticalSection;
+// Global object pools
+DOKAN_OBJECT_POOLS g_ObjectPools;
 
-PDOKAN_VECTOR g_IoEventBufferPool = NULL;
-CRITICAL_SECTION g_IoEventBufferCriticalSection;
+PTP_POOL GetThreadPool() { return g_ThreadPool; }
 
-PDOKAN_VECTOR g_EventResultPool = NULL;
-CRITICAL_SECTION g_EventResultCriticalSection;
+PDOKAN_OBJECT_POOLS GetGlobalObjectPools() { return &g_ObjectPools; }
 
-PDOKAN_VECTOR g_16KEventResultPool = NULL;
-CRITICAL_SECTION g_16KEventResultCriticalSection;
+VOID FreeIoEventBuffer(PDOKAN_IO_EVENT IoEvent) {
+  if (IoEvent) {
+    free(IoEvent);
+  }
+}
 
-PDOKAN_VECTOR g_32KEventResultPool = NULL;
-CRITICAL_SECTION g_32KEventResultCriticalSection;
+// Memory held by a free object of the pool.
+LONG64 GetPoolItemSize(DOKAN_POOL_TYPE Type, PVOID Item) {
+  switch (Type) {
+  case DokanPoolIoBatch:
+    return DOKAN_IO_BATCH_SIZE(((PDOKAN_IO_BATCH)Item)->EventContextSize);
+  case DokanPoolIoEvent:
+    return sizeof(DOKAN_IO_EVENT);
+  case DokanPoolEventResult:
+    return DOKAN_EVENT_INFO_DEFAULT_SIZE;
+  case DokanPool16KEventResult:
+    return DOKAN_EVENT_INFO_16K_SIZE;
+  case DokanPool32KEventResult:
+    return DOKAN_EVENT_INFO_32K_SIZE;
+  case DokanPool64KEventResult:
+    return DOKAN_EVENT_INFO_64K_SIZE;
+  case DokanPool128KEventResult:
+    return DOKAN_EVENT_INFO_128K_SIZE;
+  case DokanPoolFileInfo:
+    return sizeof(DOKAN_OPEN_INFO);
+  case DokanPoolDirectoryList:
+    return DokanDirectoryList_GetMemoryUsage((PDOKAN_DIRECTORY_LIST)Item);
+  default:
+    assert(FALSE);
+    return 0;
+  }
+}
 
-PDOKAN_VECTOR g_64KEventResultPool = NULL;
-CRITICAL_SECTION g_64KEventResultCriticalSection;
+// Releases an object that does not fit in the pool anymore.
+VOID FreePoolItem(PDOKAN_OBJECT_POOLS Pools, DOKAN_POOL_TYPE Type,
+                  PVOID Item) {
+  switch (Type) {
+  case DokanPoolIoBatch:
+    FreeIoBatchBuffer((PDOKAN_IO_BATCH)Item);
+    break;
+  case DokanPoolIoEvent:
+    FreeIoEventBuffer((PDOKAN_IO_EVENT)Item);
+    break;
+  case DokanPoolEventResult:
+  case DokanPool16KEventResult:
+  case DokanPool32KEventResult:
+  case DokanPool64KEventResult:
+  case DokanPool128KEventResult:
+    FreeEventResult((PEVENT_INFORMATION)Item);
+    break;
+  case DokanPoolFileInfo:
+    FreeFileOpenInfo(Pools, (PDOKAN_OPEN_INFO)Item);
+    break;
+  case DokanPoolDirectoryList:
+    DokanDirectoryList_Free((PDOKAN_DIRECTORY_LIST)Item);
+    break;
+  default:
+    assert(FALSE);
+    break;
+  }
+}
 
-PDOKAN_VECTOR g_128KEventResultPool = NULL;
-CRITICAL_SECTION g_128KEventResultCriticalSection;
+// Returns the memory released.
+LONG64 FreePoolMagazine(PDOKAN_OBJECT_POOLS Pools, DOKAN_POOL_TYPE Type,
+                        PDOKAN_POOL_MAGAZINE Magazine) {
+  LONG64 freedBytes = 0;
+  for (ULONG i = 0; i < Magazine->Count; ++i) {
+    freedBytes += GetPoolItemSize(Type, Magazine->Items[i]);
+    FreePoolItem(Pools, Type, Magazine->Items[i]);
+  }
+  _aligned_free(Magazine);
+  return freedBytes;
+}
 
-PDOKAN_VECTOR g_FileInfoPool = NULL;
-CRITICAL_SECTION g_FileInfoCriticalSection;
+PDOKAN_POOL_MAGAZINE PopEmptyMagazine(PDOKAN_OBJECT_POOL Pool) {
+  PSLIST_ENTRY entry = InterlockedPopEntrySList(&Pool->EmptyMagazines);
+  PDOKAN_POOL_MAGAZINE magazine;
+  if (entry) {
+    magazine = CONTAINING_RECORD(entry, DOKAN_POOL_MAGAZINE, ListEntry);
+  } else {
+    magazine = (PDOKAN_POOL_MAGAZINE)_aligned_malloc(
+        sizeof(DOKAN_POOL_MAGAZINE), MEMORY_ALLOCATION_ALIGNMENT);
+    if (!magazine) {
+      return NULL;
+    }
+  }
+  magazine->Count = 0;
+  return magazine;
+}
 
-PDOKAN_VECTOR g_DirectoryListPool = NULL;
-CRITICAL_SECTION g_DirectoryListCriticalSection;
+// Hands a magazine holding objects over to the depot.
+// Fails when the depot already holds as many objects as the pool allows.
+BOOL PushFullMagazine(PDOKAN_OBJECT_POOL Pool, PDOKAN_POOL_MAGAZINE Magazine) {
+  assert(Magazine->Count > 0);
+  if (InterlockedIncrement(&Pool->FullMagazineCount) >
+      Pool->MaxFullMagazines) {
+    InterlockedDecrement(&Pool->FullMagazineCount);
+    return FALSE;
+  }
+  InterlockedPushEntrySList(&Pool->FullMagazines, &Magazine->ListEntry);
+  return TRUE;
+}
 
-PTP_POOL GetThreadPool() { return g_ThreadPool; }
+PDOKAN_POOL_MAGAZINE PopFullMagazine(PDOKAN_OBJECT_POOL Pool) {
+  PSLIST_ENTRY entry = InterlockedPopEntrySList(&Pool->FullMagazines);
+  if (!entry) {
+    return NULL;
+  }
+  InterlockedDecrement(&Pool->FullMagazineCount);
+  return CONTAINING_RECORD(entry, DOKAN_POOL_MAGAZINE, ListEntry);
+}
 
-VOID FreeIoEventBuffer(PDOKAN_IO_EVENT IoEvent) {
-  if (IoEvent) {
-    free(IoEvent);
+// Gives the magazines of a released thread cache back to the depot.
+VOID ReleaseThreadMagazine(PDOKAN_POOL_THREAD_CACHE Cache,
+                           DOKAN_POOL_TYPE Type,
+                           PDOKAN_POOL_MAGAZINE Magazine) {
+  PDOKAN_OBJECT_POOL pool = &Cache->Pools->Pools[Type];
+  if (!Magazine) {
+    return;
   }
+  if (Magazine->Count > 0 && PushFullMagazine(pool, Magazine)) {
+    return;
+  }
+  Cache->Statistics[Type].CachedBytes -=
+      FreePoolMagazine(Cache->Pools, Type, Magazine);
+}
+
+VOID AddPoolStatistics(PDOKAN_POOL_STATISTICS Total,
+                       PDOKAN_POOL_STATISTICS Statistics) {
+  Total->Hits += Statistics->Hits;
+  Total->Misses += Statistics->Misses;
+  Total->DepotRefills += Statistics->DepotRefills;
+  Total->DepotSpills += Statistics->DepotSpills;
+  Total->Overflows += Statistics->Overflows;
+  Total->CachedBytes += Statistics->CachedBytes;
+  Total->InUseBytes += Statistics->InUseBytes;
+}
+
+VOID WINAPI ReleaseThreadCache(PVOID Data) {
+  PDOKAN_POOL_THREAD_CACHE cache = (PDOKAN_POOL_THREAD_CACHE)Data;
+  PDOKAN_OBJECT_POOLS pools;
+  if (!cache) {
+    return;
+  }
+  pools = cache->Pools;
+  for (int type = 0; type < DokanPoolTypeCount; ++type) {
+    ReleaseThreadMagazine(cache, type, cache->Loaded[type]);
+    ReleaseThreadMagazine(cache, type, cache->Previous[type]);
+  }
+  EnterCriticalSection(&pools->ThreadCacheCriticalSection);
+  {
+    for (int type = 0; type < DokanPoolTypeCount; ++type) {
+      AddPoolStatistics(&pools->RetiredStatistics[type],
+                        &cache->Statistics[type]);
+    }
+    RemoveEntryList(&cache->ListEntry);
+  }
+  LeaveCriticalSection(&pools->ThreadCacheCriticalSection);
+  free(cache);
+}
+
+PDOKAN_POOL_THREAD_CACHE GetThreadCache(PDOKAN_OBJECT_POOLS Pools) {
+  PDOKAN_POOL_THREAD_CACHE cache;
+  if (Pools->FlsIndex == FLS_OUT_OF_INDEXES) {
+    return NULL;
+  }
+  cache = (PDOKAN_POOL_THREAD_CACHE)FlsGetValue(Pools->FlsIndex);
+  if (cache) {
+    return cache;
+  }
+  cache = (PDOKAN_POOL_THREAD_CACHE)calloc(1, sizeof(DOKAN_POOL_THREAD_CACHE));
+  if (!cache) {
+    return NULL;
+  }
+  cache->Pools = Pools;
+  EnterCriticalSection(&Pools->ThreadCacheCriticalSection);
+  InsertTailList(&Pools->ThreadCacheList, &cache->ListEntry);
+  LeaveCriticalSection(&Pools->ThreadCacheCriticalSection);
+  if (!FlsSetValue(Pools->FlsIndex, cache)) {
+    ReleaseThreadCache(cache);
+    return NULL;
+  }
+  return cache;
+}
+
+// Accounts for the memory of an object handed out by a pool, or given back to
+// it with a negative Bytes whether it is then kept or freed.
+VOID AddPoolInUseBytes(PDOKAN_OBJECT_POOLS Pools, DOKAN_POOL_TYPE Type,
+                       LONG64 Bytes) {
+  PDOKAN_POOL_THREAD_CACHE cache = GetThreadCache(Pools);
+  if (cache) {
+    cache->Statistics[Type].InUseBytes += Bytes;
+  }
+}
+
+// Takes a free object from the calling thread magazines, refilling them from
+// the depot when they are empty. Returns NULL when the pool has nothing left.
+PVOID PopPoolItem(PDOKAN_OBJECT_POOLS Pools, DOKAN_POOL_TYPE Type) {
+  PDOKAN_OBJECT_POOL pool = &Pools->Pools[Type];
+  PDOKAN_POOL_THREAD_CACHE cache = GetThreadCache(Pools);
+  PDOKAN_POOL_MAGAZINE loaded;
+  PDOKAN_POOL_MAGAZINE previous;
+  PDOKAN_POOL_MAGAZINE full;
+  PVOID item;
+  if (!cache) {
+    return NULL;
+  }
+  loaded = cache->Loaded[Type];
+  previous = cache->Previous[Type];
+  if (!loaded || loaded->Count == 0) {
+    if (previous && previous->Count > 0) {
+      cache->Loaded[Type] = previous;
+      cache->Previous[Type] = loaded;
+    } else {
+      full = PopFullMagazine(pool);
+      if (!full) {
+        ++cache->Statistics[Type].Misses;
+        return NULL;
+      }
+      ++cache->Statistics[Type].DepotRefills;
+      if (previous) {
+        InterlockedPushEntrySList(&pool->EmptyMagazines, &previous->ListEntry);
+      }
+      cache->Previous[Type] = loaded;
+      cache->Loaded[Type] = full;
+    }
+    loaded = cache->Loaded[Type];
+  }
+  ++cache->Statistics[Type].Hits;
+  item = loaded->Items[--loaded->Count];
+  cache->Statistics[Type].CachedBytes -= GetPoolItemSize(Type, item);
+  return item;
+}
+
+// Stores a free object in the calling thread magazines, spilling them to the
+// depot when they are full. Returns FALSE when the pool is full and the
+// caller has to free the object.
+BOOL PushPoolItem(PDOKAN_OBJECT_POOLS Pools, DOKAN_POOL_TYPE Type,
+                  PVOID Item) {
+  PDOKAN_OBJECT_POOL pool = &Pools->Pools[Type];
+  PDOKAN_POOL_THREAD_CACHE cache = GetThreadCache(Pools);
+  PDOKAN_POOL_MAGAZINE loaded;
+  PDOKAN_POOL_MAGAZINE previous;
+  PDOKAN_POOL_MAGAZINE empty;
+  if (!cache) {
+    return FALSE;
+  }
+  loaded = cache->Loaded[Type];
+  previous = cache->Previous[Type];
+  if (!loaded || loaded->Count == pool->MagazineSize) {
+    if (previous && previous->Count < pool->MagazineSize) {
+      cache->Loaded[Type] = previous;
+      cache->Previous[Type] = loaded;
+    } else {
+      empty = PopEmptyMagazine(pool);
+      if (!empty) {
+        ++cache->Statistics[Type].Overflows;
+        return FALSE;
+      }
+      if (previous) {
+        if (!PushFullMagazine(pool, previous)) {
+          InterlockedPushEntrySList(&pool->EmptyMagazines, &empty->ListEntry);
+          ++cache->Statistics[Type].Overflows;
+          return FALSE;
+        }
+        ++cache->Statistics[Type].DepotSpills;
+      }
+      cache->Previous[Type] = loaded;
+      cache->Loaded[Type] = empty;
+    }
+    loaded = cache->Loaded[Type];
+  }
+  loaded->Items[loaded->Count++] = Item;
+  cache->Statistics[Type].CachedBytes += GetPoolItemSize(Type, Item);
+  return TRUE;
+}
+
+VOID InitializeObjectPool(PDOKAN_OBJECT_POOLS Pools, DOKAN_POOL_TYPE Type,
+                          ULONG PoolSize, ULONG MagazineSize) {
+  PDOKAN_OBJECT_POOL pool = &Pools->Pools[Type];
+  assert(MagazineSize > 0 && MagazineSize <= DOKAN_POOL_MAGAZINE_MAX_SIZE);
+  InitializeSListHead(&pool->FullMagazines);
+  InitializeSListHead(&pool->EmptyMagazines);
+  pool->FullMagazineCount = 0;
+  pool->MagazineSize = MagazineSize;
+  pool->MaxFullMagazines = PoolSize / MagazineSize;
+}
+
+VOID CleanupObjectPool(PDOKAN_OBJECT_POOLS Pools, DOKAN_POOL_TYPE Type) {
+  PDOKAN_OBJECT_POOL pool = &Pools->Pools[Type];
+  PSLIST_ENTRY entry;
+  LONG64 freedBytes = 0;
+  while ((entry = InterlockedPopEntrySList(&pool->FullMagazines)) != NULL) {
+    freedBytes += FreePoolMagazine(
+        Pools, Type, CONTAINING_RECORD(entry, DOKAN_POOL_MAGAZINE, ListEntry));
+  }
+  while ((entry = InterlockedPopEntrySList(&pool->EmptyMagazines)) != NULL) {
+    freedBytes += FreePoolMagazine(
+        Pools, Type, CONTAINING_RECORD(entry, DOKAN_POOL_MAGAZINE, ListEntry));
+  }
+  pool->FullMagazineCount = 0;
+  Pools->RetiredStatistics[Type].CachedBytes -= freedBytes;
+}
+
+// Sizes the pools of a set. PoolSize is the number of objects the depots of
+// the main pools can hold, the pools of large or rare objects get an eighth
+// of it.
+BOOL InitializeObjectPools(PDOKAN_OBJECT_POOLS Pools, ULONG PoolSize) {
+  ULONG extraPoolSize = PoolSize / 8;
+  (void)InitializeCriticalSectionAndSpinCount(
+      &Pools->ThreadCacheCriticalSection, 0x80000400);
+  InitializeListHead(&Pools->ThreadCacheList);
+  RtlZeroMemory(Pools->RetiredStatistics, sizeof(Pools->RetiredStatistics));
+
+  // Without an FLS slot every pop and push misses and objects are simply
+  // allocated and freed.
+  Pools->FlsIndex = FlsAlloc(ReleaseThreadCache);
+  if (Pools->FlsIndex == FLS_OUT_OF_INDEXES) {
+    DokanDbgPrint("Dokan Warning: Failed to allocate the object pool FLS slot. "
+                  "Error: %lu\n",
+                  GetLastError());
+  }
+
+  // Large buffers use small magazines to limit what each thread keeps aside.
+  InitializeObjectPool(Pools, DokanPoolIoBatch, PoolSize, 4);
+  InitializeObjectPool(Pools, DokanPoolIoEvent, PoolSize, 32);
+  InitializeObjectPool(Pools, DokanPoolEventResult, PoolSize, 16);
+  InitializeObjectPool(Pools, DokanPool16KEventResult, extraPoolSize, 4);
+  InitializeObjectPool(Pools, DokanPool32KEventResult, extraPoolSize, 4);
+  InitializeObjectPool(Pools, DokanPool64KEventResult, extraPoolSize, 2);
+  InitializeObjectPool(Pools, DokanPool128KEventResult, extraPoolSize, 2);
+  InitializeObjectPool(Pools, DokanPoolFileInfo, PoolSize, 32);
+  InitializeObjectPool(Pools, DokanPoolDirectoryList, extraPoolSize, 4);
+  return Pools->FlsIndex != FLS_OUT_OF_INDEXES;
+}
+
+VOID CleanupObjectPools(PDOKAN_OBJECT_POOLS Pools) {
+  //////////////////// Thread caches ////////////////////
+  // Freeing the slot runs ReleaseThreadCache for every thread still owning a
+  // cache. Release whatever would remain afterwards.
+  if (Pools->FlsIndex != FLS_OUT_OF_INDEXES) {
+    FlsFree(Pools->FlsIndex);
+    Pools->FlsIndex = FLS_OUT_OF_INDEXES;
+  }
+  for (;;) {
+    PDOKAN_POOL_THREAD_CACHE cache = NULL;
+    EnterCriticalSection(&Pools->ThreadCacheCriticalSection);
+    if (!IsListEmpty(&Pools->ThreadCacheList)) {
+      cache = CONTAINING_RECORD(Pools->ThreadCacheList.Flink,
+                                DOKAN_POOL_THREAD_CACHE, ListEntry);
+    }
+    LeaveCriticalSection(&Pools->ThreadCacheCriticalSection);
+    if (!cache) {
+      break;
+    }
+    ReleaseThreadCache(cache);
+  }
+
+  //////////////////// Object pool depots ////////////////////
+  for (int type = 0; type < DokanPoolTypeCount; ++type) {
+    CleanupObjectPool(Pools, type);
+  }
+  DeleteCriticalSection(&Pools->ThreadCacheCriticalSection);
 }
 
 int InitializePool() {
-  (void)InitializeCriticalSectionAndSpinCount(&g_IoBatchBufferCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_IoEventBufferCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_EventResultCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_16KEventResultCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_32KEventResultCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_64KEventResultCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_128KEventResultCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_FileInfoCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_DirectoryListCriticalSection,
-                                              0x80000400);
+  (void)InitializeObjectPools(&g_ObjectPools, DOKAN_OBJECT_POOL_DEFAULT_SIZE);
 
   if (g_ThreadPool) {
     DokanDbgPrint("Dokan Error: Thread pool has already been created.\n");
@@ -101,25 +491,6 @@ int InitializePool() {
     DokanDbgPrint("Dokan Error: Failed to create thread pool.\n");
     return DOKAN_DRIVER_INSTALL_ERROR;
   }
-
-  g_IoBatchBufferPool =
-      DokanVector_AllocWithCapacity(sizeof(PVOID), DOKAN_IO_BATCH_POOL_SIZE);
-  g_IoEventBufferPool =
-      DokanVector_AllocWithCapacity(sizeof(PVOID), DOKAN_IO_EVENT_POOL_SIZE);
-  g_EventResultPool =
-      DokanVector_AllocWithCapacity(sizeof(PVOID), DOKAN_IO_EVENT_POOL_SIZE);
-  g_16KEventResultPool = DokanVector_AllocWithCapacity(
-      sizeof(PVOID), DOKAN_IO_EXTRA_EVENT_POOL_SIZE);
-  g_32KEventResultPool = DokanVector_AllocWithCapacity(
-      sizeof(PVOID), DOKAN_IO_EXTRA_EVENT_POOL_SIZE);
-  g_64KEventResultPool = DokanVector_AllocWithCapacity(
-      sizeof(PVOID), DOKAN_IO_EXTRA_EVENT_POOL_SIZE);
-  g_128KEventResultPool = DokanVector_AllocWithCapacity(
-      sizeof(PVOID), DOKAN_IO_EXTRA_EVENT_POOL_SIZE);
-  g_FileInfoPool =
-      DokanVector_AllocWithCapacity(sizeof(PVOID), DOKAN_IO_EVENT_POOL_SIZE);
-  g_DirectoryListPool = DokanVector_AllocWithCapacity(
-      sizeof(PVOID), DOKAN_DIRECTORY_LIST_POOL_SIZE);
   return DOKAN_SUCCESS;
 }
 
@@ -128,169 +499,192 @@ VOID CleanupPool() {
     CloseThreadpool(g_ThreadPool);
     g_ThreadPool = NULL;
   }
-  //////////////////// IO batch buffer object pool ////////////////////
-  {
-    EnterCriticalSection(&g_IoBatchBufferCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_IoBatchBufferPool); ++i) {
-        FreeIoBatchBuffer(
-            *(PDOKAN_IO_BATCH *)DokanVector_GetItem(g_IoBatchBufferPool, i));
-      }
-      DokanVector_Free(g_IoBatchBufferPool);
-      g_IoBatchBufferPool = NULL;
-    }
-    LeaveCriticalSection(&g_IoBatchBufferCriticalSection);
-    DeleteCriticalSection(&g_IoBatchBufferCriticalSection);
-  }
+  CleanupObjectPools(&g_ObjectPools);
 
-  //////////////////// IO event buffer object pool ////////////////////
-  {
-    EnterCriticalSection(&g_IoEventBufferCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_IoEventBufferPool); ++i) {
-        FreeIoEventBuffer(
-            *(PDOKAN_IO_EVENT *)DokanVector_GetItem(g_IoEventBufferPool, i));
-      }
-      DokanVector_Free(g_IoEventBufferPool);
-      g_IoEventBufferPool = NULL;
-    }
-    LeaveCriticalSection(&g_IoEventBufferCriticalSection);
-    DeleteCriticalSection(&g_IoEventBufferCriticalSection);
-  }
+  //////////////////// Object pool cleanup finished ////////////////////
+}
 
-  //////////////////// Event result object pool ////////////////////
-  {
-    EnterCriticalSection(&g_EventResultCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_EventResultPool); ++i) {
-        FreeEventResult(
-            *(PEVENT_INFORMATION *)DokanVector_GetItem(g_EventResultPool, i));
-      }
-      DokanVector_Free(g_EventResultPool);
-      g_EventResultPool = NULL;
-    }
-    LeaveCriticalSection(&g_EventResultCriticalSection);
-    DeleteCriticalSection(&g_EventResultCriticalSection);
+// Allocates a new object of the pools that can be prewarmed.
+PVOID AllocPoolItem(DOKAN_POOL_TYPE Type) {
+  switch (Type) {
+  case DokanPoolIoEvent:
+    return malloc(sizeof(DOKAN_IO_EVENT));
+  case DokanPoolEventResult:
+    return malloc(DOKAN_EVENT_INFO_DEFAULT_SIZE);
+  case DokanPoolFileInfo:
+    return AllocFileOpenInfo();
+  default:
+    assert(FALSE);
+    return NULL;
   }
+}
 
-  {
-    EnterCriticalSection(&g_16KEventResultCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_16KEventResultPool); ++i) {
-        FreeEventResult(*(PEVENT_INFORMATION *)DokanVector_GetItem(
-            g_16KEventResultPool, i));
-      }
-      DokanVector_Free(g_16KEventResultPool);
-      g_16KEventResultPool = NULL;
+// Fills the depot of a pool with up to Count new objects, in full magazines.
+VOID PrewarmObjectPool(PDOKAN_OBJECT_POOLS Pools, DOKAN_POOL_TYPE Type,
+                       ULONG Count) {
+  PDOKAN_OBJECT_POOL pool = &Pools->Pools[Type];
+  PDOKAN_POOL_MAGAZINE magazine;
+  PVOID item;
+  LONG64 cachedBytes = 0;
+  while (Count >= pool->MagazineSize) {
+    magazine = PopEmptyMagazine(pool);
+    if (!magazine) {
+      break;
     }
-    LeaveCriticalSection(&g_16KEventResultCriticalSection);
-    DeleteCriticalSection(&g_16KEventResultCriticalSection);
-  }
-
-  {
-    EnterCriticalSection(&g_32KEventResultCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_32KEventResultPool); ++i) {
-        FreeEventResult(*(PEVENT_INFORMATION *)DokanVector_GetItem(
-            g_32KEventResultPool, i));
-      }
-      DokanVector_Free(g_32KEventResultPool);
-      g_32KEventResultPool = NULL;
+    while (magazine->Count < pool->MagazineSize &&
+           (item = AllocPoolItem(Type)) != NULL) {
+      magazine->Items[magazine->Count++] = item;
     }
-    LeaveCriticalSection(&g_32KEventResultCriticalSection);
-    DeleteCriticalSection(&g_32KEventResultCriticalSection);
-  }
-
-  {
-    EnterCriticalSection(&g_64KEventResultCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_64KEventResultPool); ++i) {
-        FreeEventResult(*(PEVENT_INFORMATION *)DokanVector_GetItem(
-            g_64KEventResultPool, i));
-      }
-      DokanVector_Free(g_64KEventResultPool);
-      g_64KEventResultPool = NULL;
+    if (magazine->Count < pool->MagazineSize ||
+        !PushFullMagazine(pool, magazine)) {
+      FreePoolMagazine(Pools, Type, magazine);
+      break;
     }
-    LeaveCriticalSection(&g_64KEventResultCriticalSection);
-    DeleteCriticalSection(&g_64KEventResultCriticalSection);
+    cachedBytes += magazine->Count * GetPoolItemSize(Type, magazine->Items[0]);
+    Count -= pool->MagazineSize;
   }
+  EnterCriticalSection(&Pools->ThreadCacheCriticalSection);
+  Pools->RetiredStatistics[Type].CachedBytes += cachedBytes;
+  LeaveCriticalSection(&Pools->ThreadCacheCriticalSection);
+}
 
-  {
-    EnterCriticalSection(&g_128KEventResultCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_128KEventResultPool); ++i) {
-        FreeEventResult(*(PEVENT_INFORMATION *)DokanVector_GetItem(
-            g_128KEventResultPool, i));
-      }
-      DokanVector_Free(g_128KEventResultPool);
-      g_128KEventResultPool = NULL;
-    }
-    LeaveCriticalSection(&g_128KEventResultCriticalSection);
-    DeleteCriticalSection(&g_128KEventResultCriticalSection);
-  }
+PDOKAN_OBJECT_POOLS AllocObjectPools(ULONG PoolSize, ULONG PrewarmCount) {
+  PDOKAN_OBJECT_POOLS pools =
+      (PDOKAN_OBJECT_POOLS)calloc(1, sizeof(DOKAN_OBJECT_POOLS));
+  if (!pools) {
+    return NULL;
+  }
+  if (!InitializeObjectPools(
+          pools, PoolSize ? PoolSize : DOKAN_OBJECT_POOL_DEFAULT_SIZE)) {
+    CleanupObjectPools(pools);
+    free(pools);
+    return NULL;
+  }
+  PrewarmObjectPool(pools, DokanPoolIoEvent, PrewarmCount);
+  PrewarmObjectPool(pools, DokanPoolEventResult, PrewarmCount);
+  PrewarmObjectPool(pools, DokanPoolFileInfo, PrewarmCount);
+  return pools;
+}
 
-  //////////////////// File info object pool ////////////////////
-  {
-    EnterCriticalSection(&g_FileInfoCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_FileInfoPool); ++i) {
-        FreeFileOpenInfo(
-            *(PDOKAN_OPEN_INFO *)DokanVector_GetItem(g_FileInfoPool, i));
-      }
-      DokanVector_Free(g_FileInfoPool);
-      g_FileInfoPool = NULL;
-    }
-    LeaveCriticalSection(&g_FileInfoCriticalSection);
-    DeleteCriticalSection(&g_FileInfoCriticalSection);
+VOID FreeObjectPools(PDOKAN_OBJECT_POOLS Pools) {
+  if (!Pools || Pools == &g_ObjectPools) {
+    return;
   }
+  CleanupObjectPools(Pools);
+  free(Pools);
+}
 
-  //////////////////// Directory list pool ////////////////////
+VOID GetPoolStatistics(PDOKAN_OBJECT_POOLS Pools, DOKAN_POOL_TYPE Type,
+                       PDOKAN_POOL_STATISTICS Statistics) {
+  assert(Type < DokanPoolTypeCount);
+  RtlZeroMemory(Statistics, sizeof(DOKAN_POOL_STATISTICS));
+  EnterCriticalSection(&Pools->ThreadCacheCriticalSection);
   {
-    EnterCriticalSection(&g_DirectoryListCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_DirectoryListPool); ++i) {
-        DokanVector_Free(
-            *(PDOKAN_VECTOR *)DokanVector_GetItem(g_DirectoryListPool, i));
-      }
-      DokanVector_Free(g_DirectoryListPool);
-      g_DirectoryListPool = NULL;
+    AddPoolStatistics(Statistics, &Pools->RetiredStatistics[Type]);
+    // Counters of live threads are read without synchronization and can be
+    // slightly behind.
+    for (PLIST_ENTRY entry = Pools->ThreadCacheList.Flink;
+         entry != &Pools->ThreadCacheList; entry = entry->Flink) {
+      PDOKAN_POOL_THREAD_CACHE cache =
+          CONTAINING_RECORD(entry, DOKAN_POOL_THREAD_CACHE, ListEntry);
+      AddPoolStatistics(Statistics, &cache->Statistics[Type]);
     }
-    LeaveCriticalSection(&g_DirectoryListCriticalSection);
-    DeleteCriticalSection(&g_DirectoryListCriticalSection);
   }
-
-  //////////////////// Object pool cleanup finished ////////////////////
+  LeaveCriticalSection(&Pools->ThreadCacheCriticalSection);
+  if (Statistics->CachedBytes < 0) {
+    Statistics->CachedBytes = 0;
+  }
+  if (Statistics->InUseBytes < 0) {
+    Statistics->InUseBytes = 0;
+  }
 }
 
 /////////////////// DOKAN_IO_BATCH ///////////////////
-PDOKAN_IO_BATCH PopIoBatchBuffer() {
-  PDOKAN_IO_BATCH ioBatch = NULL;
-  EnterCriticalSection(&g_IoBatchBufferCriticalSection);
-  {
-    if (DokanVector_GetCount(g_IoBatchBufferPool) > 0) {
-      ioBatch =
-          *(PDOKAN_IO_BATCH *)DokanVector_GetLastItem(g_IoBatchBufferPool);
-      DokanVector_PopBack(g_IoBatchBufferPool);
-    }
+PDOKAN_IO_BATCH PopIoBatchBuffer(PDOKAN_OBJECT_POOLS Pools,
+                                 ULONG EventContextSize) {
+  PDOKAN_IO_BATCH ioBatch = PopPoolItem(Pools, DokanPoolIoBatch);
+  while (ioBatch && ioBatch->EventContextSize != EventContextSize) {
+    // Left from before the batch size changed.
+    FreeIoBatchBuffer(ioBatch);
+    ioBatch = PopPoolItem(Pools, DokanPoolIoBatch);
   }
-  LeaveCriticalSection(&g_IoBatchBufferCriticalSection);
   if (!ioBatch) {
-    ioBatch = (PDOKAN_IO_BATCH)malloc(DOKAN_IO_BATCH_SIZE);
+    ioBatch = (PDOKAN_IO_BATCH)malloc(DOKAN_IO_BATCH_SIZE(EventContextSize));
   }
   if (ioBatch) {
     RtlZeroMemory(ioBatch, FIELD_OFFSET(DOKAN_IO_BATCH, EventContext));
     ioBatch->PoolAllocated = TRUE;
+    ioBatch->EventContextSize = EventContextSize;
+    AddPoolInUseBytes(Pools, DokanPoolIoBatch,
+                      DOKAN_IO_BATCH_SIZE(EventContextSize));
   }
   return ioBatch;
 }
 
+// Frees the batches of EventContextSize bytes of a magazine and returns the
+// memory released.
+LONG64 TrimIoBatchMagazine(PDOKAN_POOL_MAGAZINE Magazine,
+                           ULONG EventContextSize) {
+  LONG64 freedBytes = 0;
+  ULONG count = 0;
+  if (!Magazine) {
+    return 0;
+  }
+  for (ULONG i = 0; i < Magazine->Count; ++i) {
+    PDOKAN_IO_BATCH ioBatch = (PDOKAN_IO_BATCH)Magazine->Items[i];
+    if (ioBatch->EventContextSize == EventContextSize) {
+      freedBytes += DOKAN_IO_BATCH_SIZE(EventContextSize);
+      FreeIoBatchBuffer(ioBatch);
+    } else {
+      Magazine->Items[count++] = ioBatch;
+    }
+  }
+  Magazine->Count = count;
+  return freedBytes;
+}
+
+VOID TrimIoBatchBuffers(PDOKAN_OBJECT_POOLS Pools, ULONG EventContextSize) {
+  PDOKAN_OBJECT_POOL pool = &Pools->Pools[DokanPoolIoBatch];
+  PDOKAN_POOL_THREAD_CACHE cache = GetThreadCache(Pools);
+  PDOKAN_POOL_MAGAZINE trimmed = NULL;
+  PDOKAN_POOL_MAGAZINE magazine;
+  LONG64 freedBytes = 0;
+  if (!cache) {
+    return;
+  }
+  freedBytes += TrimIoBatchMagazine(cache->Loaded[DokanPoolIoBatch],
+                                    EventContextSize);
+  freedBytes += TrimIoBatchMagazine(cache->Previous[DokanPoolIoBatch],
+                                    EventContextSize);
+  // The whole depot is taken before any magazine goes back so that none is
+  // trimmed twice. Other threads miss the pool meanwhile.
+  while ((magazine = PopFullMagazine(pool)) != NULL) {
+    freedBytes += TrimIoBatchMagazine(magazine, EventContextSize);
+    magazine->ListEntry.Next = trimmed ? &trimmed->ListEntry : NULL;
+    trimmed = magazine;
+  }
+  while (trimmed) {
+    magazine = trimmed;
+    trimmed = magazine->ListEntry.Next
+                  ? CONTAINING_RECORD(magazine->ListEntry.Next,
+                                      DOKAN_POOL_MAGAZINE, ListEntry)
+                  : NULL;
+    if (!magazine->Count) {
+      InterlockedPushEntrySList(&pool->EmptyMagazines, &magazine->ListEntry);
+    } else if (!PushFullMagazine(pool, magazine)) {
+      freedBytes += FreePoolMagazine(Pools, DokanPoolIoBatch, magazine);
+    }
+  }
+  cache->Statistics[DokanPoolIoBatch].CachedBytes -= freedBytes;
+}
+
 VOID FreeIoBatchBuffer(PDOKAN_IO_BATCH IoBatch) {
   if (IoBatch) {
     free(IoBatch);
   }
 }
 
-VOID PushIoBatchBuffer(PDOKAN_IO_BATCH IoBatch) {
+VOID PushIoBatchBuffer(PDOKAN_OBJECT_POOLS Pools, PDOKAN_IO_BATCH IoBatch) {
   assert(IoBatch);
   LONG currentEventContextBatchCount =
       InterlockedDecrement(&IoBatch->EventContextBatchCount);
@@ -301,72 +695,44 @@ VOID PushIoBatchBuffer(PDOKAN_IO_BATCH IoBatch) {
     FreeIoBatchBuffer(IoBatch);
     return;
   }
-  EnterCriticalSection(&g_IoBatchBufferCriticalSection);
-  {
-    if (DokanVector_GetCount(g_IoBatchBufferPool) < DOKAN_IO_BATCH_POOL_SIZE) {
-      DokanVector_PushBack(g_IoBatchBufferPool, &IoBatch);
-      IoBatch = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_IoBatchBufferCriticalSection);
-  if (IoBatch) {
+  AddPoolInUseBytes(Pools, DokanPoolIoBatch,
+                    -(LONG64)DOKAN_IO_BATCH_SIZE(IoBatch->EventContextSize));
+  if (!PushPoolItem(Pools, DokanPoolIoBatch, IoBatch)) {
     FreeIoBatchBuffer(IoBatch);
   }
 }
 
 /////////////////// DOKAN_IO_EVENT ///////////////////
-PDOKAN_IO_EVENT PopIoEventBuffer() {
-  PDOKAN_IO_EVENT ioEvent = NULL;
-  EnterCriticalSection(&g_IoEventBufferCriticalSection);
-  {
-    if (DokanVector_GetCount(g_IoEventBufferPool) > 0) {
-      ioEvent =
-          *(PDOKAN_IO_EVENT *)DokanVector_GetLastItem(g_IoEventBufferPool);
-      DokanVector_PopBack(g_IoEventBufferPool);
-    }
-  }
-  LeaveCriticalSection(&g_IoEventBufferCriticalSection);
+PDOKAN_IO_EVENT PopIoEventBuffer(PDOKAN_OBJECT_POOLS Pools) {
+  PDOKAN_IO_EVENT ioEvent = PopPoolItem(Pools, DokanPoolIoEvent);
   if (!ioEvent) {
     ioEvent = (PDOKAN_IO_EVENT)malloc(sizeof(DOKAN_IO_EVENT));
   }
   if (ioEvent) {
     RtlZeroMemory(ioEvent, sizeof(DOKAN_IO_EVENT));
+    AddPoolInUseBytes(Pools, DokanPoolIoEvent, sizeof(DOKAN_IO_EVENT));
   }
   return ioEvent;
 }
 
-VOID PushIoEventBuffer(PDOKAN_IO_EVENT IoEvent) {
+VOID PushIoEventBuffer(PDOKAN_OBJECT_POOLS Pools, PDOKAN_IO_EVENT IoEvent) {
   assert(IoEvent);
-  EnterCriticalSection(&g_IoEventBufferCriticalSection);
-  {
-    if (DokanVector_GetCount(g_IoEventBufferPool) < DOKAN_IO_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_IoEventBufferPool, &IoEvent);
-      IoEvent = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_IoEventBufferCriticalSection);
-  if (IoEvent) {
+  AddPoolInUseBytes(Pools, DokanPoolIoEvent, -(LONG64)sizeof(DOKAN_IO_EVENT));
+  if (!PushPoolItem(Pools, DokanPoolIoEvent, IoEvent)) {
     FreeIoEventBuffer(IoEvent);
   }
 }
 
 /////////////////// EVENT_INFORMATION ///////////////////
-PEVENT_INFORMATION PopEventResult() {
-  PEVENT_INFORMATION eventResult = NULL;
-  EnterCriticalSection(&g_EventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_EventResultPool) > 0) {
-      eventResult =
-          *(PEVENT_INFORMATION *)DokanVector_GetLastItem(g_EventResultPool);
-      DokanVector_PopBack(g_EventResultPool);
-    }
-  }
-  LeaveCriticalSection(&g_EventResultCriticalSection);
+PEVENT_INFORMATION PopEventResult(PDOKAN_OBJECT_POOLS Pools) {
+  PEVENT_INFORMATION eventResult = PopPoolItem(Pools, DokanPoolEventResult);
   if (!eventResult) {
     eventResult = (PEVENT_INFORMATION)malloc(DOKAN_EVENT_INFO_DEFAULT_SIZE);
   }
   if (eventResult) {
     RtlZeroMemory(eventResult, DOKAN_EVENT_INFO_DEFAULT_SIZE);
+    AddPoolInUseBytes(Pools, DokanPoolEventResult,
+                      DOKAN_EVENT_INFO_DEFAULT_SIZE);
   }
   return eventResult;
 }
@@ -377,208 +743,166 @@ VOID FreeEventResult(PEVENT_INFORMATION EventResult) {
   }
 }
 
-VOID PushEventResult(PEVENT_INFORMATION EventResult) {
+VOID PushEventResult(PDOKAN_OBJECT_POOLS Pools,
+                     PEVENT_INFORMATION EventResult) {
   assert(EventResult);
-  EnterCriticalSection(&g_EventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_EventResultPool) < DOKAN_IO_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_EventResultPool, &EventResult);
-      EventResult = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_EventResultCriticalSection);
-  if (EventResult) {
+  AddPoolInUseBytes(Pools, DokanPoolEventResult,
+                    -(LONG64)DOKAN_EVENT_INFO_DEFAULT_SIZE);
+  if (!PushPoolItem(Pools, DokanPoolEventResult, EventResult)) {
     FreeEventResult(EventResult);
   }
 }
 
 /////////////////// EVENT_INFORMATION 16K ///////////////////
-PEVENT_INFORMATION Pop16KEventResult() {
-  PEVENT_INFORMATION eventResult = NULL;
-  EnterCriticalSection(&g_16KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_16KEventResultPool) > 0) {
-      eventResult =
-          *(PEVENT_INFORMATION *)DokanVector_GetLastItem(g_16KEventResultPool);
-      DokanVector_PopBack(g_16KEventResultPool);
-    }
-  }
-  LeaveCriticalSection(&g_16KEventResultCriticalSection);
+PEVENT_INFORMATION Pop16KEventResult(PDOKAN_OBJECT_POOLS Pools) {
+  PEVENT_INFORMATION eventResult =
+      PopPoolItem(Pools, DokanPool16KEventResult);
   if (!eventResult) {
     eventResult = (PEVENT_INFORMATION)malloc(DOKAN_EVENT_INFO_16K_SIZE);
   }
   if (eventResult) {
     RtlZeroMemory(eventResult, FIELD_OFFSET(EVENT_INFORMATION, Buffer));
+    AddPoolInUseBytes(Pools, DokanPool16KEventResult,
+                      DOKAN_EVENT_INFO_16K_SIZE);
   }
   return eventResult;
 }
 
-VOID Push16KEventResult(PEVENT_INFORMATION EventResult) {
+VOID Push16KEventResult(PDOKAN_OBJECT_POOLS Pools,
+                        PEVENT_INFORMATION EventResult) {
   assert(EventResult);
-  EnterCriticalSection(&g_16KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_16KEventResultPool) <
-        DOKAN_IO_EXTRA_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_16KEventResultPool, &EventResult);
-      EventResult = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_16KEventResultCriticalSection);
-  if (EventResult) {
+  AddPoolInUseBytes(Pools, DokanPool16KEventResult,
+                    -(LONG64)DOKAN_EVENT_INFO_16K_SIZE);
+  if (!PushPoolItem(Pools, DokanPool16KEventResult, EventResult)) {
     FreeEventResult(EventResult);
   }
 }
 
 /////////////////// EVENT_INFORMATION 32K ///////////////////
-PEVENT_INFORMATION Pop32KEventResult() {
-  PEVENT_INFORMATION eventResult = NULL;
-  EnterCriticalSection(&g_32KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_32KEventResultPool) > 0) {
-      eventResult =
-          *(PEVENT_INFORMATION *)DokanVector_GetLastItem(g_32KEventResultPool);
-      DokanVector_PopBack(g_32KEventResultPool);
-    }
-  }
-  LeaveCriticalSection(&g_32KEventResultCriticalSection);
+PEVENT_INFORMATION Pop32KEventResult(PDOKAN_OBJECT_POOLS Pools) {
+  PEVENT_INFORMATION eventResult =
+      PopPoolItem(Pools, DokanPool32KEventResult);
   if (!eventResult) {
     eventResult = (PEVENT_INFORMATION)malloc(DOKAN_EVENT_INFO_32K_SIZE);
   }
   if (eventResult) {
     RtlZeroMemory(eventResult, FIELD_OFFSET(EVENT_INFORMATION, Buffer));
+    AddPoolInUseBytes(Pools, DokanPool32KEventResult,
+                      DOKAN_EVENT_INFO_32K_SIZE);
   }
   return eventResult;
 }
 
-VOID Push32KEventResult(PEVENT_INFORMATION EventResult) {
+VOID Push32KEventResult(PDOKAN_OBJECT_POOLS Pools,
+                        PEVENT_INFORMATION EventResult) {
   assert(EventResult);
-  EnterCriticalSection(&g_32KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_32KEventResultPool) <
-        DOKAN_IO_EXTRA_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_32KEventResultPool, &EventResult);
-      EventResult = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_32KEventResultCriticalSection);
-  if (EventResult) {
+  AddPoolInUseBytes(Pools, DokanPool32KEventResult,
+                    -(LONG64)DOKAN_EVENT_INFO_32K_SIZE);
+  if (!PushPoolItem(Pools, DokanPool32KEventResult, EventResult)) {
     FreeEventResult(EventResult);
   }
 }
 
 /////////////////// EVENT_INFORMATION 64K ///////////////////
-PEVENT_INFORMATION Pop64KEventResult() {
-  PEVENT_INFORMATION eventResult = NULL;
-  EnterCriticalSection(&g_64KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_64KEventResultPool) > 0) {
-      eventResult =
-          *(PEVENT_INFORMATION *)DokanVector_GetLastItem(g_64KEventResultPool);
-      DokanVector_PopBack(g_64KEventResultPool);
-    }
-  }
-  LeaveCriticalSection(&g_64KEventResultCriticalSection);
+PEVENT_INFORMATION Pop64KEventResult(PDOKAN_OBJECT_POOLS Pools) {
+  PEVENT_INFORMATION eventResult =
+      PopPoolItem(Pools, DokanPool64KEventResult);
   if (!eventResult) {
     eventResult = (PEVENT_INFORMATION)malloc(DOKAN_EVENT_INFO_64K_SIZE);
   }
   if (eventResult) {
     RtlZeroMemory(eventResult, FIELD_OFFSET(EVENT_INFORMATION, Buffer));
+    AddPoolInUseBytes(Pools, DokanPool64KEventResult,
+                      DOKAN_EVENT_INFO_64K_SIZE);
   }
   return eventResult;
 }
 
-VOID Push64KEventResult(PEVENT_INFORMATION EventResult) {
+VOID Push64KEventResult(PDOKAN_OBJECT_POOLS Pools,
+                        PEVENT_INFORMATION EventResult) {
   assert(EventResult);
-  EnterCriticalSection(&g_64KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_64KEventResultPool) <
-        DOKAN_IO_EXTRA_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_64KEventResultPool, &EventResult);
-      EventResult = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_64KEventResultCriticalSection);
-  if (EventResult) {
+  AddPoolInUseBytes(Pools, DokanPool64KEventResult,
+                    -(LONG64)DOKAN_EVENT_INFO_64K_SIZE);
+  if (!PushPoolItem(Pools, DokanPool64KEventResult, EventResult)) {
     FreeEventResult(EventResult);
   }
 }
 
 /////////////////// EVENT_INFORMATION 128K ///////////////////
-PEVENT_INFORMATION Pop128KEventResult() {
-  PEVENT_INFORMATION eventResult = NULL;
-  EnterCriticalSection(&g_128KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_128KEventResultPool) > 0) {
-      eventResult =
-          *(PEVENT_INFORMATION *)DokanVector_GetLastItem(g_128KEventResultPool);
-      DokanVector_PopBack(g_128KEventResultPool);
-    }
-  }
-  LeaveCriticalSection(&g_128KEventResultCriticalSection);
+PEVENT_INFORMATION Pop128KEventResult(PDOKAN_OBJECT_POOLS Pools) {
+  PEVENT_INFORMATION eventResult =
+      PopPoolItem(Pools, DokanPool128KEventResult);
   if (!eventResult) {
     eventResult = (PEVENT_INFORMATION)malloc(DOKAN_EVENT_INFO_128K_SIZE);
   }
   if (eventResult) {
     RtlZeroMemory(eventResult, FIELD_OFFSET(EVENT_INFORMATION, Buffer));
+    AddPoolInUseBytes(Pools, DokanPool128KEventResult,
+                      DOKAN_EVENT_INFO_128K_SIZE);
   }
   return eventResult;
 }
 
-VOID Push128KEventResult(PEVENT_INFORMATION EventResult) {
+VOID Push128KEventResult(PDOKAN_OBJECT_POOLS Pools,
+                         PEVENT_INFORMATION EventResult) {
   assert(EventResult);
-  EnterCriticalSection(&g_128KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_128KEventResultPool) <
-        DOKAN_IO_EXTRA_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_128KEventResultPool, &EventResult);
-      EventResult = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_128KEventResultCriticalSection);
-  if (EventResult) {
+  AddPoolInUseBytes(Pools, DokanPool128KEventResult,
+                    -(LONG64)DOKAN_EVENT_INFO_128K_SIZE);
+  if (!PushPoolItem(Pools, DokanPool128KEventResult, EventResult)) {
     FreeEventResult(EventResult);
   }
 }
 
 /////////////////// DOKAN_OPEN_INFO ///////////////////
-PDOKAN_OPEN_INFO PopFileOpenInfo() {
-  PDOKAN_OPEN_INFO fileInfo = NULL;
-  EnterCriticalSection(&g_FileInfoCriticalSection);
-  {
-    if (DokanVector_GetCount(g_FileInfoPool) > 0) {
-      fileInfo = *(PDOKAN_OPEN_INFO *)DokanVector_GetLastItem(g_FileInfoPool);
-      DokanVector_PopBack(g_FileInfoPool);
-    }
+PDOKAN_OPEN_INFO AllocFileOpenInfo() {
+  PDOKAN_OPEN_INFO fileInfo =
+      (PDOKAN_OPEN_INFO)malloc(sizeof(DOKAN_OPEN_INFO));
+  if (!fileInfo) {
+    DokanDbgPrint("Dokan Error: Failed to allocate DOKAN_OPEN_INFO.\n");
+    return NULL;
   }
-  LeaveCriticalSection(&g_FileInfoCriticalSection);
+  RtlZeroMemory(fileInfo, sizeof(DOKAN_OPEN_INFO));
+  InitializeCriticalSection(&fileInfo->CriticalSection);
+  return fileInfo;
+}
+
+PDOKAN_OPEN_INFO PopFileOpenInfo(PDOKAN_OBJECT_POOLS Pools) {
+  PDOKAN_OPEN_INFO fileInfo = PopPoolItem(Pools, DokanPoolFileInfo);
   if (!fileInfo) {
-    fileInfo = (PDOKAN_OPEN_INFO)malloc(sizeof(DOKAN_OPEN_INFO));
+    fileInfo = AllocFileOpenInfo();
     if (!fileInfo) {
-      DokanDbgPrint("Dokan Error: Failed to allocate DOKAN_OPEN_INFO.\n");
       return NULL;
     }
-    RtlZeroMemory(fileInfo, sizeof(DOKAN_OPEN_INFO));
-    InitializeCriticalSection(&fileInfo->CriticalSection);
   }
   if (fileInfo) {
     fileInfo->DokanInstance = NULL;
     fileInfo->DirList = NULL;
     fileInfo->DirListSearchPattern= NULL;
+    fileInfo->DirListCursor.Index = 0;
+    fileInfo->DirListCursor.Position = 0;
     fileInfo->UnimplementedFindFilesWithPattern = FALSE;
     fileInfo->UserContext = 0;
     fileInfo->EventId = 0;
     fileInfo->IsDirectory = FALSE;
     fileInfo->OpenCount = 0;
     fileInfo->CloseFileName = NULL;
+    fileInfo->FileName = NULL;
+    fileInfo->FileNameGeneration = 0;
     fileInfo->CloseUserContext = 0;
     fileInfo->EventContext = NULL;
+    fileInfo->NextReadOffset = 0;
+    fileInfo->SequentialReadCount = 0;
+    fileInfo->ReadAheadWindow = NULL;
+    fileInfo->WriteBuffer = NULL;
+    AddPoolInUseBytes(Pools, DokanPoolFileInfo, sizeof(DOKAN_OPEN_INFO));
   }
   return fileInfo;
 }
 
-VOID CleanupFileOpenInfo(PDOKAN_OPEN_INFO FileInfo) {
+VOID CleanupFileOpenInfo(PDOKAN_OBJECT_POOLS Pools,
+                         PDOKAN_OPEN_INFO FileInfo) {
   assert(FileInfo);
-  PDOKAN_VECTOR dirList = NULL;
+  PDOKAN_DIRECTORY_LIST dirList = NULL;
   EnterCriticalSection(&FileInfo->CriticalSection);
   {
     if (FileInfo->DirListSearchPattern) {
@@ -590,73 +914,58 @@ VOID CleanupFileOpenInfo(PDOKAN_OPEN_INFO FileInfo) {
       dirList = FileInfo->DirList;
       FileInfo->DirList = NULL;
     }
+    FileInfo->DirListCursor.Index = 0;
+    FileInfo->DirListCursor.Position = 0;
+
+    if (FileInfo->FileName) {
+      free(FileInfo->FileName);
+      FileInfo->FileName = NULL;
+    }
   }
   LeaveCriticalSection(&FileInfo->CriticalSection);
   if (dirList) {
-    PushDirectoryList(dirList);
+    PushDirectoryList(Pools, dirList);
   }
 }
 
-VOID FreeFileOpenInfo(PDOKAN_OPEN_INFO FileInfo) {
+VOID FreeFileOpenInfo(PDOKAN_OBJECT_POOLS Pools, PDOKAN_OPEN_INFO FileInfo) {
   if (FileInfo) {
-    CleanupFileOpenInfo(FileInfo);
+    CleanupFileOpenInfo(Pools, FileInfo);
     DeleteCriticalSection(&FileInfo->CriticalSection);
     free(FileInfo);
   }
 }
 
-VOID PushFileOpenInfo(PDOKAN_OPEN_INFO FileInfo) {
+VOID PushFileOpenInfo(PDOKAN_OBJECT_POOLS Pools, PDOKAN_OPEN_INFO FileInfo) {
   assert(FileInfo);
-  CleanupFileOpenInfo(FileInfo);
-  EnterCriticalSection(&g_FileInfoCriticalSection);
-  {
-    if (DokanVector_GetCount(g_FileInfoPool) < DOKAN_IO_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_FileInfoPool, &FileInfo);
-      FileInfo = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_FileInfoCriticalSection);
-  if (FileInfo) {
-    FreeFileOpenInfo(FileInfo);
+  CleanupFileOpenInfo(Pools, FileInfo);
+  AddPoolInUseBytes(Pools, DokanPoolFileInfo, -(LONG64)sizeof(DOKAN_OPEN_INFO));
+  if (!PushPoolItem(Pools, DokanPoolFileInfo, FileInfo)) {
+    FreeFileOpenInfo(Pools, FileInfo);
   }
 }
 
 /////////////////// Directory list ///////////////////
-PDOKAN_VECTOR PopDirectoryList() {
-  PDOKAN_VECTOR directoryList = NULL;
-  EnterCriticalSection(&g_DirectoryListCriticalSection);
-  {
-    if (DokanVector_GetCount(g_DirectoryListPool) > 0) {
-      directoryList =
-          *(PDOKAN_VECTOR *)DokanVector_GetLastItem(g_DirectoryListPool);
-      DokanVector_PopBack(g_DirectoryListPool);
-    }
-  }
-  LeaveCriticalSection(&g_DirectoryListCriticalSection);
+PDOKAN_DIRECTORY_LIST PopDirectoryList(PDOKAN_OBJECT_POOLS Pools) {
+  PDOKAN_DIRECTORY_LIST directoryList =
+      PopPoolItem(Pools, DokanPoolDirectoryList);
   if (!directoryList) {
-    directoryList = DokanVector_Alloc(sizeof(WIN32_FIND_DATAW));
+    directoryList = DokanDirectoryList_Alloc();
   }
   if (directoryList) {
-    DokanVector_Clear(directoryList);
+    DokanDirectoryList_Clear(directoryList);
   }
   return directoryList;
 }
 
-VOID PushDirectoryList(PDOKAN_VECTOR DirectoryList) {
+VOID PushDirectoryList(PDOKAN_OBJECT_POOLS Pools,
+                       PDOKAN_DIRECTORY_LIST DirectoryList) {
   assert(DirectoryList);
-  assert(DokanVector_GetItemSize(DirectoryList) == sizeof(WIN32_FIND_DATAW));
-  EnterCriticalSection(&g_DirectoryListCriticalSection);
-  {
-    if (DokanVector_GetCount(g_DirectoryListPool) <
-        DOKAN_DIRECTORY_LIST_POOL_SIZE) {
-      DokanVector_PushBack(g_DirectoryListPool, &DirectoryList);
-      DirectoryList = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_DirectoryListCriticalSection);
-  if (DirectoryList) {
-    DokanVector_Free(DirectoryList);
+  if (DokanDirectoryList_GetMemoryUsage(DirectoryList) >
+          DOKAN_DIRECTORY_LIST_POOL_MAX_MEMORY ||
+      !PushPoolItem(Pools, DokanPoolDirectoryList, DirectoryList)) {
+    DokanDirectoryList_Free(DirectoryList);
   }
 }
 
-/////////////////// Push/Pop pattern finished ///////////////////
\ No newline at end of file
+/////////////////// Push/Pop pattern finished ///////////////////
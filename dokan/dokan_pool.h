@@ -27,10 +27,8 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #define DOKAN_PULL_EVENT_TIMEOUT_MS 100
 #define DOKAN_MAIN_PULL_THREAD_COUNT_MAX 16
 #define DOKAN_MAIN_PULL_THREAD_COUNT_MIN 2
-#define BATCH_EVENT_CONTEXT_SIZE (EVENT_CONTEXT_MAX_SIZE * 4)
-#define DOKAN_IO_BATCH_SIZE                                                    \
-  ((SIZE_T)(FIELD_OFFSET(DOKAN_IO_BATCH, EventContext)) +                      \
-   BATCH_EVENT_CONTEXT_SIZE)
+#define DOKAN_IO_BATCH_SIZE(EventContextSize)                                  \
+  ((SIZE_T)(FIELD_OFFSET(DOKAN_IO_BATCH, EventContext)) + (EventContextSize))
 
 #define DOKAN_EVENT_INFO_16K_SIZE                                              \
   (FIELD_OFFSET(EVENT_INFORMATION, Buffer) + (16 * 1024))
@@ -41,37 +39,118 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #define DOKAN_EVENT_INFO_128K_SIZE                                             \
   (FIELD_OFFSET(EVENT_INFORMATION, Buffer) + (128 * 1024))
 
+/**
+ * \enum DOKAN_POOL_TYPE
+ * \brief Object pools of a DOKAN_OBJECT_POOLS set
+ */
+typedef enum _DOKAN_POOL_TYPE {
+  DokanPoolIoBatch,
+  DokanPoolIoEvent,
+  DokanPoolEventResult,
+  DokanPool16KEventResult,
+  DokanPool32KEventResult,
+  DokanPool64KEventResult,
+  DokanPool128KEventResult,
+  DokanPoolFileInfo,
+  DokanPoolDirectoryList,
+  DokanPoolTypeCount,
+} DOKAN_POOL_TYPE;
+
+/**
+ * \struct DOKAN_POOL_STATISTICS
+ * \brief Usage counters of an object pool
+ */
+typedef struct _DOKAN_POOL_STATISTICS {
+  /** Objects served from the pool */
+  ULONG64 Hits;
+  /** Objects that had to be allocated because the pool was empty */
+  ULONG64 Misses;
+  /** Times a thread took a magazine of objects from the shared depot */
+  ULONG64 DepotRefills;
+  /** Times a thread gave a magazine of objects to the shared depot */
+  ULONG64 DepotSpills;
+  /** Objects freed because the pool was full */
+  ULONG64 Overflows;
+  /**
+   * Memory in bytes held by the free objects of the pool. The counter of a
+   * single thread can be negative when it takes objects freed by others.
+   */
+  LONG64 CachedBytes;
+  /**
+   * Memory in bytes of the objects handed out by the pool and not given back
+   * yet. Directory lists grow while in use and are not counted.
+   */
+  LONG64 InUseBytes;
+} DOKAN_POOL_STATISTICS, *PDOKAN_POOL_STATISTICS;
+
+/**
+ * A set of object pools, one of each DOKAN_POOL_TYPE.
+ *
+ * Instances use the global set unless DOKAN_OPTION_INSTANCE_POOLS gives them
+ * their own, see DOKAN_INSTANCE.ObjectPools.
+ */
+typedef struct _DOKAN_OBJECT_POOLS DOKAN_OBJECT_POOLS, *PDOKAN_OBJECT_POOLS;
+
 PTP_POOL GetThreadPool();
 int InitializePool();
 VOID CleanupPool();
 
-PDOKAN_IO_BATCH PopIoBatchBuffer();
-VOID PushIoBatchBuffer(PDOKAN_IO_BATCH IoBatch);
+// The set shared by the instances without pools of their own.
+PDOKAN_OBJECT_POOLS GetGlobalObjectPools();
+
+// Allocates a set whose main pools keep up to PoolSize free objects, 0 for
+// the default. PrewarmCount objects of the pools used by every request are
+// allocated upfront. Returns NULL on failure.
+PDOKAN_OBJECT_POOLS AllocObjectPools(ULONG PoolSize, ULONG PrewarmCount);
+
+// Frees the set and the objects it holds. Does nothing for the global set.
+VOID FreeObjectPools(PDOKAN_OBJECT_POOLS Pools);
+
+// Sums the counters of all threads for the given pool of a set.
+VOID GetPoolStatistics(PDOKAN_OBJECT_POOLS Pools, DOKAN_POOL_TYPE Type,
+                       PDOKAN_POOL_STATISTICS Statistics);
+
+// Batches of another EventContextSize found in the pool are freed.
+PDOKAN_IO_BATCH PopIoBatchBuffer(PDOKAN_OBJECT_POOLS Pools,
+                                 ULONG EventContextSize);
+VOID PushIoBatchBuffer(PDOKAN_OBJECT_POOLS Pools, PDOKAN_IO_BATCH IoBatch);
+// Frees the batches of EventContextSize bytes held by the depot and the
+// calling thread, once that size is stale. Those of other threads are freed
+// when popped.
+VOID TrimIoBatchBuffers(PDOKAN_OBJECT_POOLS Pools, ULONG EventContextSize);
 VOID FreeIoBatchBuffer(PDOKAN_IO_BATCH IoBatch);
 
-PDOKAN_IO_EVENT PopIoEventBuffer();
-VOID PushIoEventBuffer(PDOKAN_IO_EVENT IoEvent);
+PDOKAN_IO_EVENT PopIoEventBuffer(PDOKAN_OBJECT_POOLS Pools);
+VOID PushIoEventBuffer(PDOKAN_OBJECT_POOLS Pools, PDOKAN_IO_EVENT IoEvent);
 
 // Default Event size.
-PEVENT_INFORMATION PopEventResult();
-VOID PushEventResult(PEVENT_INFORMATION EventResult);
+PEVENT_INFORMATION PopEventResult(PDOKAN_OBJECT_POOLS Pools);
+VOID PushEventResult(PDOKAN_OBJECT_POOLS Pools,
+                     PEVENT_INFORMATION EventResult);
 VOID FreeEventResult(PEVENT_INFORMATION EventResult);
 
 // Event with extra memory allocated for events holding additional data. 
-PEVENT_INFORMATION Pop16KEventResult();
-VOID Push16KEventResult(PEVENT_INFORMATION EventResult);
-PEVENT_INFORMATION Pop32KEventResult();
-VOID Push32KEventResult(PEVENT_INFORMATION EventResult);
-PEVENT_INFORMATION Pop64KEventResult();
-VOID Push64KEventResult(PEVENT_INFORMATION EventResult);
-PEVENT_INFORMATION Pop128KEventResult();
-VOID Push128KEventResult(PEVENT_INFORMATION EventResult);
-
-PDOKAN_OPEN_INFO PopFileOpenInfo();
-VOID PushFileOpenInfo(PDOKAN_OPEN_INFO FileInfo);
-VOID FreeFileOpenInfo(PDOKAN_OPEN_INFO FileInfo);
-
-PDOKAN_VECTOR PopDirectoryList();
-VOID PushDirectoryList(PDOKAN_VECTOR DirectoryList);
+PEVENT_INFORMATION Pop16KEventResult(PDOKAN_OBJECT_POOLS Pools);
+VOID Push16KEventResult(PDOKAN_OBJECT_POOLS Pools,
+                        PEVENT_INFORMATION EventResult);
+PEVENT_INFORMATION Pop32KEventResult(PDOKAN_OBJECT_POOLS Pools);
+VOID Push32KEventResult(PDOKAN_OBJECT_POOLS Pools,
+                        PEVENT_INFORMATION EventResult);
+PEVENT_INFORMATION Pop64KEventResult(PDOKAN_OBJECT_POOLS Pools);
+VOID Push64KEventResult(PDOKAN_OBJECT_POOLS Pools,
+                        PEVENT_INFORMATION EventResult);
+PEVENT_INFORMATION Pop128KEventResult(PDOKAN_OBJECT_POOLS Pools);
+VOID Push128KEventResult(PDOKAN_OBJECT_POOLS Pools,
+                         PEVENT_INFORMATION EventResult);
+
+// Allocates an open info outside of any pool.
+PDOKAN_OPEN_INFO AllocFileOpenInfo();
+PDOKAN_OPEN_INFO PopFileOpenInfo(PDOKAN_OBJECT_POOLS Pools);
+VOID PushFileOpenInfo(PDOKAN_OBJECT_POOLS Pools, PDOKAN_OPEN_INFO FileInfo);
+VOID FreeFileOpenInfo(PDOKAN_OBJECT_POOLS Pools, PDOKAN_OPEN_INFO FileInfo);
+
+PDOKAN_DIRECTORY_LIST PopDirectoryList(PDOKAN_OBJECT_POOLS Pools);
+VOID PushDirectoryList(PDOKAN_OBJECT_POOLS Pools,
+                       PDOKAN_DIRECTORY_LIST DirectoryList);
 
 #endif
@@ -0,0 +1,461 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokan_read_ahead.h"
+
+#include <assert.h>
+
+#define DOKAN_READ_AHEAD_ALIGN(Length) (((Length) + 7) & ~(SIZE_T)7)
+
+static BOOL ReserveMemory(PDOKAN_READ_AHEAD ReadAhead, ULONG64 Size) {
+  if ((ULONG64)InterlockedAdd64(&ReadAhead->MemoryUsage, (LONG64)Size) >
+      ReadAhead->MaxMemory) {
+    InterlockedAdd64(&ReadAhead->MemoryUsage, -(LONG64)Size);
+    InterlockedIncrement64(&ReadAhead->SkippedSpeculativeReads);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static VOID ReleaseMemory(PDOKAN_READ_AHEAD ReadAhead, ULONG64 Size) {
+  InterlockedAdd64(&ReadAhead->MemoryUsage, -(LONG64)Size);
+}
+
+static WCHAR FoldChar(PDOKAN_READ_AHEAD ReadAhead, WCHAR C) {
+  return ReadAhead->CaseSensitive ? C : towupper(C);
+}
+
+// Whether the window name is Name, or a file under it if IncludeChildren is
+// set.
+static BOOL MatchesName(PDOKAN_READ_AHEAD ReadAhead, LPCWSTR WindowName,
+                        LPCWSTR Name, size_t Length, BOOL IncludeChildren) {
+  size_t i;
+  for (i = 0; i < Length; ++i) {
+    if (!WindowName[i] ||
+        FoldChar(ReadAhead, WindowName[i]) != FoldChar(ReadAhead, Name[i])) {
+      return FALSE;
+    }
+  }
+  return WindowName[Length] == L'\0' ||
+         (IncludeChildren && WindowName[Length] == L'\\');
+}
+
+// Drops the data of the window and discards the speculative read in
+// progress. Must be called with the lock of the open held.
+static VOID DropWindowData(PDOKAN_READ_AHEAD ReadAhead,
+                           PDOKAN_READ_AHEAD_WINDOW Window) {
+  if (Window->Length || Window->EndOfFile || Window->FetchPending) {
+    InterlockedIncrement64(&ReadAhead->Invalidations);
+  }
+  ++Window->Generation;
+  Window->Length = 0;
+  Window->EndOfFile = FALSE;
+}
+
+static VOID FreeWindow(PDOKAN_READ_AHEAD ReadAhead,
+                       PDOKAN_READ_AHEAD_WINDOW Window) {
+  free(Window->FileName);
+  free(Window->Data);
+  free(Window);
+  ReleaseMemory(ReadAhead, 2 * (ULONG64)ReadAhead->Size);
+}
+
+// Creates the window of an open, unless a concurrent read did. Returns the
+// window of the open or NULL.
+static PDOKAN_READ_AHEAD_WINDOW AttachWindow(PDOKAN_READ_AHEAD ReadAhead,
+                                             PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_READ_AHEAD_WINDOW window;
+  PDOKAN_READ_AHEAD_WINDOW attached;
+  if (!ReserveMemory(ReadAhead, 2 * (ULONG64)ReadAhead->Size)) {
+    return NULL;
+  }
+  window = calloc(1, sizeof(DOKAN_READ_AHEAD_WINDOW));
+  if (window) {
+    window->Data = malloc(2 * (SIZE_T)ReadAhead->Size);
+  }
+  if (!window || !window->Data) {
+    DbgPrintW(L"Dokan Error: Read-ahead window allocation failed.\n");
+    if (window) {
+      free(window);
+    }
+    ReleaseMemory(ReadAhead, 2 * (ULONG64)ReadAhead->Size);
+    return NULL;
+  }
+  window->OpenInfo = OpenInfo;
+  // The list lock is taken before the lock of the opens.
+  AcquireSRWLockExclusive(&ReadAhead->Lock);
+  InsertTailList(&ReadAhead->Windows, &window->ListEntry);
+  ReleaseSRWLockExclusive(&ReadAhead->Lock);
+
+  EnterCriticalSection(&OpenInfo->CriticalSection);
+  attached = OpenInfo->ReadAheadWindow;
+  if (!attached) {
+    OpenInfo->ReadAheadWindow = window;
+    attached = window;
+    window = NULL;
+  }
+  LeaveCriticalSection(&OpenInfo->CriticalSection);
+
+  if (window) {
+    AcquireSRWLockExclusive(&ReadAhead->Lock);
+    RemoveEntryList(&window->ListEntry);
+    ReleaseSRWLockExclusive(&ReadAhead->Lock);
+    FreeWindow(ReadAhead, window);
+  }
+  return attached;
+}
+
+// Keeps the current name of the file, the one of the open when the kernel
+// does not send it. Must be called with the lock of the open held.
+static VOID UpdateWindowFileName(PDOKAN_READ_AHEAD_WINDOW Window,
+                                 LPCWSTR FileName) {
+  LPWSTR fileName;
+  if (!FileName[0]) {
+    FileName = Window->OpenInfo->FileName;
+  }
+  if (!FileName ||
+      (Window->FileName && wcscmp(Window->FileName, FileName) == 0)) {
+    return;
+  }
+  fileName = _wcsdup(FileName);
+  if (!fileName) {
+    return;
+  }
+  free(Window->FileName);
+  Window->FileName = fileName;
+}
+
+// Copies the range of the read from the window if it holds all of it, or up
+// to the end of the file. Must be called with the lock of the open held.
+static BOOL ReadWindow(PDOKAN_READ_AHEAD_WINDOW Window, PREAD_CONTEXT Read,
+                       PCHAR Buffer, PULONG ReadLength) {
+  LONG64 offset = Read->ByteOffset.QuadPart;
+  LONG64 end = Window->Offset + Window->Length;
+  ULONG length;
+  if (!Read->BufferLength || offset < Window->Offset || offset > end ||
+      (offset + Read->BufferLength > end && !Window->EndOfFile)) {
+    return FALSE;
+  }
+  length = (ULONG)min((LONG64)Read->BufferLength, end - offset);
+  RtlCopyMemory(Buffer, Window->Data + (offset - Window->Offset), length);
+  *ReadLength = length;
+  return TRUE;
+}
+
+// Prepares a speculative read after the data the open has not read yet,
+// unless there is enough of it. Must be called with the lock of the open
+// held.
+static PDOKAN_READ_AHEAD_FETCH StartFetch(PDOKAN_READ_AHEAD ReadAhead,
+                                          PDOKAN_IO_EVENT IoEvent,
+                                          PDOKAN_READ_AHEAD_WINDOW Window) {
+  PDOKAN_OPEN_INFO openInfo = IoEvent->DokanOpenInfo;
+  LONG64 next = openInfo->NextReadOffset;
+  LONG64 end = Window->Offset + Window->Length;
+  LONG64 offset = next;
+  ULONG eventLength = IoEvent->EventContext->Length;
+  PDOKAN_READ_AHEAD_FETCH fetch;
+
+  if (Window->FetchPending) {
+    return NULL;
+  }
+  if ((Window->Length || Window->EndOfFile) && Window->Offset <= next &&
+      next <= end) {
+    if (Window->EndOfFile || end - next >= ReadAhead->Size) {
+      return NULL;
+    }
+    offset = end;
+  }
+  if (!ReserveMemory(ReadAhead, ReadAhead->Size)) {
+    return NULL;
+  }
+  fetch = malloc(DOKAN_READ_AHEAD_ALIGN(sizeof(DOKAN_READ_AHEAD_FETCH)) +
+                 DOKAN_READ_AHEAD_ALIGN(eventLength) + ReadAhead->Size);
+  if (!fetch) {
+    DbgPrintW(L"Dokan Error: Read-ahead allocation failed.\n");
+    ReleaseMemory(ReadAhead, ReadAhead->Size);
+    return NULL;
+  }
+  ZeroMemory(fetch, sizeof(DOKAN_READ_AHEAD_FETCH));
+  fetch->EventContext =
+      (PEVENT_CONTEXT)((PCHAR)fetch +
+                       DOKAN_READ_AHEAD_ALIGN(sizeof(DOKAN_READ_AHEAD_FETCH)));
+  RtlCopyMemory(fetch->EventContext, IoEvent->EventContext, eventLength);
+  fetch->EventContext->Operation.Read.ByteOffset.QuadPart = offset;
+  fetch->EventContext->Operation.Read.BufferLength = ReadAhead->Size;
+  fetch->Data =
+      (PCHAR)fetch->EventContext + DOKAN_READ_AHEAD_ALIGN(eventLength);
+  fetch->Window = Window;
+  fetch->Generation = Window->Generation;
+  fetch->IoEvent.DokanInstance = IoEvent->DokanInstance;
+  fetch->IoEvent.DokanOpenInfo = openInfo;
+  fetch->IoEvent.EventContext = fetch->EventContext;
+  fetch->IoEvent.DokanFileInfo = IoEvent->DokanFileInfo;
+  fetch->IoEvent.DokanFileInfo.Context = openInfo->UserContext;
+  fetch->IoEvent.DokanFileInfo.DokanContext = (ULONG64)&fetch->IoEvent;
+  fetch->IoEvent.ReadAheadFetch = TRUE;
+  // Keeps the open alive until DokanReadAhead_EndFetch.
+  ++openInfo->OpenCount;
+  Window->FetchPending = TRUE;
+  InterlockedIncrement64(&ReadAhead->SpeculativeReads);
+  return fetch;
+}
+
+static VOID CALLBACK FetchCallback(PTP_CALLBACK_INSTANCE Instance,
+                                   PVOID Context) {
+  PDOKAN_READ_AHEAD_FETCH fetch = (PDOKAN_READ_AHEAD_FETCH)Context;
+  PDOKAN_IO_EVENT ioEvent = &fetch->IoEvent;
+  PREAD_CONTEXT read = &fetch->EventContext->Operation.Read;
+  ULONG readLength = 0;
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+
+  UNREFERENCED_PARAMETER(Instance);
+  if (ioEvent->DokanInstance->DokanOperations->ReadFile) {
+    status = ioEvent->DokanInstance->DokanOperations->ReadFile(
+        read->FileName, fetch->Data, read->BufferLength, &readLength,
+        read->ByteOffset.QuadPart, &ioEvent->DokanFileInfo);
+  }
+  if (status == STATUS_PENDING) {
+    // Completed by DokanEndDispatchRead
+    return;
+  }
+  DokanReadAhead_EndFetch(ioEvent, readLength, status);
+}
+
+static VOID SubmitFetch(PDOKAN_READ_AHEAD_FETCH Fetch) {
+  if (!TrySubmitThreadpoolCallback(
+          FetchCallback, Fetch,
+          &Fetch->IoEvent.DokanInstance->ThreadInfo.CallbackEnvironment)) {
+    DbgPrintW(L"Dokan Error: TrySubmitThreadpoolCallback() has returned "
+              L"error code %u.\n",
+              GetLastError());
+    DokanReadAhead_EndFetch(&Fetch->IoEvent, 0, STATUS_INSUFFICIENT_RESOURCES);
+  }
+}
+
+PDOKAN_READ_AHEAD DokanReadAhead_Alloc(ULONG Size, ULONG MaxMemory,
+                                       BOOL CaseSensitive) {
+  PDOKAN_READ_AHEAD readAhead = calloc(1, sizeof(DOKAN_READ_AHEAD));
+  if (!readAhead) {
+    return NULL;
+  }
+  InitializeSRWLock(&readAhead->Lock);
+  InitializeListHead(&readAhead->Windows);
+  readAhead->Size = Size ? min(Size, DOKAN_READ_AHEAD_MAX_SIZE)
+                         : DOKAN_READ_AHEAD_DEFAULT_SIZE;
+  readAhead->MaxMemory = MaxMemory ? MaxMemory
+                                   : DOKAN_READ_AHEAD_DEFAULT_MAX_MEMORY;
+  // An open reading ahead needs its window and a speculative read, a smaller
+  // limit would silently disable the read-ahead.
+  if (readAhead->MaxMemory < 3 * (ULONG64)readAhead->Size) {
+    ULONG size = max((ULONG)(readAhead->MaxMemory / 3) &
+                         ~(ULONG)(DOKAN_READ_AHEAD_MIN_SIZE - 1),
+                     min(readAhead->Size, DOKAN_READ_AHEAD_MIN_SIZE));
+    DbgPrintW(L"Dokan Warning: Read-ahead size %lu does not fit 3 times in "
+              L"the memory limit %llu, reduced to %lu.\n",
+              readAhead->Size, readAhead->MaxMemory, size);
+    readAhead->Size = size;
+    readAhead->MaxMemory = max(readAhead->MaxMemory, 3 * (ULONG64)size);
+  }
+  readAhead->CaseSensitive = CaseSensitive;
+  return readAhead;
+}
+
+VOID DokanReadAhead_Free(PDOKAN_READ_AHEAD ReadAhead) {
+  if (!ReadAhead) {
+    return;
+  }
+  while (!IsListEmpty(&ReadAhead->Windows)) {
+    PLIST_ENTRY entry = RemoveHeadList(&ReadAhead->Windows);
+    FreeWindow(ReadAhead,
+               CONTAINING_RECORD(entry, DOKAN_READ_AHEAD_WINDOW, ListEntry));
+  }
+  free(ReadAhead);
+}
+
+BOOL DokanReadAhead_Read(PDOKAN_READ_AHEAD ReadAhead, PDOKAN_IO_EVENT IoEvent,
+                         PULONG ReadLength) {
+  PDOKAN_OPEN_INFO openInfo = IoEvent->DokanOpenInfo;
+  PREAD_CONTEXT read = &IoEvent->EventContext->Operation.Read;
+  PDOKAN_READ_AHEAD_WINDOW window;
+  PDOKAN_READ_AHEAD_FETCH fetch = NULL;
+  BOOL sequential;
+  BOOL hit = FALSE;
+
+  EnterCriticalSection(&openInfo->CriticalSection);
+  if (read->ByteOffset.QuadPart == openInfo->NextReadOffset) {
+    if (openInfo->SequentialReadCount < DOKAN_READ_AHEAD_SEQUENTIAL_READS) {
+      ++openInfo->SequentialReadCount;
+    }
+  } else {
+    openInfo->SequentialReadCount = 0;
+  }
+  // Assumes the read returns everything, a short read ends the file.
+  openInfo->NextReadOffset = read->ByteOffset.QuadPart + read->BufferLength;
+  // Reads at least as large as the speculative ones would not be served
+  // from them.
+  sequential =
+      openInfo->SequentialReadCount >= DOKAN_READ_AHEAD_SEQUENTIAL_READS &&
+      read->BufferLength < ReadAhead->Size;
+  window = openInfo->ReadAheadWindow;
+  if (!window && sequential) {
+    LeaveCriticalSection(&openInfo->CriticalSection);
+    window = AttachWindow(ReadAhead, openInfo);
+    EnterCriticalSection(&openInfo->CriticalSection);
+  }
+  if (window) {
+    UpdateWindowFileName(window, read->FileName);
+    hit = ReadWindow(window, read, IoEvent->EventResult->Buffer, ReadLength);
+    if (sequential) {
+      fetch = StartFetch(ReadAhead, IoEvent, window);
+    }
+  }
+  LeaveCriticalSection(&openInfo->CriticalSection);
+
+  InterlockedIncrement64(hit ? &ReadAhead->Hits : &ReadAhead->Misses);
+  if (fetch) {
+    SubmitFetch(fetch);
+  }
+  return hit;
+}
+
+VOID DokanReadAhead_EndFetch(PDOKAN_IO_EVENT IoEvent, ULONG ReadLength,
+                             NTSTATUS Status) {
+  PDOKAN_READ_AHEAD_FETCH fetch =
+      CONTAINING_RECORD(IoEvent, DOKAN_READ_AHEAD_FETCH, IoEvent);
+  PDOKAN_READ_AHEAD readAhead = IoEvent->DokanInstance->ReadAhead;
+  PDOKAN_OPEN_INFO openInfo = IoEvent->DokanOpenInfo;
+  PDOKAN_READ_AHEAD_WINDOW window = fetch->Window;
+  LONG64 offset = fetch->EventContext->Operation.Read.ByteOffset.QuadPart;
+  ULONG size = fetch->EventContext->Operation.Read.BufferLength;
+  ULONG capacity = 2 * readAhead->Size;
+  BOOL success = Status == STATUS_SUCCESS || Status == STATUS_END_OF_FILE;
+
+  assert(IoEvent->ReadAheadFetch);
+  ReadLength = Status == STATUS_SUCCESS ? min(ReadLength, size) : 0;
+  InterlockedAdd64(&readAhead->SpeculativeReadBytes, ReadLength);
+
+  EnterCriticalSection(&openInfo->CriticalSection);
+  window->FetchPending = FALSE;
+  if (success && fetch->Generation == window->Generation) {
+    LONG64 next = openInfo->NextReadOffset;
+    LONG64 end = window->Offset + window->Length;
+    ULONG copyLength;
+    if (offset == end && window->Offset <= next && next <= end) {
+      // Drop the data already read to make room.
+      ULONG consumed = (ULONG)(next - window->Offset);
+      MoveMemory(window->Data, window->Data + consumed,
+                 window->Length - consumed);
+      window->Offset = next;
+      window->Length -= consumed;
+    } else {
+      window->Offset = offset;
+      window->Length = 0;
+    }
+    copyLength = min(ReadLength, capacity - window->Length);
+    RtlCopyMemory(window->Data + window->Length, fetch->Data, copyLength);
+    window->Length += copyLength;
+    window->EndOfFile = copyLength == ReadLength && ReadLength < size;
+  }
+  LeaveCriticalSection(&openInfo->CriticalSection);
+
+  ReleaseMemory(readAhead, size);
+  // Closes the file and releases the window if the open was closed meanwhile.
+  ReleaseDokanOpenInfo(IoEvent);
+  free(fetch);
+}
+
+VOID DokanReadAhead_Invalidate(PDOKAN_READ_AHEAD ReadAhead, LPCWSTR FileName,
+                               size_t Length, BOOL IncludeChildren) {
+  PLIST_ENTRY entry;
+  BOOL all;
+  while (Length > 1 && FileName[Length - 1] == L'\\') {
+    --Length;
+  }
+  all = IncludeChildren && Length == 1 && FileName[0] == L'\\';
+  AcquireSRWLockShared(&ReadAhead->Lock);
+  for (entry = ReadAhead->Windows.Flink; entry != &ReadAhead->Windows;
+       entry = entry->Flink) {
+    PDOKAN_READ_AHEAD_WINDOW window =
+        CONTAINING_RECORD(entry, DOKAN_READ_AHEAD_WINDOW, ListEntry);
+    EnterCriticalSection(&window->OpenInfo->CriticalSection);
+    if (window->FileName &&
+        (all || MatchesName(ReadAhead, window->FileName, FileName, Length,
+                            IncludeChildren))) {
+      DropWindowData(ReadAhead, window);
+    }
+    LeaveCriticalSection(&window->OpenInfo->CriticalSection);
+  }
+  ReleaseSRWLockShared(&ReadAhead->Lock);
+}
+
+VOID DokanReadAhead_InvalidateEventFile(PDOKAN_READ_AHEAD ReadAhead,
+                                        PDOKAN_IO_EVENT IoEvent,
+                                        LPCWSTR FileName) {
+  PDOKAN_OPEN_INFO openInfo = IoEvent->DokanOpenInfo;
+  LPWSTR openFileName = NULL;
+  if (!ReadAhead) {
+    return;
+  }
+  if (openInfo) {
+    EnterCriticalSection(&openInfo->CriticalSection);
+    if (openInfo->ReadAheadWindow) {
+      DropWindowData(ReadAhead, openInfo->ReadAheadWindow);
+    }
+    if (!FileName[0] && openInfo->FileName) {
+      openFileName = _wcsdup(openInfo->FileName);
+    }
+    LeaveCriticalSection(&openInfo->CriticalSection);
+  }
+  if (FileName[0]) {
+    DokanReadAhead_Invalidate(ReadAhead, FileName, wcslen(FileName),
+                              /*IncludeChildren=*/FALSE);
+  } else if (openFileName) {
+    DokanReadAhead_Invalidate(ReadAhead, openFileName, wcslen(openFileName),
+                              /*IncludeChildren=*/FALSE);
+    free(openFileName);
+  }
+}
+
+VOID DokanReadAhead_ReleaseOpen(PDOKAN_READ_AHEAD ReadAhead,
+                                PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_READ_AHEAD_WINDOW window = OpenInfo->ReadAheadWindow;
+  if (!ReadAhead || !window) {
+    return;
+  }
+  // Nothing else references the open anymore.
+  assert(!window->FetchPending);
+  OpenInfo->ReadAheadWindow = NULL;
+  AcquireSRWLockExclusive(&ReadAhead->Lock);
+  RemoveEntryList(&window->ListEntry);
+  ReleaseSRWLockExclusive(&ReadAhead->Lock);
+  FreeWindow(ReadAhead, window);
+}
+
+VOID DokanReadAhead_GetStatistics(PDOKAN_READ_AHEAD ReadAhead,
+                                  PDOKAN_READ_AHEAD_STATISTICS Statistics) {
+  Statistics->Hits = ReadAhead->Hits;
+  Statistics->Misses = ReadAhead->Misses;
+  Statistics->SpeculativeReads = ReadAhead->SpeculativeReads;
+  Statistics->SpeculativeReadBytes = ReadAhead->SpeculativeReadBytes;
+  Statistics->SkippedSpeculativeReads = ReadAhead->SkippedSpeculativeReads;
+  Statistics->Invalidations = ReadAhead->Invalidations;
+  Statistics->MemoryUsage = ReadAhead->MemoryUsage;
+}
@@ -0,0 +1,133 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_READ_AHEAD_H_
+#define DOKAN_READ_AHEAD_H_
+
+#include "dokani.h"
+
+// Default size of the speculative reads.
+#define DOKAN_READ_AHEAD_DEFAULT_SIZE (1024 * 1024)
+
+// Smallest size of the speculative reads, and their alignment when the
+// memory limit reduces them.
+#define DOKAN_READ_AHEAD_MIN_SIZE (64 * 1024)
+
+// Largest size of the speculative reads.
+#define DOKAN_READ_AHEAD_MAX_SIZE (64 * 1024 * 1024)
+
+// Default memory limit of the read-ahead of a mount.
+#define DOKAN_READ_AHEAD_DEFAULT_MAX_MEMORY (64 * 1024 * 1024)
+
+// Number of consecutive sequential reads of an open before reading ahead.
+#define DOKAN_READ_AHEAD_SEQUENTIAL_READS 2
+
+// Data read ahead for an open. Protected by the CriticalSection of the open.
+typedef struct _DOKAN_READ_AHEAD_WINDOW {
+  // Entry in DOKAN_READ_AHEAD.Windows.
+  LIST_ENTRY ListEntry;
+  PDOKAN_OPEN_INFO OpenInfo;
+  // Name of the file at the last read, matched by the invalidations.
+  LPWSTR FileName;
+  // Holds up to 2 speculative reads.
+  PCHAR Data;
+  // The window holds the bytes of the file at [Offset, Offset + Length).
+  LONG64 Offset;
+  ULONG Length;
+  // Whether the file ends at Offset + Length.
+  BOOL EndOfFile;
+  // Whether a speculative read is in progress.
+  BOOL FetchPending;
+  // Incremented when the data is dropped, a speculative read started before
+  // is discarded.
+  ULONG Generation;
+} DOKAN_READ_AHEAD_WINDOW, *PDOKAN_READ_AHEAD_WINDOW;
+
+// Speculative read in progress. The IoEvent holds a reference on the open.
+typedef struct _DOKAN_READ_AHEAD_FETCH {
+  DOKAN_IO_EVENT IoEvent;
+  PDOKAN_READ_AHEAD_WINDOW Window;
+  // DOKAN_READ_AHEAD_WINDOW.Generation when the read started.
+  ULONG Generation;
+  // Copy of the read event triggering the speculative read, with its range.
+  PEVENT_CONTEXT EventContext;
+  // Buffer of the read, of DOKAN_READ_AHEAD.Size bytes.
+  PCHAR Data;
+} DOKAN_READ_AHEAD_FETCH, *PDOKAN_READ_AHEAD_FETCH;
+
+// Read-ahead of a mount instance, see DOKAN_OPTION_READ_AHEAD.
+typedef struct _DOKAN_READ_AHEAD {
+  // Protects Windows. Taken before the CriticalSection of the opens.
+  SRWLOCK Lock;
+  LIST_ENTRY Windows;
+  // Size of the speculative reads.
+  ULONG Size;
+  ULONG64 MaxMemory;
+  BOOL CaseSensitive;
+  volatile LONG64 MemoryUsage;
+  volatile LONG64 Hits;
+  volatile LONG64 Misses;
+  volatile LONG64 SpeculativeReads;
+  volatile LONG64 SpeculativeReadBytes;
+  volatile LONG64 SkippedSpeculativeReads;
+  volatile LONG64 Invalidations;
+} DOKAN_READ_AHEAD, *PDOKAN_READ_AHEAD;
+
+// Creates the read-ahead of a mount. A Size or MaxMemory of 0 selects the
+// default. Size is reduced when MaxMemory cannot hold the 3 times Size an
+// open reading ahead uses.
+PDOKAN_READ_AHEAD DokanReadAhead_Alloc(ULONG Size, ULONG MaxMemory,
+                                       BOOL CaseSensitive);
+
+// Releases the read-ahead and the windows of the opens still alive.
+VOID DokanReadAhead_Free(PDOKAN_READ_AHEAD ReadAhead);
+
+// Records the read of the event in the history of its open and starts
+// reading ahead when it is sequential. Returns TRUE and sets ReadLength when
+// the read was answered in the result of the event from the data read ahead,
+// the file system is not called then.
+BOOL DokanReadAhead_Read(PDOKAN_READ_AHEAD ReadAhead, PDOKAN_IO_EVENT IoEvent,
+                         PULONG ReadLength);
+
+// Called once the ReadFile callback of a speculative read returned or ended
+// with DokanEndDispatchRead. Releases the event.
+VOID DokanReadAhead_EndFetch(PDOKAN_IO_EVENT IoEvent, ULONG ReadLength,
+                             NTSTATUS Status);
+
+// Drops the data read ahead for a file by all the opens, and for the files
+// under it if IncludeChildren is set.
+VOID DokanReadAhead_Invalidate(PDOKAN_READ_AHEAD ReadAhead, LPCWSTR FileName,
+                               size_t Length, BOOL IncludeChildren);
+
+// Drops the data read ahead for the file of the event. FileName is the name
+// sent with the event, the one of the open is used when it is empty.
+VOID DokanReadAhead_InvalidateEventFile(PDOKAN_READ_AHEAD ReadAhead,
+                                        PDOKAN_IO_EVENT IoEvent,
+                                        LPCWSTR FileName);
+
+// Releases the window of an open that is about to be freed.
+VOID DokanReadAhead_ReleaseOpen(PDOKAN_READ_AHEAD ReadAhead,
+                                PDOKAN_OPEN_INFO OpenInfo);
+
+VOID DokanReadAhead_GetStatistics(PDOKAN_READ_AHEAD ReadAhead,
+                                  PDOKAN_READ_AHEAD_STATISTICS Statistics);
+
+#endif
@@ -0,0 +1,171 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokan_reply.h"
+
+#include <assert.h>
+
+PDOKAN_REPLY_AGGREGATOR DokanReplyAggregator_Alloc() {
+  PDOKAN_REPLY_AGGREGATOR aggregator = malloc(sizeof(DOKAN_REPLY_AGGREGATOR));
+  if (!aggregator) {
+    DokanDbgPrintW(L"Dokan Error: Failed to allocate reply aggregator.\n");
+    return NULL;
+  }
+  ZeroMemory(aggregator, sizeof(DOKAN_REPLY_AGGREGATOR));
+  InitializeCriticalSection(&aggregator->CriticalSection);
+  InitializeConditionVariable(&aggregator->WindowClosed);
+  return aggregator;
+}
+
+VOID DokanReplyAggregator_Free(PDOKAN_REPLY_AGGREGATOR Aggregator) {
+  if (!Aggregator) {
+    return;
+  }
+  assert(!Aggregator->Collecting);
+  DbgPrint("Dokan Information: %lld replies sent with %lld ioctls, %lld "
+           "aggregated, at most %d per ioctl\n",
+           Aggregator->RepliesSent, Aggregator->Ioctls,
+           Aggregator->AggregatedIoctls, Aggregator->MaxRepliesPerIoctl);
+  DeleteCriticalSection(&Aggregator->CriticalSection);
+  free(Aggregator);
+}
+
+VOID DokanReplyAggregator_BeginDispatch(PDOKAN_REPLY_AGGREGATOR Aggregator) {
+  InterlockedIncrement(&Aggregator->DispatchingCount);
+}
+
+VOID DokanReplyAggregator_EndDispatch(PDOKAN_REPLY_AGGREGATOR Aggregator) {
+  if (InterlockedDecrement(&Aggregator->DispatchingCount) == 0 &&
+      Aggregator->Collecting) {
+    // Taking the lock orders the wake after the check of the leader.
+    EnterCriticalSection(&Aggregator->CriticalSection);
+    WakeConditionVariable(&Aggregator->WindowClosed);
+    LeaveCriticalSection(&Aggregator->CriticalSection);
+  }
+}
+
+static BOOL IsWindowOpen(PDOKAN_REPLY_AGGREGATOR Aggregator) {
+  return Aggregator->DispatchingCount > 0 &&
+         Aggregator->ReplyCount < DOKAN_REPLY_AGGREGATION_MAX_REPLIES - 1;
+}
+
+// Waits for the other replies of the window, with the critical section held.
+// The leader is no longer counted as dispatching so the wait ends as soon as
+// no other reply can come.
+static VOID WaitForReplies(PDOKAN_REPLY_AGGREGATOR Aggregator) {
+  ULONG64 deadline = GetTickCount64() + DOKAN_REPLY_AGGREGATION_WINDOW_MS;
+  while (IsWindowOpen(Aggregator)) {
+    ULONG64 now = GetTickCount64();
+    if (now >= deadline ||
+        !SleepConditionVariableCS(&Aggregator->WindowClosed,
+                                  &Aggregator->CriticalSection,
+                                  (DWORD)(deadline - now))) {
+      break;
+    }
+  }
+}
+
+ULONG DokanReplyAggregator_Collect(
+    PDOKAN_REPLY_AGGREGATOR Aggregator, PDOKAN_IO_EVENT IoEvent,
+    ULONG EventInfoSize, BOOL MainPullThread,
+    PDOKAN_IO_EVENT Replies[DOKAN_REPLY_AGGREGATION_MAX_REPLIES]) {
+  BOOL leader = FALSE;
+  BOOL handedOff = FALSE;
+  ULONG replyCount = 1;
+
+  Replies[0] = IoEvent;
+  // The driver stops reading a batch at a buffer overflow reply as the size
+  // of those cannot be known.
+  if (IoEvent->EventResult->Status == STATUS_BUFFER_OVERFLOW ||
+      EventInfoSize > DOKAN_REPLY_AGGREGATION_MAX_REPLY_SIZE) {
+    return 1;
+  }
+
+  EnterCriticalSection(&Aggregator->CriticalSection);
+  {
+    if (!Aggregator->Collecting) {
+      Aggregator->Collecting = TRUE;
+      leader = TRUE;
+    } else if (!MainPullThread && Aggregator->ReplyCount <
+                                      DOKAN_REPLY_AGGREGATION_MAX_REPLIES - 1) {
+      Aggregator->Replies[Aggregator->ReplyCount] = IoEvent;
+      InterlockedIncrement(&Aggregator->ReplyCount);
+      handedOff = TRUE;
+      if (!IsWindowOpen(Aggregator)) {
+        WakeConditionVariable(&Aggregator->WindowClosed);
+      }
+    }
+  }
+  if (!leader) {
+    LeaveCriticalSection(&Aggregator->CriticalSection);
+    return handedOff ? 0 : 1;
+  }
+
+  WaitForReplies(Aggregator);
+  {
+    for (LONG i = 0; i < Aggregator->ReplyCount; ++i) {
+      Replies[replyCount++] = Aggregator->Replies[i];
+    }
+    Aggregator->ReplyCount = 0;
+    Aggregator->Collecting = FALSE;
+  }
+  LeaveCriticalSection(&Aggregator->CriticalSection);
+
+  // The driver expects the replies sorted by serial number.
+  for (ULONG i = 1; i < replyCount; ++i) {
+    PDOKAN_IO_EVENT reply = Replies[i];
+    ULONG j = i;
+    while (j > 0 && Replies[j - 1]->EventResult->SerialNumber >
+                        reply->EventResult->SerialNumber) {
+      Replies[j] = Replies[j - 1];
+      --j;
+    }
+    Replies[j] = reply;
+  }
+  return replyCount;
+}
+
+VOID DokanReplyAggregator_RecordIoctl(PDOKAN_REPLY_AGGREGATOR Aggregator,
+                                      ULONG ReplyCount) {
+  LONG maxReplies;
+  InterlockedIncrement64(&Aggregator->Ioctls);
+  InterlockedAdd64(&Aggregator->RepliesSent, ReplyCount);
+  if (ReplyCount <= 1) {
+    return;
+  }
+  InterlockedIncrement64(&Aggregator->AggregatedIoctls);
+  maxReplies = Aggregator->MaxRepliesPerIoctl;
+  while ((LONG)ReplyCount > maxReplies) {
+    LONG previous = InterlockedCompareExchange(
+        &Aggregator->MaxRepliesPerIoctl, (LONG)ReplyCount, maxReplies);
+    if (previous == maxReplies) {
+      break;
+    }
+    maxReplies = previous;
+  }
+}
+
+VOID DokanReplyAggregator_GetStatistics(PDOKAN_REPLY_AGGREGATOR Aggregator,
+                                        PDOKAN_REPLY_STATISTICS Statistics) {
+  Statistics->Ioctls = Aggregator->Ioctls;
+  Statistics->Replies = Aggregator->RepliesSent;
+  Statistics->AggregatedIoctls = Aggregator->AggregatedIoctls;
+  Statistics->MaxRepliesPerIoctl = Aggregator->MaxRepliesPerIoctl;
+}
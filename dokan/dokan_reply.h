@@ -0,0 +1,99 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_REPLY_H_
+#define DOKAN_REPLY_H_
+
+#include "dokani.h"
+
+// Largest number of replies sent to the driver with a single ioctl.
+#define DOKAN_REPLY_AGGREGATION_MAX_REPLIES 32
+
+// Replies larger than this, like most reads, are always sent alone.
+#define DOKAN_REPLY_AGGREGATION_MAX_REPLY_SIZE 4096
+
+// Longest time in milliseconds a reply waits for others to be sent with. The
+// wait usually ends much earlier, as soon as no other event is dispatched.
+#define DOKAN_REPLY_AGGREGATION_WINDOW_MS 1
+
+/**
+ * \struct DOKAN_REPLY_STATISTICS
+ * \brief Counters of the replies sent to the driver
+ */
+typedef struct _DOKAN_REPLY_STATISTICS {
+  /** Ioctls that carried at least one reply */
+  ULONG64 Ioctls;
+  /** Replies sent */
+  ULONG64 Replies;
+  /** Ioctls that carried more than one reply */
+  ULONG64 AggregatedIoctls;
+  /** Most replies sent with a single ioctl */
+  ULONG MaxRepliesPerIoctl;
+} DOKAN_REPLY_STATISTICS, *PDOKAN_REPLY_STATISTICS;
+
+// Merges the replies of worker threads finishing at nearly the same time so
+// they reach the driver with a single FSCTL_EVENT_PROCESS_N_PULL.
+// The first thread with a reply opens a window and becomes the leader. The
+// threads finishing during the window hand their reply to it and stop. The
+// leader sleeps until no other event is being dispatched, the window elapsed
+// or it is full, and sends every reply sorted by serial number.
+typedef struct _DOKAN_REPLY_AGGREGATOR {
+  CRITICAL_SECTION CriticalSection;
+  // Wakes the leader when the last dispatch ends or the window is full.
+  CONDITION_VARIABLE WindowClosed;
+  // Whether a leader is collecting replies.
+  volatile BOOL Collecting;
+  // Replies handed to the leader.
+  PDOKAN_IO_EVENT Replies[DOKAN_REPLY_AGGREGATION_MAX_REPLIES - 1];
+  volatile LONG ReplyCount;
+  // Events currently being dispatched that could still join the window.
+  volatile LONG DispatchingCount;
+  volatile LONG64 Ioctls;
+  volatile LONG64 RepliesSent;
+  volatile LONG64 AggregatedIoctls;
+  volatile LONG MaxRepliesPerIoctl;
+} DOKAN_REPLY_AGGREGATOR, *PDOKAN_REPLY_AGGREGATOR;
+
+PDOKAN_REPLY_AGGREGATOR DokanReplyAggregator_Alloc();
+
+VOID DokanReplyAggregator_Free(PDOKAN_REPLY_AGGREGATOR Aggregator);
+
+// Brackets the dispatch of an event whose reply could join the window, from
+// the time it is queued.
+VOID DokanReplyAggregator_BeginDispatch(PDOKAN_REPLY_AGGREGATOR Aggregator);
+VOID DokanReplyAggregator_EndDispatch(PDOKAN_REPLY_AGGREGATOR Aggregator);
+
+// Submits the reply of IoEvent. Returns 0 when the reply was handed to
+// another thread that will send it. Otherwise the caller is the one sending
+// the returned number of replies stored in Replies, sorted by serial number
+// and including its own. Main pull threads never hand their reply off.
+ULONG DokanReplyAggregator_Collect(
+    PDOKAN_REPLY_AGGREGATOR Aggregator, PDOKAN_IO_EVENT IoEvent,
+    ULONG EventInfoSize, BOOL MainPullThread,
+    PDOKAN_IO_EVENT Replies[DOKAN_REPLY_AGGREGATION_MAX_REPLIES]);
+
+// Counts an ioctl sent with ReplyCount replies.
+VOID DokanReplyAggregator_RecordIoctl(PDOKAN_REPLY_AGGREGATOR Aggregator,
+                                      ULONG ReplyCount);
+
+VOID DokanReplyAggregator_GetStatistics(PDOKAN_REPLY_AGGREGATOR Aggregator,
+                                        PDOKAN_REPLY_STATISTICS Statistics);
+
+#endif
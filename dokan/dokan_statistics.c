@@ -0,0 +1,262 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokan_statistics.h"
+
+#include <intrin.h>
+
+// Number of buckets per power of two, above the first ones.
+#define DOKAN_LATENCY_SUB_BUCKET_BITS 2
+#define DOKAN_LATENCY_SUB_BUCKET_COUNT (1 << DOKAN_LATENCY_SUB_BUCKET_BITS)
+
+// The statistics are merged and reset counter by counter.
+C_ASSERT(sizeof(DOKAN_STATISTICS) % sizeof(ULONG64) == 0);
+#define DOKAN_STATISTICS_COUNTER_COUNT                                         \
+  (sizeof(DOKAN_STATISTICS) / sizeof(ULONG64))
+
+static ULONG GetLatencyBucket(ULONG64 Microseconds) {
+  unsigned long msb;
+  if (Microseconds < DOKAN_LATENCY_SUB_BUCKET_COUNT) {
+    return (ULONG)Microseconds;
+  }
+  if (Microseconds > MAXULONG) {
+    return DOKAN_LATENCY_HISTOGRAM_BUCKET_COUNT - 1;
+  }
+  _BitScanReverse(&msb, (unsigned long)Microseconds);
+  return min(DOKAN_LATENCY_HISTOGRAM_BUCKET_COUNT - 1,
+             (msb - DOKAN_LATENCY_SUB_BUCKET_BITS + 1) *
+                     DOKAN_LATENCY_SUB_BUCKET_COUNT +
+                 (ULONG)((Microseconds >> (msb - DOKAN_LATENCY_SUB_BUCKET_BITS)) &
+                         (DOKAN_LATENCY_SUB_BUCKET_COUNT - 1)));
+}
+
+// Smallest duration counted by Bucket.
+static ULONG64 GetLatencyBucketLowerBound(ULONG Bucket) {
+  if (Bucket < DOKAN_LATENCY_SUB_BUCKET_COUNT) {
+    return Bucket;
+  }
+  return (ULONG64)(DOKAN_LATENCY_SUB_BUCKET_COUNT +
+                   Bucket % DOKAN_LATENCY_SUB_BUCKET_COUNT)
+         << (Bucket / DOKAN_LATENCY_SUB_BUCKET_COUNT - 1);
+}
+
+static VOID AddStatistics(PDOKAN_STATISTICS Total,
+                          const volatile DOKAN_STATISTICS *Statistics) {
+  ULONG64 *totalCounters = (ULONG64 *)Total;
+  const volatile ULONG64 *counters = (const volatile ULONG64 *)Statistics;
+  for (size_t i = 0; i < DOKAN_STATISTICS_COUNTER_COUNT; ++i) {
+    totalCounters[i] += counters[i];
+  }
+}
+
+// Folds the shard of an exiting thread into the retired counters. Also called
+// for every thread still owning a shard when the slot is freed.
+static VOID WINAPI ReleaseThreadShard(PVOID Data) {
+  PDOKAN_STATISTICS_SHARD shard = (PDOKAN_STATISTICS_SHARD)Data;
+  PDOKAN_STATISTICS_COLLECTOR collector;
+  if (!shard) {
+    return;
+  }
+  collector = shard->Collector;
+  AcquireSRWLockExclusive(&collector->Lock);
+  AddStatistics(&collector->Retired, &shard->Statistics);
+  RemoveEntryList(&shard->ListEntry);
+  ReleaseSRWLockExclusive(&collector->Lock);
+  free(shard);
+}
+
+PDOKAN_STATISTICS_COLLECTOR DokanStatistics_Alloc() {
+  LARGE_INTEGER frequency;
+  PDOKAN_STATISTICS_COLLECTOR collector =
+      malloc(sizeof(DOKAN_STATISTICS_COLLECTOR));
+  if (!collector) {
+    DokanDbgPrintW(L"Dokan Error: Failed to allocate statistics collector.\n");
+    return NULL;
+  }
+  ZeroMemory(collector, sizeof(DOKAN_STATISTICS_COLLECTOR));
+  collector->FlsIndex = FlsAlloc(ReleaseThreadShard);
+  if (collector->FlsIndex == FLS_OUT_OF_INDEXES) {
+    DokanDbgPrintW(L"Dokan Error: FlsAlloc() has returned error code %u.\n",
+                   GetLastError());
+    free(collector);
+    return NULL;
+  }
+  QueryPerformanceFrequency(&frequency);
+  collector->Frequency = frequency.QuadPart;
+  InitializeSRWLock(&collector->Lock);
+  InitializeListHead(&collector->Shards);
+  return collector;
+}
+
+VOID DokanStatistics_Free(PDOKAN_STATISTICS_COLLECTOR Collector) {
+  if (!Collector) {
+    return;
+  }
+  // Freeing the slot releases the shards of the threads still running.
+  // Release whatever would remain afterwards.
+  FlsFree(Collector->FlsIndex);
+  while (!IsListEmpty(&Collector->Shards)) {
+    PLIST_ENTRY entry = RemoveHeadList(&Collector->Shards);
+    free(CONTAINING_RECORD(entry, DOKAN_STATISTICS_SHARD, ListEntry));
+  }
+  free(Collector->Baseline);
+  free(Collector);
+}
+
+LONG64 DokanStatistics_Now() {
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return counter.QuadPart;
+}
+
+static PDOKAN_STATISTICS_SHARD
+GetThreadShard(PDOKAN_STATISTICS_COLLECTOR Collector) {
+  PDOKAN_STATISTICS_SHARD shard = FlsGetValue(Collector->FlsIndex);
+  if (shard) {
+    return shard;
+  }
+  shard = calloc(1, sizeof(DOKAN_STATISTICS_SHARD));
+  if (!shard) {
+    return NULL;
+  }
+  shard->Collector = Collector;
+  AcquireSRWLockExclusive(&Collector->Lock);
+  InsertTailList(&Collector->Shards, &shard->ListEntry);
+  ReleaseSRWLockExclusive(&Collector->Lock);
+  if (!FlsSetValue(Collector->FlsIndex, shard)) {
+    ReleaseThreadShard(shard);
+    return NULL;
+  }
+  return shard;
+}
+
+static VOID RecordLatency(PDOKAN_STATISTICS_COLLECTOR Collector,
+                          PDOKAN_LATENCY_HISTOGRAM Histogram, LONG64 Start,
+                          LONG64 End) {
+  ULONG64 microseconds =
+      End > Start ? (ULONG64)(End - Start) * 1000000 / Collector->Frequency
+                  : 0;
+  // Only this thread writes its shard, readers tolerate a stale value.
+  ++Histogram->Count;
+  Histogram->TotalMicroseconds += microseconds;
+  ++Histogram->Buckets[GetLatencyBucket(microseconds)];
+}
+
+VOID DokanStatistics_RecordDispatch(PDOKAN_STATISTICS_COLLECTOR Collector,
+                                    ULONG MajorFunction, LONG64 PullTime,
+                                    LONG64 DispatchStart, LONG64 DispatchEnd,
+                                    BOOL Pending) {
+  PDOKAN_STATISTICS_SHARD shard;
+  PDOKAN_OPERATION_STATISTICS operation;
+  if (!Collector || MajorFunction >= DOKAN_STATISTICS_OPERATION_COUNT) {
+    return;
+  }
+  shard = GetThreadShard(Collector);
+  if (!shard) {
+    return;
+  }
+  operation = &shard->Statistics.Operations[MajorFunction];
+  if (PullTime) {
+    RecordLatency(Collector, &operation->QueueTime, PullTime, DispatchStart);
+  }
+  RecordLatency(Collector, &operation->CallbackTime, DispatchStart,
+                DispatchEnd);
+  if (Pending) {
+    ++operation->PendingEvents;
+  } else if (PullTime) {
+    RecordLatency(Collector, &operation->TotalTime, PullTime, DispatchEnd);
+  }
+}
+
+VOID DokanStatistics_RecordCompletion(PDOKAN_STATISTICS_COLLECTOR Collector,
+                                      ULONG MajorFunction, LONG64 PullTime,
+                                      LONG64 CompletionTime) {
+  PDOKAN_STATISTICS_SHARD shard;
+  if (!Collector || MajorFunction >= DOKAN_STATISTICS_OPERATION_COUNT ||
+      !PullTime) {
+    return;
+  }
+  shard = GetThreadShard(Collector);
+  if (!shard) {
+    return;
+  }
+  RecordLatency(Collector,
+                &shard->Statistics.Operations[MajorFunction].TotalTime,
+                PullTime, CompletionTime);
+}
+
+BOOL DokanStatistics_Get(PDOKAN_STATISTICS_COLLECTOR Collector,
+                         PDOKAN_STATISTICS Statistics, BOOL Reset) {
+  PDOKAN_STATISTICS merged = calloc(1, sizeof(DOKAN_STATISTICS));
+  ULONG64 *counters = (ULONG64 *)merged;
+  PLIST_ENTRY entry;
+  ULONG64 *output = (ULONG64 *)Statistics;
+  ULONG64 *baseline;
+
+  if (!merged) {
+    DokanDbgPrintW(L"Dokan Error: Failed to allocate statistics.\n");
+    return FALSE;
+  }
+  AcquireSRWLockExclusive(&Collector->Lock);
+  AddStatistics(merged, &Collector->Retired);
+  for (entry = Collector->Shards.Flink; entry != &Collector->Shards;
+       entry = entry->Flink) {
+    AddStatistics(merged, &CONTAINING_RECORD(entry, DOKAN_STATISTICS_SHARD,
+                                             ListEntry)
+                               ->Statistics);
+  }
+  baseline = (ULONG64 *)Collector->Baseline;
+  if (output) {
+    for (size_t i = 0; i < DOKAN_STATISTICS_COUNTER_COUNT; ++i) {
+      output[i] = baseline ? counters[i] - baseline[i] : counters[i];
+    }
+  }
+  if (Reset) {
+    free(Collector->Baseline);
+    Collector->Baseline = merged;
+    merged = NULL;
+  }
+  ReleaseSRWLockExclusive(&Collector->Lock);
+  free(merged);
+  return TRUE;
+}
+
+ULONG64 DOKANAPI
+DokanGetLatencyPercentile(_In_ const DOKAN_LATENCY_HISTOGRAM *Histogram,
+                          _In_ double Percentile) {
+  ULONG64 count = 0;
+  ULONG64 rank;
+  ULONG64 seen = 0;
+  for (ULONG i = 0; i < DOKAN_LATENCY_HISTOGRAM_BUCKET_COUNT; ++i) {
+    count += Histogram->Buckets[i];
+  }
+  if (!count) {
+    return 0;
+  }
+  Percentile = max(0.0, min(100.0, Percentile));
+  rank = max(1, (ULONG64)(count * Percentile / 100.0 + 0.5));
+  for (ULONG i = 0; i < DOKAN_LATENCY_HISTOGRAM_BUCKET_COUNT; ++i) {
+    seen += Histogram->Buckets[i];
+    if (seen >= rank) {
+      return GetLatencyBucketLowerBound(i + 1) - 1;
+    }
+  }
+  return GetLatencyBucketLowerBound(DOKAN_LATENCY_HISTOGRAM_BUCKET_COUNT) - 1;
+}
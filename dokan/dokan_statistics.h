@@ -0,0 +1,81 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_STATISTICS_H_
+#define DOKAN_STATISTICS_H_
+
+#include "dokani.h"
+
+typedef struct _DOKAN_STATISTICS_COLLECTOR DOKAN_STATISTICS_COLLECTOR,
+    *PDOKAN_STATISTICS_COLLECTOR;
+
+// Counters of a single thread, only written by it and merged when read.
+typedef struct _DOKAN_STATISTICS_SHARD {
+  LIST_ENTRY ListEntry;
+  PDOKAN_STATISTICS_COLLECTOR Collector;
+  DOKAN_STATISTICS Statistics;
+} DOKAN_STATISTICS_SHARD, *PDOKAN_STATISTICS_SHARD;
+
+// Records the latencies of the events dispatched by a mount, see
+// DokanGetStatistics.
+// Each thread recording a latency gets its own shard, found through an FLS
+// slot, so that recording does not need any lock nor interlocked operation.
+// The shard of an exiting thread is folded into Retired and freed.
+// Resetting does not touch the shards: the merged counters at the time of the
+// reset are kept as a baseline that is subtracted from the next reads.
+struct _DOKAN_STATISTICS_COLLECTOR {
+  DWORD FlsIndex;
+  // Performance counter ticks per second.
+  LONG64 Frequency;
+  // Protects Shards, Retired and Baseline.
+  SRWLOCK Lock;
+  LIST_ENTRY Shards;
+  // Counters of the threads that exited.
+  DOKAN_STATISTICS Retired;
+  // Merged counters at the last reset, NULL until the first one.
+  PDOKAN_STATISTICS Baseline;
+};
+
+PDOKAN_STATISTICS_COLLECTOR DokanStatistics_Alloc();
+
+VOID DokanStatistics_Free(PDOKAN_STATISTICS_COLLECTOR Collector);
+
+// Returns the current performance counter, the time unit of the other
+// functions.
+LONG64 DokanStatistics_Now();
+
+// Records the dispatch of an event pulled at PullTime. The total time of
+// pending events is recorded on completion instead.
+VOID DokanStatistics_RecordDispatch(PDOKAN_STATISTICS_COLLECTOR Collector,
+                                    ULONG MajorFunction, LONG64 PullTime,
+                                    LONG64 DispatchStart, LONG64 DispatchEnd,
+                                    BOOL Pending);
+
+// Records the completion of a pending event pulled at PullTime.
+VOID DokanStatistics_RecordCompletion(PDOKAN_STATISTICS_COLLECTOR Collector,
+                                      ULONG MajorFunction, LONG64 PullTime,
+                                      LONG64 CompletionTime);
+
+// Merges the counters of the shards recorded since the last reset into
+// Statistics, if not NULL. Returns FALSE if the merge could not be allocated.
+BOOL DokanStatistics_Get(PDOKAN_STATISTICS_COLLECTOR Collector,
+                         PDOKAN_STATISTICS Statistics, BOOL Reset);
+
+#endif
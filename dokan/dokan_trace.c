@@ -0,0 +1,233 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokan_trace.h"
+#include "fileinfo.h"
+
+#define DOKAN_TRACE_TICKS_PER_MILLISECOND 10000
+#define DOKAN_TRACE_MILLISECONDS_PER_DAY (24 * 60 * 60 * 1000)
+
+typedef struct _DOKAN_TRACE_NAME {
+  ULONG Value;
+  const char *Name;
+} DOKAN_TRACE_NAME;
+
+static const char *MajorFunctionNames[IRP_MJ_MAXIMUM_FUNCTION + 1] = {
+    "IRP_MJ_CREATE",
+    "IRP_MJ_CREATE_NAMED_PIPE",
+    "IRP_MJ_CLOSE",
+    "IRP_MJ_READ",
+    "IRP_MJ_WRITE",
+    "IRP_MJ_QUERY_INFORMATION",
+    "IRP_MJ_SET_INFORMATION",
+    "IRP_MJ_QUERY_EA",
+    "IRP_MJ_SET_EA",
+    "IRP_MJ_FLUSH_BUFFERS",
+    "IRP_MJ_QUERY_VOLUME_INFORMATION",
+    "IRP_MJ_SET_VOLUME_INFORMATION",
+    "IRP_MJ_DIRECTORY_CONTROL",
+    "IRP_MJ_FILE_SYSTEM_CONTROL",
+    "IRP_MJ_DEVICE_CONTROL",
+    "IRP_MJ_INTERNAL_DEVICE_CONTROL",
+    "IRP_MJ_SHUTDOWN",
+    "IRP_MJ_LOCK_CONTROL",
+    "IRP_MJ_CLEANUP",
+    "IRP_MJ_CREATE_MAILSLOT",
+    "IRP_MJ_QUERY_SECURITY",
+    "IRP_MJ_SET_SECURITY",
+    "IRP_MJ_POWER",
+    "IRP_MJ_SYSTEM_CONTROL",
+    "IRP_MJ_DEVICE_CHANGE",
+    "IRP_MJ_QUERY_QUOTA",
+    "IRP_MJ_SET_QUOTA",
+    "IRP_MJ_PNP",
+};
+
+// Minor functions of the major functions the driver logs the most. The values
+// are the ones of ntifs.h and wdm.h.
+static const DOKAN_TRACE_NAME ReadWriteMinorFunctionNames[] = {
+    {0x00, "IRP_MN_NORMAL"},       {0x01, "IRP_MN_DPC"},
+    {0x02, "IRP_MN_MDL"},          {0x03, "IRP_MN_MDL_DPC"},
+    {0x04, "IRP_MN_COMPLETE"},     {0x06, "IRP_MN_COMPLETE_MDL"},
+    {0x07, "IRP_MN_COMPLETE_MDL_DPC"}, {0x08, "IRP_MN_COMPRESSED"},
+    {0, NULL}};
+
+static const DOKAN_TRACE_NAME FlushMinorFunctionNames[] = {
+    {0x01, "IRP_MN_FLUSH_AND_PURGE"},
+    {0x02, "IRP_MN_FLUSH_DATA_ONLY"},
+    {0x03, "IRP_MN_FLUSH_NO_SYNC"},
+    {0x04, "IRP_MN_FLUSH_DATA_SYNC_ONLY"},
+    {0, NULL}};
+
+static const DOKAN_TRACE_NAME DirectoryControlMinorFunctionNames[] = {
+    {0x01, "IRP_MN_QUERY_DIRECTORY"},
+    {0x02, "IRP_MN_NOTIFY_CHANGE_DIRECTORY"},
+    {0x03, "IRP_MN_NOTIFY_CHANGE_DIRECTORY_EX"},
+    {0, NULL}};
+
+static const DOKAN_TRACE_NAME FileSystemControlMinorFunctionNames[] = {
+    {0x00, "IRP_MN_USER_FS_REQUEST"}, {0x01, "IRP_MN_MOUNT_VOLUME"},
+    {0x02, "IRP_MN_VERIFY_VOLUME"},   {0x03, "IRP_MN_LOAD_FILE_SYSTEM"},
+    {0x04, "IRP_MN_KERNEL_CALL"},     {0, NULL}};
+
+static const DOKAN_TRACE_NAME LockControlMinorFunctionNames[] = {
+    {0x01, "IRP_MN_LOCK"},
+    {0x02, "IRP_MN_UNLOCK_SINGLE"},
+    {0x03, "IRP_MN_UNLOCK_ALL"},
+    {0x04, "IRP_MN_UNLOCK_ALL_BY_KEY"},
+    {0, NULL}};
+
+// Identifier types of the driver structures, see FSD_IDENTIFIER_TYPE.
+static const DOKAN_TRACE_NAME IdTypeNames[] = {
+    {':DGL', "DGL"}, {':DDC', "DCB"}, {':VCB', "VCB"},      {':FCB', "FCB"},
+    {':CCB', "CCB"}, {':FFC', "FREED_FCB"}, {0, "NULL"}, {0, NULL}};
+
+static const char *FindTraceName(const DOKAN_TRACE_NAME *Names, ULONG64 Value,
+                                 const char *Default) {
+  for (; Names->Name; ++Names) {
+    if (Names->Value == Value) {
+      return Names->Name;
+    }
+  }
+  return Default;
+}
+
+static const char *GetMajorFunctionName(ULONG64 MajorFunction) {
+  if (MajorFunction > IRP_MJ_MAXIMUM_FUNCTION) {
+    return "MJ_UKNOWN";
+  }
+  return MajorFunctionNames[MajorFunction];
+}
+
+static const char *GetMinorFunctionName(ULONG64 MajorFunction,
+                                        ULONG64 MinorFunction) {
+  switch (MajorFunction) {
+  case IRP_MJ_READ:
+  case IRP_MJ_WRITE:
+    return FindTraceName(ReadWriteMinorFunctionNames, MinorFunction,
+                         "MN_UNKNOWN");
+  case IRP_MJ_FLUSH_BUFFERS:
+    return FindTraceName(FlushMinorFunctionNames, MinorFunction, "MN_UNKNOWN");
+  case IRP_MJ_DIRECTORY_CONTROL:
+    return FindTraceName(DirectoryControlMinorFunctionNames, MinorFunction,
+                         "MN_UNKNOWN");
+  case IRP_MJ_FILE_SYSTEM_CONTROL:
+    return FindTraceName(FileSystemControlMinorFunctionNames, MinorFunction,
+                         "MN_UNKNOWN");
+  case IRP_MJ_LOCK_CONTROL:
+    return FindTraceName(LockControlMinorFunctionNames, MinorFunction,
+                         "MN_UNKNOWN");
+  }
+  return "";
+}
+
+const DOKAN_TRACE_RECORD *
+DokanTraceNextRecord(const DOKAN_LOG_MESSAGE *Message, ULONG *Offset) {
+  const DOKAN_TRACE_RECORD *record;
+  if (*Offset >= Message->RecordsLength ||
+      Message->RecordsLength - *Offset < DOKAN_TRACE_RECORD_HEADER_SIZE) {
+    return NULL;
+  }
+  record = (const DOKAN_TRACE_RECORD *)((const char *)Message->Records +
+                                        *Offset);
+  if (record->Size < DOKAN_TRACE_RECORD_HEADER_SIZE ||
+      record->Size > Message->RecordsLength - *Offset) {
+    return NULL;
+  }
+  *Offset += DOKAN_TRACE_RECORD_ALIGNED_SIZE(record->Size);
+  return record;
+}
+
+BOOL DokanTraceIsValidMessage(const DOKAN_LOG_MESSAGE *Message,
+                              ULONG MessageSize) {
+  ULONG offset = 0;
+  if (MessageSize < FIELD_OFFSET(DOKAN_LOG_MESSAGE, Records[0]) ||
+      Message->RecordsLength >
+          MessageSize - FIELD_OFFSET(DOKAN_LOG_MESSAGE, Records[0])) {
+    return FALSE;
+  }
+  while (DokanTraceNextRecord(Message, &offset)) {
+  }
+  return offset >= Message->RecordsLength;
+}
+
+size_t DokanTraceFormatRecord(const DOKAN_TRACE_RECORD *Record, char *Buffer,
+                              size_t BufferSize) {
+  ULONG64 milliseconds;
+  size_t length;
+  int written;
+
+  if (!BufferSize) {
+    return 0;
+  }
+  milliseconds =
+      ((ULONG64)Record->Timestamp / DOKAN_TRACE_TICKS_PER_MILLISECOND) %
+      DOKAN_TRACE_MILLISECONDS_PER_DAY;
+  written = snprintf(Buffer, BufferSize, "[%02u:%02u:%02u.%03u][%lu]",
+                     (unsigned)(milliseconds / (60 * 60 * 1000)),
+                     (unsigned)(milliseconds / (60 * 1000) % 60),
+                     (unsigned)(milliseconds / 1000 % 60),
+                     (unsigned)(milliseconds % 1000), Record->Processor);
+  if (written < 0) {
+    Buffer[0] = '\0';
+    return 0;
+  }
+  length = min((size_t)written, BufferSize - 1);
+
+  switch (Record->EventId) {
+  case DOKAN_TRACE_TEXT:
+    written = snprintf(Buffer + length, BufferSize - length, "%.*s",
+                       (int)(Record->Size - DOKAN_TRACE_RECORD_HEADER_SIZE),
+                       Record->Text);
+    break;
+  case DOKAN_TRACE_IRP_BEGIN:
+    written = snprintf(
+        Buffer + length, BufferSize - length,
+        "[0x%llx][%s][%s][%s]: Begin ProcessId=%lu", Record->Irp,
+        FindTraceName(IdTypeNames, Record->Args[2], "Unknown"),
+        GetMajorFunctionName(Record->Args[0]),
+        GetMinorFunctionName(Record->Args[0], Record->Args[1]),
+        Record->ProcessId);
+    break;
+  case DOKAN_TRACE_IRP_END:
+    written = snprintf(Buffer + length, BufferSize - length,
+                       "[0x%llx]: End - 0x%08lx Information=%llx", Record->Irp,
+                       Record->Status, Record->Args[0]);
+    break;
+  case DOKAN_TRACE_IRP_END_PENDING:
+    written = snprintf(Buffer + length, BufferSize - length,
+                       "[0x%llx]: End - Irp is marked pending", Record->Irp);
+    break;
+  case DOKAN_TRACE_IRP_END_NOT_COMPLETED:
+    written = snprintf(Buffer + length, BufferSize - length,
+                       "[0x%llx]: End - Irp not completed 0x%08lx",
+                       Record->Irp, Record->Status);
+    break;
+  default:
+    written = snprintf(Buffer + length, BufferSize - length,
+                       ": Unknown driver log event %u", Record->EventId);
+    break;
+  }
+  if (written < 0) {
+    Buffer[length] = '\0';
+    return length;
+  }
+  return min(length + (size_t)written, BufferSize - 1);
+}
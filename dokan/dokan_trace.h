@@ -0,0 +1,49 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_TRACE_H_
+#define DOKAN_TRACE_H_
+
+#include "dokani.h"
+
+// Decoding of the binary DOKAN_TRACE_RECORD logs the driver dispatches with
+// DOKAN_IRP_LOG_MESSAGE. The driver only records the raw values of a log and
+// leaves their formatting to the library. This only relies on the record
+// format of public.h and the C runtime.
+
+// Size of a buffer large enough for any formatted record.
+#define DOKAN_TRACE_LINE_MAX_SIZE 640
+
+// Returns the record of Message at *Offset and moves *Offset to the next one.
+// Returns NULL once all the records were returned or when the record at
+// *Offset does not fit in the message.
+const DOKAN_TRACE_RECORD *
+DokanTraceNextRecord(const DOKAN_LOG_MESSAGE *Message, ULONG *Offset);
+
+// Whether the records of Message fit in the MessageSize bytes received.
+BOOL DokanTraceIsValidMessage(const DOKAN_LOG_MESSAGE *Message,
+                              ULONG MessageSize);
+
+// Formats Record as a log line in Buffer, truncated to BufferSize chars
+// including the null terminator. Returns the length of the line.
+size_t DokanTraceFormatRecord(const DOKAN_TRACE_RECORD *Record, char *Buffer,
+                              size_t BufferSize);
+
+#endif
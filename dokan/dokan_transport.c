@@ -0,0 +1,49 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokan_transport.h"
+
+static BOOL DeviceControl(PDOKAN_INSTANCE DokanInstance, DWORD IoControlCode,
+                          PVOID InputBuffer, DWORD InputLength,
+                          PVOID OutputBuffer, DWORD OutputLength,
+                          LPDWORD BytesReturned) {
+  return DeviceIoControl(DokanInstance->Device, // Handle to device
+                         IoControlCode,         // IO Control code
+                         InputBuffer,           // Input Buffer to driver.
+                         InputLength,   // Length of input buffer in bytes.
+                         OutputBuffer,  // Output Buffer from driver.
+                         OutputLength,  // Length of output buffer in bytes.
+                         BytesReturned, // Bytes placed in buffer.
+                         NULL           // synchronous call
+  );
+}
+
+const DOKAN_TRANSPORT g_DokanDeviceTransport = {DeviceControl,
+                                                /*Mounted=*/TRUE};
+
+BOOL DokanTransport_Control(PDOKAN_INSTANCE DokanInstance, DWORD IoControlCode,
+                            PVOID InputBuffer, DWORD InputLength,
+                            PVOID OutputBuffer, DWORD OutputLength,
+                            LPDWORD BytesReturned) {
+  return DokanInstance->Transport->Control(DokanInstance, IoControlCode,
+                                           InputBuffer, InputLength,
+                                           OutputBuffer, OutputLength,
+                                           BytesReturned);
+}
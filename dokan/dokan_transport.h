@@ -0,0 +1,49 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_TRANSPORT_H_
+#define DOKAN_TRANSPORT_H_
+
+#include "dokani.h"
+
+// Carries the events and their replies between an instance and the source of
+// its events. This is the driver for a mount, see DOKAN_INSTANCE.Transport.
+typedef struct _DOKAN_TRANSPORT {
+  // Works like DeviceIoControl on the device of the mount for
+  // FSCTL_EVENT_PROCESS_N_PULL, FSCTL_EVENT_WRITE and FSCTL_RESET_TIMEOUT.
+  // Returns FALSE and sets the last error on failure.
+  BOOL (*Control)(PDOKAN_INSTANCE DokanInstance, DWORD IoControlCode,
+                  PVOID InputBuffer, DWORD InputLength, PVOID OutputBuffer,
+                  DWORD OutputLength, LPDWORD BytesReturned);
+  // Whether the events come from a mounted volume, whose unmount is notified
+  // to the file system and the system.
+  BOOL Mounted;
+} DOKAN_TRANSPORT, *PDOKAN_TRANSPORT;
+
+// Sends the ioctls to DOKAN_INSTANCE.Device.
+extern const DOKAN_TRANSPORT g_DokanDeviceTransport;
+
+// Sends an ioctl through the transport of the instance.
+BOOL DokanTransport_Control(PDOKAN_INSTANCE DokanInstance, DWORD IoControlCode,
+                            PVOID InputBuffer, DWORD InputLength,
+                            PVOID OutputBuffer, DWORD OutputLength,
+                            LPDWORD BytesReturned);
+
+#endif
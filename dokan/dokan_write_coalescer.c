@@ -0,0 +1,478 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokan_write_coalescer.h"
+#include "dokan_read_ahead.h"
+
+static VOID FreeBuffer(PDOKAN_WRITE_COALESCER Coalescer,
+                       PDOKAN_WRITE_BUFFER Buffer) {
+  if (Buffer->Data) {
+    free(Buffer->Data);
+    InterlockedAdd64(&Coalescer->MemoryUsage, -(LONG64)Coalescer->Size);
+  }
+  free(Buffer->FileName);
+  CloseHandle(Buffer->CompletedEvent);
+  free(Buffer);
+}
+
+static VOID ReleaseBuffer(PDOKAN_WRITE_COALESCER Coalescer,
+                          PDOKAN_WRITE_BUFFER Buffer) {
+  if (InterlockedDecrement(&Buffer->References) == 0) {
+    FreeBuffer(Coalescer, Buffer);
+  }
+}
+
+// Creates the buffer of an open, unless a concurrent write did. Returns the
+// buffer of the open or NULL.
+static PDOKAN_WRITE_BUFFER AttachBuffer(PDOKAN_WRITE_COALESCER Coalescer,
+                                        PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_WRITE_BUFFER buffer;
+  PDOKAN_WRITE_BUFFER attached;
+  buffer = calloc(1, sizeof(DOKAN_WRITE_BUFFER));
+  if (!buffer) {
+    return NULL;
+  }
+  buffer->CompletedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (!buffer->CompletedEvent) {
+    DbgPrintW(L"Dokan Error: CreateEvent() has returned error code %u.\n",
+              GetLastError());
+    free(buffer);
+    return NULL;
+  }
+  InitializeSRWLock(&buffer->Lock);
+  buffer->References = 1;
+  buffer->OpenInfo = OpenInfo;
+
+  EnterCriticalSection(&OpenInfo->CriticalSection);
+  attached = OpenInfo->WriteBuffer;
+  if (!attached) {
+    OpenInfo->WriteBuffer = buffer;
+    attached = buffer;
+    buffer = NULL;
+  }
+  LeaveCriticalSection(&OpenInfo->CriticalSection);
+
+  if (buffer) {
+    FreeBuffer(Coalescer, buffer);
+    return attached;
+  }
+  AcquireSRWLockExclusive(&Coalescer->Lock);
+  InsertTailList(&Coalescer->Buffers, &attached->ListEntry);
+  ++Coalescer->BufferCount;
+  ReleaseSRWLockExclusive(&Coalescer->Lock);
+  return attached;
+}
+
+// Returns the buffers of the coalescer in an array to free with
+// ReleaseSnapshot, with a reference taken on each so that they are flushed
+// without holding the lock of the list. Returns FALSE on allocation failure.
+static BOOL SnapshotBuffers(PDOKAN_WRITE_COALESCER Coalescer,
+                           PDOKAN_WRITE_BUFFER **Buffers, PULONG Count) {
+  PDOKAN_WRITE_BUFFER *buffers = NULL;
+  ULONG capacity = 0;
+  PLIST_ENTRY entry;
+
+  *Buffers = NULL;
+  *Count = 0;
+  while (TRUE) {
+    AcquireSRWLockShared(&Coalescer->Lock);
+    if (Coalescer->BufferCount <= capacity) {
+      break;
+    }
+    capacity = Coalescer->BufferCount;
+    ReleaseSRWLockShared(&Coalescer->Lock);
+    free(buffers);
+    buffers = malloc(capacity * sizeof(PDOKAN_WRITE_BUFFER));
+    if (!buffers) {
+      return FALSE;
+    }
+  }
+  for (entry = Coalescer->Buffers.Flink; entry != &Coalescer->Buffers;
+       entry = entry->Flink) {
+    PDOKAN_WRITE_BUFFER buffer =
+        CONTAINING_RECORD(entry, DOKAN_WRITE_BUFFER, ListEntry);
+    InterlockedIncrement(&buffer->References);
+    buffers[(*Count)++] = buffer;
+  }
+  ReleaseSRWLockShared(&Coalescer->Lock);
+  *Buffers = buffers;
+  return TRUE;
+}
+
+static VOID ReleaseSnapshot(PDOKAN_WRITE_COALESCER Coalescer,
+                            PDOKAN_WRITE_BUFFER *Buffers, ULONG Count) {
+  for (ULONG i = 0; i < Count; ++i) {
+    ReleaseBuffer(Coalescer, Buffers[i]);
+  }
+  free(Buffers);
+}
+
+static PDOKAN_WRITE_BUFFER GetBuffer(PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_WRITE_BUFFER buffer;
+  EnterCriticalSection(&OpenInfo->CriticalSection);
+  buffer = OpenInfo->WriteBuffer;
+  LeaveCriticalSection(&OpenInfo->CriticalSection);
+  return buffer;
+}
+
+// Passes the data of the buffer to WriteFile, as the open would have with its
+// event. Must be called with the lock of the buffer held and data buffered.
+static VOID FlushLocked(PDOKAN_WRITE_COALESCER Coalescer,
+                        PDOKAN_WRITE_BUFFER Buffer) {
+  PDOKAN_INSTANCE dokanInstance = Coalescer->DokanInstance;
+  PDOKAN_OPEN_INFO openInfo = Buffer->OpenInfo;
+  DOKAN_IO_EVENT ioEvent;
+  ULONG writtenLength = 0;
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+
+  ZeroMemory(&ioEvent, sizeof(DOKAN_IO_EVENT));
+  ioEvent.DokanInstance = dokanInstance;
+  ioEvent.DokanOpenInfo = openInfo;
+  ioEvent.WriteCoalescingFlush = TRUE;
+  ioEvent.DokanFileInfo = Buffer->FileInfo;
+  ioEvent.DokanFileInfo.DokanContext = (ULONG64)&ioEvent;
+  ioEvent.DokanFileInfo.ProcessingContext = NULL;
+  EnterCriticalSection(&openInfo->CriticalSection);
+  ioEvent.DokanFileInfo.Context = openInfo->UserContext;
+  LeaveCriticalSection(&openInfo->CriticalSection);
+
+  if (dokanInstance->DokanOperations->WriteFile) {
+    status = dokanInstance->DokanOperations->WriteFile(
+        Buffer->FileName, Buffer->Data, Buffer->Length, &writtenLength,
+        Buffer->Offset, &ioEvent.DokanFileInfo);
+  }
+  if (status == STATUS_PENDING) {
+    // Completed by DokanEndDispatchWrite
+    WaitForSingleObject(Buffer->CompletedEvent, INFINITE);
+    writtenLength = Buffer->CompletedLength;
+    status = Buffer->CompletedStatus;
+  }
+
+  EnterCriticalSection(&openInfo->CriticalSection);
+  openInfo->UserContext = ioEvent.DokanFileInfo.Context;
+  LeaveCriticalSection(&openInfo->CriticalSection);
+
+  InterlockedIncrement64(&Coalescer->Flushes);
+  InterlockedAdd64(&Coalescer->FlushedBytes,
+                   status == STATUS_SUCCESS ? writtenLength : 0);
+  if (status != STATUS_SUCCESS || writtenLength != Buffer->Length) {
+    DbgPrintW(L"Dokan Error: Buffered write of %lu bytes at %lld failed with "
+              L"status 0x%x, %lu bytes written.\n",
+              Buffer->Length, Buffer->Offset, status, writtenLength);
+    InterlockedIncrement64(&Coalescer->FailedFlushes);
+    if (Buffer->Error == STATUS_SUCCESS) {
+      Buffer->Error =
+          status != STATUS_SUCCESS ? status : STATUS_UNEXPECTED_IO_ERROR;
+    }
+  }
+
+  // Data read by the other opens since the write was buffered is stale.
+  if (Buffer->FileName[0] && dokanInstance->FileInfoCache) {
+    DokanFileInfoCache_InvalidateFile(dokanInstance->FileInfoCache,
+                                      Buffer->FileName,
+                                      wcslen(Buffer->FileName),
+                                      /*IncludeParent=*/FALSE);
+  }
+  DokanReadAhead_InvalidateEventFile(dokanInstance->ReadAhead, &ioEvent,
+                                     Buffer->FileName);
+  Buffer->Length = 0;
+}
+
+// Keeps the name sent with the first write of the data. Returns FALSE on
+// allocation failure.
+static BOOL UpdateBufferFileName(PDOKAN_WRITE_BUFFER Buffer,
+                                 LPCWSTR FileName) {
+  LPWSTR fileName;
+  if (Buffer->FileName && wcscmp(Buffer->FileName, FileName) == 0) {
+    return TRUE;
+  }
+  fileName = _wcsdup(FileName);
+  if (!fileName) {
+    return FALSE;
+  }
+  free(Buffer->FileName);
+  Buffer->FileName = fileName;
+  return TRUE;
+}
+
+static VOID CALLBACK TimerCallback(PTP_CALLBACK_INSTANCE Instance,
+                                   PVOID Context, PTP_TIMER Timer) {
+  PDOKAN_WRITE_COALESCER coalescer = (PDOKAN_WRITE_COALESCER)Context;
+  // The timer runs every half timeout, flushing the data older than that
+  // bounds the time it stays buffered by the timeout.
+  ULONG64 age = coalescer->Timeout - coalescer->Timeout / 2;
+  ULONG64 now = GetTickCount64();
+  PDOKAN_WRITE_BUFFER *buffers;
+  ULONG count;
+
+  UNREFERENCED_PARAMETER(Instance);
+  UNREFERENCED_PARAMETER(Timer);
+  if (InterlockedCompareExchange(&coalescer->TimerRunning, 1, 0)) {
+    return;
+  }
+  if (!SnapshotBuffers(coalescer, &buffers, &count)) {
+    InterlockedExchange(&coalescer->TimerRunning, 0);
+    return;
+  }
+  for (ULONG i = 0; i < count; ++i) {
+    PDOKAN_WRITE_BUFFER buffer = buffers[i];
+    // A buffer in use is flushed by its write or at the next run.
+    if (!TryAcquireSRWLockExclusive(&buffer->Lock)) {
+      continue;
+    }
+    if (buffer->OpenInfo && now - buffer->FirstWriteTime >= age) {
+      if (buffer->Length) {
+        InterlockedIncrement64(&coalescer->TimeoutFlushes);
+        FlushLocked(coalescer, buffer);
+      } else if (buffer->Data) {
+        // The open stopped writing.
+        free(buffer->Data);
+        buffer->Data = NULL;
+        InterlockedAdd64(&coalescer->MemoryUsage, -(LONG64)coalescer->Size);
+      }
+    }
+    ReleaseSRWLockExclusive(&buffer->Lock);
+  }
+  ReleaseSnapshot(coalescer, buffers, count);
+  InterlockedExchange(&coalescer->TimerRunning, 0);
+}
+
+PDOKAN_WRITE_COALESCER DokanWriteCoalescer_Alloc(PDOKAN_INSTANCE DokanInstance,
+                                                 ULONG Size, ULONG Timeout,
+                                                 BOOL CaseSensitive) {
+  PDOKAN_WRITE_COALESCER coalescer;
+  LARGE_INTEGER dueTime;
+  FILETIME fileDueTime;
+  ULONG period;
+
+  coalescer = calloc(1, sizeof(DOKAN_WRITE_COALESCER));
+  if (!coalescer) {
+    return NULL;
+  }
+  coalescer->DokanInstance = DokanInstance;
+  InitializeSRWLock(&coalescer->Lock);
+  InitializeListHead(&coalescer->Buffers);
+  coalescer->Size = Size ? min(Size, DOKAN_WRITE_COALESCING_MAX_SIZE)
+                         : DOKAN_WRITE_COALESCING_DEFAULT_SIZE;
+  coalescer->Timeout =
+      Timeout ? Timeout : DOKAN_WRITE_COALESCING_DEFAULT_TIMEOUT;
+  coalescer->CaseSensitive = CaseSensitive;
+  coalescer->Timer =
+      CreateThreadpoolTimer(TimerCallback, coalescer,
+                            &DokanInstance->ThreadInfo.CallbackEnvironment);
+  if (!coalescer->Timer) {
+    DbgPrintW(L"Dokan Error: CreateThreadpoolTimer() has returned error code "
+              L"%u.\n",
+              GetLastError());
+    free(coalescer);
+    return NULL;
+  }
+  period = max(coalescer->Timeout / 2, 1);
+  // Relative due time in 100 nanoseconds units.
+  dueTime.QuadPart = -(LONGLONG)period * 10000;
+  fileDueTime.dwLowDateTime = dueTime.LowPart;
+  fileDueTime.dwHighDateTime = dueTime.HighPart;
+  SetThreadpoolTimer(coalescer->Timer, &fileDueTime, period, 0);
+  return coalescer;
+}
+
+VOID DokanWriteCoalescer_Free(PDOKAN_WRITE_COALESCER Coalescer) {
+  if (!Coalescer) {
+    return;
+  }
+  // Opens never closed by the kernel can still hold data at unmount.
+  while (!IsListEmpty(&Coalescer->Buffers)) {
+    PDOKAN_WRITE_BUFFER buffer = CONTAINING_RECORD(
+        RemoveHeadList(&Coalescer->Buffers), DOKAN_WRITE_BUFFER, ListEntry);
+    if (buffer->Length) {
+      FlushLocked(Coalescer, buffer);
+    }
+    FreeBuffer(Coalescer, buffer);
+  }
+  free(Coalescer);
+}
+
+BOOL DokanWriteCoalescer_Write(PDOKAN_WRITE_COALESCER Coalescer,
+                               PDOKAN_IO_EVENT IoEvent,
+                               PEVENT_CONTEXT EventContext) {
+  PDOKAN_OPEN_INFO openInfo = IoEvent->DokanOpenInfo;
+  PWRITE_CONTEXT write = &EventContext->Operation.Write;
+  PDOKAN_WRITE_BUFFER buffer = GetBuffer(openInfo);
+
+  if (!write->BufferLength || write->BufferLength >= Coalescer->Size ||
+      IoEvent->DokanFileInfo.PagingIo || IoEvent->DokanFileInfo.Nocache ||
+      IoEvent->DokanFileInfo.WriteToEndOfFile) {
+    // Keeps the order with the writes buffered before.
+    if (buffer) {
+      DokanWriteCoalescer_Flush(Coalescer, IoEvent, /*TakeError=*/FALSE);
+    }
+    InterlockedIncrement64(&Coalescer->DirectWrites);
+    return FALSE;
+  }
+  if (!buffer) {
+    buffer = AttachBuffer(Coalescer, openInfo);
+    if (!buffer) {
+      InterlockedIncrement64(&Coalescer->DirectWrites);
+      return FALSE;
+    }
+  }
+
+  AcquireSRWLockExclusive(&buffer->Lock);
+  if (buffer->Length &&
+      write->ByteOffset.QuadPart != buffer->Offset + buffer->Length) {
+    FlushLocked(Coalescer, buffer);
+  }
+  if (buffer->Length + write->BufferLength > Coalescer->Size) {
+    InterlockedIncrement64(&Coalescer->FullFlushes);
+    FlushLocked(Coalescer, buffer);
+  }
+  if (!buffer->Data) {
+    buffer->Data = malloc(Coalescer->Size);
+    if (!buffer->Data) {
+      ReleaseSRWLockExclusive(&buffer->Lock);
+      InterlockedIncrement64(&Coalescer->DirectWrites);
+      return FALSE;
+    }
+    InterlockedAdd64(&Coalescer->MemoryUsage, Coalescer->Size);
+  }
+  if (!buffer->Length) {
+    if (!UpdateBufferFileName(buffer, write->FileName)) {
+      ReleaseSRWLockExclusive(&buffer->Lock);
+      InterlockedIncrement64(&Coalescer->DirectWrites);
+      return FALSE;
+    }
+    buffer->Offset = write->ByteOffset.QuadPart;
+    buffer->FirstWriteTime = GetTickCount64();
+    buffer->FileInfo = IoEvent->DokanFileInfo;
+  }
+  RtlCopyMemory(buffer->Data + buffer->Length,
+                (PCHAR)EventContext + write->BufferOffset, write->BufferLength);
+  buffer->Length += write->BufferLength;
+  if (buffer->Length == Coalescer->Size) {
+    InterlockedIncrement64(&Coalescer->FullFlushes);
+    FlushLocked(Coalescer, buffer);
+  }
+  ReleaseSRWLockExclusive(&buffer->Lock);
+  InterlockedIncrement64(&Coalescer->BufferedWrites);
+  return TRUE;
+}
+
+NTSTATUS DokanWriteCoalescer_Flush(PDOKAN_WRITE_COALESCER Coalescer,
+                                   PDOKAN_IO_EVENT IoEvent, BOOL TakeError) {
+  PDOKAN_WRITE_BUFFER buffer = GetBuffer(IoEvent->DokanOpenInfo);
+  NTSTATUS status = STATUS_SUCCESS;
+  if (!buffer) {
+    return STATUS_SUCCESS;
+  }
+  AcquireSRWLockExclusive(&buffer->Lock);
+  if (buffer->Length) {
+    FlushLocked(Coalescer, buffer);
+  }
+  if (TakeError) {
+    status = buffer->Error;
+    buffer->Error = STATUS_SUCCESS;
+  }
+  ReleaseSRWLockExclusive(&buffer->Lock);
+  return status;
+}
+
+// Whether the buffer holds writes of FileName. Must be called with the lock of
+// the buffer held.
+static BOOL BufferMatchesFile(PDOKAN_WRITE_COALESCER Coalescer,
+                              PDOKAN_WRITE_BUFFER Buffer, LPCWSTR FileName) {
+  if (!Buffer->FileName[0] || !FileName[0]) {
+    // A name the kernel did not send may be the one of the file.
+    return TRUE;
+  }
+  return Coalescer->CaseSensitive ? wcscmp(Buffer->FileName, FileName) == 0
+                                  : _wcsicmp(Buffer->FileName, FileName) == 0;
+}
+
+VOID DokanWriteCoalescer_FlushFile(PDOKAN_WRITE_COALESCER Coalescer,
+                                   LPCWSTR FileName) {
+  PDOKAN_WRITE_BUFFER *buffers;
+  ULONG count;
+  if (!SnapshotBuffers(Coalescer, &buffers, &count)) {
+    DbgPrintW(L"Dokan Error: Failed to flush the buffered writes of %s.\n",
+              FileName);
+    return;
+  }
+  for (ULONG i = 0; i < count; ++i) {
+    PDOKAN_WRITE_BUFFER buffer = buffers[i];
+    AcquireSRWLockExclusive(&buffer->Lock);
+    if (buffer->OpenInfo && buffer->Length &&
+        BufferMatchesFile(Coalescer, buffer, FileName)) {
+      FlushLocked(Coalescer, buffer);
+    }
+    ReleaseSRWLockExclusive(&buffer->Lock);
+  }
+  ReleaseSnapshot(Coalescer, buffers, count);
+}
+
+VOID DokanWriteCoalescer_EndFlush(PDOKAN_IO_EVENT IoEvent,
+                                  ULONG NumberOfBytesWritten,
+                                  NTSTATUS Status) {
+  // The flush holds the lock of the buffer while it waits.
+  PDOKAN_WRITE_BUFFER buffer = IoEvent->DokanOpenInfo->WriteBuffer;
+  buffer->CompletedLength = NumberOfBytesWritten;
+  buffer->CompletedStatus = Status;
+  SetEvent(buffer->CompletedEvent);
+}
+
+VOID DokanWriteCoalescer_ReleaseOpen(PDOKAN_WRITE_COALESCER Coalescer,
+                                     PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_WRITE_BUFFER buffer = OpenInfo->WriteBuffer;
+  if (!Coalescer || !buffer) {
+    return;
+  }
+  AcquireSRWLockExclusive(&Coalescer->Lock);
+  RemoveEntryList(&buffer->ListEntry);
+  --Coalescer->BufferCount;
+  ReleaseSRWLockExclusive(&Coalescer->Lock);
+  // A snapshot taken before may still reference the buffer, it skips the
+  // buffer once the open is cleared.
+  AcquireSRWLockExclusive(&buffer->Lock);
+  if (buffer->Length) {
+    FlushLocked(Coalescer, buffer);
+  }
+  if (buffer->Error != STATUS_SUCCESS) {
+    DbgPrintW(L"Dokan Warning: Buffered write error 0x%x was not reported, "
+              L"the open had no flush after it.\n",
+              buffer->Error);
+  }
+  buffer->OpenInfo = NULL;
+  ReleaseSRWLockExclusive(&buffer->Lock);
+  OpenInfo->WriteBuffer = NULL;
+  ReleaseBuffer(Coalescer, buffer);
+}
+
+VOID DokanWriteCoalescer_GetStatistics(
+    PDOKAN_WRITE_COALESCER Coalescer,
+    PDOKAN_WRITE_COALESCING_STATISTICS Statistics) {
+  Statistics->BufferedWrites = Coalescer->BufferedWrites;
+  Statistics->DirectWrites = Coalescer->DirectWrites;
+  Statistics->Flushes = Coalescer->Flushes;
+  Statistics->FullFlushes = Coalescer->FullFlushes;
+  Statistics->TimeoutFlushes = Coalescer->TimeoutFlushes;
+  Statistics->FlushedBytes = Coalescer->FlushedBytes;
+  Statistics->FailedFlushes = Coalescer->FailedFlushes;
+  Statistics->MemoryUsage = Coalescer->MemoryUsage;
+}
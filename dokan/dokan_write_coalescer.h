@@ -0,0 +1,134 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_WRITE_COALESCER_H_
+#define DOKAN_WRITE_COALESCER_H_
+
+#include "dokani.h"
+
+// Default size of the buffer of an open.
+#define DOKAN_WRITE_COALESCING_DEFAULT_SIZE (1024 * 1024)
+
+// Largest size of the buffer of an open.
+#define DOKAN_WRITE_COALESCING_MAX_SIZE (64 * 1024 * 1024)
+
+// Default time in milliseconds a write stays buffered.
+#define DOKAN_WRITE_COALESCING_DEFAULT_TIMEOUT 100
+
+// Writes buffered for an open.
+typedef struct _DOKAN_WRITE_BUFFER {
+  // Entry in DOKAN_WRITE_COALESCER.Buffers.
+  LIST_ENTRY ListEntry;
+  // Held by the open and by the snapshots of the buffers, see
+  // SnapshotBuffers. The last reference frees the buffer.
+  volatile LONG References;
+  // Cleared under the lock of the buffer once the open released it.
+  PDOKAN_OPEN_INFO OpenInfo;
+  // Serializes the writes and flushes of the open and protects the fields
+  // below. Held during the WriteFile call of a flush.
+  SRWLOCK Lock;
+  // DOKAN_WRITE_COALESCER.Size bytes, allocated by the first write buffered
+  // and released once the open stops writing.
+  PCHAR Data;
+  // The buffer holds the bytes of the file at [Offset, Offset + Length).
+  LONG64 Offset;
+  ULONG Length;
+  // GetTickCount64 at the first write of the data.
+  ULONG64 FirstWriteTime;
+  // Name and file info of the first write of the data, given to WriteFile.
+  LPWSTR FileName;
+  DOKAN_FILE_INFO FileInfo;
+  // Error of a flush not returned by a FlushFileBuffers yet.
+  NTSTATUS Error;
+  // Set when a WriteFile returning STATUS_PENDING completes, with its result.
+  HANDLE CompletedEvent;
+  ULONG CompletedLength;
+  NTSTATUS CompletedStatus;
+} DOKAN_WRITE_BUFFER, *PDOKAN_WRITE_BUFFER;
+
+// Write coalescing of a mount instance, see DOKAN_OPTION_WRITE_COALESCING.
+typedef struct _DOKAN_WRITE_COALESCER {
+  PDOKAN_INSTANCE DokanInstance;
+  // Protects Buffers and BufferCount. Never held while a buffer is flushed.
+  SRWLOCK Lock;
+  LIST_ENTRY Buffers;
+  ULONG BufferCount;
+  ULONG Size;
+  ULONG Timeout;
+  BOOL CaseSensitive;
+  // Flushes the buffers of the opens that stopped writing. It belongs to the
+  // cleanup group of the instance, which closes it.
+  PTP_TIMER Timer;
+  // Set while a run of the timer flushes, the runs due meanwhile are skipped.
+  volatile LONG TimerRunning;
+  volatile LONG64 MemoryUsage;
+  volatile LONG64 BufferedWrites;
+  volatile LONG64 DirectWrites;
+  volatile LONG64 Flushes;
+  volatile LONG64 FullFlushes;
+  volatile LONG64 TimeoutFlushes;
+  volatile LONG64 FlushedBytes;
+  volatile LONG64 FailedFlushes;
+} DOKAN_WRITE_COALESCER, *PDOKAN_WRITE_COALESCER;
+
+// Creates the write coalescing of a mount and starts its timer on the thread
+// pool of the instance. A Size or Timeout of 0 selects the default.
+// CaseSensitive tells how DokanWriteCoalescer_FlushFile compares the names.
+PDOKAN_WRITE_COALESCER DokanWriteCoalescer_Alloc(PDOKAN_INSTANCE DokanInstance,
+                                                 ULONG Size, ULONG Timeout,
+                                                 BOOL CaseSensitive);
+
+// Flushes the writes still buffered and releases the coalescer. The cleanup
+// group of the instance must have closed the timer.
+VOID DokanWriteCoalescer_Free(PDOKAN_WRITE_COALESCER Coalescer);
+
+// Buffers the write of the event, whose data are in EventContext. Returns
+// TRUE if the write was buffered and can be completed. Otherwise the writes
+// buffered before were flushed and the write must be passed to WriteFile.
+BOOL DokanWriteCoalescer_Write(PDOKAN_WRITE_COALESCER Coalescer,
+                               PDOKAN_IO_EVENT IoEvent,
+                               PEVENT_CONTEXT EventContext);
+
+// Flushes the writes buffered for the open of the event. Returns the error of
+// a flush not reported yet, which is cleared, if TakeError is set.
+NTSTATUS DokanWriteCoalescer_Flush(PDOKAN_WRITE_COALESCER Coalescer,
+                                   PDOKAN_IO_EVENT IoEvent, BOOL TakeError);
+
+// Flushes the writes buffered by all the opens of FileName, before an
+// operation changing the size of the file.
+VOID DokanWriteCoalescer_FlushFile(PDOKAN_WRITE_COALESCER Coalescer,
+                                   LPCWSTR FileName);
+
+// Called by DokanEndDispatchWrite for a flush whose WriteFile returned
+// STATUS_PENDING.
+VOID DokanWriteCoalescer_EndFlush(PDOKAN_IO_EVENT IoEvent,
+                                  ULONG NumberOfBytesWritten,
+                                  NTSTATUS Status);
+
+// Flushes and releases the buffer of an open that is about to be freed.
+VOID DokanWriteCoalescer_ReleaseOpen(PDOKAN_WRITE_COALESCER Coalescer,
+                                     PDOKAN_OPEN_INFO OpenInfo);
+
+VOID DokanWriteCoalescer_GetStatistics(
+    PDOKAN_WRITE_COALESCER Coalescer,
+    PDOKAN_WRITE_COALESCING_STATISTICS Statistics);
+
+#endif
@@ -32,6 +32,9 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "dokanc.h"
 #include "list.h"
 #include "dokan_vector.h"
+#include "dokan_dirlist.h"
+#include "dokan_dirlist_cache.h"
+#include "dokan_fileinfo_cache.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,6 +44,17 @@ typedef struct _DOKAN_INSTANCE_THREADINFO {
   PTP_POOL ThreadPool;
   PTP_CLEANUP_GROUP CleanupGroup;
   TP_CALLBACK_ENVIRON CallbackEnvironment;
+  /**
+   * Events waiting to be executed by DispatchWork, oldest first so that the
+   * events of a batch start in the order they were pulled.
+   */
+  LIST_ENTRY DispatchQueue;
+  SRWLOCK DispatchQueueLock;
+  /**
+   * Work submitted once per event of DispatchQueue.
+   * Only created when \ref DOKAN_OPTION_ALLOW_IPC_BATCHING is enabled.
+   */
+  PTP_WORK DispatchWork;
 } DOKAN_INSTANCE_THREADINFO;
 
 /**
@@ -93,8 +107,71 @@ typedef struct _DOKAN_INSTANCE {
    * Only the first incrementer thread will call it.
    */
   LONG UnmountedCalled;
+  /**
+   * Directory listings shared between the handles of the mount.
+   * Only allocated when \ref DOKAN_OPTION_DIRECTORY_LIST_CACHE is enabled.
+   */
+  PDOKAN_DIRECTORY_LIST_CACHE DirectoryListCache;
+  /**
+   * GetFileInformation results of the mount.
+   * Only allocated when \ref DOKAN_OPTION_FILE_INFO_CACHE is enabled.
+   */
+  PDOKAN_FILE_INFO_CACHE FileInfoCache;
+  /**
+   * Data read ahead for the sequential readers of the mount.
+   * Only allocated when \ref DOKAN_OPTION_READ_AHEAD is enabled.
+   */
+  struct _DOKAN_READ_AHEAD *ReadAhead;
+  /**
+   * Buffers of the small sequential writes of the mount.
+   * Only allocated when \ref DOKAN_OPTION_WRITE_COALESCING is enabled.
+   */
+  struct _DOKAN_WRITE_COALESCER *WriteCoalescer;
+  /**
+   * Object pools the events of the mount are allocated from. The global
+   * pools unless \ref DOKAN_OPTION_INSTANCE_POOLS gave the mount its own.
+   */
+  struct _DOKAN_OBJECT_POOLS *ObjectPools;
+  /**
+   * Merges the replies sent to the driver.
+   * Only allocated when \ref DOKAN_OPTION_ALLOW_IPC_BATCHING is enabled.
+   */
+  struct _DOKAN_REPLY_AGGREGATOR *ReplyAggregator;
+  /** Picks the size of the buffers pulling events from the driver. */
+  struct _DOKAN_IO_BATCH_SIZER *IoBatchSizer;
+  /** Latencies of the dispatched events, see DokanGetStatistics. */
+  struct _DOKAN_STATISTICS_COLLECTOR *Statistics;
+  /** Writes the pulled events to a trace, see DokanStartEventRecording. */
+  struct _DOKAN_EVENT_RECORDER *EventRecorder;
+  /**
+   * Carries the events and replies, the driver unless the instance replays a
+   * trace or runs a loopback benchmark.
+   */
+  const struct _DOKAN_TRANSPORT *Transport;
+  /** State of the transport when it is not the driver. */
+  PVOID TransportContext;
+  /**
+   * Pending events left by the pulling threads whose reply is not sent yet,
+   * see DetachPendingEvent. The instance is only deleted once they are.
+   */
+  volatile LONG DetachedEvents;
 } DOKAN_INSTANCE, *PDOKAN_INSTANCE;
 
+/**
+ * \struct DOKAN_DIRECTORY_CURSOR
+ * \brief Resume position of a directory enumeration
+ *
+ * Remembers where the last MatchFiles call stopped in a cached directory list
+ * so the next query continuing at the same FileIndex does not have to rescan
+ * and re-match the list from its beginning.
+ */
+typedef struct _DOKAN_DIRECTORY_CURSOR {
+  /** Number of entries matching the pattern before Position */
+  ULONG Index;
+  /** Position in the directory list where the scan resumes */
+  size_t Position;
+} DOKAN_DIRECTORY_CURSOR, *PDOKAN_DIRECTORY_CURSOR;
+
 /**
  * \struct DOKAN_OPEN_INFO
  * \brief Dokan open file informations
@@ -105,8 +182,10 @@ typedef struct _DOKAN_OPEN_INFO {
   CRITICAL_SECTION CriticalSection;
   /** Dokan instance linked to the open */
   PDOKAN_INSTANCE DokanInstance;
-  PDOKAN_VECTOR DirList;
+  PDOKAN_DIRECTORY_LIST DirList;
   PWCHAR DirListSearchPattern;
+  /** Resume position of the enumeration in DirList */
+  DOKAN_DIRECTORY_CURSOR DirListCursor;
   /** Whether the FindFilesWithPattern has returned STATUS_NOT_IMPLEMENTED */
   BOOLEAN UnimplementedFindFilesWithPattern;
   /** User Context see DOKAN_FILE_INFO.Context */
@@ -119,9 +198,21 @@ typedef struct _DOKAN_OPEN_INFO {
   ULONG OpenCount;
   /** Used when dispatching the close once the OpenCount drops to 0 **/
   LPWSTR CloseFileName;
+  /** Current file name, kept when DOKAN_OPTION_OMIT_IO_FILE_NAMES is enabled */
+  LPWSTR FileName;
+  /** EVENT_CONTEXT.FileNameGeneration of the event FileName comes from */
+  ULONG FileNameGeneration;
   LONG64 CloseUserContext;
   /** Event context */
   PEVENT_CONTEXT EventContext;
+  /** End of the last read, a read starting there is sequential */
+  LONG64 NextReadOffset;
+  /** Number of consecutive sequential reads, capped */
+  ULONG SequentialReadCount;
+  /** Data read ahead for the open, see DOKAN_OPTION_READ_AHEAD */
+  struct _DOKAN_READ_AHEAD_WINDOW *ReadAheadWindow;
+  /** Writes buffered for the open, see DOKAN_OPTION_WRITE_COALESCING */
+  struct _DOKAN_WRITE_BUFFER *WriteBuffer;
 } DOKAN_OPEN_INFO, *PDOKAN_OPEN_INFO;
 
 /**
@@ -140,6 +231,8 @@ typedef struct _DOKAN_IO_BATCH {
   PDOKAN_INSTANCE DokanInstance;
   /** Size read from kernel that is hold in EventContext */
   DWORD NumberOfBytesTransferred;
+  /** Size of the EventContext buffer */
+  ULONG EventContextSize;
   /** Whether it is used by the Main pull thread that wait indefinitely in kernel compared to volatile pool threads */
   BOOL MainPullThread;
   /**
@@ -153,6 +246,8 @@ typedef struct _DOKAN_IO_BATCH {
    * When it reaches 0, the buffer is free or pushed to the memory pool.
    */
   LONG EventContextBatchCount;
+  /** Performance counter when the pull filling EventContext returned */
+  LONG64 PullTime;
   /**
    * The actual buffer used to pull events from kernel.
    * It may contain multiple EVENT_CONTEXT depending on what the kernel has to offer right now.
@@ -194,8 +289,36 @@ typedef struct _DOKAN_IO_EVENT {
    * When it is free, the EventContext of this IoEvent is no longer safe to access.
    */
   PDOKAN_IO_BATCH IoBatch;
+  /**
+   * Completion state of an event whose callback returned STATUS_PENDING.
+   * See DOKAN_IO_EVENT_ASYNC_*.
+   */
+  LONG AsyncState;
+  /** Performance counter when the event was pulled from the kernel */
+  LONG64 PullTime;
+  /** Entry in DOKAN_INSTANCE_THREADINFO.DispatchQueue */
+  LIST_ENTRY DispatchListEntry;
+  /**
+   * Whether the event is a speculative read of the read-ahead. It was not
+   * pulled from the kernel and has no result to send.
+   */
+  BOOL ReadAheadFetch;
+  /**
+   * Whether the event is the WriteFile call of buffered writes. It was not
+   * pulled from the kernel and has no result to send.
+   */
+  BOOL WriteCoalescingFlush;
 } DOKAN_IO_EVENT, *PDOKAN_IO_EVENT;
 
+/** The event is completed on the thread that dispatched it */
+#define DOKAN_IO_EVENT_ASYNC_NONE 0
+/** The callback returned STATUS_PENDING and the dispatch is returning */
+#define DOKAN_IO_EVENT_ASYNC_DISPATCHED 1
+/** The dispatching thread left the event to the thread completing it */
+#define DOKAN_IO_EVENT_ASYNC_PENDING 2
+/** The result of the event was filled by the file system */
+#define DOKAN_IO_EVENT_ASYNC_COMPLETED 3
+
 #define IOEVENT_RESULT_BUFFER_SIZE(ioEvent)                                    \
   ((ioEvent)->EventResultSize >= offsetof(EVENT_INFORMATION, Buffer)           \
        ? (ioEvent)->EventResultSize - offsetof(EVENT_INFORMATION, Buffer)      \
@@ -221,6 +344,18 @@ BOOL IsMountPointDriveLetter(LPCWSTR mountPoint);
 
 VOID EventCompletion(PDOKAN_IO_EVENT EventInfo);
 
+VOID DispatchPendingEvent(PDOKAN_IO_EVENT IoEvent);
+
+BOOL DetachPendingEvent(PDOKAN_IO_EVENT IoEvent);
+
+VOID CompletePendingEvent(PDOKAN_IO_EVENT IoEvent);
+
+// Sends the reply of the event without pulling new events, then releases the
+// event.
+VOID SendEventInformation(PDOKAN_IO_EVENT IoEvent);
+
+DWORD GetEventInfoSize(ULONG MajorFunction, PEVENT_INFORMATION EventInfo);
+
 VOID CreateDispatchCommon(PDOKAN_IO_EVENT IoEvent, ULONG SizeOfEventInfo,
                           BOOL UseExtraMemoryPool, BOOL ClearNonPoolBuffer);
 
@@ -256,10 +391,17 @@ BOOL SendGlobalReleaseIRP(LPCWSTR MountPoint);
 
 VOID CheckFileName(LPWSTR FileName);
 
+VOID UpdateOpenInfoFileName(PDOKAN_IO_EVENT IoEvent, LPCWSTR FileName);
+
 VOID ReleaseDokanOpenInfo(PDOKAN_IO_EVENT IoEvent);
 
 VOID DokanNotifyUnmounted(PDOKAN_INSTANCE DokanInstance);
 
+// Whether the events of a batch are started with a thread pool work created
+// for each of them, as before the dispatch queue. Their works are only closed
+// with the instance. Only set by the benchmarks, to compare both.
+extern BOOL g_DokanWorkPerBatchEvent;
+
 #ifdef __cplusplus
 }
 #endif
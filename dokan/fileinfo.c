@@ -475,6 +475,9 @@ VOID DispatchQueryInformation(PDOKAN_IO_EVENT IoEvent) {
                        /*UseExtraMemoryPool=*/FALSE,
                        /*ClearNonPoolBuffer=*/TRUE);
 
+  UpdateOpenInfoFileName(IoEvent,
+                         IoEvent->EventContext->Operation.File.FileName);
+
   if (IoEvent->EventContext->Operation.File.FileInformationClass ==
       FileStreamInformation) {
     DbgPrint("FileStreamInformation\n");
@@ -493,11 +496,39 @@ VOID DispatchQueryInformation(PDOKAN_IO_EVENT IoEvent) {
       status = STATUS_NOT_IMPLEMENTED;
     }
   } else if (IoEvent->DokanInstance->DokanOperations->GetFileInformation) {
+    PDOKAN_FILE_INFO_CACHE fileInfoCache =
+        DokanFileInfoCache_IsCacheable(
+            IoEvent->EventContext->Operation.File.FileInformationClass)
+            ? IoEvent->DokanInstance->FileInfoCache
+            : NULL;
+    ULONG64 invalidationSequence = 0;
+
+    if (fileInfoCache &&
+        DokanFileInfoCache_Lookup(
+            fileInfoCache, IoEvent->EventContext->Operation.File.FileName,
+            IoEvent->DokanFileInfo.Context,
+            IoEvent->EventContext->Operation.File.FileInformationClass,
+            &byHandleFileInfo)) {
+      DbgPrint("\tFile information cache hit\n");
+      DokanEndDispatchGetFileInformation(IoEvent, &byHandleFileInfo,
+                                         STATUS_SUCCESS);
+      return;
+    }
+    if (fileInfoCache) {
+      invalidationSequence =
+          DokanFileInfoCache_GetInvalidationSequence(fileInfoCache);
+    }
 
     ZeroMemory(&byHandleFileInfo, sizeof(BY_HANDLE_FILE_INFORMATION));
     status = IoEvent->DokanInstance->DokanOperations->GetFileInformation(
         IoEvent->EventContext->Operation.File.FileName, &byHandleFileInfo,
         &IoEvent->DokanFileInfo);
+    if (status == STATUS_SUCCESS && fileInfoCache) {
+      DokanFileInfoCache_Insert(fileInfoCache,
+                                IoEvent->EventContext->Operation.File.FileName,
+                                IoEvent->DokanFileInfo.Context,
+                                &byHandleFileInfo, invalidationSequence);
+    }
     DokanEndDispatchGetFileInformation(IoEvent, &byHandleFileInfo, status);
   } else {
 
@@ -21,6 +21,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "dokani.h"
+#include "dokan_write_coalescer.h"
 
 VOID DispatchFlush(PDOKAN_IO_EVENT IoEvent) {
   NTSTATUS status;
@@ -30,12 +31,26 @@ VOID DispatchFlush(PDOKAN_IO_EVENT IoEvent) {
   CreateDispatchCommon(IoEvent, 0, /*UseExtraMemoryPool=*/FALSE,
                        /*ClearNonPoolBuffer=*/TRUE);
 
+  UpdateOpenInfoFileName(IoEvent,
+                         IoEvent->EventContext->Operation.Flush.FileName);
+
   DbgPrint("###Flush file handle = 0x%p, eventID = %04d, event Info = 0x%p\n",
            IoEvent->DokanOpenInfo,
            IoEvent->DokanOpenInfo != NULL ? IoEvent->DokanOpenInfo->EventId
                                           : -1,
            IoEvent);
 
+  // The buffered writes reach the file system before it flushes them.
+  if (IoEvent->DokanInstance->WriteCoalescer && IoEvent->DokanOpenInfo) {
+    status = DokanWriteCoalescer_Flush(IoEvent->DokanInstance->WriteCoalescer,
+                                       IoEvent, /*TakeError=*/TRUE);
+    if (status != STATUS_SUCCESS) {
+      IoEvent->EventResult->Status = status;
+      EventCompletion(IoEvent);
+      return;
+    }
+  }
+
   if (IoEvent->DokanInstance->DokanOperations->FlushFileBuffers) {
     status = IoEvent->DokanInstance->DokanOperations->FlushFileBuffers(
         IoEvent->EventContext->Operation.Flush.FileName, &IoEvent->DokanFileInfo);
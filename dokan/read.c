@@ -21,6 +21,40 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "dokani.h"
+#include "dokan_read_ahead.h"
+
+#include <assert.h>
+
+static VOID EndDispatchRead(PDOKAN_IO_EVENT IoEvent, ULONG ReadLength,
+                            NTSTATUS Status) {
+  IoEvent->EventResult->BufferLength = 0;
+  IoEvent->EventResult->Status = Status;
+
+  if (Status == STATUS_SUCCESS) {
+    if (ReadLength == 0) {
+      IoEvent->EventResult->Status = STATUS_END_OF_FILE;
+    } else {
+      IoEvent->EventResult->BufferLength = ReadLength;
+      IoEvent->EventResult->Operation.Read.CurrentByteOffset.QuadPart =
+          IoEvent->EventContext->Operation.Read.ByteOffset.QuadPart +
+          ReadLength;
+    }
+  }
+
+  EventCompletion(IoEvent);
+}
+
+VOID DOKANAPI DokanEndDispatchRead(PDOKAN_FILE_INFO DokanFileInfo,
+                                   ULONG ReadLength, NTSTATUS Status) {
+  PDOKAN_IO_EVENT ioEvent = (PDOKAN_IO_EVENT)DokanFileInfo->DokanContext;
+  assert(Status != STATUS_PENDING);
+  if (ioEvent->ReadAheadFetch) {
+    DokanReadAhead_EndFetch(ioEvent, ReadLength, Status);
+    return;
+  }
+  EndDispatchRead(ioEvent, ReadLength, Status);
+  CompletePendingEvent(ioEvent);
+}
 
 VOID DispatchRead(PDOKAN_IO_EVENT IoEvent) {
   ULONG readLength = 0;
@@ -33,12 +67,22 @@ VOID DispatchRead(PDOKAN_IO_EVENT IoEvent) {
                        /*UseExtraMemoryPool=*/TRUE,
                        /*ClearNonPoolBuffer=*/FALSE);
 
+  UpdateOpenInfoFileName(IoEvent,
+                         IoEvent->EventContext->Operation.Read.FileName);
+
   DbgPrint("###Read file handle = 0x%p, eventID = %04d, event Info = 0x%p\n",
            IoEvent->DokanOpenInfo,
            IoEvent->DokanOpenInfo != NULL ? IoEvent->DokanOpenInfo->EventId
                                           : -1,
            IoEvent);
 
+  if (IoEvent->DokanInstance->ReadAhead && IoEvent->DokanOpenInfo &&
+      DokanReadAhead_Read(IoEvent->DokanInstance->ReadAhead, IoEvent,
+                          &readLength)) {
+    EndDispatchRead(IoEvent, readLength, STATUS_SUCCESS);
+    return;
+  }
+
   if (IoEvent->DokanInstance->DokanOperations->ReadFile) {
     status = IoEvent->DokanInstance->DokanOperations->ReadFile(
         IoEvent->EventContext->Operation.Read.FileName,
@@ -48,19 +92,11 @@ VOID DispatchRead(PDOKAN_IO_EVENT IoEvent) {
         &IoEvent->DokanFileInfo);
   }
 
-  IoEvent->EventResult->BufferLength = 0;
-  IoEvent->EventResult->Status = status;
-
-  if (status == STATUS_SUCCESS) {
-    if (readLength == 0) {
-      IoEvent->EventResult->Status = STATUS_END_OF_FILE;
-    } else {
-      IoEvent->EventResult->BufferLength = readLength;
-      IoEvent->EventResult->Operation.Read.CurrentByteOffset.QuadPart =
-          IoEvent->EventContext->Operation.Read.ByteOffset.QuadPart +
-          readLength;
-    }
+  if (status == STATUS_PENDING) {
+    // Completed by DokanEndDispatchRead
+    DispatchPendingEvent(IoEvent);
+    return;
   }
 
-  EventCompletion(IoEvent);
+  EndDispatchRead(IoEvent, readLength, status);
 }
@@ -23,6 +23,8 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <stdlib.h>
 #include "dokani.h"
+#include "dokan_read_ahead.h"
+#include "dokan_write_coalescer.h"
 #include "fileinfo.h"
 
 NTSTATUS
@@ -222,6 +224,15 @@ VOID DispatchSetInformation(PDOKAN_IO_EVENT IoEvent) {
       IoEvent->DokanOpenInfo != NULL ? IoEvent->DokanOpenInfo->EventId : -1,
       fileInformationClass, IoEvent);
 
+  // The writes other opens of the file buffered land before the size changes.
+  if (IoEvent->DokanInstance->WriteCoalescer &&
+      (fileInformationClass == FileAllocationInformation ||
+       fileInformationClass == FileEndOfFileInformation)) {
+    DokanWriteCoalescer_FlushFile(
+        IoEvent->DokanInstance->WriteCoalescer,
+        IoEvent->EventContext->Operation.SetFile.FileName);
+  }
+
   switch (fileInformationClass) {
   case FileAllocationInformation:
     status =
@@ -289,6 +300,56 @@ VOID DispatchSetInformation(PDOKAN_IO_EVENT IoEvent) {
       IoEvent->EventResult->BufferLength = renameInfo->FileNameLength;
       CopyMemory(IoEvent->EventResult->Buffer, renameInfo->FileName,
                  renameInfo->FileNameLength);
+      if (IoEvent->DokanInstance->DirectoryListCache) {
+        DokanDirectoryListCache_Invalidate(
+            IoEvent->DokanInstance->DirectoryListCache, renameInfo->FileName,
+            renameInfo->FileNameLength / sizeof(WCHAR));
+      }
+      if (IoEvent->DokanInstance->FileInfoCache) {
+        DokanFileInfoCache_InvalidateTree(
+            IoEvent->DokanInstance->FileInfoCache, renameInfo->FileName,
+            renameInfo->FileNameLength / sizeof(WCHAR));
+      }
+      if (IoEvent->DokanInstance->ReadAhead) {
+        DokanReadAhead_Invalidate(IoEvent->DokanInstance->ReadAhead,
+                                  renameInfo->FileName,
+                                  renameInfo->FileNameLength / sizeof(WCHAR),
+                                  /*IncludeChildren=*/TRUE);
+      }
+    }
+    if (fileInformationClass != FilePositionInformation) {
+      LPCWSTR fileName = IoEvent->EventContext->Operation.SetFile.FileName;
+      // Sizes, times, attributes and names are all part of the parent listing
+      if (IoEvent->DokanInstance->DirectoryListCache) {
+        DokanDirectoryListCache_Invalidate(
+            IoEvent->DokanInstance->DirectoryListCache, fileName,
+            wcslen(fileName));
+      }
+      if (IoEvent->DokanInstance->FileInfoCache) {
+        if (fileInformationClass == FileRenameInformation ||
+            fileInformationClass == FileRenameInformationEx) {
+          DokanFileInfoCache_InvalidateTree(
+              IoEvent->DokanInstance->FileInfoCache, fileName,
+              wcslen(fileName));
+        } else {
+          DokanFileInfoCache_InvalidateFile(
+              IoEvent->DokanInstance->FileInfoCache, fileName,
+              wcslen(fileName), /*IncludeParent=*/FALSE);
+        }
+      }
+      // Only a change of the content makes the data read ahead stale
+      if (IoEvent->DokanInstance->ReadAhead) {
+        if (fileInformationClass == FileRenameInformation ||
+            fileInformationClass == FileRenameInformationEx) {
+          DokanReadAhead_Invalidate(IoEvent->DokanInstance->ReadAhead,
+                                    fileName, wcslen(fileName),
+                                    /*IncludeChildren=*/TRUE);
+        } else if (fileInformationClass == FileEndOfFileInformation ||
+                   fileInformationClass == FileAllocationInformation) {
+          DokanReadAhead_InvalidateEventFile(IoEvent->DokanInstance->ReadAhead,
+                                             IoEvent, fileName);
+        }
+      }
     }
   }
 
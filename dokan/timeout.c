@@ -22,6 +22,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <process.h>
 #include "dokani.h"
+#include "dokan_transport.h"
 
 BOOL DOKANAPI DokanResetTimeout(ULONG Timeout, PDOKAN_FILE_INFO FileInfo) {
   BOOL status;
@@ -29,7 +30,6 @@ BOOL DOKANAPI DokanResetTimeout(ULONG Timeout, PDOKAN_FILE_INFO FileInfo) {
   PDOKAN_IO_EVENT ioEvent;
   PEVENT_INFORMATION eventInfo;
   ULONG eventInfoSize = sizeof(EVENT_INFORMATION);
-  WCHAR rawDeviceName[MAX_PATH];
 
   ioEvent = (PDOKAN_IO_EVENT)(UINT_PTR)FileInfo->DokanContext;
   if (ioEvent->EventContext == NULL || ioEvent->DokanInstance == NULL) {
@@ -46,9 +46,9 @@ BOOL DOKANAPI DokanResetTimeout(ULONG Timeout, PDOKAN_FILE_INFO FileInfo) {
 
   eventInfo->SerialNumber = ioEvent->EventContext->SerialNumber;
   eventInfo->Operation.ResetTimeout.Timeout = Timeout;
-  GetRawDeviceName(ioEvent->DokanInstance->DeviceName, rawDeviceName, MAX_PATH);
-  status = SendToDevice(rawDeviceName, FSCTL_RESET_TIMEOUT, eventInfo,
-                        eventInfoSize, NULL, 0, &returnedLength);
+  status = DokanTransport_Control(ioEvent->DokanInstance, FSCTL_RESET_TIMEOUT,
+                                  eventInfo, eventInfoSize, NULL, 0,
+                                  &returnedLength);
   if (!status) {
     DbgPrintW(L"Failed to Reset Timeout for %04d with timeout: %04d\n",
               ioEvent->EventContext->SerialNumber, Timeout);
@@ -22,6 +22,11 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokani.h"
 #include "dokan_pool.h"
+#include "dokan_batch_sizer.h"
+#include "dokan_event_trace.h"
+#include "dokan_read_ahead.h"
+#include "dokan_transport.h"
+#include "dokan_write_coalescer.h"
 
 #include <assert.h>
 
@@ -29,8 +34,11 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 DWORD SendWriteRequest(PDOKAN_IO_EVENT IoEvent, ULONG WriteEventContextLength,
                        PDOKAN_IO_BATCH *WriteIoBatch) {
   DWORD WrittenLength = 0;
-  if (WriteEventContextLength <= BATCH_EVENT_CONTEXT_SIZE) {
-    *WriteIoBatch = PopIoBatchBuffer();
+  ULONG batchSize =
+      DokanIoBatchSizer_GetSize(IoEvent->DokanInstance->IoBatchSizer);
+  if (WriteEventContextLength <= batchSize) {
+    *WriteIoBatch =
+        PopIoBatchBuffer(IoEvent->DokanInstance->ObjectPools, batchSize);
   } else {
     PDOKAN_IO_BATCH buffer =
         malloc((SIZE_T)FIELD_OFFSET(DOKAN_IO_BATCH, EventContext) +
@@ -41,25 +49,94 @@ DWORD SendWriteRequest(PDOKAN_IO_EVENT IoEvent, ULONG WriteEventContextLength,
     }
     *WriteIoBatch = buffer;
     (*WriteIoBatch)->PoolAllocated = FALSE;
+    (*WriteIoBatch)->EventContextSize = WriteEventContextLength;
   }
 
-  if (!DeviceIoControl(
-          IoEvent->DokanInstance->Device,    // Handle to device
+  if (!DokanTransport_Control(
+          IoEvent->DokanInstance,            // Instance pulling the write
           FSCTL_EVENT_WRITE,                 // IO Control code
           IoEvent->EventResult,              // Input Buffer to driver.
           IoEvent->EventResultSize,          // Length of input buffer in bytes.
           &(*WriteIoBatch)->EventContext[0], // Output Buffer from driver.
           WriteEventContextLength, // Length of output buffer in bytes.
-          &WrittenLength,          // Bytes placed in buffer.
-          NULL                     // asynchronous call
+          &WrittenLength           // Bytes placed in buffer.
           )) {
     return GetLastError();
   }
+  DokanEventRecorder_RecordWrite(IoEvent->DokanInstance->EventRecorder,
+                                 &(*WriteIoBatch)->EventContext[0],
+                                 WrittenLength);
   return 0;
 }
 
+// Returns the write event of the buffer holding the data of the write: the event
+// itself unless the data were requested with FSCTL_EVENT_WRITE. The event is
+// not necessarily the first one of its batch.
+static PEVENT_CONTEXT GetWriteEventContext(PDOKAN_IO_EVENT IoEvent,
+                                           PDOKAN_IO_BATCH WriteIoBatch) {
+  return WriteIoBatch == IoEvent->IoBatch ? IoEvent->EventContext
+                                          : WriteIoBatch->EventContext;
+}
+
+static VOID ReleaseWriteIoBatch(PDOKAN_IO_EVENT IoEvent,
+                                PDOKAN_IO_BATCH WriteIoBatch) {
+  if (WriteIoBatch != IoEvent->IoBatch) {
+    if (WriteIoBatch->PoolAllocated) {
+      PushIoBatchBuffer(IoEvent->DokanInstance->ObjectPools, WriteIoBatch);
+    } else {
+      free(WriteIoBatch);
+    }
+  }
+}
+
+static VOID EndDispatchWrite(PDOKAN_IO_EVENT IoEvent,
+                             ULONG NumberOfBytesWritten, NTSTATUS Status) {
+  PDOKAN_IO_BATCH writeIoBatch =
+      (PDOKAN_IO_BATCH)IoEvent->DokanFileInfo.ProcessingContext;
+  LPCWSTR fileName = IoEvent->EventContext->Operation.Write.FileName;
+
+  // Even a failed write may have changed the size or times of the file
+  if (IoEvent->DokanInstance->FileInfoCache) {
+    DokanFileInfoCache_InvalidateFile(IoEvent->DokanInstance->FileInfoCache,
+                                      fileName, wcslen(fileName),
+                                      /*IncludeParent=*/FALSE);
+  }
+  DokanReadAhead_InvalidateEventFile(IoEvent->DokanInstance->ReadAhead, IoEvent,
+                                     fileName);
+
+  IoEvent->EventResult->Status = Status;
+  IoEvent->EventResult->BufferLength = 0;
+
+  if (Status == STATUS_SUCCESS) {
+    IoEvent->EventResult->BufferLength = NumberOfBytesWritten;
+    IoEvent->EventResult->Operation.Write.CurrentByteOffset.QuadPart =
+        GetWriteEventContext(IoEvent, writeIoBatch)
+            ->Operation.Write.ByteOffset.QuadPart +
+        NumberOfBytesWritten;
+  }
+
+  IoEvent->DokanFileInfo.ProcessingContext = NULL;
+  ReleaseWriteIoBatch(IoEvent, writeIoBatch);
+
+  EventCompletion(IoEvent);
+}
+
+VOID DOKANAPI DokanEndDispatchWrite(PDOKAN_FILE_INFO DokanFileInfo,
+                                    ULONG NumberOfBytesWritten,
+                                    NTSTATUS Status) {
+  PDOKAN_IO_EVENT ioEvent = (PDOKAN_IO_EVENT)DokanFileInfo->DokanContext;
+  assert(Status != STATUS_PENDING);
+  if (ioEvent->WriteCoalescingFlush) {
+    DokanWriteCoalescer_EndFlush(ioEvent, NumberOfBytesWritten, Status);
+    return;
+  }
+  EndDispatchWrite(ioEvent, NumberOfBytesWritten, Status);
+  CompletePendingEvent(ioEvent);
+}
+
 VOID DispatchWrite(PDOKAN_IO_EVENT IoEvent) {
   PDOKAN_IO_BATCH writeIoBatch = IoEvent->IoBatch;
+  PEVENT_CONTEXT writeEventContext;
   ULONG writtenLength = 0;
   NTSTATUS status;
 
@@ -67,6 +144,8 @@ VOID DispatchWrite(PDOKAN_IO_EVENT IoEvent) {
                        /*ClearNonPoolBuffer=*/TRUE);
 
   CheckFileName(IoEvent->EventContext->Operation.Write.FileName);
+  UpdateOpenInfoFileName(IoEvent,
+                         IoEvent->EventContext->Operation.Write.FileName);
   DbgPrint(
       "###WriteFile file handle = 0x%p, eventID = %04d, event Info = 0x%p\n",
       IoEvent->DokanOpenInfo,
@@ -92,49 +171,41 @@ VOID DispatchWrite(PDOKAN_IO_EVENT IoEvent) {
                  "EventContext had been destoryed. Status = %X. \n",
                  error, IoEvent->EventResult->Status);
       }
-      if (writeIoBatch != IoEvent->IoBatch) {
-        if (writeIoBatch->PoolAllocated) {
-          PushIoBatchBuffer(writeIoBatch);
-        } else {
-          free(writeIoBatch);
-        }
-      }
+      ReleaseWriteIoBatch(IoEvent, writeIoBatch);
       EventCompletion(IoEvent);
       return;
     }
   }
 
   // for the case SendWriteRequest success
+  // The buffer must outlive the callback when the write completes
+  // asynchronously. It is released by EndDispatchWrite.
+  IoEvent->DokanFileInfo.ProcessingContext = writeIoBatch;
+  writeEventContext = GetWriteEventContext(IoEvent, writeIoBatch);
+  if (IoEvent->DokanInstance->WriteCoalescer && IoEvent->DokanOpenInfo &&
+      DokanWriteCoalescer_Write(IoEvent->DokanInstance->WriteCoalescer,
+                                IoEvent, writeEventContext)) {
+    EndDispatchWrite(IoEvent, writeEventContext->Operation.Write.BufferLength,
+                     STATUS_SUCCESS);
+    return;
+  }
   if (IoEvent->DokanInstance->DokanOperations->WriteFile) {
     status = IoEvent->DokanInstance->DokanOperations->WriteFile(
-        writeIoBatch->EventContext->Operation.Write.FileName,
-        (PCHAR)writeIoBatch->EventContext +
-            writeIoBatch->EventContext->Operation.Write.BufferOffset,
-        writeIoBatch->EventContext->Operation.Write.BufferLength,
-        &writtenLength,
-        writeIoBatch->EventContext->Operation.Write.ByteOffset.QuadPart,
+        writeEventContext->Operation.Write.FileName,
+        (PCHAR)writeEventContext +
+            writeEventContext->Operation.Write.BufferOffset,
+        writeEventContext->Operation.Write.BufferLength, &writtenLength,
+        writeEventContext->Operation.Write.ByteOffset.QuadPart,
         &IoEvent->DokanFileInfo);
   } else {
     status = STATUS_NOT_IMPLEMENTED;
   }
 
-  IoEvent->EventResult->Status = status;
-  IoEvent->EventResult->BufferLength = 0;
-
-  if (status == STATUS_SUCCESS) {
-    IoEvent->EventResult->BufferLength = writtenLength;
-    IoEvent->EventResult->Operation.Write.CurrentByteOffset.QuadPart =
-        writeIoBatch->EventContext->Operation.Write.ByteOffset.QuadPart +
-        writtenLength;
+  if (status == STATUS_PENDING) {
+    // Completed by DokanEndDispatchWrite
+    DispatchPendingEvent(IoEvent);
+    return;
   }
 
-  if (writeIoBatch != IoEvent->IoBatch) {
-    if (writeIoBatch->PoolAllocated) {
-      PushIoBatchBuffer(writeIoBatch);
-    } else {
-      free(writeIoBatch);
-    }
-  }
-
-  EventCompletion(IoEvent);
+  EndDispatchWrite(IoEvent, writtenLength, status);
 }
@@ -0,0 +1,99 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// The parts of the library replaced on the host: there is no mount manager,
+// and the shim only knows the Win32 error codes below.
+
+#include "../dokan/dokani.h"
+
+BOOL DokanMount(PDOKAN_INSTANCE DokanInstance, PDOKAN_OPTIONS DokanOptions) {
+  UNREFERENCED_PARAMETER(DokanInstance);
+  UNREFERENCED_PARAMETER(DokanOptions);
+  return FALSE;
+}
+
+BOOL DOKANAPI DokanRemoveMountPoint(LPCWSTR MountPoint) {
+  UNREFERENCED_PARAMETER(MountPoint);
+  return FALSE;
+}
+
+VOID DokanNotifyUnmounted(PDOKAN_INSTANCE DokanInstance) {
+  UNREFERENCED_PARAMETER(DokanInstance);
+}
+
+NTSTATUS DOKANAPI DokanNtStatusFromWin32(DWORD Error) {
+  switch (Error) {
+  case ERROR_SUCCESS:
+    return STATUS_SUCCESS;
+  case ERROR_INVALID_FUNCTION:
+    return STATUS_NOT_IMPLEMENTED;
+  case ERROR_FILE_NOT_FOUND:
+    return STATUS_OBJECT_NAME_NOT_FOUND;
+  case ERROR_PATH_NOT_FOUND:
+    return STATUS_OBJECT_PATH_NOT_FOUND;
+  case ERROR_ACCESS_DENIED:
+    return STATUS_ACCESS_DENIED;
+  case ERROR_INVALID_HANDLE:
+    return STATUS_INVALID_HANDLE;
+  case ERROR_NOT_ENOUGH_MEMORY:
+    return STATUS_NO_MEMORY;
+  case ERROR_SHARING_VIOLATION:
+    return STATUS_SHARING_VIOLATION;
+  case ERROR_HANDLE_EOF:
+    return STATUS_END_OF_FILE;
+  case ERROR_NOT_SUPPORTED:
+    return STATUS_NOT_SUPPORTED;
+  case ERROR_FILE_EXISTS:
+  case ERROR_ALREADY_EXISTS:
+    return STATUS_OBJECT_NAME_COLLISION;
+  case ERROR_INVALID_PARAMETER:
+    return STATUS_INVALID_PARAMETER;
+  case ERROR_DISK_FULL:
+    return STATUS_DISK_FULL;
+  case ERROR_INSUFFICIENT_BUFFER:
+    return STATUS_BUFFER_TOO_SMALL;
+  case ERROR_INVALID_NAME:
+    return STATUS_OBJECT_NAME_INVALID;
+  case ERROR_DIR_NOT_EMPTY:
+    return STATUS_DIRECTORY_NOT_EMPTY;
+  case ERROR_BUSY:
+    return STATUS_DEVICE_BUSY;
+  case ERROR_MORE_DATA:
+    return STATUS_BUFFER_OVERFLOW;
+  case ERROR_DIRECTORY:
+    return STATUS_NOT_A_DIRECTORY;
+  case ERROR_OPERATION_ABORTED:
+    return STATUS_CANCELLED;
+  case ERROR_IO_PENDING:
+    return STATUS_PENDING;
+  case ERROR_NOT_FOUND:
+    return STATUS_NOT_FOUND;
+  case ERROR_NO_SYSTEM_RESOURCES:
+    return STATUS_INSUFFICIENT_RESOURCES;
+  case ERROR_TIMEOUT:
+    return STATUS_TIMEOUT;
+  case ERROR_TOO_MANY_OPEN_FILES:
+    return STATUS_INSUFFICIENT_RESOURCES;
+  default:
+    DbgPrintW(L"DokanNtStatusFromWin32 - Unknown Win32 error code %d\n", Error);
+    return STATUS_ACCESS_DENIED;
+  }
+}
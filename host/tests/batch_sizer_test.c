@@ -0,0 +1,127 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Tests the adaptive size of the IO batches and the release of the pooled
+// batches of a stale size.
+
+#include "test_fs.h"
+
+#include "../../dokan/dokan_batch_sizer.h"
+#include "../../dokan/dokan_pool.h"
+
+#define TEST_BATCH_COUNT 100
+
+// Grows to the largest size under full pulls, then shrinks back while idle
+// without waiting for DOKAN_IO_BATCH_SHRINK_PULLS empty pulls.
+static VOID TestIdleShrink(void) {
+  PDOKAN_IO_BATCH_SIZER sizer = DokanIoBatchSizer_Alloc(/*Adaptive=*/TRUE);
+  ULONG size;
+  ULONG emptyPulls = 0;
+  TEST_CHECK(sizer);
+  while ((size = DokanIoBatchSizer_GetSize(sizer)) <
+         DOKAN_IO_BATCH_MAX_EVENT_CONTEXT_SIZE) {
+    TEST_CHECK(DokanIoBatchSizer_RecordPull(sizer, size, size));
+  }
+  TEST_CHECK(!DokanIoBatchSizer_RecordPull(sizer, size, size));
+  TEST_CHECK(DokanIoBatchSizer_GetMainPullTimeout(sizer) ==
+             DOKAN_IO_BATCH_IDLE_PULL_TIMEOUT_MS);
+
+  // The empty pulls of the main pull threads, one per timeout.
+  while (DokanIoBatchSizer_GetMainPullTimeout(sizer)) {
+    size = DokanIoBatchSizer_GetSize(sizer);
+    Sleep(DOKAN_IO_BATCH_IDLE_PULL_TIMEOUT_MS);
+    if (DokanIoBatchSizer_RecordPull(sizer, size, 0)) {
+      TEST_CHECK(DokanIoBatchSizer_GetSize(sizer) == size / 2);
+    }
+    TEST_CHECK(++emptyPulls < DOKAN_IO_BATCH_SHRINK_PULLS);
+  }
+  TEST_CHECK(DokanIoBatchSizer_GetSize(sizer) ==
+             DOKAN_IO_BATCH_MIN_EVENT_CONTEXT_SIZE);
+  printf("idle shrink: %lu empty pulls\n", emptyPulls);
+
+  // A pull made with a previous size changes nothing.
+  TEST_CHECK(!DokanIoBatchSizer_RecordPull(
+      sizer, DOKAN_IO_BATCH_MAX_EVENT_CONTEXT_SIZE,
+      DOKAN_IO_BATCH_MAX_EVENT_CONTEXT_SIZE));
+  DokanIoBatchSizer_Free(sizer);
+
+  // Without IPC batching the size never changes and the main pull threads
+  // wait indefinitely.
+  sizer = DokanIoBatchSizer_Alloc(/*Adaptive=*/FALSE);
+  TEST_CHECK(sizer);
+  size = DokanIoBatchSizer_GetSize(sizer);
+  TEST_CHECK(!DokanIoBatchSizer_RecordPull(sizer, size, size));
+  TEST_CHECK(DokanIoBatchSizer_GetMainPullTimeout(sizer) == 0);
+  DokanIoBatchSizer_Free(sizer);
+}
+
+// The batches of a stale size are freed from the pool while the others stay.
+static VOID TestTrim(void) {
+  PDOKAN_OBJECT_POOLS pools = AllocObjectPools(0, 0);
+  PDOKAN_IO_BATCH batches[2 * TEST_BATCH_COUNT];
+  DOKAN_POOL_STATISTICS statistics;
+  ULONG staleSize = DOKAN_IO_BATCH_DEFAULT_EVENT_CONTEXT_SIZE;
+  ULONG size = DOKAN_IO_BATCH_DEFAULT_EVENT_CONTEXT_SIZE * 2;
+  TEST_CHECK(pools);
+  for (ULONG i = 0; i < 2 * TEST_BATCH_COUNT; ++i) {
+    batches[i] = PopIoBatchBuffer(pools, i % 2 ? size : staleSize);
+    TEST_CHECK(batches[i]);
+    batches[i]->EventContextBatchCount = 1;
+  }
+  // Enough to fill the magazines of the thread and spill some to the depot.
+  for (ULONG i = 0; i < 2 * TEST_BATCH_COUNT; ++i) {
+    PushIoBatchBuffer(pools, batches[i]);
+  }
+  GetPoolStatistics(pools, DokanPoolIoBatch, &statistics);
+  TEST_CHECK(statistics.DepotSpills > 0);
+  TEST_CHECK(statistics.CachedBytes ==
+             TEST_BATCH_COUNT * (LONG64)(DOKAN_IO_BATCH_SIZE(staleSize) +
+                                         DOKAN_IO_BATCH_SIZE(size)));
+
+  TrimIoBatchBuffers(pools, staleSize);
+  GetPoolStatistics(pools, DokanPoolIoBatch, &statistics);
+  TEST_CHECK(statistics.CachedBytes ==
+             TEST_BATCH_COUNT * (LONG64)DOKAN_IO_BATCH_SIZE(size));
+
+  // All the batches left are served from the pool.
+  for (ULONG i = 0; i < TEST_BATCH_COUNT; ++i) {
+    batches[i] = PopIoBatchBuffer(pools, size);
+    TEST_CHECK(batches[i] && batches[i]->EventContextSize == size);
+  }
+  GetPoolStatistics(pools, DokanPoolIoBatch, &statistics);
+  TEST_CHECK(statistics.CachedBytes == 0);
+  for (ULONG i = 0; i < TEST_BATCH_COUNT; ++i) {
+    FreeIoBatchBuffer(batches[i]);
+  }
+  FreeObjectPools(pools);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  DokanInit();
+  TestIdleShrink();
+  TestTrim();
+  DokanShutdown();
+  printf("batch sizer test passed\n");
+  return 0;
+}
@@ -0,0 +1,131 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Lists directories of growing sizes through the dispatch, with the listing
+// cached in the open and streamed with DOKAN_OPTION_STREAM_FIND_FILES, and
+// checks that the time per entry does not grow with the directory like when
+// every query rescanned the entries before its FileIndex.
+
+#include "test_fs.h"
+
+// Like FindNextFile.
+#define DIRECTORY_BENCHMARK_BUFFER_LENGTH 4096
+#define DIRECTORY_BENCHMARK_LISTINGS 2
+// Largest increase of the time per entry between the smallest and the
+// largest directory, which are 16 times apart.
+#define DIRECTORY_BENCHMARK_MAX_GROWTH 3.0
+
+static const ULONG g_EntryCounts[] = {12500, 25000, 50000, 100000, 200000};
+static ULONG g_EntryCount;
+
+// Lists g_EntryCount files named File<N>.txt, resuming at the entry a
+// streamed query starts at.
+static NTSTATUS DOKAN_CALLBACK
+GeneratedFindFiles(LPCWSTR FileName, PFillFindData FillFindData,
+                   PDOKAN_FILE_INFO DokanFileInfo) {
+  WIN32_FIND_DATAW findData;
+  UNREFERENCED_PARAMETER(FileName);
+  InterlockedIncrement64(&g_TestFsCounters.FindFiles);
+  ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
+  findData.dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+  for (ULONG i = DokanGetFindFilesStartIndex(DokanFileInfo); i < g_EntryCount;
+       ++i) {
+    swprintf_s(findData.cFileName, MAX_PATH, L"File%07lu.txt", i);
+    if (FillFindData(&findData, DokanFileInfo)) {
+      break;
+    }
+  }
+  return STATUS_SUCCESS;
+}
+
+// Returns the time per entry in nanoseconds.
+static double ListDirectory(ULONG EntryCount, BOOL Stream,
+                            LPCWSTR SearchPattern, ULONG MatchCount) {
+  DOKAN_OPTIONS options;
+  DOKAN_OPERATIONS operations;
+  DOKAN_LOOPBACK_WORKLOAD workload;
+  DOKAN_LOOPBACK_RESULT result;
+  double entryTime;
+
+  TestFs_InitializeOptions(&options);
+  if (Stream) {
+    options.Options |= DOKAN_OPTION_STREAM_FIND_FILES;
+  }
+  TestFs_Reset();
+  TestFs_Initialize(&operations);
+  operations.FindFiles = GeneratedFindFiles;
+  g_EntryCount = EntryCount;
+
+  ZeroMemory(&workload, sizeof(workload));
+  workload.Concurrency = 1;
+  workload.OpensPerFile = 1;
+  workload.OperationsPerOpen = DIRECTORY_BENCHMARK_LISTINGS;
+  workload.DirectoryQueryBufferLength = DIRECTORY_BENCHMARK_BUFFER_LENGTH;
+  workload.DirectorySearchPattern = SearchPattern;
+  TEST_CHECK(DokanRunLoopbackBenchmark(&options, &operations, &workload,
+                                       &result, NULL));
+  entryTime = result.ElapsedMicroseconds * 1000.0 /
+              ((double)EntryCount * DIRECTORY_BENCHMARK_LISTINGS);
+  // Without the create, cleanup and close.
+  printf("%s %6lu entries, %s: %llu queries, %llu us, %.1f ns per entry\n",
+         Stream ? "streamed" : "cached  ", EntryCount,
+         SearchPattern ? "filtered" : "all", result.Events - 3,
+         result.ElapsedMicroseconds, entryTime);
+  TEST_CHECK(result.InvalidReplies == 0);
+  TEST_CHECK(result.DirectoryEntries ==
+             (ULONG64)MatchCount * DIRECTORY_BENCHMARK_LISTINGS);
+  if (!Stream) {
+    // A single FindFiles per listing.
+    TEST_CHECK(g_TestFsCounters.FindFiles == DIRECTORY_BENCHMARK_LISTINGS);
+  }
+  return entryTime;
+}
+
+static VOID CheckLinear(BOOL Stream) {
+  ULONG count = sizeof(g_EntryCounts) / sizeof(g_EntryCounts[0]);
+  double firstTime = 0;
+  double lastTime = 0;
+  for (ULONG i = 0; i < count; ++i) {
+    lastTime = ListDirectory(g_EntryCounts[i], Stream, NULL, g_EntryCounts[i]);
+    if (!i) {
+      firstTime = lastTime;
+    }
+  }
+  TEST_CHECK(lastTime <= firstTime * DIRECTORY_BENCHMARK_MAX_GROWTH);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  ULONG largest = g_EntryCounts[sizeof(g_EntryCounts) /
+                                    sizeof(g_EntryCounts[0]) -
+                                1];
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  DokanInit();
+  CheckLinear(/*Stream=*/FALSE);
+  CheckLinear(/*Stream=*/TRUE);
+  // Filtered by the library, one name out of 10 matches.
+  ListDirectory(largest, /*Stream=*/FALSE, L"*1.txt", largest / 10);
+  ListDirectory(largest, /*Stream=*/TRUE, L"*1.txt", largest / 10);
+  DokanShutdown();
+  printf("directory benchmark passed\n");
+  return 0;
+}
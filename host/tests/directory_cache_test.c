@@ -0,0 +1,313 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Lists directories through the loopback with
+// DOKAN_OPTION_DIRECTORY_LIST_CACHE, changes them through the mount, behind
+// it with or without DokanNotifyCreate and DokanNotifyDelete, and checks
+// which listings are answered from the cache and that the next listing after
+// a change shows it. Then checks the expiration of the listings and their
+// eviction to stay within DOKAN_OPTIONS.DirectoryListCacheMaxSize.
+
+#include "test_loopback.h"
+
+#define DIRECTORY_CACHE_TIMEOUT_MS 60000
+#define DIRECTORY_CACHE_SHORT_TIMEOUT_MS 500
+#define DIRECTORY_CACHE_FILES 16
+#define DIRECTORY_CACHE_DIRECTORIES 3
+
+static VOID GetStatistics(PDOKAN_INSTANCE Instance,
+                          PDOKAN_CACHE_STATISTICS Statistics) {
+  TEST_CHECK(DokanGetCacheStatistics((DOKAN_HANDLE)Instance, NULL, Statistics));
+}
+
+static ULONG64 OpenDirectory(PDOKAN_INSTANCE Instance, LPCWSTR DirectoryName,
+                             ULONG CreateDisposition) {
+  ULONG64 context;
+  TEST_CHECK(TestLoopback_Create(Instance, DirectoryName, CreateDisposition,
+                                 /*Directory=*/TRUE, &context,
+                                 NULL) == STATUS_SUCCESS);
+  return context;
+}
+
+static VOID CreateFileThroughMount(PDOKAN_INSTANCE Instance,
+                                   LPCWSTR FileName) {
+  ULONG64 context;
+  ULONG information;
+  TEST_CHECK(TestLoopback_Create(Instance, FileName, FILE_CREATE,
+                                 /*Directory=*/FALSE, &context,
+                                 &information) == STATUS_SUCCESS);
+  TEST_CHECK(information == FILE_CREATED);
+  TestLoopback_Close(Instance, context, FileName, /*DeleteOnClose=*/FALSE);
+}
+
+// Lists the directory of the open and checks whether Name is in it and
+// whether the listing came from the cache. Returns the size of Name, -1 if
+// it is not listed.
+static LONG64 CheckListing(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                           LPCWSTR DirectoryName, LPCWSTR Name, BOOL Listed,
+                           BOOL Cached) {
+  DOKAN_CACHE_STATISTICS before;
+  DOKAN_CACHE_STATISTICS after;
+  LONG64 findFiles = g_TestFsCounters.FindFiles;
+  LONG64 size;
+  GetStatistics(Instance, &before);
+  TestLoopback_ListDirectory(Instance, Context, DirectoryName, Name, &size);
+  GetStatistics(Instance, &after);
+  TEST_CHECK((size >= 0) == Listed);
+  if (Cached) {
+    TEST_CHECK(g_TestFsCounters.FindFiles == findFiles);
+    TEST_CHECK(after.Hits == before.Hits + 1);
+  } else {
+    TEST_CHECK(g_TestFsCounters.FindFiles == findFiles + 1);
+    TEST_CHECK(after.Misses == before.Misses + 1);
+  }
+  return size;
+}
+
+static VOID TestInvalidations(void) {
+  DOKAN_OPERATIONS operations;
+  DOKAN_OPTIONS options;
+  DOKAN_CACHE_STATISTICS statistics;
+  PDOKAN_INSTANCE instance;
+  ULONG64 root;
+  ULONG64 directory;
+  ULONG64 context;
+
+  TestFs_Initialize(&operations);
+  TEST_CHECK(TestFs_AddFile(L"\\a", "a", 1));
+  TestFs_InitializeOptions(&options);
+  options.Options |= DOKAN_OPTION_DIRECTORY_LIST_CACHE;
+  options.DirectoryListCacheTimeout = DIRECTORY_CACHE_TIMEOUT_MS;
+  instance = TestLoopback_Start(&options, &operations);
+  root = OpenDirectory(instance, L"\\", FILE_OPEN);
+
+  // Another listing of the directory is answered from the cache.
+  CheckListing(instance, root, L"\\", L"a", /*Listed=*/TRUE,
+               /*Cached=*/FALSE);
+  CheckListing(instance, root, L"\\", L"a", /*Listed=*/TRUE, /*Cached=*/TRUE);
+
+  // A file added behind the mount is only listed once notified.
+  TEST_CHECK(TestFs_AddFile(L"\\b", "b", 1));
+  CheckListing(instance, root, L"\\", L"b", /*Listed=*/FALSE,
+               /*Cached=*/TRUE);
+  TEST_CHECK(DokanNotifyCreate((DOKAN_HANDLE)instance, L"M:\\b",
+                               /*IsDirectory=*/FALSE));
+  CheckListing(instance, root, L"\\", L"b", /*Listed=*/TRUE,
+               /*Cached=*/FALSE);
+
+  // A file created through the mount.
+  CreateFileThroughMount(instance, L"\\c");
+  CheckListing(instance, root, L"\\", L"c", /*Listed=*/TRUE,
+               /*Cached=*/FALSE);
+  CheckListing(instance, root, L"\\", L"c", /*Listed=*/TRUE, /*Cached=*/TRUE);
+
+  // A rename through the mount.
+  TEST_CHECK(TestLoopback_Create(instance, L"\\c", FILE_OPEN,
+                                 /*Directory=*/FALSE, &context,
+                                 NULL) == STATUS_SUCCESS);
+  TEST_CHECK(TestLoopback_Rename(instance, context, L"\\c", L"\\d") ==
+             STATUS_SUCCESS);
+  TestLoopback_Close(instance, context, L"\\d", /*DeleteOnClose=*/FALSE);
+  CheckListing(instance, root, L"\\", L"d", /*Listed=*/TRUE,
+               /*Cached=*/FALSE);
+  CheckListing(instance, root, L"\\", L"c", /*Listed=*/FALSE,
+               /*Cached=*/TRUE);
+
+  // A deletion through the mount.
+  TEST_CHECK(TestLoopback_Create(instance, L"\\d", FILE_OPEN,
+                                 /*Directory=*/FALSE, &context,
+                                 NULL) == STATUS_SUCCESS);
+  TestLoopback_Close(instance, context, L"\\d", /*DeleteOnClose=*/TRUE);
+  CheckListing(instance, root, L"\\", L"d", /*Listed=*/FALSE,
+               /*Cached=*/FALSE);
+
+  // A change of size through the mount.
+  TEST_CHECK(TestLoopback_Create(instance, L"\\a", FILE_OPEN,
+                                 /*Directory=*/FALSE, &context,
+                                 NULL) == STATUS_SUCCESS);
+  TEST_CHECK(TestLoopback_SetEndOfFile(instance, context, L"\\a", 100) ==
+             STATUS_SUCCESS);
+  TestLoopback_Close(instance, context, L"\\a", /*DeleteOnClose=*/FALSE);
+  TEST_CHECK(CheckListing(instance, root, L"\\", L"a", /*Listed=*/TRUE,
+                          /*Cached=*/FALSE) == 100);
+
+  // A file created in a subdirectory only drops the listing of the
+  // subdirectory.
+  directory = OpenDirectory(instance, L"\\dir", FILE_CREATE);
+  CheckListing(instance, directory, L"\\dir", L"e", /*Listed=*/FALSE,
+               /*Cached=*/FALSE);
+  CheckListing(instance, root, L"\\", L"dir", /*Listed=*/TRUE,
+               /*Cached=*/FALSE);
+  CreateFileThroughMount(instance, L"\\dir\\e");
+  CheckListing(instance, directory, L"\\dir", L"e", /*Listed=*/TRUE,
+               /*Cached=*/FALSE);
+  CheckListing(instance, root, L"\\", L"dir", /*Listed=*/TRUE,
+               /*Cached=*/TRUE);
+
+  // A subdirectory deleted behind the mount and notified drops its listing
+  // and the one of its parent.
+  TestFs_Find(L"\\dir")->Name[0] = L'\0';
+  TEST_CHECK(DokanNotifyDelete((DOKAN_HANDLE)instance, L"M:\\dir",
+                               /*IsDirectory=*/TRUE));
+  CheckListing(instance, root, L"\\", L"dir", /*Listed=*/FALSE,
+               /*Cached=*/FALSE);
+  CheckListing(instance, directory, L"\\dir", L"e", /*Listed=*/TRUE,
+               /*Cached=*/FALSE);
+
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(statistics.Invalidations > 0);
+  TEST_CHECK(statistics.Evictions == 0);
+  TestLoopback_Close(instance, directory, L"\\dir", /*DeleteOnClose=*/FALSE);
+  TestLoopback_Close(instance, root, L"\\", /*DeleteOnClose=*/FALSE);
+  TestLoopback_Stop(instance);
+  TestFs_Reset();
+}
+
+// A change behind the mount shows once the listing expired.
+static VOID TestExpiration(void) {
+  DOKAN_OPERATIONS operations;
+  DOKAN_OPTIONS options;
+  PDOKAN_INSTANCE instance;
+  ULONG64 root;
+
+  TestFs_Initialize(&operations);
+  TestFs_InitializeOptions(&options);
+  options.Options |= DOKAN_OPTION_DIRECTORY_LIST_CACHE;
+  options.DirectoryListCacheTimeout = DIRECTORY_CACHE_SHORT_TIMEOUT_MS;
+  instance = TestLoopback_Start(&options, &operations);
+  root = OpenDirectory(instance, L"\\", FILE_OPEN);
+
+  CheckListing(instance, root, L"\\", L"a", /*Listed=*/FALSE,
+               /*Cached=*/FALSE);
+  TEST_CHECK(TestFs_AddFile(L"\\a", "a", 1));
+  CheckListing(instance, root, L"\\", L"a", /*Listed=*/FALSE,
+               /*Cached=*/TRUE);
+  Sleep(2 * DIRECTORY_CACHE_SHORT_TIMEOUT_MS);
+  CheckListing(instance, root, L"\\", L"a", /*Listed=*/TRUE,
+               /*Cached=*/FALSE);
+
+  TestLoopback_Close(instance, root, L"\\", /*DeleteOnClose=*/FALSE);
+  TestLoopback_Stop(instance);
+  TestFs_Reset();
+}
+
+// Creates the directories \dir<N> holding the same number of files, so that
+// their listings use the same memory.
+static VOID CreateDirectories(PDOKAN_INSTANCE Instance) {
+  for (ULONG i = 0; i < DIRECTORY_CACHE_DIRECTORIES; ++i) {
+    WCHAR directoryName[MAX_PATH];
+    ULONG64 context;
+    swprintf_s(directoryName, MAX_PATH, L"\\dir%lu", i);
+    context = OpenDirectory(Instance, directoryName, FILE_CREATE);
+    TestLoopback_Close(Instance, context, directoryName,
+                       /*DeleteOnClose=*/FALSE);
+    for (ULONG j = 0; j < DIRECTORY_CACHE_FILES; ++j) {
+      WCHAR fileName[MAX_PATH];
+      swprintf_s(fileName, MAX_PATH, L"%s\\file%lu", directoryName, j);
+      CreateFileThroughMount(Instance, fileName);
+    }
+  }
+}
+
+static VOID ListDirectory(PDOKAN_INSTANCE Instance, ULONG Index,
+                          BOOL Cached) {
+  WCHAR directoryName[MAX_PATH];
+  ULONG64 context;
+  swprintf_s(directoryName, MAX_PATH, L"\\dir%lu", Index);
+  context = OpenDirectory(Instance, directoryName, FILE_OPEN);
+  CheckListing(Instance, context, directoryName, L"file0", /*Listed=*/TRUE,
+               Cached);
+  TestLoopback_Close(Instance, context, directoryName,
+                     /*DeleteOnClose=*/FALSE);
+}
+
+// Starts an instance caching the listings within MaxSize, 0 for the default,
+// with the directories of CreateDirectories.
+static PDOKAN_INSTANCE StartWithDirectories(PDOKAN_OPERATIONS Operations,
+                                            ULONG MaxSize) {
+  DOKAN_OPTIONS options;
+  PDOKAN_INSTANCE instance;
+  TestFs_Initialize(Operations);
+  TestFs_InitializeOptions(&options);
+  options.Options |= DOKAN_OPTION_DIRECTORY_LIST_CACHE;
+  options.DirectoryListCacheTimeout = DIRECTORY_CACHE_TIMEOUT_MS;
+  options.DirectoryListCacheMaxSize = MaxSize;
+  instance = TestLoopback_Start(&options, Operations);
+  CreateDirectories(instance);
+  return instance;
+}
+
+static VOID StopWithDirectories(PDOKAN_INSTANCE Instance) {
+  TestLoopback_Stop(Instance);
+  TestFs_Reset();
+}
+
+// The least recently used listings are evicted to stay within the memory
+// budget, and a listing larger than it is not kept.
+static VOID TestMemoryBudget(void) {
+  DOKAN_OPERATIONS operations;
+  DOKAN_CACHE_STATISTICS statistics;
+  PDOKAN_INSTANCE instance;
+  ULONG listingSize;
+
+  // The memory used by the listing of one directory.
+  instance = StartWithDirectories(&operations, 0);
+  ListDirectory(instance, 0, /*Cached=*/FALSE);
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(statistics.EntryCount == 1 && statistics.MemoryUsage > 0);
+  listingSize = (ULONG)statistics.MemoryUsage;
+  StopWithDirectories(instance);
+
+  // Room for a single listing.
+  instance = StartWithDirectories(&operations, listingSize + listingSize / 2);
+  for (ULONG i = 0; i < DIRECTORY_CACHE_DIRECTORIES; ++i) {
+    ListDirectory(instance, i, /*Cached=*/FALSE);
+    GetStatistics(instance, &statistics);
+    TEST_CHECK(statistics.EntryCount == 1);
+    TEST_CHECK(statistics.MemoryUsage == listingSize);
+    TEST_CHECK(statistics.Evictions == i);
+  }
+  ListDirectory(instance, DIRECTORY_CACHE_DIRECTORIES - 1, /*Cached=*/TRUE);
+  ListDirectory(instance, 0, /*Cached=*/FALSE);
+  StopWithDirectories(instance);
+
+  // No room for any listing.
+  instance = StartWithDirectories(&operations, listingSize - 1);
+  ListDirectory(instance, 0, /*Cached=*/FALSE);
+  ListDirectory(instance, 0, /*Cached=*/FALSE);
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(statistics.EntryCount == 0 && statistics.MemoryUsage == 0);
+  TEST_CHECK(statistics.Evictions == 0);
+  StopWithDirectories(instance);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  DokanInit();
+  TestInvalidations();
+  TestExpiration();
+  TestMemoryBudget();
+  DokanShutdown();
+  printf("directory cache test passed\n");
+  return 0;
+}
@@ -0,0 +1,90 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Pushes a million events through the batching dispatch, where all the
+// events of a batch but one go through the dispatch queue of the instance,
+// then through the former path that created a thread pool work per event.
+
+#include "test_fs.h"
+
+#include "../../dokan/dokani.h"
+
+#define EVENT_BENCHMARK_CONCURRENCY 64
+#define EVENT_BENCHMARK_OPENS_PER_FILE 16
+// With the create, cleanup and close, 1024 events per open.
+#define EVENT_BENCHMARK_OPERATIONS_PER_OPEN 1021
+
+// Returns the duration of the run.
+static ULONG64 RunEvents(LPCSTR Path) {
+  DOKAN_OPTIONS options;
+  DOKAN_OPERATIONS operations;
+  DOKAN_LOOPBACK_WORKLOAD workload;
+  DOKAN_LOOPBACK_RESULT result;
+  ULONG64 events = (ULONG64)EVENT_BENCHMARK_CONCURRENCY *
+                   EVENT_BENCHMARK_OPENS_PER_FILE *
+                   (EVENT_BENCHMARK_OPERATIONS_PER_OPEN + 3);
+
+  TestFs_Reset();
+  TestFs_InitializeOptions(&options);
+  options.Options |= DOKAN_OPTION_ALLOW_IPC_BATCHING;
+  TestFs_Initialize(&operations);
+
+  ZeroMemory(&workload, sizeof(workload));
+  workload.Concurrency = EVENT_BENCHMARK_CONCURRENCY;
+  workload.OpensPerFile = EVENT_BENCHMARK_OPENS_PER_FILE;
+  workload.OperationsPerOpen = EVENT_BENCHMARK_OPERATIONS_PER_OPEN;
+  workload.ReadWeight = 1;
+  workload.WriteWeight = 1;
+  workload.QueryInformationWeight = 2;
+  workload.IoSize = 512;
+  workload.Seed = 1;
+  TEST_CHECK(DokanRunLoopbackBenchmark(&options, &operations, &workload,
+                                       &result, NULL));
+  printf("%s: %llu events in %llu pulls, %.1f events per pull, %llu us, "
+         "%.0f events/s\n",
+         Path, result.Events, result.Pulls,
+         (double)result.Events / result.Pulls, result.ElapsedMicroseconds,
+         result.ElapsedMicroseconds
+             ? result.Events * 1000000.0 / result.ElapsedMicroseconds
+             : 0.0);
+  TEST_CHECK(result.InvalidReplies == 0);
+  TEST_CHECK(result.Events == events);
+  return result.ElapsedMicroseconds;
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  ULONG64 queueTime;
+  ULONG64 workTime;
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  DokanInit();
+  queueTime = RunEvents("dispatch queue");
+  g_DokanWorkPerBatchEvent = TRUE;
+  workTime = RunEvents("work per event");
+  g_DokanWorkPerBatchEvent = FALSE;
+  printf("dispatch queue %llu us, work per event %llu us, %.2fx\n", queueTime,
+         workTime, queueTime ? (double)workTime / queueTime : 0.0);
+
+  DokanShutdown();
+  printf("event benchmark passed\n");
+  return 0;
+}
@@ -0,0 +1,105 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Measures the cost of sending and dispatching the file names of the reads,
+// writes and queries of deep files, with and without
+// DOKAN_OPTION_OMIT_IO_FILE_NAMES, and checks that the callbacks still get the
+// name of the open from DokanGetFileName when it is omitted.
+
+#include "test_fs.h"
+
+static DOKAN_OPERATIONS g_TestFsOperations;
+static volatile LONG64 g_OmittedNames;
+static volatile LONG64 g_WrongNames;
+
+// Queries of the test file system that check the name of the open when the
+// event omitted it.
+static NTSTATUS DOKAN_CALLBACK CheckNameGetFileInformation(
+    LPCWSTR FileName, LPBY_HANDLE_FILE_INFORMATION Buffer,
+    PDOKAN_FILE_INFO DokanFileInfo) {
+  PTEST_FS_FILE file = TestFs_GetOpenFile(DokanFileInfo);
+  if (FileName[0] == L'\0' && file) {
+    WCHAR fileName[TEST_FS_NAME_MAX];
+    InterlockedIncrement64(&g_OmittedNames);
+    if (DokanGetFileName(DokanFileInfo, fileName, TEST_FS_NAME_MAX) !=
+            STATUS_SUCCESS ||
+        wcscmp(fileName, file->Name) != 0) {
+      InterlockedIncrement64(&g_WrongNames);
+    }
+  }
+  return g_TestFsOperations.GetFileInformation(FileName, Buffer,
+                                               DokanFileInfo);
+}
+
+static VOID RunWorkload(ULONG FileNameDepth, BOOL OmitIoFileNames) {
+  DOKAN_OPTIONS options;
+  DOKAN_OPERATIONS operations;
+  DOKAN_LOOPBACK_WORKLOAD workload;
+  DOKAN_LOOPBACK_RESULT result;
+
+  TestFs_InitializeOptions(&options);
+  options.Options |= DOKAN_OPTION_ALLOW_IPC_BATCHING;
+  if (OmitIoFileNames) {
+    options.Options |= DOKAN_OPTION_OMIT_IO_FILE_NAMES;
+  }
+  ZeroMemory(&workload, sizeof(workload));
+  workload.Concurrency = 64;
+  workload.OpensPerFile = 4;
+  workload.OperationsPerOpen = 256;
+  workload.ReadWeight = 1;
+  workload.WriteWeight = 1;
+  workload.QueryInformationWeight = 2;
+  workload.IoSize = 64;
+  workload.Seed = 1;
+  workload.FileNameDepth = FileNameDepth;
+
+  TestFs_Reset();
+  TestFs_Initialize(&g_TestFsOperations);
+  operations = g_TestFsOperations;
+  operations.GetFileInformation = CheckNameGetFileInformation;
+  g_OmittedNames = 0;
+  g_WrongNames = 0;
+  TEST_CHECK(DokanRunLoopbackBenchmark(&options, &operations, &workload,
+                                       &result, NULL));
+  TEST_CHECK(result.InvalidReplies == 0);
+  TEST_CHECK(g_WrongNames == 0);
+  TEST_CHECK((g_OmittedNames != 0) == (OmitIoFileNames != FALSE));
+  printf("depth %lu, %s names: %llu events in %llu us, %.0f events/s\n",
+         FileNameDepth, OmitIoFileNames ? "omitted" : "full", result.Events,
+         result.ElapsedMicroseconds,
+         result.ElapsedMicroseconds
+             ? result.Events * 1000000.0 / result.ElapsedMicroseconds
+             : 0.0);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  DokanInit();
+  RunWorkload(0, FALSE);
+  RunWorkload(0, TRUE);
+  RunWorkload(DOKAN_LOOPBACK_MAX_FILE_NAME_DEPTH, FALSE);
+  RunWorkload(DOKAN_LOOPBACK_MAX_FILE_NAME_DEPTH, TRUE);
+  DokanShutdown();
+  printf("file name benchmark passed\n");
+  return 0;
+}
@@ -0,0 +1,182 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Queries file information through the loopback with
+// DOKAN_OPTION_FILE_INFO_CACHE, checks with the hit and miss counters of
+// DokanGetCacheStatistics which queries are answered from the cache,
+// including the ones filled by a directory listing, then changes the file by
+// a write, a truncation and a rename and checks that the next query returns
+// the new information.
+
+#include "test_loopback.h"
+
+#define FILE_INFO_CACHE_TIMEOUT_MS 60000
+
+static VOID GetStatistics(PDOKAN_INSTANCE Instance,
+                          PDOKAN_CACHE_STATISTICS Statistics) {
+  TEST_CHECK(DokanGetCacheStatistics((DOKAN_HANDLE)Instance, Statistics, NULL));
+}
+
+static ULONG64 OpenFile(PDOKAN_INSTANCE Instance, LPCWSTR FileName) {
+  ULONG64 context;
+  TEST_CHECK(TestLoopback_Create(Instance, FileName, FILE_OPEN,
+                                 /*Directory=*/FALSE, &context,
+                                 NULL) == STATUS_SUCCESS);
+  return context;
+}
+
+// Queries the FileStandardInformation or FileNetworkOpenInformation of the
+// open, checks whether it came from the cache and returns the end of file.
+static LONG64 QueryEndOfFile(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                             LPCWSTR FileName, ULONG FileInformationClass,
+                             BOOL Cached) {
+  DOKAN_CACHE_STATISTICS before;
+  DOKAN_CACHE_STATISTICS after;
+  FILE_STANDARD_INFORMATION standardInfo;
+  FILE_NETWORK_OPEN_INFORMATION networkOpenInfo;
+  LONG64 queries = g_TestFsCounters.Queries;
+  LONG64 endOfFile;
+  GetStatistics(Instance, &before);
+  if (FileInformationClass == FileStandardInformation) {
+    TEST_CHECK(TestLoopback_QueryInformation(
+                   Instance, Context, FileName, FileStandardInformation,
+                   &standardInfo, sizeof(standardInfo)) == STATUS_SUCCESS);
+    endOfFile = standardInfo.EndOfFile.QuadPart;
+  } else {
+    TEST_CHECK(TestLoopback_QueryInformation(
+                   Instance, Context, FileName, FileNetworkOpenInformation,
+                   &networkOpenInfo,
+                   sizeof(networkOpenInfo)) == STATUS_SUCCESS);
+    endOfFile = networkOpenInfo.EndOfFile.QuadPart;
+  }
+  GetStatistics(Instance, &after);
+  if (Cached) {
+    TEST_CHECK(g_TestFsCounters.Queries == queries);
+    TEST_CHECK(after.Hits == before.Hits + 1 && after.Misses == before.Misses);
+  } else {
+    TEST_CHECK(g_TestFsCounters.Queries == queries + 1);
+    TEST_CHECK(after.Misses == before.Misses + 1 && after.Hits == before.Hits);
+  }
+  return endOfFile;
+}
+
+// Checks that the change of the file dropped its cached information and that
+// the next query returns EndOfFile.
+static VOID CheckFreshQuery(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                            LPCWSTR FileName, LONG64 EndOfFile,
+                            const DOKAN_CACHE_STATISTICS *Before) {
+  DOKAN_CACHE_STATISTICS statistics;
+  GetStatistics(Instance, &statistics);
+  TEST_CHECK(statistics.Invalidations > Before->Invalidations);
+  TEST_CHECK(QueryEndOfFile(Instance, Context, FileName,
+                            FileStandardInformation,
+                            /*Cached=*/FALSE) == EndOfFile);
+  TEST_CHECK(QueryEndOfFile(Instance, Context, FileName,
+                            FileStandardInformation,
+                            /*Cached=*/TRUE) == EndOfFile);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  DOKAN_OPERATIONS operations;
+  DOKAN_OPTIONS options;
+  DOKAN_CACHE_STATISTICS statistics;
+  DOKAN_CACHE_STATISTICS otherStatistics;
+  PDOKAN_INSTANCE instance;
+  ULONG64 root;
+  ULONG64 context;
+  ULONG64 otherContext;
+  LONG64 size;
+  CHAR data[100];
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  DokanInit();
+  TestFs_Initialize(&operations);
+  FillMemory(data, sizeof(data), 'a');
+  TEST_CHECK(TestFs_AddFile(L"\\a", data, 10));
+  TEST_CHECK(TestFs_AddFile(L"\\b", data, 20));
+  TestFs_InitializeOptions(&options);
+  options.Options |= DOKAN_OPTION_FILE_INFO_CACHE;
+  options.FileInfoCacheTimeout = FILE_INFO_CACHE_TIMEOUT_MS;
+  instance = TestLoopback_Start(&options, &operations);
+
+  // The information of an open is cached for the next queries.
+  context = OpenFile(instance, L"\\a");
+  TEST_CHECK(QueryEndOfFile(instance, context, L"\\a",
+                            FileStandardInformation, /*Cached=*/FALSE) == 10);
+  TEST_CHECK(QueryEndOfFile(instance, context, L"\\a",
+                            FileStandardInformation, /*Cached=*/TRUE) == 10);
+  TEST_CHECK(QueryEndOfFile(instance, context, L"\\a",
+                            FileNetworkOpenInformation, /*Cached=*/TRUE) == 10);
+
+  // A listing answers the queries of the entries it holds, of any open, but
+  // only for the classes it has all the fields of.
+  TEST_CHECK(TestLoopback_Create(instance, L"\\", FILE_OPEN,
+                                 /*Directory=*/TRUE, &root,
+                                 NULL) == STATUS_SUCCESS);
+  TestLoopback_ListDirectory(instance, root, L"\\", L"b", &size);
+  TEST_CHECK(size == 20);
+  TestLoopback_Close(instance, root, L"\\", /*DeleteOnClose=*/FALSE);
+  otherContext = OpenFile(instance, L"\\b");
+  TEST_CHECK(QueryEndOfFile(instance, otherContext, L"\\b",
+                            FileNetworkOpenInformation, /*Cached=*/TRUE) == 20);
+  TEST_CHECK(QueryEndOfFile(instance, otherContext, L"\\b",
+                            FileStandardInformation, /*Cached=*/FALSE) == 20);
+  TestLoopback_Close(instance, otherContext, L"\\b", /*DeleteOnClose=*/FALSE);
+
+  // A write from another open.
+  otherContext = OpenFile(instance, L"\\a");
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(TestLoopback_Write(instance, otherContext, L"\\a", 10, data,
+                                30) == STATUS_SUCCESS);
+  TestLoopback_Close(instance, otherContext, L"\\a", /*DeleteOnClose=*/FALSE);
+  CheckFreshQuery(instance, context, L"\\a", 40, &statistics);
+
+  // A write from the same open.
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(TestLoopback_Write(instance, context, L"\\a", 40, data, 10) ==
+             STATUS_SUCCESS);
+  CheckFreshQuery(instance, context, L"\\a", 50, &statistics);
+
+  // A truncation.
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(TestLoopback_SetEndOfFile(instance, context, L"\\a", 5) ==
+             STATUS_SUCCESS);
+  CheckFreshQuery(instance, context, L"\\a", 5, &statistics);
+
+  // A rename drops the entries of the old name, the open is then queried
+  // under the new one.
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(TestLoopback_Rename(instance, context, L"\\a", L"\\c") ==
+             STATUS_SUCCESS);
+  GetStatistics(instance, &otherStatistics);
+  TEST_CHECK(otherStatistics.EntryCount < statistics.EntryCount);
+  CheckFreshQuery(instance, context, L"\\c", 5, &statistics);
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(statistics.Evictions == 0);
+
+  TestLoopback_Close(instance, context, L"\\c", /*DeleteOnClose=*/FALSE);
+  TestLoopback_Stop(instance);
+  TestFs_Reset();
+  DokanShutdown();
+  printf("file info cache test passed\n");
+  return 0;
+}
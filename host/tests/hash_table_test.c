@@ -0,0 +1,277 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Tests the FCB table of sys/util/hash_table.h the way sys/util/fcb.c uses
+// it, with case-insensitive file names and growth, and compares its lookups
+// with the AVL table of the FCBs it replaced.
+
+#include "test_fs.h"
+
+#include "../../sys/util/hash_table.h"
+
+#define TEST_FCB_COUNT 100000
+#define TEST_INITIAL_BUCKET_COUNT 256
+#define TEST_NAME_MAX 64
+
+typedef struct _TEST_AVL_NODE {
+  struct _TEST_AVL_NODE* Children[2];
+  LONG Height;
+} TEST_AVL_NODE, *PTEST_AVL_NODE;
+
+typedef struct _TEST_FCB {
+  DOKAN_HASH_TABLE_LINK Link;
+  TEST_AVL_NODE AvlNode;
+  WCHAR FileName[TEST_NAME_MAX];
+} TEST_FCB, *PTEST_FCB;
+
+static DOKAN_HASH_TABLE g_Table;
+static PDOKAN_HASH_TABLE_LINK g_InitialBuckets[TEST_INITIAL_BUCKET_COUNT];
+static PTEST_AVL_NODE g_AvlRoot;
+
+// Like HashFcbFileName on a case-insensitive volume.
+static ULONG HashFileName(LPCWSTR FileName) {
+  ULONG hash = DOKAN_HASH_TABLE_HASH_INIT;
+  for (; *FileName; ++FileName) {
+    hash = DokanHashTableHashChar(hash, towupper(*FileName));
+  }
+  return hash;
+}
+
+// Like RtlCompareUnicodeString with CaseInSensitive set.
+static LONG CompareFileName(LPCWSTR First, LPCWSTR Second) {
+  for (;; ++First, ++Second) {
+    WCHAR first = towupper(*First);
+    WCHAR second = towupper(*Second);
+    if (first != second || !first) {
+      return (LONG)first - (LONG)second;
+    }
+  }
+}
+
+static PTEST_FCB FindFcb(LPCWSTR FileName, ULONG Hash) {
+  for (PDOKAN_HASH_TABLE_LINK link = DokanHashTableFind(&g_Table, Hash);
+       link != NULL; link = DokanHashTableFindNext(link)) {
+    PTEST_FCB fcb = CONTAINING_RECORD(link, TEST_FCB, Link);
+    if (CompareFileName(fcb->FileName, FileName) == 0) {
+      return fcb;
+    }
+  }
+  return NULL;
+}
+
+// Like InsertFcb, grows the table 4 times when it gets too loaded.
+static VOID InsertFcb(PTEST_FCB Fcb, ULONG Hash) {
+  ULONG bucketCount;
+  PDOKAN_HASH_TABLE_LINK* buckets;
+  DokanHashTableInsert(&g_Table, &Fcb->Link, Hash);
+  if (!DokanHashTableShouldGrow(&g_Table)) {
+    return;
+  }
+  bucketCount = g_Table.BucketCount * 4;
+  buckets = calloc(bucketCount, sizeof(PDOKAN_HASH_TABLE_LINK));
+  TEST_CHECK(buckets);
+  buckets = DokanHashTableRehash(&g_Table, buckets, bucketCount);
+  if (buckets != g_InitialBuckets) {
+    free(buckets);
+  }
+}
+
+static LONG AvlHeight(PTEST_AVL_NODE Node) { return Node ? Node->Height : 0; }
+
+static PTEST_AVL_NODE AvlUpdate(PTEST_AVL_NODE Node) {
+  Node->Height = 1 + max(AvlHeight(Node->Children[0]),
+                         AvlHeight(Node->Children[1]));
+  return Node;
+}
+
+// Rotates the child of side Side up.
+static PTEST_AVL_NODE AvlRotate(PTEST_AVL_NODE Node, int Side) {
+  PTEST_AVL_NODE child = Node->Children[Side];
+  Node->Children[Side] = child->Children[!Side];
+  child->Children[!Side] = AvlUpdate(Node);
+  return AvlUpdate(child);
+}
+
+static PTEST_AVL_NODE AvlBalance(PTEST_AVL_NODE Node) {
+  LONG balance;
+  AvlUpdate(Node);
+  balance = AvlHeight(Node->Children[1]) - AvlHeight(Node->Children[0]);
+  if (balance > 1 || balance < -1) {
+    int side = balance > 1;
+    PTEST_AVL_NODE child = Node->Children[side];
+    if (AvlHeight(child->Children[!side]) > AvlHeight(child->Children[side])) {
+      Node->Children[side] = AvlRotate(child, !side);
+    }
+    return AvlRotate(Node, side);
+  }
+  return Node;
+}
+
+static PTEST_AVL_NODE AvlInsert(PTEST_AVL_NODE Root, PTEST_FCB Fcb) {
+  int side;
+  if (!Root) {
+    Fcb->AvlNode.Children[0] = NULL;
+    Fcb->AvlNode.Children[1] = NULL;
+    Fcb->AvlNode.Height = 1;
+    return &Fcb->AvlNode;
+  }
+  side = CompareFileName(
+             Fcb->FileName,
+             CONTAINING_RECORD(Root, TEST_FCB, AvlNode)->FileName) > 0;
+  Root->Children[side] = AvlInsert(Root->Children[side], Fcb);
+  return AvlBalance(Root);
+}
+
+static PTEST_FCB AvlFind(LPCWSTR FileName) {
+  PTEST_AVL_NODE node = g_AvlRoot;
+  while (node) {
+    PTEST_FCB fcb = CONTAINING_RECORD(node, TEST_FCB, AvlNode);
+    LONG result = CompareFileName(FileName, fcb->FileName);
+    if (result == 0) {
+      return fcb;
+    }
+    node = node->Children[result > 0];
+  }
+  return NULL;
+}
+
+// Deep names sharing long prefixes, like the files of a source tree.
+static VOID FormatFileName(ULONG Index, PWCHAR FileName) {
+  swprintf_s(FileName, TEST_NAME_MAX, L"\\Projects\\Dokan\\Dir%lu\\File%lu.txt",
+           Index % 256, Index);
+}
+
+static VOID TestTable(PTEST_FCB Fcbs) {
+  WCHAR fileName[TEST_NAME_MAX];
+  ULONG enumerated = 0;
+  for (ULONG i = 0; i < TEST_FCB_COUNT; ++i) {
+    TEST_CHECK(FindFcb(Fcbs[i].FileName, HashFileName(Fcbs[i].FileName)) ==
+               &Fcbs[i]);
+  }
+  TEST_CHECK(g_Table.BucketCount > TEST_INITIAL_BUCKET_COUNT);
+  TEST_CHECK(!DokanHashTableShouldGrow(&g_Table));
+
+  // Names differing by case get the same FCB.
+  FormatFileName(1234, fileName);
+  for (PWCHAR c = fileName; *c; ++c) {
+    *c = towupper(*c);
+  }
+  TEST_CHECK(FindFcb(fileName, HashFileName(fileName)) == &Fcbs[1234]);
+  FormatFileName(TEST_FCB_COUNT, fileName);
+  TEST_CHECK(FindFcb(fileName, HashFileName(fileName)) == NULL);
+
+  for (PDOKAN_HASH_TABLE_LINK link = DokanHashTableEnumerate(&g_Table, NULL);
+       link != NULL; link = DokanHashTableEnumerate(&g_Table, link)) {
+    ++enumerated;
+  }
+  TEST_CHECK(enumerated == TEST_FCB_COUNT);
+
+  for (ULONG i = 0; i < TEST_FCB_COUNT; i += 2) {
+    DokanHashTableRemove(&g_Table, &Fcbs[i].Link);
+    DokanHashTableRemove(&g_Table, &Fcbs[i].Link);
+  }
+  TEST_CHECK(g_Table.Count == TEST_FCB_COUNT / 2);
+  for (ULONG i = 0; i < TEST_FCB_COUNT; ++i) {
+    TEST_CHECK(FindFcb(Fcbs[i].FileName, HashFileName(Fcbs[i].FileName)) ==
+               (i % 2 ? &Fcbs[i] : NULL));
+  }
+  for (ULONG i = 0; i < TEST_FCB_COUNT; i += 2) {
+    DokanHashTableInsert(&g_Table, &Fcbs[i].Link,
+                         HashFileName(Fcbs[i].FileName));
+  }
+}
+
+// Entries with the same hash are all found, and told apart by their names.
+static VOID TestCollisions(void) {
+  TEST_FCB fcbs[8];
+  DOKAN_HASH_TABLE table;
+  PDOKAN_HASH_TABLE_LINK buckets[4];
+  ULONG found = 0;
+  ZeroMemory(buckets, sizeof(buckets));
+  ZeroMemory(fcbs, sizeof(fcbs));
+  DokanHashTableInitialize(&table, buckets, 4);
+  for (ULONG i = 0; i < 8; ++i) {
+    DokanHashTableInitializeLink(&fcbs[i].Link);
+    DokanHashTableInsert(&table, &fcbs[i].Link, i % 2 ? 42 : 42 + 4);
+  }
+  for (PDOKAN_HASH_TABLE_LINK link = DokanHashTableFind(&table, 42);
+       link != NULL; link = DokanHashTableFindNext(link)) {
+    TEST_CHECK(link->Hash == 42);
+    ++found;
+  }
+  TEST_CHECK(found == 4);
+  DokanHashTableRemove(&table, &fcbs[3].Link);
+  found = 0;
+  for (PDOKAN_HASH_TABLE_LINK link = DokanHashTableFind(&table, 42);
+       link != NULL; link = DokanHashTableFindNext(link)) {
+    TEST_CHECK(link != &fcbs[3].Link);
+    ++found;
+  }
+  TEST_CHECK(found == 3);
+  TEST_CHECK(DokanHashTableFind(&table, 43) == NULL);
+}
+
+// Looks up every FCB, like the creates of already open files.
+static VOID Benchmark(PTEST_FCB Fcbs) {
+  ULONG64 start;
+  ULONG64 tableTime;
+  ULONG64 avlTime;
+  start = TestNowMicroseconds();
+  for (ULONG i = 0; i < TEST_FCB_COUNT; ++i) {
+    TEST_CHECK(FindFcb(Fcbs[i].FileName, HashFileName(Fcbs[i].FileName)) ==
+               &Fcbs[i]);
+  }
+  tableTime = TestNowMicroseconds() - start;
+  start = TestNowMicroseconds();
+  for (ULONG i = 0; i < TEST_FCB_COUNT; ++i) {
+    TEST_CHECK(AvlFind(Fcbs[i].FileName) == &Fcbs[i]);
+  }
+  avlTime = TestNowMicroseconds() - start;
+  printf("%d FCB lookups: hash table %llu us, AVL table %llu us\n",
+         TEST_FCB_COUNT, tableTime, avlTime);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  PTEST_FCB fcbs = calloc(TEST_FCB_COUNT, sizeof(TEST_FCB));
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  TEST_CHECK(fcbs);
+  DokanHashTableInitialize(&g_Table, g_InitialBuckets,
+                           TEST_INITIAL_BUCKET_COUNT);
+  for (ULONG i = 0; i < TEST_FCB_COUNT; ++i) {
+    DokanHashTableInitializeLink(&fcbs[i].Link);
+    FormatFileName(i, fcbs[i].FileName);
+    InsertFcb(&fcbs[i], HashFileName(fcbs[i].FileName));
+    g_AvlRoot = AvlInsert(g_AvlRoot, &fcbs[i]);
+  }
+  TEST_CHECK(AvlHeight(g_AvlRoot) <= 25);
+
+  TestTable(fcbs);
+  TestCollisions();
+  Benchmark(fcbs);
+  if (g_Table.Buckets != g_InitialBuckets) {
+    free(g_Table.Buckets);
+  }
+  free(fcbs);
+  printf("hash table test passed\n");
+  return 0;
+}
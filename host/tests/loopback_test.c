@@ -0,0 +1,246 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Runs synthetic workloads through the dispatch of the library with the
+// loopback transport and checks every reply.
+
+#include "test_fs.h"
+
+#define LOOPBACK_SMALL_WRITE_FILES 4
+#define LOOPBACK_SMALL_WRITES_PER_FILE 512
+#define LOOPBACK_SMALL_WRITE_SIZE 512
+#define LOOPBACK_COALESCING_SIZE (16 * 1024)
+
+// Latencies of the last run, too large for the stack.
+static DOKAN_STATISTICS g_Statistics;
+
+static VOID RunWorkload(PDOKAN_OPTIONS Options,
+                        const DOKAN_LOOPBACK_WORKLOAD *Workload,
+                        PDOKAN_LOOPBACK_RESULT Result) {
+  DOKAN_OPERATIONS operations;
+  ULONG64 opens = (ULONG64)Workload->Concurrency * Workload->OpensPerFile;
+
+  TestFs_Reset();
+  TestFs_Initialize(&operations);
+  TEST_CHECK(DokanRunLoopbackBenchmark(Options, &operations, Workload, Result,
+                                       &g_Statistics));
+  printf("concurrency %lu batching %d/%lu io %lu: %llu events in %llu pulls, "
+         "%llu us\n",
+         Workload->Concurrency,
+         (Options->Options & DOKAN_OPTION_ALLOW_IPC_BATCHING) != 0,
+         Workload->MaxBatchEvents, Workload->IoSize, Result->Events,
+         Result->Pulls, Result->ElapsedMicroseconds);
+  TEST_CHECK(Result->InvalidReplies == 0);
+  // A create, the operations, a cleanup and a close per open.
+  TEST_CHECK(Result->Events == opens * (Workload->OperationsPerOpen + 3));
+  TEST_CHECK(g_TestFsCounters.Creates == (LONG64)opens);
+  TEST_CHECK(g_TestFsCounters.Cleanups == (LONG64)opens);
+  TEST_CHECK(g_TestFsCounters.Closes == (LONG64)opens);
+  // Including the events dispatched by pool threads that exited since.
+  TEST_CHECK(g_Statistics.Operations[IRP_MJ_CREATE].CallbackTime.Count ==
+             opens);
+  TEST_CHECK(TestFs_Find(L"\\DokanLoopback0") != NULL);
+}
+
+// Checks that the files hold the pattern written by a workload of writes
+// only. The write N of a file is its event N + 1 and writes the block N.
+static VOID CheckWrittenFiles(const DOKAN_LOOPBACK_WORKLOAD *Workload) {
+  for (ULONG i = 0; i < Workload->Concurrency; ++i) {
+    WCHAR name[TEST_FS_NAME_MAX];
+    PTEST_FS_FILE file;
+    swprintf_s(name, TEST_FS_NAME_MAX, L"\\DokanLoopback%lu", i);
+    file = TestFs_Find(name);
+    TEST_CHECK(file != NULL);
+    TEST_CHECK(file->Size == Workload->FileBlocks * Workload->IoSize);
+    for (ULONG block = 0; block < Workload->FileBlocks; ++block) {
+      BYTE pattern = (BYTE)((block + 1) * Workload->Concurrency + i + 1);
+      for (ULONG j = 0; j < Workload->IoSize; ++j) {
+        TEST_CHECK((BYTE)file->Data[block * Workload->IoSize + j] == pattern);
+      }
+    }
+  }
+}
+
+// Reads and writes the file system completes after returning STATUS_PENDING,
+// before or after its callback returned. With and without batching, in
+// single thread mode and with writes too large for the pull buffers.
+static VOID TestPendingIos(PDOKAN_OPTIONS Options) {
+  static const TEST_FS_COMPLETION completions[] = {
+      TestFsCompletionBeforeReturn, TestFsCompletionAfterReturn};
+  DOKAN_LOOPBACK_WORKLOAD workload;
+  DOKAN_LOOPBACK_RESULT result;
+  ULONG options = Options->Options;
+
+  for (ULONG i = 0; i < sizeof(completions) / sizeof(completions[0]); ++i) {
+    g_TestFsCompletion = completions[i];
+    ZeroMemory(&workload, sizeof(workload));
+    workload.Concurrency = 8;
+    workload.OpensPerFile = 2;
+    workload.OperationsPerOpen = 16;
+    workload.ReadWeight = 2;
+    workload.WriteWeight = 1;
+    workload.QueryInformationWeight = 1;
+    workload.IoSize = 4096;
+    workload.Seed = 1;
+    Options->Options = options & ~DOKAN_OPTION_ALLOW_IPC_BATCHING;
+    RunWorkload(Options, &workload, &result);
+    TEST_CHECK(g_TestFsCounters.PendingIos ==
+               g_TestFsCounters.Reads + g_TestFsCounters.Writes);
+    Options->Options |= DOKAN_OPTION_ALLOW_IPC_BATCHING;
+    RunWorkload(Options, &workload, &result);
+    TEST_CHECK(g_TestFsCounters.PendingIos ==
+               g_TestFsCounters.Reads + g_TestFsCounters.Writes);
+    Options->SingleThread = TRUE;
+    RunWorkload(Options, &workload, &result);
+    TEST_CHECK(g_TestFsCounters.PendingIos ==
+               g_TestFsCounters.Reads + g_TestFsCounters.Writes);
+    Options->SingleThread = FALSE;
+
+    // The data of the pending writes reaches the files.
+    workload.OpensPerFile = 1;
+    workload.ReadWeight = 0;
+    workload.QueryInformationWeight = 0;
+    workload.FileBlocks = workload.OperationsPerOpen;
+    RunWorkload(Options, &workload, &result);
+    TEST_CHECK(g_TestFsCounters.PendingIos == g_TestFsCounters.Writes);
+    CheckWrittenFiles(&workload);
+    workload.Concurrency = 4;
+    workload.OperationsPerOpen = 4;
+    workload.FileBlocks = 4;
+    workload.IoSize = 1024 * 1024;
+    RunWorkload(Options, &workload, &result);
+    TEST_CHECK(g_TestFsCounters.PendingIos == g_TestFsCounters.Writes);
+    CheckWrittenFiles(&workload);
+  }
+  g_TestFsCompletion = TestFsCompletionSynchronous;
+  Options->Options = options;
+}
+
+// Sequential writes of 512 bytes, like a log, with and without the write
+// coalescing. The file system must get the same data in far fewer WriteFile
+// calls.
+static VOID BenchmarkSmallWrites(PDOKAN_OPTIONS Options) {
+  DOKAN_LOOPBACK_WORKLOAD workload;
+  DOKAN_LOOPBACK_RESULT result;
+  PDOKAN_WRITE_COALESCING_STATISTICS statistics = &result.WriteCoalescing;
+  ULONG64 writes = (ULONG64)LOOPBACK_SMALL_WRITE_FILES *
+                   LOOPBACK_SMALL_WRITES_PER_FILE;
+  ULONG64 directTime;
+  ULONG64 coalescedWrites;
+
+  ZeroMemory(&workload, sizeof(workload));
+  workload.Concurrency = LOOPBACK_SMALL_WRITE_FILES;
+  workload.OpensPerFile = 1;
+  workload.OperationsPerOpen = LOOPBACK_SMALL_WRITES_PER_FILE;
+  workload.WriteWeight = 1;
+  workload.IoSize = LOOPBACK_SMALL_WRITE_SIZE;
+  workload.FileBlocks = LOOPBACK_SMALL_WRITES_PER_FILE;
+  workload.Seed = 1;
+
+  RunWorkload(Options, &workload, &result);
+  TEST_CHECK(g_TestFsCounters.Writes == (LONG64)writes);
+  TEST_CHECK(statistics->BufferedWrites == 0 && statistics->Flushes == 0);
+  CheckWrittenFiles(&workload);
+  directTime = result.ElapsedMicroseconds;
+
+  Options->Options |= DOKAN_OPTION_WRITE_COALESCING;
+  Options->WriteCoalescingSize = LOOPBACK_COALESCING_SIZE;
+  // Long enough for the flushes to come from full buffers and cleanups.
+  Options->WriteCoalescingTimeout = 60 * 1000;
+  RunWorkload(Options, &workload, &result);
+  Options->Options &= ~DOKAN_OPTION_WRITE_COALESCING;
+  Options->WriteCoalescingSize = 0;
+  Options->WriteCoalescingTimeout = 0;
+  coalescedWrites = (ULONG64)g_TestFsCounters.Writes;
+  TEST_CHECK(statistics->BufferedWrites == writes);
+  TEST_CHECK(statistics->DirectWrites == 0);
+  TEST_CHECK(statistics->FailedFlushes == 0);
+  TEST_CHECK(statistics->Flushes == coalescedWrites);
+  TEST_CHECK(statistics->FlushedBytes == writes * LOOPBACK_SMALL_WRITE_SIZE);
+  // Every buffer is flushed once full, the last one of each file is full too.
+  TEST_CHECK(statistics->FullFlushes ==
+             writes * LOOPBACK_SMALL_WRITE_SIZE / LOOPBACK_COALESCING_SIZE);
+  TEST_CHECK(coalescedWrites * (LOOPBACK_COALESCING_SIZE /
+                                LOOPBACK_SMALL_WRITE_SIZE) ==
+             writes);
+  CheckWrittenFiles(&workload);
+  printf("%llu sequential writes of %d bytes: %llu WriteFile calls in %llu "
+         "us, coalesced %llu WriteFile calls in %llu us\n",
+         writes, LOOPBACK_SMALL_WRITE_SIZE, writes, directTime,
+         coalescedWrites, result.ElapsedMicroseconds);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  DOKAN_OPTIONS options;
+  DOKAN_LOOPBACK_WORKLOAD workload;
+  DOKAN_LOOPBACK_RESULT result;
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  DokanInit();
+  TestFs_InitializeOptions(&options);
+
+  ZeroMemory(&workload, sizeof(workload));
+  workload.Concurrency = 16;
+  workload.OpensPerFile = 4;
+  workload.OperationsPerOpen = 32;
+  workload.ReadWeight = 2;
+  workload.WriteWeight = 1;
+  workload.QueryInformationWeight = 1;
+  workload.IoSize = 4096;
+  workload.Seed = 1;
+  RunWorkload(&options, &workload, &result);
+
+  // Batches as large as the pull buffers, then of 4 events.
+  options.Options |= DOKAN_OPTION_ALLOW_IPC_BATCHING;
+  RunWorkload(&options, &workload, &result);
+  workload.MaxBatchEvents = 4;
+  RunWorkload(&options, &workload, &result);
+
+  // Writes larger than the pull buffers, sent by FSCTL_EVENT_WRITE.
+  workload.MaxBatchEvents = 0;
+  workload.Concurrency = 4;
+  workload.IoSize = 1024 * 1024;
+  workload.OperationsPerOpen = 4;
+  workload.FileBlocks = 2;
+  RunWorkload(&options, &workload, &result);
+
+  // The same workload in single thread mode.
+  options.SingleThread = TRUE;
+  workload.IoSize = 4096;
+  workload.OperationsPerOpen = 32;
+  RunWorkload(&options, &workload, &result);
+
+  // Writes buffered per open, flushed by the other operations and the timer.
+  options.SingleThread = FALSE;
+  options.Options |= DOKAN_OPTION_WRITE_COALESCING;
+  options.WriteCoalescingTimeout = 1;
+  workload.Concurrency = 16;
+  RunWorkload(&options, &workload, &result);
+  options.Options &= ~DOKAN_OPTION_WRITE_COALESCING;
+
+  TestPendingIos(&options);
+  BenchmarkSmallWrites(&options);
+
+  DokanShutdown();
+  printf("loopback test passed\n");
+  return 0;
+}
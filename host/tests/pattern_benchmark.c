@@ -0,0 +1,99 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Matches a million file names against the search patterns of directory
+// listings, with the compiled patterns of dokan_pattern.h and with
+// DokanIsNameInExpression, and checks that both agree.
+
+#include "test_fs.h"
+
+#include "../../dokan/dokan_pattern.h"
+
+#define PATTERN_BENCHMARK_NAME_COUNT 1000000
+#define PATTERN_BENCHMARK_NAME_MAX 32
+
+// Patterns of each kind of DOKAN_PATTERN_KIND, as sent by Explorer, cmd and
+// FindFirstFile.
+static const LPCWSTR g_Patterns[] = {
+    L"*.txt", L"<.JPG", L"IMG_*", L"report_2024*", L"Notes_123.md",
+    L"*", L"IMG_?1*.jpg", L"*_2024<.docx", L"*.?x?", L"README>>>\"*",
+};
+
+static const LPCWSTR g_NameFormats[] = {
+    L"IMG_%06lu.jpg", L"report_%lu.docx", L"File%lu.txt", L"Notes_%lu.MD",
+    L"data%lu.TXT.bak", L"README%lu", L".hidden%lu",
+};
+
+static WCHAR (*g_Names)[PATTERN_BENCHMARK_NAME_MAX];
+
+static VOID BenchmarkPattern(LPCWSTR Expression) {
+  DOKAN_PATTERN pattern;
+  ULONG compiledMatches = 0;
+  ULONG interpretedMatches = 0;
+  ULONG64 start;
+  ULONG64 compiledTime;
+  ULONG64 interpretedTime;
+
+  start = TestNowMicroseconds();
+  TEST_CHECK(DokanPattern_Compile(&pattern, Expression, /*IgnoreCase=*/TRUE));
+  for (ULONG i = 0; i < PATTERN_BENCHMARK_NAME_COUNT; ++i) {
+    compiledMatches += DokanPattern_Match(&pattern, g_Names[i]) ? 1 : 0;
+  }
+  compiledTime = TestNowMicroseconds() - start;
+
+  start = TestNowMicroseconds();
+  for (ULONG i = 0; i < PATTERN_BENCHMARK_NAME_COUNT; ++i) {
+    interpretedMatches +=
+        DokanIsNameInExpression(Expression, g_Names[i], /*IgnoreCase=*/TRUE)
+            ? 1
+            : 0;
+  }
+  interpretedTime = TestNowMicroseconds() - start;
+
+  for (ULONG i = 0; i < PATTERN_BENCHMARK_NAME_COUNT; ++i) {
+    TEST_CHECK(!DokanPattern_Match(&pattern, g_Names[i]) ==
+               !DokanIsNameInExpression(Expression, g_Names[i],
+                                        /*IgnoreCase=*/TRUE));
+  }
+  TEST_CHECK(compiledMatches == interpretedMatches);
+  printf("kind %d, %7lu matches: compiled %6llu us, interpreted %6llu us\n",
+         pattern.Kind, compiledMatches, compiledTime, interpretedTime);
+  DokanPattern_Free(&pattern);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  ULONG formatCount = sizeof(g_NameFormats) / sizeof(g_NameFormats[0]);
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  g_Names = calloc(PATTERN_BENCHMARK_NAME_COUNT, sizeof(g_Names[0]));
+  TEST_CHECK(g_Names);
+  for (ULONG i = 0; i < PATTERN_BENCHMARK_NAME_COUNT; ++i) {
+    swprintf_s(g_Names[i], PATTERN_BENCHMARK_NAME_MAX,
+               g_NameFormats[i % formatCount], i / formatCount);
+  }
+  for (ULONG i = 0; i < sizeof(g_Patterns) / sizeof(g_Patterns[0]); ++i) {
+    BenchmarkPattern(g_Patterns[i]);
+  }
+  free(g_Names);
+  printf("pattern benchmark passed\n");
+  return 0;
+}
@@ -0,0 +1,182 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Stresses the object pools of dokan_pool.h from a growing number of threads
+// taking and releasing the objects of every request, checks their hit, miss,
+// depot and memory counters, and compares their throughput with malloc and
+// free.
+
+#include "test_fs.h"
+
+#include "../../dokan/dokan_pool.h"
+
+#define POOL_BENCHMARK_POOL_SIZE 4096
+#define POOL_BENCHMARK_REQUESTS 204800
+// Requests pulled at once by a thread, more than its magazines hold so that
+// it goes to the shared depots.
+#define POOL_BENCHMARK_BATCH 128
+
+static const ULONG g_ThreadCounts[] = {1, 2, 4, 8};
+
+typedef struct _TEST_REQUEST {
+  PDOKAN_IO_EVENT IoEvent;
+  PEVENT_INFORMATION EventResult;
+  PDOKAN_OPEN_INFO FileInfo;
+} TEST_REQUEST, *PTEST_REQUEST;
+
+typedef struct _POOL_BENCHMARK {
+  // NULL for the malloc and free baseline.
+  PDOKAN_OBJECT_POOLS Pools;
+} POOL_BENCHMARK, *PPOOL_BENCHMARK;
+
+static VOID AllocRequest(PDOKAN_OBJECT_POOLS Pools, PTEST_REQUEST Request) {
+  if (Pools) {
+    Request->IoEvent = PopIoEventBuffer(Pools);
+    Request->EventResult = PopEventResult(Pools);
+    Request->FileInfo = PopFileOpenInfo(Pools);
+  } else {
+    Request->IoEvent = calloc(1, sizeof(DOKAN_IO_EVENT));
+    Request->EventResult = calloc(1, DOKAN_EVENT_INFO_DEFAULT_SIZE);
+    Request->FileInfo = AllocFileOpenInfo();
+  }
+  TEST_CHECK(Request->IoEvent && Request->EventResult && Request->FileInfo);
+}
+
+static VOID FreeRequest(PDOKAN_OBJECT_POOLS Pools, PTEST_REQUEST Request) {
+  if (Pools) {
+    PushIoEventBuffer(Pools, Request->IoEvent);
+    PushEventResult(Pools, Request->EventResult);
+    PushFileOpenInfo(Pools, Request->FileInfo);
+  } else {
+    free(Request->IoEvent);
+    free(Request->EventResult);
+    FreeFileOpenInfo(NULL, Request->FileInfo);
+  }
+}
+
+// Takes the objects of a batch of requests and releases them once all are
+// done, like a pull thread and its replies.
+static VOID BenchmarkRoutine(PVOID Context, ULONG Index) {
+  PPOOL_BENCHMARK benchmark = (PPOOL_BENCHMARK)Context;
+  TEST_REQUEST requests[POOL_BENCHMARK_BATCH];
+  UNREFERENCED_PARAMETER(Index);
+  for (ULONG i = 0; i < POOL_BENCHMARK_REQUESTS; i += POOL_BENCHMARK_BATCH) {
+    for (ULONG j = 0; j < POOL_BENCHMARK_BATCH; ++j) {
+      AllocRequest(benchmark->Pools, &requests[j]);
+    }
+    for (ULONG j = 0; j < POOL_BENCHMARK_BATCH; ++j) {
+      FreeRequest(benchmark->Pools, &requests[j]);
+    }
+  }
+}
+
+// Returns the time to run the requests on ThreadCount threads.
+static ULONG64 RunRequests(PDOKAN_OBJECT_POOLS Pools, ULONG ThreadCount) {
+  POOL_BENCHMARK benchmark;
+  ULONG64 start;
+  benchmark.Pools = Pools;
+  start = TestNowMicroseconds();
+  TestRunThreads(ThreadCount, BenchmarkRoutine, &benchmark);
+  return TestNowMicroseconds() - start;
+}
+
+// The prewarmed pools hold more objects than the threads ever keep aside, so
+// every object comes from them and goes back to them.
+static VOID CheckPool(PDOKAN_OBJECT_POOLS Pools, DOKAN_POOL_TYPE Type,
+                      ULONG ThreadCount, LONG64 ItemSize,
+                      PULONG64 DepotExchanges) {
+  DOKAN_POOL_STATISTICS statistics;
+  GetPoolStatistics(Pools, Type, &statistics);
+  TEST_CHECK(statistics.Hits ==
+             (ULONG64)ThreadCount * POOL_BENCHMARK_REQUESTS);
+  TEST_CHECK(statistics.Misses == 0);
+  TEST_CHECK(statistics.Overflows == 0);
+  TEST_CHECK(statistics.DepotRefills > 0 && statistics.DepotSpills > 0);
+  TEST_CHECK(statistics.CachedBytes == POOL_BENCHMARK_POOL_SIZE * ItemSize);
+  TEST_CHECK(statistics.InUseBytes == 0);
+  *DepotExchanges += statistics.DepotRefills + statistics.DepotSpills;
+}
+
+// The objects of the requests in flight are counted in use until released,
+// including the ones allocated when the pools are empty.
+static VOID TestInUseMemory(void) {
+  PDOKAN_OBJECT_POOLS pools = AllocObjectPools(POOL_BENCHMARK_POOL_SIZE, 0);
+  TEST_REQUEST requests[POOL_BENCHMARK_BATCH];
+  DOKAN_POOL_STATISTICS statistics;
+  TEST_CHECK(pools);
+  for (ULONG i = 0; i < POOL_BENCHMARK_BATCH; ++i) {
+    AllocRequest(pools, &requests[i]);
+  }
+  GetPoolStatistics(pools, DokanPoolEventResult, &statistics);
+  TEST_CHECK(statistics.Misses == POOL_BENCHMARK_BATCH);
+  TEST_CHECK(statistics.InUseBytes ==
+             POOL_BENCHMARK_BATCH * DOKAN_EVENT_INFO_DEFAULT_SIZE);
+  TEST_CHECK(statistics.CachedBytes == 0);
+  for (ULONG i = 0; i < POOL_BENCHMARK_BATCH; ++i) {
+    FreeRequest(pools, &requests[i]);
+  }
+  GetPoolStatistics(pools, DokanPoolFileInfo, &statistics);
+  TEST_CHECK(statistics.InUseBytes == 0);
+  TEST_CHECK(statistics.CachedBytes ==
+             POOL_BENCHMARK_BATCH * sizeof(DOKAN_OPEN_INFO));
+  FreeObjectPools(pools);
+}
+
+static VOID Benchmark(ULONG ThreadCount) {
+  PDOKAN_OBJECT_POOLS pools =
+      AllocObjectPools(POOL_BENCHMARK_POOL_SIZE, POOL_BENCHMARK_POOL_SIZE);
+  ULONG64 requests = (ULONG64)ThreadCount * POOL_BENCHMARK_REQUESTS;
+  ULONG64 depotExchanges = 0;
+  ULONG64 poolTime;
+  ULONG64 mallocTime;
+  TEST_CHECK(pools);
+  poolTime = RunRequests(pools, ThreadCount);
+  mallocTime = RunRequests(NULL, ThreadCount);
+
+  CheckPool(pools, DokanPoolIoEvent, ThreadCount, sizeof(DOKAN_IO_EVENT),
+            &depotExchanges);
+  CheckPool(pools, DokanPoolEventResult, ThreadCount,
+            DOKAN_EVENT_INFO_DEFAULT_SIZE, &depotExchanges);
+  CheckPool(pools, DokanPoolFileInfo, ThreadCount, sizeof(DOKAN_OPEN_INFO),
+            &depotExchanges);
+  // Threads only go to the shared depots once per magazine of objects.
+  TEST_CHECK(depotExchanges * 8 < requests * 3);
+  printf("%lu threads, %llu requests: pools %llu us with %.1f depot "
+         "exchanges per 1000 objects, malloc %llu us\n",
+         ThreadCount, requests, poolTime,
+         depotExchanges * 1000.0 / (requests * 3), mallocTime);
+  FreeObjectPools(pools);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  DokanInit();
+  TestInUseMemory();
+  for (ULONG i = 0; i < sizeof(g_ThreadCounts) / sizeof(g_ThreadCounts[0]);
+       ++i) {
+    Benchmark(g_ThreadCounts[i]);
+  }
+  DokanShutdown();
+  printf("pool benchmark passed\n");
+  return 0;
+}
@@ -0,0 +1,170 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Reads a file sequentially through the loopback with
+// DOKAN_OPTION_READ_AHEAD, checks that the reads are answered from the data
+// read ahead, then changes the file by a write from another open, a write
+// from the same open and a truncation, and checks that the next read returns
+// the new data.
+
+#include "test_loopback.h"
+
+#include "../../dokan/dokan_read_ahead.h"
+
+#define READ_AHEAD_SIZE (64 * 1024)
+#define READ_AHEAD_FILE_SIZE (256 * 1024)
+#define READ_AHEAD_IO_SIZE 4096
+#define READ_AHEAD_READS 32
+// Time to wait for the speculative reads to complete.
+#define READ_AHEAD_TIMEOUT_MS 10000
+
+static const WCHAR g_FileName[] = L"\\read_ahead";
+
+// Expected content of the file.
+static CHAR g_Data[READ_AHEAD_FILE_SIZE];
+
+static VOID GetStatistics(PDOKAN_INSTANCE Instance,
+                          PDOKAN_READ_AHEAD_STATISTICS Statistics) {
+  TEST_CHECK(
+      DokanGetReadAheadStatistics((DOKAN_HANDLE)Instance, Statistics));
+}
+
+// Waits until no speculative read is in progress. The only open reading
+// ahead holds its window, the speculative reads add to it.
+static VOID WaitForSpeculativeReads(PDOKAN_INSTANCE Instance) {
+  DOKAN_READ_AHEAD_STATISTICS statistics;
+  ULONG64 start = GetTickCount64();
+  for (;;) {
+    GetStatistics(Instance, &statistics);
+    if (statistics.MemoryUsage <= 2 * READ_AHEAD_SIZE) {
+      return;
+    }
+    TEST_CHECK(GetTickCount64() - start < READ_AHEAD_TIMEOUT_MS);
+    Sleep(1);
+  }
+}
+
+// Reads a block and checks it against g_Data, up to the end of file at
+// FileSize.
+static VOID ReadBlock(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                      LONG64 Offset, ULONG FileSize) {
+  CHAR buffer[READ_AHEAD_IO_SIZE];
+  ULONG expectedLength =
+      (ULONG)min(READ_AHEAD_IO_SIZE, (LONG64)FileSize - Offset);
+  ULONG readLength;
+  TEST_CHECK(TestLoopback_Read(Instance, Context, g_FileName, Offset, buffer,
+                               READ_AHEAD_IO_SIZE,
+                               &readLength) == STATUS_SUCCESS);
+  TEST_CHECK(readLength == expectedLength);
+  TEST_CHECK(memcmp(buffer, g_Data + Offset, readLength) == 0);
+  WaitForSpeculativeReads(Instance);
+}
+
+// Checks that the change of the file dropped the data read ahead and that
+// the next read, at Offset, returns the new data.
+static VOID CheckFreshRead(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                           LONG64 Offset, ULONG FileSize,
+                           const DOKAN_READ_AHEAD_STATISTICS *Before) {
+  DOKAN_READ_AHEAD_STATISTICS statistics;
+  GetStatistics(Instance, &statistics);
+  TEST_CHECK(statistics.Invalidations > Before->Invalidations);
+  ReadBlock(Instance, Context, Offset, FileSize);
+  GetStatistics(Instance, &statistics);
+  TEST_CHECK(statistics.Misses == Before->Misses + 1);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  DOKAN_OPERATIONS operations;
+  DOKAN_OPTIONS options;
+  DOKAN_READ_AHEAD_STATISTICS statistics;
+  PDOKAN_INSTANCE instance;
+  ULONG64 context;
+  ULONG64 otherContext;
+  LONG64 offset = 0;
+  CHAR block[READ_AHEAD_IO_SIZE];
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  DokanInit();
+  TestFs_Initialize(&operations);
+  for (ULONG i = 0; i < READ_AHEAD_FILE_SIZE; ++i) {
+    g_Data[i] = (CHAR)(i * 7 + i / READ_AHEAD_IO_SIZE);
+  }
+  TEST_CHECK(TestFs_AddFile(g_FileName, g_Data, READ_AHEAD_FILE_SIZE));
+  TestFs_InitializeOptions(&options);
+  options.Options |= DOKAN_OPTION_READ_AHEAD;
+  options.ReadAheadSize = READ_AHEAD_SIZE;
+  instance = TestLoopback_Start(&options, &operations);
+  TEST_CHECK(TestLoopback_Create(instance, g_FileName, FILE_OPEN,
+                                 /*Directory=*/FALSE, &context,
+                                 NULL) == STATUS_SUCCESS);
+
+  // The read-ahead starts after the first sequential reads, the next ones
+  // are answered from it.
+  for (ULONG i = 0; i < READ_AHEAD_READS; ++i) {
+    ReadBlock(instance, context, offset, READ_AHEAD_FILE_SIZE);
+    offset += READ_AHEAD_IO_SIZE;
+  }
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(statistics.Hits ==
+             READ_AHEAD_READS - DOKAN_READ_AHEAD_SEQUENTIAL_READS);
+  TEST_CHECK(statistics.Misses == DOKAN_READ_AHEAD_SEQUENTIAL_READS);
+  TEST_CHECK(statistics.SpeculativeReads > 0);
+  TEST_CHECK((ULONG64)g_TestFsCounters.Reads ==
+             statistics.Misses + statistics.SpeculativeReads);
+  TEST_CHECK(g_TestFsCounters.Reads < READ_AHEAD_READS / 4);
+
+  // A write from another open to the data read ahead.
+  TEST_CHECK(TestLoopback_Create(instance, g_FileName, FILE_OPEN,
+                                 /*Directory=*/FALSE, &otherContext,
+                                 NULL) == STATUS_SUCCESS);
+  FillMemory(block, sizeof(block), 0xA5);
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(TestLoopback_Write(instance, otherContext, g_FileName, offset,
+                                block, sizeof(block)) == STATUS_SUCCESS);
+  RtlCopyMemory(g_Data + offset, block, sizeof(block));
+  TestLoopback_Close(instance, otherContext, g_FileName,
+                     /*DeleteOnClose=*/FALSE);
+  CheckFreshRead(instance, context, offset, READ_AHEAD_FILE_SIZE, &statistics);
+  offset += READ_AHEAD_IO_SIZE;
+
+  // A write from the open reading ahead.
+  FillMemory(block, sizeof(block), 0x5A);
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(TestLoopback_Write(instance, context, g_FileName, offset, block,
+                                sizeof(block)) == STATUS_SUCCESS);
+  RtlCopyMemory(g_Data + offset, block, sizeof(block));
+  CheckFreshRead(instance, context, offset, READ_AHEAD_FILE_SIZE, &statistics);
+  offset += READ_AHEAD_IO_SIZE;
+
+  // A truncation in the middle of the data read ahead.
+  GetStatistics(instance, &statistics);
+  TEST_CHECK(TestLoopback_SetEndOfFile(instance, context, g_FileName,
+                                       offset + 100) == STATUS_SUCCESS);
+  CheckFreshRead(instance, context, offset, (ULONG)offset + 100, &statistics);
+
+  TestLoopback_Close(instance, context, g_FileName, /*DeleteOnClose=*/FALSE);
+  TestLoopback_Stop(instance);
+  TestFs_Reset();
+  DokanShutdown();
+  printf("read ahead test passed\n");
+  return 0;
+}
@@ -0,0 +1,221 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Writes an event trace like a recording mount would, replays it against the
+// test file system and checks the resulting file.
+
+#include "test_fs.h"
+
+#include "../../dokan/dokan_event_trace.h"
+
+#define REPLAY_TRACE_PATH L"replay_test.trace"
+#define REPLAY_FILE_NAME L"\\replay.txt"
+// Context the recorded mount replied for the create.
+#define REPLAY_RECORDED_CONTEXT 0x1234
+#define REPLAY_ALIGN(Length) (((Length) + 7) & ~(ULONG)7)
+
+static const char g_FirstWrite[] = "hello replay";
+static const char g_LargeWrite[] = ", again";
+
+// Appends an event of the given operation to Buffer and returns it. Length is
+// the size of the event up to its file name.
+static PEVENT_CONTEXT AppendEvent(PCHAR Buffer, PULONG BufferLength,
+                                  ULONG SerialNumber, UCHAR MajorFunction,
+                                  ULONG Length, ULONG64 Context) {
+  PEVENT_CONTEXT eventContext = (PEVENT_CONTEXT)(Buffer + *BufferLength);
+  Length = REPLAY_ALIGN(max((ULONG)sizeof(EVENT_CONTEXT),
+                            Length + (ULONG)sizeof(REPLAY_FILE_NAME)));
+  ZeroMemory(eventContext, Length);
+  eventContext->Length = Length;
+  eventContext->SerialNumber = SerialNumber;
+  eventContext->MajorFunction = MajorFunction;
+  eventContext->Context = Context;
+  *BufferLength += Length;
+  return eventContext;
+}
+
+static VOID AppendCreate(PCHAR Buffer, PULONG BufferLength,
+                         ULONG SerialNumber) {
+  ULONG nameOffset =
+      sizeof(CREATE_CONTEXT) + 2 * sizeof(DOKAN_UNICODE_STRING_INTERMEDIATE);
+  PEVENT_CONTEXT eventContext = AppendEvent(
+      Buffer, BufferLength, SerialNumber, IRP_MJ_CREATE,
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.Create) + nameOffset, 0);
+  PCREATE_CONTEXT create = &eventContext->Operation.Create;
+  PDOKAN_ACCESS_STATE_INTERMEDIATE accessState =
+      &create->SecurityContext.AccessState;
+  // Empty object name and type, followed by the file name.
+  accessState->UnicodeStringObjectNameOffset = sizeof(CREATE_CONTEXT);
+  accessState->UnicodeStringObjectTypeOffset =
+      sizeof(CREATE_CONTEXT) + sizeof(DOKAN_UNICODE_STRING_INTERMEDIATE);
+  accessState->OriginalDesiredAccess = FILE_GENERIC_READ | FILE_GENERIC_WRITE;
+  accessState->RemainingDesiredAccess = accessState->OriginalDesiredAccess;
+  create->SecurityContext.DesiredAccess = accessState->OriginalDesiredAccess;
+  create->FileAttributes = FILE_ATTRIBUTE_NORMAL;
+  create->CreateOptions = (FILE_OPEN_IF << 24) | FILE_NON_DIRECTORY_FILE |
+                          FILE_SYNCHRONOUS_IO_NONALERT;
+  create->ShareAccess = FILE_SHARE_READ | FILE_SHARE_WRITE;
+  create->FileNameLength = sizeof(REPLAY_FILE_NAME) - sizeof(WCHAR);
+  create->FileNameOffset = nameOffset;
+  RtlCopyMemory((PCHAR)create + nameOffset, REPLAY_FILE_NAME,
+                sizeof(REPLAY_FILE_NAME));
+}
+
+// Appends a write of Data at ByteOffset. With RequestData, the event has no
+// data and the returned length is the one of the event holding them.
+static ULONG AppendWrite(PCHAR Buffer, PULONG BufferLength, ULONG SerialNumber,
+                         const char *Data, ULONG DataLength, LONG64 ByteOffset,
+                         BOOL RequestData) {
+  ULONG bufferOffset = REPLAY_ALIGN(FIELD_OFFSET(EVENT_CONTEXT,
+                                                 Operation.Write.FileName) +
+                                    sizeof(REPLAY_FILE_NAME));
+  ULONG fullLength = REPLAY_ALIGN(
+      max((ULONG)sizeof(EVENT_CONTEXT), bufferOffset + DataLength));
+  PEVENT_CONTEXT eventContext = AppendEvent(
+      Buffer, BufferLength, SerialNumber, IRP_MJ_WRITE,
+      RequestData ? bufferOffset : fullLength - sizeof(REPLAY_FILE_NAME),
+      REPLAY_RECORDED_CONTEXT);
+  eventContext->Operation.Write.ByteOffset.QuadPart = ByteOffset;
+  eventContext->Operation.Write.BufferLength = DataLength;
+  eventContext->Operation.Write.BufferOffset = bufferOffset;
+  eventContext->Operation.Write.RequestLength = RequestData ? fullLength : 0;
+  eventContext->Operation.Write.FileNameLength =
+      sizeof(REPLAY_FILE_NAME) - sizeof(WCHAR);
+  RtlCopyMemory(eventContext->Operation.Write.FileName, REPLAY_FILE_NAME,
+                sizeof(REPLAY_FILE_NAME));
+  if (!RequestData) {
+    RtlCopyMemory((PCHAR)eventContext + bufferOffset, Data, DataLength);
+  }
+  return fullLength;
+}
+
+static VOID WriteTrace(void) {
+  PDOKAN_EVENT_RECORDER recorder = DokanEventRecorder_Alloc();
+  PCHAR buffer = calloc(1, 64 * 1024);
+  PCHAR largeWrite = calloc(1, 4096);
+  ULONG length = 0;
+  ULONG largeWriteLength = 0;
+  ULONG largeWriteEventLength;
+  PEVENT_CONTEXT eventContext;
+  TEST_CHECK(recorder && buffer && largeWrite);
+  TEST_CHECK(DokanEventRecorder_Start(recorder, REPLAY_TRACE_PATH) ==
+             ERROR_SUCCESS);
+
+  AppendCreate(buffer, &length, 1);
+  DokanEventRecorder_RecordBatch(recorder, (PEVENT_CONTEXT)buffer, length);
+  DokanEventRecorder_RecordOpen(recorder, 1, REPLAY_RECORDED_CONTEXT);
+
+  // A batch of operations on the open, with one event of an unknown open.
+  length = 0;
+  AppendWrite(buffer, &length, 2, g_FirstWrite, sizeof(g_FirstWrite) - 1, 0,
+              /*RequestData=*/FALSE);
+  largeWriteEventLength =
+      AppendWrite(buffer, &length, 3, g_LargeWrite, sizeof(g_LargeWrite) - 1,
+                  sizeof(g_FirstWrite) - 1, /*RequestData=*/TRUE);
+  eventContext = AppendEvent(
+      buffer, &length, 4, IRP_MJ_READ,
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.Read.FileName),
+      REPLAY_RECORDED_CONTEXT);
+  eventContext->Operation.Read.BufferLength = 64;
+  eventContext->Operation.Read.FileNameLength =
+      sizeof(REPLAY_FILE_NAME) - sizeof(WCHAR);
+  RtlCopyMemory(eventContext->Operation.Read.FileName, REPLAY_FILE_NAME,
+                sizeof(REPLAY_FILE_NAME));
+  eventContext = AppendEvent(
+      buffer, &length, 5, IRP_MJ_CLEANUP,
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.Cleanup.FileName), 0x9999);
+  eventContext->Operation.Cleanup.FileNameLength =
+      sizeof(REPLAY_FILE_NAME) - sizeof(WCHAR);
+  DokanEventRecorder_RecordBatch(recorder, (PEVENT_CONTEXT)buffer, length);
+
+  // The data of the large write, pulled with FSCTL_EVENT_WRITE.
+  AppendWrite(largeWrite, &largeWriteLength, 3, g_LargeWrite,
+              sizeof(g_LargeWrite) - 1, sizeof(g_FirstWrite) - 1,
+              /*RequestData=*/FALSE);
+  TEST_CHECK(largeWriteLength == largeWriteEventLength);
+  DokanEventRecorder_RecordWrite(recorder, (PEVENT_CONTEXT)largeWrite,
+                                 largeWriteLength);
+
+  length = 0;
+  eventContext = AppendEvent(
+      buffer, &length, 6, IRP_MJ_CLEANUP,
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.Cleanup.FileName),
+      REPLAY_RECORDED_CONTEXT);
+  eventContext->Operation.Cleanup.FileNameLength =
+      sizeof(REPLAY_FILE_NAME) - sizeof(WCHAR);
+  RtlCopyMemory(eventContext->Operation.Cleanup.FileName, REPLAY_FILE_NAME,
+                sizeof(REPLAY_FILE_NAME));
+  eventContext = AppendEvent(
+      buffer, &length, 7, IRP_MJ_CLOSE,
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.Close.FileName),
+      REPLAY_RECORDED_CONTEXT);
+  eventContext->Operation.Close.FileNameLength =
+      sizeof(REPLAY_FILE_NAME) - sizeof(WCHAR);
+  RtlCopyMemory(eventContext->Operation.Close.FileName, REPLAY_FILE_NAME,
+                sizeof(REPLAY_FILE_NAME));
+  DokanEventRecorder_RecordBatch(recorder, (PEVENT_CONTEXT)buffer, length);
+
+  TEST_CHECK(DokanEventRecorder_Stop(recorder) == ERROR_SUCCESS);
+  DokanEventRecorder_Free(recorder);
+  free(largeWrite);
+  free(buffer);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  DOKAN_OPTIONS options;
+  DOKAN_OPERATIONS operations;
+  DOKAN_REPLAY_RESULT result;
+  PTEST_FS_FILE file;
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  DokanInit();
+  TestFs_InitializeOptions(&options);
+  TestFs_Initialize(&operations);
+  WriteTrace();
+
+  TEST_CHECK(DokanReplayEventTrace(REPLAY_TRACE_PATH, &options, &operations,
+                                   &result, NULL));
+  printf("replayed %llu events, %llu skipped, in %llu us\n", result.Events,
+         result.SkippedEvents, result.ElapsedMicroseconds);
+  // The cleanup of the unknown open is skipped.
+  TEST_CHECK(result.Events == 6);
+  TEST_CHECK(result.SkippedEvents == 1);
+  TEST_CHECK(g_TestFsCounters.Creates == 1);
+  TEST_CHECK(g_TestFsCounters.Writes == 2);
+  TEST_CHECK(g_TestFsCounters.Reads == 1);
+  TEST_CHECK(g_TestFsCounters.Cleanups == 1);
+  TEST_CHECK(g_TestFsCounters.Closes == 1);
+  file = TestFs_Find(REPLAY_FILE_NAME);
+  TEST_CHECK(file != NULL);
+  TEST_CHECK(file->Size ==
+             sizeof(g_FirstWrite) - 1 + sizeof(g_LargeWrite) - 1);
+  TEST_CHECK(memcmp(file->Data, "hello replay, again", file->Size) == 0);
+
+  // A trace that does not exist.
+  TEST_CHECK(!DokanReplayEventTrace(L"replay_test.missing", &options,
+                                    &operations, &result, NULL));
+
+  DeleteFileW(REPLAY_TRACE_PATH);
+  DokanShutdown();
+  printf("replay test passed\n");
+  return 0;
+}
@@ -0,0 +1,68 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Measures how many replies the batching dispatch sends per call to the
+// driver, with replies small enough to be aggregated.
+
+#include "test_fs.h"
+
+static VOID RunWorkload(PDOKAN_OPTIONS Options, ULONG Concurrency) {
+  DOKAN_OPERATIONS operations;
+  DOKAN_LOOPBACK_WORKLOAD workload;
+  DOKAN_LOOPBACK_RESULT result;
+
+  ZeroMemory(&workload, sizeof(workload));
+  workload.Concurrency = Concurrency;
+  workload.OpensPerFile = 4;
+  workload.OperationsPerOpen = 64;
+  workload.WriteWeight = 1;
+  workload.QueryInformationWeight = 3;
+  workload.IoSize = 512;
+  workload.Seed = 1;
+
+  TestFs_Reset();
+  TestFs_Initialize(&operations);
+  TEST_CHECK(DokanRunLoopbackBenchmark(Options, &operations, &workload,
+                                       &result, NULL));
+  TEST_CHECK(result.InvalidReplies == 0);
+  TEST_CHECK(result.ReplyIoctls > 0);
+  printf("concurrency %lu: %llu replies in %llu ioctls, %.2f per ioctl, "
+         "%llu events in %llu us\n",
+         Concurrency, result.Replies, result.ReplyIoctls,
+         (double)result.Replies / result.ReplyIoctls, result.Events,
+         result.ElapsedMicroseconds);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  DOKAN_OPTIONS options;
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  DokanInit();
+  TestFs_InitializeOptions(&options);
+  options.Options |= DOKAN_OPTION_ALLOW_IPC_BATCHING;
+  RunWorkload(&options, 1);
+  RunWorkload(&options, 16);
+  RunWorkload(&options, 64);
+  DokanShutdown();
+  printf("reply benchmark passed\n");
+  return 0;
+}
@@ -0,0 +1,342 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Tests the pending IRP index of sys/util/serial_table.h: lookups, removals,
+// serial number wrap around and the bucket spread of sharded tables. Compares
+// its lookups with the scan of the list it replaced, and the contention on
+// the locks of the sharded tables with a single one.
+
+#include "test_fs.h"
+
+#include "../../dokan/list.h"
+#include "../../sys/util/serial_table.h"
+
+#define TEST_SHARD_BITS 2
+#define TEST_SHARD_COUNT (1 << TEST_SHARD_BITS)
+#define TEST_PENDING_COUNT 10000
+#define TEST_CACHE_LINE_SIZE 64
+#define TEST_THREAD_COUNT 8
+// IRPs a thread keeps pending, and the ones it registers and completes.
+#define TEST_THREAD_PENDING_COUNT 64
+#define TEST_THREAD_IRP_COUNT 200000
+
+typedef struct _TEST_ENTRY {
+  DOKAN_SERIAL_TABLE_LINK Link;
+  // Entry in the list of the baseline.
+  LIST_ENTRY ListEntry;
+  ULONG SerialNumber;
+} TEST_ENTRY, *PTEST_ENTRY;
+
+static DOKAN_SERIAL_TABLE g_Tables[TEST_SHARD_COUNT];
+
+// Stand-in for the KSPIN_LOCK of a pending IRP list.
+typedef struct _TEST_SPIN_LOCK {
+  volatile LONG Value;
+} TEST_SPIN_LOCK, *PTEST_SPIN_LOCK;
+
+// A shard of the pending IRPs, with its lock on its own cache line.
+typedef struct DECLSPEC_ALIGN(TEST_CACHE_LINE_SIZE) _TEST_SHARD {
+  TEST_SPIN_LOCK Lock;
+  DOKAN_SERIAL_TABLE Table;
+} TEST_SHARD, *PTEST_SHARD;
+
+typedef struct _TEST_CONTENTION {
+  PTEST_SHARD Shards;
+  ULONG ShardCount;
+  volatile LONG NextSerialNumber;
+  // Acquisitions that found the lock held, per thread.
+  ULONG64 Contended[TEST_THREAD_COUNT];
+} TEST_CONTENTION, *PTEST_CONTENTION;
+
+static PTEST_ENTRY AllocEntries(ULONG Count, ULONG FirstSerialNumber) {
+  PTEST_ENTRY entries = calloc(Count, sizeof(TEST_ENTRY));
+  TEST_CHECK(entries);
+  for (ULONG i = 0; i < Count; ++i) {
+    DokanSerialTableInitializeLink(&entries[i].Link);
+    entries[i].SerialNumber = FirstSerialNumber + i;
+  }
+  return entries;
+}
+
+static ULONG BucketLength(PDOKAN_SERIAL_TABLE Table, ULONG Bucket) {
+  ULONG length = 0;
+  for (PDOKAN_SERIAL_TABLE_LINK link = Table->Buckets[Bucket].Next;
+       link != &Table->Buckets[Bucket]; link = link->Next) {
+    ++length;
+  }
+  return length;
+}
+
+// More entries than buckets, then half of them removed.
+static VOID TestFindRemove(void) {
+  PDOKAN_SERIAL_TABLE table = &g_Tables[0];
+  ULONG count = 4 * DOKAN_SERIAL_TABLE_BUCKET_COUNT;
+  PTEST_ENTRY entries = AllocEntries(count, 1);
+  DokanSerialTableInitialize(table, 0);
+  for (ULONG i = 0; i < count; ++i) {
+    DokanSerialTableInsert(table, &entries[i].Link, entries[i].SerialNumber);
+  }
+  TEST_CHECK(table->Count == count);
+  for (ULONG i = 0; i < count; ++i) {
+    TEST_CHECK(DokanSerialTableFind(table, entries[i].SerialNumber) ==
+               &entries[i].Link);
+  }
+  // Serial number 0 is never inserted, see RegisterPendingIrpMain.
+  TEST_CHECK(DokanSerialTableFind(table, 0) == NULL);
+  TEST_CHECK(DokanSerialTableFind(table, count + 1) == NULL);
+
+  for (ULONG i = 0; i < count; i += 2) {
+    DokanSerialTableRemove(table, &entries[i].Link);
+    TEST_CHECK(!DokanSerialTableIsLinked(&entries[i].Link));
+    // A second removal, like the cancel routine after a completion.
+    DokanSerialTableRemove(table, &entries[i].Link);
+  }
+  TEST_CHECK(table->Count == count / 2);
+  for (ULONG i = 0; i < count; ++i) {
+    TEST_CHECK(DokanSerialTableFind(table, entries[i].SerialNumber) ==
+               (i % 2 ? &entries[i].Link : NULL));
+  }
+  for (ULONG i = 1; i < count; i += 2) {
+    DokanSerialTableRemove(table, &entries[i].Link);
+  }
+  TEST_CHECK(table->Count == 0);
+  for (ULONG i = 0; i < DOKAN_SERIAL_TABLE_BUCKET_COUNT; ++i) {
+    TEST_CHECK(BucketLength(table, i) == 0);
+  }
+  free(entries);
+}
+
+// The serial numbers of the driver wrap around.
+static VOID TestWrapAround(void) {
+  PDOKAN_SERIAL_TABLE table = &g_Tables[0];
+  ULONG count = 64;
+  PTEST_ENTRY entries = AllocEntries(count, MAXULONG - count / 2 + 1);
+  // Serial number 0 is skipped, it is never in the table.
+  for (ULONG i = count / 2; i < count; ++i) {
+    ++entries[i].SerialNumber;
+  }
+  DokanSerialTableInitialize(table, 0);
+  for (ULONG i = 0; i < count; ++i) {
+    DokanSerialTableInsert(table, &entries[i].Link, entries[i].SerialNumber);
+  }
+  for (ULONG i = 0; i < count; ++i) {
+    TEST_CHECK(DokanSerialTableFind(table, entries[i].SerialNumber) ==
+               &entries[i].Link);
+  }
+  for (ULONG i = 0; i < count; ++i) {
+    DokanSerialTableRemove(table, &entries[i].Link);
+  }
+  TEST_CHECK(table->Count == 0);
+  free(entries);
+}
+
+// Each shard holds the serial numbers sharing their low bits, which KeyShift
+// skips so that they still use every bucket.
+static VOID TestShards(void) {
+  ULONG count = TEST_SHARD_COUNT * DOKAN_SERIAL_TABLE_BUCKET_COUNT * 2;
+  PTEST_ENTRY entries = AllocEntries(count, 1);
+  for (ULONG shard = 0; shard < TEST_SHARD_COUNT; ++shard) {
+    DokanSerialTableInitialize(&g_Tables[shard], TEST_SHARD_BITS);
+  }
+  for (ULONG i = 0; i < count; ++i) {
+    ULONG serialNumber = entries[i].SerialNumber;
+    DokanSerialTableInsert(&g_Tables[serialNumber & (TEST_SHARD_COUNT - 1)],
+                           &entries[i].Link, serialNumber);
+  }
+  for (ULONG shard = 0; shard < TEST_SHARD_COUNT; ++shard) {
+    PDOKAN_SERIAL_TABLE table = &g_Tables[shard];
+    TEST_CHECK(table->Count == count / TEST_SHARD_COUNT);
+    for (ULONG i = 0; i < DOKAN_SERIAL_TABLE_BUCKET_COUNT; ++i) {
+      TEST_CHECK(BucketLength(table, i) == 2);
+    }
+  }
+  for (ULONG i = 0; i < count; ++i) {
+    ULONG serialNumber = entries[i].SerialNumber;
+    PDOKAN_SERIAL_TABLE table =
+        &g_Tables[serialNumber & (TEST_SHARD_COUNT - 1)];
+    TEST_CHECK(DokanSerialTableFind(table, serialNumber) == &entries[i].Link);
+    DokanSerialTableRemove(table, &entries[i].Link);
+  }
+
+  // Without the shift, a shard only uses a quarter of the buckets.
+  DokanSerialTableInitialize(&g_Tables[0], 0);
+  for (ULONG i = 0; i < count; i += TEST_SHARD_COUNT) {
+    DokanSerialTableInsert(&g_Tables[0], &entries[i].Link,
+                           entries[i].SerialNumber);
+  }
+  TEST_CHECK(BucketLength(&g_Tables[0], 1) == 2 * TEST_SHARD_COUNT);
+  TEST_CHECK(BucketLength(&g_Tables[0], 2) == 0);
+  free(entries);
+}
+
+// Completes TEST_PENDING_COUNT pending IRPs newest first, the worst order for
+// the list scanned before the table.
+static VOID Benchmark(void) {
+  PDOKAN_SERIAL_TABLE table = &g_Tables[0];
+  PTEST_ENTRY entries = AllocEntries(TEST_PENDING_COUNT, 1);
+  LIST_ENTRY list;
+  ULONG64 start;
+  ULONG64 tableTime;
+  ULONG64 listTime;
+  DokanSerialTableInitialize(table, 0);
+  InitializeListHead(&list);
+  for (ULONG i = 0; i < TEST_PENDING_COUNT; ++i) {
+    DokanSerialTableInsert(table, &entries[i].Link, entries[i].SerialNumber);
+    InsertTailList(&list, &entries[i].ListEntry);
+  }
+
+  start = TestNowMicroseconds();
+  for (ULONG i = TEST_PENDING_COUNT; i-- > 0;) {
+    PDOKAN_SERIAL_TABLE_LINK link =
+        DokanSerialTableFind(table, entries[i].SerialNumber);
+    TEST_CHECK(link == &entries[i].Link);
+    DokanSerialTableRemove(table, link);
+  }
+  tableTime = TestNowMicroseconds() - start;
+
+  start = TestNowMicroseconds();
+  for (ULONG i = TEST_PENDING_COUNT; i-- > 0;) {
+    PLIST_ENTRY entry;
+    for (entry = list.Flink; entry != &list; entry = entry->Flink) {
+      if (CONTAINING_RECORD(entry, TEST_ENTRY, ListEntry)->SerialNumber ==
+          entries[i].SerialNumber) {
+        break;
+      }
+    }
+    TEST_CHECK(entry == &entries[i].ListEntry);
+    RemoveEntryList(entry);
+  }
+  listTime = TestNowMicroseconds() - start;
+  printf("%d pending IRPs completed newest first: table %llu us, list %llu "
+         "us\n",
+         TEST_PENDING_COUNT, tableTime, listTime);
+  free(entries);
+}
+
+// Returns TRUE if the lock was held by another thread.
+static BOOL AcquireSpinLock(PTEST_SPIN_LOCK Lock) {
+  ULONG spins = 0;
+  if (InterlockedCompareExchange(&Lock->Value, 1, 0) == 0) {
+    return FALSE;
+  }
+  while (Lock->Value || InterlockedCompareExchange(&Lock->Value, 1, 0) != 0) {
+    // A kernel spin lock holder cannot be preempted, a thread here can. Let
+    // it run rather than spinning until the end of the time slice.
+    if (++spins % 64 == 0) {
+      SwitchToThread();
+    } else {
+      YieldProcessor();
+    }
+  }
+  return TRUE;
+}
+
+static VOID ReleaseSpinLock(PTEST_SPIN_LOCK Lock) {
+  InterlockedExchange(&Lock->Value, 0);
+}
+
+static PTEST_SHARD GetShard(PTEST_CONTENTION Contention, ULONG SerialNumber) {
+  return &Contention->Shards[SerialNumber & (Contention->ShardCount - 1)];
+}
+
+// Registers pending IRPs under new serial numbers and completes the oldest
+// one after each, like the event threads and the replies of a volume.
+static VOID ContentionRoutine(PVOID Context, ULONG Index) {
+  PTEST_CONTENTION contention = (PTEST_CONTENTION)Context;
+  PTEST_ENTRY entries = AllocEntries(TEST_THREAD_PENDING_COUNT, 0);
+  ULONG64 contended = 0;
+  for (ULONG i = 0; i < TEST_THREAD_IRP_COUNT; ++i) {
+    PTEST_ENTRY entry = &entries[i % TEST_THREAD_PENDING_COUNT];
+    PTEST_SHARD shard;
+    if (i >= TEST_THREAD_PENDING_COUNT) {
+      shard = GetShard(contention, entry->SerialNumber);
+      contended += AcquireSpinLock(&shard->Lock);
+      TEST_CHECK(DokanSerialTableFind(&shard->Table, entry->SerialNumber) ==
+                 &entry->Link);
+      DokanSerialTableRemove(&shard->Table, &entry->Link);
+      ReleaseSpinLock(&shard->Lock);
+    }
+    entry->SerialNumber =
+        (ULONG)InterlockedIncrement(&contention->NextSerialNumber);
+    shard = GetShard(contention, entry->SerialNumber);
+    contended += AcquireSpinLock(&shard->Lock);
+    DokanSerialTableInsert(&shard->Table, &entry->Link, entry->SerialNumber);
+    ReleaseSpinLock(&shard->Lock);
+  }
+  for (ULONG i = 0; i < TEST_THREAD_PENDING_COUNT; ++i) {
+    PTEST_SHARD shard = GetShard(contention, entries[i].SerialNumber);
+    contended += AcquireSpinLock(&shard->Lock);
+    DokanSerialTableRemove(&shard->Table, &entries[i].Link);
+    ReleaseSpinLock(&shard->Lock);
+  }
+  contention->Contended[Index] = contended;
+  free(entries);
+}
+
+// Runs TEST_THREAD_COUNT threads on ShardBits sharded tables, with KeyShift
+// set like in the driver.
+static VOID BenchmarkContention(ULONG ShardBits) {
+  TEST_CONTENTION contention;
+  ULONG64 contended = 0;
+  ULONG64 acquisitions = (ULONG64)TEST_THREAD_COUNT * TEST_THREAD_IRP_COUNT * 2;
+  ULONG64 start;
+  ULONG64 elapsed;
+  ZeroMemory(&contention, sizeof(contention));
+  contention.ShardCount = 1UL << ShardBits;
+  contention.Shards = _aligned_malloc(
+      contention.ShardCount * sizeof(TEST_SHARD), TEST_CACHE_LINE_SIZE);
+  TEST_CHECK(contention.Shards);
+  for (ULONG i = 0; i < contention.ShardCount; ++i) {
+    contention.Shards[i].Lock.Value = 0;
+    DokanSerialTableInitialize(&contention.Shards[i].Table, ShardBits);
+  }
+
+  start = TestNowMicroseconds();
+  TestRunThreads(TEST_THREAD_COUNT, ContentionRoutine, &contention);
+  elapsed = TestNowMicroseconds() - start;
+  for (ULONG i = 0; i < contention.ShardCount; ++i) {
+    TEST_CHECK(contention.Shards[i].Table.Count == 0);
+  }
+  for (ULONG i = 0; i < TEST_THREAD_COUNT; ++i) {
+    contended += contention.Contended[i];
+  }
+  printf("%d threads, %2lu shards: %llu us, %.3f%% of the lock acquisitions "
+         "contended\n",
+         TEST_THREAD_COUNT, contention.ShardCount, elapsed,
+         contended * 100.0 / acquisitions);
+  _aligned_free(contention.Shards);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  TestFindRemove();
+  TestWrapAround();
+  TestShards();
+  Benchmark();
+  // A single lock, then up to the 16 shards the driver allows.
+  BenchmarkContention(0);
+  BenchmarkContention(TEST_SHARD_BITS);
+  BenchmarkContention(4);
+  printf("serial table test passed\n");
+  return 0;
+}
@@ -0,0 +1,495 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "test_fs.h"
+
+TEST_FS_COUNTERS g_TestFsCounters;
+TEST_FS_COMPLETION g_TestFsCompletion;
+
+static CRITICAL_SECTION g_TestFsLock;
+static TEST_FS_FILE g_TestFsFiles[TEST_FS_FILE_MAX];
+// Files in use at the start of g_TestFsFiles.
+static volatile LONG g_TestFsFileCount;
+
+static BOOL IsRoot(LPCWSTR FileName) {
+  return FileName[0] == L'\\' && FileName[1] == L'\0';
+}
+
+PTEST_FS_FILE TestFs_GetOpenFile(PDOKAN_FILE_INFO DokanFileInfo) {
+  if (!DokanFileInfo->Context) {
+    return NULL;
+  }
+  return &g_TestFsFiles[DokanFileInfo->Context - 1];
+}
+
+PTEST_FS_FILE TestFs_Find(LPCWSTR FileName) {
+  LONG count = InterlockedCompareExchange(&g_TestFsFileCount, 0, 0);
+  for (LONG i = 0; i < count; ++i) {
+    if (_wcsicmp(g_TestFsFiles[i].Name, FileName) == 0) {
+      return &g_TestFsFiles[i];
+    }
+  }
+  return NULL;
+}
+
+// Called with g_TestFsLock held.
+static PTEST_FS_FILE AddFile(LPCWSTR FileName, BOOL Directory) {
+  PTEST_FS_FILE file;
+  if (g_TestFsFileCount == TEST_FS_FILE_MAX ||
+      wcslen(FileName) >= TEST_FS_NAME_MAX) {
+    return NULL;
+  }
+  file = &g_TestFsFiles[g_TestFsFileCount];
+  ZeroMemory(file, sizeof(TEST_FS_FILE));
+  InitializeSRWLock(&file->Lock);
+  wcscpy_s(file->Name, TEST_FS_NAME_MAX, FileName);
+  file->Directory = Directory;
+  // Published once initialized, the lookups do not take the lock.
+  InterlockedIncrement(&g_TestFsFileCount);
+  return file;
+}
+
+BOOL TestFs_AddFiles(LPCWSTR Prefix, ULONG Count) {
+  BOOL success = TRUE;
+  EnterCriticalSection(&g_TestFsLock);
+  for (ULONG i = 0; i < Count && success; ++i) {
+    WCHAR name[TEST_FS_NAME_MAX];
+    swprintf_s(name, TEST_FS_NAME_MAX, L"\\%s%lu", Prefix, i);
+    success = AddFile(name, /*Directory=*/FALSE) != NULL;
+  }
+  LeaveCriticalSection(&g_TestFsLock);
+  return success;
+}
+
+PTEST_FS_FILE TestFs_AddFile(LPCWSTR FileName, const VOID *Data, ULONG Size) {
+  PTEST_FS_FILE file = NULL;
+  PCHAR data = malloc(max(Size, 1));
+  if (!data) {
+    return NULL;
+  }
+  RtlCopyMemory(data, Data, Size);
+  EnterCriticalSection(&g_TestFsLock);
+  if (!TestFs_Find(FileName)) {
+    file = AddFile(FileName, /*Directory=*/FALSE);
+  }
+  if (file) {
+    file->Data = data;
+    file->Size = Size;
+    file->Capacity = max(Size, 1);
+  }
+  LeaveCriticalSection(&g_TestFsLock);
+  if (!file) {
+    free(data);
+  }
+  return file;
+}
+
+VOID TestFs_Reset(void) {
+  EnterCriticalSection(&g_TestFsLock);
+  for (LONG i = 0; i < g_TestFsFileCount; ++i) {
+    free(g_TestFsFiles[i].Data);
+  }
+  g_TestFsFileCount = 0;
+  ZeroMemory(&g_TestFsCounters, sizeof(TEST_FS_COUNTERS));
+  LeaveCriticalSection(&g_TestFsLock);
+}
+
+static NTSTATUS DOKAN_CALLBACK TestFsCreateFile(
+    LPCWSTR FileName, PDOKAN_IO_SECURITY_CONTEXT SecurityContext,
+    ACCESS_MASK DesiredAccess, ULONG FileAttributes, ULONG ShareAccess,
+    ULONG CreateDisposition, ULONG CreateOptions,
+    PDOKAN_FILE_INFO DokanFileInfo) {
+  PTEST_FS_FILE file;
+  UNREFERENCED_PARAMETER(SecurityContext);
+  UNREFERENCED_PARAMETER(DesiredAccess);
+  UNREFERENCED_PARAMETER(FileAttributes);
+  UNREFERENCED_PARAMETER(ShareAccess);
+
+  InterlockedIncrement64(&g_TestFsCounters.Creates);
+  if (IsRoot(FileName)) {
+    DokanFileInfo->IsDirectory = TRUE;
+    DokanFileInfo->Context = 0;
+    return STATUS_SUCCESS;
+  }
+  file = TestFs_Find(FileName);
+  if (!file) {
+    if (CreateDisposition == FILE_OPEN || CreateDisposition == FILE_OVERWRITE) {
+      return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+    EnterCriticalSection(&g_TestFsLock);
+    // Another open may have created it meanwhile.
+    file = TestFs_Find(FileName);
+    if (!file) {
+      file = AddFile(FileName, (CreateOptions & FILE_DIRECTORY_FILE) != 0);
+    }
+    LeaveCriticalSection(&g_TestFsLock);
+    if (!file) {
+      return STATUS_INSUFFICIENT_RESOURCES;
+    }
+  } else if (CreateDisposition == FILE_CREATE) {
+    return STATUS_OBJECT_NAME_COLLISION;
+  }
+  if (file->Directory && (CreateOptions & FILE_NON_DIRECTORY_FILE)) {
+    return STATUS_FILE_IS_A_DIRECTORY;
+  }
+  if (!file->Directory && (CreateOptions & FILE_DIRECTORY_FILE)) {
+    return STATUS_NOT_A_DIRECTORY;
+  }
+  DokanFileInfo->IsDirectory = (UCHAR)file->Directory;
+  DokanFileInfo->Context = (ULONG64)(file - g_TestFsFiles) + 1;
+  return STATUS_SUCCESS;
+}
+
+static void DOKAN_CALLBACK TestFsCleanup(LPCWSTR FileName,
+                                         PDOKAN_FILE_INFO DokanFileInfo) {
+  PTEST_FS_FILE file = TestFs_GetOpenFile(DokanFileInfo);
+  UNREFERENCED_PARAMETER(FileName);
+  InterlockedIncrement64(&g_TestFsCounters.Cleanups);
+  if (file && DokanFileInfo->DeletePending) {
+    EnterCriticalSection(&g_TestFsLock);
+    file->Name[0] = L'\0';
+    LeaveCriticalSection(&g_TestFsLock);
+  }
+}
+
+static void DOKAN_CALLBACK TestFsCloseFile(LPCWSTR FileName,
+                                           PDOKAN_FILE_INFO DokanFileInfo) {
+  UNREFERENCED_PARAMETER(FileName);
+  UNREFERENCED_PARAMETER(DokanFileInfo);
+  InterlockedIncrement64(&g_TestFsCounters.Closes);
+}
+
+typedef struct _TEST_FS_COMPLETION_CONTEXT {
+  PDOKAN_FILE_INFO DokanFileInfo;
+  BOOL Write;
+  ULONG Length;
+  NTSTATUS Status;
+} TEST_FS_COMPLETION_CONTEXT, *PTEST_FS_COMPLETION_CONTEXT;
+
+static VOID EndDispatchIo(PDOKAN_FILE_INFO DokanFileInfo, BOOL Write,
+                          ULONG Length, NTSTATUS Status) {
+  if (Write) {
+    DokanEndDispatchWrite(DokanFileInfo, Length, Status);
+  } else {
+    DokanEndDispatchRead(DokanFileInfo, Length, Status);
+  }
+}
+
+static VOID CALLBACK CompleteIoCallback(PTP_CALLBACK_INSTANCE Instance,
+                                        PVOID Context) {
+  PTEST_FS_COMPLETION_CONTEXT completion = Context;
+  UNREFERENCED_PARAMETER(Instance);
+  // Leaves the callback time to return, so that the event is usually
+  // detached from its pulling thread when completed.
+  Sleep(1);
+  EndDispatchIo(completion->DokanFileInfo, completion->Write,
+                completion->Length, completion->Status);
+  free(completion);
+}
+
+// Returns the result of a read or write already done, or completes it as
+// g_TestFsCompletion asks and returns STATUS_PENDING.
+static NTSTATUS CompleteIo(PDOKAN_FILE_INFO DokanFileInfo, BOOL Write,
+                           ULONG Length, NTSTATUS Status) {
+  PTEST_FS_COMPLETION_CONTEXT completion;
+  switch (g_TestFsCompletion) {
+  case TestFsCompletionBeforeReturn:
+    InterlockedIncrement64(&g_TestFsCounters.PendingIos);
+    EndDispatchIo(DokanFileInfo, Write, Length, Status);
+    return STATUS_PENDING;
+  case TestFsCompletionAfterReturn:
+    InterlockedIncrement64(&g_TestFsCounters.PendingIos);
+    completion = malloc(sizeof(TEST_FS_COMPLETION_CONTEXT));
+    TEST_CHECK(completion != NULL);
+    completion->DokanFileInfo = DokanFileInfo;
+    completion->Write = Write;
+    completion->Length = Length;
+    completion->Status = Status;
+    TEST_CHECK(TrySubmitThreadpoolCallback(CompleteIoCallback, completion,
+                                           NULL));
+    return STATUS_PENDING;
+  default:
+    return Status;
+  }
+}
+
+static NTSTATUS DOKAN_CALLBACK TestFsReadFile(LPCWSTR FileName, LPVOID Buffer,
+                                              DWORD BufferLength,
+                                              LPDWORD ReadLength,
+                                              LONGLONG Offset,
+                                              PDOKAN_FILE_INFO DokanFileInfo) {
+  PTEST_FS_FILE file = TestFs_GetOpenFile(DokanFileInfo);
+  UNREFERENCED_PARAMETER(FileName);
+  InterlockedIncrement64(&g_TestFsCounters.Reads);
+  *ReadLength = 0;
+  if (!file) {
+    return STATUS_INVALID_DEVICE_REQUEST;
+  }
+  AcquireSRWLockShared(&file->Lock);
+  if (Offset < file->Size) {
+    *ReadLength = (DWORD)min((ULONGLONG)BufferLength, file->Size - Offset);
+    RtlCopyMemory(Buffer, file->Data + Offset, *ReadLength);
+  }
+  ReleaseSRWLockShared(&file->Lock);
+  return CompleteIo(DokanFileInfo, /*Write=*/FALSE, *ReadLength,
+                    *ReadLength || !BufferLength ? STATUS_SUCCESS
+                                                 : STATUS_END_OF_FILE);
+}
+
+static NTSTATUS DOKAN_CALLBACK TestFsWriteFile(
+    LPCWSTR FileName, LPCVOID Buffer, DWORD NumberOfBytesToWrite,
+    LPDWORD NumberOfBytesWritten, LONGLONG Offset,
+    PDOKAN_FILE_INFO DokanFileInfo) {
+  PTEST_FS_FILE file = TestFs_GetOpenFile(DokanFileInfo);
+  NTSTATUS status = STATUS_SUCCESS;
+  ULONGLONG end;
+  UNREFERENCED_PARAMETER(FileName);
+  InterlockedIncrement64(&g_TestFsCounters.Writes);
+  *NumberOfBytesWritten = 0;
+  if (!file) {
+    return STATUS_INVALID_DEVICE_REQUEST;
+  }
+  AcquireSRWLockExclusive(&file->Lock);
+  if (DokanFileInfo->WriteToEndOfFile) {
+    Offset = file->Size;
+  }
+  end = (ULONGLONG)Offset + NumberOfBytesToWrite;
+  if (end > MAXLONG) {
+    status = STATUS_DISK_FULL;
+  } else if (end > file->Capacity) {
+    ULONG capacity = max((ULONG)end, file->Capacity * 2);
+    PCHAR data = realloc(file->Data, capacity);
+    if (!data) {
+      status = STATUS_INSUFFICIENT_RESOURCES;
+    } else {
+      file->Data = data;
+      file->Capacity = capacity;
+    }
+  }
+  if (status == STATUS_SUCCESS) {
+    if (Offset > file->Size) {
+      ZeroMemory(file->Data + file->Size, (SIZE_T)(Offset - file->Size));
+    }
+    RtlCopyMemory(file->Data + Offset, Buffer, NumberOfBytesToWrite);
+    file->Size = max(file->Size, (ULONG)end);
+    *NumberOfBytesWritten = NumberOfBytesToWrite;
+  }
+  ReleaseSRWLockExclusive(&file->Lock);
+  return CompleteIo(DokanFileInfo, /*Write=*/TRUE, *NumberOfBytesWritten,
+                    status);
+}
+
+static NTSTATUS DOKAN_CALLBACK TestFsSetEndOfFile(
+    LPCWSTR FileName, LONGLONG ByteOffset, PDOKAN_FILE_INFO DokanFileInfo) {
+  PTEST_FS_FILE file = TestFs_GetOpenFile(DokanFileInfo);
+  NTSTATUS status = STATUS_SUCCESS;
+  UNREFERENCED_PARAMETER(FileName);
+  if (!file) {
+    return STATUS_INVALID_DEVICE_REQUEST;
+  }
+  if (ByteOffset < 0 || ByteOffset > MAXLONG) {
+    return STATUS_INVALID_PARAMETER;
+  }
+  AcquireSRWLockExclusive(&file->Lock);
+  if (ByteOffset > file->Capacity) {
+    PCHAR data = realloc(file->Data, (SIZE_T)ByteOffset);
+    if (!data) {
+      status = STATUS_INSUFFICIENT_RESOURCES;
+    } else {
+      file->Data = data;
+      file->Capacity = (ULONG)ByteOffset;
+    }
+  }
+  if (status == STATUS_SUCCESS) {
+    if (ByteOffset > file->Size) {
+      ZeroMemory(file->Data + file->Size, (SIZE_T)(ByteOffset - file->Size));
+    }
+    file->Size = (ULONG)ByteOffset;
+  }
+  ReleaseSRWLockExclusive(&file->Lock);
+  return status;
+}
+
+static NTSTATUS DOKAN_CALLBACK TestFsMoveFile(LPCWSTR FileName,
+                                              LPCWSTR NewFileName,
+                                              BOOL ReplaceIfExisting,
+                                              PDOKAN_FILE_INFO DokanFileInfo) {
+  PTEST_FS_FILE file = TestFs_GetOpenFile(DokanFileInfo);
+  PTEST_FS_FILE existing;
+  NTSTATUS status = STATUS_SUCCESS;
+  UNREFERENCED_PARAMETER(FileName);
+  if (!file) {
+    return STATUS_ACCESS_DENIED;
+  }
+  if (wcslen(NewFileName) >= TEST_FS_NAME_MAX) {
+    return STATUS_OBJECT_NAME_INVALID;
+  }
+  EnterCriticalSection(&g_TestFsLock);
+  existing = TestFs_Find(NewFileName);
+  if (existing && existing != file) {
+    if (!ReplaceIfExisting || existing->Directory) {
+      status = STATUS_OBJECT_NAME_COLLISION;
+    } else {
+      existing->Name[0] = L'\0';
+    }
+  }
+  if (status == STATUS_SUCCESS) {
+    wcscpy_s(file->Name, TEST_FS_NAME_MAX, NewFileName);
+  }
+  LeaveCriticalSection(&g_TestFsLock);
+  return status;
+}
+
+static NTSTATUS DOKAN_CALLBACK TestFsGetFileInformation(
+    LPCWSTR FileName, LPBY_HANDLE_FILE_INFORMATION Buffer,
+    PDOKAN_FILE_INFO DokanFileInfo) {
+  PTEST_FS_FILE file = TestFs_GetOpenFile(DokanFileInfo);
+  UNREFERENCED_PARAMETER(FileName);
+  InterlockedIncrement64(&g_TestFsCounters.Queries);
+  ZeroMemory(Buffer, sizeof(BY_HANDLE_FILE_INFORMATION));
+  Buffer->nNumberOfLinks = 1;
+  if (!file) {
+    Buffer->dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+    return STATUS_SUCCESS;
+  }
+  Buffer->dwFileAttributes =
+      file->Directory ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+  Buffer->nFileIndexLow = DokanFileInfo->Context;
+  AcquireSRWLockShared(&file->Lock);
+  Buffer->nFileSizeLow = file->Size;
+  ReleaseSRWLockShared(&file->Lock);
+  return STATUS_SUCCESS;
+}
+
+// Returns the name of FileName in the directory named DirectoryName, whose
+// name has DirectoryNameLength characters and is empty for the root, or NULL
+// if the file is not in it.
+static LPCWSTR GetNameInDirectory(LPCWSTR FileName, LPCWSTR DirectoryName,
+                                  size_t DirectoryNameLength) {
+  LPCWSTR name = FileName + DirectoryNameLength + 1;
+  if (wcsncmp(FileName, DirectoryName, DirectoryNameLength) != 0 ||
+      FileName[DirectoryNameLength] != L'\\' || !name[0] ||
+      wcschr(name, L'\\')) {
+    return NULL;
+  }
+  return name;
+}
+
+static NTSTATUS DOKAN_CALLBACK TestFsFindFiles(LPCWSTR FileName,
+                                               PFillFindData FillFindData,
+                                               PDOKAN_FILE_INFO DokanFileInfo) {
+  LONG count = InterlockedCompareExchange(&g_TestFsFileCount, 0, 0);
+  PTEST_FS_FILE directory = TestFs_GetOpenFile(DokanFileInfo);
+  size_t directoryNameLength = IsRoot(FileName) ? 0 : wcslen(FileName);
+  // Streamed queries resume after the entries the previous ones returned.
+  ULONG skip = DokanGetFindFilesStartIndex(DokanFileInfo);
+  InterlockedIncrement64(&g_TestFsCounters.FindFiles);
+  if (directory && !directory->Directory) {
+    return STATUS_NOT_A_DIRECTORY;
+  }
+  for (LONG i = 0; i < count; ++i) {
+    WIN32_FIND_DATAW findData;
+    LPCWSTR name = GetNameInDirectory(g_TestFsFiles[i].Name, FileName,
+                                      directoryNameLength);
+    if (!name) {
+      continue;
+    }
+    if (skip) {
+      --skip;
+      continue;
+    }
+    ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
+    findData.dwFileAttributes = g_TestFsFiles[i].Directory
+                                    ? FILE_ATTRIBUTE_DIRECTORY
+                                    : FILE_ATTRIBUTE_NORMAL;
+    wcscpy_s(findData.cFileName, MAX_PATH, name);
+    findData.nFileSizeLow = g_TestFsFiles[i].Size;
+    if (FillFindData(&findData, DokanFileInfo)) {
+      // The buffer is full.
+      break;
+    }
+  }
+  return STATUS_SUCCESS;
+}
+
+VOID TestFs_Initialize(PDOKAN_OPERATIONS Operations) {
+  static volatile LONG initialized;
+  if (!InterlockedExchange(&initialized, 1)) {
+    InitializeCriticalSection(&g_TestFsLock);
+  }
+  ZeroMemory(Operations, sizeof(DOKAN_OPERATIONS));
+  Operations->ZwCreateFile = TestFsCreateFile;
+  Operations->Cleanup = TestFsCleanup;
+  Operations->CloseFile = TestFsCloseFile;
+  Operations->ReadFile = TestFsReadFile;
+  Operations->WriteFile = TestFsWriteFile;
+  Operations->SetEndOfFile = TestFsSetEndOfFile;
+  Operations->MoveFile = TestFsMoveFile;
+  Operations->GetFileInformation = TestFsGetFileInformation;
+  Operations->FindFiles = TestFsFindFiles;
+}
+
+VOID TestFs_InitializeOptions(PDOKAN_OPTIONS Options) {
+  ZeroMemory(Options, sizeof(DOKAN_OPTIONS));
+  Options->Version = DOKAN_VERSION;
+  Options->MountPoint = L"M:\\";
+}
+
+typedef struct _TEST_THREADS {
+  PTEST_THREAD_ROUTINE Routine;
+  PVOID Context;
+  volatile LONG NextIndex;
+} TEST_THREADS, *PTEST_THREADS;
+
+static VOID CALLBACK RunTestThread(PTP_CALLBACK_INSTANCE Instance,
+                                   PVOID Context, PTP_WORK Work) {
+  PTEST_THREADS threads = Context;
+  UNREFERENCED_PARAMETER(Instance);
+  UNREFERENCED_PARAMETER(Work);
+  threads->Routine(threads->Context,
+                   (ULONG)InterlockedIncrement(&threads->NextIndex) - 1);
+}
+
+VOID TestRunThreads(ULONG ThreadCount, PTEST_THREAD_ROUTINE Routine,
+                    PVOID Context) {
+  TEST_THREADS threads;
+  PTP_WORK work;
+  threads.Routine = Routine;
+  threads.Context = Context;
+  threads.NextIndex = 0;
+  work = CreateThreadpoolWork(RunTestThread, &threads, NULL);
+  TEST_CHECK(work != NULL);
+  for (ULONG i = 0; i < ThreadCount; ++i) {
+    SubmitThreadpoolWork(work);
+  }
+  WaitForThreadpoolWorkCallbacks(work, FALSE);
+  CloseThreadpoolWork(work);
+}
+
+ULONG64 TestNowMicroseconds(void) {
+  LARGE_INTEGER counter;
+  LARGE_INTEGER frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (ULONG64)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+         (ULONG64)(counter.QuadPart % frequency.QuadPart) * 1000000 /
+             (ULONG64)frequency.QuadPart;
+}
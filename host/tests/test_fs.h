@@ -0,0 +1,119 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_HOST_TEST_FS_H_
+#define DOKAN_HOST_TEST_FS_H_
+
+#include "../../dokan/dokan.h"
+
+// In-memory file system of the host tests and benchmarks. Files and
+// directories are created on open, the context of an open is the index of
+// its file plus one. A name with several components is the one of a flat
+// file too, for the benchmarks of deep names, and a directory lists the
+// files whose name is its own plus one component. Files are deleted by the
+// cleanup of an open with DeletePending and renamed in place; unlike the
+// lookups, these do not expect other threads to use the file meanwhile.
+
+#define TEST_FS_FILE_MAX 4096
+#define TEST_FS_NAME_MAX MAX_PATH
+
+typedef struct _TEST_FS_FILE {
+  SRWLOCK Lock;
+  // Empty once deleted.
+  WCHAR Name[TEST_FS_NAME_MAX];
+  BOOL Directory;
+  PCHAR Data;
+  ULONG Size;
+  ULONG Capacity;
+} TEST_FS_FILE, *PTEST_FS_FILE;
+
+typedef struct _TEST_FS_COUNTERS {
+  volatile LONG64 Creates;
+  volatile LONG64 Reads;
+  volatile LONG64 Writes;
+  volatile LONG64 Queries;
+  volatile LONG64 Cleanups;
+  volatile LONG64 Closes;
+  volatile LONG64 FindFiles;
+  // Reads and writes that returned STATUS_PENDING.
+  volatile LONG64 PendingIos;
+} TEST_FS_COUNTERS, *PTEST_FS_COUNTERS;
+
+extern TEST_FS_COUNTERS g_TestFsCounters;
+
+// How ReadFile and WriteFile complete.
+typedef enum _TEST_FS_COMPLETION {
+  // By returning their status.
+  TestFsCompletionSynchronous,
+  // By DokanEndDispatchRead or DokanEndDispatchWrite, then returning
+  // STATUS_PENDING.
+  TestFsCompletionBeforeReturn,
+  // By DokanEndDispatchRead or DokanEndDispatchWrite from a pool thread,
+  // usually once they returned STATUS_PENDING.
+  TestFsCompletionAfterReturn,
+} TEST_FS_COMPLETION;
+
+// TestFsCompletionSynchronous unless a test changes it.
+extern TEST_FS_COMPLETION g_TestFsCompletion;
+
+// Fills Operations with the callbacks of the file system.
+VOID TestFs_Initialize(PDOKAN_OPERATIONS Operations);
+
+// Removes all the files and resets the counters.
+VOID TestFs_Reset(void);
+
+// Returns the file named FileName, NULL if it does not exist.
+PTEST_FS_FILE TestFs_Find(LPCWSTR FileName);
+
+// Returns the file of an open, NULL for the root.
+PTEST_FS_FILE TestFs_GetOpenFile(PDOKAN_FILE_INFO DokanFileInfo);
+
+// Adds Count empty files named <Prefix><N> for the enumerations.
+BOOL TestFs_AddFiles(LPCWSTR Prefix, ULONG Count);
+
+// Adds the file FileName holding the Size bytes of Data. Returns NULL if it
+// exists or there is no room.
+PTEST_FS_FILE TestFs_AddFile(LPCWSTR FileName, const VOID *Data, ULONG Size);
+
+// Fills Options with the defaults of the tests.
+VOID TestFs_InitializeOptions(PDOKAN_OPTIONS Options);
+
+typedef VOID (*PTEST_THREAD_ROUTINE)(PVOID Context, ULONG Index);
+
+// Runs Routine on ThreadCount threads of the default thread pool, with the
+// indexes 0 to ThreadCount - 1, and waits for them.
+VOID TestRunThreads(ULONG ThreadCount, PTEST_THREAD_ROUTINE Routine,
+                    PVOID Context);
+
+// Returns a monotonic time in microseconds, for the benchmarks.
+ULONG64 TestNowMicroseconds(void);
+
+// Prints the failed check and exits.
+#define TEST_CHECK(condition)                                                  \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      exit(1);                                                                 \
+    }                                                                          \
+  } while (0)
+
+#endif // DOKAN_HOST_TEST_FS_H_
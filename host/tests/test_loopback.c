@@ -0,0 +1,349 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "test_loopback.h"
+
+// Largest data of a read, a write or a directory query reply.
+#define TEST_LOOPBACK_MAX_DATA (64 * 1024)
+
+#define TEST_LOOPBACK_ALIGN(Length) (((Length) + 7) & ~(SIZE_T)7)
+
+typedef struct _TEST_LOOPBACK_REPLY {
+  EVENT_INFORMATION Header;
+  CHAR Data[TEST_LOOPBACK_MAX_DATA];
+} TEST_LOOPBACK_REPLY, *PTEST_LOOPBACK_REPLY;
+
+static ULONG GetFileNameLength(LPCWSTR FileName) {
+  return (ULONG)(wcslen(FileName) * sizeof(WCHAR));
+}
+
+// Returns a zeroed event whose operation ends at Length, to free.
+static PEVENT_CONTEXT AllocEvent(UCHAR MajorFunction, ULONG64 Context,
+                                 SIZE_T Length) {
+  ULONG eventLength = (ULONG)max(sizeof(EVENT_CONTEXT),
+                                 TEST_LOOPBACK_ALIGN(Length));
+  PEVENT_CONTEXT eventContext;
+  TEST_CHECK(eventLength <= EVENT_CONTEXT_MAX_SIZE);
+  eventContext = calloc(1, eventLength);
+  TEST_CHECK(eventContext != NULL);
+  eventContext->Length = eventLength;
+  eventContext->MajorFunction = MajorFunction;
+  eventContext->Context = Context;
+  return eventContext;
+}
+
+// Sends the event, frees it and returns the status of its reply.
+static NTSTATUS SendEvent(PDOKAN_INSTANCE Instance,
+                          PEVENT_CONTEXT EventContext,
+                          PTEST_LOOPBACK_REPLY Reply) {
+  ZeroMemory(&Reply->Header, sizeof(EVENT_INFORMATION));
+  TEST_CHECK(DokanLoopback_SendEvent(
+      (PDOKAN_LOOPBACK)Instance->TransportContext, EventContext,
+      &Reply->Header, sizeof(TEST_LOOPBACK_REPLY)));
+  free(EventContext);
+  return Reply->Header.Status;
+}
+
+static PTEST_LOOPBACK_REPLY AllocReply(void) {
+  PTEST_LOOPBACK_REPLY reply = malloc(sizeof(TEST_LOOPBACK_REPLY));
+  TEST_CHECK(reply != NULL);
+  return reply;
+}
+
+PDOKAN_INSTANCE TestLoopback_Start(PDOKAN_OPTIONS Options,
+                                   PDOKAN_OPERATIONS Operations) {
+  PDOKAN_INSTANCE instance = DokanStartLoopbackInstance(Options, Operations);
+  TEST_CHECK(instance != NULL);
+  return instance;
+}
+
+VOID TestLoopback_Stop(PDOKAN_INSTANCE Instance) {
+  DokanStopLoopbackInstance(Instance);
+}
+
+NTSTATUS TestLoopback_Create(PDOKAN_INSTANCE Instance, LPCWSTR FileName,
+                             ULONG CreateDisposition, BOOL Directory,
+                             PULONG64 Context, PULONG Information) {
+  ULONG nameOffset =
+      sizeof(CREATE_CONTEXT) + 2 * sizeof(DOKAN_UNICODE_STRING_INTERMEDIATE);
+  ULONG fileNameLength = GetFileNameLength(FileName);
+  PEVENT_CONTEXT eventContext =
+      AllocEvent(IRP_MJ_CREATE, 0,
+                 FIELD_OFFSET(EVENT_CONTEXT, Operation.Create) + nameOffset +
+                     fileNameLength + sizeof(WCHAR));
+  PCREATE_CONTEXT create = &eventContext->Operation.Create;
+  PDOKAN_ACCESS_STATE_INTERMEDIATE accessState =
+      &create->SecurityContext.AccessState;
+  PTEST_LOOPBACK_REPLY reply = AllocReply();
+  NTSTATUS status;
+  // Empty object name and type, followed by the file name.
+  accessState->UnicodeStringObjectNameOffset = sizeof(CREATE_CONTEXT);
+  accessState->UnicodeStringObjectTypeOffset =
+      sizeof(CREATE_CONTEXT) + sizeof(DOKAN_UNICODE_STRING_INTERMEDIATE);
+  accessState->OriginalDesiredAccess = FILE_GENERIC_READ | FILE_GENERIC_WRITE;
+  accessState->RemainingDesiredAccess = accessState->OriginalDesiredAccess;
+  create->SecurityContext.DesiredAccess = accessState->OriginalDesiredAccess;
+  create->FileAttributes = FILE_ATTRIBUTE_NORMAL;
+  create->CreateOptions =
+      (CreateDisposition << 24) |
+      (Directory ? FILE_DIRECTORY_FILE : FILE_NON_DIRECTORY_FILE) |
+      FILE_SYNCHRONOUS_IO_NONALERT;
+  create->ShareAccess = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+  create->FileNameLength = fileNameLength;
+  create->FileNameOffset = nameOffset;
+  RtlCopyMemory((PCHAR)create + nameOffset, FileName, fileNameLength);
+
+  status = SendEvent(Instance, eventContext, reply);
+  *Context = reply->Header.Context;
+  if (Information) {
+    *Information = reply->Header.Operation.Create.Information;
+  }
+  free(reply);
+  return status;
+}
+
+NTSTATUS TestLoopback_Read(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                           LPCWSTR FileName, LONG64 Offset, PVOID Buffer,
+                           ULONG Length, PULONG ReadLength) {
+  ULONG fileNameLength = GetFileNameLength(FileName);
+  PEVENT_CONTEXT eventContext = AllocEvent(
+      IRP_MJ_READ, Context,
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.Read.FileName) + fileNameLength +
+          sizeof(WCHAR));
+  PTEST_LOOPBACK_REPLY reply = AllocReply();
+  NTSTATUS status;
+  TEST_CHECK(Length <= TEST_LOOPBACK_MAX_DATA);
+  eventContext->Operation.Read.ByteOffset.QuadPart = Offset;
+  eventContext->Operation.Read.BufferLength = Length;
+  eventContext->Operation.Read.FileNameLength = fileNameLength;
+  RtlCopyMemory(eventContext->Operation.Read.FileName, FileName,
+                fileNameLength);
+
+  status = SendEvent(Instance, eventContext, reply);
+  *ReadLength = 0;
+  if (status == STATUS_SUCCESS) {
+    TEST_CHECK(reply->Header.BufferLength <= Length);
+    *ReadLength = reply->Header.BufferLength;
+    RtlCopyMemory(Buffer, reply->Header.Buffer, *ReadLength);
+  }
+  free(reply);
+  return status;
+}
+
+NTSTATUS TestLoopback_Write(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                            LPCWSTR FileName, LONG64 Offset, const VOID *Data,
+                            ULONG Length) {
+  ULONG fileNameLength = GetFileNameLength(FileName);
+  ULONG bufferOffset = (ULONG)TEST_LOOPBACK_ALIGN(
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.Write.FileName) + fileNameLength +
+      sizeof(WCHAR));
+  PEVENT_CONTEXT eventContext =
+      AllocEvent(IRP_MJ_WRITE, Context, (SIZE_T)bufferOffset + Length);
+  PTEST_LOOPBACK_REPLY reply = AllocReply();
+  NTSTATUS status;
+  eventContext->Operation.Write.ByteOffset.QuadPart = Offset;
+  eventContext->Operation.Write.BufferLength = Length;
+  eventContext->Operation.Write.BufferOffset = bufferOffset;
+  eventContext->Operation.Write.FileNameLength = fileNameLength;
+  RtlCopyMemory(eventContext->Operation.Write.FileName, FileName,
+                fileNameLength);
+  RtlCopyMemory((PCHAR)eventContext + bufferOffset, Data, Length);
+
+  status = SendEvent(Instance, eventContext, reply);
+  TEST_CHECK(status != STATUS_SUCCESS || reply->Header.BufferLength == Length);
+  free(reply);
+  return status;
+}
+
+NTSTATUS TestLoopback_QueryInformation(PDOKAN_INSTANCE Instance,
+                                       ULONG64 Context, LPCWSTR FileName,
+                                       ULONG FileInformationClass,
+                                       PVOID Buffer, ULONG Length) {
+  ULONG fileNameLength = GetFileNameLength(FileName);
+  PEVENT_CONTEXT eventContext = AllocEvent(
+      IRP_MJ_QUERY_INFORMATION, Context,
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.File.FileName) + fileNameLength +
+          sizeof(WCHAR));
+  PTEST_LOOPBACK_REPLY reply = AllocReply();
+  NTSTATUS status;
+  eventContext->Operation.File.FileInformationClass = FileInformationClass;
+  eventContext->Operation.File.BufferLength = Length;
+  eventContext->Operation.File.FileNameLength = fileNameLength;
+  RtlCopyMemory(eventContext->Operation.File.FileName, FileName,
+                fileNameLength);
+
+  status = SendEvent(Instance, eventContext, reply);
+  if (status == STATUS_SUCCESS) {
+    TEST_CHECK(reply->Header.BufferLength == Length);
+    RtlCopyMemory(Buffer, reply->Header.Buffer, Length);
+  }
+  free(reply);
+  return status;
+}
+
+// Sends a set information of FileInformationClass with the Length bytes of
+// Buffer.
+static NTSTATUS SetInformation(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                               LPCWSTR FileName, ULONG FileInformationClass,
+                               const VOID *Buffer, ULONG Length) {
+  ULONG fileNameLength = GetFileNameLength(FileName);
+  ULONG bufferOffset = (ULONG)TEST_LOOPBACK_ALIGN(
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.SetFile.FileName) +
+      fileNameLength + sizeof(WCHAR));
+  PEVENT_CONTEXT eventContext = AllocEvent(IRP_MJ_SET_INFORMATION, Context,
+                                           (SIZE_T)bufferOffset + Length);
+  PTEST_LOOPBACK_REPLY reply = AllocReply();
+  NTSTATUS status;
+  eventContext->Operation.SetFile.FileInformationClass = FileInformationClass;
+  eventContext->Operation.SetFile.BufferLength = Length;
+  eventContext->Operation.SetFile.BufferOffset = bufferOffset;
+  eventContext->Operation.SetFile.FileNameLength = fileNameLength;
+  RtlCopyMemory(eventContext->Operation.SetFile.FileName, FileName,
+                fileNameLength);
+  RtlCopyMemory((PCHAR)eventContext + bufferOffset, Buffer, Length);
+
+  status = SendEvent(Instance, eventContext, reply);
+  free(reply);
+  return status;
+}
+
+NTSTATUS TestLoopback_SetEndOfFile(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                                   LPCWSTR FileName, LONG64 EndOfFile) {
+  FILE_END_OF_FILE_INFORMATION endOfFile;
+  endOfFile.EndOfFile.QuadPart = EndOfFile;
+  return SetInformation(Instance, Context, FileName, FileEndOfFileInformation,
+                        &endOfFile, sizeof(endOfFile));
+}
+
+NTSTATUS TestLoopback_Rename(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                             LPCWSTR FileName, LPCWSTR NewFileName) {
+  ULONG newFileNameLength = GetFileNameLength(NewFileName);
+  ULONG length = (ULONG)FIELD_OFFSET(DOKAN_RENAME_INFORMATION, FileName) +
+                 newFileNameLength + sizeof(WCHAR);
+  PDOKAN_RENAME_INFORMATION renameInfo = calloc(1, length);
+  NTSTATUS status;
+  TEST_CHECK(renameInfo != NULL);
+  renameInfo->FileNameLength = newFileNameLength;
+  RtlCopyMemory(renameInfo->FileName, NewFileName, newFileNameLength);
+  status = SetInformation(Instance, Context, FileName, FileRenameInformation,
+                          renameInfo, length);
+  free(renameInfo);
+  return status;
+}
+
+// Counts the entries of a directory query reply other than "." and "..", and
+// sets Size to the one of Name when found.
+static ULONG ReadDirectoryEntries(PEVENT_INFORMATION EventInfo, LPCWSTR Name,
+                                  PLONG64 Size) {
+  ULONG count = 0;
+  ULONG offset = 0;
+  size_t nameLength = wcslen(Name);
+  for (;;) {
+    PFILE_BOTH_DIR_INFORMATION entry =
+        (PFILE_BOTH_DIR_INFORMATION)(EventInfo->Buffer + offset);
+    ULONG entryNameLength = entry->FileNameLength / sizeof(WCHAR);
+    BOOL dots = (entryNameLength == 1 && entry->FileName[0] == L'.') ||
+                (entryNameLength == 2 && entry->FileName[0] == L'.' &&
+                 entry->FileName[1] == L'.');
+    if (!dots) {
+      ++count;
+      if (entryNameLength == nameLength &&
+          wcsncmp(entry->FileName, Name, nameLength) == 0) {
+        *Size = entry->EndOfFile.QuadPart;
+      }
+    }
+    if (!entry->NextEntryOffset ||
+        entry->NextEntryOffset >= EventInfo->BufferLength - offset) {
+      return count;
+    }
+    offset += entry->NextEntryOffset;
+  }
+}
+
+ULONG TestLoopback_ListDirectory(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                                 LPCWSTR DirectoryName, LPCWSTR Name,
+                                 PLONG64 Size) {
+  ULONG directoryNameLength = GetFileNameLength(DirectoryName);
+  PTEST_LOOPBACK_REPLY reply = AllocReply();
+  ULONG fileIndex = 0;
+  ULONG count = 0;
+  *Size = -1;
+  for (;;) {
+    PEVENT_CONTEXT eventContext = AllocEvent(
+        IRP_MJ_DIRECTORY_CONTROL, Context,
+        FIELD_OFFSET(EVENT_CONTEXT, Operation.Directory.DirectoryName) +
+            directoryNameLength + sizeof(WCHAR));
+    NTSTATUS status;
+    if (!fileIndex) {
+      eventContext->Flags = SL_RESTART_SCAN;
+    }
+    eventContext->Operation.Directory.FileInformationClass =
+        FileBothDirectoryInformation;
+    eventContext->Operation.Directory.FileIndex = fileIndex;
+    eventContext->Operation.Directory.BufferLength = TEST_LOOPBACK_MAX_DATA;
+    eventContext->Operation.Directory.DirectoryNameLength =
+        directoryNameLength;
+    RtlCopyMemory(eventContext->Operation.Directory.DirectoryName,
+                  DirectoryName, directoryNameLength);
+    status = SendEvent(Instance, eventContext, reply);
+    if (status != STATUS_SUCCESS) {
+      // The listing ends with STATUS_NO_MORE_FILES, or STATUS_NO_SUCH_FILE
+      // when empty.
+      TEST_CHECK(status == STATUS_NO_MORE_FILES ||
+                 (status == STATUS_NO_SUCH_FILE && !fileIndex));
+      break;
+    }
+    TEST_CHECK(reply->Header.BufferLength &&
+               reply->Header.Operation.Directory.Index > fileIndex);
+    count += ReadDirectoryEntries(&reply->Header, Name, Size);
+    fileIndex = reply->Header.Operation.Directory.Index;
+  }
+  free(reply);
+  return count;
+}
+
+VOID TestLoopback_Close(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                        LPCWSTR FileName, BOOL DeleteOnClose) {
+  ULONG fileNameLength = GetFileNameLength(FileName);
+  PEVENT_CONTEXT eventContext = AllocEvent(
+      IRP_MJ_CLEANUP, Context,
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.Cleanup.FileName) +
+          fileNameLength + sizeof(WCHAR));
+  PTEST_LOOPBACK_REPLY reply = AllocReply();
+  if (DeleteOnClose) {
+    eventContext->FileFlags = DOKAN_DELETE_ON_CLOSE;
+  }
+  eventContext->Operation.Cleanup.FileNameLength = fileNameLength;
+  RtlCopyMemory(eventContext->Operation.Cleanup.FileName, FileName,
+                fileNameLength);
+  TEST_CHECK(SendEvent(Instance, eventContext, reply) == STATUS_SUCCESS);
+
+  eventContext = AllocEvent(
+      IRP_MJ_CLOSE, Context,
+      FIELD_OFFSET(EVENT_CONTEXT, Operation.Close.FileName) + fileNameLength +
+          sizeof(WCHAR));
+  eventContext->Operation.Close.FileNameLength = fileNameLength;
+  RtlCopyMemory(eventContext->Operation.Close.FileName, FileName,
+                fileNameLength);
+  // There is no reply to a close.
+  SendEvent(Instance, eventContext, reply);
+  free(reply);
+}
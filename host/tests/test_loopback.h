@@ -0,0 +1,81 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_HOST_TEST_LOOPBACK_H_
+#define DOKAN_HOST_TEST_LOOPBACK_H_
+
+#include "test_fs.h"
+
+#include "../../dokan/dokan_loopback.h"
+#include "../../dokan/fileinfo.h"
+
+// Events sent one at a time, like the driver would for the operations of an
+// application, to an instance dispatching them through the loopback
+// transport. For the tests of the caches, which need to choose the
+// operations and look at their replies. The file names start with a
+// backslash, the contexts are the ones replied by TestLoopback_Create.
+
+// Starts an instance with the options and callbacks, which must outlive it.
+PDOKAN_INSTANCE TestLoopback_Start(PDOKAN_OPTIONS Options,
+                                   PDOKAN_OPERATIONS Operations);
+
+VOID TestLoopback_Stop(PDOKAN_INSTANCE Instance);
+
+// Opens FileName with a FILE_* CreateDisposition, as a directory when
+// Directory is set. Sets Information to the FILE_* of the reply if not NULL.
+NTSTATUS TestLoopback_Create(PDOKAN_INSTANCE Instance, LPCWSTR FileName,
+                             ULONG CreateDisposition, BOOL Directory,
+                             PULONG64 Context, PULONG Information);
+
+NTSTATUS TestLoopback_Read(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                           LPCWSTR FileName, LONG64 Offset, PVOID Buffer,
+                           ULONG Length, PULONG ReadLength);
+
+NTSTATUS TestLoopback_Write(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                            LPCWSTR FileName, LONG64 Offset, const VOID *Data,
+                            ULONG Length);
+
+// Queries the information of FileInformationClass of the open into Buffer,
+// whose Length must be the one of the fixed size information.
+NTSTATUS TestLoopback_QueryInformation(PDOKAN_INSTANCE Instance,
+                                       ULONG64 Context, LPCWSTR FileName,
+                                       ULONG FileInformationClass,
+                                       PVOID Buffer, ULONG Length);
+
+NTSTATUS TestLoopback_SetEndOfFile(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                                   LPCWSTR FileName, LONG64 EndOfFile);
+
+NTSTATUS TestLoopback_Rename(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                             LPCWSTR FileName, LPCWSTR NewFileName);
+
+// Lists the directory of the open from its start with
+// FileBothDirectoryInformation queries. Returns the number of entries, and
+// sets Size to the one of the entry named Name or to -1 if there is none.
+ULONG TestLoopback_ListDirectory(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                                 LPCWSTR DirectoryName, LPCWSTR Name,
+                                 PLONG64 Size);
+
+// Sends the cleanup of the open, deleting its file when DeleteOnClose is set,
+// then its close.
+VOID TestLoopback_Close(PDOKAN_INSTANCE Instance, ULONG64 Context,
+                        LPCWSTR FileName, BOOL DeleteOnClose);
+
+#endif // DOKAN_HOST_TEST_LOOPBACK_H_
@@ -0,0 +1,207 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Tests the pending IRP timeouts of sys/util/timer_wheel.h, and simulates the
+// timeout checks of a volume with 100k pending IRPs to compare the time the
+// wheel holds the list lock with the scan of every IRP it replaced.
+
+#include "test_fs.h"
+
+#include "../../dokan/list.h"
+#include "../../sys/util/timer_wheel.h"
+
+// Units of the driver: a unit is around 250ms, the timeout is checked every
+// 5s and an IRP times out after 15s.
+#define TEST_CHECK_INTERVAL 20
+#define TEST_IRP_TIMEOUT 60
+#define TEST_IRP_COUNT 100000
+#define TEST_CHECK_COUNT 50
+
+typedef struct _TEST_IRP {
+  DOKAN_TIMER_WHEEL_LINK Link;
+  // Entry in the list scanned by the baseline.
+  LIST_ENTRY ListEntry;
+  BOOL ExpiredByScan;
+} TEST_IRP, *PTEST_IRP;
+
+static DOKAN_TIMER_WHEEL g_Wheel;
+static ULONG g_Random = 1;
+
+static ULONG Random(void) {
+  g_Random = g_Random * 1103515245 + 12345;
+  return g_Random >> 8;
+}
+
+// Moves the wheel to Now and returns the number of expired entries, after
+// checking that they are exactly the ones whose deadline is reached.
+static ULONG Advance(PTEST_IRP Irps, ULONG Count, ULONGLONG Now) {
+  DOKAN_TIMER_WHEEL_LINK expired;
+  ULONG expiredCount = 0;
+  DokanTimerWheelInitializeLink(&expired);
+  DokanTimerWheelAdvance(&g_Wheel, Now, &expired);
+  while (DokanTimerWheelIsLinked(&expired)) {
+    PDOKAN_TIMER_WHEEL_LINK link = expired.Next;
+    TEST_CHECK(link->Deadline <= Now);
+    DokanTimerWheelUnlink(link);
+    ++expiredCount;
+  }
+  for (ULONG i = 0; i < Count; ++i) {
+    if (DokanTimerWheelIsLinked(&Irps[i].Link)) {
+      TEST_CHECK(Irps[i].Link.Deadline > Now);
+    }
+  }
+  return expiredCount;
+}
+
+static VOID TestExpiration(void) {
+  TEST_IRP irps[4 * DOKAN_TIMER_WHEEL_SLOT_COUNT];
+  ULONG count = sizeof(irps) / sizeof(irps[0]);
+  ULONG expired = 0;
+  ZeroMemory(irps, sizeof(irps));
+  DokanTimerWheelInitialize(&g_Wheel, 1000);
+  // Deadlines on every level, one in the past and one farther than the wheel
+  // can hold.
+  for (ULONG i = 0; i < count; ++i) {
+    DokanTimerWheelInitializeLink(&irps[i].Link);
+    DokanTimerWheelInsert(&g_Wheel, &irps[i].Link,
+                          1000 + (ULONGLONG)i * i * i);
+  }
+  DokanTimerWheelRemove(&g_Wheel, &irps[1].Link);
+  DokanTimerWheelRemove(&g_Wheel, &irps[1].Link);
+  DokanTimerWheelRemove(&g_Wheel, &irps[2].Link);
+  DokanTimerWheelInsert(&g_Wheel, &irps[2].Link, 10);
+  DokanTimerWheelRemove(&g_Wheel, &irps[3].Link);
+  DokanTimerWheelInsert(&g_Wheel, &irps[3].Link,
+                        1000 + 2 * DOKAN_TIMER_WHEEL_MAX_DISTANCE);
+  TEST_CHECK(g_Wheel.Count == count - 1);
+
+  // The past deadline and the one at the current time.
+  TEST_CHECK(Advance(irps, count, 1000) == 2);
+  expired = 2;
+  // Steps growing with the time, some processing each unit and some
+  // rebuilding the wheel.
+  for (ULONGLONG now = 1001; g_Wheel.Count > 1;
+       now += 1 + (now - 1000) / 64) {
+    expired += Advance(irps, count, now);
+  }
+  TEST_CHECK(expired == count - 2);
+  TEST_CHECK(DokanTimerWheelIsLinked(&irps[3].Link));
+  // Far deadlines are placed again until reached, here after a long pause
+  // that rebuilds the wheel.
+  TEST_CHECK(Advance(irps, count, 1000 + DOKAN_TIMER_WHEEL_MAX_DISTANCE) == 0);
+  TEST_CHECK(
+      Advance(irps, count, 1000 + 2 * DOKAN_TIMER_WHEEL_MAX_DISTANCE - 1) ==
+      0);
+  TEST_CHECK(
+      Advance(irps, count, 1000 + 2 * DOKAN_TIMER_WHEEL_MAX_DISTANCE) == 1);
+  TEST_CHECK(g_Wheel.Count == 0);
+}
+
+// Between two checks, 3 IRPs out of 4 complete and are replaced by new ones,
+// and the IRPs that reached their deadline time out. The wheel only touches
+// the IRPs that expire or cascade, the scan all of them.
+static VOID SimulateTimeoutChecks(void) {
+  PTEST_IRP irps = calloc(TEST_IRP_COUNT, sizeof(TEST_IRP));
+  LIST_ENTRY list;
+  ULONGLONG now = 0;
+  ULONG64 wheelTime = 0;
+  ULONG64 scanTime = 0;
+  ULONG64 wheelMaxTime = 0;
+  ULONG64 scanMaxTime = 0;
+  ULONG64 timeouts = 0;
+  TEST_CHECK(irps);
+  InitializeListHead(&list);
+  DokanTimerWheelInitialize(&g_Wheel, now);
+  for (ULONG i = 0; i < TEST_IRP_COUNT; ++i) {
+    DokanTimerWheelInitializeLink(&irps[i].Link);
+    DokanTimerWheelInsert(&g_Wheel, &irps[i].Link, now + TEST_IRP_TIMEOUT);
+    InsertTailList(&list, &irps[i].ListEntry);
+  }
+
+  for (ULONG check = 0; check < TEST_CHECK_COUNT; ++check) {
+    DOKAN_TIMER_WHEEL_LINK expired;
+    ULONG scanExpired = 0;
+    ULONG wheelExpired = 0;
+    ULONG64 start;
+    ULONG64 elapsed;
+    for (ULONG i = 0; i < TEST_IRP_COUNT; ++i) {
+      if (Random() % 4) {
+        DokanTimerWheelRemove(&g_Wheel, &irps[i].Link);
+        DokanTimerWheelInsert(&g_Wheel, &irps[i].Link,
+                              now + 1 + Random() % TEST_CHECK_INTERVAL +
+                                  TEST_IRP_TIMEOUT);
+      }
+    }
+    now += TEST_CHECK_INTERVAL;
+
+    start = TestNowMicroseconds();
+    DokanTimerWheelInitializeLink(&expired);
+    DokanTimerWheelAdvance(&g_Wheel, now, &expired);
+    elapsed = TestNowMicroseconds() - start;
+    wheelTime += elapsed;
+    wheelMaxTime = max(wheelMaxTime, elapsed);
+
+    start = TestNowMicroseconds();
+    for (PLIST_ENTRY entry = list.Flink, next; entry != &list; entry = next) {
+      PTEST_IRP irp = CONTAINING_RECORD(entry, TEST_IRP, ListEntry);
+      next = entry->Flink;
+      if (irp->Link.Deadline <= now) {
+        RemoveEntryList(entry);
+        irp->ExpiredByScan = TRUE;
+        ++scanExpired;
+      }
+    }
+    elapsed = TestNowMicroseconds() - start;
+    scanTime += elapsed;
+    scanMaxTime = max(scanMaxTime, elapsed);
+
+    // Both expire the same IRPs, which are then replaced.
+    while (DokanTimerWheelIsLinked(&expired)) {
+      PTEST_IRP irp = CONTAINING_RECORD(expired.Next, TEST_IRP, Link);
+      DokanTimerWheelUnlink(&irp->Link);
+      TEST_CHECK(irp->ExpiredByScan);
+      irp->ExpiredByScan = FALSE;
+      DokanTimerWheelInsert(&g_Wheel, &irp->Link, now + TEST_IRP_TIMEOUT);
+      InsertTailList(&list, &irp->ListEntry);
+      ++wheelExpired;
+    }
+    TEST_CHECK(wheelExpired == scanExpired);
+    TEST_CHECK(g_Wheel.Count == TEST_IRP_COUNT);
+    timeouts += wheelExpired;
+  }
+  printf("%d pending IRPs, %d checks, %llu timeouts: lock held %llu us on "
+         "average and %llu us at most with the wheel, %llu us and %llu us "
+         "with the scan\n",
+         TEST_IRP_COUNT, TEST_CHECK_COUNT, timeouts,
+         wheelTime / TEST_CHECK_COUNT, wheelMaxTime,
+         scanTime / TEST_CHECK_COUNT, scanMaxTime);
+  free(irps);
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  TestExpiration();
+  SimulateTimeoutChecks();
+  printf("timer wheel test passed\n");
+  return 0;
+}
@@ -0,0 +1,235 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Tests the driver trace ring of sys/util/trace_ring.h: per owner cursors,
+// records spanning several slots, overwrites and concurrent writers.
+
+#include "test_fs.h"
+
+#include "../../sys/util/trace_ring.h"
+
+#define TEST_OWNER_A ((PVOID)(ULONG_PTR)0x1000)
+#define TEST_OWNER_B ((PVOID)(ULONG_PTR)0x2000)
+#define TEST_WRITER_COUNT 4
+#define TEST_RECORDS_PER_WRITER 20000
+
+// Starts like a DOKAN_TRACE_RECORD with its size, followed by a pattern
+// derived from the writer and sequence number.
+typedef struct _TEST_RECORD {
+  USHORT Size;
+  USHORT Writer;
+  ULONG Sequence;
+  UCHAR Payload[DOKAN_TRACE_RING_MAX_RECORD_SIZE - 8];
+} TEST_RECORD, *PTEST_RECORD;
+
+static DOKAN_TRACE_RING g_Ring;
+
+static USHORT RecordSize(ULONG Sequence) {
+  // From a single slot up to the largest record.
+  return (USHORT)(8 + (Sequence * 37) % (sizeof(((PTEST_RECORD)0)->Payload)));
+}
+
+static VOID WriteRecord(PVOID Owner, USHORT Writer, ULONG Sequence) {
+  TEST_RECORD record;
+  record.Size = RecordSize(Sequence);
+  record.Writer = Writer;
+  record.Sequence = Sequence;
+  for (ULONG i = 0; i < (ULONG)record.Size - 8; ++i) {
+    record.Payload[i] = (UCHAR)(Writer + Sequence + i);
+  }
+  DokanTraceRingWrite(&g_Ring, Owner, &record, record.Size);
+}
+
+static VOID CheckRecord(PTEST_RECORD Record, ULONG Size) {
+  TEST_CHECK(Size == Record->Size);
+  TEST_CHECK(Size == RecordSize(Record->Sequence));
+  for (ULONG i = 0; i < Size - 8; ++i) {
+    TEST_CHECK(Record->Payload[i] ==
+               (UCHAR)(Record->Writer + Record->Sequence + i));
+  }
+}
+
+static ULONG ReadRecord(PDOKAN_TRACE_RING_CURSOR Cursor, PVOID Owner,
+                        PTEST_RECORD Record) {
+  ULONG size;
+  TEST_CHECK(DokanTraceRingTryBeginRead(Cursor));
+  size = DokanTraceRingRead(&g_Ring, Cursor, Owner, Record,
+                            sizeof(TEST_RECORD));
+  DokanTraceRingEndRead(Cursor);
+  if (size) {
+    CheckRecord(Record, size);
+  }
+  return size;
+}
+
+// The records of another owner do not hold a cursor back, and each global
+// record is read by a single cursor.
+static VOID TestOwners(void) {
+  DOKAN_TRACE_RING_CURSOR cursorA;
+  DOKAN_TRACE_RING_CURSOR cursorB;
+  TEST_RECORD record;
+  ZeroMemory(&g_Ring, sizeof(g_Ring));
+  ZeroMemory(&cursorA, sizeof(cursorA));
+  ZeroMemory(&cursorB, sizeof(cursorB));
+
+  WriteRecord(TEST_OWNER_B, 0, 1);
+  WriteRecord(TEST_OWNER_A, 0, 2);
+  WriteRecord(NULL, 0, 3);
+  WriteRecord(TEST_OWNER_B, 0, 4);
+  WriteRecord(TEST_OWNER_A, 0, 5);
+
+  TEST_CHECK(ReadRecord(&cursorA, TEST_OWNER_A, &record));
+  TEST_CHECK(record.Sequence == 2);
+  TEST_CHECK(ReadRecord(&cursorA, TEST_OWNER_A, &record));
+  TEST_CHECK(record.Sequence == 3);
+  TEST_CHECK(ReadRecord(&cursorA, TEST_OWNER_A, &record));
+  TEST_CHECK(record.Sequence == 5);
+  TEST_CHECK(!ReadRecord(&cursorA, TEST_OWNER_A, &record));
+  TEST_CHECK(DokanTraceRingIsEmpty(&g_Ring, &cursorA));
+
+  // The global record was taken by A.
+  TEST_CHECK(ReadRecord(&cursorB, TEST_OWNER_B, &record));
+  TEST_CHECK(record.Sequence == 1);
+  TEST_CHECK(ReadRecord(&cursorB, TEST_OWNER_B, &record));
+  TEST_CHECK(record.Sequence == 4);
+  TEST_CHECK(!ReadRecord(&cursorB, TEST_OWNER_B, &record));
+  TEST_CHECK(cursorA.Dropped == 0 && cursorB.Dropped == 0);
+
+  // The records of a retired owner are skipped.
+  WriteRecord(TEST_OWNER_B, 0, 6);
+  WriteRecord(TEST_OWNER_A, 0, 7);
+  DokanTraceRingRetireOwner(&g_Ring, TEST_OWNER_B);
+  TEST_CHECK(!ReadRecord(&cursorB, TEST_OWNER_B, &record));
+  TEST_CHECK(ReadRecord(&cursorA, TEST_OWNER_A, &record));
+  TEST_CHECK(record.Sequence == 7);
+}
+
+// A ring holds 1024 header-only records, like the global log list it
+// replaced, and a reader that falls behind gets the newest records.
+static VOID TestCapacity(void) {
+  DOKAN_TRACE_RING_CURSOR cursor;
+  TEST_RECORD record;
+  ULONG count = 0;
+  ZeroMemory(&g_Ring, sizeof(g_Ring));
+  ZeroMemory(&cursor, sizeof(cursor));
+  TEST_CHECK(DOKAN_TRACE_RECORD_HEADER_SIZE <=
+             DOKAN_TRACE_RING_SLOT_DATA_SIZE);
+  for (ULONG i = 0; i < 1024; ++i) {
+    record.Size = DOKAN_TRACE_RECORD_HEADER_SIZE;
+    record.Writer = 0;
+    record.Sequence = i;
+    DokanTraceRingWrite(&g_Ring, TEST_OWNER_A, &record, record.Size);
+  }
+  TEST_CHECK(DokanTraceRingTryBeginRead(&cursor));
+  while (DokanTraceRingRead(&g_Ring, &cursor, TEST_OWNER_A, &record,
+                            sizeof(record))) {
+    TEST_CHECK(record.Sequence == count);
+    ++count;
+  }
+  DokanTraceRingEndRead(&cursor);
+  TEST_CHECK(count == 1024);
+  TEST_CHECK(cursor.Dropped == 0);
+
+  // Overwrite the ring several times with records of every size.
+  for (ULONG i = 0; i < 4 * DOKAN_TRACE_RING_SLOT_COUNT; ++i) {
+    WriteRecord(TEST_OWNER_A, 0, i);
+  }
+  count = 0;
+  while (ReadRecord(&cursor, TEST_OWNER_A, &record)) {
+    ++count;
+  }
+  TEST_CHECK(cursor.Dropped > 0);
+  TEST_CHECK(count > 0);
+  TEST_CHECK(record.Sequence == 4 * DOKAN_TRACE_RING_SLOT_COUNT - 1);
+}
+
+typedef struct _TEST_CONCURRENT {
+  volatile LONG WritersDone;
+  DOKAN_TRACE_RING_CURSOR Cursors[2];
+  LONG64 Read[2];
+} TEST_CONCURRENT, *PTEST_CONCURRENT;
+
+// Writers 0 and 1 write records of owner A and B, the others global ones.
+// Readers 0 and 1 read with the cursor of owner A and B.
+static VOID ConcurrentRoutine(PVOID Context, ULONG Index) {
+  PTEST_CONCURRENT test = Context;
+  if (Index < TEST_WRITER_COUNT) {
+    PVOID owner = Index == 0 ? TEST_OWNER_A : Index == 1 ? TEST_OWNER_B : NULL;
+    for (ULONG i = 0; i < TEST_RECORDS_PER_WRITER; ++i) {
+      WriteRecord(owner, (USHORT)Index, i);
+    }
+    InterlockedIncrement(&test->WritersDone);
+  } else {
+    ULONG reader = Index - TEST_WRITER_COUNT;
+    PVOID owner = reader == 0 ? TEST_OWNER_A : TEST_OWNER_B;
+    PDOKAN_TRACE_RING_CURSOR cursor = &test->Cursors[reader];
+    TEST_RECORD record;
+    ULONG lastSequence[TEST_WRITER_COUNT];
+    BOOL done = FALSE;
+    FillMemory(lastSequence, sizeof(lastSequence), 0xff);
+    while (!done) {
+      ULONG size;
+      done = InterlockedCompareExchange(&test->WritersDone, 0, 0) ==
+             TEST_WRITER_COUNT;
+      while ((size = ReadRecord(cursor, owner, &record)) != 0) {
+        TEST_CHECK(record.Writer < TEST_WRITER_COUNT);
+        // Own and global records only, in the order of each writer.
+        TEST_CHECK(record.Writer == reader || record.Writer >= 2);
+        TEST_CHECK(lastSequence[record.Writer] == MAXULONG ||
+                   record.Sequence > lastSequence[record.Writer]);
+        lastSequence[record.Writer] = record.Sequence;
+        ++test->Read[reader];
+      }
+    }
+  }
+}
+
+static VOID TestConcurrent(void) {
+  TEST_CONCURRENT test;
+  TEST_RECORD record;
+  ZeroMemory(&g_Ring, sizeof(g_Ring));
+  ZeroMemory(&test, sizeof(test));
+  TestRunThreads(TEST_WRITER_COUNT + 2, ConcurrentRoutine, &test);
+  printf("concurrent: read %lld and %lld records, dropped %lu and %lu "
+         "slots\n",
+         test.Read[0], test.Read[1], test.Cursors[0].Dropped,
+         test.Cursors[1].Dropped);
+
+  // The cursors are caught up with the ring.
+  WriteRecord(TEST_OWNER_B, 1, 1);
+  WriteRecord(TEST_OWNER_A, 0, 2);
+  TEST_CHECK(ReadRecord(&test.Cursors[0], TEST_OWNER_A, &record));
+  TEST_CHECK(record.Sequence == 2);
+  TEST_CHECK(ReadRecord(&test.Cursors[1], TEST_OWNER_B, &record));
+  TEST_CHECK(record.Sequence == 1);
+  TEST_CHECK(!ReadRecord(&test.Cursors[1], TEST_OWNER_B, &record));
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  UNREFERENCED_PARAMETER(argc);
+  UNREFERENCED_PARAMETER(argv);
+
+  TestOwners();
+  TestCapacity();
+  TestConcurrent();
+  printf("trace ring test passed\n");
+  return 0;
+}
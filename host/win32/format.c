@@ -0,0 +1,601 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// printf family of the host shim, following the Microsoft conventions the
+// library is written for: l is 32-bit, ll and I64 are 64-bit, I is the size
+// of a pointer, and in the wide functions %s and %c take wide characters
+// while %S and %C take narrow ones. The numbers are formatted by the C
+// library, one conversion at a time.
+
+#include <windows.h>
+#include <strsafe.h>
+
+#include <stdio.h>
+
+// The C library snprintf, hidden by the macro of windows.h.
+#undef snprintf
+
+typedef struct _DOKAN_HOST_OUTPUT {
+  char *Narrow;
+  WCHAR *Wide;
+  size_t Capacity;
+  size_t Length;
+} DOKAN_HOST_OUTPUT, *PDOKAN_HOST_OUTPUT;
+
+// Counts every unit and stores the ones that fit, leaving room for the
+// terminator.
+static void PutUnit(PDOKAN_HOST_OUTPUT Output, unsigned Unit) {
+  if (Output->Length + 1 < Output->Capacity) {
+    if (Output->Narrow) {
+      Output->Narrow[Output->Length] = (char)Unit;
+    } else if (Output->Wide) {
+      Output->Wide[Output->Length] = (WCHAR)Unit;
+    }
+  }
+  ++Output->Length;
+}
+
+// Puts a code point as UTF-8 or UTF-16 depending on the output.
+static void PutCodePoint(PDOKAN_HOST_OUTPUT Output, unsigned CodePoint) {
+  if (Output->Wide) {
+    if (CodePoint >= 0x10000) {
+      CodePoint -= 0x10000;
+      PutUnit(Output, 0xD800 + (CodePoint >> 10));
+      PutUnit(Output, 0xDC00 + (CodePoint & 0x3FF));
+    } else {
+      PutUnit(Output, CodePoint);
+    }
+    return;
+  }
+  if (CodePoint < 0x80) {
+    PutUnit(Output, CodePoint);
+  } else if (CodePoint < 0x800) {
+    PutUnit(Output, 0xC0 | (CodePoint >> 6));
+    PutUnit(Output, 0x80 | (CodePoint & 0x3F));
+  } else if (CodePoint < 0x10000) {
+    PutUnit(Output, 0xE0 | (CodePoint >> 12));
+    PutUnit(Output, 0x80 | ((CodePoint >> 6) & 0x3F));
+    PutUnit(Output, 0x80 | (CodePoint & 0x3F));
+  } else {
+    PutUnit(Output, 0xF0 | (CodePoint >> 18));
+    PutUnit(Output, 0x80 | ((CodePoint >> 12) & 0x3F));
+    PutUnit(Output, 0x80 | ((CodePoint >> 6) & 0x3F));
+    PutUnit(Output, 0x80 | (CodePoint & 0x3F));
+  }
+}
+
+// Decodes the next code point of a UTF-16 string and returns the number of
+// units it used.
+static size_t NextUtf16(const WCHAR *String, size_t Available,
+                        unsigned *CodePoint) {
+  unsigned unit = String[0];
+  if (unit >= 0xD800 && unit < 0xDC00 && Available > 1 &&
+      String[1] >= 0xDC00 && String[1] < 0xE000) {
+    *CodePoint = 0x10000 + ((unit - 0xD800) << 10) + (String[1] - 0xDC00);
+    return 2;
+  }
+  *CodePoint = unit;
+  return 1;
+}
+
+// Decodes the next code point of a UTF-8 string and returns the number of
+// bytes it used. Invalid sequences are taken byte by byte.
+static size_t NextUtf8(const char *String, size_t Available,
+                       unsigned *CodePoint) {
+  const unsigned char *s = (const unsigned char *)String;
+  size_t length = 1;
+  unsigned value = s[0];
+  if (value >= 0xF0 && value < 0xF8) {
+    length = 4;
+    value &= 0x07;
+  } else if (value >= 0xE0) {
+    length = 3;
+    value &= 0x0F;
+  } else if (value >= 0xC0) {
+    length = 2;
+    value &= 0x1F;
+  }
+  if (length > Available || length == 1 || s[0] >= 0xF8) {
+    *CodePoint = s[0];
+    return 1;
+  }
+  for (size_t i = 1; i < length; ++i) {
+    if ((s[i] & 0xC0) != 0x80) {
+      *CodePoint = s[0];
+      return 1;
+    }
+    value = (value << 6) | (s[i] & 0x3F);
+  }
+  *CodePoint = value;
+  return length;
+}
+
+static size_t WideLength(const WCHAR *String, int Precision) {
+  size_t length = 0;
+  while ((Precision < 0 || length < (size_t)Precision) && String[length]) {
+    ++length;
+  }
+  return length;
+}
+
+static size_t NarrowLength(const char *String, int Precision) {
+  size_t length = 0;
+  while ((Precision < 0 || length < (size_t)Precision) && String[length]) {
+    ++length;
+  }
+  return length;
+}
+
+static void PutPadding(PDOKAN_HOST_OUTPUT Output, int Count) {
+  while (Count-- > 0) {
+    PutUnit(Output, ' ');
+  }
+}
+
+// Puts a string, wide or narrow, with the width and precision of its
+// conversion. The precision and the width count the units of the argument.
+static void PutString(PDOKAN_HOST_OUTPUT Output, const void *String, BOOL Wide,
+                      int Width, int Precision, BOOL LeftAlign) {
+  size_t length;
+  size_t i = 0;
+  if (!String) {
+    String = Wide ? (const void *)L"(null)" : (const void *)"(null)";
+  }
+  length = Wide ? WideLength(String, Precision)
+                : NarrowLength(String, Precision);
+  if (!LeftAlign && Width > (int)length) {
+    PutPadding(Output, Width - (int)length);
+  }
+  while (i < length) {
+    unsigned codePoint;
+    if (Wide) {
+      i += NextUtf16((const WCHAR *)String + i, length - i, &codePoint);
+    } else {
+      i += NextUtf8((const char *)String + i, length - i, &codePoint);
+    }
+    PutCodePoint(Output, codePoint);
+  }
+  if (LeftAlign && Width > (int)length) {
+    PutPadding(Output, Width - (int)length);
+  }
+}
+
+typedef enum _DOKAN_HOST_ARG_SIZE {
+  ArgSizeDefault,
+  ArgSizeChar,
+  ArgSizeShort,
+  ArgSize64,
+  ArgSizePointer,
+  ArgSizeLongDouble,
+} DOKAN_HOST_ARG_SIZE;
+
+// Formats Format, whose units are narrow or wide, to Output. Consumes
+// ArgList.
+static void FormatList(PDOKAN_HOST_OUTPUT Output, const void *Format,
+                       BOOL WideFormat, va_list ArgList) {
+  size_t i = 0;
+#define FORMAT_AT(index)                                                       \
+  (WideFormat ? (unsigned)((const WCHAR *)Format)[index]                       \
+              : (unsigned)((const unsigned char *)Format)[index])
+  for (;;) {
+    unsigned c = FORMAT_AT(i);
+    char spec[32];
+    size_t specLength = 0;
+    int width = -1;
+    int precision = -1;
+    BOOL leftAlign = FALSE;
+    DOKAN_HOST_ARG_SIZE size = ArgSizeDefault;
+    BOOL wideArg = WideFormat;
+    BOOL wideArgGiven = FALSE;
+    char number[128];
+    int numberLength = 0;
+
+    if (!c) {
+      break;
+    }
+    if (c != '%') {
+      if (WideFormat) {
+        unsigned codePoint;
+        i += NextUtf16((const WCHAR *)Format + i, 2, &codePoint);
+        PutCodePoint(Output, codePoint);
+      } else {
+        PutUnit(Output, c);
+        ++i;
+      }
+      continue;
+    }
+    ++i;
+    spec[specLength++] = '%';
+    // Flags
+    while ((c = FORMAT_AT(i)) == '-' || c == '+' || c == ' ' || c == '#' ||
+           c == '0') {
+      if (c == '-') {
+        leftAlign = TRUE;
+      }
+      spec[specLength++] = (char)c;
+      ++i;
+    }
+    // Width
+    if (FORMAT_AT(i) == '*') {
+      width = va_arg(ArgList, int);
+      if (width < 0) {
+        leftAlign = TRUE;
+        spec[specLength++] = '-';
+        width = -width;
+      }
+      specLength += snprintf(spec + specLength, sizeof(spec) - specLength,
+                             "%d", width);
+      ++i;
+    } else {
+      while ((c = FORMAT_AT(i)) >= '0' && c <= '9') {
+        width = (width < 0 ? 0 : width * 10) + (int)(c - '0');
+        spec[specLength++] = (char)c;
+        ++i;
+      }
+    }
+    // Precision
+    if (FORMAT_AT(i) == '.') {
+      ++i;
+      precision = 0;
+      if (FORMAT_AT(i) == '*') {
+        precision = va_arg(ArgList, int);
+        ++i;
+      } else {
+        while ((c = FORMAT_AT(i)) >= '0' && c <= '9') {
+          precision = precision * 10 + (int)(c - '0');
+          ++i;
+        }
+      }
+      if (precision >= 0) {
+        specLength += snprintf(spec + specLength, sizeof(spec) - specLength,
+                               ".%d", precision);
+      }
+    }
+    // Size
+    c = FORMAT_AT(i);
+    if (c == 'h') {
+      ++i;
+      size = ArgSizeShort;
+      if (FORMAT_AT(i) == 'h') {
+        ++i;
+        size = ArgSizeChar;
+      }
+      wideArg = FALSE;
+      wideArgGiven = TRUE;
+    } else if (c == 'l') {
+      ++i;
+      if (FORMAT_AT(i) == 'l') {
+        ++i;
+        size = ArgSize64;
+      }
+      wideArg = TRUE;
+      wideArgGiven = TRUE;
+    } else if (c == 'w') {
+      ++i;
+      wideArg = TRUE;
+      wideArgGiven = TRUE;
+    } else if (c == 'L') {
+      ++i;
+      size = ArgSizeLongDouble;
+    } else if (c == 'z' || c == 't' || c == 'j') {
+      ++i;
+      size = c == 'j' ? ArgSize64 : ArgSizePointer;
+    } else if (c == 'I') {
+      ++i;
+      if (FORMAT_AT(i) == '6' && FORMAT_AT(i + 1) == '4') {
+        i += 2;
+        size = ArgSize64;
+      } else if (FORMAT_AT(i) == '3' && FORMAT_AT(i + 1) == '2') {
+        i += 2;
+      } else {
+        size = ArgSizePointer;
+      }
+    }
+    c = FORMAT_AT(i);
+    if (!c) {
+      break;
+    }
+    ++i;
+    switch (c) {
+    case '%':
+      PutUnit(Output, '%');
+      continue;
+    case 'S':
+    case 'C':
+      // The other width than the one of the format, unless a size is given.
+      if (!wideArgGiven) {
+        wideArg = !WideFormat;
+      }
+      c = c == 'S' ? 's' : 'c';
+      break;
+    default:
+      break;
+    }
+    switch (c) {
+    case 's':
+      PutString(Output, va_arg(ArgList, const void *), wideArg, width,
+                precision, leftAlign);
+      continue;
+    case 'c': {
+      WCHAR wide[2] = {(WCHAR)va_arg(ArgList, int), 0};
+      char narrow[2] = {(char)wide[0], 0};
+      PutString(Output, wideArg ? (const void *)wide : (const void *)narrow,
+                wideArg, width, -1, leftAlign);
+      continue;
+    }
+    case 'd':
+    case 'i':
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X': {
+      BOOL isSigned = c == 'd' || c == 'i';
+      spec[specLength++] = 'l';
+      spec[specLength++] = 'l';
+      spec[specLength++] = (char)c;
+      spec[specLength] = '\0';
+      if (isSigned) {
+        long long value;
+        switch (size) {
+        case ArgSize64:
+          value = va_arg(ArgList, long long);
+          break;
+        case ArgSizePointer:
+          value = va_arg(ArgList, intptr_t);
+          break;
+        case ArgSizeShort:
+          value = (short)va_arg(ArgList, int);
+          break;
+        case ArgSizeChar:
+          value = (signed char)va_arg(ArgList, int);
+          break;
+        default:
+          value = va_arg(ArgList, int);
+          break;
+        }
+        numberLength = snprintf(number, sizeof(number), spec, value);
+      } else {
+        unsigned long long value;
+        switch (size) {
+        case ArgSize64:
+          value = va_arg(ArgList, unsigned long long);
+          break;
+        case ArgSizePointer:
+          value = va_arg(ArgList, uintptr_t);
+          break;
+        case ArgSizeShort:
+          value = (unsigned short)va_arg(ArgList, unsigned int);
+          break;
+        case ArgSizeChar:
+          value = (unsigned char)va_arg(ArgList, unsigned int);
+          break;
+        default:
+          value = va_arg(ArgList, unsigned int);
+          break;
+        }
+        numberLength = snprintf(number, sizeof(number), spec, value);
+      }
+      break;
+    }
+    case 'p':
+      spec[specLength++] = 'p';
+      spec[specLength] = '\0';
+      numberLength =
+          snprintf(number, sizeof(number), spec, va_arg(ArgList, void *));
+      break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      if (size == ArgSizeLongDouble) {
+        spec[specLength++] = 'L';
+        spec[specLength++] = (char)c;
+        spec[specLength] = '\0';
+        numberLength = snprintf(number, sizeof(number), spec,
+                                va_arg(ArgList, long double));
+      } else {
+        spec[specLength++] = (char)c;
+        spec[specLength] = '\0';
+        numberLength =
+            snprintf(number, sizeof(number), spec, va_arg(ArgList, double));
+      }
+      break;
+    case 'n':
+      (void)va_arg(ArgList, void *);
+      continue;
+    default:
+      // Unknown conversion, output it as is.
+      PutUnit(Output, '%');
+      PutUnit(Output, c);
+      continue;
+    }
+    if (numberLength > (int)sizeof(number) - 1) {
+      numberLength = (int)sizeof(number) - 1;
+    }
+    for (int n = 0; n < numberLength; ++n) {
+      PutUnit(Output, (unsigned char)number[n]);
+    }
+  }
+#undef FORMAT_AT
+}
+
+// Same as FormatList, leaving ArgList untouched. On Windows va_list is a
+// pointer passed by value, so the callers of the vprintf functions can reuse
+// it: DokanDbgPrint counts then formats with the same list.
+static void Format(PDOKAN_HOST_OUTPUT Output, const void *Format_,
+                   BOOL WideFormat, va_list ArgList) {
+  va_list copy;
+  va_copy(copy, ArgList);
+  FormatList(Output, Format_, WideFormat, copy);
+  va_end(copy);
+}
+
+static void Terminate(PDOKAN_HOST_OUTPUT Output) {
+  if (!Output->Capacity) {
+    return;
+  }
+  size_t end = min(Output->Length, Output->Capacity - 1);
+  if (Output->Narrow) {
+    Output->Narrow[end] = '\0';
+  } else if (Output->Wide) {
+    Output->Wide[end] = L'\0';
+  }
+}
+
+int _vscwprintf(const WCHAR *Format_, va_list ArgList) {
+  DOKAN_HOST_OUTPUT output = {NULL, NULL, 0, 0};
+  // Counts in UTF-16 units.
+  WCHAR unit;
+  output.Wide = &unit;
+  Format(&output, Format_, TRUE, ArgList);
+  return (int)output.Length;
+}
+
+int vswprintf_s(WCHAR *Buffer, size_t BufferCount, const WCHAR *Format_,
+                va_list ArgList) {
+  DOKAN_HOST_OUTPUT output = {NULL, Buffer, BufferCount, 0};
+  if (!Buffer || !BufferCount) {
+    return -1;
+  }
+  Format(&output, Format_, TRUE, ArgList);
+  if (output.Length >= BufferCount) {
+    Buffer[0] = L'\0';
+    return -1;
+  }
+  Terminate(&output);
+  return (int)output.Length;
+}
+
+int swprintf_s(WCHAR *Buffer, size_t BufferCount, const WCHAR *Format_, ...) {
+  va_list argList;
+  int result;
+  va_start(argList, Format_);
+  result = vswprintf_s(Buffer, BufferCount, Format_, argList);
+  va_end(argList);
+  return result;
+}
+
+int _vscprintf(const char *Format_, va_list ArgList) {
+  DOKAN_HOST_OUTPUT output = {NULL, NULL, 0, 0};
+  Format(&output, Format_, FALSE, ArgList);
+  return (int)output.Length;
+}
+
+int vsprintf_s(char *Buffer, size_t BufferCount, const char *Format_,
+               va_list ArgList) {
+  DOKAN_HOST_OUTPUT output = {Buffer, NULL, BufferCount, 0};
+  if (!Buffer || !BufferCount) {
+    return -1;
+  }
+  Format(&output, Format_, FALSE, ArgList);
+  if (output.Length >= BufferCount) {
+    Buffer[0] = '\0';
+    return -1;
+  }
+  Terminate(&output);
+  return (int)output.Length;
+}
+
+int sprintf_s(char *Buffer, size_t BufferCount, const char *Format_, ...) {
+  va_list argList;
+  int result;
+  va_start(argList, Format_);
+  result = vsprintf_s(Buffer, BufferCount, Format_, argList);
+  va_end(argList);
+  return result;
+}
+
+int DokanHostSnprintf(char *Buffer, size_t BufferCount, const char *Format_,
+                      ...) {
+  DOKAN_HOST_OUTPUT output = {Buffer, NULL, BufferCount, 0};
+  va_list argList;
+  va_start(argList, Format_);
+  Format(&output, Format_, FALSE, argList);
+  va_end(argList);
+  Terminate(&output);
+  return (int)output.Length;
+}
+
+static int PrintTo(FILE *Stream, const char *Format_, va_list ArgList) {
+  char *buffer;
+  int length = _vscprintf(Format_, ArgList);
+  buffer = malloc((size_t)length + 1);
+  if (!buffer) {
+    return -1;
+  }
+  vsprintf_s(buffer, (size_t)length + 1, Format_, ArgList);
+  length = fputs(buffer, Stream) < 0 ? -1 : length;
+  free(buffer);
+  return length;
+}
+
+int DokanHostPrintf(const char *Format_, ...) {
+  va_list argList;
+  int result;
+  va_start(argList, Format_);
+  result = PrintTo(stdout, Format_, argList);
+  va_end(argList);
+  return result;
+}
+
+int DokanHostFprintf(FILE *Stream, const char *Format_, ...) {
+  va_list argList;
+  int result;
+  va_start(argList, Format_);
+  result = PrintTo(Stream, Format_, argList);
+  va_end(argList);
+  return result;
+}
+
+HRESULT StringCbPrintfW(LPWSTR Destination, size_t DestinationSize,
+                        LPCWSTR Format_, ...) {
+  size_t count = DestinationSize / sizeof(WCHAR);
+  DOKAN_HOST_OUTPUT output = {NULL, Destination, count, 0};
+  va_list argList;
+  if (!count) {
+    return STRSAFE_E_INSUFFICIENT_BUFFER;
+  }
+  va_start(argList, Format_);
+  Format(&output, Format_, TRUE, argList);
+  va_end(argList);
+  Terminate(&output);
+  return output.Length < count ? S_OK : STRSAFE_E_INSUFFICIENT_BUFFER;
+}
+
+int DokanHostUtf16ToUtf8(const WCHAR *Source, char *Destination,
+                         size_t DestinationSize) {
+  DOKAN_HOST_OUTPUT output = {Destination, NULL, DestinationSize, 0};
+  PutString(&output, Source, /*Wide=*/TRUE, -1, -1, FALSE);
+  Terminate(&output);
+  return output.Length < DestinationSize ? (int)output.Length : -1;
+}
+
+int DokanHostUtf8ToUtf16(const char *Source, WCHAR *Destination,
+                         size_t DestinationCount) {
+  DOKAN_HOST_OUTPUT output = {NULL, Destination, DestinationCount, 0};
+  PutString(&output, Source, /*Wide=*/FALSE, -1, -1, FALSE);
+  Terminate(&output);
+  return output.Length < DestinationCount ? (int)output.Length : -1;
+}
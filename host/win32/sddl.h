@@ -0,0 +1,45 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_HOST_SDDL_H_
+#define DOKAN_HOST_SDDL_H_
+
+#include <windows.h>
+
+// There are no security identifiers on the host, these always fail with
+// ERROR_NOT_SUPPORTED.
+#define SDDL_REVISION_1 1
+
+BOOL ConvertSidToStringSidW(PSID Sid, LPWSTR *StringSid);
+#define ConvertSidToStringSid ConvertSidToStringSidW
+BOOL ConvertStringSecurityDescriptorToSecurityDescriptorW(
+    LPCWSTR StringSecurityDescriptor, DWORD StringSDRevision,
+    PSECURITY_DESCRIPTOR *SecurityDescriptor, PULONG SecurityDescriptorSize);
+#define ConvertStringSecurityDescriptorToSecurityDescriptor                    \
+  ConvertStringSecurityDescriptorToSecurityDescriptorW
+BOOL ConvertSecurityDescriptorToStringSecurityDescriptorW(
+    PSECURITY_DESCRIPTOR SecurityDescriptor, DWORD RequestedStringSDRevision,
+    SECURITY_INFORMATION SecurityInformation, LPWSTR *StringSecurityDescriptor,
+    PULONG StringSecurityDescriptorLen);
+#define ConvertSecurityDescriptorToStringSecurityDescriptor                    \
+  ConvertSecurityDescriptorToStringSecurityDescriptorW
+
+#endif // DOKAN_HOST_SDDL_H_
@@ -0,0 +1,38 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_HOST_STRSAFE_H_
+#define DOKAN_HOST_STRSAFE_H_
+
+#include <windows.h>
+
+typedef LONG HRESULT;
+#define S_OK ((HRESULT)0L)
+#define STRSAFE_E_INSUFFICIENT_BUFFER ((HRESULT)0x8007007AL)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+HRESULT StringCbPrintfW(LPWSTR Destination, size_t DestinationSize,
+                        LPCWSTR Format, ...);
+HRESULT StringCchCopyW(LPWSTR Destination, size_t DestinationCount,
+                       LPCWSTR Source);
+
+#endif // DOKAN_HOST_STRSAFE_H_
@@ -0,0 +1,566 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Thread pool of the host shim, see threadpoolapiset.h.
+//
+// A single lock protects every pool, callback object and cleanup group: the
+// shim is built for tests and benchmarks of the library, where the pool is
+// never the bottleneck being measured.
+
+#include <windows.h>
+
+#include <errno.h>
+#include <time.h>
+
+#include "list.h"
+#include "win32_internal.h"
+
+#define DOKAN_HOST_POOL_DEFAULT_MAXIMUM 512
+// Idle threads above the minimum exit after this delay.
+#define DOKAN_HOST_POOL_IDLE_TIMEOUT_MS 10000
+
+typedef enum _DOKAN_HOST_CALLBACK_TYPE {
+  DokanHostCallbackWork,
+  DokanHostCallbackSimple,
+  DokanHostCallbackTimer,
+} DOKAN_HOST_CALLBACK_TYPE;
+
+struct _TP_POOL {
+  pthread_cond_t WorkAvailable;
+  // Callback objects with pending submissions, in submission order.
+  LIST_ENTRY Queue;
+  // Pending submissions of the objects in Queue.
+  ULONG QueuedCount;
+  ULONG Threads;
+  ULONG IdleThreads;
+  ULONG Minimum;
+  ULONG Maximum;
+  BOOL Closed;
+};
+
+struct _TP_CLEANUP_GROUP {
+  // Works and timers of the group.
+  LIST_ENTRY Members;
+  // Simple callbacks of the group not run yet.
+  ULONG Callbacks;
+};
+
+struct _TP_WORK {
+  DOKAN_HOST_CALLBACK_TYPE Type;
+  PTP_POOL Pool;
+  PTP_CLEANUP_GROUP CleanupGroup;
+  LIST_ENTRY GroupEntry;
+  LIST_ENTRY QueueEntry;
+  union {
+    PTP_WORK_CALLBACK Work;
+    PTP_SIMPLE_CALLBACK Simple;
+    PTP_TIMER_CALLBACK Timer;
+  } Callback;
+  PVOID Context;
+  ULONG Pending;
+  ULONG Running;
+  // Freed once its callbacks are done.
+  BOOL Closed;
+};
+
+struct _TP_TIMER {
+  struct _TP_WORK Work;
+  LIST_ENTRY TimerEntry;
+  BOOL Armed;
+  // Monotonic due time in milliseconds.
+  ULONGLONG DueTime;
+  DWORD Period;
+};
+
+static pthread_mutex_t g_TpLock = PTHREAD_MUTEX_INITIALIZER;
+// Signaled when a callback completes.
+static pthread_cond_t g_TpCallbackDone = PTHREAD_COND_INITIALIZER;
+static PTP_POOL g_DefaultPool;
+
+static pthread_cond_t g_TimerChanged;
+static LIST_ENTRY g_Timers;
+static BOOL g_TimerThreadStarted;
+
+static void InitializeCondition(pthread_cond_t *Condition) {
+  pthread_condattr_t attributes;
+  pthread_condattr_init(&attributes);
+  pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+  pthread_cond_init(Condition, &attributes);
+  pthread_condattr_destroy(&attributes);
+}
+
+static void WaitCondition(pthread_cond_t *Condition, DWORD Milliseconds) {
+  struct timespec deadline;
+  if (Milliseconds == INFINITE) {
+    pthread_cond_wait(Condition, &g_TpLock);
+    return;
+  }
+  DokanHostDeadline(Milliseconds, &deadline);
+  pthread_cond_timedwait(Condition, &g_TpLock, &deadline);
+}
+
+static PTP_POOL AllocPool(void) {
+  PTP_POOL pool = calloc(1, sizeof(TP_POOL));
+  if (!pool) {
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return NULL;
+  }
+  InitializeCondition(&pool->WorkAvailable);
+  InitializeListHead(&pool->Queue);
+  pool->Maximum = DOKAN_HOST_POOL_DEFAULT_MAXIMUM;
+  return pool;
+}
+
+static void FreePool(PTP_POOL Pool) {
+  pthread_cond_destroy(&Pool->WorkAvailable);
+  free(Pool);
+}
+
+// Called with the lock held.
+static PTP_POOL GetEnvironmentPool(PTP_CALLBACK_ENVIRON CallbackEnviron) {
+  if (CallbackEnviron && CallbackEnviron->Pool) {
+    return CallbackEnviron->Pool;
+  }
+  if (!g_DefaultPool) {
+    g_DefaultPool = AllocPool();
+  }
+  return g_DefaultPool;
+}
+
+static void FreeCallbackObject(PTP_WORK Work) {
+  if (Work->Type == DokanHostCallbackTimer) {
+    free(CONTAINING_RECORD(Work, TP_TIMER, Work));
+  } else {
+    free(Work);
+  }
+}
+
+//////////////////////////////// Workers ////////////////////////////////
+
+static void *WorkerThread(void *Parameter) {
+  PTP_POOL pool = Parameter;
+  pthread_mutex_lock(&g_TpLock);
+  for (;;) {
+    PTP_WORK work;
+    BOOL timedOut = FALSE;
+    while (IsListEmpty(&pool->Queue) && !pool->Closed && !timedOut) {
+      struct timespec deadline;
+      DokanHostDeadline(DOKAN_HOST_POOL_IDLE_TIMEOUT_MS, &deadline);
+      ++pool->IdleThreads;
+      timedOut = pthread_cond_timedwait(&pool->WorkAvailable, &g_TpLock,
+                                        &deadline) == ETIMEDOUT &&
+                 pool->Threads > pool->Minimum;
+      --pool->IdleThreads;
+    }
+    if (IsListEmpty(&pool->Queue)) {
+      break;
+    }
+    work = CONTAINING_RECORD(pool->Queue.Flink, TP_WORK, QueueEntry);
+    RemoveEntryList(&work->QueueEntry);
+    --pool->QueuedCount;
+    --work->Pending;
+    ++work->Running;
+    if (work->Pending) {
+      // Keeps the order with the submissions of the other objects.
+      InsertTailList(&pool->Queue, &work->QueueEntry);
+    }
+    pthread_mutex_unlock(&g_TpLock);
+
+    switch (work->Type) {
+    case DokanHostCallbackWork:
+      work->Callback.Work(NULL, work->Context, work);
+      break;
+    case DokanHostCallbackSimple:
+      work->Callback.Simple(NULL, work->Context);
+      break;
+    case DokanHostCallbackTimer:
+      work->Callback.Timer(NULL, work->Context,
+                           CONTAINING_RECORD(work, TP_TIMER, Work));
+      break;
+    }
+
+    pthread_mutex_lock(&g_TpLock);
+    --work->Running;
+    if (work->Type == DokanHostCallbackSimple && work->CleanupGroup) {
+      --work->CleanupGroup->Callbacks;
+    }
+    if (work->Closed && !work->Pending && !work->Running) {
+      FreeCallbackObject(work);
+    }
+    pthread_cond_broadcast(&g_TpCallbackDone);
+  }
+  --pool->Threads;
+  if (pool->Closed && !pool->Threads) {
+    FreePool(pool);
+  }
+  pthread_mutex_unlock(&g_TpLock);
+  return NULL;
+}
+
+// Queues one submission of Work. Called with the lock held.
+static BOOL QueueCallback(PTP_WORK Work) {
+  PTP_POOL pool = Work->Pool;
+  if (!Work->Pending) {
+    InsertTailList(&pool->Queue, &Work->QueueEntry);
+  }
+  ++Work->Pending;
+  ++pool->QueuedCount;
+  if (pool->QueuedCount > pool->IdleThreads &&
+      pool->Threads < pool->Maximum) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, WorkerThread, pool) == 0) {
+      pthread_detach(thread);
+      ++pool->Threads;
+    } else if (!pool->Threads) {
+      if (!--Work->Pending) {
+        RemoveEntryList(&Work->QueueEntry);
+      }
+      --pool->QueuedCount;
+      return FALSE;
+    }
+  }
+  pthread_cond_signal(&pool->WorkAvailable);
+  return TRUE;
+}
+
+// Drops the submissions of Work not started yet. Called with the lock held.
+static void CancelCallbacks(PTP_WORK Work) {
+  if (Work->Pending) {
+    RemoveEntryList(&Work->QueueEntry);
+    Work->Pool->QueuedCount -= Work->Pending;
+    Work->Pending = 0;
+  }
+}
+
+// Called with the lock held.
+static void WaitForCallbacks(PTP_WORK Work, BOOL CancelPendingCallbacks) {
+  if (CancelPendingCallbacks) {
+    CancelCallbacks(Work);
+  }
+  while (Work->Pending || Work->Running) {
+    pthread_cond_wait(&g_TpCallbackDone, &g_TpLock);
+  }
+}
+
+// Frees Work now or after its callbacks. Called with the lock held.
+static void CloseCallbackObject(PTP_WORK Work) {
+  if (Work->CleanupGroup && Work->Type != DokanHostCallbackSimple) {
+    RemoveEntryList(&Work->GroupEntry);
+    Work->CleanupGroup = NULL;
+  }
+  if (Work->Type == DokanHostCallbackTimer) {
+    PTP_TIMER timer = CONTAINING_RECORD(Work, TP_TIMER, Work);
+    if (timer->Armed) {
+      RemoveEntryList(&timer->TimerEntry);
+      timer->Armed = FALSE;
+    }
+  }
+  if (Work->Pending || Work->Running) {
+    Work->Closed = TRUE;
+  } else {
+    FreeCallbackObject(Work);
+  }
+}
+
+static PTP_WORK AllocCallbackObject(DOKAN_HOST_CALLBACK_TYPE Type,
+                                    size_t Size, PVOID Context,
+                                    PTP_CALLBACK_ENVIRON CallbackEnviron) {
+  PTP_WORK work = calloc(1, Size);
+  if (!work) {
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return NULL;
+  }
+  work->Type = Type;
+  work->Context = Context;
+  pthread_mutex_lock(&g_TpLock);
+  work->Pool = GetEnvironmentPool(CallbackEnviron);
+  if (!work->Pool) {
+    pthread_mutex_unlock(&g_TpLock);
+    free(work);
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return NULL;
+  }
+  if (CallbackEnviron && CallbackEnviron->CleanupGroup) {
+    work->CleanupGroup = CallbackEnviron->CleanupGroup;
+    if (Type == DokanHostCallbackSimple) {
+      ++work->CleanupGroup->Callbacks;
+    } else {
+      InsertTailList(&work->CleanupGroup->Members, &work->GroupEntry);
+    }
+  }
+  pthread_mutex_unlock(&g_TpLock);
+  return work;
+}
+
+///////////////////////////////// Pools /////////////////////////////////
+
+PTP_POOL CreateThreadpool(PVOID Reserved) {
+  UNREFERENCED_PARAMETER(Reserved);
+  return AllocPool();
+}
+
+VOID CloseThreadpool(PTP_POOL Pool) {
+  pthread_mutex_lock(&g_TpLock);
+  // The threads exit once the queued callbacks are done.
+  Pool->Closed = TRUE;
+  if (Pool->Threads) {
+    pthread_cond_broadcast(&Pool->WorkAvailable);
+  } else {
+    FreePool(Pool);
+  }
+  pthread_mutex_unlock(&g_TpLock);
+}
+
+VOID SetThreadpoolThreadMaximum(PTP_POOL Pool, DWORD Maximum) {
+  pthread_mutex_lock(&g_TpLock);
+  Pool->Maximum = max(Maximum, 1);
+  Pool->Minimum = min(Pool->Minimum, Pool->Maximum);
+  pthread_mutex_unlock(&g_TpLock);
+}
+
+BOOL SetThreadpoolThreadMinimum(PTP_POOL Pool, DWORD Minimum) {
+  pthread_mutex_lock(&g_TpLock);
+  Pool->Minimum = Minimum;
+  Pool->Maximum = max(Pool->Maximum, Minimum);
+  pthread_mutex_unlock(&g_TpLock);
+  return TRUE;
+}
+
+//////////////////////////// Cleanup groups ////////////////////////////
+
+PTP_CLEANUP_GROUP CreateThreadpoolCleanupGroup(void) {
+  PTP_CLEANUP_GROUP group = calloc(1, sizeof(TP_CLEANUP_GROUP));
+  if (!group) {
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return NULL;
+  }
+  InitializeListHead(&group->Members);
+  return group;
+}
+
+VOID CloseThreadpoolCleanupGroupMembers(PTP_CLEANUP_GROUP CleanupGroup,
+                                        BOOL CancelPendingCallbacks,
+                                        PVOID CleanupContext) {
+  UNREFERENCED_PARAMETER(CleanupContext);
+  pthread_mutex_lock(&g_TpLock);
+  while (!IsListEmpty(&CleanupGroup->Members)) {
+    PTP_WORK work =
+        CONTAINING_RECORD(CleanupGroup->Members.Flink, TP_WORK, GroupEntry);
+    RemoveEntryList(&work->GroupEntry);
+    work->CleanupGroup = NULL;
+    if (work->Type == DokanHostCallbackTimer) {
+      PTP_TIMER timer = CONTAINING_RECORD(work, TP_TIMER, Work);
+      if (timer->Armed) {
+        RemoveEntryList(&timer->TimerEntry);
+        timer->Armed = FALSE;
+      }
+    }
+    WaitForCallbacks(work, CancelPendingCallbacks);
+    if (work->Closed) {
+      // Already released by its owner, the last callback freed it.
+      continue;
+    }
+    FreeCallbackObject(work);
+  }
+  while (CleanupGroup->Callbacks) {
+    pthread_cond_wait(&g_TpCallbackDone, &g_TpLock);
+  }
+  pthread_mutex_unlock(&g_TpLock);
+}
+
+VOID CloseThreadpoolCleanupGroup(PTP_CLEANUP_GROUP CleanupGroup) {
+  free(CleanupGroup);
+}
+
+////////////////////////// Callback environments //////////////////////////
+
+VOID InitializeThreadpoolEnvironment(PTP_CALLBACK_ENVIRON CallbackEnviron) {
+  memset(CallbackEnviron, 0, sizeof(TP_CALLBACK_ENVIRON));
+}
+
+VOID SetThreadpoolCallbackPool(PTP_CALLBACK_ENVIRON CallbackEnviron,
+                               PTP_POOL Pool) {
+  CallbackEnviron->Pool = Pool;
+}
+
+VOID SetThreadpoolCallbackCleanupGroup(
+    PTP_CALLBACK_ENVIRON CallbackEnviron, PTP_CLEANUP_GROUP CleanupGroup,
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK CleanupGroupCancelCallback) {
+  CallbackEnviron->CleanupGroup = CleanupGroup;
+  CallbackEnviron->CleanupGroupCancelCallback = CleanupGroupCancelCallback;
+}
+
+VOID SetThreadpoolCallbackLibrary(PTP_CALLBACK_ENVIRON CallbackEnviron,
+                                  PVOID Module) {
+  CallbackEnviron->RaceDll = Module;
+}
+
+VOID DestroyThreadpoolEnvironment(PTP_CALLBACK_ENVIRON CallbackEnviron) {
+  UNREFERENCED_PARAMETER(CallbackEnviron);
+}
+
+///////////////////////////////// Works /////////////////////////////////
+
+PTP_WORK CreateThreadpoolWork(PTP_WORK_CALLBACK Callback, PVOID Context,
+                              PTP_CALLBACK_ENVIRON CallbackEnviron) {
+  PTP_WORK work = AllocCallbackObject(DokanHostCallbackWork, sizeof(TP_WORK),
+                                      Context, CallbackEnviron);
+  if (work) {
+    work->Callback.Work = Callback;
+  }
+  return work;
+}
+
+VOID SubmitThreadpoolWork(PTP_WORK Work) {
+  pthread_mutex_lock(&g_TpLock);
+  if (!QueueCallback(Work)) {
+    fprintf(stderr, "SubmitThreadpoolWork: cannot start a thread\n");
+    abort();
+  }
+  pthread_mutex_unlock(&g_TpLock);
+}
+
+VOID WaitForThreadpoolWorkCallbacks(PTP_WORK Work,
+                                    BOOL CancelPendingCallbacks) {
+  pthread_mutex_lock(&g_TpLock);
+  WaitForCallbacks(Work, CancelPendingCallbacks);
+  pthread_mutex_unlock(&g_TpLock);
+}
+
+VOID CloseThreadpoolWork(PTP_WORK Work) {
+  pthread_mutex_lock(&g_TpLock);
+  CloseCallbackObject(Work);
+  pthread_mutex_unlock(&g_TpLock);
+}
+
+BOOL TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK Callback, PVOID Context,
+                                 PTP_CALLBACK_ENVIRON CallbackEnviron) {
+  PTP_WORK work = AllocCallbackObject(
+      DokanHostCallbackSimple, sizeof(TP_WORK), Context, CallbackEnviron);
+  if (!work) {
+    return FALSE;
+  }
+  work->Callback.Simple = Callback;
+  pthread_mutex_lock(&g_TpLock);
+  // Freed by the worker once run.
+  work->Closed = TRUE;
+  if (!QueueCallback(work)) {
+    if (work->CleanupGroup) {
+      --work->CleanupGroup->Callbacks;
+    }
+    pthread_mutex_unlock(&g_TpLock);
+    free(work);
+    SetLastError(ERROR_NO_SYSTEM_RESOURCES);
+    return FALSE;
+  }
+  pthread_mutex_unlock(&g_TpLock);
+  return TRUE;
+}
+
+///////////////////////////////// Timers /////////////////////////////////
+
+static void *TimerThread(void *Parameter) {
+  UNREFERENCED_PARAMETER(Parameter);
+  pthread_mutex_lock(&g_TpLock);
+  for (;;) {
+    ULONGLONG now = GetTickCount64();
+    ULONGLONG next = MAXULONGLONG;
+    PLIST_ENTRY entry = g_Timers.Flink;
+    while (entry != &g_Timers) {
+      PTP_TIMER timer = CONTAINING_RECORD(entry, TP_TIMER, TimerEntry);
+      entry = entry->Flink;
+      if (timer->DueTime <= now) {
+        // A late timer does not queue its callback twice.
+        if (!timer->Work.Pending) {
+          QueueCallback(&timer->Work);
+        }
+        if (timer->Period) {
+          timer->DueTime = now + timer->Period;
+        } else {
+          RemoveEntryList(&timer->TimerEntry);
+          timer->Armed = FALSE;
+          continue;
+        }
+      }
+      next = min(next, timer->DueTime);
+    }
+    WaitCondition(&g_TimerChanged,
+                  next == MAXULONGLONG ? INFINITE : (DWORD)(next - now));
+  }
+  return NULL;
+}
+
+PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK Callback, PVOID Context,
+                                PTP_CALLBACK_ENVIRON CallbackEnviron) {
+  PTP_WORK work = AllocCallbackObject(
+      DokanHostCallbackTimer, sizeof(TP_TIMER), Context, CallbackEnviron);
+  if (!work) {
+    return NULL;
+  }
+  work->Callback.Timer = Callback;
+  return CONTAINING_RECORD(work, TP_TIMER, Work);
+}
+
+VOID SetThreadpoolTimer(PTP_TIMER Timer, PFILETIME DueTime, DWORD Period,
+                        DWORD WindowLength) {
+  UNREFERENCED_PARAMETER(WindowLength);
+  pthread_mutex_lock(&g_TpLock);
+  if (!g_TimerThreadStarted) {
+    pthread_t thread;
+    InitializeCondition(&g_TimerChanged);
+    InitializeListHead(&g_Timers);
+    if (pthread_create(&thread, NULL, TimerThread, NULL)) {
+      fprintf(stderr, "SetThreadpoolTimer: cannot start the timer thread\n");
+      abort();
+    }
+    pthread_detach(thread);
+    g_TimerThreadStarted = TRUE;
+  }
+  if (Timer->Armed) {
+    RemoveEntryList(&Timer->TimerEntry);
+    Timer->Armed = FALSE;
+  }
+  if (DueTime) {
+    LONGLONG dueTime = (LONGLONG)(((ULONGLONG)DueTime->dwHighDateTime << 32) |
+                                  DueTime->dwLowDateTime);
+    // Absolute due times are taken as already passed.
+    ULONGLONG delay = dueTime < 0 ? (ULONGLONG)-dueTime / 10000 : 0;
+    Timer->DueTime = GetTickCount64() + delay;
+    Timer->Period = Period;
+    Timer->Armed = TRUE;
+    InsertTailList(&g_Timers, &Timer->TimerEntry);
+  }
+  pthread_cond_signal(&g_TimerChanged);
+  pthread_mutex_unlock(&g_TpLock);
+}
+
+VOID WaitForThreadpoolTimerCallbacks(PTP_TIMER Timer,
+                                     BOOL CancelPendingCallbacks) {
+  pthread_mutex_lock(&g_TpLock);
+  WaitForCallbacks(&Timer->Work, CancelPendingCallbacks);
+  pthread_mutex_unlock(&g_TpLock);
+}
+
+VOID CloseThreadpoolTimer(PTP_TIMER Timer) {
+  pthread_mutex_lock(&g_TpLock);
+  CloseCallbackObject(&Timer->Work);
+  pthread_mutex_unlock(&g_TpLock);
+}
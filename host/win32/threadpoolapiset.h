@@ -0,0 +1,101 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_HOST_THREADPOOLAPISET_H_
+#define DOKAN_HOST_THREADPOOLAPISET_H_
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Thread pool of the host shim. A pool starts a thread whenever a callback is
+// queued and none is idle, so long running callbacks like the pull loops do
+// not starve the others, as with the Windows thread pool.
+typedef struct _TP_POOL TP_POOL, *PTP_POOL;
+typedef struct _TP_WORK TP_WORK, *PTP_WORK;
+typedef struct _TP_TIMER TP_TIMER, *PTP_TIMER;
+typedef struct _TP_CLEANUP_GROUP TP_CLEANUP_GROUP, *PTP_CLEANUP_GROUP;
+typedef struct _TP_CALLBACK_INSTANCE TP_CALLBACK_INSTANCE,
+    *PTP_CALLBACK_INSTANCE;
+
+typedef VOID(CALLBACK *PTP_WORK_CALLBACK)(PTP_CALLBACK_INSTANCE Instance,
+                                          PVOID Context, PTP_WORK Work);
+typedef VOID(CALLBACK *PTP_TIMER_CALLBACK)(PTP_CALLBACK_INSTANCE Instance,
+                                           PVOID Context, PTP_TIMER Timer);
+typedef VOID(CALLBACK *PTP_SIMPLE_CALLBACK)(PTP_CALLBACK_INSTANCE Instance,
+                                            PVOID Context);
+typedef VOID(CALLBACK *PTP_CLEANUP_GROUP_CANCEL_CALLBACK)(
+    PVOID ObjectContext, PVOID CleanupContext);
+
+typedef struct _TP_CALLBACK_ENVIRON {
+  PTP_POOL Pool;
+  PTP_CLEANUP_GROUP CleanupGroup;
+  PTP_CLEANUP_GROUP_CANCEL_CALLBACK CleanupGroupCancelCallback;
+  PVOID RaceDll;
+} TP_CALLBACK_ENVIRON, *PTP_CALLBACK_ENVIRON;
+
+PTP_POOL CreateThreadpool(PVOID Reserved);
+VOID CloseThreadpool(PTP_POOL Pool);
+VOID SetThreadpoolThreadMaximum(PTP_POOL Pool, DWORD Maximum);
+BOOL SetThreadpoolThreadMinimum(PTP_POOL Pool, DWORD Minimum);
+
+PTP_CLEANUP_GROUP CreateThreadpoolCleanupGroup(void);
+VOID CloseThreadpoolCleanupGroupMembers(PTP_CLEANUP_GROUP CleanupGroup,
+                                        BOOL CancelPendingCallbacks,
+                                        PVOID CleanupContext);
+VOID CloseThreadpoolCleanupGroup(PTP_CLEANUP_GROUP CleanupGroup);
+
+VOID InitializeThreadpoolEnvironment(PTP_CALLBACK_ENVIRON CallbackEnviron);
+VOID SetThreadpoolCallbackPool(PTP_CALLBACK_ENVIRON CallbackEnviron,
+                               PTP_POOL Pool);
+VOID SetThreadpoolCallbackCleanupGroup(
+    PTP_CALLBACK_ENVIRON CallbackEnviron, PTP_CLEANUP_GROUP CleanupGroup,
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK CleanupGroupCancelCallback);
+VOID SetThreadpoolCallbackLibrary(PTP_CALLBACK_ENVIRON CallbackEnviron,
+                                  PVOID Module);
+VOID DestroyThreadpoolEnvironment(PTP_CALLBACK_ENVIRON CallbackEnviron);
+
+PTP_WORK CreateThreadpoolWork(PTP_WORK_CALLBACK Callback, PVOID Context,
+                              PTP_CALLBACK_ENVIRON CallbackEnviron);
+VOID SubmitThreadpoolWork(PTP_WORK Work);
+VOID WaitForThreadpoolWorkCallbacks(PTP_WORK Work,
+                                    BOOL CancelPendingCallbacks);
+VOID CloseThreadpoolWork(PTP_WORK Work);
+
+BOOL TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK Callback, PVOID Context,
+                                 PTP_CALLBACK_ENVIRON CallbackEnviron);
+
+// Only the relative due times are supported.
+PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK Callback, PVOID Context,
+                                PTP_CALLBACK_ENVIRON CallbackEnviron);
+VOID SetThreadpoolTimer(PTP_TIMER Timer, PFILETIME DueTime, DWORD Period,
+                        DWORD WindowLength);
+VOID WaitForThreadpoolTimerCallbacks(PTP_TIMER Timer,
+                                     BOOL CancelPendingCallbacks);
+VOID CloseThreadpoolTimer(PTP_TIMER Timer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DOKAN_HOST_THREADPOOLAPISET_H_
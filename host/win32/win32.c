@@ -0,0 +1,1213 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Implementation of the host windows.h over POSIX, except the printf family
+// (format.c) and the thread pool (threadpool.c).
+
+#include <windows.h>
+#include <sddl.h>
+#include <strsafe.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "win32_internal.h"
+
+/////////////////////////////// Last error ///////////////////////////////
+
+static __thread DWORD t_LastError;
+
+DWORD GetLastError(void) { return t_LastError; }
+
+VOID SetLastError(DWORD ErrCode) { t_LastError = ErrCode; }
+
+DWORD DokanHostErrorFromErrno(int Error) {
+  switch (Error) {
+  case 0:
+    return ERROR_SUCCESS;
+  case ENOENT:
+    return ERROR_FILE_NOT_FOUND;
+  case ENOTDIR:
+    return ERROR_PATH_NOT_FOUND;
+  case EACCES:
+  case EPERM:
+  case EROFS:
+    return ERROR_ACCESS_DENIED;
+  case EEXIST:
+    return ERROR_FILE_EXISTS;
+  case EBADF:
+    return ERROR_INVALID_HANDLE;
+  case ENOMEM:
+    return ERROR_NOT_ENOUGH_MEMORY;
+  case EMFILE:
+  case ENFILE:
+    return ERROR_TOO_MANY_OPEN_FILES;
+  case ENOSPC:
+    return ERROR_DISK_FULL;
+  case EBUSY:
+    return ERROR_BUSY;
+  case ENOTEMPTY:
+    return ERROR_DIR_NOT_EMPTY;
+  case EISDIR:
+    return ERROR_DIRECTORY;
+  case ETIMEDOUT:
+    return ERROR_TIMEOUT;
+  case ENAMETOOLONG:
+    return ERROR_INVALID_NAME;
+  default:
+    return ERROR_INVALID_PARAMETER;
+  }
+}
+
+/////////////////////////////////// SList ///////////////////////////////////
+
+static void LockSList(PSLIST_HEADER ListHead) {
+  while (__atomic_exchange_n(&ListHead->Lock, 1, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(&ListHead->Lock, __ATOMIC_RELAXED)) {
+      YieldProcessor();
+    }
+  }
+}
+
+static void UnlockSList(PSLIST_HEADER ListHead) {
+  __atomic_store_n(&ListHead->Lock, 0, __ATOMIC_RELEASE);
+}
+
+VOID InitializeSListHead(PSLIST_HEADER ListHead) {
+  memset(ListHead, 0, sizeof(SLIST_HEADER));
+}
+
+PSLIST_ENTRY InterlockedPushEntrySList(PSLIST_HEADER ListHead,
+                                       PSLIST_ENTRY ListEntry) {
+  PSLIST_ENTRY previous;
+  LockSList(ListHead);
+  previous = ListHead->Next;
+  ListEntry->Next = previous;
+  ListHead->Next = ListEntry;
+  ++ListHead->Depth;
+  UnlockSList(ListHead);
+  return previous;
+}
+
+PSLIST_ENTRY InterlockedPopEntrySList(PSLIST_HEADER ListHead) {
+  PSLIST_ENTRY entry;
+  LockSList(ListHead);
+  entry = ListHead->Next;
+  if (entry) {
+    ListHead->Next = entry->Next;
+    --ListHead->Depth;
+  }
+  UnlockSList(ListHead);
+  return entry;
+}
+
+PSLIST_ENTRY InterlockedFlushSList(PSLIST_HEADER ListHead) {
+  PSLIST_ENTRY entry;
+  LockSList(ListHead);
+  entry = ListHead->Next;
+  ListHead->Next = NULL;
+  ListHead->Depth = 0;
+  UnlockSList(ListHead);
+  return entry;
+}
+
+USHORT QueryDepthSList(PSLIST_HEADER ListHead) {
+  USHORT depth;
+  LockSList(ListHead);
+  depth = ListHead->Depth;
+  UnlockSList(ListHead);
+  return depth;
+}
+
+/////////////////////////////// Memory ///////////////////////////////
+
+errno_t memcpy_s(void *Destination, size_t DestinationSize, const void *Source,
+                 size_t Count) {
+  if (!Count) {
+    return 0;
+  }
+  if (!Destination || !Source || DestinationSize < Count) {
+    if (Destination && DestinationSize) {
+      memset(Destination, 0, DestinationSize);
+    }
+    return EINVAL;
+  }
+  memcpy(Destination, Source, Count);
+  return 0;
+}
+
+errno_t memmove_s(void *Destination, size_t DestinationSize,
+                  const void *Source, size_t Count) {
+  if (!Count) {
+    return 0;
+  }
+  if (!Destination || !Source || DestinationSize < Count) {
+    return EINVAL;
+  }
+  memmove(Destination, Source, Count);
+  return 0;
+}
+
+HLOCAL LocalFree(HLOCAL Memory) {
+  free(Memory);
+  return NULL;
+}
+
+void *_aligned_malloc(size_t Size, size_t Alignment) {
+  void *memory = NULL;
+  if (Alignment < sizeof(void *)) {
+    Alignment = sizeof(void *);
+  }
+  if (posix_memalign(&memory, Alignment, Size)) {
+    return NULL;
+  }
+  return memory;
+}
+
+void _aligned_free(void *Memory) { free(Memory); }
+
+//////////////////////////// Synchronization ////////////////////////////
+
+VOID InitializeCriticalSection(LPCRITICAL_SECTION CriticalSection) {
+  pthread_mutexattr_t attributes;
+  pthread_mutexattr_init(&attributes);
+  // Critical sections can be entered again by their owner.
+  pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&CriticalSection->Mutex, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+}
+
+BOOL InitializeCriticalSectionAndSpinCount(LPCRITICAL_SECTION CriticalSection,
+                                           DWORD SpinCount) {
+  UNREFERENCED_PARAMETER(SpinCount);
+  InitializeCriticalSection(CriticalSection);
+  return TRUE;
+}
+
+VOID DeleteCriticalSection(LPCRITICAL_SECTION CriticalSection) {
+  pthread_mutex_destroy(&CriticalSection->Mutex);
+}
+
+VOID EnterCriticalSection(LPCRITICAL_SECTION CriticalSection) {
+  pthread_mutex_lock(&CriticalSection->Mutex);
+}
+
+BOOL TryEnterCriticalSection(LPCRITICAL_SECTION CriticalSection) {
+  return pthread_mutex_trylock(&CriticalSection->Mutex) == 0;
+}
+
+VOID LeaveCriticalSection(LPCRITICAL_SECTION CriticalSection) {
+  pthread_mutex_unlock(&CriticalSection->Mutex);
+}
+
+VOID InitializeSRWLock(PSRWLOCK SRWLock) {
+  pthread_rwlock_init(&SRWLock->Lock, NULL);
+}
+
+VOID AcquireSRWLockExclusive(PSRWLOCK SRWLock) {
+  pthread_rwlock_wrlock(&SRWLock->Lock);
+}
+
+VOID AcquireSRWLockShared(PSRWLOCK SRWLock) {
+  pthread_rwlock_rdlock(&SRWLock->Lock);
+}
+
+BOOLEAN TryAcquireSRWLockExclusive(PSRWLOCK SRWLock) {
+  return pthread_rwlock_trywrlock(&SRWLock->Lock) == 0;
+}
+
+BOOLEAN TryAcquireSRWLockShared(PSRWLOCK SRWLock) {
+  return pthread_rwlock_tryrdlock(&SRWLock->Lock) == 0;
+}
+
+VOID ReleaseSRWLockExclusive(PSRWLOCK SRWLock) {
+  pthread_rwlock_unlock(&SRWLock->Lock);
+}
+
+VOID ReleaseSRWLockShared(PSRWLOCK SRWLock) {
+  pthread_rwlock_unlock(&SRWLock->Lock);
+}
+
+VOID InitializeConditionVariable(PCONDITION_VARIABLE ConditionVariable) {
+  pthread_condattr_t attributes;
+  pthread_condattr_init(&attributes);
+  pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+  pthread_cond_init(&ConditionVariable->Condition, &attributes);
+  pthread_condattr_destroy(&attributes);
+}
+
+void DokanHostDeadline(DWORD Milliseconds, struct timespec *Deadline) {
+  clock_gettime(CLOCK_MONOTONIC, Deadline);
+  Deadline->tv_sec += Milliseconds / 1000;
+  Deadline->tv_nsec += (long)(Milliseconds % 1000) * 1000000;
+  if (Deadline->tv_nsec >= 1000000000) {
+    Deadline->tv_sec += 1;
+    Deadline->tv_nsec -= 1000000000;
+  }
+}
+
+BOOL SleepConditionVariableCS(PCONDITION_VARIABLE ConditionVariable,
+                              PCRITICAL_SECTION CriticalSection,
+                              DWORD Milliseconds) {
+  struct timespec deadline;
+  if (Milliseconds == INFINITE) {
+    pthread_cond_wait(&ConditionVariable->Condition, &CriticalSection->Mutex);
+    return TRUE;
+  }
+  DokanHostDeadline(Milliseconds, &deadline);
+  if (pthread_cond_timedwait(&ConditionVariable->Condition,
+                             &CriticalSection->Mutex, &deadline)) {
+    SetLastError(ERROR_TIMEOUT);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+VOID WakeConditionVariable(PCONDITION_VARIABLE ConditionVariable) {
+  pthread_cond_signal(&ConditionVariable->Condition);
+}
+
+VOID WakeAllConditionVariable(PCONDITION_VARIABLE ConditionVariable) {
+  pthread_cond_broadcast(&ConditionVariable->Condition);
+}
+
+//////////////////////////////// Handles ////////////////////////////////
+
+typedef struct _DOKAN_HOST_EVENT {
+  DOKAN_HOST_HANDLE Header;
+  pthread_mutex_t Mutex;
+  pthread_cond_t Condition;
+  BOOL ManualReset;
+  BOOL Signaled;
+} DOKAN_HOST_EVENT, *PDOKAN_HOST_EVENT;
+
+typedef struct _DOKAN_HOST_FILE {
+  DOKAN_HOST_HANDLE Header;
+  int Descriptor;
+  // Set for FILE_FLAG_DELETE_ON_CLOSE.
+  char *DeletePath;
+} DOKAN_HOST_FILE, *PDOKAN_HOST_FILE;
+
+typedef struct _DOKAN_HOST_MAPPING {
+  DOKAN_HOST_HANDLE Header;
+  int Descriptor;
+  size_t Size;
+} DOKAN_HOST_MAPPING, *PDOKAN_HOST_MAPPING;
+
+typedef struct _DOKAN_HOST_WAIT {
+  DOKAN_HOST_HANDLE Header;
+  pthread_t Thread;
+  HANDLE Object;
+  WAITORTIMERCALLBACK Callback;
+  PVOID Context;
+  ULONG Milliseconds;
+  volatile LONG Cancelled;
+} DOKAN_HOST_WAIT, *PDOKAN_HOST_WAIT;
+
+static PVOID GetHandle(HANDLE Handle, DOKAN_HOST_HANDLE_TYPE Type) {
+  if (!Handle || Handle == INVALID_HANDLE_VALUE ||
+      ((PDOKAN_HOST_HANDLE)Handle)->Type != Type) {
+    SetLastError(ERROR_INVALID_HANDLE);
+    return NULL;
+  }
+  return Handle;
+}
+
+HANDLE CreateEventW(LPSECURITY_ATTRIBUTES EventAttributes, BOOL ManualReset,
+                    BOOL InitialState, LPCWSTR Name) {
+  PDOKAN_HOST_EVENT event;
+  pthread_condattr_t attributes;
+  UNREFERENCED_PARAMETER(EventAttributes);
+  if (Name) {
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return NULL;
+  }
+  event = calloc(1, sizeof(DOKAN_HOST_EVENT));
+  if (!event) {
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return NULL;
+  }
+  event->Header.Type = DokanHostHandleEvent;
+  pthread_mutex_init(&event->Mutex, NULL);
+  pthread_condattr_init(&attributes);
+  pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+  pthread_cond_init(&event->Condition, &attributes);
+  pthread_condattr_destroy(&attributes);
+  event->ManualReset = ManualReset;
+  event->Signaled = InitialState;
+  return event;
+}
+
+BOOL SetEvent(HANDLE Event) {
+  PDOKAN_HOST_EVENT event = GetHandle(Event, DokanHostHandleEvent);
+  if (!event) {
+    return FALSE;
+  }
+  pthread_mutex_lock(&event->Mutex);
+  event->Signaled = TRUE;
+  if (event->ManualReset) {
+    pthread_cond_broadcast(&event->Condition);
+  } else {
+    pthread_cond_signal(&event->Condition);
+  }
+  pthread_mutex_unlock(&event->Mutex);
+  return TRUE;
+}
+
+BOOL ResetEvent(HANDLE Event) {
+  PDOKAN_HOST_EVENT event = GetHandle(Event, DokanHostHandleEvent);
+  if (!event) {
+    return FALSE;
+  }
+  pthread_mutex_lock(&event->Mutex);
+  event->Signaled = FALSE;
+  pthread_mutex_unlock(&event->Mutex);
+  return TRUE;
+}
+
+DWORD WaitForSingleObject(HANDLE Handle, DWORD Milliseconds) {
+  PDOKAN_HOST_EVENT event = GetHandle(Handle, DokanHostHandleEvent);
+  struct timespec deadline;
+  DWORD result = WAIT_OBJECT_0;
+  if (!event) {
+    return WAIT_FAILED;
+  }
+  if (Milliseconds != INFINITE) {
+    DokanHostDeadline(Milliseconds, &deadline);
+  }
+  pthread_mutex_lock(&event->Mutex);
+  while (!event->Signaled) {
+    if (Milliseconds == INFINITE) {
+      pthread_cond_wait(&event->Condition, &event->Mutex);
+    } else if (pthread_cond_timedwait(&event->Condition, &event->Mutex,
+                                      &deadline) == ETIMEDOUT) {
+      result = WAIT_TIMEOUT;
+      break;
+    }
+  }
+  if (result == WAIT_OBJECT_0 && !event->ManualReset) {
+    event->Signaled = FALSE;
+  }
+  pthread_mutex_unlock(&event->Mutex);
+  return result;
+}
+
+BOOL CloseHandle(HANDLE Object) {
+  PDOKAN_HOST_HANDLE handle = Object;
+  if (!handle || handle == INVALID_HANDLE_VALUE) {
+    SetLastError(ERROR_INVALID_HANDLE);
+    return FALSE;
+  }
+  switch (handle->Type) {
+  case DokanHostHandleEvent: {
+    PDOKAN_HOST_EVENT event = Object;
+    pthread_cond_destroy(&event->Condition);
+    pthread_mutex_destroy(&event->Mutex);
+    break;
+  }
+  case DokanHostHandleFile: {
+    PDOKAN_HOST_FILE file = Object;
+    close(file->Descriptor);
+    if (file->DeletePath) {
+      unlink(file->DeletePath);
+      free(file->DeletePath);
+    }
+    break;
+  }
+  case DokanHostHandleMapping: {
+    PDOKAN_HOST_MAPPING mapping = Object;
+    close(mapping->Descriptor);
+    break;
+  }
+  default:
+    SetLastError(ERROR_INVALID_HANDLE);
+    return FALSE;
+  }
+  handle->Type = 0;
+  free(handle);
+  return TRUE;
+}
+
+static void *WaitThread(void *Parameter) {
+  PDOKAN_HOST_WAIT wait = Parameter;
+  ULONG waited = 0;
+  // Waits in slices to notice the unregistration.
+  while (!InterlockedCompareExchange(&wait->Cancelled, 0, 0)) {
+    DWORD slice = 50;
+    if (wait->Milliseconds != INFINITE) {
+      slice = min(slice, wait->Milliseconds - waited);
+    }
+    if (WaitForSingleObject(wait->Object, slice) == WAIT_OBJECT_0) {
+      wait->Callback(wait->Context, FALSE);
+      break;
+    }
+    waited += slice;
+    if (wait->Milliseconds != INFINITE && waited >= wait->Milliseconds) {
+      wait->Callback(wait->Context, TRUE);
+      break;
+    }
+  }
+  return NULL;
+}
+
+BOOL RegisterWaitForSingleObject(PHANDLE NewWaitObject, HANDLE Object,
+                                 WAITORTIMERCALLBACK Callback, PVOID Context,
+                                 ULONG Milliseconds, ULONG Flags) {
+  PDOKAN_HOST_WAIT wait;
+  if (!GetHandle(Object, DokanHostHandleEvent)) {
+    return FALSE;
+  }
+  // Only the single shot waits are supported.
+  if (!(Flags & WT_EXECUTEONLYONCE)) {
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+  }
+  wait = calloc(1, sizeof(DOKAN_HOST_WAIT));
+  if (!wait) {
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return FALSE;
+  }
+  wait->Header.Type = DokanHostHandleWait;
+  wait->Object = Object;
+  wait->Callback = Callback;
+  wait->Context = Context;
+  wait->Milliseconds = Milliseconds;
+  if (pthread_create(&wait->Thread, NULL, WaitThread, wait)) {
+    free(wait);
+    SetLastError(ERROR_NO_SYSTEM_RESOURCES);
+    return FALSE;
+  }
+  *NewWaitObject = wait;
+  return TRUE;
+}
+
+BOOL UnregisterWaitEx(HANDLE WaitHandle, HANDLE CompletionEvent) {
+  PDOKAN_HOST_WAIT wait = GetHandle(WaitHandle, DokanHostHandleWait);
+  if (!wait) {
+    return FALSE;
+  }
+  InterlockedExchange(&wait->Cancelled, 1);
+  // Waits for a running callback, unless called from it.
+  if (pthread_equal(wait->Thread, pthread_self())) {
+    pthread_detach(wait->Thread);
+  } else {
+    pthread_join(wait->Thread, NULL);
+  }
+  if (CompletionEvent && CompletionEvent != INVALID_HANDLE_VALUE) {
+    SetEvent(CompletionEvent);
+  }
+  wait->Header.Type = 0;
+  free(wait);
+  return TRUE;
+}
+
+////////////////////////// Threads and processes //////////////////////////
+
+// FLS slots are thread-specific keys. Unlike on Windows, FlsFree does not
+// call the callback for the threads still holding a value: the library
+// releases those itself.
+DWORD FlsAlloc(PFLS_CALLBACK_FUNCTION Callback) {
+  pthread_key_t key;
+  if (pthread_key_create(&key, (void (*)(void *))Callback)) {
+    SetLastError(ERROR_NO_SYSTEM_RESOURCES);
+    return FLS_OUT_OF_INDEXES;
+  }
+  return (DWORD)key;
+}
+
+BOOL FlsFree(DWORD FlsIndex) { return pthread_key_delete(FlsIndex) == 0; }
+
+PVOID FlsGetValue(DWORD FlsIndex) { return pthread_getspecific(FlsIndex); }
+
+BOOL FlsSetValue(DWORD FlsIndex, PVOID FlsData) {
+  return pthread_setspecific(FlsIndex, FlsData) == 0;
+}
+
+DWORD TlsAlloc(void) { return FlsAlloc(NULL); }
+
+BOOL TlsFree(DWORD TlsIndex) { return FlsFree(TlsIndex); }
+
+LPVOID TlsGetValue(DWORD TlsIndex) { return FlsGetValue(TlsIndex); }
+
+BOOL TlsSetValue(DWORD TlsIndex, LPVOID TlsValue) {
+  return FlsSetValue(TlsIndex, TlsValue);
+}
+
+VOID Sleep(DWORD Milliseconds) {
+  struct timespec duration = {Milliseconds / 1000,
+                              (long)(Milliseconds % 1000) * 1000000};
+  if (!Milliseconds) {
+    sched_yield();
+    return;
+  }
+  while (nanosleep(&duration, &duration) && errno == EINTR) {
+  }
+}
+
+BOOL SwitchToThread(void) { return sched_yield() == 0; }
+
+HANDLE GetCurrentProcess(void) { return (HANDLE)(LONG_PTR)-1; }
+
+DWORD GetCurrentProcessId(void) { return (DWORD)getpid(); }
+
+DWORD GetCurrentThreadId(void) {
+  static volatile LONG nextId;
+  static __thread DWORD id;
+  if (!id) {
+    id = (DWORD)InterlockedIncrement(&nextId);
+  }
+  return id;
+}
+
+BOOL GetProcessAffinityMask(HANDLE Process, PDWORD_PTR ProcessAffinityMask,
+                            PDWORD_PTR SystemAffinityMask) {
+  cpu_set_t set;
+  DWORD_PTR mask = 0;
+  UNREFERENCED_PARAMETER(Process);
+  if (sched_getaffinity(0, sizeof(set), &set)) {
+    SetLastError(DokanHostErrorFromErrno(errno));
+    return FALSE;
+  }
+  for (int cpu = 0; cpu < (int)(sizeof(DWORD_PTR) * 8); ++cpu) {
+    if (CPU_ISSET(cpu, &set)) {
+      mask |= (DWORD_PTR)1 << cpu;
+    }
+  }
+  *ProcessAffinityMask = mask;
+  *SystemAffinityMask = mask;
+  return TRUE;
+}
+
+VOID RaiseException(DWORD ExceptionCode, DWORD ExceptionFlags,
+                    DWORD NumberOfArguments, const ULONG_PTR *Arguments) {
+  UNREFERENCED_PARAMETER(ExceptionFlags);
+  UNREFERENCED_PARAMETER(NumberOfArguments);
+  UNREFERENCED_PARAMETER(Arguments);
+  fprintf(stderr, "Unhandled exception 0x%08x\n", ExceptionCode);
+  abort();
+}
+
+HMODULE LoadLibraryW(LPCWSTR LibFileName) {
+  UNREFERENCED_PARAMETER(LibFileName);
+  SetLastError(ERROR_NOT_SUPPORTED);
+  return NULL;
+}
+
+BOOL FreeLibrary(HMODULE LibModule) {
+  UNREFERENCED_PARAMETER(LibModule);
+  return TRUE;
+}
+
+BOOL OpenProcessToken(HANDLE ProcessHandle, DWORD DesiredAccess,
+                      PHANDLE TokenHandle) {
+  UNREFERENCED_PARAMETER(ProcessHandle);
+  UNREFERENCED_PARAMETER(DesiredAccess);
+  *TokenHandle = NULL;
+  SetLastError(ERROR_NOT_SUPPORTED);
+  return FALSE;
+}
+
+BOOL GetTokenInformation(HANDLE TokenHandle,
+                         TOKEN_INFORMATION_CLASS TokenInformationClass,
+                         LPVOID TokenInformation, DWORD TokenInformationLength,
+                         PDWORD ReturnLength) {
+  UNREFERENCED_PARAMETER(TokenHandle);
+  UNREFERENCED_PARAMETER(TokenInformationClass);
+  UNREFERENCED_PARAMETER(TokenInformation);
+  UNREFERENCED_PARAMETER(TokenInformationLength);
+  *ReturnLength = 0;
+  SetLastError(ERROR_NOT_SUPPORTED);
+  return FALSE;
+}
+
+BOOL ConvertSidToStringSidW(PSID Sid, LPWSTR *StringSid) {
+  UNREFERENCED_PARAMETER(Sid);
+  *StringSid = NULL;
+  SetLastError(ERROR_NOT_SUPPORTED);
+  return FALSE;
+}
+
+BOOL ConvertStringSecurityDescriptorToSecurityDescriptorW(
+    LPCWSTR StringSecurityDescriptor, DWORD StringSDRevision,
+    PSECURITY_DESCRIPTOR *SecurityDescriptor, PULONG SecurityDescriptorSize) {
+  UNREFERENCED_PARAMETER(StringSecurityDescriptor);
+  UNREFERENCED_PARAMETER(StringSDRevision);
+  *SecurityDescriptor = NULL;
+  if (SecurityDescriptorSize) {
+    *SecurityDescriptorSize = 0;
+  }
+  SetLastError(ERROR_NOT_SUPPORTED);
+  return FALSE;
+}
+
+BOOL ConvertSecurityDescriptorToStringSecurityDescriptorW(
+    PSECURITY_DESCRIPTOR SecurityDescriptor, DWORD RequestedStringSDRevision,
+    SECURITY_INFORMATION SecurityInformation, LPWSTR *StringSecurityDescriptor,
+    PULONG StringSecurityDescriptorLen) {
+  UNREFERENCED_PARAMETER(SecurityDescriptor);
+  UNREFERENCED_PARAMETER(RequestedStringSDRevision);
+  UNREFERENCED_PARAMETER(SecurityInformation);
+  *StringSecurityDescriptor = NULL;
+  if (StringSecurityDescriptorLen) {
+    *StringSecurityDescriptorLen = 0;
+  }
+  SetLastError(ERROR_NOT_SUPPORTED);
+  return FALSE;
+}
+
+////////////////////////////////// Time //////////////////////////////////
+
+// 100ns units, the usual frequency of the Windows performance counter.
+#define DOKAN_HOST_COUNTER_FREQUENCY 10000000LL
+// 100ns units between 1601-01-01 and 1970-01-01.
+#define DOKAN_HOST_EPOCH_DIFFERENCE 116444736000000000LL
+
+ULONGLONG GetTickCount64(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (ULONGLONG)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+DWORD GetTickCount(void) { return (DWORD)GetTickCount64(); }
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER *PerformanceCount) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  PerformanceCount->QuadPart =
+      (LONGLONG)now.tv_sec * DOKAN_HOST_COUNTER_FREQUENCY + now.tv_nsec / 100;
+  return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *Frequency) {
+  Frequency->QuadPart = DOKAN_HOST_COUNTER_FREQUENCY;
+  return TRUE;
+}
+
+VOID GetSystemTimeAsFileTime(LPFILETIME SystemTimeAsFileTime) {
+  struct timespec now;
+  ULONGLONG time;
+  clock_gettime(CLOCK_REALTIME, &now);
+  time = (ULONGLONG)now.tv_sec * 10000000 + now.tv_nsec / 100 +
+         DOKAN_HOST_EPOCH_DIFFERENCE;
+  SystemTimeAsFileTime->dwLowDateTime = (DWORD)time;
+  SystemTimeAsFileTime->dwHighDateTime = (DWORD)(time >> 32);
+}
+
+////////////////////////////////// Files //////////////////////////////////
+
+// Converts a path to UTF-8. Returns NULL and sets the last error on failure.
+static char *ToHostPath(LPCWSTR FileName) {
+  size_t size = wcslen(FileName) * 3 + 1;
+  char *path = malloc(size);
+  if (!path) {
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return NULL;
+  }
+  if (DokanHostUtf16ToUtf8(FileName, path, size) < 0) {
+    free(path);
+    SetLastError(ERROR_INVALID_NAME);
+    return NULL;
+  }
+  return path;
+}
+
+HANDLE CreateFileW(LPCWSTR FileName, DWORD DesiredAccess, DWORD ShareMode,
+                   LPSECURITY_ATTRIBUTES SecurityAttributes,
+                   DWORD CreationDisposition, DWORD FlagsAndAttributes,
+                   HANDLE TemplateFile) {
+  PDOKAN_HOST_FILE file;
+  char *path;
+  int flags = O_CLOEXEC;
+  BOOL read = (DesiredAccess & (GENERIC_READ | GENERIC_ALL | FILE_READ_DATA)) != 0;
+  BOOL write =
+      (DesiredAccess & (GENERIC_WRITE | GENERIC_ALL | FILE_WRITE_DATA |
+                        FILE_APPEND_DATA)) != 0;
+  UNREFERENCED_PARAMETER(ShareMode);
+  UNREFERENCED_PARAMETER(SecurityAttributes);
+  UNREFERENCED_PARAMETER(TemplateFile);
+
+  flags |= read && write ? O_RDWR : write ? O_WRONLY : O_RDONLY;
+  switch (CreationDisposition) {
+  case CREATE_NEW:
+    flags |= O_CREAT | O_EXCL;
+    break;
+  case CREATE_ALWAYS:
+    flags |= O_CREAT | O_TRUNC;
+    break;
+  case OPEN_EXISTING:
+    break;
+  case OPEN_ALWAYS:
+    flags |= O_CREAT;
+    break;
+  case TRUNCATE_EXISTING:
+    flags |= O_TRUNC;
+    break;
+  default:
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return INVALID_HANDLE_VALUE;
+  }
+  path = ToHostPath(FileName);
+  if (!path) {
+    return INVALID_HANDLE_VALUE;
+  }
+  file = calloc(1, sizeof(DOKAN_HOST_FILE));
+  if (!file) {
+    free(path);
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return INVALID_HANDLE_VALUE;
+  }
+  file->Header.Type = DokanHostHandleFile;
+  file->Descriptor = open(path, flags, 0644);
+  if (file->Descriptor < 0) {
+    SetLastError(DokanHostErrorFromErrno(errno));
+    free(path);
+    free(file);
+    return INVALID_HANDLE_VALUE;
+  }
+  if (FlagsAndAttributes & FILE_FLAG_DELETE_ON_CLOSE) {
+    file->DeletePath = path;
+  } else {
+    free(path);
+  }
+  return file;
+}
+
+BOOL ReadFile(HANDLE File, LPVOID Buffer, DWORD NumberOfBytesToRead,
+              LPDWORD NumberOfBytesRead, LPOVERLAPPED Overlapped) {
+  PDOKAN_HOST_FILE file = GetHandle(File, DokanHostHandleFile);
+  DWORD total = 0;
+  if (NumberOfBytesRead) {
+    *NumberOfBytesRead = 0;
+  }
+  if (!file) {
+    return FALSE;
+  }
+  if (Overlapped) {
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+  }
+  while (total < NumberOfBytesToRead) {
+    ssize_t count =
+        read(file->Descriptor, (char *)Buffer + total, NumberOfBytesToRead - total);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      SetLastError(DokanHostErrorFromErrno(errno));
+      return FALSE;
+    }
+    if (!count) {
+      break;
+    }
+    total += (DWORD)count;
+  }
+  if (NumberOfBytesRead) {
+    *NumberOfBytesRead = total;
+  }
+  return TRUE;
+}
+
+BOOL WriteFile(HANDLE File, LPCVOID Buffer, DWORD NumberOfBytesToWrite,
+               LPDWORD NumberOfBytesWritten, LPOVERLAPPED Overlapped) {
+  PDOKAN_HOST_FILE file = GetHandle(File, DokanHostHandleFile);
+  DWORD total = 0;
+  if (NumberOfBytesWritten) {
+    *NumberOfBytesWritten = 0;
+  }
+  if (!file) {
+    return FALSE;
+  }
+  if (Overlapped) {
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+  }
+  while (total < NumberOfBytesToWrite) {
+    ssize_t written = write(file->Descriptor, (const char *)Buffer + total,
+                            NumberOfBytesToWrite - total);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      SetLastError(DokanHostErrorFromErrno(errno));
+      if (NumberOfBytesWritten) {
+        *NumberOfBytesWritten = total;
+      }
+      return FALSE;
+    }
+    total += (DWORD)written;
+  }
+  if (NumberOfBytesWritten) {
+    *NumberOfBytesWritten = total;
+  }
+  return TRUE;
+}
+
+BOOL FlushFileBuffers(HANDLE File) {
+  PDOKAN_HOST_FILE file = GetHandle(File, DokanHostHandleFile);
+  if (!file) {
+    return FALSE;
+  }
+  if (fsync(file->Descriptor)) {
+    SetLastError(DokanHostErrorFromErrno(errno));
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL GetFileSizeEx(HANDLE File, PLARGE_INTEGER FileSize) {
+  PDOKAN_HOST_FILE file = GetHandle(File, DokanHostHandleFile);
+  struct stat status;
+  if (!file) {
+    return FALSE;
+  }
+  if (fstat(file->Descriptor, &status)) {
+    SetLastError(DokanHostErrorFromErrno(errno));
+    return FALSE;
+  }
+  FileSize->QuadPart = status.st_size;
+  return TRUE;
+}
+
+BOOL DeleteFileW(LPCWSTR FileName) {
+  char *path = ToHostPath(FileName);
+  int result;
+  if (!path) {
+    return FALSE;
+  }
+  result = unlink(path);
+  free(path);
+  if (result) {
+    SetLastError(DokanHostErrorFromErrno(errno));
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// Views of the mappings, to know the length to unmap.
+typedef struct _DOKAN_HOST_VIEW {
+  struct _DOKAN_HOST_VIEW *Next;
+  LPCVOID Address;
+  size_t Length;
+} DOKAN_HOST_VIEW, *PDOKAN_HOST_VIEW;
+
+static pthread_mutex_t g_ViewMutex = PTHREAD_MUTEX_INITIALIZER;
+static PDOKAN_HOST_VIEW g_Views;
+
+HANDLE CreateFileMappingW(HANDLE File,
+                          LPSECURITY_ATTRIBUTES FileMappingAttributes,
+                          DWORD Protect, DWORD MaximumSizeHigh,
+                          DWORD MaximumSizeLow, LPCWSTR Name) {
+  PDOKAN_HOST_FILE file = GetHandle(File, DokanHostHandleFile);
+  PDOKAN_HOST_MAPPING mapping;
+  LARGE_INTEGER size;
+  UNREFERENCED_PARAMETER(FileMappingAttributes);
+  if (!file) {
+    return NULL;
+  }
+  // Only the read-only mappings of whole files are supported.
+  if (Protect != PAGE_READONLY || MaximumSizeHigh || MaximumSizeLow || Name) {
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return NULL;
+  }
+  if (!GetFileSizeEx(File, &size)) {
+    return NULL;
+  }
+  mapping = calloc(1, sizeof(DOKAN_HOST_MAPPING));
+  if (!mapping) {
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return NULL;
+  }
+  mapping->Header.Type = DokanHostHandleMapping;
+  mapping->Descriptor = dup(file->Descriptor);
+  mapping->Size = (size_t)size.QuadPart;
+  if (mapping->Descriptor < 0) {
+    SetLastError(DokanHostErrorFromErrno(errno));
+    free(mapping);
+    return NULL;
+  }
+  return mapping;
+}
+
+LPVOID MapViewOfFile(HANDLE FileMappingObject, DWORD DesiredAccess,
+                     DWORD FileOffsetHigh, DWORD FileOffsetLow,
+                     SIZE_T NumberOfBytesToMap) {
+  PDOKAN_HOST_MAPPING mapping =
+      GetHandle(FileMappingObject, DokanHostHandleMapping);
+  PDOKAN_HOST_VIEW view;
+  if (!mapping) {
+    return NULL;
+  }
+  if (DesiredAccess != FILE_MAP_READ || FileOffsetHigh || FileOffsetLow ||
+      NumberOfBytesToMap || !mapping->Size) {
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return NULL;
+  }
+  view = calloc(1, sizeof(DOKAN_HOST_VIEW));
+  if (!view) {
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return NULL;
+  }
+  view->Length = mapping->Size;
+  view->Address =
+      mmap(NULL, view->Length, PROT_READ, MAP_PRIVATE, mapping->Descriptor, 0);
+  if (view->Address == MAP_FAILED) {
+    SetLastError(DokanHostErrorFromErrno(errno));
+    free(view);
+    return NULL;
+  }
+  pthread_mutex_lock(&g_ViewMutex);
+  view->Next = g_Views;
+  g_Views = view;
+  pthread_mutex_unlock(&g_ViewMutex);
+  return (LPVOID)view->Address;
+}
+
+BOOL UnmapViewOfFile(LPCVOID BaseAddress) {
+  PDOKAN_HOST_VIEW *link;
+  PDOKAN_HOST_VIEW view = NULL;
+  pthread_mutex_lock(&g_ViewMutex);
+  for (link = &g_Views; *link; link = &(*link)->Next) {
+    if ((*link)->Address == BaseAddress) {
+      view = *link;
+      *link = view->Next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&g_ViewMutex);
+  if (!view) {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return FALSE;
+  }
+  munmap((void *)view->Address, view->Length);
+  free(view);
+  return TRUE;
+}
+
+// There is no driver on the host.
+BOOL DeviceIoControl(HANDLE Device, DWORD IoControlCode, LPVOID InBuffer,
+                     DWORD InBufferSize, LPVOID OutBuffer, DWORD OutBufferSize,
+                     LPDWORD BytesReturned, LPOVERLAPPED Overlapped) {
+  UNREFERENCED_PARAMETER(Device);
+  UNREFERENCED_PARAMETER(IoControlCode);
+  UNREFERENCED_PARAMETER(InBuffer);
+  UNREFERENCED_PARAMETER(InBufferSize);
+  UNREFERENCED_PARAMETER(OutBuffer);
+  UNREFERENCED_PARAMETER(OutBufferSize);
+  UNREFERENCED_PARAMETER(Overlapped);
+  if (BytesReturned) {
+    *BytesReturned = 0;
+  }
+  SetLastError(ERROR_INVALID_HANDLE);
+  return FALSE;
+}
+
+DWORD QueryDosDeviceW(LPCWSTR DeviceName, LPWSTR TargetPath, DWORD Max) {
+  UNREFERENCED_PARAMETER(DeviceName);
+  UNREFERENCED_PARAMETER(TargetPath);
+  UNREFERENCED_PARAMETER(Max);
+  SetLastError(ERROR_FILE_NOT_FOUND);
+  return 0;
+}
+
+DWORD GetLogicalDrives(void) { return 0; }
+
+///////////////////////////////// Debugging /////////////////////////////////
+
+// Like without a debugger attached, the output is dropped unless the
+// DOKAN_HOST_DEBUG_OUTPUT environment variable is set.
+static BOOL IsDebugOutputEnabled(void) {
+  static volatile LONG enabled = -1;
+  if (enabled < 0) {
+    InterlockedExchange(&enabled, getenv("DOKAN_HOST_DEBUG_OUTPUT") != NULL);
+  }
+  return enabled;
+}
+
+VOID OutputDebugStringA(LPCSTR OutputString) {
+  if (IsDebugOutputEnabled()) {
+    fputs(OutputString, stderr);
+  }
+}
+
+VOID OutputDebugStringW(LPCWSTR OutputString) {
+  if (IsDebugOutputEnabled()) {
+    fputws(OutputString, stderr);
+  }
+}
+
+///////////////////////////// Wide strings /////////////////////////////
+
+size_t wcslen(const WCHAR *String) {
+  size_t length = 0;
+  while (String[length]) {
+    ++length;
+  }
+  return length;
+}
+
+size_t wcsnlen(const WCHAR *String, size_t MaxCount) {
+  size_t length = 0;
+  while (length < MaxCount && String[length]) {
+    ++length;
+  }
+  return length;
+}
+
+int wcscmp(const WCHAR *String1, const WCHAR *String2) {
+  while (*String1 && *String1 == *String2) {
+    ++String1;
+    ++String2;
+  }
+  return (int)*String1 - (int)*String2;
+}
+
+int wcsncmp(const WCHAR *String1, const WCHAR *String2, size_t Count) {
+  for (size_t i = 0; i < Count; ++i) {
+    if (String1[i] != String2[i] || !String1[i]) {
+      return (int)String1[i] - (int)String2[i];
+    }
+  }
+  return 0;
+}
+
+int _wcsicmp(const WCHAR *String1, const WCHAR *String2) {
+  for (;; ++String1, ++String2) {
+    int c1 = (int)towlower(*String1);
+    int c2 = (int)towlower(*String2);
+    if (c1 != c2 || !c1) {
+      return c1 - c2;
+    }
+  }
+}
+
+WCHAR *wcschr(const WCHAR *String, WCHAR Char) {
+  for (;; ++String) {
+    if (*String == Char) {
+      return (WCHAR *)String;
+    }
+    if (!*String) {
+      return NULL;
+    }
+  }
+}
+
+WCHAR *wcsstr(const WCHAR *String, const WCHAR *SubString) {
+  size_t length = wcslen(SubString);
+  if (!length) {
+    return (WCHAR *)String;
+  }
+  for (; *String; ++String) {
+    if (!wcsncmp(String, SubString, length)) {
+      return (WCHAR *)String;
+    }
+  }
+  return NULL;
+}
+
+errno_t wcsncpy_s(WCHAR *Destination, size_t DestinationSize,
+                  const WCHAR *Source, size_t Count) {
+  size_t length;
+  if (!Destination || !DestinationSize) {
+    return EINVAL;
+  }
+  if (!Source) {
+    Destination[0] = L'\0';
+    return EINVAL;
+  }
+  length = wcsnlen(Source, Count);
+  if (length >= DestinationSize) {
+    if (Count != _TRUNCATE) {
+      Destination[0] = L'\0';
+      return ERANGE;
+    }
+    length = DestinationSize - 1;
+  }
+  memcpy(Destination, Source, length * sizeof(WCHAR));
+  Destination[length] = L'\0';
+  return 0;
+}
+
+errno_t wcscpy_s(WCHAR *Destination, size_t DestinationSize,
+                 const WCHAR *Source) {
+  size_t length;
+  if (!Destination || !DestinationSize) {
+    return EINVAL;
+  }
+  if (!Source) {
+    Destination[0] = L'\0';
+    return EINVAL;
+  }
+  length = wcslen(Source);
+  if (length >= DestinationSize) {
+    Destination[0] = L'\0';
+    return ERANGE;
+  }
+  memcpy(Destination, Source, (length + 1) * sizeof(WCHAR));
+  return 0;
+}
+
+errno_t wcscat_s(WCHAR *Destination, size_t DestinationSize,
+                 const WCHAR *Source) {
+  size_t length;
+  if (!Destination || !DestinationSize) {
+    return EINVAL;
+  }
+  length = wcsnlen(Destination, DestinationSize);
+  if (length == DestinationSize) {
+    return EINVAL;
+  }
+  return wcscpy_s(Destination + length, DestinationSize - length, Source);
+}
+
+WCHAR *_wcsdup(const WCHAR *String) {
+  size_t size = (wcslen(String) + 1) * sizeof(WCHAR);
+  WCHAR *copy = malloc(size);
+  if (copy) {
+    memcpy(copy, String, size);
+  }
+  return copy;
+}
+
+int fputws(const WCHAR *String, FILE *Stream) {
+  size_t size = wcslen(String) * 3 + 1;
+  char *narrow = malloc(size);
+  int result = EOF;
+  if (narrow) {
+    DokanHostUtf16ToUtf8(String, narrow, size);
+    result = fputs(narrow, Stream);
+    free(narrow);
+  }
+  return result;
+}
+
+HRESULT StringCchCopyW(LPWSTR Destination, size_t DestinationCount,
+                       LPCWSTR Source) {
+  if (wcsncpy_s(Destination, DestinationCount, Source, _TRUNCATE) ||
+      wcslen(Source) >= DestinationCount) {
+    return STRSAFE_E_INSUFFICIENT_BUFFER;
+  }
+  return S_OK;
+}
@@ -0,0 +1,46 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_HOST_WIN32_INTERNAL_H_
+#define DOKAN_HOST_WIN32_INTERNAL_H_
+
+#include <windows.h>
+
+#include <time.h>
+
+// Every HANDLE of the shim starts with this header.
+typedef enum _DOKAN_HOST_HANDLE_TYPE {
+  DokanHostHandleEvent = 1,
+  DokanHostHandleFile,
+  DokanHostHandleMapping,
+  DokanHostHandleWait,
+} DOKAN_HOST_HANDLE_TYPE;
+
+typedef struct _DOKAN_HOST_HANDLE {
+  ULONG Type;
+} DOKAN_HOST_HANDLE, *PDOKAN_HOST_HANDLE;
+
+DWORD DokanHostErrorFromErrno(int Error);
+
+// Absolute CLOCK_MONOTONIC time Milliseconds from now.
+void DokanHostDeadline(DWORD Milliseconds, struct timespec *Deadline);
+
+#endif // DOKAN_HOST_WIN32_INTERNAL_H_
@@ -0,0 +1,786 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_HOST_WINDOWS_H_
+#define DOKAN_HOST_WINDOWS_H_
+
+// Subset of the Win32 API used by the library, implemented over POSIX so that
+// the parts that do not need the driver (the loopback benchmark, the event
+// trace replay, the caches and pools) build and run on Linux.
+//
+// It is not a general purpose Windows layer: it only provides what the
+// library uses, with the semantics the library relies on. Must be built with
+// -fshort-wchar so that WCHAR and the L"" literals are UTF-16 like on Windows
+// and the structures shared with the driver keep their layout. The wide
+// string functions of the C library expect 32-bit characters, the ones used
+// by the library are therefore reimplemented and renamed below.
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if __SIZEOF_WCHAR_T__ != 2
+#error The host build requires -fshort-wchar.
+#endif
+
+#define _WIN32_WINNT_WIN10_RS1 0x0A00
+#define _WIN32_WINNT 0x0A00
+#define UNICODE
+#define _UNICODE
+
+/////////////////////////////// Annotations ///////////////////////////////
+
+#define WINAPI
+#define CALLBACK
+#define NTAPI
+#define __stdcall
+#define __cdecl
+#define __declspec(x)
+#define __pragma(x)
+#define FORCEINLINE static inline __attribute__((always_inline))
+#define DECLSPEC_ALIGN(x) __attribute__((aligned(x)))
+#define UNREFERENCED_PARAMETER(P) ((void)(P))
+#define C_ASSERT(e) _Static_assert(e, #e)
+#define CONST const
+#define DUMMYUNIONNAME
+#define DUMMYSTRUCTNAME
+
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Out_opt_
+#define _Inout_
+#define _Inout_opt_
+#define _Out_writes_(x)
+#define _In_reads_(x)
+#define __in
+#define __in_opt
+#define __out
+#define __out_opt
+#define __inout
+#define __inout_opt
+#define __out_bcount(x)
+#define __in_bcount(x)
+
+//////////////////////////////// Base types ////////////////////////////////
+
+#define VOID void
+typedef void *PVOID, *LPVOID;
+typedef const void *LPCVOID;
+typedef char CHAR, *PCHAR, *LPSTR, *PSTR;
+typedef const char *LPCSTR, *PCSTR;
+typedef char CCHAR;
+typedef unsigned char UCHAR, *PUCHAR, BYTE, *PBYTE, *LPBYTE, BOOLEAN,
+    *PBOOLEAN;
+typedef short SHORT, *PSHORT;
+typedef unsigned short USHORT, *PUSHORT, WORD, *PWORD;
+typedef int INT, *PINT, BOOL, *PBOOL, *LPBOOL;
+typedef unsigned int UINT, *PUINT;
+typedef int32_t LONG, *PLONG;
+typedef uint32_t ULONG, *PULONG, DWORD, *PDWORD, *LPDWORD;
+typedef int64_t LONG64, *PLONG64, LONGLONG, *PLONGLONG;
+typedef uint64_t ULONG64, *PULONG64, ULONGLONG, *PULONGLONG, DWORD64,
+    *PDWORD64;
+typedef intptr_t LONG_PTR, *PLONG_PTR;
+typedef uintptr_t ULONG_PTR, *PULONG_PTR, UINT_PTR, DWORD_PTR, *PDWORD_PTR;
+typedef size_t SIZE_T, *PSIZE_T;
+typedef intptr_t SSIZE_T;
+typedef wchar_t WCHAR, *PWCHAR, *LPWSTR, *PWSTR, TCHAR, *LPTSTR;
+typedef const wchar_t *LPCWSTR, *PCWSTR, *LPCTSTR;
+typedef void *HANDLE, **PHANDLE, *HMODULE, *HINSTANCE, *HWND, *HLOCAL;
+typedef LONG NTSTATUS, *PNTSTATUS;
+typedef DWORD ACCESS_MASK, *PACCESS_MASK;
+typedef DWORD SECURITY_INFORMATION, *PSECURITY_INFORMATION;
+typedef void *PSECURITY_DESCRIPTOR, *PSID;
+
+#define TRUE 1
+#define FALSE 0
+#define MAXULONG 0xffffffffUL
+#define MAXLONG 0x7fffffffL
+#define MAXLONGLONG 0x7fffffffffffffffLL
+#define MAXULONGLONG 0xffffffffffffffffULL
+#define MAX_PATH 260
+#define INFINITE 0xFFFFFFFF
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+#define MEMORY_ALLOCATION_ALIGNMENT 16
+#define _T(x) L##x
+#define TEXT(x) L##x
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#define CONTAINING_RECORD(address, type, field)                                \
+  ((type *)((PCHAR)(address) - (ULONG_PTR)(&((type *)0)->field)))
+
+typedef union _LARGE_INTEGER {
+  struct {
+    DWORD LowPart;
+    LONG HighPart;
+  };
+  struct {
+    DWORD LowPart;
+    LONG HighPart;
+  } u;
+  LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef union _ULARGE_INTEGER {
+  struct {
+    DWORD LowPart;
+    DWORD HighPart;
+  };
+  struct {
+    DWORD LowPart;
+    DWORD HighPart;
+  } u;
+  ULONGLONG QuadPart;
+} ULARGE_INTEGER, *PULARGE_INTEGER;
+
+typedef struct _FILETIME {
+  DWORD dwLowDateTime;
+  DWORD dwHighDateTime;
+} FILETIME, *PFILETIME, *LPFILETIME;
+
+typedef struct _GUID {
+  ULONG Data1;
+  USHORT Data2;
+  USHORT Data3;
+  UCHAR Data4[8];
+} GUID;
+
+typedef struct _SECURITY_ATTRIBUTES {
+  DWORD nLength;
+  LPVOID lpSecurityDescriptor;
+  BOOL bInheritHandle;
+} SECURITY_ATTRIBUTES, *PSECURITY_ATTRIBUTES, *LPSECURITY_ATTRIBUTES;
+
+typedef struct _SECURITY_DESCRIPTOR {
+  BYTE Revision;
+  BYTE Sbz1;
+  WORD Control;
+  PSID Owner;
+  PSID Group;
+  PVOID Sacl;
+  PVOID Dacl;
+} SECURITY_DESCRIPTOR, *PISECURITY_DESCRIPTOR;
+
+typedef struct _SID_AND_ATTRIBUTES {
+  PSID Sid;
+  DWORD Attributes;
+} SID_AND_ATTRIBUTES;
+
+typedef struct _TOKEN_USER {
+  SID_AND_ATTRIBUTES User;
+} TOKEN_USER, *PTOKEN_USER;
+
+typedef struct _TOKEN_GROUPS {
+  DWORD GroupCount;
+  SID_AND_ATTRIBUTES Groups[1];
+} TOKEN_GROUPS, *PTOKEN_GROUPS;
+
+typedef enum _TOKEN_INFORMATION_CLASS {
+  TokenUser = 1,
+  TokenGroups,
+} TOKEN_INFORMATION_CLASS;
+
+typedef struct _OVERLAPPED {
+  ULONG_PTR Internal;
+  ULONG_PTR InternalHigh;
+  LARGE_INTEGER Offset;
+  HANDLE hEvent;
+} OVERLAPPED, *LPOVERLAPPED;
+
+typedef struct _WIN32_FIND_DATAW {
+  DWORD dwFileAttributes;
+  FILETIME ftCreationTime;
+  FILETIME ftLastAccessTime;
+  FILETIME ftLastWriteTime;
+  DWORD nFileSizeHigh;
+  DWORD nFileSizeLow;
+  DWORD dwReserved0;
+  DWORD dwReserved1;
+  WCHAR cFileName[MAX_PATH];
+  WCHAR cAlternateFileName[14];
+} WIN32_FIND_DATAW, *PWIN32_FIND_DATAW, *LPWIN32_FIND_DATAW;
+
+typedef struct _WIN32_FIND_STREAM_DATA {
+  LARGE_INTEGER StreamSize;
+  WCHAR cStreamName[MAX_PATH + 36];
+} WIN32_FIND_STREAM_DATA, *PWIN32_FIND_STREAM_DATA;
+
+typedef struct _BY_HANDLE_FILE_INFORMATION {
+  DWORD dwFileAttributes;
+  FILETIME ftCreationTime;
+  FILETIME ftLastAccessTime;
+  FILETIME ftLastWriteTime;
+  DWORD dwVolumeSerialNumber;
+  DWORD nFileSizeHigh;
+  DWORD nFileSizeLow;
+  DWORD nNumberOfLinks;
+  DWORD nFileIndexHigh;
+  DWORD nFileIndexLow;
+} BY_HANDLE_FILE_INFORMATION, *PBY_HANDLE_FILE_INFORMATION,
+    *LPBY_HANDLE_FILE_INFORMATION;
+
+typedef struct _FILE_ID_128 {
+  BYTE Identifier[16];
+} FILE_ID_128, *PFILE_ID_128;
+
+typedef struct _FILE_ID_EXTD_DIR_INFO {
+  ULONG NextEntryOffset;
+  ULONG FileIndex;
+  LARGE_INTEGER CreationTime;
+  LARGE_INTEGER LastAccessTime;
+  LARGE_INTEGER LastWriteTime;
+  LARGE_INTEGER ChangeTime;
+  LARGE_INTEGER EndOfFile;
+  LARGE_INTEGER AllocationSize;
+  ULONG FileAttributes;
+  ULONG FileNameLength;
+  ULONG EaSize;
+  ULONG ReparsePointTag;
+  FILE_ID_128 FileId;
+  WCHAR FileName[1];
+} FILE_ID_EXTD_DIR_INFO, *PFILE_ID_EXTD_DIR_INFO;
+
+//////////////////////////////// Constants ////////////////////////////////
+
+#define DELETE 0x00010000L
+#define READ_CONTROL 0x00020000L
+#define WRITE_DAC 0x00040000L
+#define WRITE_OWNER 0x00080000L
+#define SYNCHRONIZE 0x00100000L
+#define STANDARD_RIGHTS_REQUIRED 0x000F0000L
+#define STANDARD_RIGHTS_READ READ_CONTROL
+#define STANDARD_RIGHTS_WRITE READ_CONTROL
+#define STANDARD_RIGHTS_EXECUTE READ_CONTROL
+#define STANDARD_RIGHTS_ALL 0x001F0000L
+#define ACCESS_SYSTEM_SECURITY 0x01000000L
+#define MAXIMUM_ALLOWED 0x02000000L
+#define GENERIC_READ 0x80000000L
+#define GENERIC_WRITE 0x40000000L
+#define GENERIC_EXECUTE 0x20000000L
+#define GENERIC_ALL 0x10000000L
+
+#define FILE_READ_DATA 0x0001
+#define FILE_LIST_DIRECTORY 0x0001
+#define FILE_WRITE_DATA 0x0002
+#define FILE_ADD_FILE 0x0002
+#define FILE_APPEND_DATA 0x0004
+#define FILE_ADD_SUBDIRECTORY 0x0004
+#define FILE_READ_EA 0x0008
+#define FILE_WRITE_EA 0x0010
+#define FILE_EXECUTE 0x0020
+#define FILE_TRAVERSE 0x0020
+#define FILE_DELETE_CHILD 0x0040
+#define FILE_READ_ATTRIBUTES 0x0080
+#define FILE_WRITE_ATTRIBUTES 0x0100
+#define FILE_ALL_ACCESS (STANDARD_RIGHTS_REQUIRED | SYNCHRONIZE | 0x1FF)
+#define FILE_GENERIC_READ                                                      \
+  (STANDARD_RIGHTS_READ | FILE_READ_DATA | FILE_READ_ATTRIBUTES |              \
+   FILE_READ_EA | SYNCHRONIZE)
+#define FILE_GENERIC_WRITE                                                     \
+  (STANDARD_RIGHTS_WRITE | FILE_WRITE_DATA | FILE_WRITE_ATTRIBUTES |           \
+   FILE_WRITE_EA | FILE_APPEND_DATA | SYNCHRONIZE)
+#define FILE_GENERIC_EXECUTE                                                   \
+  (STANDARD_RIGHTS_EXECUTE | FILE_READ_ATTRIBUTES | FILE_EXECUTE | SYNCHRONIZE)
+
+#define FILE_SHARE_READ 0x00000001
+#define FILE_SHARE_WRITE 0x00000002
+#define FILE_SHARE_DELETE 0x00000004
+
+#define FILE_ATTRIBUTE_READONLY 0x00000001
+#define FILE_ATTRIBUTE_HIDDEN 0x00000002
+#define FILE_ATTRIBUTE_SYSTEM 0x00000004
+#define FILE_ATTRIBUTE_DIRECTORY 0x00000010
+#define FILE_ATTRIBUTE_ARCHIVE 0x00000020
+#define FILE_ATTRIBUTE_DEVICE 0x00000040
+#define FILE_ATTRIBUTE_NORMAL 0x00000080
+#define FILE_ATTRIBUTE_TEMPORARY 0x00000100
+#define FILE_ATTRIBUTE_SPARSE_FILE 0x00000200
+#define FILE_ATTRIBUTE_REPARSE_POINT 0x00000400
+#define FILE_ATTRIBUTE_COMPRESSED 0x00000800
+#define FILE_ATTRIBUTE_OFFLINE 0x00001000
+#define FILE_ATTRIBUTE_NOT_CONTENT_INDEXED 0x00002000
+#define FILE_ATTRIBUTE_ENCRYPTED 0x00004000
+
+#define FILE_FLAG_WRITE_THROUGH 0x80000000
+#define FILE_FLAG_OVERLAPPED 0x40000000
+#define FILE_FLAG_NO_BUFFERING 0x20000000
+#define FILE_FLAG_RANDOM_ACCESS 0x10000000
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define FILE_FLAG_DELETE_ON_CLOSE 0x04000000
+#define FILE_FLAG_BACKUP_SEMANTICS 0x02000000
+#define FILE_FLAG_POSIX_SEMANTICS 0x01000000
+#define FILE_FLAG_SESSION_AWARE 0x00800000
+#define FILE_FLAG_OPEN_REPARSE_POINT 0x00200000
+#define FILE_FLAG_OPEN_NO_RECALL 0x00100000
+
+#define CREATE_NEW 1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define OPEN_ALWAYS 4
+#define TRUNCATE_EXISTING 5
+
+#define FILE_BEGIN 0
+#define FILE_CURRENT 1
+#define FILE_END 2
+
+#define FILE_CASE_SENSITIVE_SEARCH 0x00000001
+#define FILE_CASE_PRESERVED_NAMES 0x00000002
+#define FILE_UNICODE_ON_DISK 0x00000004
+#define FILE_PERSISTENT_ACLS 0x00000008
+#define FILE_SUPPORTS_REMOTE_STORAGE 0x00000100
+#define FILE_NAMED_STREAMS 0x00040000
+#define FILE_READ_ONLY_VOLUME 0x00080000
+
+#define FILE_NOTIFY_CHANGE_FILE_NAME 0x00000001
+#define FILE_NOTIFY_CHANGE_DIR_NAME 0x00000002
+#define FILE_NOTIFY_CHANGE_ATTRIBUTES 0x00000004
+#define FILE_ACTION_ADDED 0x00000001
+#define FILE_ACTION_REMOVED 0x00000002
+#define FILE_ACTION_MODIFIED 0x00000003
+#define FILE_ACTION_RENAMED_OLD_NAME 0x00000004
+#define FILE_ACTION_RENAMED_NEW_NAME 0x00000005
+
+#define FILE_DEVICE_FILE_SYSTEM 0x00000009
+#define FILE_DEVICE_DISK_FILE_SYSTEM 0x00000008
+#define FILE_DEVICE_NETWORK_FILE_SYSTEM 0x00000014
+#define METHOD_BUFFERED 0
+#define METHOD_IN_DIRECT 1
+#define METHOD_OUT_DIRECT 2
+#define METHOD_NEITHER 3
+#define FILE_ANY_ACCESS 0
+#define FILE_SPECIAL_ACCESS FILE_ANY_ACCESS
+#define FILE_READ_ACCESS 0x0001
+#define FILE_WRITE_ACCESS 0x0002
+#define CTL_CODE(DeviceType, Function, Method, Access)                         \
+  (((DeviceType) << 16) | ((Access) << 14) | ((Function) << 2) | (Method))
+
+#define PAGE_READONLY 0x02
+#define FILE_MAP_READ 0x0004
+
+#define OWNER_SECURITY_INFORMATION 0x00000001L
+#define GROUP_SECURITY_INFORMATION 0x00000002L
+#define DACL_SECURITY_INFORMATION 0x00000004L
+#define SACL_SECURITY_INFORMATION 0x00000008L
+#define TOKEN_QUERY 0x0008
+#define TOKEN_READ (STANDARD_RIGHTS_READ | TOKEN_QUERY)
+
+#define DLL_PROCESS_DETACH 0
+#define DLL_PROCESS_ATTACH 1
+#define DLL_THREAD_ATTACH 2
+#define DLL_THREAD_DETACH 3
+
+#define EXCEPTION_NONCONTINUABLE 0x1
+
+#define WAIT_OBJECT_0 0x00000000L
+#define WAIT_ABANDONED 0x00000080L
+#define WAIT_TIMEOUT 0x00000102L
+#define WAIT_FAILED 0xFFFFFFFF
+#define WT_EXECUTEDEFAULT 0x00000000
+#define WT_EXECUTEONLYONCE 0x00000008
+
+#define TLS_OUT_OF_INDEXES ((DWORD)0xFFFFFFFF)
+#define FLS_OUT_OF_INDEXES ((DWORD)0xFFFFFFFF)
+
+// Win32 error codes, see GetLastError.
+#define ERROR_SUCCESS 0L
+#define NO_ERROR 0L
+#define ERROR_INVALID_FUNCTION 1L
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_PATH_NOT_FOUND 3L
+#define ERROR_TOO_MANY_OPEN_FILES 4L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_INVALID_HANDLE 6L
+#define ERROR_NOT_ENOUGH_MEMORY 8L
+#define ERROR_BAD_FORMAT 11L
+#define ERROR_INVALID_DATA 13L
+#define ERROR_OUTOFMEMORY 14L
+#define ERROR_WRITE_FAULT 29L
+#define ERROR_READ_FAULT 30L
+#define ERROR_SHARING_VIOLATION 32L
+#define ERROR_HANDLE_EOF 38L
+#define ERROR_NOT_SUPPORTED 50L
+#define ERROR_FILE_EXISTS 80L
+#define ERROR_INVALID_PARAMETER 87L
+#define ERROR_DISK_FULL 112L
+#define ERROR_CALL_NOT_IMPLEMENTED 120L
+#define ERROR_INSUFFICIENT_BUFFER 122L
+#define ERROR_INVALID_NAME 123L
+#define ERROR_DIR_NOT_EMPTY 145L
+#define ERROR_BUSY 170L
+#define ERROR_ALREADY_EXISTS 183L
+#define ERROR_MORE_DATA 234L
+#define ERROR_NO_MORE_ITEMS 259L
+#define ERROR_DIRECTORY 267L
+#define ERROR_OPERATION_ABORTED 995L
+#define ERROR_IO_PENDING 997L
+#define ERROR_NOACCESS 998L
+#define ERROR_INVALID_FLAGS 1004L
+#define ERROR_ALREADY_INITIALIZED 1247L
+#define ERROR_NO_SYSTEM_RESOURCES 1450L
+#define ERROR_TIMEOUT 1460L
+#define ERROR_NOT_FOUND 1168L
+#define ERROR_INVALID_STATE 5023L
+
+#ifndef WIN32_NO_STATUS
+#include <ntstatus.h>
+#endif
+
+/////////////////////////////////// Lists ///////////////////////////////////
+
+typedef struct _LIST_ENTRY {
+  struct _LIST_ENTRY *Flink;
+  struct _LIST_ENTRY *Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+typedef struct _SINGLE_LIST_ENTRY {
+  struct _SINGLE_LIST_ENTRY *Next;
+} SINGLE_LIST_ENTRY, *PSINGLE_LIST_ENTRY;
+
+typedef struct DECLSPEC_ALIGN(16) _SLIST_ENTRY {
+  struct _SLIST_ENTRY *Next;
+} SLIST_ENTRY, *PSLIST_ENTRY;
+
+// Interlocked singly linked list. The host version serializes the pushes and
+// pops with a spin lock instead of a double-width compare and exchange.
+typedef struct DECLSPEC_ALIGN(16) _SLIST_HEADER {
+  PSLIST_ENTRY Next;
+  volatile LONG Lock;
+  USHORT Depth;
+} SLIST_HEADER, *PSLIST_HEADER;
+
+VOID InitializeSListHead(PSLIST_HEADER ListHead);
+PSLIST_ENTRY InterlockedPushEntrySList(PSLIST_HEADER ListHead,
+                                       PSLIST_ENTRY ListEntry);
+PSLIST_ENTRY InterlockedPopEntrySList(PSLIST_HEADER ListHead);
+PSLIST_ENTRY InterlockedFlushSList(PSLIST_HEADER ListHead);
+USHORT QueryDepthSList(PSLIST_HEADER ListHead);
+
+////////////////////////////// Interlocked //////////////////////////////
+
+// Type generic so that they apply to the 32 and 64-bit integers and pointers
+// alike. They all are full barriers, like on Windows.
+#define DOKAN_HOST_SEQ_CST __ATOMIC_SEQ_CST
+#define InterlockedIncrement(p) __atomic_add_fetch((p), 1, DOKAN_HOST_SEQ_CST)
+#define InterlockedDecrement(p) __atomic_sub_fetch((p), 1, DOKAN_HOST_SEQ_CST)
+#define InterlockedAdd(p, v) __atomic_add_fetch((p), (v), DOKAN_HOST_SEQ_CST)
+#define InterlockedExchangeAdd(p, v)                                           \
+  __atomic_fetch_add((p), (v), DOKAN_HOST_SEQ_CST)
+#define InterlockedExchange(p, v)                                              \
+  __atomic_exchange_n((p), (v), DOKAN_HOST_SEQ_CST)
+#define InterlockedOr(p, v) __atomic_fetch_or((p), (v), DOKAN_HOST_SEQ_CST)
+#define InterlockedAnd(p, v) __atomic_fetch_and((p), (v), DOKAN_HOST_SEQ_CST)
+#define InterlockedCompareExchange(p, Exchange, Comperand)                     \
+  __extension__({                                                              \
+    __auto_type dokanHostComperand = (__typeof__(*(p)))(Comperand);            \
+    __atomic_compare_exchange_n((p), &dokanHostComperand, (Exchange), 0,       \
+                                DOKAN_HOST_SEQ_CST, DOKAN_HOST_SEQ_CST);       \
+    dokanHostComperand;                                                        \
+  })
+#define InterlockedIncrement64 InterlockedIncrement
+#define InterlockedDecrement64 InterlockedDecrement
+#define InterlockedAdd64 InterlockedAdd
+#define InterlockedExchangeAdd64 InterlockedExchangeAdd
+#define InterlockedExchange64 InterlockedExchange
+#define InterlockedCompareExchange64 InterlockedCompareExchange
+#define InterlockedExchangePointer InterlockedExchange
+#define InterlockedCompareExchangePointer(p, Exchange, Comperand)              \
+  __extension__({                                                              \
+    PVOID dokanHostComperand = (PVOID)(Comperand);                             \
+    __atomic_compare_exchange_n((PVOID volatile *)(p), &dokanHostComperand,    \
+                                (PVOID)(Exchange), 0, DOKAN_HOST_SEQ_CST,      \
+                                DOKAN_HOST_SEQ_CST);                           \
+    dokanHostComperand;                                                        \
+  })
+#define MemoryBarrier() __atomic_thread_fence(DOKAN_HOST_SEQ_CST)
+#define YieldProcessor() __builtin_ia32_pause()
+
+/////////////////////////////// Memory ///////////////////////////////
+
+#define RtlCopyMemory(Destination, Source, Length)                             \
+  memcpy((Destination), (Source), (Length))
+#define RtlMoveMemory(Destination, Source, Length)                             \
+  memmove((Destination), (Source), (Length))
+#define RtlFillMemory(Destination, Length, Fill)                               \
+  memset((Destination), (Fill), (Length))
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#define CopyMemory RtlCopyMemory
+#define MoveMemory RtlMoveMemory
+#define FillMemory RtlFillMemory
+#define ZeroMemory RtlZeroMemory
+
+typedef int errno_t;
+typedef size_t rsize_t;
+errno_t memcpy_s(void *Destination, size_t DestinationSize, const void *Source,
+                 size_t Count);
+errno_t memmove_s(void *Destination, size_t DestinationSize,
+                  const void *Source, size_t Count);
+HLOCAL LocalFree(HLOCAL Memory);
+
+//////////////////////////// Synchronization ////////////////////////////
+
+#include <pthread.h>
+
+typedef struct _CRITICAL_SECTION {
+  pthread_mutex_t Mutex;
+} CRITICAL_SECTION, *PCRITICAL_SECTION, *LPCRITICAL_SECTION;
+
+typedef struct _SRWLOCK {
+  pthread_rwlock_t Lock;
+} SRWLOCK, *PSRWLOCK;
+#define SRWLOCK_INIT {PTHREAD_RWLOCK_INITIALIZER}
+
+typedef struct _CONDITION_VARIABLE {
+  pthread_cond_t Condition;
+} CONDITION_VARIABLE, *PCONDITION_VARIABLE;
+
+VOID InitializeCriticalSection(LPCRITICAL_SECTION CriticalSection);
+BOOL InitializeCriticalSectionAndSpinCount(LPCRITICAL_SECTION CriticalSection,
+                                           DWORD SpinCount);
+VOID DeleteCriticalSection(LPCRITICAL_SECTION CriticalSection);
+VOID EnterCriticalSection(LPCRITICAL_SECTION CriticalSection);
+BOOL TryEnterCriticalSection(LPCRITICAL_SECTION CriticalSection);
+VOID LeaveCriticalSection(LPCRITICAL_SECTION CriticalSection);
+
+VOID InitializeSRWLock(PSRWLOCK SRWLock);
+VOID AcquireSRWLockExclusive(PSRWLOCK SRWLock);
+VOID AcquireSRWLockShared(PSRWLOCK SRWLock);
+BOOLEAN TryAcquireSRWLockExclusive(PSRWLOCK SRWLock);
+BOOLEAN TryAcquireSRWLockShared(PSRWLOCK SRWLock);
+VOID ReleaseSRWLockExclusive(PSRWLOCK SRWLock);
+VOID ReleaseSRWLockShared(PSRWLOCK SRWLock);
+
+VOID InitializeConditionVariable(PCONDITION_VARIABLE ConditionVariable);
+BOOL SleepConditionVariableCS(PCONDITION_VARIABLE ConditionVariable,
+                              PCRITICAL_SECTION CriticalSection,
+                              DWORD Milliseconds);
+VOID WakeConditionVariable(PCONDITION_VARIABLE ConditionVariable);
+VOID WakeAllConditionVariable(PCONDITION_VARIABLE ConditionVariable);
+
+HANDLE CreateEventW(LPSECURITY_ATTRIBUTES EventAttributes, BOOL ManualReset,
+                    BOOL InitialState, LPCWSTR Name);
+#define CreateEvent CreateEventW
+BOOL SetEvent(HANDLE Event);
+BOOL ResetEvent(HANDLE Event);
+DWORD WaitForSingleObject(HANDLE Handle, DWORD Milliseconds);
+BOOL CloseHandle(HANDLE Object);
+
+typedef VOID(CALLBACK *WAITORTIMERCALLBACK)(PVOID Parameter,
+                                            BOOLEAN TimerOrWaitFired);
+typedef WAITORTIMERCALLBACK WAITORTIMERCALLBACKFUNC;
+BOOL RegisterWaitForSingleObject(PHANDLE NewWaitObject, HANDLE Object,
+                                 WAITORTIMERCALLBACK Callback, PVOID Context,
+                                 ULONG Milliseconds, ULONG Flags);
+BOOL UnregisterWaitEx(HANDLE WaitHandle, HANDLE CompletionEvent);
+
+////////////////////////// Threads and processes //////////////////////////
+
+typedef VOID(WINAPI *PFLS_CALLBACK_FUNCTION)(PVOID FlsData);
+DWORD FlsAlloc(PFLS_CALLBACK_FUNCTION Callback);
+BOOL FlsFree(DWORD FlsIndex);
+PVOID FlsGetValue(DWORD FlsIndex);
+BOOL FlsSetValue(DWORD FlsIndex, PVOID FlsData);
+DWORD TlsAlloc(void);
+BOOL TlsFree(DWORD TlsIndex);
+LPVOID TlsGetValue(DWORD TlsIndex);
+BOOL TlsSetValue(DWORD TlsIndex, LPVOID TlsValue);
+
+DWORD GetLastError(void);
+VOID SetLastError(DWORD ErrCode);
+VOID Sleep(DWORD Milliseconds);
+BOOL SwitchToThread(void);
+HANDLE GetCurrentProcess(void);
+DWORD GetCurrentProcessId(void);
+DWORD GetCurrentThreadId(void);
+BOOL GetProcessAffinityMask(HANDLE Process, PDWORD_PTR ProcessAffinityMask,
+                            PDWORD_PTR SystemAffinityMask);
+__attribute__((noreturn)) VOID RaiseException(DWORD ExceptionCode,
+                                              DWORD ExceptionFlags,
+                                              DWORD NumberOfArguments,
+                                              const ULONG_PTR *Arguments);
+HMODULE LoadLibraryW(LPCWSTR LibFileName);
+#define LoadLibrary LoadLibraryW
+BOOL FreeLibrary(HMODULE LibModule);
+
+BOOL OpenProcessToken(HANDLE ProcessHandle, DWORD DesiredAccess,
+                      PHANDLE TokenHandle);
+BOOL GetTokenInformation(HANDLE TokenHandle,
+                         TOKEN_INFORMATION_CLASS TokenInformationClass,
+                         LPVOID TokenInformation, DWORD TokenInformationLength,
+                         PDWORD ReturnLength);
+
+////////////////////////////////// Time //////////////////////////////////
+
+ULONGLONG GetTickCount64(void);
+DWORD GetTickCount(void);
+BOOL QueryPerformanceCounter(LARGE_INTEGER *PerformanceCount);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *Frequency);
+VOID GetSystemTimeAsFileTime(LPFILETIME SystemTimeAsFileTime);
+
+////////////////////////////////// Files //////////////////////////////////
+
+HANDLE CreateFileW(LPCWSTR FileName, DWORD DesiredAccess, DWORD ShareMode,
+                   LPSECURITY_ATTRIBUTES SecurityAttributes,
+                   DWORD CreationDisposition, DWORD FlagsAndAttributes,
+                   HANDLE TemplateFile);
+#define CreateFile CreateFileW
+BOOL ReadFile(HANDLE File, LPVOID Buffer, DWORD NumberOfBytesToRead,
+              LPDWORD NumberOfBytesRead, LPOVERLAPPED Overlapped);
+BOOL WriteFile(HANDLE File, LPCVOID Buffer, DWORD NumberOfBytesToWrite,
+               LPDWORD NumberOfBytesWritten, LPOVERLAPPED Overlapped);
+BOOL FlushFileBuffers(HANDLE File);
+BOOL GetFileSizeEx(HANDLE File, PLARGE_INTEGER FileSize);
+BOOL DeleteFileW(LPCWSTR FileName);
+HANDLE CreateFileMappingW(HANDLE File,
+                          LPSECURITY_ATTRIBUTES FileMappingAttributes,
+                          DWORD Protect, DWORD MaximumSizeHigh,
+                          DWORD MaximumSizeLow, LPCWSTR Name);
+LPVOID MapViewOfFile(HANDLE FileMappingObject, DWORD DesiredAccess,
+                     DWORD FileOffsetHigh, DWORD FileOffsetLow,
+                     SIZE_T NumberOfBytesToMap);
+BOOL UnmapViewOfFile(LPCVOID BaseAddress);
+BOOL DeviceIoControl(HANDLE Device, DWORD IoControlCode, LPVOID InBuffer,
+                     DWORD InBufferSize, LPVOID OutBuffer, DWORD OutBufferSize,
+                     LPDWORD BytesReturned, LPOVERLAPPED Overlapped);
+DWORD QueryDosDeviceW(LPCWSTR DeviceName, LPWSTR TargetPath, DWORD Max);
+#define QueryDosDevice QueryDosDeviceW
+DWORD GetLogicalDrives(void);
+
+///////////////////////////////// Debugging /////////////////////////////////
+
+VOID OutputDebugStringA(LPCSTR OutputString);
+VOID OutputDebugStringW(LPCWSTR OutputString);
+
+////////////////////////////////// Bits //////////////////////////////////
+
+static inline BOOLEAN DokanHostBitScanReverse(ULONG *Index, ULONG64 Mask) {
+  if (!Mask) {
+    return FALSE;
+  }
+  *Index = 63 - __builtin_clzll(Mask);
+  return TRUE;
+}
+
+// The index can be an unsigned long, 64-bit on the host.
+#define _BitScanReverse(Index, Mask)                                           \
+  __extension__({                                                              \
+    ULONG dokanHostIndex = 0;                                                  \
+    BOOLEAN dokanHostFound =                                                   \
+        DokanHostBitScanReverse(&dokanHostIndex, (ULONG)(Mask));               \
+    *(Index) = dokanHostIndex;                                                 \
+    dokanHostFound;                                                            \
+  })
+#define _BitScanReverse64(Index, Mask)                                         \
+  __extension__({                                                              \
+    ULONG dokanHostIndex = 0;                                                  \
+    BOOLEAN dokanHostFound =                                                   \
+        DokanHostBitScanReverse(&dokanHostIndex, (ULONG64)(Mask));             \
+    *(Index) = dokanHostIndex;                                                 \
+    dokanHostFound;                                                            \
+  })
+
+///////////////////////////// Wide strings /////////////////////////////
+
+// UTF-16 versions of the C library functions, see the top of the file.
+#define wcslen DokanHostWcslen
+#define wcsnlen DokanHostWcsnlen
+#define wcscmp DokanHostWcscmp
+#define wcsncmp DokanHostWcsncmp
+#define wcschr DokanHostWcschr
+#define wcsstr DokanHostWcsstr
+#define wcscpy_s DokanHostWcscpy_s
+#define wcsncpy_s DokanHostWcsncpy_s
+#define wcscat_s DokanHostWcscat_s
+#define _wcsdup DokanHostWcsdup
+#define _wcsicmp DokanHostWcsicmp
+#define fputws DokanHostFputws
+#define swprintf_s DokanHostSwprintf_s
+#define vswprintf_s DokanHostVswprintf_s
+#define _vscwprintf DokanHostVscwprintf
+#define _TRUNCATE ((size_t)-1)
+
+size_t wcslen(const WCHAR *String);
+size_t wcsnlen(const WCHAR *String, size_t MaxCount);
+int wcscmp(const WCHAR *String1, const WCHAR *String2);
+int wcsncmp(const WCHAR *String1, const WCHAR *String2, size_t Count);
+int _wcsicmp(const WCHAR *String1, const WCHAR *String2);
+WCHAR *wcschr(const WCHAR *String, WCHAR Char);
+WCHAR *wcsstr(const WCHAR *String, const WCHAR *SubString);
+errno_t wcscpy_s(WCHAR *Destination, size_t DestinationSize,
+                 const WCHAR *Source);
+errno_t wcsncpy_s(WCHAR *Destination, size_t DestinationSize,
+                  const WCHAR *Source, size_t Count);
+errno_t wcscat_s(WCHAR *Destination, size_t DestinationSize,
+                 const WCHAR *Source);
+WCHAR *_wcsdup(const WCHAR *String);
+int fputws(const WCHAR *String, FILE *Stream);
+
+// The formats follow the Microsoft conventions: l is 32-bit, ll and I64 are
+// 64-bit, and %s is a wide string in the wide functions.
+int swprintf_s(WCHAR *Buffer, size_t BufferCount, const WCHAR *Format, ...);
+int vswprintf_s(WCHAR *Buffer, size_t BufferCount, const WCHAR *Format,
+                va_list ArgList);
+int _vscwprintf(const WCHAR *Format, va_list ArgList);
+int _vscprintf(const char *Format, va_list ArgList);
+int vsprintf_s(char *Buffer, size_t BufferCount, const char *Format,
+               va_list ArgList);
+int sprintf_s(char *Buffer, size_t BufferCount, const char *Format, ...);
+#define snprintf DokanHostSnprintf
+int snprintf(char *Buffer, size_t BufferCount, const char *Format, ...);
+#define printf DokanHostPrintf
+int printf(const char *Format, ...);
+#define fprintf DokanHostFprintf
+int fprintf(FILE *Stream, const char *Format, ...);
+
+// Converts between UTF-16 and UTF-8. Returns the number of units written,
+// terminator excluded, or -1 if Destination is too small.
+int DokanHostUtf16ToUtf8(const WCHAR *Source, char *Destination,
+                         size_t DestinationSize);
+int DokanHostUtf8ToUtf16(const char *Source, WCHAR *Destination,
+                         size_t DestinationCount);
+
+#define _malloca(size) malloc(size)
+#define _freea(memory) free(memory)
+void *_aligned_malloc(size_t Size, size_t Alignment);
+void _aligned_free(void *Memory);
+
+#include <threadpoolapiset.h>
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DOKAN_HOST_WINDOWS_H_
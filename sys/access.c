@@ -26,9 +26,9 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 NTSTATUS
 DokanGetAccessToken(__in PREQUEST_CONTEXT RequestContext) {
   KIRQL oldIrql = 0;
-  PLIST_ENTRY thisEntry, nextEntry, listHead;
   PIRP_ENTRY irpEntry;
   PEVENT_INFORMATION eventInfo = NULL;
+  PIRP_LIST pendingIrp = NULL;
   PACCESS_TOKEN accessToken;
   NTSTATUS status = STATUS_INVALID_PARAMETER;
   HANDLE handle;
@@ -53,32 +53,21 @@ DokanGetAccessToken(__in PREQUEST_CONTEXT RequestContext) {
       __leave;
     }
 
+    pendingIrp =
+        DokanGetPendingIrpList(RequestContext->Dcb, eventInfo->SerialNumber);
     ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
-    KeAcquireSpinLock(&RequestContext->Dcb->PendingIrp.ListLock, &oldIrql);
+    KeAcquireSpinLock(&pendingIrp->ListLock, &oldIrql);
     hasLock = TRUE;
 
-    // search corresponding IRP through pending IRP list
-    listHead = &RequestContext->Dcb->PendingIrp.ListHead;
-
-    for (thisEntry = listHead->Flink; thisEntry != listHead;
-         thisEntry = nextEntry) {
-
-      nextEntry = thisEntry->Flink;
-
-      irpEntry = CONTAINING_RECORD(thisEntry, IRP_ENTRY, ListEntry);
-
-      if (irpEntry->SerialNumber != eventInfo->SerialNumber) {
-        continue;
-      }
-
-      // this irp must be IRP_MJ_CREATE
-      if (irpEntry->RequestContext.IrpSp->Parameters.Create.SecurityContext) {
-        accessState = irpEntry->RequestContext.IrpSp->Parameters.Create
-                          .SecurityContext->AccessState;
-      }
-      break;
+    // search corresponding IRP through pending IRP table
+    irpEntry = DokanFindIrpEntry(pendingIrp, eventInfo->SerialNumber);
+    // this irp must be IRP_MJ_CREATE
+    if (irpEntry != NULL &&
+        irpEntry->RequestContext.IrpSp->Parameters.Create.SecurityContext) {
+      accessState = irpEntry->RequestContext.IrpSp->Parameters.Create
+                        .SecurityContext->AccessState;
     }
-    KeReleaseSpinLock(&RequestContext->Dcb->PendingIrp.ListLock, oldIrql);
+    KeReleaseSpinLock(&pendingIrp->ListLock, oldIrql);
     hasLock = FALSE;
 
     if (accessState == NULL) {
@@ -108,7 +97,7 @@ DokanGetAccessToken(__in PREQUEST_CONTEXT RequestContext) {
 
   } __finally {
     if (hasLock) {
-      KeReleaseSpinLock(&RequestContext->Dcb->PendingIrp.ListLock, oldIrql);
+      KeReleaseSpinLock(&pendingIrp->ListLock, oldIrql);
     }
   }
   return status;
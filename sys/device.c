@@ -713,6 +713,29 @@ NTSTATUS DokanGetVolumeMetrics(__in PREQUEST_CONTEXT RequestContext) {
   DokanVCBLockRO(RequestContext->Vcb);
   *outputBuffer = RequestContext->Vcb->VolumeMetrics;
   DokanVCBUnlock(RequestContext->Vcb);
+  outputBuffer->EventContext512BLookasideHits =
+      DokanGetEventContextLookasideHits(0);
+  outputBuffer->EventContext512BLookasideMisses =
+      InterlockedCompareExchange64(&g_DokanEventContextLookasideMisses[0], 0,
+                                   0);
+  outputBuffer->EventContext1KBLookasideHits =
+      DokanGetEventContextLookasideHits(1);
+  outputBuffer->EventContext1KBLookasideMisses =
+      InterlockedCompareExchange64(&g_DokanEventContextLookasideMisses[1], 0,
+                                   0);
+  outputBuffer->EventContext4KBLookasideHits =
+      DokanGetEventContextLookasideHits(2);
+  outputBuffer->EventContext4KBLookasideMisses =
+      InterlockedCompareExchange64(&g_DokanEventContextLookasideMisses[2], 0,
+                                   0);
+  outputBuffer->EventContext32KBLookasideHits =
+      DokanGetEventContextLookasideHits(3);
+  outputBuffer->EventContext32KBLookasideMisses =
+      InterlockedCompareExchange64(&g_DokanEventContextLookasideMisses[3], 0,
+                                   0);
+  outputBuffer->EventContextOverflowAllocations = InterlockedCompareExchange64(
+      &g_DokanEventContextAllocations[DOKAN_EVENT_CONTEXT_OVERFLOW_SIZE_CLASS],
+      0, 0);
   return STATUS_SUCCESS;
 }
 
@@ -245,10 +245,6 @@ Return Value:
 
   UNREFERENCED_PARAMETER(RegistryPath);
 
-  // Initialize log entry list first before any log.
-  InitializeListHead(&g_DokanLogEntryList.Log);
-  ExInitializeResourceLite(&g_DokanLogEntryList.Resource);
-
 #ifdef DEBUG_
   DOKAN_LOG_("ver.%x, %s %s", DOKAN_DRIVER_VERSION, __DATE__,
             __TIME__);
@@ -353,6 +349,15 @@ Return Value:
     return STATUS_INSUFFICIENT_RESOURCES;
   }
 
+  if (!DokanInitializeEventContextLookasideLists()) {
+    DOKAN_LOG("DokanInitializeEventContextLookasideLists failed");
+    CleanupGlobalDiskDevice(dokanGlobal);
+    ExDeleteLookasideListEx(&g_DokanCCBLookasideList);
+    ExDeleteLookasideListEx(&g_DokanFCBLookasideList);
+    ExDeleteLookasideListEx(&g_DokanEResourceLookasideList);
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+
   // Detect if we are running on a older version than NTDDI_WIN10_RS4
   // needing to fix FileName during Reparse MountPoint.
   g_FixFileNameForReparseMountPoint =
@@ -399,6 +404,8 @@ Return Value:
   ExDeleteLookasideListEx(&g_DokanCCBLookasideList);
   ExDeleteLookasideListEx(&g_DokanFCBLookasideList);
   ExDeleteLookasideListEx(&g_DokanEResourceLookasideList);
+  DokanDeleteEventContextLookasideLists();
+  DokanDeleteTraceRings();
 
   DOKAN_LOG("All resources released");
 }
@@ -35,6 +35,10 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "public.h"
 #include "util/log.h"
+#include "util/serial_table.h"
+#include "util/timer_wheel.h"
+#include "util/hash_table.h"
+#include "util/trace_ring.h"
 
 //
 // DEFINES
@@ -127,7 +131,36 @@ extern ULONG DokanMdlSafePriority;
 #define DOKAN_IRP_PENDING_TIMEOUT_RESET_MAX (1000 * 60 * 5) // in millisecond
 #define DOKAN_CHECK_INTERVAL (1000 * 5)                     // in millisecond
 
+// Maximum number of shards of the pending IRP list of a volume. Must be a
+// power of 2.
+#define DOKAN_MAX_PENDING_IRP_SHARD_COUNT 16
+
+// Number of buckets of the FCB table of a volume before it grows. Must be a
+// power of 2.
+#define DOKAN_FCB_TABLE_INITIAL_BUCKET_COUNT 256
+
+// Number of generations of garbage FCBs. A garbage FCB survives between
+// DOKAN_FCB_GARBAGE_GENERATION_COUNT - 1 and DOKAN_FCB_GARBAGE_GENERATION_COUNT
+// GC intervals before deletion.
+#define DOKAN_FCB_GARBAGE_GENERATION_COUNT 2
+
 extern NPAGED_LOOKASIDE_LIST DokanIrpEntryLookasideList;
+// Number of size classes of the event context allocations. Each one is backed
+// by a lookaside list, and the larger contexts are allocated from the pool
+// directly.
+#define DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT 4
+#define DOKAN_EVENT_CONTEXT_OVERFLOW_SIZE_CLASS                                \
+  DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT
+
+// Number of event contexts allocated from each size class, followed by the
+// number of overflowing ones, across all volumes.
+extern LONG64
+    g_DokanEventContextAllocations[DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT + 1];
+// Number of allocations of each size class that found its lookaside list
+// empty and went to the pool.
+extern LONG64
+    g_DokanEventContextLookasideMisses[DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT];
+
 #define DokanAllocateIrpEntry()                                                \
   ExAllocateFromNPagedLookasideList(&DokanIrpEntryLookasideList)
 #define DokanFreeIrpEntry(IrpEntry)                                            \
@@ -180,6 +213,11 @@ typedef struct _IRP_LIST {
   BOOLEAN EventEnabled;
   KEVENT NotEmpty;
   KSPIN_LOCK ListLock;
+  // Optional index of the entries having a serial number, protected by
+  // ListLock.
+  PDOKAN_SERIAL_TABLE SerialTable;
+  // Optional timer wheel of the entry timeouts, protected by ListLock.
+  PDOKAN_TIMER_WHEEL TimerWheel;
 } IRP_LIST, *PIRP_LIST;
 
 typedef struct _DOKAN_GLOBAL {
@@ -220,8 +258,16 @@ typedef struct _DokanDiskControlBlock {
 
   PVOID Vcb;
 
-  // Pending IRPs
-  IRP_LIST PendingIrp;
+  // Pending IRPs, sharded by serial number so that concurrent requests do not
+  // all contend on the same list lock. Only the first PendingIrpShardCount
+  // shards are used. See DokanGetPendingIrpList.
+  IRP_LIST PendingIrp[DOKAN_MAX_PENDING_IRP_SHARD_COUNT];
+  // Power of 2 set at creation and constant afterwards.
+  ULONG PendingIrpShardCount;
+  // Pending IRPs by serial number, used to find the IRP of a reply.
+  DOKAN_SERIAL_TABLE PendingIrpSerialTable[DOKAN_MAX_PENDING_IRP_SHARD_COUNT];
+  // Pending IRPs by timeout, used to only visit the timed out IRPs.
+  DOKAN_TIMER_WHEEL PendingIrpTimerWheel[DOKAN_MAX_PENDING_IRP_SHARD_COUNT];
   // Pending IRPs waiting to be dispatched to userland
   IRP_LIST NotifyEvent;
   LIST_ENTRY NotifyIrpEventQueueList;
@@ -290,6 +336,9 @@ typedef struct _DokanDiskControlBlock {
   // strictly one for each DeviceIoControl that the DLL issues to fetch a
   // request.
   BOOLEAN AllowIpcBatching;
+  // Omit the file name from the read, write, flush and query information
+  // events of the opens that already sent the current one.
+  BOOLEAN OmitIoEventFileNames;
 
   // How often to garbage-collect FCBs. If this is 0, we use the historical
   // default behavior of freeing them on the spot and in the current context
@@ -370,18 +419,21 @@ typedef struct _DokanVolumeControlBlock {
   PDEVICE_OBJECT DeviceObject;
   PDokanDCB Dcb;
 
-  // Avl Table storing the DokanFCB instances.
-  RTL_AVL_TABLE FcbTable;
-  // Lookaside list for the FCB Avl table node containing the Avl header and a
-  // pointer to our DokanFCB that is allocated by the global fcb lookaside list.
-  LOOKASIDE_LIST_EX FCBAvlNodeLookasideList;
-  // Whether the lookaside list was initialized.
-  BOOLEAN FCBAvlNodeLookasideListInit;
+  // Hash table storing the DokanFCB instances, keyed by the hash of their
+  // FileName case-folded unless the volume is case sensitive.
+  DOKAN_HASH_TABLE FcbTable;
+  // Buckets of FcbTable until it grows and gets allocated ones.
+  PDOKAN_HASH_TABLE_LINK
+      FcbTableInitialBuckets[DOKAN_FCB_TABLE_INITIAL_BUCKET_COUNT];
 
   // NotifySync is used by notify directory change
   PNOTIFY_SYNC NotifySync;
   LIST_ENTRY DirNotifyList;
 
+  // Position of the volume in each trace ring when it dispatches the driver
+  // logs, NULL otherwise. See DokanAllocateTraceCursors.
+  PDOKAN_TRACE_RING_CURSOR TraceCursors;
+
   LONG FcbAllocated;
   LONG FcbFreed;
   LONG CcbAllocated;
@@ -400,8 +452,23 @@ typedef struct _DokanVolumeControlBlock {
   BOOLEAN IsKeepaliveActive;
 
   PKTHREAD FcbGarbageCollectorThread;
-  LIST_ENTRY FcbGarbageList;
+  // The FCBs scheduled for garbage collection, bucketed by the GC interval in
+  // which they got scheduled. New garbage goes in the current generation, and
+  // each normal pass only deletes the oldest one before reusing it as the
+  // current one. All of this is guarded by the VCB lock.
+  LIST_ENTRY FcbGarbageGenerations[DOKAN_FCB_GARBAGE_GENERATION_COUNT];
+  ULONG FcbGarbageCurrentGeneration;
+  ULONG FcbGarbageCount;
   KEVENT FcbGarbageListNotEmpty;
+  // The GC interval currently in use, which is shortened down to
+  // MIN_FCB_GARBAGE_COLLECTION_INTERVAL under FCB allocation pressure and
+  // grows back to Dcb->FcbGarbageCollectionIntervalMs otherwise. Owned by the
+  // garbage collector thread.
+  ULONG FcbGarbageCollectionIntervalMs;
+  // The FCB allocation and forced GC metrics at the last normal pass, used to
+  // measure the pressure over the last interval.
+  ULONG64 FcbAllocationsAtLastGarbagePass;
+  ULONG64 ForcedFcbGarbagePassesAtLastGarbagePass;
 
   VOLUME_METRICS VolumeMetrics;
 } DokanVCB, *PDokanVCB;
@@ -498,10 +565,15 @@ typedef struct _DokanFileControlBlock {
   // Modifications must lock the VCB followed by the FCB. Reads may
   // lock either one.
   UNICODE_STRING FileName;
+  // Incremented each time FileName changes. Locking: same as FileName.
+  ULONG FileNameGeneration;
 
   // Locking: FsRtl routines should be enough after initialization.
   FILE_LOCK FileLock;
 
+  // Entry of this FCB in the VCB FcbTable, guarded by the VCB lock.
+  DOKAN_HASH_TABLE_LINK FcbTableLink;
+
   //
   //  The following field is used by the oplock module
   //  to maintain current oplock information for < NTDDI_WIN8.
@@ -547,16 +619,11 @@ typedef struct _DokanFileControlBlock {
   // guarded by the VCB lock.
   LIST_ENTRY NextGarbageCollectableFcb;
 
-  // Used only when FCB garbage collection is enabled, to ensure that the FCB
-  // has been scheduled for deletion long enough to actually delete it. This is
-  // owned by the VCB and guarded by the VCB lock.
-  BOOLEAN GarbageCollectionGracePeriodPassed;
-
-  // The Fcb was removed from the Avl table and is waiting to be deleted when
+  // The Fcb was removed from the FCB table and is waiting to be deleted when
   // all existing handles are being closed. This can happen when a file is
   // renamed with the destination having an open handle. NTFS denies this action
   // but due to a Dokan bug, this is actually possible. Until it is fixed, we
-  // reproduce the behavior prior to the Avl table.
+  // reproduce the behavior prior to the FCB table.
   BOOLEAN ReplacedByRename;
 } DokanFCB, *PDokanFCB;
 
@@ -758,6 +825,12 @@ typedef struct _DokanContextControlBlock {
 
   // The process that created the CCB, for debugging purposes.
   HANDLE ProcessId;
+
+  // The latest FileNameGeneration of the FCB that user mode acknowledged
+  // receiving the file name of for this open. See
+  // DokanGetIoEventFileNameLength.
+  // Locking: Interlocked, see DokanAcknowledgeIoEventFileName.
+  volatile LONG FileNameGeneration;
 } DokanCCB, *PDokanCCB;
 
 //
@@ -812,12 +885,18 @@ typedef struct _REQUEST_CONTEXT {
 // this structure is also used to store event notification IRP
 typedef struct _IRP_ENTRY {
   LIST_ENTRY ListEntry;
+  DOKAN_SERIAL_TABLE_LINK SerialLink;
+  DOKAN_TIMER_WHEEL_LINK TimerLink;
   ULONG SerialNumber;
   REQUEST_CONTEXT RequestContext;
   BOOLEAN CancelRoutineFreeMemory;
   NTSTATUS AsyncStatus;
   LARGE_INTEGER TickCount;
   PIRP_LIST IrpList;
+  // Reply of the IRP while DokanCompleteIrp completes it.
+  PEVENT_INFORMATION EventInfo;
+  // The FileNameGeneration of the event, acknowledged by its reply.
+  ULONG FileNameGeneration;
 } IRP_ENTRY, *PIRP_ENTRY;
 
 typedef struct _DEVICE_ENTRY {
@@ -831,6 +910,9 @@ typedef struct _DEVICE_ENTRY {
 
 typedef struct _DRIVER_EVENT_CONTEXT {
   LIST_ENTRY ListEntry;
+  // The size class it was allocated from, or
+  // DOKAN_EVENT_CONTEXT_OVERFLOW_SIZE_CLASS.
+  ULONG SizeClass;
   EVENT_CONTEXT EventContext;
 } DRIVER_EVENT_CONTEXT, *PDRIVER_EVENT_CONTEXT;
 
@@ -1005,12 +1087,29 @@ AllocateEventContext(__in PREQUEST_CONTEXT RequestContext,
 
 VOID DokanFreeEventContext(__in PEVENT_CONTEXT EventContext);
 
+BOOLEAN DokanInitializeEventContextLookasideLists(VOID);
+
+VOID DokanDeleteEventContextLookasideLists(VOID);
+
+// Number of allocations of the size class served by its lookaside list.
+ULONG64 DokanGetEventContextLookasideHits(__in ULONG SizeClass);
+
 NTSTATUS
 DokanRegisterPendingIrp(__in PREQUEST_CONTEXT RequestContext,
                         __in PEVENT_CONTEXT EventContext);
 
 VOID DokanRegisterPendingRetryIrp(__in PREQUEST_CONTEXT RequestContext);
 
+// Removes the entry from its IRP list. The list lock must be held.
+VOID DokanRemoveIrpEntry(__in PIRP_ENTRY IrpEntry);
+
+// Returns the shard of the pending IRP list holding the IRP with SerialNumber.
+PIRP_LIST DokanGetPendingIrpList(__in PDokanDCB Dcb, __in ULONG SerialNumber);
+
+// Returns the entry of the indexed IRP list registered with SerialNumber, or
+// NULL. The list lock must be held.
+PIRP_ENTRY DokanFindIrpEntry(__in PIRP_LIST IrpList, __in ULONG SerialNumber);
+
 VOID DokanRegisterAsyncCreateFailure(__in PREQUEST_CONTEXT RequestContext,
                                      __in NTSTATUS Status);
 
@@ -1077,6 +1176,7 @@ DokanCreateDiskDevice(__in PDRIVER_OBJECT DriverObject, __in ULONG MountId,
                       __in DEVICE_TYPE DeviceType,
                       __in ULONG DeviceCharacteristics,
                       __in BOOLEAN MountGlobally, __in BOOLEAN UseMountManager,
+                      __in ULONG PendingIrpShardCount,
                       __out PDOKAN_CONTROL DokanControl);
 
 VOID DokanInitVpb(__in PVPB Vpb, __in PDEVICE_OBJECT VolumeDevice);
@@ -1162,6 +1262,13 @@ VOID DokanStopEventNotificationThread(__in PDokanDCB Dcb);
 
 VOID DokanUpdateTimeout(__out PLARGE_INTEGER KickCount, __in ULONG Timeout);
 
+// Converts a tick count to the time unit of the IRP timer wheels.
+ULONGLONG DokanTickCountToTimerWheelTime(__in PLARGE_INTEGER TickCount);
+
+// Puts the entry in the timer wheel of its IRP list according to its current
+// TickCount. The list lock must be held.
+VOID DokanScheduleIrpTimeout(__in PIRP_ENTRY IrpEntry);
+
 VOID DokanUnmount(__in_opt PREQUEST_CONTEXT RequestContext, __in PDokanDCB Dcb);
 
 BOOLEAN IsUnmountPending(__in PDEVICE_OBJECT DeviceObject);
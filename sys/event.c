@@ -84,7 +84,7 @@ VOID DokanIrpCancelRoutine(_Inout_ PDEVICE_OBJECT DeviceObject,
 
     serialNumber = irpEntry->SerialNumber;
 
-    RemoveEntryList(&irpEntry->ListEntry);
+    DokanRemoveIrpEntry(irpEntry);
     InitializeListHead(&irpEntry->ListEntry);
 
     DOKAN_LOG_("Cancel [%s][%s] FileObject=%p",
@@ -217,8 +217,12 @@ RegisterPendingIrpMain(__in PREQUEST_CONTEXT RequestContext,
   RtlZeroMemory(irpEntry, sizeof(IRP_ENTRY));
 
   InitializeListHead(&irpEntry->ListEntry);
+  DokanSerialTableInitializeLink(&irpEntry->SerialLink);
+  DokanTimerWheelInitializeLink(&irpEntry->TimerLink);
 
-  irpEntry->SerialNumber = 0;
+  irpEntry->SerialNumber = EventContext ? EventContext->SerialNumber : 0;
+  irpEntry->FileNameGeneration =
+      EventContext ? EventContext->FileNameGeneration : 0;
   irpEntry->RequestContext = *RequestContext;
   irpEntry->IrpList = IrpList;
   irpEntry->AsyncStatus = CurrentStatus;
@@ -246,11 +250,6 @@ RegisterPendingIrpMain(__in PREQUEST_CONTEXT RequestContext,
     return STATUS_NO_SUCH_DEVICE;
   }
 
-  if (EventContext) {
-    EventContext->SerialNumber =
-        InterlockedIncrement((LONG*)&RequestContext->Dcb->SerialNumber);
-    irpEntry->SerialNumber = EventContext->SerialNumber;
-  }
   if (RequestContext->IrpSp->MajorFunction == IRP_MJ_CREATE) {
     IoSetCancelRoutine(RequestContext->Irp, DokanCreateIrpCancelRoutine);
   } else {
@@ -268,6 +267,11 @@ RegisterPendingIrpMain(__in PREQUEST_CONTEXT RequestContext,
   IoMarkIrpPending(RequestContext->Irp);
 
   InsertTailList(&IrpList->ListHead, &irpEntry->ListEntry);
+  if (IrpList->SerialTable && irpEntry->SerialNumber) {
+    DokanSerialTableInsert(IrpList->SerialTable, &irpEntry->SerialLink,
+                           irpEntry->SerialNumber);
+  }
+  DokanScheduleIrpTimeout(irpEntry);
 
   irpEntry->CancelRoutineFreeMemory = FALSE;
 
@@ -284,6 +288,31 @@ RegisterPendingIrpMain(__in PREQUEST_CONTEXT RequestContext,
   return STATUS_PENDING;
 }
 
+VOID DokanRemoveIrpEntry(__in PIRP_ENTRY IrpEntry) {
+  RemoveEntryList(&IrpEntry->ListEntry);
+  if (IrpEntry->IrpList->SerialTable) {
+    DokanSerialTableRemove(IrpEntry->IrpList->SerialTable,
+                           &IrpEntry->SerialLink);
+  }
+  if (IrpEntry->IrpList->TimerWheel) {
+    DokanTimerWheelRemove(IrpEntry->IrpList->TimerWheel, &IrpEntry->TimerLink);
+  }
+}
+
+PIRP_LIST DokanGetPendingIrpList(__in PDokanDCB Dcb, __in ULONG SerialNumber) {
+  return &Dcb->PendingIrp[SerialNumber & (Dcb->PendingIrpShardCount - 1)];
+}
+
+PIRP_ENTRY DokanFindIrpEntry(__in PIRP_LIST IrpList, __in ULONG SerialNumber) {
+  PDOKAN_SERIAL_TABLE_LINK link;
+  ASSERT(IrpList->SerialTable != NULL);
+  link = DokanSerialTableFind(IrpList->SerialTable, SerialNumber);
+  if (link == NULL) {
+    return NULL;
+  }
+  return CONTAINING_RECORD(link, IRP_ENTRY, SerialLink);
+}
+
 NTSTATUS
 DokanRegisterPendingIrp(__in PREQUEST_CONTEXT RequestContext,
                         __in PEVENT_CONTEXT EventContext) {
@@ -310,8 +339,14 @@ DokanRegisterPendingIrp(__in PREQUEST_CONTEXT RequestContext,
                            L"IRP %xh, canceling it.",
                            RequestContext->IrpSp->MajorFunction);
   } else {
+    // The serial number picks the shard of the pending IRP list, so it is
+    // assigned before registering.
+    EventContext->SerialNumber =
+        InterlockedIncrement((LONG*)&RequestContext->Dcb->SerialNumber);
     status = RegisterPendingIrpMain(RequestContext, EventContext,
-                                    &RequestContext->Dcb->PendingIrp,
+                                    DokanGetPendingIrpList(
+                                        RequestContext->Dcb,
+                                        EventContext->SerialNumber),
                                     /*CheckMount=*/TRUE,
                                     /*CurrentStatus=*/STATUS_SUCCESS);
   }
@@ -352,7 +387,8 @@ VOID DokanRegisterAsyncCreateFailure(__in PREQUEST_CONTEXT RequestContext,
     return;
   }
   RegisterPendingIrpMain(RequestContext, /*EventContext=*/NULL,
-                         &RequestContext->Dcb->PendingIrp,
+                         DokanGetPendingIrpList(RequestContext->Dcb,
+                                                /*SerialNumber=*/0),
                          /*CheckMount=*/TRUE, /*CurrentStatus=*/Status);
   KeSetEvent(&RequestContext->Dcb->ForceTimeoutEvent, 0, FALSE);
 }
@@ -372,6 +408,20 @@ void DokanDispatchCompletion(__in PDEVICE_OBJECT DeviceObject,
 
   ASSERT(!irpEntry->RequestContext.DoNotComplete);
 
+  switch (irpEntry->RequestContext.IrpSp->MajorFunction) {
+  case IRP_MJ_READ:
+  case IRP_MJ_WRITE:
+  case IRP_MJ_QUERY_INFORMATION:
+  case IRP_MJ_FLUSH_BUFFERS:
+    // User mode dispatched the event, so it knows the name it carried.
+    DokanAcknowledgeIoEventFileName(
+        irpEntry->RequestContext.IrpSp->FileObject->FsContext2,
+        irpEntry->FileNameGeneration);
+    break;
+  default:
+    break;
+  }
+
   switch (irpEntry->RequestContext.IrpSp->MajorFunction) {
   case IRP_MJ_DIRECTORY_CONTROL:
     DokanCompleteDirectoryControl(&irpEntry->RequestContext, eventInfo);
@@ -440,11 +490,13 @@ DokanCompleteIrp(__in PREQUEST_CONTEXT RequestContext) {
   DOKAN_INIT_LOGGER(logger, RequestContext->DeviceObject->DriverObject, 0);
   KIRQL oldIrql;
   NTSTATUS result = STATUS_SUCCESS;
-  PLIST_ENTRY thisEntry, nextEntry, listHead;
+  PLIST_ENTRY listHead;
   PIRP_ENTRY irpEntry;
   LIST_ENTRY completeList;
+  PIRP_LIST pendingIrp;
   ULONG offset = 0;
   ULONG eventInfoSize = 0;
+  ULONG replyLength = 0;
   ULONG lastSerialNumber = 0;
   PEVENT_INFORMATION eventInfo = NULL;
   BOOLEAN badUsageByCaller = FALSE;
@@ -465,19 +517,20 @@ DokanCompleteIrp(__in PREQUEST_CONTEXT RequestContext) {
 
   buffer = (PCHAR)RequestContext->Irp->AssociatedIrp.SystemBuffer;
   ASSERT(buffer != NULL);
+  eventInfo = (PEVENT_INFORMATION)buffer;
+  if (bufferLength == sizeof(EVENT_INFORMATION) &&
+      eventInfo->SerialNumber == 0 && eventInfo->ReplyLength) {
+    // A pull with a timeout and no reply.
+    return STATUS_SUCCESS;
+  }
 
   InitializeListHead(&completeList);
 
-  ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
-  KeAcquireSpinLock(&RequestContext->Dcb->PendingIrp.ListLock, &oldIrql);
-
-  // search corresponding IRP through pending IRP list
-  listHead = &RequestContext->Dcb->PendingIrp.ListHead;
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
-    nextEntry = thisEntry->Flink;
-    irpEntry = CONTAINING_RECORD(thisEntry, IRP_ENTRY, ListEntry);
+  // search corresponding IRP of each reply through the pending IRP table of
+  // its shard
+  while (TRUE) {
     eventInfo = (PEVENT_INFORMATION)(buffer + offset);
+    replyLength = eventInfo->ReplyLength;
     if (eventInfo->SerialNumber < lastSerialNumber) {
       // This would be a coding error in the DLL.
       result = DokanLogError(&logger,
@@ -486,45 +539,78 @@ DokanCompleteIrp(__in PREQUEST_CONTEXT RequestContext) {
       badUsageByCaller = TRUE;
       break;
     }
-    lastSerialNumber = eventInfo->SerialNumber;
-    if (irpEntry->SerialNumber != eventInfo->SerialNumber) {
-      continue;
-    }
-    RemoveEntryList(thisEntry);
-    if (irpEntry->RequestContext.Irp == NULL) {
-      // This IRP is already canceled; just discard it.
-      ASSERT(irpEntry->CancelRoutineFreeMemory == FALSE);
-      DokanFreeIrpEntry(irpEntry);
-    } else if (IoSetCancelRoutine(irpEntry->RequestContext.Irp, NULL) == NULL) {
-      // Cancellation is already in progress, and the cancel routine will run as
-      // soon as we release the lock.
-      InitializeListHead(&irpEntry->ListEntry);
-      irpEntry->CancelRoutineFreeMemory = TRUE;
-    } else {
-      // IrpEntry is saved here for CancelRoutine
-      // Clear it to prevent to be completed by CancelRoutine twice
-      irpEntry->RequestContext.Irp->Tail.Overlay
-          .DriverContext[DRIVER_CONTEXT_IRP_ENTRY] = NULL;
-      InsertTailList(&completeList, thisEntry);
-    }
-    offset += GetEventInfoSize(irpEntry->RequestContext.IrpSp->MajorFunction,
-                               eventInfo);
-    // Everything through offset - 1 must be readable by the completion function
-    // that receives the EVENT_INFORMATION object.
-    if (offset > bufferLength) {
-      result = DokanLogError(
-          &logger,
-          STATUS_INVALID_PARAMETER,
-          L"Full EVENT_INFORMATION size too large for passed-in buffer.");
+    if (replyLength && (replyLength < sizeof(EVENT_INFORMATION) ||
+                        replyLength > bufferLength - offset)) {
+      result = DokanLogError(&logger, STATUS_INVALID_PARAMETER,
+                             L"Reply length does not fit in the buffer.");
       badUsageByCaller = TRUE;
       break;
     }
-    // Batching is currently not allowed for buffer overflow replies, and the
-    // checks below don't work for them. Essentially, if user mode populated a
-    // partial object, it has no way of indicating the real size of that
-    // EVENT_INFORMATION object, other than the size passed to DeviceIoControl
-    // externally to the buffer.
-    if (eventInfo->Status == STATUS_BUFFER_OVERFLOW) {
+    lastSerialNumber = eventInfo->SerialNumber;
+    pendingIrp =
+        DokanGetPendingIrpList(RequestContext->Dcb, eventInfo->SerialNumber);
+    ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
+    KeAcquireSpinLock(&pendingIrp->ListLock, &oldIrql);
+    irpEntry = DokanFindIrpEntry(pendingIrp, eventInfo->SerialNumber);
+    if (irpEntry == NULL) {
+      KeReleaseSpinLock(&pendingIrp->ListLock, oldIrql);
+      if (!replyLength) {
+        // The IRP already timed out. The size of its reply depends on the
+        // IRP, so the rest of the batch cannot be read.
+        break;
+      }
+      // The IRP already timed out, skip its reply.
+      eventInfoSize = replyLength;
+    } else {
+      DokanRemoveIrpEntry(irpEntry);
+      // The entry may be freed below, or by the cancel routine once the lock
+      // is released.
+      eventInfoSize = GetEventInfoSize(
+          irpEntry->RequestContext.IrpSp->MajorFunction, eventInfo);
+      // Everything through offset + eventInfoSize - 1 must be readable by the
+      // completion function that receives the EVENT_INFORMATION object.
+      if (eventInfoSize > bufferLength - offset ||
+          (replyLength && replyLength < eventInfoSize)) {
+        result = DokanLogError(
+            &logger,
+            STATUS_INVALID_PARAMETER,
+            L"Full EVENT_INFORMATION size too large for passed-in buffer.");
+        badUsageByCaller = TRUE;
+      }
+      if (irpEntry->RequestContext.Irp == NULL) {
+        // This IRP is already canceled; just discard it.
+        ASSERT(irpEntry->CancelRoutineFreeMemory == FALSE);
+        DokanFreeIrpEntry(irpEntry);
+      } else if (IoSetCancelRoutine(irpEntry->RequestContext.Irp, NULL) ==
+                 NULL) {
+        // Cancellation is already in progress, and the cancel routine will
+        // run as soon as we release the lock.
+        InitializeListHead(&irpEntry->ListEntry);
+        irpEntry->CancelRoutineFreeMemory = TRUE;
+      } else {
+        // IrpEntry is saved here for CancelRoutine
+        // Clear it to prevent to be completed by CancelRoutine twice
+        irpEntry->RequestContext.Irp->Tail.Overlay
+            .DriverContext[DRIVER_CONTEXT_IRP_ENTRY] = NULL;
+        // Each entry keeps its reply, as the entries discarded above leave
+        // holes in the batch. An invalid reply cancels the IRP.
+        irpEntry->EventInfo = badUsageByCaller ? NULL : eventInfo;
+        InsertTailList(&completeList, &irpEntry->ListEntry);
+      }
+      KeReleaseSpinLock(&pendingIrp->ListLock, oldIrql);
+      if (badUsageByCaller) {
+        break;
+      }
+      if (replyLength) {
+        eventInfoSize = replyLength;
+      }
+    }
+    offset += eventInfoSize;
+    // Without its length, the size of a buffer overflow reply cannot be
+    // known. Essentially, if user mode populated a partial object, it has no
+    // way of indicating the real size of that EVENT_INFORMATION object, other
+    // than the size passed to DeviceIoControl externally to the buffer.
+    if (!replyLength && eventInfo->Status == STATUS_BUFFER_OVERFLOW) {
       break;
     }
     // Don't loop if batching is not enabled; there should only be one reply at
@@ -551,30 +637,22 @@ DokanCompleteIrp(__in PREQUEST_CONTEXT RequestContext) {
       break;
     }
   }
-  KeReleaseSpinLock(&RequestContext->Dcb->PendingIrp.ListLock, oldIrql);
-  offset = 0;
-  eventInfo = NULL;
   if (IsListEmpty(&completeList)) {
     DokanLogInfo(&logger, L"Warning: no matching IRPs found for reply.");
   }
   while (!IsListEmpty(&completeList)) {
     listHead = RemoveHeadList(&completeList);
+    irpEntry = CONTAINING_RECORD(listHead, IRP_ENTRY, ListEntry);
     if (IsUnmountPendingVcb(RequestContext->Vcb)) {
       DOKAN_LOG_FINE_IRP(RequestContext, "Volume is not mounted second check");
       return STATUS_NO_SUCH_DEVICE;
     }
-    irpEntry = CONTAINING_RECORD(listHead, IRP_ENTRY, ListEntry);
-    if (offset >= bufferLength) {
-      DokanLogInfo(&logger, L"Unexpected end of event info list.");
+    if (irpEntry->EventInfo == NULL) {
       irpEntry->RequestContext.Irp->IoStatus.Information = 0;
       DokanCompleteIrpRequest(irpEntry->RequestContext.Irp, STATUS_CANCELLED);
     } else {
-      eventInfo = (PEVENT_INFORMATION)(buffer + offset);
-      eventInfoSize = GetEventInfoSize(
-          irpEntry->RequestContext.IrpSp->MajorFunction,
-                                       eventInfo);
-      DokanDispatchCompletion(RequestContext->DeviceObject, irpEntry, eventInfo);
-      offset += eventInfoSize;
+      DokanDispatchCompletion(RequestContext->DeviceObject, irpEntry,
+                              irpEntry->EventInfo);
     }
     DokanFreeIrpEntry(irpEntry);
     irpEntry = NULL;
@@ -935,7 +1013,11 @@ DokanEventStart(__in PREQUEST_CONTEXT RequestContext) {
       RequestContext->DokanGlobal->MountId, eventStart->MountPoint,
       eventStart->UNCName, volumeSecurityDescriptor, sessionId, baseGuidString,
       RequestContext->DokanGlobal, deviceType, deviceCharacteristics,
-      mountGlobally, useMountManager, &dokanControl);
+      mountGlobally, useMountManager,
+      eventStart->PendingIrpShardCount != 0
+          ? eventStart->PendingIrpShardCount
+          : KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS),
+      &dokanControl);
 
   if (!NT_SUCCESS(status)) {
     if (foundPrevEntry) {
@@ -954,6 +1036,8 @@ DokanEventStart(__in PREQUEST_CONTEXT RequestContext) {
       (eventStart->Flags & DOKAN_EVENT_DISPATCH_DRIVER_LOGS) != 0;
   dcb->AllowIpcBatching =
       (eventStart->Flags & DOKAN_EVENT_ALLOW_IPC_BATCHING) != 0;
+  dcb->OmitIoEventFileNames =
+      (eventStart->Flags & DOKAN_EVENT_OMIT_IO_FILE_NAMES) != 0;
   isMountPointDriveLetter = IsMountPointDriveLetter(dcb->MountPoint);
 
   if (dcb->DispatchDriverLogs) {
@@ -1056,6 +1140,9 @@ DokanEventStart(__in PREQUEST_CONTEXT RequestContext) {
   DokanLogInfo(&logger, L"Event start using mount ID: %d; device name: %s.",
                dcb->MountId, driverInfo->DeviceName);
 
+  DOKAN_LOG_FINE_IRP(RequestContext, "Pending IRP shards: %lu",
+                     dcb->PendingIrpShardCount);
+
   dcb->UseAltStream = 0;
   if (eventStart->Flags & DOKAN_EVENT_ALTERNATIVE_STREAM_ON) {
     DOKAN_LOG_FINE_IRP(RequestContext, "ALT_STREAM_ON");
@@ -1176,53 +1263,44 @@ DokanEventStart(__in PREQUEST_CONTEXT RequestContext) {
 NTSTATUS
 DokanEventWrite(__in PREQUEST_CONTEXT RequestContext) {
   KIRQL oldIrql;
-  PLIST_ENTRY thisEntry, nextEntry, listHead;
   PIRP_ENTRY irpEntry;
   PEVENT_INFORMATION eventInfo = NULL;
+  PIRP_LIST pendingIrp;
   PIRP writeIrp;
 
   GET_IRP_BUFFER_OR_RETURN(RequestContext->Irp, eventInfo);
 
   DOKAN_LOG_FINE_IRP(RequestContext, "EventInfo #%X", eventInfo->SerialNumber);
 
+  pendingIrp =
+      DokanGetPendingIrpList(RequestContext->Dcb, eventInfo->SerialNumber);
   ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
-  KeAcquireSpinLock(&RequestContext->Dcb->PendingIrp.ListLock, &oldIrql);
-
-  // search corresponding write IRP through pending IRP list
-  listHead = &RequestContext->Dcb->PendingIrp.ListHead;
-
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
-
-    PIO_STACK_LOCATION writeIrpSp, eventIrpSp;
-    PEVENT_CONTEXT eventContext;
-    ULONG info = 0;
-    NTSTATUS status;
-
-    nextEntry = thisEntry->Flink;
-    irpEntry = CONTAINING_RECORD(thisEntry, IRP_ENTRY, ListEntry);
-
-    // check whehter this is corresponding IRP
-    if (irpEntry->SerialNumber != eventInfo->SerialNumber) {
-      continue;
-    }
+  KeAcquireSpinLock(&pendingIrp->ListLock, &oldIrql);
 
+  // search corresponding write IRP through pending IRP table
+  irpEntry = DokanFindIrpEntry(pendingIrp, eventInfo->SerialNumber);
+  if (irpEntry != NULL) {
     writeIrp = irpEntry->RequestContext.Irp;
     if (writeIrp == NULL) {
       // this IRP has already been canceled
       ASSERT(irpEntry->CancelRoutineFreeMemory == FALSE);
-      RemoveEntryList(&irpEntry->ListEntry);
+      DokanRemoveIrpEntry(irpEntry);
       DokanFreeIrpEntry(irpEntry);
-      continue;
-    }
-
-    if (IoSetCancelRoutine(writeIrp, DokanIrpCancelRoutine) == NULL) {
+      irpEntry = NULL;
+    } else if (IoSetCancelRoutine(writeIrp, DokanIrpCancelRoutine) == NULL) {
       // Cancel routine will run as soon as we release the lock
-      RemoveEntryList(&irpEntry->ListEntry);
+      DokanRemoveIrpEntry(irpEntry);
       InitializeListHead(&irpEntry->ListEntry);
       irpEntry->CancelRoutineFreeMemory = TRUE;
-      continue;
+      irpEntry = NULL;
     }
+  }
+
+  if (irpEntry != NULL) {
+    PIO_STACK_LOCATION writeIrpSp, eventIrpSp;
+    PEVENT_CONTEXT eventContext;
+    ULONG info = 0;
+    NTSTATUS status;
 
     writeIrpSp = irpEntry->RequestContext.IrpSp;
     eventIrpSp = IoGetCurrentIrpStackLocation(RequestContext->Irp);
@@ -1262,7 +1340,7 @@ DokanEventWrite(__in PREQUEST_CONTEXT RequestContext) {
     DokanFreeEventContext(eventContext);
     writeIrp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_EVENT] = 0;
 
-    KeReleaseSpinLock(&RequestContext->Dcb->PendingIrp.ListLock, oldIrql);
+    KeReleaseSpinLock(&pendingIrp->ListLock, oldIrql);
 
     RequestContext->Irp->IoStatus.Status = status;
     RequestContext->Irp->IoStatus.Information = info;
@@ -1271,7 +1349,7 @@ DokanEventWrite(__in PREQUEST_CONTEXT RequestContext) {
     return RequestContext->Irp->IoStatus.Status;
   }
 
-  KeReleaseSpinLock(&RequestContext->Dcb->PendingIrp.ListLock, oldIrql);
+  KeReleaseSpinLock(&pendingIrp->ListLock, oldIrql);
 
   // if the corresponding IRP not found, the user should already
   // canceled the operation and the IRP already destroyed.
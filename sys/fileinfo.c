@@ -64,6 +64,7 @@ DokanDispatchQueryInformation(__in PREQUEST_CONTEXT RequestContext) {
   PDokanCCB ccb;
   PDokanFCB fcb = NULL;
   ULONG eventLength;
+  USHORT fileNameLength;
   PEVENT_CONTEXT eventContext;
   BOOLEAN fcbLocked = FALSE;
 
@@ -186,7 +187,8 @@ DokanDispatchQueryInformation(__in PREQUEST_CONTEXT RequestContext) {
     }
 
     // If the request is not handled by the switch case we send it to userland.
-    eventLength = sizeof(EVENT_CONTEXT) + fcb->FileName.Length;
+    fileNameLength = DokanGetIoEventFileNameLength(RequestContext->Dcb, ccb);
+    eventLength = sizeof(EVENT_CONTEXT) + fileNameLength;
     eventContext = AllocateEventContext(RequestContext, eventLength, ccb);
 
     if (eventContext == NULL) {
@@ -202,9 +204,9 @@ DokanDispatchQueryInformation(__in PREQUEST_CONTEXT RequestContext) {
         RequestContext->IrpSp->Parameters.QueryFile.Length;
 
     // copy file name to EventContext from FCB
-    eventContext->Operation.File.FileNameLength = fcb->FileName.Length;
+    eventContext->Operation.File.FileNameLength = fileNameLength;
     RtlCopyMemory(eventContext->Operation.File.FileName, fcb->FileName.Buffer,
-                  fcb->FileName.Length);
+                  fileNameLength);
 
     // register this IRP to pending IRP list
     status = DokanRegisterPendingIrp(RequestContext, eventContext);
@@ -395,12 +397,12 @@ VOID FlushAllCachedFcb(__in PREQUEST_CONTEXT RequestContext,
 
   DokanVCBLockRW(FcbRelatedTo->Vcb);
 
-  for (PDokanFCB* fcbInTable = (PDokanFCB*)RtlEnumerateGenericTableAvl(
-	  &RequestContext->Vcb->FcbTable, /*Restart=*/TRUE);
-	  fcbInTable != NULL;
-	  fcbInTable = (PDokanFCB*)RtlEnumerateGenericTableAvl(
-		  &RequestContext->Vcb->FcbTable, /*Restart=*/FALSE)) {
-	  FlushIfDescendant(RequestContext, FcbRelatedTo, *fcbInTable);
+  for (PDOKAN_HASH_TABLE_LINK link =
+           DokanHashTableEnumerate(&RequestContext->Vcb->FcbTable, NULL);
+       link != NULL;
+       link = DokanHashTableEnumerate(&RequestContext->Vcb->FcbTable, link)) {
+    FlushIfDescendant(RequestContext, FcbRelatedTo,
+                      CONTAINING_RECORD(link, DokanFCB, FcbTableLink));
   }
 
   DokanVCBUnlock(FcbRelatedTo->Vcb);
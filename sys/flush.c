@@ -21,6 +21,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "dokan.h"
+#include "util/fcb.h"
 
 NTSTATUS
 DokanDispatchFlush(__in PREQUEST_CONTEXT RequestContext) {
@@ -30,6 +31,7 @@ DokanDispatchFlush(__in PREQUEST_CONTEXT RequestContext) {
   PDokanCCB ccb;
   PEVENT_CONTEXT eventContext;
   ULONG eventLength;
+  USHORT fileNameLength;
 
   __try {
     fileObject = RequestContext->IrpSp->FileObject;
@@ -49,7 +51,8 @@ DokanDispatchFlush(__in PREQUEST_CONTEXT RequestContext) {
     OplockDebugRecordMajorFunction(fcb, IRP_MJ_FLUSH_BUFFERS);
     DokanFCBLockRO(fcb);
 
-    eventLength = sizeof(EVENT_CONTEXT) + fcb->FileName.Length;
+    fileNameLength = DokanGetIoEventFileNameLength(RequestContext->Dcb, ccb);
+    eventLength = sizeof(EVENT_CONTEXT) + fileNameLength;
     eventContext = AllocateEventContext(RequestContext, eventLength, ccb);
 
     if (eventContext == NULL) {
@@ -61,9 +64,9 @@ DokanDispatchFlush(__in PREQUEST_CONTEXT RequestContext) {
     DOKAN_LOG_FINE_IRP(RequestContext, "Get Context %X", (ULONG)ccb->UserContext);
 
     // copy file name to be flushed
-    eventContext->Operation.Flush.FileNameLength = fcb->FileName.Length;
+    eventContext->Operation.Flush.FileNameLength = fileNameLength;
     RtlCopyMemory(eventContext->Operation.Flush.FileName, fcb->FileName.Buffer,
-                  fcb->FileName.Length);
+                  fileNameLength);
 
     CcUninitializeCacheMap(fileObject, NULL, NULL);
 
@@ -490,7 +490,7 @@ NTSTATUS PullEvents(__in PREQUEST_CONTEXT RequestContext,
     currentIoctlBufferBytesRemaining -= workItemBytes;
     currentIoctlBuffer += workItemBytes;
     RequestContext->Irp->IoStatus.Information += workItemBytes;
-    ExFreePool(workItem);
+    DokanFreeEventContext(&workItem->EventContext);
     if (!RequestContext->Dcb->AllowIpcBatching) {
       break;
     }
@@ -759,6 +759,7 @@ NTSTATUS DokanMountVolume(__in PREQUEST_CONTEXT RequestContext) {
   PDEVICE_OBJECT volDeviceObject;
   PDRIVER_OBJECT driverObject = RequestContext->DeviceObject->DriverObject;
   NTSTATUS status = STATUS_UNRECOGNIZED_VOLUME;
+  ULONG generation;
   // Note: this can't live on DOKAN_GLOBAL because we can't reliably access that
   // in the case where we use this.
   static LONG hasMountedAnyDisk = 0;
@@ -854,16 +855,26 @@ NTSTATUS DokanMountVolume(__in PREQUEST_CONTEXT RequestContext) {
   vcb->ResourceLogger.DriverObject = driverObject;
   vcb->ValidFcbMask = 0xffffffffffffffff;
   dcb->Vcb = vcb;
+  if (dcb->DispatchDriverLogs) {
+    DokanAllocateTraceCursors(vcb);
+  }
 
   if (vcb->Dcb->FcbGarbageCollectionIntervalMs != 0) {
-    InitializeListHead(&vcb->FcbGarbageList);
+    for (generation = 0; generation < DOKAN_FCB_GARBAGE_GENERATION_COUNT;
+         ++generation) {
+      InitializeListHead(&vcb->FcbGarbageGenerations[generation]);
+    }
+    vcb->FcbGarbageCollectionIntervalMs =
+        vcb->Dcb->FcbGarbageCollectionIntervalMs;
+    vcb->VolumeMetrics.FcbGarbageCollectionIntervalMs =
+        vcb->FcbGarbageCollectionIntervalMs;
     KeInitializeEvent(&vcb->FcbGarbageListNotEmpty, SynchronizationEvent,
                       FALSE);
     DokanStartFcbGarbageCollector(vcb);
   }
 
-  RtlInitializeGenericTableAvl(&vcb->FcbTable, DokanCompareFcb,
-                               DokanAllocateFcbAvl, DokanFreeFcbAvl, vcb);
+  DokanHashTableInitialize(&vcb->FcbTable, vcb->FcbTableInitialBuckets,
+                           DOKAN_FCB_TABLE_INITIAL_BUCKET_COUNT);
 
   InitializeListHead(&vcb->DirNotifyList);
   FsRtlNotifyInitializeSync(&vcb->NotifySync);
@@ -21,6 +21,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "dokan.h"
+#include "util/fcb.h"
 #include "util/irp_buffer_helper.h"
 #include "util/mountmgr.h"
 #include "util/str.h"
@@ -56,11 +57,26 @@ static VOID FreeDcbNames(__in PDokanDCB Dcb) {
   }
 }
 
-VOID DokanInitIrpList(__in PIRP_LIST IrpList, __in BOOLEAN EventEnabled) {
+VOID DokanInitIrpList(__in PIRP_LIST IrpList, __in BOOLEAN EventEnabled,
+                      __in_opt PDOKAN_SERIAL_TABLE SerialTable,
+                      __in ULONG SerialKeyShift,
+                      __in_opt PDOKAN_TIMER_WHEEL TimerWheel) {
+  LARGE_INTEGER tickCount;
+
   InitializeListHead(&IrpList->ListHead);
   KeInitializeSpinLock(&IrpList->ListLock);
   KeInitializeEvent(&IrpList->NotEmpty, NotificationEvent, FALSE);
   IrpList->EventEnabled = EventEnabled;
+  IrpList->SerialTable = SerialTable;
+  if (SerialTable) {
+    DokanSerialTableInitialize(SerialTable, SerialKeyShift);
+  }
+  IrpList->TimerWheel = TimerWheel;
+  if (TimerWheel) {
+    KeQueryTickCount(&tickCount);
+    DokanTimerWheelInitialize(TimerWheel,
+                              DokanTickCountToTimerWheelTime(&tickCount));
+  }
 }
 
 PDEVICE_ENTRY
@@ -221,6 +237,10 @@ VOID DeleteDeviceDelayed(PDOKAN_GLOBAL dokanGlobal) {
               }
 
               FreeDcbNames(dcb);
+              DokanFreeFcbTable(
+                  deviceEntry->VolumeDeviceObject->DeviceExtension);
+              DokanFreeTraceCursors(
+                  deviceEntry->VolumeDeviceObject->DeviceExtension);
 
               DOKAN_LOG_("Delete the volume device. ReferenceCount %lu",
                         deviceEntry->VolumeDeviceObject->ReferenceCount);
@@ -952,6 +972,7 @@ DokanCreateDiskDevice(__in PDRIVER_OBJECT DriverObject, __in ULONG MountId,
                       __in DEVICE_TYPE DeviceType,
                       __in ULONG DeviceCharacteristics,
                       __in BOOLEAN MountGlobally, __in BOOLEAN UseMountManager,
+                      __in ULONG PendingIrpShardCount,
                       __out PDOKAN_CONTROL DokanControl) {
   WCHAR *diskDeviceNameBuf = NULL;
   WCHAR *symbolicLinkNameBuf = NULL;
@@ -960,6 +981,8 @@ DokanCreateDiskDevice(__in PDRIVER_OBJECT DriverObject, __in ULONG MountId,
   PDokanDCB dcb = NULL;
   UNICODE_STRING diskDeviceName;
   BOOLEAN isNetworkFileSystem = FALSE;
+  ULONG shardBits = 0;
+  ULONG shard;
   NTSTATUS status = STATUS_SUCCESS;
   DOKAN_INIT_LOGGER(logger, DriverObject, 0);
 
@@ -1076,9 +1099,25 @@ DokanCreateDiskDevice(__in PDRIVER_OBJECT DriverObject, __in ULONG MountId,
     diskDeviceObject->Flags |= DO_DIRECT_IO;
 
     // initialize Event and Event queue
-    DokanInitIrpList(&dcb->PendingIrp, /*EventEnabled=*/FALSE);
-    DokanInitIrpList(&dcb->NotifyEvent, /*EventEnabled=*/TRUE);
-    DokanInitIrpList(&dcb->PendingRetryIrp, /*EventEnabled=*/TRUE);
+    // The shard count is rounded down to a power of 2 so that the shard of a
+    // serial number is its low bits, which the serial tables then skip.
+    while ((1UL << (shardBits + 1)) <= PendingIrpShardCount &&
+           (1UL << (shardBits + 1)) <= DOKAN_MAX_PENDING_IRP_SHARD_COUNT) {
+      ++shardBits;
+    }
+    dcb->PendingIrpShardCount = 1UL << shardBits;
+    for (shard = 0; shard < dcb->PendingIrpShardCount; ++shard) {
+      DokanInitIrpList(&dcb->PendingIrp[shard], /*EventEnabled=*/FALSE,
+                       &dcb->PendingIrpSerialTable[shard],
+                       /*SerialKeyShift=*/shardBits,
+                       &dcb->PendingIrpTimerWheel[shard]);
+    }
+    DokanInitIrpList(&dcb->NotifyEvent, /*EventEnabled=*/TRUE,
+                     /*SerialTable=*/NULL, /*SerialKeyShift=*/0,
+                     /*TimerWheel=*/NULL);
+    DokanInitIrpList(&dcb->PendingRetryIrp, /*EventEnabled=*/TRUE,
+                     /*SerialTable=*/NULL, /*SerialKeyShift=*/0,
+                     /*TimerWheel=*/NULL);
     RtlZeroMemory(&dcb->NotifyIrpEventQueueList, sizeof(LIST_ENTRY));
     InitializeListHead(&dcb->NotifyIrpEventQueueList);
     KeInitializeQueue(&dcb->NotifyIrpEventQueue, 0);
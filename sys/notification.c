@@ -55,14 +55,83 @@ VOID SetCommonEventContext(__in PREQUEST_CONTEXT RequestContext,
 
   if (Ccb) {
     EventContext->FileFlags = DokanCCBFlagsGet(Ccb);
+    EventContext->FileNameGeneration = Ccb->Fcb->FileNameGeneration;
   }
 
   EventContext->ProcessId = RequestContext->ProcessId;
 }
 
+// The allocation size of each event context size class. Most requests fit in
+// the smallest ones, while the largest one covers the usual read and write
+// buffers.
+static const ULONG
+    EventContextSizeClasses[DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT] = {
+        512, 1024, 4 * 1024, 32 * 1024};
+
+static LOOKASIDE_LIST_EX
+    EventContextLookasideLists[DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT];
+
+LONG64 g_DokanEventContextAllocations[DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT + 1];
+LONG64 g_DokanEventContextLookasideMisses[DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT];
+
+// Called by a lookaside list of the event contexts when it has no free entry
+// to hand out.
+PVOID
+AllocateEventContextLookasideEntry(__in POOL_TYPE PoolType,
+                                   __in SIZE_T NumberOfBytes, __in ULONG Tag,
+                                   __inout PLOOKASIDE_LIST_EX Lookaside) {
+  PVOID entry = ExAllocatePoolWithTag(PoolType, NumberOfBytes, Tag);
+  if (entry != NULL) {
+    InterlockedIncrement64(
+        &g_DokanEventContextLookasideMisses[Lookaside -
+                                            EventContextLookasideLists]);
+  }
+  return entry;
+}
+
+BOOLEAN DokanInitializeEventContextLookasideLists(VOID) {
+  ULONG sizeClass;
+  NTSTATUS status;
+  for (sizeClass = 0; sizeClass < DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT;
+       ++sizeClass) {
+    status = ExInitializeLookasideListEx(
+        &EventContextLookasideLists[sizeClass],
+        AllocateEventContextLookasideEntry, NULL, NonPagedPool, 0,
+        EventContextSizeClasses[sizeClass], TAG, 0);
+    if (!NT_SUCCESS(status)) {
+      DOKAN_LOG_("ExInitializeLookasideListEx failed, Status (0x%x) %s",
+                 status, DokanGetNTSTATUSStr(status));
+      while (sizeClass > 0) {
+        ExDeleteLookasideListEx(&EventContextLookasideLists[--sizeClass]);
+      }
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+ULONG64 DokanGetEventContextLookasideHits(__in ULONG SizeClass) {
+  // Misses are read first: an allocation is counted after its miss, so the
+  // difference is never too large.
+  LONG64 misses = InterlockedCompareExchange64(
+      &g_DokanEventContextLookasideMisses[SizeClass], 0, 0);
+  LONG64 allocations = InterlockedCompareExchange64(
+      &g_DokanEventContextAllocations[SizeClass], 0, 0);
+  return allocations > misses ? (ULONG64)(allocations - misses) : 0;
+}
+
+VOID DokanDeleteEventContextLookasideLists(VOID) {
+  ULONG sizeClass;
+  for (sizeClass = 0; sizeClass < DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT;
+       ++sizeClass) {
+    ExDeleteLookasideListEx(&EventContextLookasideLists[sizeClass]);
+  }
+}
+
 PEVENT_CONTEXT
 AllocateEventContextRaw(__in ULONG EventContextLength) {
   ULONG driverContextLength;
+  ULONG sizeClass;
   PDRIVER_EVENT_CONTEXT driverEventContext;
   PEVENT_CONTEXT eventContext;
 
@@ -74,11 +143,27 @@ AllocateEventContextRaw(__in ULONG EventContextLength) {
 
   driverContextLength =
       EventContextLength - sizeof(EVENT_CONTEXT) + sizeof(DRIVER_EVENT_CONTEXT);
-  driverEventContext = DokanAllocZero(driverContextLength);
+  for (sizeClass = 0; sizeClass < DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT;
+       ++sizeClass) {
+    if (driverContextLength <= EventContextSizeClasses[sizeClass]) {
+      break;
+    }
+  }
+  if (sizeClass < DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT) {
+    driverEventContext =
+        ExAllocateFromLookasideListEx(&EventContextLookasideLists[sizeClass]);
+    if (driverEventContext != NULL) {
+      RtlZeroMemory(driverEventContext, driverContextLength);
+    }
+  } else {
+    driverEventContext = DokanAllocZero(driverContextLength);
+  }
   if (driverEventContext == NULL) {
     return NULL;
   }
+  InterlockedIncrement64(&g_DokanEventContextAllocations[sizeClass]);
 
+  driverEventContext->SizeClass = sizeClass;
   InitializeListHead(&driverEventContext->ListEntry);
 
   eventContext = &driverEventContext->EventContext;
@@ -102,7 +187,13 @@ AllocateEventContext(__in PREQUEST_CONTEXT RequestContext,
 VOID DokanFreeEventContext(__in PEVENT_CONTEXT EventContext) {
   PDRIVER_EVENT_CONTEXT driverEventContext =
       CONTAINING_RECORD(EventContext, DRIVER_EVENT_CONTEXT, EventContext);
-  ExFreePool(driverEventContext);
+  if (driverEventContext->SizeClass < DOKAN_EVENT_CONTEXT_SIZE_CLASS_COUNT) {
+    ExFreeToLookasideListEx(
+        &EventContextLookasideLists[driverEventContext->SizeClass],
+        driverEventContext);
+  } else {
+    ExFreePool(driverEventContext);
+  }
 }
 
 VOID DokanEventNotification(__in PREQUEST_CONTEXT RequestContext,
@@ -130,7 +221,6 @@ VOID DokanEventNotification(__in PREQUEST_CONTEXT RequestContext,
 // should then be acted on in some way that leads to their completion. The
 // Source list is still usable and is empty after this function returns.
 VOID MoveIrpList(__in PIRP_LIST Source, __out LIST_ENTRY* Dest) {
-  PLIST_ENTRY listHead;
   PIRP_ENTRY irpEntry;
   KIRQL oldIrql;
   PIRP irp;
@@ -141,8 +231,8 @@ VOID MoveIrpList(__in PIRP_LIST Source, __out LIST_ENTRY* Dest) {
   KeAcquireSpinLock(&Source->ListLock, &oldIrql);
 
   while (!IsListEmpty(&Source->ListHead)) {
-    listHead = RemoveHeadList(&Source->ListHead);
-    irpEntry = CONTAINING_RECORD(listHead, IRP_ENTRY, ListEntry);
+    irpEntry = CONTAINING_RECORD(Source->ListHead.Flink, IRP_ENTRY, ListEntry);
+    DokanRemoveIrpEntry(irpEntry);
     irp = irpEntry->RequestContext.Irp;
     if (irp == NULL) {
       // this IRP has already been canceled
@@ -201,7 +291,7 @@ VOID ReleaseNotifyEvent(__in PIRP_LIST NotifyEvent) {
     listHead = RemoveHeadList(&NotifyEvent->ListHead);
     driverEventContext =
         CONTAINING_RECORD(listHead, DRIVER_EVENT_CONTEXT, ListEntry);
-    ExFreePool(driverEventContext);
+    DokanFreeEventContext(&driverEventContext->EventContext);
   }
 
   KeClearEvent(&NotifyEvent->NotEmpty);
@@ -314,6 +404,7 @@ NTSTATUS DokanEventRelease(__in_opt PREQUEST_CONTEXT RequestContext,
                            __in PDEVICE_OBJECT DeviceObject) {
   PDokanDCB dcb;
   PDokanVCB vcb;
+  ULONG shard;
   NTSTATUS status = STATUS_SUCCESS;
   DOKAN_INIT_LOGGER(logger,
                     DeviceObject == NULL ? NULL
@@ -361,7 +452,9 @@ NTSTATUS DokanEventRelease(__in_opt PREQUEST_CONTEXT RequestContext,
   DokanLogInfo(&logger, L"Starting unmount for device \"%wZ\"",
                         dcb->DiskDeviceName);
 
-  ReleasePendingIrp(&dcb->PendingIrp);
+  for (shard = 0; shard < dcb->PendingIrpShardCount; ++shard) {
+    ReleasePendingIrp(&dcb->PendingIrp[shard]);
+  }
   ReleasePendingIrp(&dcb->PendingRetryIrp);
   ReleaseNotifyEvent(&dcb->NotifyEvent);
   DokanStopCheckThread(dcb);
@@ -374,9 +467,6 @@ NTSTATUS DokanEventRelease(__in_opt PREQUEST_CONTEXT RequestContext,
   DokanStopFcbGarbageCollectorThread(vcb);
   ClearLongFlag(vcb->Flags, VCB_MOUNTED);
 
-  if (vcb->FCBAvlNodeLookasideListInit) {
-    ExDeleteLookasideListEx(&vcb->FCBAvlNodeLookasideList);
-  }
   DokanCleanupAllChangeNotificationWaiters(vcb);
   IoReleaseRemoveLockAndWait(&dcb->RemoveLock, RequestContext);
 
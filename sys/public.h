@@ -28,7 +28,11 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <minwindef.h>
 #endif
 
-#define DOKAN_DRIVER_VERSION 0x0000190
+// The driver and the library only work together with the same version, it
+// changes with the layout of the structs they exchange. 0x191 added
+// EVENT_CONTEXT.FileNameGeneration and EVENT_START.PendingIrpShardCount, and
+// replaced the text of DOKAN_LOG_MESSAGE by DOKAN_TRACE_RECORD entries.
+#define DOKAN_DRIVER_VERSION 0x0000191
 
 #define EVENT_CONTEXT_MAX_SIZE (1024 * 32)
 // This is arbitrary. There isn't really an absolute max, but we marshal it in
@@ -318,6 +322,10 @@ typedef struct _EVENT_CONTEXT {
   UCHAR MinorFunction;
   ULONG Flags;
   ULONG FileFlags;
+  // Generation of the file name of the open when the event was built. With
+  // DOKAN_EVENT_OMIT_IO_FILE_NAMES, names from older generations than the
+  // one already known for the open are outdated.
+  ULONG FileNameGeneration;
   ULONG64 Context;
   union {
     DIRECTORY_CONTEXT Directory;
@@ -350,6 +358,30 @@ typedef struct _VOLUME_METRICS {
   // Number of IRPs with a too large buffer that could not be registered for
   // being forward to userland.
   ULONG64 LargeIRPRegistrationCanceled;
+  // Number of FCBs deleted by normal garbage collection passes. Each pass only
+  // visits the oldest generation of garbage FCBs.
+  ULONG64 NormalFcbGarbageCollectionDeletions;
+  // Number of times the garbage collection interval got shortened due to FCB
+  // allocation pressure, or lengthened back after it.
+  ULONG64 FcbGarbageCollectionIntervalDecreases;
+  ULONG64 FcbGarbageCollectionIntervalIncreases;
+  // The garbage collection interval in use, in milliseconds.
+  ULONG64 FcbGarbageCollectionIntervalMs;
+  // Number of FCBs still scheduled for garbage collection after the last pass.
+  ULONG64 PendingGarbageFcbs;
+  // Number of event contexts of each size class of the driver served by its
+  // lookaside list (hits) or allocated from the pool because the list was
+  // empty (misses), and of larger ones always allocated from the pool. These
+  // are shared by all the volumes.
+  ULONG64 EventContext512BLookasideHits;
+  ULONG64 EventContext512BLookasideMisses;
+  ULONG64 EventContext1KBLookasideHits;
+  ULONG64 EventContext1KBLookasideMisses;
+  ULONG64 EventContext4KBLookasideHits;
+  ULONG64 EventContext4KBLookasideMisses;
+  ULONG64 EventContext32KBLookasideHits;
+  ULONG64 EventContext32KBLookasideMisses;
+  ULONG64 EventContextOverflowAllocations;
 } VOLUME_METRICS, *PVOLUME_METRICS;
 
 #define WRITE_MAX_SIZE                                                         \
@@ -361,7 +393,10 @@ typedef struct _VOLUME_METRICS {
 typedef struct _EVENT_INFORMATION {
   ULONG SerialNumber;
   NTSTATUS Status;
-  ULONG Flags;
+  // Size of the reply including its buffer, which is where the next reply of
+  // a batch starts. 0 if not given, the driver then derives it from the
+  // event and cannot skip the reply of an event that timed out.
+  ULONG ReplyLength;
   union {
     struct {
       ULONG Index;
@@ -388,6 +423,9 @@ typedef struct _EVENT_INFORMATION {
   } Operation;
   ULONG64 Context;
   ULONG BufferLength;
+  // Wait for new events of the pull, taken from the first reply. 0 waits
+  // indefinitely. A reply with a SerialNumber of 0 and a ReplyLength only
+  // carries it.
   ULONG PullEventTimeoutMs;
   UCHAR Buffer[DOKAN_EVENT_INFO_MIN_BUFFER_SIZE];
 } EVENT_INFORMATION, *PEVENT_INFORMATION;
@@ -421,6 +459,9 @@ typedef struct _EVENT_INFORMATION {
 #define DOKAN_EVENT_DISPATCH_DRIVER_LOGS                            (1 << 8)
 #define DOKAN_EVENT_ALLOW_IPC_BATCHING                              (1 << 9)
 #define DOKAN_EVENT_DRIVE_LETTER_IN_USE                             (1 << 10)
+// Omit the file name from the read, write, flush and query information events
+// of an open, unless the file got renamed since the open last sent it.
+#define DOKAN_EVENT_OMIT_IO_FILE_NAMES                              (1 << 11)
 
 // Non-exclusive bits that can be set in EVENT_DRIVER_INFO.Flags for the driver
 // to send back extra info about what happened during a mount attempt, whether
@@ -472,6 +513,9 @@ typedef struct _EVENT_START {
   ULONG FcbGarbageCollectionIntervalMs;
   ULONG VolumeSecurityDescriptorLength;
   CHAR VolumeSecurityDescriptor[VOLUME_SECURITY_DESCRIPTOR_MAX_SIZE];
+  // Number of shards of the pending IRP list, rounded down to a power of 2 and
+  // capped by the driver. 0 uses one shard per active processor.
+  ULONG PendingIrpShardCount;
 } EVENT_START, *PEVENT_START;
 
 #ifdef _MSC_VER
@@ -517,10 +561,56 @@ typedef struct _DOKAN_MOUNT_POINT_INFO {
 // EVENT_CONTEXT.
 #define DOKAN_IRP_LOG_MESSAGE 0x20
 
-// Driver log message disptached during DOKAN_IRP_LOG_MESSAGE event.
+// Driver trace record event ids.
+// Free-form message formatted by the driver. The text follows the record.
+#define DOKAN_TRACE_TEXT 1
+// IRP entering the dispatch. Args are the major function, the minor function
+// and the identifier type of the device extension.
+#define DOKAN_TRACE_IRP_BEGIN 2
+// IRP completed on exit of the dispatch. Args[0] is IoStatus.Information.
+#define DOKAN_TRACE_IRP_END 3
+// IRP marked pending on exit of the dispatch.
+#define DOKAN_TRACE_IRP_END_PENDING 4
+// IRP left to be completed by someone else on exit of the dispatch.
+#define DOKAN_TRACE_IRP_END_NOT_COMPLETED 5
+
+#define DOKAN_TRACE_RECORD_ARG_COUNT 3
+
+// Compact binary record of a driver log. Records are only formatted by the
+// library when they are dispatched, see DokanTraceFormatRecord.
+typedef struct _DOKAN_TRACE_RECORD {
+  // Size of the record including the trailing text, if any.
+  USHORT Size;
+  USHORT EventId;
+  ULONG Processor;
+  // Local time of the record, in 100ns units.
+  LONGLONG Timestamp;
+  ULONG64 Irp;
+  NTSTATUS Status;
+  // Process of the request, 0 for the logs outside of one.
+  ULONG ProcessId;
+  ULONG64 Args[DOKAN_TRACE_RECORD_ARG_COUNT];
+  // Not null terminated, only present for DOKAN_TRACE_TEXT.
+  CHAR Text[1];
+} DOKAN_TRACE_RECORD, *PDOKAN_TRACE_RECORD;
+
+#define DOKAN_TRACE_RECORD_HEADER_SIZE FIELD_OFFSET(DOKAN_TRACE_RECORD, Text)
+// Records are packed in DOKAN_LOG_MESSAGE at this alignment.
+#define DOKAN_TRACE_RECORD_ALIGNMENT 8
+#define DOKAN_TRACE_RECORD_ALIGNED_SIZE(Size)                                  \
+  (((Size) + DOKAN_TRACE_RECORD_ALIGNMENT - 1) &                               \
+   ~(DOKAN_TRACE_RECORD_ALIGNMENT - 1))
+
+// Driver log records disptached during DOKAN_IRP_LOG_MESSAGE event. Before
+// DOKAN_DRIVER_VERSION 0x191, it held a single text message instead.
 typedef struct _DOKAN_LOG_MESSAGE {
-  ULONG MessageLength;
-  CHAR Message[1];
+  // Size of the records that follow.
+  ULONG RecordsLength;
+  // Approximate number of records overwritten in the driver before they could
+  // be dispatched, since the previous message.
+  ULONG DroppedRecords;
+  // Packed DOKAN_TRACE_RECORD entries.
+  ULONG64 Records[1];
 } DOKAN_LOG_MESSAGE, *PDOKAN_LOG_MESSAGE;
 
 #endif // PUBLIC_H_
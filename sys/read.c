@@ -21,6 +21,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "dokan.h"
+#include "util/fcb.h"
 
 NTSTATUS
 DokanDispatchRead(__in PREQUEST_CONTEXT RequestContext)
@@ -51,6 +52,7 @@ Return Value:
   PVOID currentAddress = NULL;
   PEVENT_CONTEXT eventContext;
   ULONG eventLength;
+  USHORT fileNameLength;
   BOOLEAN fcbLocked = FALSE;
   BOOLEAN isPagingIo = FALSE;
   BOOLEAN isSynchronousIo = FALSE;
@@ -167,7 +169,8 @@ Return Value:
     DokanFCBLockRO(fcb);
     fcbLocked = TRUE;
     // length of EventContext is sum of file name length and itself
-    eventLength = sizeof(EVENT_CONTEXT) + fcb->FileName.Length;
+    fileNameLength = DokanGetIoEventFileNameLength(RequestContext->Dcb, ccb);
+    eventLength = sizeof(EVENT_CONTEXT) + fileNameLength;
     eventContext = AllocateEventContext(RequestContext, eventLength, ccb);
     if (eventContext == NULL) {
       status = STATUS_INSUFFICIENT_RESOURCES;
@@ -199,9 +202,9 @@ Return Value:
         RequestContext->IrpSp->Parameters.Read.Length;
 
     // copy the accessed file name
-    eventContext->Operation.Read.FileNameLength = fcb->FileName.Length;
+    eventContext->Operation.Read.FileNameLength = fileNameLength;
     RtlCopyMemory(eventContext->Operation.Read.FileName, fcb->FileName.Buffer,
-                  fcb->FileName.Length);
+                  fileNameLength);
 
     //
     //  We now check whether we can proceed based on the state of
@@ -34,13 +34,99 @@ VOID DokanUnmount(__in_opt PREQUEST_CONTEXT RequestContext, __in PDokanDCB Dcb)
   DOKAN_LOG("End");
 }
 
+// Time unit of the pending IRP timer wheels is 2^DOKAN_TIMER_WHEEL_TICK_SHIFT
+// ticks, around 250ms with the default clock resolution.
+#define DOKAN_TIMER_WHEEL_TICK_SHIFT 4
+
+ULONGLONG DokanTickCountToTimerWheelTime(__in PLARGE_INTEGER TickCount) {
+  return (ULONGLONG)TickCount->QuadPart >> DOKAN_TIMER_WHEEL_TICK_SHIFT;
+}
+
+VOID DokanScheduleIrpTimeout(__in PIRP_ENTRY IrpEntry) {
+  PDOKAN_TIMER_WHEEL timerWheel = IrpEntry->IrpList->TimerWheel;
+  if (!timerWheel) {
+    return;
+  }
+  DokanTimerWheelRemove(timerWheel, &IrpEntry->TimerLink);
+  // The deadline is rounded up so that the IRP does not expire before its
+  // tick count.
+  DokanTimerWheelInsert(
+      timerWheel, &IrpEntry->TimerLink,
+      ((ULONGLONG)IrpEntry->TickCount.QuadPart +
+       (1ULL << DOKAN_TIMER_WHEEL_TICK_SHIFT) - 1) >>
+          DOKAN_TIMER_WHEEL_TICK_SHIFT);
+}
+
+// Moves the pending IRP to CompleteList if it has timed out or has an async
+// failure status. The list lock must be held.
+static VOID CollectTimeoutPendingIrp(__in PIRP_ENTRY IrpEntry,
+                                     __in PLARGE_INTEGER TickCount,
+                                     __inout PLIST_ENTRY CompleteList) {
+  PIRP irp;
+
+  // If an async operation (like an oplock break or CancelIoEx call from user
+  // mode) has set the AsyncStatus to a failure status, then we clean up that
+  // IRP as if it had timed out but use the status. The normal way an IRP gets
+  // timed out is by its TickCount being too long ago. Returning here means
+  // the IRP is not eligible for cleanup in either way.
+  if (IrpEntry->AsyncStatus == STATUS_SUCCESS &&
+      TickCount->QuadPart < IrpEntry->TickCount.QuadPart) {
+    // Put back an entry the timer wheel handed out early.
+    if (!DokanTimerWheelIsLinked(&IrpEntry->TimerLink)) {
+      DokanScheduleIrpTimeout(IrpEntry);
+    }
+    return;
+  }
+
+  DokanRemoveIrpEntry(IrpEntry);
+
+  DOKAN_LOG_("Timeout Irp %ld", IrpEntry->SerialNumber);
+
+  irp = IrpEntry->RequestContext.Irp;
+
+  // Create IRPs (ForcedCanceled) are special in that this routine is always
+  // their place of effective cancellation. So we only care about races with
+  // the cancel routine for other IRPs (which can be effectively canceled in
+  // either place).
+  if (!IrpEntry->RequestContext.ForcedCanceled) {
+    if (irp == NULL) {
+      // Already canceled previously.
+      ASSERT(IrpEntry->CancelRoutineFreeMemory == FALSE);
+      DokanFreeIrpEntry(IrpEntry);
+      return;
+    }
+    if (IoSetCancelRoutine(irp, NULL) == NULL) {
+      // Cancel routine is already destined to run.
+      InitializeListHead(&IrpEntry->ListEntry);
+      IrpEntry->CancelRoutineFreeMemory = TRUE;
+      return;
+    }
+  } else {
+    // Cleanup ForcedCanceled IRP of the attached CancelRoutine before
+    // Completion.
+    IoSetCancelRoutine(irp, NULL);
+  }
+
+  // Prevent possible future runs of the cancel routine from doing anything.
+  irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_IRP_ENTRY] = NULL;
+
+  InsertTailList(CompleteList, &IrpEntry->ListEntry);
+}
+
+// Completes the pending IRPs that have timed out. The periodic check only
+// visits the IRPs whose timeout expired in the timer wheel. ScanAll is used
+// when an IRP was canceled or given an async failure status, which does not
+// go through the timer wheel, and visits every pending IRP.
 NTSTATUS
-ReleaseTimeoutPendingIrp(__in PDokanDCB Dcb) {
+ReleaseTimeoutPendingIrp(__in PDokanDCB Dcb, __in BOOLEAN ScanAll) {
   KIRQL oldIrql;
   PLIST_ENTRY thisEntry, nextEntry, listHead;
   PIRP_ENTRY irpEntry;
   LARGE_INTEGER tickCount;
   LIST_ENTRY completeList;
+  DOKAN_TIMER_WHEEL_LINK expired;
+  PIRP_LIST pendingIrp;
+  ULONG shard;
   PIRP irp;
   BOOLEAN shouldUnmount = FALSE;
   PDokanVCB vcb = Dcb->Vcb;
@@ -49,77 +135,46 @@ ReleaseTimeoutPendingIrp(__in PDokanDCB Dcb) {
   DOKAN_LOG("Start");
   InitializeListHead(&completeList);
 
-  ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
-  KeAcquireSpinLock(&Dcb->PendingIrp.ListLock, &oldIrql);
-
-  // when IRP queue is empty, there is nothing to do
-  if (IsListEmpty(&Dcb->PendingIrp.ListHead)) {
-    KeReleaseSpinLock(&Dcb->PendingIrp.ListLock, oldIrql);
-    DOKAN_LOG("IrpQueue is Empty");
-    return STATUS_SUCCESS;
-  }
-
   KeQueryTickCount(&tickCount);
 
-  // search timeout IRP through pending IRP list
-  listHead = &Dcb->PendingIrp.ListHead;
-
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
+  for (shard = 0; shard < Dcb->PendingIrpShardCount; ++shard) {
+    pendingIrp = &Dcb->PendingIrp[shard];
 
-    nextEntry = thisEntry->Flink;
+    ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
+    KeAcquireSpinLock(&pendingIrp->ListLock, &oldIrql);
 
-    irpEntry = CONTAINING_RECORD(thisEntry, IRP_ENTRY, ListEntry);
-
-    // If an async operation (like an oplock break or CancelIoEx call from user
-    // mode) has set the AsyncStatus to a failure status, then we clean up that
-    // IRP as if it had timed out but use the status. The normal way an IRP gets
-    // timed out is by its TickCount being too long ago. Continuing here means
-    // the IRP is not eligible for cleanup in either way.
-    if (irpEntry->AsyncStatus == STATUS_SUCCESS &&
-        tickCount.QuadPart < irpEntry->TickCount.QuadPart) {
+    // when IRP queue is empty, there is nothing to do
+    if (IsListEmpty(&pendingIrp->ListHead)) {
+      KeReleaseSpinLock(&pendingIrp->ListLock, oldIrql);
       continue;
     }
 
-    RemoveEntryList(thisEntry);
-
-    DOKAN_LOG_("Timeout Irp %ld", irpEntry->SerialNumber);
-
-    irp = irpEntry->RequestContext.Irp;
-
-    // Create IRPs (ForcedCanceled) are special in that this routine is always
-    // their place of effective cancellation. So we only care about races with
-    // the cancel routine for other IRPs (which can be effectively canceled in
-    // either place).
-    if (!irpEntry->RequestContext.ForcedCanceled) {
-      if (irp == NULL) {
-        // Already canceled previously.
-        ASSERT(irpEntry->CancelRoutineFreeMemory == FALSE);
-        DokanFreeIrpEntry(irpEntry);
-        continue;
-      }
-      if (IoSetCancelRoutine(irp, NULL) == NULL) {
-        // Cancel routine is already destined to run.
-        InitializeListHead(&irpEntry->ListEntry);
-        irpEntry->CancelRoutineFreeMemory = TRUE;
-        continue;
+    if (ScanAll) {
+      // search timeout IRP through pending IRP list
+      listHead = &pendingIrp->ListHead;
+      for (thisEntry = listHead->Flink; thisEntry != listHead;
+           thisEntry = nextEntry) {
+        nextEntry = thisEntry->Flink;
+        irpEntry = CONTAINING_RECORD(thisEntry, IRP_ENTRY, ListEntry);
+        CollectTimeoutPendingIrp(irpEntry, &tickCount, &completeList);
       }
     } else {
-      // Cleanup ForcedCanceled IRP of the attached CancelRoutine before
-      // Completion.
-      IoSetCancelRoutine(irp, NULL);
+      DokanTimerWheelInitializeLink(&expired);
+      DokanTimerWheelAdvance(pendingIrp->TimerWheel,
+                             DokanTickCountToTimerWheelTime(&tickCount),
+                             &expired);
+      while (DokanTimerWheelIsLinked(&expired)) {
+        irpEntry = CONTAINING_RECORD(expired.Next, IRP_ENTRY, TimerLink);
+        DokanTimerWheelUnlink(&irpEntry->TimerLink);
+        CollectTimeoutPendingIrp(irpEntry, &tickCount, &completeList);
+      }
     }
 
-    // Prevent possible future runs of the cancel routine from doing anything.
-    irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_IRP_ENTRY] = NULL;
-
-    InsertTailList(&completeList, &irpEntry->ListEntry);
-  }
-
-  if (IsListEmpty(&Dcb->PendingIrp.ListHead)) {
-    KeClearEvent(&Dcb->PendingIrp.NotEmpty);
+    if (IsListEmpty(&pendingIrp->ListHead)) {
+      KeClearEvent(&pendingIrp->NotEmpty);
+    }
+    KeReleaseSpinLock(&pendingIrp->ListLock, oldIrql);
   }
-  KeReleaseSpinLock(&Dcb->PendingIrp.ListLock, oldIrql);
 
   shouldUnmount = !vcb->IsKeepaliveActive && !IsListEmpty(&completeList);
   while (!IsListEmpty(&completeList)) {
@@ -177,9 +232,9 @@ ReleaseTimeoutPendingIrp(__in PDokanDCB Dcb) {
 NTSTATUS
 DokanResetPendingIrpTimeout(__in PREQUEST_CONTEXT RequestContext) {
   KIRQL oldIrql;
-  PLIST_ENTRY thisEntry, nextEntry, listHead;
   PIRP_ENTRY irpEntry;
   PEVENT_INFORMATION eventInfo = NULL;
+  PIRP_LIST pendingIrp;
   ULONG timeout; // in milisecond
 
   GET_IRP_BUFFER_OR_RETURN(RequestContext->Irp, eventInfo);
@@ -189,27 +244,18 @@ DokanResetPendingIrpTimeout(__in PREQUEST_CONTEXT RequestContext) {
     timeout = DOKAN_IRP_PENDING_TIMEOUT_RESET_MAX;
   }
 
+  pendingIrp =
+      DokanGetPendingIrpList(RequestContext->Dcb, eventInfo->SerialNumber);
   ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
-  KeAcquireSpinLock(&RequestContext->Dcb->PendingIrp.ListLock, &oldIrql);
-
-  // search corresponding IRP through pending IRP list
-  listHead = &RequestContext->Dcb->PendingIrp.ListHead;
-
-  for (thisEntry = listHead->Flink; thisEntry != listHead;
-       thisEntry = nextEntry) {
-
-    nextEntry = thisEntry->Flink;
-
-    irpEntry = CONTAINING_RECORD(thisEntry, IRP_ENTRY, ListEntry);
-
-    if (irpEntry->SerialNumber != eventInfo->SerialNumber) {
-      continue;
-    }
+  KeAcquireSpinLock(&pendingIrp->ListLock, &oldIrql);
 
+  // search corresponding IRP through pending IRP table
+  irpEntry = DokanFindIrpEntry(pendingIrp, eventInfo->SerialNumber);
+  if (irpEntry != NULL) {
     DokanUpdateTimeout(&irpEntry->TickCount, timeout);
-    break;
+    DokanScheduleIrpTimeout(irpEntry);
   }
-  KeReleaseSpinLock(&RequestContext->Dcb->PendingIrp.ListLock, oldIrql);
+  KeReleaseSpinLock(&pendingIrp->ListLock, oldIrql);
   return STATUS_SUCCESS;
 }
 
@@ -263,7 +309,7 @@ Routine Description:
           ((DOKAN_CHECK_INTERVAL + 2000) * 10000)) {
         DokanLogInfo(&logger, L"Wake from sleep detected.");
       } else {
-        ReleaseTimeoutPendingIrp(Dcb);
+        ReleaseTimeoutPendingIrp(Dcb, /*ScanAll=*/status == STATUS_WAIT_1);
       }
       KeQuerySystemTime(&LastTime);
     }
@@ -80,10 +80,82 @@ BOOLEAN DokanInitializeFcb(__in PREQUEST_CONTEXT RequestContext,
   return TRUE;
 }
 
+// Returns the hash of FileName in the FCB table of the volume. Names that
+// compare equal for the volume get the same hash.
+ULONG HashFcbFileName(__in PDokanVCB Vcb, __in PUNICODE_STRING FileName) {
+  BOOLEAN caseInSensitive =
+      !(Vcb->Dcb->MountOptions & DOKAN_EVENT_CASE_SENSITIVE);
+  ULONG hash = DOKAN_HASH_TABLE_HASH_INIT;
+  USHORT i;
+  for (i = 0; i < FileName->Length / sizeof(WCHAR); ++i) {
+    WCHAR c = FileName->Buffer[i];
+    if (caseInSensitive) {
+      c = RtlUpcaseUnicodeChar(c);
+    }
+    hash = DokanHashTableHashChar(hash, c);
+  }
+  return hash;
+}
+
+// Returns the FCB of the table having FileName, whose hash is Hash, or NULL.
+// Called with the VCB locked.
+PDokanFCB FindFcb(__in PDokanVCB Vcb, __in PUNICODE_STRING FileName,
+                  __in ULONG Hash) {
+  BOOLEAN caseInSensitive =
+      !(Vcb->Dcb->MountOptions & DOKAN_EVENT_CASE_SENSITIVE);
+  PDOKAN_HASH_TABLE_LINK link;
+  for (link = DokanHashTableFind(&Vcb->FcbTable, Hash); link != NULL;
+       link = DokanHashTableFindNext(link)) {
+    PDokanFCB fcb = CONTAINING_RECORD(link, DokanFCB, FcbTableLink);
+    if (RtlEqualUnicodeString(&fcb->FileName, FileName, caseInSensitive)) {
+      return fcb;
+    }
+  }
+  return NULL;
+}
+
+// Adds the FCB to the table and grows the table if it got too loaded. Called
+// with the VCB locked RW.
+VOID InsertFcb(__in PDokanVCB Vcb, __in PDokanFCB Fcb, __in ULONG Hash) {
+  DokanHashTableInsert(&Vcb->FcbTable, &Fcb->FcbTableLink, Hash);
+  if (!DokanHashTableShouldGrow(&Vcb->FcbTable)) {
+    return;
+  }
+  ULONG bucketCount = Vcb->FcbTable.BucketCount * 4;
+  PDOKAN_HASH_TABLE_LINK *buckets =
+      DokanAllocZero(bucketCount * sizeof(PDOKAN_HASH_TABLE_LINK));
+  if (buckets == NULL) {
+    // Lookups get slower but keep working. Growing is tried again on the
+    // next insert.
+    return;
+  }
+  DOKAN_LOG_VCB(Vcb, "Growing FCB table to %lu buckets for %lu FCBs",
+                bucketCount, Vcb->FcbTable.Count);
+  buckets = DokanHashTableRehash(&Vcb->FcbTable, buckets, bucketCount);
+  if (buckets != Vcb->FcbTableInitialBuckets) {
+    ExFreePool(buckets);
+  }
+}
+
+VOID DokanFreeFcbTable(__in PDokanVCB Vcb) {
+  if (Vcb->FcbTable.Buckets != NULL &&
+      Vcb->FcbTable.Buckets != Vcb->FcbTableInitialBuckets) {
+    ExFreePool(Vcb->FcbTable.Buckets);
+  }
+  Vcb->FcbTable.Buckets = NULL;
+}
+
 PDokanFCB GetOrCreateUninitializedFcb(__in PREQUEST_CONTEXT RequestContext,
                                       __in PUNICODE_STRING FileName,
                                       __in PBOOLEAN NewElement) {
   PDokanFCB fcb = NULL;
+  ULONG hash = HashFcbFileName(RequestContext->Vcb, FileName);
+
+  fcb = FindFcb(RequestContext->Vcb, FileName, hash);
+  if (fcb != NULL) {
+    *NewElement = FALSE;
+    return fcb;
+  }
 
   fcb = ExAllocateFromLookasideListEx(&g_DokanFCBLookasideList);
   // Try again if garbage collection frees up space. This is a no-op when
@@ -97,16 +169,10 @@ PDokanFCB GetOrCreateUninitializedFcb(__in PREQUEST_CONTEXT RequestContext,
   RtlZeroMemory(fcb, sizeof(DokanFCB));
   fcb->FileName = *FileName;
 
-  PDokanFCB *fcbInTable = (PDokanFCB *)RtlInsertElementGenericTableAvl(
-      &RequestContext->Vcb->FcbTable, &fcb, sizeof(PDokanFCB), NewElement);
-  if (!fcbInTable) {
-    ExFreeToLookasideListEx(&g_DokanFCBLookasideList, fcb);
-    return NULL;
-  }
-  if (!(*NewElement)) {
-    ExFreeToLookasideListEx(&g_DokanFCBLookasideList, fcb);
-  }
-  return *fcbInTable;
+  DokanHashTableInitializeLink(&fcb->FcbTableLink);
+  InsertFcb(RequestContext->Vcb, fcb, hash);
+  *NewElement = TRUE;
+  return fcb;
 }
 
 PDokanFCB DokanGetFCB(__in PREQUEST_CONTEXT RequestContext,
@@ -131,10 +197,7 @@ PDokanFCB DokanGetFCB(__in PREQUEST_CONTEXT RequestContext,
     DOKAN_LOG_FINE_IRP(RequestContext, "New FCB %p allocated for %wZ", fcb,
                        &fcb->FileName);
     if (!DokanInitializeFcb(RequestContext, fcb)) {
-      BOOLEAN removed =
-          RtlDeleteElementGenericTableAvl(&RequestContext->Vcb->FcbTable, &fcb);
-      ASSERT(removed);
-      UNREFERENCED_PARAMETER(removed);
+      DokanHashTableRemove(&RequestContext->Vcb->FcbTable, &fcb->FcbTableLink);
       DOKAN_LOG_FINE_IRP(RequestContext, "Failed to init FCB %p for %wZ", fcb,
                          &fcb->FileName);
       ExFreePool(FileName);
@@ -228,9 +291,8 @@ VOID DokanDeleteFcb(__in PDokanVCB Vcb, __in PDokanFCB Fcb,
   ASSERT(Fcb->OpenCount == 0);
 
   if (DeleteFromTable) {
-    BOOLEAN removed = RtlDeleteElementGenericTableAvl(&Vcb->FcbTable, &Fcb);
-    ASSERT(removed);
-    UNREFERENCED_PARAMETER(removed);
+    ASSERT(DokanHashTableIsLinked(&Fcb->FcbTableLink));
+    DokanHashTableRemove(&Vcb->FcbTable, &Fcb->FcbTableLink);
   }
   ASSERT(IsListEmpty(&Fcb->NextCCB));
   InitializeListHead(&Fcb->NextCCB);
@@ -273,8 +335,9 @@ BOOLEAN DokanScheduleFcbForGarbageCollection(__in PDokanVCB Vcb,
                  L" already scheduled.");
     return TRUE;
   }
-  Fcb->GarbageCollectionGracePeriodPassed = FALSE;
-  InsertTailList(&Vcb->FcbGarbageList, &Fcb->NextGarbageCollectableFcb);
+  InsertTailList(&Vcb->FcbGarbageGenerations[Vcb->FcbGarbageCurrentGeneration],
+                 &Fcb->NextGarbageCollectableFcb);
+  ++Vcb->FcbGarbageCount;
   KeSetEvent(&Vcb->FcbGarbageListNotEmpty, IO_NO_INCREMENT, FALSE);
   return TRUE;
 }
@@ -290,7 +353,7 @@ VOID DokanCancelFcbGarbageCollection(__in PDokanFCB Fcb,
     Fcb->FileName = *NewFileName;
     RemoveEntryList(&Fcb->NextGarbageCollectableFcb);
     Fcb->NextGarbageCollectableFcb.Flink = NULL;
-    Fcb->GarbageCollectionGracePeriodPassed = FALSE;
+    --Fcb->Vcb->FcbGarbageCount;
     DokanFCBFlagsClearBit(Fcb, DOKAN_FCB_STATE_DELETE_PENDING);
     DokanFCBFlagsClearBit(Fcb, DOKAN_FILE_DIRECTORY);
     DokanFCBFlagsClearBit(Fcb, DOKAN_FILE_CHANGE_LAST_WRITE);
@@ -306,47 +369,63 @@ VOID DokanCancelFcbGarbageCollection(__in PDokanFCB Fcb,
 VOID GarbageCollectFCB(__in PDokanVCB Vcb, __in PDokanFCB Fcb,
                        __in BOOLEAN RemoveFromTable) {
   RemoveEntryList(&Fcb->NextGarbageCollectableFcb);
+  --Vcb->FcbGarbageCount;
   DokanFCBLockRW(Fcb);
   DokanDeleteFcb(Vcb, Fcb, RemoveFromTable);
 }
 
+// Called with the VCB locked. Deletes every FCB of the given garbage
+// generation and returns how many there were.
+ULONG DeleteFcbGarbageGeneration(__in PDokanVCB Vcb, __in ULONG Generation) {
+  PLIST_ENTRY generation = &Vcb->FcbGarbageGenerations[Generation];
+  PDokanFCB nextFcb = NULL;
+  ULONG deletedCount = 0;
+  while (!IsListEmpty(generation)) {
+    nextFcb = CONTAINING_RECORD(generation->Flink, DokanFCB,
+                                NextGarbageCollectableFcb);
+    GarbageCollectFCB(Vcb, nextFcb, /*RemoveFromTable=*/TRUE);
+    ++deletedCount;
+  }
+  return deletedCount;
+}
+
 // Called with the VCB locked. Immediately deletes the FCBs that are ready to
-// delete. Returns how many are skipped due to having been scheduled too
-// recently. If Force is TRUE then all the scheduled ones are deleted, and the
-// return value is 0.
+// delete, which are the ones of the oldest generation, and makes that
+// generation the current one. Returns how many are skipped due to having been
+// scheduled too recently. If Force is TRUE then all the scheduled ones are
+// deleted, and the return value is 0.
 ULONG DeleteFcbGarbageAndGetRemainingCount(__in PDokanVCB Vcb,
                                            __in BOOLEAN Force) {
-  ULONG remainingCount = 0;
-  PLIST_ENTRY thisEntry = NULL;
-  PLIST_ENTRY nextEntry = NULL;
-  PDokanFCB nextFcb = NULL;
-  for (thisEntry = Vcb->FcbGarbageList.Flink; thisEntry != &Vcb->FcbGarbageList;
-       thisEntry = nextEntry) {
-    nextEntry = thisEntry->Flink;
-    nextFcb = CONTAINING_RECORD(thisEntry, DokanFCB, NextGarbageCollectableFcb);
-    // We want it to have been scheduled for at least one timer interval so
-    // that there is a guaranteed window of possible reuse, which achieves the
-    // performance gains we are aiming for with GC.
-    if (Force || nextFcb->GarbageCollectionGracePeriodPassed) {
-      GarbageCollectFCB(Vcb, nextFcb, /*RemoveFromTable=*/TRUE);
-    } else {
-      nextFcb->GarbageCollectionGracePeriodPassed = TRUE;
-      ++remainingCount;
+  ULONG generation = 0;
+  if (Force) {
+    for (generation = 0; generation < DOKAN_FCB_GARBAGE_GENERATION_COUNT;
+         ++generation) {
+      DeleteFcbGarbageGeneration(Vcb, generation);
     }
+  } else {
+    // We want each FCB to have been scheduled for at least one timer interval
+    // so that there is a guaranteed window of possible reuse, which achieves
+    // the performance gains we are aiming for with GC. The generation after
+    // the current one is the oldest, and got filled at least one interval ago.
+    generation = (Vcb->FcbGarbageCurrentGeneration + 1) %
+                 DOKAN_FCB_GARBAGE_GENERATION_COUNT;
+    Vcb->VolumeMetrics.NormalFcbGarbageCollectionDeletions +=
+        DeleteFcbGarbageGeneration(Vcb, generation);
+    Vcb->FcbGarbageCurrentGeneration = generation;
   }
-  ASSERT(!Force || remainingCount == 0);
+  ASSERT(!Force || Vcb->FcbGarbageCount == 0);
+  Vcb->VolumeMetrics.PendingGarbageFcbs = Vcb->FcbGarbageCount;
   // When an FCB gets deleted by a GC cycle already in progress at the time of
   // its scheduling, there's no point in triggering a follow-up cycle for that
   // one.
-  if (remainingCount == 0) {
+  if (Vcb->FcbGarbageCount == 0) {
     KeClearEvent(&Vcb->FcbGarbageListNotEmpty);
   }
-  return remainingCount;
+  return Vcb->FcbGarbageCount;
 }
 
 BOOLEAN DokanForceFcbGarbageCollection(__in PDokanVCB Vcb) {
-  if (Vcb->FcbGarbageCollectorThread == NULL ||
-      IsListEmpty(&Vcb->FcbGarbageList)) {
+  if (Vcb->FcbGarbageCollectorThread == NULL || Vcb->FcbGarbageCount == 0) {
     return FALSE;
   }
   ++Vcb->VolumeMetrics.ForcedFcbGarbageCollectionPasses;
@@ -354,6 +433,57 @@ BOOLEAN DokanForceFcbGarbageCollection(__in PDokanVCB Vcb) {
   return TRUE;
 }
 
+// FCB allocation rate, per second, above which the GC interval is halved so
+// that the garbage does not pile up. The interval is doubled back towards the
+// configured one when the rate falls below a quarter of it.
+#define FCB_GARBAGE_PRESSURE_ALLOCATIONS_PER_SECOND 1024
+
+// Called with the VCB locked after a normal pass. If MeasurePressure is TRUE,
+// adapts the GC interval to the FCB allocations and forced passes since the
+// previous pass, which happened one interval ago. Returns the new interval, or
+// 0 if it did not change.
+ULONG AdaptFcbGarbageCollectionInterval(__in PDokanVCB Vcb,
+                                        __in BOOLEAN MeasurePressure) {
+  ULONG64 allocations = Vcb->VolumeMetrics.FcbAllocations -
+                        Vcb->FcbAllocationsAtLastGarbagePass;
+  ULONG64 forcedPasses = Vcb->VolumeMetrics.ForcedFcbGarbageCollectionPasses -
+                         Vcb->ForcedFcbGarbagePassesAtLastGarbagePass;
+  ULONG intervalMs = Vcb->FcbGarbageCollectionIntervalMs;
+  ULONG64 allocationsPerSecond = allocations * 1000 / intervalMs;
+  Vcb->FcbAllocationsAtLastGarbagePass = Vcb->VolumeMetrics.FcbAllocations;
+  Vcb->ForcedFcbGarbagePassesAtLastGarbagePass =
+      Vcb->VolumeMetrics.ForcedFcbGarbageCollectionPasses;
+  if (!MeasurePressure) {
+    return 0;
+  }
+  if (forcedPasses > 0 ||
+      allocationsPerSecond >= FCB_GARBAGE_PRESSURE_ALLOCATIONS_PER_SECOND) {
+    intervalMs = max(intervalMs / 2, MIN_FCB_GARBAGE_COLLECTION_INTERVAL);
+  } else if (allocationsPerSecond <
+             FCB_GARBAGE_PRESSURE_ALLOCATIONS_PER_SECOND / 4) {
+    intervalMs = min(intervalMs * 2, Vcb->Dcb->FcbGarbageCollectionIntervalMs);
+  }
+  if (intervalMs == Vcb->FcbGarbageCollectionIntervalMs) {
+    return 0;
+  }
+  if (intervalMs < Vcb->FcbGarbageCollectionIntervalMs) {
+    ++Vcb->VolumeMetrics.FcbGarbageCollectionIntervalDecreases;
+  } else {
+    ++Vcb->VolumeMetrics.FcbGarbageCollectionIntervalIncreases;
+  }
+  Vcb->FcbGarbageCollectionIntervalMs = intervalMs;
+  Vcb->VolumeMetrics.FcbGarbageCollectionIntervalMs = intervalMs;
+  return intervalMs;
+}
+
+// Arms the GC interval timer to fire every IntervalMs, starting IntervalMs
+// from now.
+VOID SetFcbGarbageCollectionTimer(__in PKTIMER Timer, __in ULONG IntervalMs) {
+  LARGE_INTEGER dueTime;
+  dueTime.QuadPart = -(LONGLONG)IntervalMs * 10000;
+  KeSetTimerEx(Timer, dueTime, IntervalMs, NULL);
+}
+
 // Called when there are no pending garbage FCBs and we may need to wait
 // indefinitely for one to appear.
 NTSTATUS WaitForNewFcbGarbage(__in PDokanVCB Vcb) {
@@ -371,6 +501,7 @@ NTSTATUS WaitForNewFcbGarbage(__in PDokanVCB Vcb) {
 NTSTATUS AgeAndDeleteFcbGarbage(__in PDokanVCB Vcb, __in PKTIMER Timer) {
   NTSTATUS status = STATUS_INVALID_PARAMETER;
   ULONG pendingCount = 0;
+  ULONG newIntervalMs = 0;
   PVOID events[2];
   BOOLEAN waited = FALSE;
   events[0] = &Vcb->Dcb->ReleaseEvent;
@@ -381,7 +512,16 @@ NTSTATUS AgeAndDeleteFcbGarbage(__in PDokanVCB Vcb, __in PKTIMER Timer) {
     DokanVCBLockRW(Vcb);
     ++Vcb->VolumeMetrics.NormalFcbGarbageCollectionPasses;
     pendingCount = DeleteFcbGarbageAndGetRemainingCount(Vcb, /*Force=*/FALSE);
+    // The first pass of a cycle follows an indefinite wait, so the pressure is
+    // only measured over the timer intervals.
+    newIntervalMs =
+        AdaptFcbGarbageCollectionInterval(Vcb, /*MeasurePressure=*/waited);
     DokanVCBUnlock(Vcb);
+    if (newIntervalMs != 0) {
+      DOKAN_LOG_("FCB garbage collection interval is now %lu ms",
+                 newIntervalMs);
+      SetFcbGarbageCollectionTimer(Timer, newIntervalMs);
+    }
     // If we have cleared out all the garbage, return so the garbage collector
     // will do an indefinite wait for new garbage. But we wait at least once on
     // the GC interval timer to avoid having multiple no-op cycles in one
@@ -407,13 +547,12 @@ NTSTATUS AgeAndDeleteFcbGarbage(__in PDokanVCB Vcb, __in PKTIMER Timer) {
 VOID FcbGarbageCollectorThread(__in PVOID pVcb) {
   KTIMER timer;
   NTSTATUS status = STATUS_INVALID_PARAMETER;
-  LARGE_INTEGER timeout = {0};
   PDokanVCB Vcb = pVcb;
   DOKAN_INIT_LOGGER(logger, Vcb->Dcb->DeviceObject->DriverObject, 0);
   KeInitializeTimerEx(&timer, SynchronizationTimer);
-  KeSetTimerEx(&timer, timeout, Vcb->Dcb->FcbGarbageCollectionIntervalMs, NULL);
+  SetFcbGarbageCollectionTimer(&timer, Vcb->FcbGarbageCollectionIntervalMs);
   DokanLogInfo(&logger, L"Starting FCB garbage collector with %lu ms interval.",
-               Vcb->Dcb->FcbGarbageCollectionIntervalMs);
+               Vcb->FcbGarbageCollectionIntervalMs);
   for (;;) {
     status = WaitForNewFcbGarbage(Vcb);
     if (status != STATUS_SUCCESS) {
@@ -448,74 +587,58 @@ void DokanStartFcbGarbageCollector(PDokanVCB Vcb) {
   ZwClose(thread);
 }
 
-RTL_GENERIC_COMPARE_RESULTS DokanCompareFcb(__in struct _RTL_AVL_TABLE *Table,
-                                            __in PVOID FirstStruct,
-                                            __in PVOID SecondStruct) {
-  PDokanVCB vcb = (PDokanVCB)Table->TableContext;
-  PDokanFCB firstFcb = *(PDokanFCB *)FirstStruct;
-  PDokanFCB secondFcb = *(PDokanFCB *)SecondStruct;
-  LONG result = RtlCompareUnicodeString(
-      &firstFcb->FileName, &secondFcb->FileName,
-      !(vcb->Dcb->MountOptions & DOKAN_EVENT_CASE_SENSITIVE));
-  DOKAN_LOG_VCB(vcb, "First: %p %wZ Second: %p %wZ - Result: %ld", firstFcb,
-                &firstFcb->FileName, secondFcb, &secondFcb->FileName, result);
-  if (result < 0) {
-    return GenericLessThan;
-  } else if (result > 0) {
-    return GenericGreaterThan;
-  }
-  return GenericEqual;
-}
+VOID DokanRenameFcb(__in PREQUEST_CONTEXT RequestContext, __in PDokanFCB Fcb,
+                    __in PWCH FileName, __in USHORT FileNameLength) {
+  ASSERT(DokanHashTableIsLinked(&Fcb->FcbTableLink));
+  DokanHashTableRemove(&RequestContext->Vcb->FcbTable, &Fcb->FcbTableLink);
 
-PVOID DokanAllocateFcbAvl(__in struct _RTL_AVL_TABLE *Table,
-                          __in CLONG ByteSize) {
-  PDokanVCB vcb = (PDokanVCB)Table->TableContext;
-  if (!vcb->FCBAvlNodeLookasideListInit) {
-    if (!DokanLookasideCreate(&vcb->FCBAvlNodeLookasideList, ByteSize)) {
-      DOKAN_LOG_VCB(vcb,
-                    "DokanLookasideCreate VCB FCBAvlNodeLookasideList failed.");
-      return NULL;
+  Fcb->FileName = DokanWrapUnicodeString(FileName, FileNameLength);
+  ++Fcb->FileNameGeneration;
+
+  ULONG hash = HashFcbFileName(RequestContext->Vcb, &Fcb->FileName);
+  PDokanFCB conflictingFcb =
+      FindFcb(RequestContext->Vcb, &Fcb->FileName, hash);
+  if (conflictingFcb != NULL) {
+    ASSERT(!conflictingFcb->ReplacedByRename);
+    // An Fcb with the same name already exists in the table and needs to be
+    // removed to allow the new Fcb to take over.
+    DokanHashTableRemove(&RequestContext->Vcb->FcbTable,
+                         &conflictingFcb->FcbTableLink);
+    if (conflictingFcb->NextGarbageCollectableFcb.Flink) {
+      // The Fcb is pending GC. Force it's deletion now.
+      GarbageCollectFCB(RequestContext->Vcb, conflictingFcb,
+                        /*RemoveFromTable=*/FALSE);
+    } else {
+      // This cannot happen on NTFS. See Fcb::PendingDeletion doc.
+      conflictingFcb->ReplacedByRename = TRUE;
     }
-    vcb->FCBAvlNodeLookasideListInit = TRUE;
   }
-  return ExAllocateFromLookasideListEx(&vcb->FCBAvlNodeLookasideList);
-}
 
-VOID DokanFreeFcbAvl(__in struct _RTL_AVL_TABLE *Table, __in PVOID Buffer) {
-  PDokanVCB vcb = (PDokanVCB)Table->TableContext;
-  ExFreeToLookasideListEx(&vcb->FCBAvlNodeLookasideList, Buffer);
+  // Reinsert the Fcb with the updated name
+  InsertFcb(RequestContext->Vcb, Fcb, hash);
 }
 
-VOID DokanRenameFcb(__in PREQUEST_CONTEXT RequestContext, __in PDokanFCB Fcb,
-                    __in PWCH FileName, __in USHORT FileNameLength) {
-  BOOLEAN removed =
-      RtlDeleteElementGenericTableAvl(&RequestContext->Vcb->FcbTable, &Fcb);
-  ASSERT(removed);
-  UNREFERENCED_PARAMETER(removed);
-
-  Fcb->FileName = DokanWrapUnicodeString(FileName, FileNameLength);
-
-  BOOLEAN newElement = FALSE;
-  PDokanFCB *fcbInTable = (PDokanFCB *)RtlInsertElementGenericTableAvl(
-      &RequestContext->Vcb->FcbTable, &Fcb, sizeof(PDokanFCB), &newElement);
-  ASSERT(fcbInTable);
-  if (newElement) {
-    return;
+USHORT DokanGetIoEventFileNameLength(__in PDokanDCB Dcb, __in PDokanCCB Ccb) {
+  PDokanFCB fcb = Ccb->Fcb;
+  if (Dcb->OmitIoEventFileNames &&
+      (ULONG)Ccb->FileNameGeneration == fcb->FileNameGeneration) {
+    return 0;
   }
+  return fcb->FileName.Length;
+}
 
-  PDokanFCB conflictingFcb = *fcbInTable;
-  ASSERT(!conflictingFcb->ReplacedByRename);
-  // An Fcb with the same name already exists in the table and needs to be
-  // removed to allow the new Fcb to take over.
-  if (conflictingFcb->NextGarbageCollectableFcb.Flink) {
-    // The Fcb is pending GC. Force it's deletion now.
-    GarbageCollectFCB(RequestContext->Vcb, conflictingFcb,
-                      /*RemoveFromTable=*/FALSE);
-  } else {
-    // This cannot happen on NTFS. See Fcb::PendingDeletion doc.
-    conflictingFcb->ReplacedByRename = TRUE;
+VOID DokanAcknowledgeIoEventFileName(__in_opt PDokanCCB Ccb,
+                                     __in ULONG FileNameGeneration) {
+  LONG acknowledged;
+  if (Ccb == NULL) {
+    return;
   }
-
-  // Reinsert the Fcb with the updated name
-  *fcbInTable = Fcb;
-}
\ No newline at end of file
+  do {
+    acknowledged = Ccb->FileNameGeneration;
+    if ((LONG)(FileNameGeneration - (ULONG)acknowledged) <= 0) {
+      return;
+    }
+  } while (InterlockedCompareExchange(&Ccb->FileNameGeneration,
+                                      (LONG)FileNameGeneration,
+                                      acknowledged) != acknowledged);
+}
@@ -69,19 +69,23 @@ BOOLEAN DokanForceFcbGarbageCollection(__in PDokanVCB Vcb);
 VOID DokanDeleteFcb(__in PDokanVCB Vcb, __in PDokanFCB Fcb,
                     __in BOOLEAN RemoveFromTable);
 
-// Comparison callback routine for the AVL table.
-// Both pointers are FCB. Return the compare result based on the FileName.
-RTL_GENERIC_COMPARE_RESULTS DokanCompareFcb(__in struct _RTL_AVL_TABLE* Table,
-                                            __in PVOID FirstStruct,
-                                            __in PVOID SecondStruct);
-
-// Allocation callback routine for the AVL table.
-// The size requested contains the AVL node header and the data.
-PVOID DokanAllocateFcbAvl(__in struct _RTL_AVL_TABLE* Table,
-                          __in CLONG ByteSize);
-
-// Deallocation callback routine for the AVL table.
-VOID DokanFreeFcbAvl(__in struct _RTL_AVL_TABLE* Table, __in PVOID Buffer);
+// Frees the buckets the FCB table of the volume allocated as it grew. Called
+// when the volume device is deleted.
+VOID DokanFreeFcbTable(__in PDokanVCB Vcb);
+
+// Returns the length of the file name to send in the read, write, flush and
+// query information events of the given open. When the volume omits the file
+// names of these events, this is 0 unless the file got renamed since user
+// mode acknowledged the name of the open. Until then every event carries it,
+// so that events failing or completing out of order cannot lose the name.
+// The FCB must be locked.
+USHORT DokanGetIoEventFileNameLength(__in PDokanDCB Dcb, __in PDokanCCB Ccb);
+
+// Records that user mode received the file name of the open at the given
+// FileNameGeneration, from the reply of an event built with it. Replies
+// arriving out of order never move the acknowledged generation backward.
+VOID DokanAcknowledgeIoEventFileName(__in_opt PDokanCCB Ccb,
+                                     __in ULONG FileNameGeneration);
 
 // Update the filename of the given Fcb.
 // The Vcb & Fcb must be acquired priore to the call.
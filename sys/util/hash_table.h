@@ -0,0 +1,188 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HASH_TABLE_H_
+#define HASH_TABLE_H_
+
+// Table of objects keyed by a 32-bit hash computed by the caller, like the
+// FCBs keyed by the hash of their case-folded file name.
+//
+// The table only compares hashes: the caller walks the entries having the
+// hash it looks for and compares the actual keys. Each bucket is a
+// NULL-terminated list whose entries also point to the pointer referencing
+// them, so that an entry is removed in O(1) without knowing its bucket.
+// Entries are intrusive and the table does not allocate, nor lock: the caller
+// provides both, and provides a bigger bucket array through
+// DokanHashTableRehash when DokanHashTableShouldGrow says so.
+//
+// The header only relies on the base Windows types so that it can be built
+// outside of the kernel.
+
+// Average number of entries per bucket above which the table should grow.
+#define DOKAN_HASH_TABLE_MAX_LOAD 2
+
+// FNV-1a parameters used by DokanHashTableHashChar.
+#define DOKAN_HASH_TABLE_HASH_INIT 2166136261UL
+#define DOKAN_HASH_TABLE_HASH_PRIME 16777619UL
+
+typedef struct _DOKAN_HASH_TABLE_LINK {
+  struct _DOKAN_HASH_TABLE_LINK* Next;
+  // Pointer referencing this entry: the bucket or Next of the previous entry.
+  // NULL when the entry is not in a table.
+  struct _DOKAN_HASH_TABLE_LINK** Referer;
+  ULONG Hash;
+} DOKAN_HASH_TABLE_LINK, *PDOKAN_HASH_TABLE_LINK;
+
+typedef struct _DOKAN_HASH_TABLE {
+  PDOKAN_HASH_TABLE_LINK* Buckets;
+  // Must be a power of 2.
+  ULONG BucketCount;
+  ULONG Count;
+} DOKAN_HASH_TABLE, *PDOKAN_HASH_TABLE;
+
+// Adds Char to Hash. Hashing a key starts with DOKAN_HASH_TABLE_HASH_INIT.
+inline ULONG DokanHashTableHashChar(__in ULONG Hash, __in WCHAR Char) {
+  Hash = (Hash ^ (Char & 0xFF)) * DOKAN_HASH_TABLE_HASH_PRIME;
+  return (Hash ^ ((Char >> 8) & 0xFF)) * DOKAN_HASH_TABLE_HASH_PRIME;
+}
+
+inline VOID DokanHashTableInitializeLink(__out PDOKAN_HASH_TABLE_LINK Link) {
+  Link->Next = NULL;
+  Link->Referer = NULL;
+  Link->Hash = 0;
+}
+
+inline BOOLEAN DokanHashTableIsLinked(__in PDOKAN_HASH_TABLE_LINK Link) {
+  return Link->Referer != NULL;
+}
+
+// Initializes the table with the given zeroed array of BucketCount buckets.
+inline VOID DokanHashTableInitialize(__out PDOKAN_HASH_TABLE Table,
+                                     __in PDOKAN_HASH_TABLE_LINK* Buckets,
+                                     __in ULONG BucketCount) {
+  Table->Buckets = Buckets;
+  Table->BucketCount = BucketCount;
+  Table->Count = 0;
+}
+
+inline PDOKAN_HASH_TABLE_LINK* DokanHashTableBucket(
+    __in PDOKAN_HASH_TABLE Table, __in ULONG Hash) {
+  return &Table->Buckets[Hash & (Table->BucketCount - 1)];
+}
+
+inline VOID DokanHashTablePush(__inout PDOKAN_HASH_TABLE_LINK* Bucket,
+                               __inout PDOKAN_HASH_TABLE_LINK Link) {
+  Link->Next = *Bucket;
+  if (Link->Next) {
+    Link->Next->Referer = &Link->Next;
+  }
+  Link->Referer = Bucket;
+  *Bucket = Link;
+}
+
+// Adds Link to the table. The link must not be in a table already.
+inline VOID DokanHashTableInsert(__inout PDOKAN_HASH_TABLE Table,
+                                 __inout PDOKAN_HASH_TABLE_LINK Link,
+                                 __in ULONG Hash) {
+  Link->Hash = Hash;
+  DokanHashTablePush(DokanHashTableBucket(Table, Hash), Link);
+  ++Table->Count;
+}
+
+// Removes Link from the table. Does nothing if it is not in it.
+inline VOID DokanHashTableRemove(__inout PDOKAN_HASH_TABLE Table,
+                                 __inout PDOKAN_HASH_TABLE_LINK Link) {
+  if (!DokanHashTableIsLinked(Link)) {
+    return;
+  }
+  *Link->Referer = Link->Next;
+  if (Link->Next) {
+    Link->Next->Referer = Link->Referer;
+  }
+  Link->Next = NULL;
+  Link->Referer = NULL;
+  --Table->Count;
+}
+
+// Returns the first entry following Link, included, that has Hash, or NULL.
+inline PDOKAN_HASH_TABLE_LINK DokanHashTableMatch(
+    __in_opt PDOKAN_HASH_TABLE_LINK Link, __in ULONG Hash) {
+  while (Link && Link->Hash != Hash) {
+    Link = Link->Next;
+  }
+  return Link;
+}
+
+// Returns the first entry having Hash, or NULL. The following ones are
+// returned by DokanHashTableFindNext.
+inline PDOKAN_HASH_TABLE_LINK DokanHashTableFind(__in PDOKAN_HASH_TABLE Table,
+                                                 __in ULONG Hash) {
+  return DokanHashTableMatch(*DokanHashTableBucket(Table, Hash), Hash);
+}
+
+inline PDOKAN_HASH_TABLE_LINK DokanHashTableFindNext(
+    __in PDOKAN_HASH_TABLE_LINK Link) {
+  return DokanHashTableMatch(Link->Next, Link->Hash);
+}
+
+// Returns the entry following Link in the table, or the first entry when Link
+// is NULL, or NULL after the last entry. The table must not be modified
+// during the enumeration.
+inline PDOKAN_HASH_TABLE_LINK DokanHashTableEnumerate(
+    __in PDOKAN_HASH_TABLE Table, __in_opt PDOKAN_HASH_TABLE_LINK Link) {
+  ULONG bucket = 0;
+  if (Link) {
+    if (Link->Next) {
+      return Link->Next;
+    }
+    bucket = (Link->Hash & (Table->BucketCount - 1)) + 1;
+  }
+  for (; bucket < Table->BucketCount; ++bucket) {
+    if (Table->Buckets[bucket]) {
+      return Table->Buckets[bucket];
+    }
+  }
+  return NULL;
+}
+
+inline BOOLEAN DokanHashTableShouldGrow(__in PDOKAN_HASH_TABLE Table) {
+  return Table->Count > Table->BucketCount * DOKAN_HASH_TABLE_MAX_LOAD;
+}
+
+// Moves every entry to the given zeroed array of BucketCount buckets and
+// returns the previous array, which the caller then owns.
+inline PDOKAN_HASH_TABLE_LINK* DokanHashTableRehash(
+    __inout PDOKAN_HASH_TABLE Table, __in PDOKAN_HASH_TABLE_LINK* Buckets,
+    __in ULONG BucketCount) {
+  PDOKAN_HASH_TABLE_LINK* oldBuckets = Table->Buckets;
+  ULONG oldBucketCount = Table->BucketCount;
+  Table->Buckets = Buckets;
+  Table->BucketCount = BucketCount;
+  for (ULONG i = 0; i < oldBucketCount; ++i) {
+    while (oldBuckets[i]) {
+      PDOKAN_HASH_TABLE_LINK link = oldBuckets[i];
+      oldBuckets[i] = link->Next;
+      DokanHashTablePush(DokanHashTableBucket(Table, link->Hash), link);
+    }
+  }
+  return oldBuckets;
+}
+
+#endif
@@ -23,6 +23,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "../dokan.h"
 #include "log.h"
+#include "trace_ring.h"
 
 #include <mountdev.h>
 #include <ntdddisk.h>
@@ -38,16 +39,20 @@ ULONG g_Debug = DOKAN_DEBUG_DEFAULT;
 BOOLEAN g_DokanDriverLogCacheEnabled = FALSE;
 // Number of current Dokan Volume having Drive log caching enabled.
 LONG g_DokanVcbDriverLogCacheCount = 0;
-DOKAN_LOG_CACHE g_DokanLogEntryList;
+// One trace ring per processor, allocated when the log caching gets enabled.
+PDOKAN_TRACE_RING g_DokanTraceRings = NULL;
+ULONG g_DokanTraceRingCount = 0;
 
 VOID PopDokanLogEntry(_In_opt_ PVOID RequestContext, _In_ PDokanVCB Vcb);
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text(PAGE, PushDokanLogEntry)
+#pragma alloc_text(PAGE, PushDokanTraceRecord)
 #pragma alloc_text(PAGE, PopDokanLogEntry)
 #pragma alloc_text(PAGE, CleanDokanLogEntry)
 #endif
 
-#define DOKAN_LOG_MAX_ENTRY_CACHED 1024
+// Size of the records sent by a single DOKAN_IRP_LOG_MESSAGE event.
+#define DOKAN_LOG_MESSAGE_RECORDS_SIZE 2048
 
 #define DOKAN_LOG_MAX_CHAR_COUNT 2048
 #define DOKAN_LOG_MAX_PACKET_BYTES \
@@ -492,110 +497,176 @@ PCHAR DokanGetIoctlStr(ULONG ControlCode) {
   return "Unknown";
 }
 
+// Stamps the record and writes it to the trace ring of the current processor,
+// then dispatches the pending logs when the log belongs to a volume.
+static VOID WriteDokanTraceRecord(_In_opt_ PREQUEST_CONTEXT RequestContext,
+                                  _Inout_ PDOKAN_TRACE_RECORD Record) {
+  LARGE_INTEGER sysTime;
+  LARGE_INTEGER localTime;
+  PDOKAN_TRACE_RING rings = g_DokanTraceRings;
+  ULONG processor;
+
+  if (!rings) {
+    return;
+  }
+
+  processor = KeGetCurrentProcessorNumberEx(NULL);
+  DokanQuerySystemTime(&sysTime);
+  ExSystemTimeToLocalTime(&sysTime, &localTime);
+  Record->Processor = processor;
+  Record->Timestamp = localTime.QuadPart;
+  if (RequestContext) {
+    Record->Irp = (ULONG64)(ULONG_PTR)RequestContext->Irp;
+    Record->ProcessId = RequestContext->ProcessId;
+  }
+
+  DokanTraceRingWrite(&rings[processor % g_DokanTraceRingCount],
+                      RequestContext ? RequestContext->Vcb : NULL, Record,
+                      Record->Size);
+
+  if (RequestContext && RequestContext->Vcb && RequestContext->Vcb->Dcb) {
+    PopDokanLogEntry(RequestContext, RequestContext->Vcb);
+  }
+}
+
+// Is that a global log or a Vcb log that has driver log disptached enabled ?
+static BOOLEAN
+IsDokanLogDispatched(_In_opt_ PREQUEST_CONTEXT RequestContext) {
+  return !RequestContext || !RequestContext->Vcb ||
+         !RequestContext->Vcb->Dcb ||
+         RequestContext->Vcb->Dcb->DispatchDriverLogs;
+}
+
 VOID PushDokanLogEntry(_In_opt_ PVOID RequestContext, _In_ PCSTR Format, ...) {
   PREQUEST_CONTEXT requestContext = RequestContext;
-  PDOKAN_LOG_ENTRY logEntry;
+  ULONG64 buffer[DOKAN_TRACE_RING_MAX_RECORD_SIZE / sizeof(ULONG64)];
+  PDOKAN_TRACE_RECORD record = (PDOKAN_TRACE_RECORD)buffer;
+  PSTR textEnd = NULL;
+  va_list args;
+  NTSTATUS status;
 
   PAGED_CODE();
 
-  // Is that a global log or a Vcb log that has driver log disptached
-  // enabled ?
-  if (requestContext && requestContext->Vcb && requestContext->Vcb->Dcb &&
-      !requestContext->Vcb->Dcb->DispatchDriverLogs) {
+  if (!IsDokanLogDispatched(requestContext)) {
     return;
   }
 
-  __try {
-    DokanResourceLockRW(&(g_DokanLogEntryList.Resource));
-    if (g_DokanLogEntryList.NumberOfCachedEntries >=
-        DOKAN_LOG_MAX_ENTRY_CACHED) {
-      ASSERT(!IsListEmpty(&g_DokanLogEntryList.Log));
-      PLIST_ENTRY listEntry = g_DokanLogEntryList.Log.Flink;
-      RemoveEntryList(listEntry);
-      logEntry = CONTAINING_RECORD(listEntry, DOKAN_LOG_ENTRY, ListEntry);
-      ExFreePool(logEntry);
-      --g_DokanLogEntryList.NumberOfCachedEntries;
-    }
+  RtlZeroMemory(record, DOKAN_TRACE_RECORD_HEADER_SIZE);
+  record->EventId = DOKAN_TRACE_TEXT;
+  va_start(args, Format);
+  status = RtlStringCchVPrintfExA(
+      record->Text,
+      DOKAN_TRACE_RING_MAX_RECORD_SIZE - DOKAN_TRACE_RECORD_HEADER_SIZE,
+      &textEnd, NULL, 0, Format, args);
+  va_end(args);
+  if (status != STATUS_SUCCESS && status != STATUS_BUFFER_OVERFLOW) {
+    return;
+  }
+  record->Size =
+      (USHORT)(DOKAN_TRACE_RECORD_HEADER_SIZE + (textEnd - record->Text));
+  WriteDokanTraceRecord(requestContext, record);
+}
 
-    logEntry =
-        DokanAllocZero(sizeof(DOKAN_LOG_ENTRY) + DOKAN_LOG_MAX_CHAR_COUNT);
-    if (!logEntry) {
-      DOKAN_NO_CACHE_LOG("Failed to allocate DOKAN_LOG_ENTRY");
-      __leave;
-    }
-    InitializeListHead(&logEntry->ListEntry);
-    if (requestContext) {
-      logEntry->Vcb = requestContext->Vcb;
-    }
+VOID PushDokanTraceRecord(_In_opt_ PVOID RequestContext, _In_ USHORT EventId,
+                          _In_ NTSTATUS Status, _In_ ULONG64 Arg0,
+                          _In_ ULONG64 Arg1, _In_ ULONG64 Arg2) {
+  PREQUEST_CONTEXT requestContext = RequestContext;
+  DOKAN_TRACE_RECORD record;
 
-    PSTR ppszDestEnd = NULL;
-    va_list args;
-    va_start(args, Format);
-    NTSTATUS status =
-        RtlStringCchVPrintfExA(logEntry->Log.Message, DOKAN_LOG_MAX_CHAR_COUNT,
-                               &ppszDestEnd, NULL, 0, Format, args);
-    logEntry->Log.MessageLength = (ULONG)(ppszDestEnd - logEntry->Log.Message);
-    va_end(args);
-    if (status != STATUS_SUCCESS && status != STATUS_BUFFER_OVERFLOW) {
-      ExFreePool(logEntry);
-      __leave;
-    }
+  PAGED_CODE();
 
-    ++g_DokanLogEntryList.NumberOfCachedEntries;
-    InsertTailList(&g_DokanLogEntryList.Log, &logEntry->ListEntry);
+  if (!IsDokanLogDispatched(requestContext)) {
+    return;
+  }
 
-    if (requestContext && requestContext->Vcb && requestContext->Vcb->Dcb) {
-      PopDokanLogEntry(requestContext, requestContext->Vcb);
-    }
-  } __finally {
-    DokanResourceUnlock(&(g_DokanLogEntryList.Resource));
+  RtlZeroMemory(&record, sizeof(DOKAN_TRACE_RECORD));
+  record.Size = DOKAN_TRACE_RECORD_HEADER_SIZE;
+  record.EventId = EventId;
+  record.Status = Status;
+  record.Args[0] = Arg0;
+  record.Args[1] = Arg1;
+  record.Args[2] = Arg2;
+  WriteDokanTraceRecord(requestContext, &record);
+}
+
+static VOID SendDokanLogMessage(_In_ PVOID RequestContext,
+                                _In_ PDokanVCB Vcb,
+                                _In_ PEVENT_CONTEXT EventContext,
+                                _In_ PDOKAN_TRACE_RING_CURSOR Cursor) {
+  PDOKAN_LOG_MESSAGE logMessage =
+      (PDOKAN_LOG_MESSAGE)((PCHAR)EventContext + sizeof(EVENT_CONTEXT));
+  if (!logMessage->RecordsLength) {
+    DokanFreeEventContext(EventContext);
+    return;
   }
+  logMessage->DroppedRecords = Cursor->Dropped;
+  Cursor->Dropped = 0;
+  EventContext->Length = sizeof(EVENT_CONTEXT) +
+                         FIELD_OFFSET(DOKAN_LOG_MESSAGE, Records[0]) +
+                         logMessage->RecordsLength;
+  DokanEventNotification(RequestContext, &Vcb->Dcb->NotifyEvent, EventContext);
 }
 
-// Dispatch global and specific Vcb log messages from global
-// log entry cache list to userland.
-// Need to be called with g_DokanLogEntryList Lock RW.
+// Dispatch global and specific Vcb log records from the trace rings to
+// userland. Rings the Vcb is reading from another thread are left to it.
 VOID PopDokanLogEntry(_In_opt_ PVOID RequestContext, _In_ PDokanVCB Vcb) {
-  PLIST_ENTRY listEntry;
-  PLIST_ENTRY nextListEntry;
-  PDOKAN_LOG_ENTRY logEntry;
-  PDOKAN_LOG_MESSAGE dokanLogString;
-  ULONG messageFullSize;
+  PDOKAN_TRACE_RING rings = g_DokanTraceRings;
+  PDOKAN_TRACE_RING_CURSOR cursors = Vcb->TraceCursors;
+  PEVENT_CONTEXT eventContext;
+  PDOKAN_LOG_MESSAGE logMessage;
+  ULONG recordSize;
 
   PAGED_CODE();
 
-  listEntry = g_DokanLogEntryList.Log.Flink;
-  while (listEntry != &(g_DokanLogEntryList.Log)) {
-    logEntry = CONTAINING_RECORD(listEntry, DOKAN_LOG_ENTRY, ListEntry);
+  if (!RequestContext || !rings || !cursors) {
+    return;
+  }
 
-    // Only Pop global and the Vcb logs.
-    if (logEntry->Vcb != NULL && logEntry->Vcb != Vcb) {
-      listEntry = listEntry->Flink;
+  for (ULONG i = 0; i < g_DokanTraceRingCount; ++i) {
+    PDOKAN_TRACE_RING ring = &rings[i];
+    PDOKAN_TRACE_RING_CURSOR cursor = &cursors[i];
+    if (DokanTraceRingIsEmpty(ring, cursor) ||
+        !DokanTraceRingTryBeginRead(cursor)) {
       continue;
     }
-
-    messageFullSize = logEntry->Log.MessageLength +
-                      FIELD_OFFSET(DOKAN_LOG_MESSAGE, Message[0]);
-    PEVENT_CONTEXT eventContext =
-        AllocateEventContextRaw(sizeof(EVENT_CONTEXT) + messageFullSize);
-    if (!eventContext) {
-      return;
+    eventContext = NULL;
+    logMessage = NULL;
+    for (;;) {
+      if (!eventContext) {
+        if (DokanTraceRingIsEmpty(ring, cursor)) {
+          break;
+        }
+        eventContext = AllocateEventContextRaw(
+            sizeof(EVENT_CONTEXT) + FIELD_OFFSET(DOKAN_LOG_MESSAGE, Records[0]) +
+            DOKAN_LOG_MESSAGE_RECORDS_SIZE);
+        if (!eventContext) {
+          break;
+        }
+        eventContext->MountId = Vcb->Dcb->MountId;
+        eventContext->MajorFunction = DOKAN_IRP_LOG_MESSAGE;
+        logMessage =
+            (PDOKAN_LOG_MESSAGE)((PCHAR)eventContext + sizeof(EVENT_CONTEXT));
+      }
+      recordSize = DokanTraceRingRead(
+          ring, cursor, Vcb,
+          (PCHAR)logMessage->Records + logMessage->RecordsLength,
+          DOKAN_LOG_MESSAGE_RECORDS_SIZE - logMessage->RecordsLength);
+      if (!recordSize) {
+        break;
+      }
+      logMessage->RecordsLength +=
+          DOKAN_TRACE_RECORD_ALIGNED_SIZE(recordSize);
+      if (logMessage->RecordsLength + DOKAN_TRACE_RING_MAX_RECORD_SIZE >
+          DOKAN_LOG_MESSAGE_RECORDS_SIZE) {
+        // The next record might not fit.
+        SendDokanLogMessage(RequestContext, Vcb, eventContext, cursor);
+        eventContext = NULL;
+      }
     }
-    eventContext->MountId = Vcb->Dcb->MountId;
-    eventContext->MajorFunction = DOKAN_IRP_LOG_MESSAGE;
-    dokanLogString = (PDOKAN_LOG_MESSAGE)((PCHAR)(PCHAR)eventContext +
-                                          sizeof(EVENT_CONTEXT));
-    RtlCopyMemory(dokanLogString, &logEntry->Log, messageFullSize);
-    if (RequestContext) {
-      DokanEventNotification(RequestContext, &Vcb->Dcb->NotifyEvent,
-                             eventContext);
+    if (eventContext) {
+      SendDokanLogMessage(RequestContext, Vcb, eventContext, cursor);
     }
-
-    nextListEntry = listEntry->Flink;
-    RemoveEntryList(listEntry);
-    ExFreePool(logEntry);
-    --g_DokanLogEntryList.NumberOfCachedEntries;
-    listEntry = nextListEntry;
+    DokanTraceRingEndRead(cursor);
   }
 }
 
@@ -607,6 +678,20 @@ BOOLEAN IsLogCacheEnabled(_In_opt_ PVOID RequestContext) {
 }
 
 VOID IncrementVcbLogCacheCount() {
+  if (!g_DokanTraceRings) {
+    ULONG ringCount = KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    PDOKAN_TRACE_RING rings =
+        DokanAllocZero(sizeof(DOKAN_TRACE_RING) * ringCount);
+    if (!rings) {
+      DOKAN_NO_CACHE_LOG("Failed to allocate the trace rings");
+    } else {
+      g_DokanTraceRingCount = ringCount;
+      if (InterlockedCompareExchangePointer(&g_DokanTraceRings, rings, NULL) !=
+          NULL) {
+        ExFreePool(rings);
+      }
+    }
+  }
   InterlockedIncrement(&g_DokanVcbDriverLogCacheCount);
   if (!g_DokanDriverLogCacheEnabled) {
     g_DokanDriverLogCacheEnabled = TRUE;
@@ -614,10 +699,8 @@ VOID IncrementVcbLogCacheCount() {
 }
 
 VOID CleanDokanLogEntry(_In_ PVOID Vcb) {
-  PLIST_ENTRY listEntry;
-  PLIST_ENTRY nextListEntry;
-  PDOKAN_LOG_ENTRY logEntry;
   PDokanVCB vcb = Vcb;
+  PDOKAN_TRACE_RING rings = g_DokanTraceRings;
 
   PAGED_CODE();
 
@@ -627,24 +710,38 @@ VOID CleanDokanLogEntry(_In_ PVOID Vcb) {
 
   InterlockedDecrement(&g_DokanVcbDriverLogCacheCount);
 
-  __try {
-    DokanResourceLockRW(&(g_DokanLogEntryList.Resource));
-    listEntry = g_DokanLogEntryList.Log.Flink;
-    while (listEntry != &(g_DokanLogEntryList.Log)) {
-      logEntry = CONTAINING_RECORD(listEntry, DOKAN_LOG_ENTRY, ListEntry);
-
-      if (logEntry->Vcb != Vcb) {
-        listEntry = listEntry->Flink;
-        continue;
-      }
+  if (!rings) {
+    return;
+  }
+  for (ULONG i = 0; i < g_DokanTraceRingCount; ++i) {
+    DokanTraceRingRetireOwner(&rings[i], Vcb);
+  }
+}
 
-      nextListEntry = listEntry->Flink;
-      RemoveEntryList(listEntry);
-      ExFreePool(logEntry);
-      --g_DokanLogEntryList.NumberOfCachedEntries;
-      listEntry = nextListEntry;
-    }
-  } __finally {
-    DokanResourceUnlock(&(g_DokanLogEntryList.Resource));
+VOID DokanAllocateTraceCursors(_In_ PVOID Vcb) {
+  PDokanVCB vcb = Vcb;
+  if (!g_DokanTraceRings) {
+    return;
+  }
+  // The rings are never reallocated, so their count does not change.
+  vcb->TraceCursors =
+      DokanAllocZero(sizeof(DOKAN_TRACE_RING_CURSOR) * g_DokanTraceRingCount);
+  if (!vcb->TraceCursors) {
+    DOKAN_NO_CACHE_LOG("Failed to allocate the trace cursors");
+  }
+}
+
+VOID DokanFreeTraceCursors(_In_ PVOID Vcb) {
+  PDokanVCB vcb = Vcb;
+  if (vcb->TraceCursors) {
+    ExFreePool(vcb->TraceCursors);
+    vcb->TraceCursors = NULL;
+  }
+}
+
+VOID DokanDeleteTraceRings() {
+  if (g_DokanTraceRings) {
+    ExFreePool(g_DokanTraceRings);
+    g_DokanTraceRings = NULL;
   }
 }
@@ -32,28 +32,29 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 // Whether DbgPrint is enabled or not.
 extern ULONG g_Debug;
 
-typedef struct _DOKAN_LOG_ENTRY {
-  LIST_ENTRY ListEntry;
-  PVOID Vcb;
-  DOKAN_LOG_MESSAGE Log;
-} DOKAN_LOG_ENTRY, *PDOKAN_LOG_ENTRY;
-
-typedef struct _DOKAN_LOG_CACHE {
-  LONG NumberOfCachedEntries;
-  ERESOURCE Resource;
-  LIST_ENTRY Log;
-} DOKAN_LOG_CACHE, *PDOKAN_LOG_CACHE;
-
-// Global cache for driver global and specific volume logs.
-extern DOKAN_LOG_CACHE g_DokanLogEntryList;
-
-// Push log into the global log entry cache list.
+// Push log into the trace ring of the current processor.
 VOID PushDokanLogEntry(_In_opt_ PVOID RequestContext,
                        _In_ PCSTR Format, ...);
 
-// Remove all logs attached to a specific volume from the global cache.
+// Push a binary DOKAN_TRACE_RECORD of EventId into the trace ring of the
+// current processor. It is only formatted by the library.
+VOID PushDokanTraceRecord(_In_opt_ PVOID RequestContext, _In_ USHORT EventId,
+                          _In_ NTSTATUS Status, _In_ ULONG64 Arg0,
+                          _In_ ULONG64 Arg1, _In_ ULONG64 Arg2);
+
+// Release the logs attached to a specific volume from the trace rings.
 VOID CleanDokanLogEntry(_In_ PVOID Vcb);
 
+// Allocate the cursors with which the volume reads its logs from the trace
+// rings, when it dispatches the driver logs.
+VOID DokanAllocateTraceCursors(_In_ PVOID Vcb);
+
+// Free the cursors of the volume once its device is deleted.
+VOID DokanFreeTraceCursors(_In_ PVOID Vcb);
+
+// Free the trace rings on driver unload.
+VOID DokanDeleteTraceRings();
+
 // Whether the IRP log should be cached.
 // Used as an early check to unnecessary avoid computing the arguments when it
 // is not needed.
@@ -77,18 +78,9 @@ VOID IncrementVcbLogCacheCount();
 #define DokanQuerySystemTime KeQuerySystemTime
 #endif
 
+// The time of the log is recorded by the trace record.
 #define DOKAN_PUSH_LOG(RequestContext, Format, ...)                          \
-  {                                                                          \
-    LARGE_INTEGER SysTime;                                                   \
-    LARGE_INTEGER LocalTime;                                                 \
-    TIME_FIELDS TimeFields;                                                  \
-    DokanQuerySystemTime(&SysTime);                                          \
-    ExSystemTimeToLocalTime(&SysTime, &LocalTime);                           \
-    RtlTimeToTimeFields(&LocalTime, &TimeFields);                            \
-    PushDokanLogEntry(RequestContext, "[%02d:%02d:%02d.%03d]" Format,        \
-                      TimeFields.Hour, TimeFields.Minute, TimeFields.Second, \
-                      TimeFields.Milliseconds, __VA_ARGS__);                 \
-  }
+  { PushDokanLogEntry(RequestContext, Format, __VA_ARGS__); }
 
 // Log and push to the cache the log message
 #define DOKAN_CACHED_LOG(RequestContext, Format, ...)                  \
@@ -178,23 +170,64 @@ VOID IncrementVcbLogCacheCount();
                                RequestContext->IrpSp->MinorFunction),          \
       __VA_ARGS__)
 
+// Log and push to the cache a binary trace record. Format and its arguments
+// are only used for the debug print.
+#define DOKAN_CACHED_TRACE(RequestContext, EventId, Status, Arg0, Arg1, Arg2, \
+                           Format, ...)                                       \
+  {                                                                           \
+    KIRQL Kirql = KeGetCurrentIrql();                                         \
+    if (g_Debug) {                                                            \
+      DDbgPrint("[%d]" DOKAN_LOG_HEADER Format, Kirql, __VA_ARGS__)           \
+    }                                                                         \
+    if (Kirql == PASSIVE_LEVEL && IsLogCacheEnabled(RequestContext)) {        \
+      PushDokanTraceRecord(RequestContext, EventId, Status, (ULONG64)(Arg0),  \
+                           (ULONG64)(Arg1), (ULONG64)(Arg2));                 \
+    }                                                                         \
+  }
+
+// Binary counterpart of DOKAN_LOG_FINE_IRP.
+#define DOKAN_TRACE_FINE_IRP(RequestContext, EventId, Status, Arg0, Format,    \
+                             ...)                                              \
+  if (!RequestContext->DoNotLogActivity) {                                     \
+    DOKAN_CACHED_TRACE(RequestContext, EventId, Status, Arg0, 0, 0,            \
+                       "[%p]: " Format, RequestContext->Irp, __VA_ARGS__)      \
+  }
+
 // Log the Irp at dispatch time.
 #define DOKAN_LOG_BEGIN_MJ(RequestContext)                                     \
-  DOKAN_LOG_MJ_IRP(RequestContext, "Begin ProcessId=%lu",                      \
-                   RequestContext->ProcessId)
+  do {                                                                         \
+    PVOID dDeviceExtension = RequestContext->DeviceObject->DeviceExtension;    \
+    if (!RequestContext->DoNotLogActivity) {                                   \
+      DOKAN_CACHED_TRACE(                                                      \
+          RequestContext, DOKAN_TRACE_IRP_BEGIN, STATUS_SUCCESS,               \
+          RequestContext->IrpSp->MajorFunction,                                \
+          RequestContext->IrpSp->MinorFunction,                                \
+          (dDeviceExtension ? GetIdentifierType(dDeviceExtension) : 0),        \
+          "[%p][%s][%s][%s]: Begin ProcessId=%lu", RequestContext->Irp,        \
+          DokanGetIdTypeStr(dDeviceExtension),                                 \
+          DokanGetMajorFunctionStr(RequestContext->IrpSp->MajorFunction),      \
+          DokanGetMinorFunctionStr(RequestContext->IrpSp->MajorFunction,       \
+                                   RequestContext->IrpSp->MinorFunction),      \
+          RequestContext->ProcessId)                                           \
+    }                                                                          \
+  } while (0)
 
 // Log the Irp on exit of the dispatch.
 #define DOKAN_LOG_END_MJ(RequestContext, Status)                               \
   do {                                                                         \
     if (RequestContext->DoNotComplete) {                                       \
-      DOKAN_LOG_FINE_IRP(RequestContext, "End - Irp not completed %s",         \
-                         DokanGetNTSTATUSStr(Status));                         \
+      DOKAN_TRACE_FINE_IRP(RequestContext, DOKAN_TRACE_IRP_END_NOT_COMPLETED,  \
+                           Status, 0, "End - Irp not completed %s",            \
+                           DokanGetNTSTATUSStr(Status));                       \
     } else if (Status == STATUS_PENDING) {                                     \
-      DOKAN_LOG_FINE_IRP(RequestContext, "End - Irp is marked pending");       \
+      DOKAN_TRACE_FINE_IRP(RequestContext, DOKAN_TRACE_IRP_END_PENDING,        \
+                           Status, 0, "End - Irp is marked pending");          \
     } else {                                                                   \
-      DOKAN_LOG_FINE_IRP(RequestContext, "End - %s Information=%llx",          \
-                         DokanGetNTSTATUSStr(Status),                          \
-                         RequestContext->Irp->IoStatus.Information);           \
+      DOKAN_TRACE_FINE_IRP(RequestContext, DOKAN_TRACE_IRP_END, Status,        \
+                           RequestContext->Irp->IoStatus.Information,          \
+                           "End - %s Information=%llx",                        \
+                           DokanGetNTSTATUSStr(Status),                        \
+                           RequestContext->Irp->IoStatus.Information);         \
       DokanCompleteIrpRequest(RequestContext->Irp, Status);                    \
     }                                                                          \
   } while (0)
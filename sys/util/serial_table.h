@@ -0,0 +1,124 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SERIAL_TABLE_H_
+#define SERIAL_TABLE_H_
+
+// Table of objects keyed by a serial number, like the pending IRPs keyed by
+// the serial number of their event.
+//
+// Serial numbers are handed out by a monotonic counter, so the bucket of an
+// entry is the low bits of its serial number: the buckets work as a ring over
+// the latest serials and stay evenly filled, and insert, find and remove are
+// O(1) as long as fewer than DOKAN_SERIAL_TABLE_BUCKET_COUNT entries are
+// outstanding. When the entries of a table share their lowest serial number
+// bits, like when they are sharded by serial number, KeyShift skips those
+// bits. Entries are intrusive and the table does not allocate, nor
+// lock: the caller provides both.
+//
+// The header only relies on the base Windows types so that it can be built
+// outside of the kernel.
+
+// Must be a power of 2.
+#define DOKAN_SERIAL_TABLE_BUCKET_COUNT 512
+
+typedef struct _DOKAN_SERIAL_TABLE_LINK {
+  struct _DOKAN_SERIAL_TABLE_LINK* Next;
+  struct _DOKAN_SERIAL_TABLE_LINK* Prev;
+  ULONG SerialNumber;
+} DOKAN_SERIAL_TABLE_LINK, *PDOKAN_SERIAL_TABLE_LINK;
+
+typedef struct _DOKAN_SERIAL_TABLE {
+  // Circular lists whose heads are the buckets themselves.
+  DOKAN_SERIAL_TABLE_LINK Buckets[DOKAN_SERIAL_TABLE_BUCKET_COUNT];
+  ULONG Count;
+  // Number of low serial number bits ignored to pick the bucket.
+  ULONG KeyShift;
+} DOKAN_SERIAL_TABLE, *PDOKAN_SERIAL_TABLE;
+
+inline VOID DokanSerialTableInitializeLink(__out PDOKAN_SERIAL_TABLE_LINK Link) {
+  Link->Next = Link;
+  Link->Prev = Link;
+  Link->SerialNumber = 0;
+}
+
+inline BOOLEAN DokanSerialTableIsLinked(__in PDOKAN_SERIAL_TABLE_LINK Link) {
+  return Link->Next != Link;
+}
+
+inline VOID DokanSerialTableInitialize(__out PDOKAN_SERIAL_TABLE Table,
+                                       __in ULONG KeyShift) {
+  for (ULONG i = 0; i < DOKAN_SERIAL_TABLE_BUCKET_COUNT; ++i) {
+    DokanSerialTableInitializeLink(&Table->Buckets[i]);
+  }
+  Table->Count = 0;
+  Table->KeyShift = KeyShift;
+}
+
+inline PDOKAN_SERIAL_TABLE_LINK DokanSerialTableBucket(
+    __in PDOKAN_SERIAL_TABLE Table, __in ULONG SerialNumber) {
+  return &Table->Buckets[(SerialNumber >> Table->KeyShift) &
+                         (DOKAN_SERIAL_TABLE_BUCKET_COUNT - 1)];
+}
+
+// Adds Link to the table. The link must not be in a table already.
+inline VOID DokanSerialTableInsert(__inout PDOKAN_SERIAL_TABLE Table,
+                                   __inout PDOKAN_SERIAL_TABLE_LINK Link,
+                                   __in ULONG SerialNumber) {
+  PDOKAN_SERIAL_TABLE_LINK bucket =
+      DokanSerialTableBucket(Table, SerialNumber);
+  Link->SerialNumber = SerialNumber;
+  // Newer serials are inserted last so the oldest entries, the most likely
+  // to complete next, are found first.
+  Link->Next = bucket;
+  Link->Prev = bucket->Prev;
+  bucket->Prev->Next = Link;
+  bucket->Prev = Link;
+  ++Table->Count;
+}
+
+// Removes Link from the table. Does nothing if it is not in it.
+inline VOID DokanSerialTableRemove(__inout PDOKAN_SERIAL_TABLE Table,
+                                   __inout PDOKAN_SERIAL_TABLE_LINK Link) {
+  if (!DokanSerialTableIsLinked(Link)) {
+    return;
+  }
+  Link->Prev->Next = Link->Next;
+  Link->Next->Prev = Link->Prev;
+  Link->Next = Link;
+  Link->Prev = Link;
+  --Table->Count;
+}
+
+// Returns the link inserted with SerialNumber or NULL.
+inline PDOKAN_SERIAL_TABLE_LINK DokanSerialTableFind(
+    __in PDOKAN_SERIAL_TABLE Table, __in ULONG SerialNumber) {
+  PDOKAN_SERIAL_TABLE_LINK bucket =
+      DokanSerialTableBucket(Table, SerialNumber);
+  for (PDOKAN_SERIAL_TABLE_LINK link = bucket->Next; link != bucket;
+       link = link->Next) {
+    if (link->SerialNumber == SerialNumber) {
+      return link;
+    }
+  }
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,229 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+// Hierarchical timer wheel tracking deadlines expressed in abstract time
+// units.
+//
+// Level L has DOKAN_TIMER_WHEEL_SLOT_COUNT slots each covering
+// DOKAN_TIMER_WHEEL_SLOT_COUNT^L units. An entry is put in the lowest level
+// able to hold its distance to the current time. When the current time enters
+// a new slot of a higher level, the entries of that slot are cascaded down to
+// the lower levels. Entries therefore reach level 0 right before expiring, and
+// advancing the wheel only touches the entries that expire or cascade instead
+// of all of them.
+//
+// Entries are intrusive and the table does not allocate, nor lock: the caller
+// provides both. The header only relies on the base Windows types so that it
+// can be built outside of the kernel.
+
+#define DOKAN_TIMER_WHEEL_SLOT_BITS 6
+#define DOKAN_TIMER_WHEEL_SLOT_COUNT (1 << DOKAN_TIMER_WHEEL_SLOT_BITS)
+#define DOKAN_TIMER_WHEEL_SLOT_MASK (DOKAN_TIMER_WHEEL_SLOT_COUNT - 1)
+#define DOKAN_TIMER_WHEEL_LEVEL_COUNT 4
+// Largest distance to the current time a deadline can be put at. Farther
+// deadlines are put at this distance and put back in the wheel when reached.
+#define DOKAN_TIMER_WHEEL_MAX_DISTANCE                                         \
+  ((1ULL << (DOKAN_TIMER_WHEEL_SLOT_BITS * DOKAN_TIMER_WHEEL_LEVEL_COUNT)) - 1)
+
+typedef struct _DOKAN_TIMER_WHEEL_LINK {
+  struct _DOKAN_TIMER_WHEEL_LINK* Next;
+  struct _DOKAN_TIMER_WHEEL_LINK* Prev;
+  ULONGLONG Deadline;
+} DOKAN_TIMER_WHEEL_LINK, *PDOKAN_TIMER_WHEEL_LINK;
+
+typedef struct _DOKAN_TIMER_WHEEL {
+  // Circular lists whose heads are the slots themselves.
+  DOKAN_TIMER_WHEEL_LINK Slots[DOKAN_TIMER_WHEEL_LEVEL_COUNT]
+                              [DOKAN_TIMER_WHEEL_SLOT_COUNT];
+  // Next time unit to process. Every deadline before it has expired.
+  ULONGLONG Now;
+  ULONG Count;
+} DOKAN_TIMER_WHEEL, *PDOKAN_TIMER_WHEEL;
+
+// Also used to initialize the list heads receiving the expired entries.
+inline VOID DokanTimerWheelInitializeLink(__out PDOKAN_TIMER_WHEEL_LINK Link) {
+  Link->Next = Link;
+  Link->Prev = Link;
+  Link->Deadline = 0;
+}
+
+inline BOOLEAN DokanTimerWheelIsLinked(__in PDOKAN_TIMER_WHEEL_LINK Link) {
+  return Link->Next != Link;
+}
+
+inline VOID DokanTimerWheelInitialize(__out PDOKAN_TIMER_WHEEL Wheel,
+                                      __in ULONGLONG Now) {
+  for (ULONG level = 0; level < DOKAN_TIMER_WHEEL_LEVEL_COUNT; ++level) {
+    for (ULONG slot = 0; slot < DOKAN_TIMER_WHEEL_SLOT_COUNT; ++slot) {
+      DokanTimerWheelInitializeLink(&Wheel->Slots[level][slot]);
+    }
+  }
+  Wheel->Now = Now;
+  Wheel->Count = 0;
+}
+
+inline VOID DokanTimerWheelAppend(__inout PDOKAN_TIMER_WHEEL_LINK Head,
+                                  __inout PDOKAN_TIMER_WHEEL_LINK Link) {
+  Link->Next = Head;
+  Link->Prev = Head->Prev;
+  Head->Prev->Next = Link;
+  Head->Prev = Link;
+}
+
+inline VOID DokanTimerWheelUnlink(__inout PDOKAN_TIMER_WHEEL_LINK Link) {
+  Link->Prev->Next = Link->Next;
+  Link->Next->Prev = Link->Prev;
+  Link->Next = Link;
+  Link->Prev = Link;
+}
+
+// Puts Link in its slot according to its deadline and the current time.
+inline VOID DokanTimerWheelPlace(__inout PDOKAN_TIMER_WHEEL Wheel,
+                                 __inout PDOKAN_TIMER_WHEEL_LINK Link) {
+  ULONGLONG key = Link->Deadline;
+  ULONGLONG distance;
+  ULONG level = 0;
+  if (key < Wheel->Now) {
+    key = Wheel->Now;
+  } else if (key - Wheel->Now > DOKAN_TIMER_WHEEL_MAX_DISTANCE) {
+    key = Wheel->Now + DOKAN_TIMER_WHEEL_MAX_DISTANCE;
+  }
+  distance = key - Wheel->Now;
+  while (level + 1 < DOKAN_TIMER_WHEEL_LEVEL_COUNT &&
+         distance >> (DOKAN_TIMER_WHEEL_SLOT_BITS * (level + 1))) {
+    ++level;
+  }
+  DokanTimerWheelAppend(
+      &Wheel->Slots[level][(key >> (DOKAN_TIMER_WHEEL_SLOT_BITS * level)) &
+                           DOKAN_TIMER_WHEEL_SLOT_MASK],
+      Link);
+}
+
+// Adds Link to the wheel, expiring at Deadline. The link must not be in the
+// wheel already.
+inline VOID DokanTimerWheelInsert(__inout PDOKAN_TIMER_WHEEL Wheel,
+                                  __inout PDOKAN_TIMER_WHEEL_LINK Link,
+                                  __in ULONGLONG Deadline) {
+  Link->Deadline = Deadline;
+  DokanTimerWheelPlace(Wheel, Link);
+  ++Wheel->Count;
+}
+
+// Removes Link from the wheel. Does nothing if it is not in it.
+inline VOID DokanTimerWheelRemove(__inout PDOKAN_TIMER_WHEEL Wheel,
+                                  __inout PDOKAN_TIMER_WHEEL_LINK Link) {
+  if (!DokanTimerWheelIsLinked(Link)) {
+    return;
+  }
+  DokanTimerWheelUnlink(Link);
+  --Wheel->Count;
+}
+
+// Moves the time to Now + 1 by placing every entry again. Used instead of
+// processing each time unit when more have elapsed than there are entries.
+inline VOID DokanTimerWheelRebuild(__inout PDOKAN_TIMER_WHEEL Wheel,
+                                   __in ULONGLONG Now,
+                                   __inout PDOKAN_TIMER_WHEEL_LINK Expired) {
+  DOKAN_TIMER_WHEEL_LINK entries;
+  DokanTimerWheelInitializeLink(&entries);
+  for (ULONG level = 0; level < DOKAN_TIMER_WHEEL_LEVEL_COUNT; ++level) {
+    for (ULONG slot = 0; slot < DOKAN_TIMER_WHEEL_SLOT_COUNT; ++slot) {
+      PDOKAN_TIMER_WHEEL_LINK head = &Wheel->Slots[level][slot];
+      while (head->Next != head) {
+        PDOKAN_TIMER_WHEEL_LINK link = head->Next;
+        DokanTimerWheelUnlink(link);
+        DokanTimerWheelAppend(&entries, link);
+      }
+    }
+  }
+  Wheel->Now = Now + 1;
+  while (entries.Next != &entries) {
+    PDOKAN_TIMER_WHEEL_LINK link = entries.Next;
+    DokanTimerWheelUnlink(link);
+    if (link->Deadline <= Now) {
+      DokanTimerWheelAppend(Expired, link);
+      --Wheel->Count;
+    } else {
+      DokanTimerWheelPlace(Wheel, link);
+    }
+  }
+}
+
+// Processes the time units up to Now included. The entries whose deadline
+// is reached are moved to the Expired list and are no longer in the wheel.
+inline VOID DokanTimerWheelAdvance(__inout PDOKAN_TIMER_WHEEL Wheel,
+                                   __in ULONGLONG Now,
+                                   __inout PDOKAN_TIMER_WHEEL_LINK Expired) {
+  if (Now < Wheel->Now) {
+    return;
+  }
+  if (Wheel->Count == 0) {
+    Wheel->Now = Now + 1;
+    return;
+  }
+  // After a long pause, like a system sleep, processing each elapsed unit
+  // would cost more than placing every entry again.
+  if (Now - Wheel->Now >= (ULONGLONG)Wheel->Count +
+                              DOKAN_TIMER_WHEEL_LEVEL_COUNT *
+                                  DOKAN_TIMER_WHEEL_SLOT_COUNT) {
+    DokanTimerWheelRebuild(Wheel, Now, Expired);
+    return;
+  }
+  for (; Wheel->Now <= Now; ++Wheel->Now) {
+    PDOKAN_TIMER_WHEEL_LINK slot;
+    // Cascade the slots of the higher levels the current time just entered.
+    ULONG level = 0;
+    while (level + 1 < DOKAN_TIMER_WHEEL_LEVEL_COUNT &&
+           (Wheel->Now &
+            ((1ULL << (DOKAN_TIMER_WHEEL_SLOT_BITS * (level + 1))) - 1)) == 0) {
+      ++level;
+    }
+    for (; level > 0; --level) {
+      slot = &Wheel->Slots[level][(Wheel->Now >>
+                                   (DOKAN_TIMER_WHEEL_SLOT_BITS * level)) &
+                                  DOKAN_TIMER_WHEEL_SLOT_MASK];
+      while (slot->Next != slot) {
+        PDOKAN_TIMER_WHEEL_LINK link = slot->Next;
+        DokanTimerWheelUnlink(link);
+        DokanTimerWheelPlace(Wheel, link);
+      }
+    }
+    slot = &Wheel->Slots[0][Wheel->Now & DOKAN_TIMER_WHEEL_SLOT_MASK];
+    while (slot->Next != slot) {
+      PDOKAN_TIMER_WHEEL_LINK link = slot->Next;
+      DokanTimerWheelUnlink(link);
+      if (link->Deadline > Wheel->Now) {
+        // Deadline farther than the wheel can hold.
+        DokanTimerWheelPlace(Wheel, link);
+        continue;
+      }
+      DokanTimerWheelAppend(Expired, link);
+      --Wheel->Count;
+    }
+    if (Wheel->Count == 0) {
+      Wheel->Now = Now;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,258 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TRACE_RING_H_
+#define TRACE_RING_H_
+
+// Lock-free ring of DOKAN_TRACE_RECORD entries.
+//
+// Writers reserve consecutive slots with a single interlocked add on Head and
+// never wait: the oldest slots are overwritten once the ring is full. Each
+// slot carries the sequence number it was last written with, which lets the
+// readers detect the slots that are still being written and the ones that
+// were overwritten while they were reading them. A record too large for one
+// slot spans several consecutive ones.
+//
+// Records can be owned by a volume. Each owner reads the ring with a cursor of
+// its own, which skips the records of the other owners so that they never
+// hold it back. Global records are taken by the first reader that reaches
+// them. Owners are only compared and never dereferenced.
+//
+// The ring does not allocate and must be zero initialized, like the cursors.
+// The header only relies on the base Windows types so that it can be built
+// outside of the kernel.
+
+// The ring of a processor holds the 1024 dispatch records that the global log
+// list used to keep at most, text records take up to 5 slots.
+#define DOKAN_TRACE_RING_SLOT_BITS 10
+#define DOKAN_TRACE_RING_SLOT_COUNT (1 << DOKAN_TRACE_RING_SLOT_BITS)
+#define DOKAN_TRACE_RING_SLOT_MASK (DOKAN_TRACE_RING_SLOT_COUNT - 1)
+#define DOKAN_TRACE_RING_SLOT_DATA_SIZE 104
+// Largest record that can be written to the ring.
+#define DOKAN_TRACE_RING_MAX_RECORD_SIZE 512
+
+// Owner of the records nobody reads anymore: the ones of a volume that is
+// gone and the global ones already taken by a reader.
+#define DOKAN_TRACE_RING_RETIRED_OWNER ((PVOID)(ULONG_PTR)1)
+
+typedef struct _DOKAN_TRACE_RING_SLOT {
+  // Index + 1 of the slot in the ring once written, 0 while being written.
+  volatile LONG64 Sequence;
+  PVOID volatile Owner;
+  // Number of slots used by the record, and index of this one among them.
+  USHORT RecordSlots;
+  USHORT Position;
+  UCHAR Data[DOKAN_TRACE_RING_SLOT_DATA_SIZE];
+} DOKAN_TRACE_RING_SLOT, *PDOKAN_TRACE_RING_SLOT;
+
+typedef struct _DOKAN_TRACE_RING {
+  // Index of the next slot to write.
+  volatile LONG64 Head;
+  DOKAN_TRACE_RING_SLOT Slots[DOKAN_TRACE_RING_SLOT_COUNT];
+} DOKAN_TRACE_RING, *PDOKAN_TRACE_RING;
+
+// Position of an owner in a ring.
+typedef struct _DOKAN_TRACE_RING_CURSOR {
+  // Index of the next slot to read.
+  LONG64 Tail;
+  // Slots overwritten before the cursor reached them, whatever their owner.
+  ULONG Dropped;
+  volatile LONG Reading;
+} DOKAN_TRACE_RING_CURSOR, *PDOKAN_TRACE_RING_CURSOR;
+
+inline USHORT DokanTraceRingSlotsFor(__in ULONG RecordSize) {
+  return (USHORT)((RecordSize + DOKAN_TRACE_RING_SLOT_DATA_SIZE - 1) /
+                  DOKAN_TRACE_RING_SLOT_DATA_SIZE);
+}
+
+// Returns whether the slot of the given index, which holds the given sequence
+// number, is yet to be written by the writer that reserved it: the sequence is
+// 0 while being written and the one of the previous turn of the ring before.
+// Other sequence numbers are left by writers that fell a turn behind.
+inline BOOLEAN DokanTraceRingIsPending(__in LONG64 Sequence,
+                                       __in LONG64 Index) {
+  return Sequence == 0 || Sequence == Index + 1 - DOKAN_TRACE_RING_SLOT_COUNT;
+}
+
+// Writes the record of RecordSize bytes. Can be called concurrently by any
+// number of writers.
+inline VOID DokanTraceRingWrite(__in PDOKAN_TRACE_RING Ring,
+                                __in_opt PVOID Owner,
+                                __in const VOID* Record,
+                                __in ULONG RecordSize) {
+  USHORT recordSlots = DokanTraceRingSlotsFor(RecordSize);
+  LONG64 index = InterlockedExchangeAdd64(&Ring->Head, recordSlots);
+  for (USHORT i = 0; i < recordSlots; ++i) {
+    PDOKAN_TRACE_RING_SLOT slot =
+        &Ring->Slots[(index + i) & DOKAN_TRACE_RING_SLOT_MASK];
+    ULONG offset = i * DOKAN_TRACE_RING_SLOT_DATA_SIZE;
+    ULONG chunk = RecordSize - offset;
+    if (chunk > DOKAN_TRACE_RING_SLOT_DATA_SIZE) {
+      chunk = DOKAN_TRACE_RING_SLOT_DATA_SIZE;
+    }
+    InterlockedExchange64(&slot->Sequence, 0);
+    slot->Owner = Owner;
+    slot->RecordSlots = recordSlots;
+    slot->Position = i;
+    RtlCopyMemory(slot->Data, (const UCHAR*)Record + offset, chunk);
+    InterlockedExchange64(&slot->Sequence, index + i + 1);
+  }
+}
+
+// Only one reader can use a cursor at a time. Returns FALSE when another one
+// is reading with it.
+inline BOOLEAN DokanTraceRingTryBeginRead(
+    __in PDOKAN_TRACE_RING_CURSOR Cursor) {
+  return InterlockedCompareExchange(&Cursor->Reading, 1, 0) == 0;
+}
+
+inline VOID DokanTraceRingEndRead(__in PDOKAN_TRACE_RING_CURSOR Cursor) {
+  InterlockedExchange(&Cursor->Reading, 0);
+}
+
+// Returns whether the cursor reached the last record written to the ring.
+inline BOOLEAN DokanTraceRingIsEmpty(__in PDOKAN_TRACE_RING Ring,
+                                     __in PDOKAN_TRACE_RING_CURSOR Cursor) {
+  return Cursor->Tail == InterlockedCompareExchange64(&Ring->Head, 0, 0);
+}
+
+// Copies the next record that is global or owned by Owner to Buffer and
+// returns its size, skipping the records of other owners. Returns 0 when there
+// is no such record to read yet or when it does not fit in BufferSize bytes.
+// Must be called between DokanTraceRingTryBeginRead and
+// DokanTraceRingEndRead.
+inline ULONG DokanTraceRingRead(__in PDOKAN_TRACE_RING Ring,
+                                __in PDOKAN_TRACE_RING_CURSOR Cursor,
+                                __in_opt PVOID Owner,
+                                __out_bcount(BufferSize) VOID* Buffer,
+                                __in ULONG BufferSize) {
+  for (;;) {
+    LONG64 head = InterlockedCompareExchange64(&Ring->Head, 0, 0);
+    LONG64 tail = Cursor->Tail;
+    if (tail >= head) {
+      return 0;
+    }
+    if (head - tail > DOKAN_TRACE_RING_SLOT_COUNT) {
+      Cursor->Dropped += (ULONG)(head - tail - DOKAN_TRACE_RING_SLOT_COUNT);
+      tail = head - DOKAN_TRACE_RING_SLOT_COUNT;
+      Cursor->Tail = tail;
+    }
+
+    PDOKAN_TRACE_RING_SLOT first =
+        &Ring->Slots[tail & DOKAN_TRACE_RING_SLOT_MASK];
+    LONG64 sequence = InterlockedCompareExchange64(&first->Sequence, 0, 0);
+    if (sequence != tail + 1) {
+      if (head - tail < DOKAN_TRACE_RING_SLOT_COUNT &&
+          DokanTraceRingIsPending(sequence, tail)) {
+        // Still being written.
+        return 0;
+      }
+      // Overwritten, or torn by two writers a full ring apart.
+      ++Cursor->Dropped;
+      Cursor->Tail = tail + 1;
+      continue;
+    }
+    if (first->Position != 0) {
+      // Remainder of a record whose beginning was overwritten.
+      Cursor->Tail = tail + 1;
+      continue;
+    }
+    USHORT recordSlots = first->RecordSlots;
+    if (recordSlots == 0 ||
+        recordSlots >
+            DokanTraceRingSlotsFor(DOKAN_TRACE_RING_MAX_RECORD_SIZE)) {
+      ++Cursor->Dropped;
+      Cursor->Tail = tail + 1;
+      continue;
+    }
+    PVOID owner = first->Owner;
+    if (owner != NULL && owner != Owner) {
+      // Retired or read by another cursor.
+      Cursor->Tail = tail + recordSlots;
+      continue;
+    }
+
+    ULONG recordSize = *(const USHORT*)first->Data;
+    if (recordSlots != DokanTraceRingSlotsFor(recordSize) ||
+        recordSize > DOKAN_TRACE_RING_MAX_RECORD_SIZE) {
+      ++Cursor->Dropped;
+      Cursor->Tail = tail + 1;
+      continue;
+    }
+    if (recordSize > BufferSize) {
+      return 0;
+    }
+    BOOLEAN torn = FALSE;
+    for (USHORT i = 0; i < recordSlots && !torn; ++i) {
+      PDOKAN_TRACE_RING_SLOT slot =
+          &Ring->Slots[(tail + i) & DOKAN_TRACE_RING_SLOT_MASK];
+      ULONG offset = i * DOKAN_TRACE_RING_SLOT_DATA_SIZE;
+      ULONG chunk = recordSize - offset;
+      if (chunk > DOKAN_TRACE_RING_SLOT_DATA_SIZE) {
+        chunk = DOKAN_TRACE_RING_SLOT_DATA_SIZE;
+      }
+      sequence = InterlockedCompareExchange64(&slot->Sequence, 0, 0);
+      if (head - tail < DOKAN_TRACE_RING_SLOT_COUNT &&
+          DokanTraceRingIsPending(sequence, tail + i)) {
+        // The end of the record is still being written.
+        return 0;
+      }
+      RtlCopyMemory((UCHAR*)Buffer + offset, slot->Data, chunk);
+      torn = sequence != tail + i + 1 ||
+             InterlockedCompareExchange64(&slot->Sequence, 0, 0) != sequence;
+    }
+    if (torn) {
+      ++Cursor->Dropped;
+      Cursor->Tail = tail + 1;
+      continue;
+    }
+    Cursor->Tail = tail + recordSlots;
+    if (owner == NULL) {
+      // Take the global record from the other cursors. A writer may have
+      // reused the slot meanwhile, the owner of its record is then restored.
+      owner = InterlockedCompareExchangePointer(
+          &first->Owner, DOKAN_TRACE_RING_RETIRED_OWNER, NULL);
+      if (owner == DOKAN_TRACE_RING_RETIRED_OWNER) {
+        // Taken by another cursor.
+        continue;
+      }
+      if (owner == NULL &&
+          InterlockedCompareExchange64(&first->Sequence, 0, 0) != tail + 1) {
+        InterlockedCompareExchangePointer(
+            &first->Owner, NULL, DOKAN_TRACE_RING_RETIRED_OWNER);
+      }
+    }
+    return recordSize;
+  }
+}
+
+// Marks the records of Owner as no longer owned by anyone, so that a later
+// owner at the same address does not read them. Called once the owner is
+// gone.
+inline VOID DokanTraceRingRetireOwner(__in PDOKAN_TRACE_RING Ring,
+                                      __in PVOID Owner) {
+  for (ULONG i = 0; i < DOKAN_TRACE_RING_SLOT_COUNT; ++i) {
+    InterlockedCompareExchangePointer(&Ring->Slots[i].Owner,
+                                      DOKAN_TRACE_RING_RETIRED_OWNER, Owner);
+  }
+}
+
+#endif  // TRACE_RING_H_
@@ -21,6 +21,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "dokan.h"
+#include "util/fcb.h"
 
 NTSTATUS
 DokanDispatchWrite(__in PREQUEST_CONTEXT RequestContext) {
@@ -28,6 +29,7 @@ DokanDispatchWrite(__in PREQUEST_CONTEXT RequestContext) {
   NTSTATUS status = STATUS_INVALID_PARAMETER;
   PEVENT_CONTEXT eventContext;
   ULONG eventLength;
+  USHORT fileNameLength;
   PDokanCCB ccb;
   PDokanFCB fcb = NULL;
   PVOID buffer;
@@ -135,13 +137,13 @@ DokanDispatchWrite(__in PREQUEST_CONTEXT RequestContext) {
     DokanFCBLockRO(fcb);
     fcbLocked = TRUE;
 
+    fileNameLength = DokanGetIoEventFileNameLength(RequestContext->Dcb, ccb);
     LARGE_INTEGER safeEventLength;
     safeEventLength.QuadPart =
         sizeof(EVENT_CONTEXT) + RequestContext->IrpSp->Parameters.Write.Length +
-                  fcb->FileName.Length;
+                  fileNameLength;
     if (safeEventLength.HighPart != 0 ||
-        safeEventLength.QuadPart <
-            sizeof(EVENT_CONTEXT) + fcb->FileName.Length) {
+        safeEventLength.QuadPart < sizeof(EVENT_CONTEXT) + fileNameLength) {
       DokanLogError(&logger,
                     STATUS_INVALID_PARAMETER,
                     L"Write with unsupported total size: %I64u",
@@ -208,7 +210,7 @@ DokanDispatchWrite(__in PREQUEST_CONTEXT RequestContext) {
     // the contents to write will be copyed to this offset
     eventContext->Operation.Write.BufferOffset =
         FIELD_OFFSET(EVENT_CONTEXT, Operation.Write.FileName[0]) +
-        fcb->FileName.Length + sizeof(WCHAR); // adds last null char
+        fileNameLength + sizeof(WCHAR); // adds last null char
 
     // copies the content to write to EventContext
     RtlCopyMemory((PCHAR)eventContext +
@@ -216,9 +218,9 @@ DokanDispatchWrite(__in PREQUEST_CONTEXT RequestContext) {
         buffer, RequestContext->IrpSp->Parameters.Write.Length);
 
     // copies file name
-    eventContext->Operation.Write.FileNameLength = fcb->FileName.Length;
+    eventContext->Operation.Write.FileNameLength = fileNameLength;
     RtlCopyMemory(eventContext->Operation.Write.FileName, fcb->FileName.Buffer,
-                  fcb->FileName.Length);
+                  fileNameLength);
 
     // When eventlength is less than event notification buffer,
     // returns it to user-mode using pending event.